@@ -0,0 +1,295 @@
+/***********************************************************************
+DepthDecodeBenchmark - Utility to measure the decompression throughput of
+recorded losslessly compressed depth frame files.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <Misc/SizedTypes.h>
+#include <Misc/Timer.h>
+#include <Misc/Marshaller.h>
+#include <IO/File.h>
+#include <IO/SeekableFile.h>
+#include <IO/FixedMemoryFile.h>
+#include <IO/VariableMemoryFile.h>
+#include <IO/OpenFile.h>
+#include <Math/Constants.h>
+#include <Geometry/GeometryMarshallers.h>
+#include <Kinect/FrameBuffer.h>
+#include <Kinect/FrameSource.h>
+#include <Kinect/DepthFrameReader.h>
+#include <Kinect/DepthFrameWriter.h>
+
+/**************
+Helper classes:
+**************/
+
+class FrameComparer // Class to compare a re-compressed depth frame against its original compressed representation
+	{
+	/* Elements: */
+	private:
+	const Misc::UInt8* original; // Pointer to the original compressed frame data not yet compared
+	size_t originalSize; // Amount of original compressed frame data not yet compared
+	bool equal; // Flag whether all data compared so far was identical
+	
+	/* Constructors and destructors: */
+	public:
+	FrameComparer(const Misc::UInt8* sOriginal,size_t sOriginalSize)
+		:original(sOriginal),originalSize(sOriginalSize),
+		 equal(true)
+		{
+		}
+	
+	/* Methods: */
+	void writeRaw(const void* data,size_t dataSize) // Compares the given data against the next piece of original data
+		{
+		if(dataSize>originalSize||memcmp(data,original,dataSize)!=0)
+			equal=false;
+		else
+			{
+			original+=dataSize;
+			originalSize-=dataSize;
+			}
+		}
+	bool isEqual(void) const // Returns true if the re-compressed frame was identical to the original
+		{
+		return equal&&originalSize==0;
+		}
+	};
+
+/****************
+Helper functions:
+****************/
+
+bool skipDepthFileHeader(IO::File& depthFile) // Skips the header of a depth frame file; returns true if the depth stream is losslessly compressed
+	{
+	/* Read the file's format version number: */
+	Misc::UInt32 fileFormatVersion=depthFile.read<Misc::UInt32>();
+	
+	/* Skip the depth correction parameters: */
+	if(fileFormatVersion>=4)
+		Kinect::FrameSource::DepthCorrection depthCorrection(depthFile);
+	else if(fileFormatVersion>=2&&depthFile.read<Misc::UInt8>()!=0)
+		{
+		Misc::SInt32 size[2];
+		depthFile.read<Misc::SInt32>(size,2);
+		depthFile.skip<Misc::Float32>(size[1]*size[0]*2);
+		}
+	
+	/* Check if the depth stream uses lossy compression: */
+	bool depthIsLossy=fileFormatVersion>=3&&depthFile.read<Misc::UInt8>()!=0;
+	
+	/* Skip the depth camera's lens distortion correction parameters: */
+	if(fileFormatVersion>=5)
+		{
+		Kinect::LensDistortion lensDistortion;
+		lensDistortion.read(depthFile);
+		}
+	
+	/* Skip the depth projection and the camera transformation: */
+	Misc::Marshaller<Kinect::FrameSource::IntrinsicParameters::PTransform>::read(depthFile);
+	Misc::Marshaller<Kinect::FrameSource::ExtrinsicParameters>::read(depthFile);
+	
+	return !depthIsLossy;
+	}
+
+void printUsage(void)
+	{
+	std::cout<<"Usage: DepthDecodeBenchmark [-passes <number of passes>] [-threads <number of threads>] [-verify] <depth file name> [<depth file name> ...]"<<std::endl;
+	std::cout<<"  -passes <number of passes>"<<std::endl;
+	std::cout<<"     Decodes each depth file the given number of times and reports the"<<std::endl;
+	std::cout<<"     best pass. Default: 3"<<std::endl;
+	std::cout<<"  -threads <number of threads>"<<std::endl;
+	std::cout<<"     Decodes the tiles of depth files using the tiled depth codec on the"<<std::endl;
+	std::cout<<"     given number of threads. Default: 1"<<std::endl;
+	std::cout<<"  -verify"<<std::endl;
+	std::cout<<"     Re-compresses every decoded frame and checks that it is bit-identical"<<std::endl;
+	std::cout<<"     to the frame's original compressed representation"<<std::endl;
+	std::cout<<"  Depth file names are either full names of .depth files, or prefixes of"<<std::endl;
+	std::cout<<"  recorded .color/.depth file pairs"<<std::endl;
+	}
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	unsigned int numPasses=3;
+	unsigned int numThreads=1;
+	bool verify=false;
+	std::vector<std::string> depthFileNames;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"passes")==0)
+				{
+				++i;
+				if(i<argc)
+					numPasses=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"threads")==0)
+				{
+				++i;
+				if(i<argc)
+					numThreads=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"verify")==0)
+				verify=true;
+			else if(strcasecmp(argv[i]+1,"h")==0)
+				{
+				printUsage();
+				return 0;
+				}
+			else
+				std::cerr<<"Ignoring unrecognized command line option "<<argv[i]<<std::endl;
+			}
+		else
+			{
+			/* Append the depth file extension if the name is a file name prefix: */
+			std::string depthFileName=argv[i];
+			if(depthFileName.size()<6||depthFileName.compare(depthFileName.size()-6,6,".depth")!=0)
+				depthFileName.append(".depth");
+			depthFileNames.push_back(depthFileName);
+			}
+		}
+	if(depthFileNames.empty()||numPasses==0)
+		{
+		printUsage();
+		return 1;
+		}
+	
+	/* Benchmark all depth files: */
+	int result=0;
+	for(std::vector<std::string>::iterator dfnIt=depthFileNames.begin();dfnIt!=depthFileNames.end();++dfnIt)
+		{
+		try
+			{
+			/* Read the entire depth file into memory to exclude file I/O from the measurements: */
+			IO::SeekableFilePtr depthFile(IO::openSeekableFile(dfnIt->c_str()));
+			depthFile->setEndianness(Misc::LittleEndian);
+			if(!skipDepthFileHeader(*depthFile))
+				{
+				std::cerr<<"Skipping lossily compressed depth file "<<*dfnIt<<std::endl;
+				continue;
+				}
+			size_t streamSize=size_t(depthFile->getSize()-depthFile->getReadPos());
+			IO::FixedMemoryFile stream(streamSize);
+			depthFile->readRaw(stream.getMemory(),streamSize);
+			depthFile=0;
+			stream.setEndianness(Misc::LittleEndian);
+			const Misc::UInt8* streamData=static_cast<const Misc::UInt8*>(static_cast<const IO::FixedMemoryFile&>(stream).getMemory());
+			
+			/* Decode the depth stream the requested number of times: */
+			double bestTime=Math::Constants<double>::max;
+			unsigned int numFrames=0;
+			unsigned int numTiles=0;
+			unsigned int numMismatches=0;
+			size_t frameSize=0;
+			for(unsigned int pass=0;pass<numPasses;++pass)
+				{
+				/* Rewind the in-memory depth stream and create a depth frame reader for it: */
+				stream.setReadDataSize(streamSize);
+				Misc::Timer decodeTimer;
+				Kinect::DepthFrameReader depthFrameReader(stream);
+				depthFrameReader.setNumDecodingThreads(numThreads);
+				numTiles=depthFrameReader.getNumTiles();
+				
+				/* Decode all frames: */
+				const unsigned int* size=depthFrameReader.getSize();
+				frameSize=size_t(size[0])*size_t(size[1])*sizeof(Kinect::FrameSource::DepthPixel);
+				numFrames=0;
+				while(true)
+					{
+					Kinect::FrameBuffer frame=depthFrameReader.readNextFrame();
+					if(frame.timeStamp==Math::Constants<double>::max)
+						break;
+					++numFrames;
+					}
+				decodeTimer.elapse();
+				if(bestTime>decodeTimer.getTime())
+					bestTime=decodeTimer.getTime();
+				}
+			
+			if(verify)
+				{
+				/* Decode the depth stream again, tracking where each compressed frame starts and ends: */
+				stream.setReadDataSize(streamSize);
+				Kinect::DepthFrameReader depthFrameReader(stream);
+				
+				/* Create a depth frame writer writing into a memory buffer: */
+				IO::VariableMemoryFile recompressed;
+				recompressed.setEndianness(Misc::LittleEndian);
+				Kinect::DepthFrameWriter depthFrameWriter(recompressed,depthFrameReader.getSize(),depthFrameReader.getNumTiles());
+				
+				size_t frameStart=size_t(stream.getReadPos());
+				for(unsigned int frameIndex=0;true;++frameIndex)
+					{
+					Kinect::FrameBuffer frame=depthFrameReader.readNextFrame();
+					if(frame.timeStamp==Math::Constants<double>::max)
+						break;
+					size_t frameEnd=size_t(stream.getReadPos());
+					
+					/* Re-compress the decoded frame and compare it to the original: */
+					recompressed.clear();
+					depthFrameWriter.writeFrame(frame);
+					FrameComparer comparer(streamData+frameStart,frameEnd-frameStart);
+					recompressed.writeToSink(comparer);
+					if(!comparer.isEqual())
+						{
+						std::cerr<<"Frame "<<frameIndex<<" of depth file "<<*dfnIt<<" does not round-trip"<<std::endl;
+						++numMismatches;
+						}
+					
+					frameStart=frameEnd;
+					}
+				}
+			
+			/* Print the results: */
+			std::cout<<*dfnIt<<": "<<numFrames<<" frames, "<<streamSize<<" compressed bytes";
+			if(numTiles!=0)
+				std::cout<<", "<<numTiles<<" tiles per frame";
+			std::cout<<std::endl;
+			std::cout<<"  Best decoding time: "<<bestTime*1000.0<<" ms, "<<double(numFrames)/bestTime<<" frames/s"<<std::endl;
+			std::cout<<"  Compressed throughput: "<<double(streamSize)/(bestTime*1024.0*1024.0)<<" MB/s"<<std::endl;
+			std::cout<<"  Decompressed throughput: "<<double(numFrames)*double(frameSize)/(bestTime*1024.0*1024.0)<<" MB/s"<<std::endl;
+			if(verify)
+				{
+				if(numMismatches==0)
+					std::cout<<"  All frames are bit-identical after re-compression"<<std::endl;
+				else
+					{
+					std::cout<<"  "<<numMismatches<<" frames differ after re-compression"<<std::endl;
+					result=1;
+					}
+				}
+			}
+		catch(const std::runtime_error& err)
+			{
+			std::cerr<<"Unable to benchmark depth file "<<*dfnIt<<" due to exception "<<err.what()<<std::endl;
+			result=1;
+			}
+		}
+	
+	return result;
+	}
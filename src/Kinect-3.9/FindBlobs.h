@@ -2,7 +2,7 @@
 FindBlobs - Helper function to extract all eight-connected blobs of
 pixels from a frame whose pixel values match a given value up to a given
 tolerance.
-Copyright (c) 2010-2015 Oliver Kreylos
+Copyright (c) 2010-2020 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -26,6 +26,7 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #define FINDBLOBS_INCLUDED
 
 #include <vector>
+#include <Images/BlobLabeler.h>
 #include <Kinect/FrameBuffer.h>
 
 template <class PixelParam>
@@ -1,7 +1,7 @@
 /***********************************************************************
 Camera - Wrapper class to represent the color and depth camera interface
 aspects of the Kinect sensor.
-Copyright (c) 2010-2016 Oliver Kreylos
+Copyright (c) 2010-2020 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -53,6 +53,9 @@ class DeviceList;
 namespace IO {
 class File;
 }
+namespace Kinect {
+class KinectV1FrameDecoder;
+}
 
 namespace Kinect {
 
@@ -184,6 +187,7 @@ class Camera:public DirectFrameSource
 	bool nearMode; // Flag if "near mode" is enabled on supporting camera devices
 	unsigned int sharpening; // Color camera sharpening value for next streaming operation
 	StreamingState* streamers[2]; // Streaming states for color and depth frames
+	KinectV1FrameDecoder* frameDecoder; // Object to unpack raw depth frames and demosaic raw color frames
 	
 	#if KINECT_CAMERA_DUMP_HEADERS
 	IO::FilePtr headerFile;
@@ -1,6 +1,6 @@
 /***********************************************************************
 CameraRealSense - Class representing an Intel RealSense camera.
-Copyright (c) 2016-2018 Oliver Kreylos
+Copyright (c) 2016-2020 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -202,6 +202,7 @@ void* CameraRealSense::streamingThreadMethod(void)
 				processDepthFrameBackground(depthFrame);
 				
 				/* Call the streaming callback: */
+				depthFrame.stampSourceTrace(double(timeBase)+timeStamp);
 				(*depthStreamingCallback)(depthFrame);
 				}
 			
@@ -220,6 +221,7 @@ void* CameraRealSense::streamingThreadMethod(void)
 					memcpy(dRowPtr,sRowPtr,frameSizes[0][0]*sizeof(FrameSource::ColorPixel));
 				
 				/* Call the streaming callback: */
+				colorFrame.stampSourceTrace(double(timeBase)+timeStamp);
 				(*colorStreamingCallback)(colorFrame);
 				}
 			}
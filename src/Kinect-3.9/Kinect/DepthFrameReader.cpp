@@ -1,7 +1,7 @@
 /***********************************************************************
 DepthFrameReader - Class to read compressed depth frames from a source,
 and pass decompressed time-stamped depth frames to a client.
-Copyright (c) 2010-2015 Oliver Kreylos
+Copyright (c) 2010-2020 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -23,13 +23,155 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 
 #include <Kinect/DepthFrameReader.h>
 
+#include <Misc/ThrowStdErr.h>
 #include <IO/File.h>
 #include <Math/Constants.h>
 #include <Kinect/FrameBuffer.h>
 #include <Kinect/FrameSource.h>
+#include <Kinect/WorkerPool.h>
 
 namespace Kinect {
 
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+class FileWordSource // Class reading 32-bit words of compressed data directly from a file
+	{
+	/* Elements: */
+	private:
+	IO::File& file; // File providing the words
+	
+	/* Constructors and destructors: */
+	public:
+	FileWordSource(IO::File& sFile)
+		:file(sFile)
+		{
+		}
+	
+	/* Methods: */
+	Misc::UInt32 readWord(void)
+		{
+		return file.read<Misc::UInt32>();
+		}
+	};
+
+class MemoryWordSource // Class reading 32-bit words of compressed data from a memory block
+	{
+	/* Elements: */
+	private:
+	const Misc::UInt32* wordPtr; // Pointer to the next unread word
+	const Misc::UInt32* wordEnd; // Pointer behind the last word
+	bool overrun; // Flag whether a read past the end of the memory block was attempted
+	
+	/* Constructors and destructors: */
+	public:
+	MemoryWordSource(const Misc::UInt32* sWordPtr,const Misc::UInt32* sWordEnd)
+		:wordPtr(sWordPtr),wordEnd(sWordEnd),overrun(false)
+		{
+		}
+	
+	/* Methods: */
+	Misc::UInt32 readWord(void)
+		{
+		/* Return zero bits past the end of the memory block: */
+		if(wordPtr==wordEnd)
+			{
+			overrun=true;
+			return 0x0U;
+			}
+		
+		return *(wordPtr++);
+		}
+	bool wasOverrun(void) const
+		{
+		return overrun;
+		}
+	};
+
+}
+
+/*******************************************
+Embedded classes of class DepthFrameReader:
+*******************************************/
+
+template <class WordSourceParam>
+class DepthFrameReader::BitReader
+	{
+	/* Elements: */
+	private:
+	WordSourceParam& wordSource; // Source of 32-bit words
+	Misc::UInt64 bitBuffer; // Buffer to extract bits from the word source; valid bits are right-aligned
+	unsigned int numBufferBits; // Number of not yet consumed bits in the bit buffer
+	
+	/* Private methods: */
+	void fillBitBuffer(void) // Appends the next 32-bit word from the source to the bit buffer; buffer must not hold more than 32 bits
+		{
+		bitBuffer=(bitBuffer<<32)|Misc::UInt64(wordSource.readWord());
+		numBufferBits+=32;
+		}
+	
+	/* Constructors and destructors: */
+	public:
+	BitReader(WordSourceParam& sWordSource)
+		:wordSource(sWordSource),bitBuffer(0x0U),numBufferBits(0)
+		{
+		}
+	
+	/* Methods: */
+	Misc::UInt32 getBit(void) // Reads a single bit from the source and returns its state
+		{
+		/* Fill the bit buffer if it is empty: */
+		if(numBufferBits==0)
+			fillBitBuffer();
+		
+		/* Extract one bit from the bit buffer: */
+		--numBufferBits;
+		return Misc::UInt32(bitBuffer>>numBufferBits)&0x1U;
+		}
+	Misc::UInt32 getBits(unsigned int numBits) // Reads the given number of bits (at most 32) from the source and returns them MSB first
+		{
+		/* Fill the bit buffer if it does not contain enough bits: */
+		if(numBufferBits<numBits)
+			fillBitBuffer();
+		
+		/* Extract the bits from the bit buffer: */
+		numBufferBits-=numBits;
+		return Misc::UInt32(bitBuffer>>numBufferBits)&Misc::UInt32((Misc::UInt64(1)<<numBits)-1U);
+		}
+	unsigned int decode(const DecodeEntry* table,unsigned int numLeaves,const HuffmanNode* nodes) // Decodes the next Huffman-encoded symbol using the given decoding table and tree
+		{
+		while(true)
+			{
+			/* Look up the next bits, padded with zeros if the bit buffer does not hold enough: */
+			Misc::UInt32 index;
+			if(numBufferBits>=decodeTableBits)
+				index=Misc::UInt32(bitBuffer>>(numBufferBits-decodeTableBits));
+			else
+				index=Misc::UInt32(bitBuffer<<(decodeTableBits-numBufferBits));
+			const DecodeEntry& entry=table[index&((0x1U<<decodeTableBits)-1U)];
+			
+			/* Check if the entry's bit pattern is entirely inside the bit buffer: */
+			if(entry.numBits<=numBufferBits)
+				{
+				numBufferBits-=entry.numBits;
+				
+				/* Walk down the rest of the tree one bit at a time if the code is longer than the table: */
+				unsigned int node=entry.node;
+				while(node>=numLeaves)
+					node=getBit()?nodes[node-numLeaves].right:nodes[node-numLeaves].left;
+				
+				return node;
+				}
+			
+			/* Read more bits; the current code is known to extend past the bit buffer, so this never reads ahead into the next frame: */
+			fillBitBuffer();
+			}
+		}
+	};
+
 /*********************************
 Methods of class DepthFrameReader:
 *********************************/
@@ -38,6 +180,8 @@ void DepthFrameReader::readHuffmanTree(unsigned int& numLeaves,DepthFrameReader:
 	{
 	/* Read the number of leaf nodes: */
 	numLeaves=source.read<Misc::UInt32>();
+	if(numLeaves==0||numLeaves>0x8000U)
+		Misc::throwStdErr("Kinect::DepthFrameReader: Invalid Huffman tree with %u leaves",numLeaves);
 	
 	/* Allocate and read the tree's node array: */
 	nodes=new HuffmanNode[numLeaves-1]; // No need to store leaves; only interior nodes
@@ -50,79 +194,50 @@ void DepthFrameReader::readHuffmanTree(unsigned int& numLeaves,DepthFrameReader:
 		}
 	}
 
-void DepthFrameReader::fillBitBuffer(void)
+DepthFrameReader::DecodeEntry* DepthFrameReader::createDecodeTable(unsigned int numLeaves,const DepthFrameReader::HuffmanNode* nodes)
 	{
-	/* Read more data: */
-	source.read(currentBits);
-	currentBitMask=0x80000000U;
-	}
-
-void DepthFrameReader::flushBits(void)
-	{
-	/* Mark the bit buffer as empty: */
-	currentBits=0x0U;
-	currentBitMask=0x0U;
-	}
-
-DepthFrameReader::DepthFrameReader(IO::File& sSource)
-	:source(sSource),
-	 pixelDeltaNumLeaves(0),pixelDeltaNodes(0),
-	 spanLengthNumLeaves(0),spanLengthNodes(0),
-	 currentBits(0x0U),currentBitMask(0x0U)
-	{
-	/* Read the frame size from the source: */
-	for(int i=0;i<2;++i)
-		size[i]=source.read<Misc::UInt32>();
+	/* Create the table: */
+	unsigned int tableSize=0x1U<<decodeTableBits;
+	DecodeEntry* result=new DecodeEntry[tableSize];
 	
-	/* Create the Hilbert curve offset array: */
-	hilbertCurve.init(size);
+	/* Walk down the tree for each possible bit pattern until a leaf is found or the bit pattern is exhausted: */
+	for(unsigned int index=0;index<tableSize;++index)
+		{
+		unsigned int node=numLeaves+numLeaves-2; // Start at the Huffman tree's root node
+		unsigned int numBits=0;
+		while(node>=numLeaves&&numBits<decodeTableBits)
+			{
+			/* Select the next node based on the next bit: */
+			if(index&(0x1U<<(decodeTableBits-1-numBits)))
+				node=nodes[node-numLeaves].right;
+			else
+				node=nodes[node-numLeaves].left;
+			++numBits;
+			}
+		result[index].node=Misc::UInt16(node);
+		result[index].numBits=Misc::UInt16(numBits);
+		}
 	
-	/* Read the pixel delta and span length Huffman decoding trees from the source: */
-	readHuffmanTree(pixelDeltaNumLeaves,pixelDeltaNodes);
-	readHuffmanTree(spanLengthNumLeaves,spanLengthNodes);
-	}
-
-DepthFrameReader::~DepthFrameReader(void)
-	{
-	delete[] pixelDeltaNodes;
-	delete[] spanLengthNodes;
+	return result;
 	}
 
-FrameBuffer DepthFrameReader::readNextFrame(void)
+template <class BitReaderParam>
+bool DepthFrameReader::decodePixels(BitReaderParam& bitReader,FrameBuffer& frame,unsigned int firstPixel,unsigned int numPixels) const
 	{
-	/* Create the result frame: */
-	FrameBuffer result(size[0],size[1],size[0]*size[1]*sizeof(FrameSource::DepthPixel));
-	
-	/* Return a dummy frame if the file is over: */
-	if(source.eof())
-		{
-		result.timeStamp=Math::Constants<double>::max;
-		return result;
-		}
-	
-	/* Read the frame's time stamp from the source: */
-	result.timeStamp=source.read<Misc::Float64>();
-	
 	/* Process all spans: */
-	FrameSource::DepthPixel* resultBuffer=result.getData<FrameSource::DepthPixel>();
-	unsigned int numPixels=size[0]*size[1];
-	const unsigned int* hcPtr=hilbertCurve.getOffsets();
+	FrameSource::DepthPixel* resultBuffer=frame.getData<FrameSource::DepthPixel>();
+	const unsigned int* hcPtr=hilbertCurve.getOffsets()+firstPixel;
 	while(numPixels>0)
 		{
 		/* Detect the type of the next span: */
-		if(getBit())
+		if(bitReader.getBit())
 			{
 			/******************************
 			Process a span of valid pixels:
 			******************************/
 			
 			/* Read the 11-bit unencoded value of the initial pixel: */
-			unsigned int pixelValue=getBit();
-			for(int i=1;i<11;++i)
-				{
-				pixelValue<<=1;
-				pixelValue|=getBit();
-				}
+			unsigned int pixelValue=bitReader.getBits(11);
 			
 			/* Process the span's pixels: */
 			while(true)
@@ -133,17 +248,11 @@ FrameBuffer DepthFrameReader::readNextFrame(void)
 				--numPixels;
 				
 				/* Read the Huffman-encoded pixel value delta for the next pixel: */
-				unsigned int delta=pixelDeltaNumLeaves+pixelDeltaNumLeaves-2; // Start at the Huffman tree's root node
-				while(delta>=pixelDeltaNumLeaves)
-					{
-					/* Select the next node based on the next bit: */
-					if(getBit())
-						delta=pixelDeltaNodes[delta-pixelDeltaNumLeaves].right;
-					else
-						delta=pixelDeltaNodes[delta-pixelDeltaNumLeaves].left;
-					}
+				unsigned int delta=bitReader.decode(pixelDeltaTable,pixelDeltaNumLeaves,pixelDeltaNodes);
 				if(delta==0) // Zero is span-ending code
 					break;
+				if(numPixels==0)
+					return false;
 				
 				/* Adjust the current pixel value: */
 				pixelValue=pixelValue+delta-16U;
@@ -156,31 +265,150 @@ FrameBuffer DepthFrameReader::readNextFrame(void)
 			********************************/
 			
 			/* Read the Huffman-encoded span length: */
-			unsigned int spanLength=spanLengthNumLeaves+spanLengthNumLeaves-2; // Start at the Huffman tree's root node
-			while(spanLength>=spanLengthNumLeaves)
-				{
-				/* Select the next node based on the next bit: */
-				if(getBit())
-					spanLength=spanLengthNodes[spanLength-spanLengthNumLeaves].right;
-				else
-					spanLength=spanLengthNodes[spanLength-spanLengthNumLeaves].left;
-				}
-			++spanLength; // Compressor encoded spanLength-1, since 0 is impossible
-			while(spanLength>0)
-				{
-				/* Set the current pixel to invalid: */
+			unsigned int spanLength=bitReader.decode(spanLengthTable,spanLengthNumLeaves,spanLengthNodes)+1; // Compressor encoded spanLength-1, since 0 is impossible
+			if(spanLength>numPixels)
+				return false;
+			
+			/* Scatter invalid pixels along the precomputed Hilbert curve offsets: */
+			const unsigned int* hcEnd=hcPtr+spanLength;
+			for(;hcPtr!=hcEnd;++hcPtr)
 				resultBuffer[*hcPtr]=FrameSource::invalidDepth;
-				++hcPtr;
-				--numPixels;
-				--spanLength;
-				}
+			numPixels-=spanLength;
 			}
 		}
 	
-	/* Flush the bit buffer; frames start at byte-boundaries: */
-	flushBits();
+	return true;
+	}
+
+void DepthFrameReader::decodeTiles(unsigned int bandIndex,int tileBegin,int tileEnd)
+	{
+	Misc::UInt64 numPixels=Misc::UInt64(size[0])*Misc::UInt64(size[1]);
+	for(int tile=tileBegin;tile<tileEnd;++tile)
+		{
+		/* Decode the tile's segment of the Hilbert curve from the tile's bit stream: */
+		unsigned int firstPixel=(unsigned int)((numPixels*Misc::UInt64(tile))/numTiles);
+		unsigned int lastPixel=(unsigned int)((numPixels*Misc::UInt64(tile+1))/numTiles);
+		const Misc::UInt32* tileData=tileWords.empty()?0:&tileWords[0];
+		MemoryWordSource wordSource(tileData+tileOffsets[tile],tileData+tileOffsets[tile+1]);
+		BitReader<MemoryWordSource> bitReader(wordSource);
+		if(!decodePixels(bitReader,*currentFrame,firstPixel,lastPixel-firstPixel)||wordSource.wasOverrun())
+			{
+			/* Count the tile as corrupted; reported after all tiles have been decoded: */
+			Threads::Mutex::Lock numCorruptTilesLock(numCorruptTilesMutex);
+			++numCorruptTiles;
+			}
+		}
+	}
+
+DepthFrameReader::DepthFrameReader(IO::File& sSource)
+	:source(sSource),
+	 numTiles(0),
+	 pixelDeltaNumLeaves(0),pixelDeltaNodes(0),pixelDeltaTable(0),
+	 spanLengthNumLeaves(0),spanLengthNodes(0),spanLengthTable(0),
+	 currentFrame(0),numCorruptTiles(0),
+	 decodingPool(0)
+	{
+	/* Read the codec version header or the frame width; original streams start with the non-zero frame width: */
+	size[0]=source.read<Misc::UInt32>();
+	if(size[0]==0)
+		{
+		/* Check the codec version: */
+		Misc::UInt32 codecVersion=source.read<Misc::UInt32>();
+		if(codecVersion!=2)
+			Misc::throwStdErr("Kinect::DepthFrameReader: Unsupported depth codec version %u",(unsigned int)codecVersion);
+		
+		/* Read the frame size and the number of tiles per frame: */
+		for(int i=0;i<2;++i)
+			size[i]=source.read<Misc::UInt32>();
+		numTiles=source.read<Misc::UInt32>();
+		if(numTiles==0||numTiles>size[0]*size[1])
+			Misc::throwStdErr("Kinect::DepthFrameReader: Invalid number of tiles %u",numTiles);
+		tileOffsets.resize(numTiles+1);
+		}
+	else
+		{
+		/* Read the frame height: */
+		size[1]=source.read<Misc::UInt32>();
+		}
+	
+	/* Create the Hilbert curve offset array: */
+	hilbertCurve.init(size);
+	
+	/* Read the pixel delta and span length Huffman decoding trees from the source: */
+	readHuffmanTree(pixelDeltaNumLeaves,pixelDeltaNodes);
+	readHuffmanTree(spanLengthNumLeaves,spanLengthNodes);
+	
+	/* Create multi-bit decoding tables for both Huffman trees: */
+	pixelDeltaTable=createDecodeTable(pixelDeltaNumLeaves,pixelDeltaNodes);
+	spanLengthTable=createDecodeTable(spanLengthNumLeaves,spanLengthNodes);
+	}
+
+DepthFrameReader::~DepthFrameReader(void)
+	{
+	delete decodingPool;
+	delete[] pixelDeltaNodes;
+	delete[] spanLengthNodes;
+	delete[] pixelDeltaTable;
+	delete[] spanLengthTable;
+	}
+
+FrameBuffer DepthFrameReader::readNextFrame(void)
+	{
+	/* Create the result frame: */
+	FrameBuffer result(size[0],size[1],size[0]*size[1]*sizeof(FrameSource::DepthPixel));
+	
+	/* Return a dummy frame if the file is over: */
+	if(source.eof())
+		{
+		result.timeStamp=Math::Constants<double>::max;
+		return result;
+		}
+	
+	/* Read the frame's time stamp from the source: */
+	result.timeStamp=source.read<Misc::Float64>();
+	
+	if(numTiles==0)
+		{
+		/* Decode the entire frame directly from the source; the bit reader is discarded at the end of the frame as frames start at word boundaries: */
+		FileWordSource wordSource(source);
+		BitReader<FileWordSource> bitReader(wordSource);
+		if(!decodePixels(bitReader,result,0,size[0]*size[1]))
+			Misc::throwStdErr("Kinect::DepthFrameReader::readNextFrame: Corrupted depth frame");
+		}
+	else
+		{
+		/* Read the sizes of all tiles' bit streams: */
+		tileOffsets[0]=0;
+		for(unsigned int tile=0;tile<numTiles;++tile)
+			tileOffsets[tile+1]=tileOffsets[tile]+size_t(source.read<Misc::UInt32>());
+		
+		/* Read all tiles' bit streams: */
+		tileWords.resize(tileOffsets[numTiles]);
+		if(!tileWords.empty())
+			source.read(&tileWords[0],tileWords.size());
+		
+		/* Decode all tiles, in parallel if there is a decoding pool: */
+		currentFrame=&result;
+		numCorruptTiles=0;
+		if(decodingPool!=0)
+			decodingPool->processBands(0,int(numTiles),this,&DepthFrameReader::decodeTiles);
+		else
+			decodeTiles(0,0,int(numTiles));
+		currentFrame=0;
+		if(numCorruptTiles!=0)
+			Misc::throwStdErr("Kinect::DepthFrameReader::readNextFrame: Corrupted depth frame with %u bad tiles",numCorruptTiles);
+		}
 	
 	return result;
 	}
 
+void DepthFrameReader::setNumDecodingThreads(unsigned int newNumDecodingThreads)
+	{
+	/* Replace the current decoding pool: */
+	delete decodingPool;
+	decodingPool=0;
+	if(numTiles>0&&newNumDecodingThreads>1)
+		decodingPool=new WorkerPool(newNumDecodingThreads);
+	}
+
 }
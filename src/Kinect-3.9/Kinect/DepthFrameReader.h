@@ -1,7 +1,7 @@
 /***********************************************************************
 DepthFrameReader - Class to read compressed depth frames from a source,
 and pass decompressed time-stamped depth frames to a client.
-Copyright (c) 2010-2015 Oliver Kreylos
+Copyright (c) 2010-2020 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -25,7 +25,9 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #define KINECT_DEPTHFRAMEREADER_INCLUDED
 
 #include <stddef.h>
+#include <vector>
 #include <Misc/SizedTypes.h>
+#include <Threads/Mutex.h>
 #include <Kinect/HilbertCurve.h>
 #include <Kinect/FrameReader.h>
 
@@ -33,6 +35,9 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 namespace IO {
 class File;
 }
+namespace Kinect {
+class WorkerPool;
+}
 
 namespace Kinect {
 
@@ -48,35 +53,42 @@ class DepthFrameReader:public FrameReader
 		unsigned int right; // Index of right subtree
 		};
 	
+	struct DecodeEntry // Structure representing an entry in a multi-bit Huffman decoding table
+		{
+		/* Elements: */
+		public:
+		Misc::UInt16 node; // Index of leaf reached by the entry's bit pattern, or interior node from which to continue decoding if code is longer than the table
+		Misc::UInt16 numBits; // Number of bits consumed to reach the node
+		};
+	
+	template <class WordSourceParam>
+	class BitReader; // Class to extract bits MSB first from a source of 32-bit words through a 64-bit bit buffer
+	
 	/* Elements: */
 	private:
+	static const unsigned int decodeTableBits=10; // Number of bits resolved by a single decoding table look-up
 	IO::File& source; // Data source for compressed depth frames
 	HilbertCurve hilbertCurve; // Object to traverse depth frames in Hilbert curve order
+	unsigned int numTiles; // Number of independently encoded tiles per frame in the tiled (version 2) codec, or 0 for the original (version 1) codec
 	unsigned int pixelDeltaNumLeaves; // Number of leaves in the pixel delta Huffman tree
 	HuffmanNode* pixelDeltaNodes; // Node array of the pixel delta Huffman tree
+	DecodeEntry* pixelDeltaTable; // Multi-bit decoding table for the pixel delta Huffman tree
 	unsigned int spanLengthNumLeaves; // Number of leaves in the span length Huffman tree
 	HuffmanNode* spanLengthNodes; // Node array of the span length Huffman tree
-	Misc::UInt32 currentBits; // Buffer to extract bits from the source buffer
-	Misc::UInt32 currentBitMask; // Mask to extract the next bit from the bit buffer
+	DecodeEntry* spanLengthTable; // Multi-bit decoding table for the span length Huffman tree
+	std::vector<Misc::UInt32> tileWords; // Compressed bit streams of all tiles of the frame currently being read
+	std::vector<size_t> tileOffsets; // Offsets of each tile's bit stream in the tile word array, plus one past the last tile
+	FrameBuffer* currentFrame; // Frame currently being decoded in tiles
+	Threads::Mutex numCorruptTilesMutex; // Mutex serializing access to the corrupt tile counter
+	unsigned int numCorruptTiles; // Number of tiles of the current frame that could not be decoded
+	WorkerPool* decodingPool; // Pool of threads to decode tiles in parallel, or 0 if tiles are decoded in the calling thread
 	
 	/* Private methods: */
 	void readHuffmanTree(unsigned int& numLeaves,HuffmanNode*& nodes); // Reads a Huffman decoding tree from the source
-	void fillBitBuffer(void); // Fills the bit buffer from the source
-	Misc::UInt32 getBit(void) // Reads a single bit from the source and returns its state
-		{
-		/* Fill the bit buffer if it is empty: */
-		if(currentBitMask==0x0U)
-			fillBitBuffer();
-		
-		/* Extract one bit from the bit buffer: */
-		Misc::UInt32 result=0x0U;
-		if(currentBits&currentBitMask)
-			result=0x1U;
-		currentBitMask>>=1;
-		
-		return result;
-		}
-	void flushBits(void); // Clears the bit buffer at the end of a frame
+	static DecodeEntry* createDecodeTable(unsigned int numLeaves,const HuffmanNode* nodes); // Creates a multi-bit decoding table for the given Huffman tree
+	template <class BitReaderParam>
+	bool decodePixels(BitReaderParam& bitReader,FrameBuffer& frame,unsigned int firstPixel,unsigned int numPixels) const; // Decodes the given range of pixels along the Hilbert curve; returns false if the compressed data is corrupted
+	void decodeTiles(unsigned int bandIndex,int tileBegin,int tileEnd); // Decodes the given range of tiles of the current frame
 	
 	/* Constructors and destructors: */
 	public:
@@ -85,6 +97,13 @@ class DepthFrameReader:public FrameReader
 	
 	/* Methods from FrameReader: */
 	virtual FrameBuffer readNextFrame(void);
+	
+	/* New methods: */
+	unsigned int getNumTiles(void) const // Returns the number of tiles per frame, or 0 if the source uses the original codec
+		{
+		return numTiles;
+		}
+	void setNumDecodingThreads(unsigned int newNumDecodingThreads); // Sets the number of threads decoding tiles in parallel; must not be called while a frame is being read
 	};
 
 }
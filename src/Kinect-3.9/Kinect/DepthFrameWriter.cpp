@@ -1,6 +1,6 @@
 /***********************************************************************
 DepthFrameWriter - Class to write compressed depth frames to a sink.
-Copyright (c) 2010-2015 Oliver Kreylos
+Copyright (c) 2010-2020 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -25,9 +25,104 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include <IO/File.h>
 #include <Kinect/FrameBuffer.h>
 #include <Kinect/FrameSource.h>
+#include <Kinect/WorkerPool.h>
 
 namespace Kinect {
 
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+class FileWordSink // Class writing 32-bit words of compressed data directly to a file
+	{
+	/* Elements: */
+	private:
+	IO::File& file; // File receiving the words
+	size_t numWords; // Number of words written so far
+	
+	/* Constructors and destructors: */
+	public:
+	FileWordSink(IO::File& sFile)
+		:file(sFile),numWords(0)
+		{
+		}
+	
+	/* Methods: */
+	void writeWord(Misc::UInt32 word)
+		{
+		file.write(word);
+		++numWords;
+		}
+	size_t getNumWords(void) const
+		{
+		return numWords;
+		}
+	};
+
+class VectorWordSink // Class collecting 32-bit words of compressed data in a vector
+	{
+	/* Elements: */
+	private:
+	std::vector<Misc::UInt32>& words; // Vector receiving the words
+	
+	/* Constructors and destructors: */
+	public:
+	VectorWordSink(std::vector<Misc::UInt32>& sWords)
+		:words(sWords)
+		{
+		}
+	
+	/* Methods: */
+	void writeWord(Misc::UInt32 word)
+		{
+		words.push_back(word);
+		}
+	};
+
+template <class WordSinkParam>
+class BitWriter // Class to pack variable-length codes MSB first into 32-bit words through a 64-bit accumulator
+	{
+	/* Elements: */
+	private:
+	WordSinkParam& wordSink; // Sink receiving completed 32-bit words
+	Misc::UInt64 bits; // Bit accumulator; pending bits are right-aligned
+	unsigned int numBits; // Number of pending bits in the accumulator; always less than 32 between calls
+	
+	/* Constructors and destructors: */
+	public:
+	BitWriter(WordSinkParam& sWordSink)
+		:wordSink(sWordSink),bits(0x0U),numBits(0)
+		{
+		}
+	
+	/* Methods: */
+	void writeBits(Misc::UInt32 newBits,unsigned int numNewBits) // Appends the given number of bits (at most 32)
+		{
+		/* Append the new bits to the accumulator: */
+		bits=(bits<<numNewBits)|Misc::UInt64(newBits);
+		numBits+=numNewBits;
+		
+		/* Emit a word if the accumulator holds at least 32 bits: */
+		if(numBits>=32)
+			{
+			numBits-=32;
+			wordSink.writeWord(Misc::UInt32(bits>>numBits));
+			}
+		}
+	void flush(void) // Emits any pending bits, padded with zeros to a full word
+		{
+		if(numBits>0)
+			{
+			wordSink.writeWord(Misc::UInt32(bits<<(32-numBits)));
+			numBits=0;
+			}
+		}
+	};
+
+}
+
 /*****************************************
 Static elements of class DepthFrameWriter:
 *****************************************/
@@ -124,93 +219,12 @@ const Misc::UInt32 DepthFrameWriter::spanLengthNodes[255][2]=
 Methods of class DepthFrameWriter:
 *********************************/
 
-void DepthFrameWriter::writeManyBits(Misc::UInt32 bits,unsigned int numBits)
-	{
-	while(numBits>0)
-		{
-		/* Figure out how many bits can be copied in one go: */
-		unsigned int numCopyBits=numBits;
-		if(numCopyBits>currentBitsLeft)
-			numCopyBits=currentBitsLeft;
-		
-		/* Copy the determined number of bits: */
-		currentBits=(currentBits<<numCopyBits)|(bits>>(numBits-numCopyBits));
-		currentBitsLeft-=numCopyBits;
-		if(currentBitsLeft==0)
-			{
-			/* Write the bit buffer to the sink: */
-			sink.write(currentBits);
-			compressedSize+=sizeof(Misc::UInt32);
-			
-			/* Clear the bit buffer: */
-			currentBits=0x0U;
-			currentBitsLeft=32;
-			}
-		
-		/* Prepare to write the rest of bits: */
-		numBits-=numCopyBits;
-		if(numBits>0)
-			bits=bits&((0x1U<<numBits)-0x1U);
-		}
-	}
-
-void DepthFrameWriter::flush(void)
-	{
-	/* Check if there are bits in the bit buffer: */
-	if(currentBitsLeft<32)
-		{
-		/* Push the leftover bits to the left: */
-		currentBits<<=currentBitsLeft;
-		
-		/* Write the bit buffer to the sink: */
-		sink.write(currentBits);
-		compressedSize+=sizeof(Misc::UInt32);
-		
-		/* Clear the bit buffer: */
-		currentBits=0x0U;
-		currentBitsLeft=32;
-		}
-	}
-
-DepthFrameWriter::DepthFrameWriter(IO::File& sSink,const unsigned int sSize[2])
-	:FrameWriter(sSize),
-	 sink(sSink),
-	 currentBits(0x0U),currentBitsLeft(32)
-	{
-	/* Create the Hilbert curve offset array: */
-	hilbertCurve.init(size);
-	
-	/* Write the frame size to the sink: */
-	for(int i=0;i<2;++i)
-		sink.write<Misc::UInt32>(size[i]);
-	
-	/* Write the pixel delta Huffman decoding tree to the sink: */
-	unsigned int pdnc=pixelDeltaNumCodes;
-	sink.write<Misc::UInt32>(pdnc);
-	sink.write(&pixelDeltaNodes[0][0],(pixelDeltaNumCodes-1)*2);
-	
-	/* Write the span length Huffman decoding tree to the sink: */
-	unsigned int slnc=spanLengthNumCodes;
-	sink.write<Misc::UInt32>(slnc);
-	sink.write(&spanLengthNodes[0][0],(spanLengthNumCodes-1)*2);
-	}
-
-DepthFrameWriter::~DepthFrameWriter(void)
-	{
-	}
-
-size_t DepthFrameWriter::writeFrame(const FrameBuffer& frame)
+template <class BitWriterParam>
+void DepthFrameWriter::encodePixels(const FrameBuffer& frame,unsigned int firstPixel,unsigned int numPixels,BitWriterParam& bitWriter) const
 	{
-	compressedSize=0;
-	
-	/* Write the frame's time stamp: */
-	sink.write<Misc::Float64>(frame.timeStamp);
-	compressedSize+=sizeof(Misc::Float64);
-	
 	/* Process all pixels: */
 	const FrameSource::DepthPixel* frameBuffer=frame.getData<FrameSource::DepthPixel>();
-	unsigned int numPixels=size[0]*size[1];
-	const unsigned int* hcPtr=hilbertCurve.getOffsets();
+	const unsigned int* hcPtr=hilbertCurve.getOffsets()+firstPixel;
 	while(numPixels>0)
 		{
 		/* Check if the next span is valid or invalid: */
@@ -222,7 +236,7 @@ size_t DepthFrameWriter::writeFrame(const FrameBuffer& frame)
 			
 			/* Write the span header and the initial pixel value: */
 			Misc::UInt32 pixelValue=frameBuffer[*hcPtr];
-			writeBits(0x800U|pixelValue,12); // 1 bit span header, 11 bits initial pixel value
+			bitWriter.writeBits(0x800U|pixelValue,12); // 1 bit span header, 11 bits initial pixel value
 			
 			/* Write the rest of pixels in the span: */
 			++hcPtr;
@@ -231,7 +245,7 @@ size_t DepthFrameWriter::writeFrame(const FrameBuffer& frame)
 				{
 				/* Write the Huffman-encoded pixel value delta: */
 				unsigned int delta=frameBuffer[*hcPtr]+16-pixelValue;
-				writeBits(pixelDeltaCodes[delta][0],pixelDeltaCodes[delta][1]);
+				bitWriter.writeBits(pixelDeltaCodes[delta][0],pixelDeltaCodes[delta][1]);
 				
 				pixelValue=frameBuffer[*hcPtr];
 				++hcPtr;
@@ -239,7 +253,7 @@ size_t DepthFrameWriter::writeFrame(const FrameBuffer& frame)
 				}
 			
 			/* Write the span terminator: */
-			writeBits(pixelDeltaCodes[0][0],pixelDeltaCodes[0][1]);
+			bitWriter.writeBits(pixelDeltaCodes[0][0],pixelDeltaCodes[0][1]);
 			}
 		else
 			{
@@ -259,14 +273,123 @@ size_t DepthFrameWriter::writeFrame(const FrameBuffer& frame)
 				}
 			
 			/* Write the span header and the Huffman-encoded span length minus 1: */
-			writeBits(spanLengthCodes[spanLength-1][0],spanLengthCodes[spanLength-1][1]+1); // Write one extra zero bit for the span header
+			bitWriter.writeBits(spanLengthCodes[spanLength-1][0],spanLengthCodes[spanLength-1][1]+1); // Write one extra zero bit for the span header
 			}
 		}
 	
-	/* Flush the bit buffer: */
-	flush();
+	/* Flush the bit buffer; frames and tiles start at word boundaries: */
+	bitWriter.flush();
+	}
+
+void DepthFrameWriter::encodeTiles(unsigned int bandIndex,int tileBegin,int tileEnd)
+	{
+	Misc::UInt64 numPixels=Misc::UInt64(size[0])*Misc::UInt64(size[1]);
+	for(int tile=tileBegin;tile<tileEnd;++tile)
+		{
+		/* Encode the tile's segment of the Hilbert curve into the tile's bit stream: */
+		unsigned int firstPixel=(unsigned int)((numPixels*Misc::UInt64(tile))/numTiles);
+		unsigned int lastPixel=(unsigned int)((numPixels*Misc::UInt64(tile+1))/numTiles);
+		tileWords[tile].clear();
+		VectorWordSink wordSink(tileWords[tile]);
+		BitWriter<VectorWordSink> bitWriter(wordSink);
+		encodePixels(*currentFrame,firstPixel,lastPixel-firstPixel,bitWriter);
+		}
+	}
+
+DepthFrameWriter::DepthFrameWriter(IO::File& sSink,const unsigned int sSize[2],unsigned int sNumTiles)
+	:FrameWriter(sSize),
+	 sink(sSink),
+	 numTiles(sNumTiles),tileWords(0),currentFrame(0),
+	 encodingPool(0)
+	{
+	/* Create the Hilbert curve offset array: */
+	hilbertCurve.init(size);
+	
+	if(numTiles>0)
+		{
+		/* Limit the number of tiles to the number of pixels: */
+		if(numTiles>size[0]*size[1])
+			numTiles=size[0]*size[1];
+		
+		/* Write the codec version header; original streams start with the non-zero frame width: */
+		sink.write<Misc::UInt32>(0);
+		sink.write<Misc::UInt32>(2);
+		}
+	
+	/* Write the frame size to the sink: */
+	for(int i=0;i<2;++i)
+		sink.write<Misc::UInt32>(size[i]);
+	
+	if(numTiles>0)
+		{
+		/* Write the number of tiles per frame and create the tile bit streams: */
+		sink.write<Misc::UInt32>(numTiles);
+		tileWords=new std::vector<Misc::UInt32>[numTiles];
+		}
+	
+	/* Write the pixel delta Huffman decoding tree to the sink: */
+	unsigned int pdnc=pixelDeltaNumCodes;
+	sink.write<Misc::UInt32>(pdnc);
+	sink.write(&pixelDeltaNodes[0][0],(pixelDeltaNumCodes-1)*2);
+	
+	/* Write the span length Huffman decoding tree to the sink: */
+	unsigned int slnc=spanLengthNumCodes;
+	sink.write<Misc::UInt32>(slnc);
+	sink.write(&spanLengthNodes[0][0],(spanLengthNumCodes-1)*2);
+	}
+
+DepthFrameWriter::~DepthFrameWriter(void)
+	{
+	delete encodingPool;
+	delete[] tileWords;
+	}
+
+size_t DepthFrameWriter::writeFrame(const FrameBuffer& frame)
+	{
+	/* Write the frame's time stamp: */
+	sink.write<Misc::Float64>(frame.timeStamp);
+	size_t compressedSize=sizeof(Misc::Float64);
+	
+	if(numTiles==0)
+		{
+		/* Encode the entire frame directly into the sink: */
+		FileWordSink wordSink(sink);
+		BitWriter<FileWordSink> bitWriter(wordSink);
+		encodePixels(frame,0,size[0]*size[1],bitWriter);
+		compressedSize+=wordSink.getNumWords()*sizeof(Misc::UInt32);
+		}
+	else
+		{
+		/* Encode all tiles, in parallel if there is an encoding pool: */
+		currentFrame=&frame;
+		if(encodingPool!=0)
+			encodingPool->processBands(0,int(numTiles),this,&DepthFrameWriter::encodeTiles);
+		else
+			encodeTiles(0,0,int(numTiles));
+		currentFrame=0;
+		
+		/* Write the sizes of all tiles' bit streams, followed by the bit streams: */
+		for(unsigned int tile=0;tile<numTiles;++tile)
+			sink.write<Misc::UInt32>(Misc::UInt32(tileWords[tile].size()));
+		compressedSize+=numTiles*sizeof(Misc::UInt32);
+		for(unsigned int tile=0;tile<numTiles;++tile)
+			if(!tileWords[tile].empty())
+				{
+				sink.write(&tileWords[tile][0],tileWords[tile].size());
+				compressedSize+=tileWords[tile].size()*sizeof(Misc::UInt32);
+				}
+		}
 	
 	return compressedSize;
 	}
 
+void DepthFrameWriter::setNumEncodingThreads(unsigned int newNumEncodingThreads)
+	{
+	/* Replace the current encoding pool: */
+	delete encodingPool;
+	encodingPool=0;
+	if(numTiles>0&&newNumEncodingThreads>1)
+		encodingPool=new WorkerPool(newNumEncodingThreads);
+	}
+
 }
@@ -1,6 +1,6 @@
 /***********************************************************************
 DepthFrameWriter - Class to write compressed depth frames to a sink.
-Copyright (c) 2010-2015 Oliver Kreylos
+Copyright (c) 2010-2020 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -24,6 +24,7 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #define KINECT_DEPTHFRAMEWRITER_INCLUDED
 
 #include <stddef.h>
+#include <vector>
 #include <Misc/SizedTypes.h>
 #include <Kinect/HilbertCurve.h>
 #include <Kinect/FrameWriter.h>
@@ -32,6 +33,9 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 namespace IO {
 class File;
 }
+namespace Kinect {
+class WorkerPool;
+}
 
 namespace Kinect {
 
@@ -47,34 +51,30 @@ class DepthFrameWriter:public FrameWriter
 	static const unsigned int spanLengthNumCodes=256; // Number of codes for span lengths
 	static const Misc::UInt32 spanLengthCodes[spanLengthNumCodes][2]; // Huffman code array for span lengths
 	static const Misc::UInt32 spanLengthNodes[spanLengthNumCodes-1][2]; // Huffman decoding tree nodes for span lengths
-	Misc::UInt32 currentBits; // Buffer to push bits into the sink buffer
-	unsigned int currentBitsLeft; // Number of available bits left in the bit buffer
-	size_t compressedSize; // Aggregated size of compressed frame during writing
+	unsigned int numTiles; // Number of independently encoded tiles per frame in the tiled (version 2) codec, or 0 for the original (version 1) codec
+	std::vector<Misc::UInt32>* tileWords; // Array of compressed bit streams for the tiles of the frame currently being written
+	const FrameBuffer* currentFrame; // Frame currently being encoded in tiles
+	WorkerPool* encodingPool; // Pool of threads to encode tiles in parallel, or 0 if tiles are encoded in the calling thread
 	
 	/* Private methods: */
-	void writeManyBits(Misc::UInt32 bits,unsigned int numBits); // Writes the given number of bits to the sink
-	void writeBits(Misc::UInt32 bits,unsigned int numBits) // Writes the given number of bits to the sink
-		{
-		if(numBits<=currentBitsLeft)
-			{
-			currentBits=(currentBits<<numBits)|bits;
-			currentBitsLeft-=numBits;
-			}
-		else
-			{
-			/* Fall back to slower default method: */
-			writeManyBits(bits,numBits);
-			}
-		}
-	void flush(void); // Flushes the bit buffer
+	template <class BitWriterParam>
+	void encodePixels(const FrameBuffer& frame,unsigned int firstPixel,unsigned int numPixels,BitWriterParam& bitWriter) const; // Encodes the given range of pixels along the Hilbert curve
+	void encodeTiles(unsigned int bandIndex,int tileBegin,int tileEnd); // Encodes the given range of tiles of the current frame
 	
 	/* Constructors and destructors: */
 	public:
-	DepthFrameWriter(IO::File& sSink,const unsigned int sSize[2]); // Creates a depth frame writer for the given sink and frame size
+	DepthFrameWriter(IO::File& sSink,const unsigned int sSize[2],unsigned int sNumTiles =0); // Creates a depth frame writer for the given sink and frame size; uses the tiled codec if the number of tiles is non-zero
 	virtual ~DepthFrameWriter(void);
 	
 	/* Methods from FrameWriter: */
 	virtual size_t writeFrame(const FrameBuffer& frame);
+	
+	/* New methods: */
+	unsigned int getNumTiles(void) const // Returns the number of tiles per frame, or 0 if the writer uses the original codec
+		{
+		return numTiles;
+		}
+	void setNumEncodingThreads(unsigned int newNumEncodingThreads); // Sets the number of threads encoding tiles in parallel; must not be called while a frame is being written
 	};
 
 }
@@ -1,7 +1,7 @@
 /***********************************************************************
 DirectFrameSource - Intermediate class for frame sources that are
 directly connected to a camera device.
-Copyright (c) 2015-2018 Oliver Kreylos
+Copyright (c) 2015-2020 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -56,7 +56,7 @@ Misc::SelfDestructPointer<GLMotif::FileSelectionHelper> DirectFrameSource::backg
 Methods of class DirectFrameSource:
 **********************************/
 
-void DirectFrameSource::processDepthFrameBackground(FrameBuffer& depthFrame)
+void DirectFrameSource::processDepthFrameBackground(FrameBuffer& depthFrame,bool backgroundRemoved)
 	{
 	/* Check if a background capture is currently active: */
 	if(backgroundCaptureNumFrames>0)
@@ -127,8 +127,8 @@ void DirectFrameSource::processDepthFrameBackground(FrameBuffer& depthFrame)
 			}
 		}
 	
-	/* Check if we're removing background: */
-	if(removeBackground)
+	/* Check if we're removing background and the decoder didn't already do it: */
+	if(removeBackground&&!backgroundRemoved)
 		{
 		/* Remove background pixels: */
 		DepthPixel* dfPtr=depthFrame.getData<DepthPixel>();
@@ -1,7 +1,7 @@
 /***********************************************************************
 DirectFrameSource - Intermediate class for frame sources that are
 directly connected to a camera device.
-Copyright (c) 2015-2016 Oliver Kreylos
+Copyright (c) 2015-2020 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -92,7 +92,11 @@ class DirectFrameSource:public FrameSource
 	Misc::CallbackList intrinsicParametersChangedCallbacks; // List of callbacks to be called when the camera's intrinsic parameters change
 	
 	/* Protected methods: */
-	void processDepthFrameBackground(FrameBuffer& depthFrame); // Runs a newly-decoded depth frame through background capture and/or removal
+	const DepthPixel* getRemovalBackgroundFrame(void) const // Returns the background frame if a decoder can remove background pixels while decoding, or null if background removal is disabled or a background capture is active
+		{
+		return removeBackground&&backgroundCaptureNumFrames==0?backgroundFrame:0;
+		}
+	void processDepthFrameBackground(FrameBuffer& depthFrame,bool backgroundRemoved =false); // Runs a newly-decoded depth frame through background capture and/or removal; skips removal if the decoder already removed background pixels
 	
 	/* Private methods: */
 	private:
@@ -1,7 +1,7 @@
 /***********************************************************************
 FileFrameSource - Class to stream depth and color frames from a pair of
 time-stamped depth and color stream files.
-Copyright (c) 2010-2018 Oliver Kreylos
+Copyright (c) 2010-2020 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -129,6 +129,7 @@ void* FileFrameSource::colorStreamingThreadMethod(void)
 			Realtime::TimePointMonotonic::sleep(timeBase+Realtime::TimeVector(colorFrame.timeStamp));
 			
 			/* Post the next color frame to the consumer: */
+			colorFrame.stampSourceTrace(double(timeBase)+colorFrame.timeStamp);
 			(*colorStreamingCallback)(colorFrame);
 			
 			/* Read the next color frame: */
@@ -222,6 +223,7 @@ void* FileFrameSource::depthStreamingThreadMethod(void)
 			Realtime::TimePointMonotonic::sleep(timeBase+Realtime::TimeVector(median.timeStamp));
 			
 			/* Post the median depth frame to the consumer: */
+			median.stampSourceTrace(double(timeBase)+median.timeStamp);
 			(*depthStreamingCallback)(median);
 			
 			/* Read the next depth frame: */
@@ -244,6 +246,7 @@ void* FileFrameSource::depthStreamingThreadMethod(void)
 			Realtime::TimePointMonotonic::sleep(timeBase+Realtime::TimeVector(depthFrame.timeStamp));
 			
 			/* Post the next depth frame to the consumer: */
+			depthFrame.stampSourceTrace(double(timeBase)+depthFrame.timeStamp);
 			(*depthStreamingCallback)(depthFrame);
 			
 			/* Read the next depth frame: */
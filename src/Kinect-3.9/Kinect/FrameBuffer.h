@@ -1,7 +1,7 @@
 /***********************************************************************
 FrameBuffer - Class for reference-counted decoded color or depth frame
 buffers.
-Copyright (c) 2010-2015 Oliver Kreylos
+Copyright (c) 2010-2020 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -34,25 +34,69 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include <iostream>
 #endif
 #include <Threads/Atomic.h>
+#include <Threads/Spinlock.h>
+#include <Realtime/Time.h>
+#include <Kinect/FramePool.h>
 
 namespace Kinect {
 
 class FrameBuffer
 	{
 	/* Embedded classes: */
+	public:
+	enum TraceStage // Enumerated type for processing stages recorded in a frame's trace
+		{
+		CAPTURE=0, // Frame source started receiving the frame
+		DECODE, // Frame source finished decoding the frame and passes it to its consumer
+		FIRST_USER_TRACE_STAGE, // First stage index available to applications processing the frame further
+		MAX_NUM_TRACE_STAGES=12
+		};
+	
+	struct Trace // Structure recording the times at which a frame passed through processing stages
+		{
+		/* Elements: */
+		public:
+		unsigned int stampMask; // Bit mask of stages that have been recorded
+		double times[MAX_NUM_TRACE_STAGES]; // Times at which the frame passed each recorded stage in seconds on the monotonic clock
+		
+		/* Constructors and destructors: */
+		Trace(void)
+			:stampMask(0x0U)
+			{
+			}
+		
+		/* Methods: */
+		bool isStamped(int stage) const // Returns true if the given stage has been recorded
+			{
+			return (stampMask&(0x1U<<stage))!=0x0U;
+			}
+		bool stamp(int stage,double time) // Records the given time for the given stage unless the stage has already been recorded; returns true if the time was recorded
+			{
+			if(stampMask&(0x1U<<stage))
+				return false;
+			times[stage]=time;
+			stampMask|=0x1U<<stage;
+			return true;
+			}
+		};
+	
 	private:
 	struct BufferHeader
 		{
 		/* Elements: */
 		public:
 		Threads::Atomic<unsigned int> refCount; // Reference counter
+		Threads::Spinlock traceMutex; // Mutual exclusion semaphore serializing concurrent accesses to the trace record from multiple threads
+		Trace trace; // Trace record of the frame stored in the buffer, shared by all references to the buffer
+		FramePool* pool; // Pool to which the buffer's memory block is returned when the buffer becomes orphaned
+		unsigned int sizeClass; // Size class of the buffer's memory block in its pool
 		#if KINECT_FRAMEBUFFER_DEBUGLOCK
 		int destroyed;
 		#endif
 		
 		/* Constructors and destructors: */
-		BufferHeader(void)
-			:refCount(1)
+		BufferHeader(FramePool* sPool,unsigned int sSizeClass)
+			:refCount(1),pool(sPool),sizeClass(sSizeClass)
 			#if KINECT_FRAMEBUFFER_DEBUGLOCK
 			 ,destroyed(0)
 			#endif
@@ -91,6 +135,27 @@ class FrameBuffer
 	public:
 	double timeStamp; // Frame's time stamp in originating camera's own clock
 	
+	/* Private methods: */
+	private:
+	static void* createBuffer(size_t bufferSize,FramePool& pool) // Creates a reference-counted buffer of the given size in bytes from the given pool
+		{
+		/* Allocate the enlarged frame buffer: */
+		unsigned int sizeClass;
+		unsigned char* paddedBuffer=static_cast<unsigned char*>(pool.allocate(bufferSize+sizeof(BufferHeader),sizeClass));
+		new(paddedBuffer) BufferHeader(&pool,sizeClass);
+		
+		/* Return the actual buffer pointer: */
+		return paddedBuffer+sizeof(BufferHeader);
+		}
+	static void destroyBuffer(void* buffer) // Destroys an orphaned buffer and returns its memory block to its pool
+		{
+		BufferHeader* header=static_cast<BufferHeader*>(buffer)-1;
+		FramePool* pool=header->pool;
+		unsigned int sizeClass=header->sizeClass;
+		header->~BufferHeader();
+		pool->release(header,sizeClass);
+		}
+	
 	/* Constructors and destructors: */
 	public:
 	FrameBuffer(void) // Creates invalid frame buffer
@@ -98,19 +163,19 @@ class FrameBuffer
 		{
 		size[1]=size[0]=0;
 		}
-	FrameBuffer(int sizeX,int sizeY,size_t bufferSize) // Allocates a new frame buffer of the given frame size and size in bytes
-		:buffer(0),timeStamp(0.0)
+	FrameBuffer(int sizeX,int sizeY,size_t bufferSize) // Allocates a new frame buffer of the given frame size and size in bytes from the default frame pool
+		:buffer(createBuffer(bufferSize,FramePool::getDefaultPool())),timeStamp(0.0)
+		{
+		/* Copy the frame size: */
+		size[0]=sizeX;
+		size[1]=sizeY;
+		}
+	FrameBuffer(int sizeX,int sizeY,size_t bufferSize,FramePool& pool) // Ditto, from the given frame pool, which must outlive the buffer
+		:buffer(createBuffer(bufferSize,pool)),timeStamp(0.0)
 		{
 		/* Copy the frame size: */
 		size[0]=sizeX;
 		size[1]=sizeY;
-		
-		/* Allocate the enlarged frame buffer: */
-		unsigned char* paddedBuffer=new unsigned char[bufferSize+sizeof(BufferHeader)];
-		new(paddedBuffer) BufferHeader;
-		
-		/* Store the actual buffer pointer: */
-		buffer=paddedBuffer+sizeof(BufferHeader);
 		}
 	FrameBuffer(const FrameBuffer& source) // Copy constructor
 		:buffer(source.buffer),timeStamp(source.timeStamp)
@@ -136,9 +201,8 @@ class FrameBuffer
 				{
 				if(static_cast<BufferHeader*>(buffer)[-1].unref())
 					{
-					/* Delete the unused buffer: */
-					static_cast<BufferHeader*>(buffer)[-1].~BufferHeader();
-					delete[] (static_cast<unsigned char*>(buffer)-sizeof(BufferHeader));
+					/* Return the unused buffer to its pool: */
+					destroyBuffer(buffer);
 					}
 				}
 			
@@ -163,9 +227,8 @@ class FrameBuffer
 			{
 			if(static_cast<BufferHeader*>(buffer)[-1].unref())
 				{
-				/* Delete the unused buffer: */
-				static_cast<BufferHeader*>(buffer)[-1].~BufferHeader();
-				delete[] (static_cast<unsigned char*>(buffer)-sizeof(BufferHeader));
+				/* Return the unused buffer to its pool: */
+				destroyBuffer(buffer);
 				}
 			}
 		}
@@ -183,6 +246,35 @@ class FrameBuffer
 		{
 		return size[dimension];
 		}
+	Trace getTrace(void) const // Returns a consistent copy of the trace record of a valid frame
+		{
+		BufferHeader& header=static_cast<BufferHeader*>(buffer)[-1];
+		Threads::Spinlock::Lock traceLock(header.traceMutex);
+		return header.trace;
+		}
+	bool stampTrace(int stage,double time) // Records the given time on the monotonic clock for the given stage in a valid frame's trace unless already recorded; returns true if the time was recorded
+		{
+		BufferHeader& header=static_cast<BufferHeader*>(buffer)[-1];
+		Threads::Spinlock::Lock traceLock(header.traceMutex);
+		return header.trace.stamp(stage,time);
+		}
+	bool stampTrace(int stage) // Ditto, using the current time
+		{
+		return stampTrace(stage,double(Realtime::TimePointMonotonic()));
+		}
+	void stampSourceTrace(double captureTime) // Records the given time on the monotonic clock at which a frame source started receiving a valid frame, and the current time as the time at which the frame source passes the frame to its consumer, in the frame's trace
+		{
+		stampTrace(CAPTURE,captureTime);
+		stampTrace(DECODE);
+		}
+	void copyTrace(const FrameBuffer& source) // Replaces a valid frame's trace with the trace of the given valid frame, for frames derived from the source frame
+		{
+		/* Copy the source frame's trace first to not hold both frames' locks at the same time: */
+		Trace sourceTrace=source.getTrace();
+		BufferHeader& header=static_cast<BufferHeader*>(buffer)[-1];
+		Threads::Spinlock::Lock traceLock(header.traceMutex);
+		header.trace=sourceTrace;
+		}
 	template <class ContentParam>
 	const ContentParam* getData(void) const // Returns the frame buffer as the given content type
 		{
@@ -203,9 +295,8 @@ class FrameBuffer
 			{
 			if(static_cast<BufferHeader*>(buffer)[-1].unref())
 				{
-				/* Delete the unused buffer: */
-				static_cast<BufferHeader*>(buffer)[-1].~BufferHeader();
-				delete[] (static_cast<unsigned char*>(buffer)-sizeof(BufferHeader));
+				/* Return the unused buffer to its pool: */
+				destroyBuffer(buffer);
 				}
 			
 			/* Drop the buffer reference: */
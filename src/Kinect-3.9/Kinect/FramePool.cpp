@@ -0,0 +1,158 @@
+/***********************************************************************
+FramePool - Class to recycle the memory blocks backing frame buffers in
+a set of size classes, to avoid allocator traffic and page faults when
+allocating a new buffer for every frame.
+Copyright (c) 2020 Oliver Kreylos
+
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <Kinect/FramePool.h>
+
+namespace Kinect {
+
+/**************************
+Methods of class FramePool:
+**************************/
+
+FramePool::FramePool(void)
+	:numAllocations(0),numRecycled(0),numReleases(0),numFreed(0)
+	{
+	}
+
+FramePool::~FramePool(void)
+	{
+	/* Free all recycled blocks: */
+	trim();
+	}
+
+FramePool& FramePool::getDefaultPool(void)
+	{
+	/* Create the default pool on first use, and never destroy it, as frame buffers might be released during static destruction: */
+	static FramePool* defaultPool=new FramePool;
+	return *defaultPool;
+	}
+
+unsigned int FramePool::getSizeClass(size_t size)
+	{
+	/***********************************************************************
+	The first eight size classes hold blocks of one to eight pages; each
+	following doubling of block size is split into eight equally-spaced
+	size classes, which wastes at most 12.5% of a block.
+	***********************************************************************/
+	
+	size_t numPages=(size+pageSize-1)/pageSize;
+	if(numPages<=8)
+		return numPages>0?(unsigned int)(numPages-1):0U;
+	
+	/* Find the doubling containing the number of pages: */
+	size_t q=numPages-1;
+	unsigned int exponent=3;
+	while((q>>(exponent+1))!=0)
+		++exponent;
+	unsigned int sizeClass=8+(exponent-3)*8+(unsigned int)((q>>(exponent-3))-8);
+	return sizeClass<numSizeClasses?sizeClass:noSizeClass;
+	}
+
+size_t FramePool::getSizeClassSize(unsigned int sizeClass)
+	{
+	if(sizeClass<8)
+		return size_t(sizeClass+1)*pageSize;
+	unsigned int exponent=3+(sizeClass-8)/8;
+	return (size_t((sizeClass-8)%8+9)<<(exponent-3))*pageSize;
+	}
+
+void* FramePool::allocate(size_t size,unsigned int& sizeClass)
+	{
+	numAllocations.preAdd(1);
+	
+	/* Allocate blocks too large for recycling directly: */
+	sizeClass=getSizeClass(size);
+	if(sizeClass==noSizeClass)
+		return new unsigned char[size];
+	
+	/* Try taking a recycled block from the size class's slots: */
+	Slot* scSlots=slots[sizeClass];
+	for(unsigned int i=0;i<numSlots;++i)
+		{
+		void* block=scSlots[i].block.get();
+		if(block!=0&&scSlots[i].block.ifCompareAndSwap(block,0))
+			{
+			numRecycled.preAdd(1);
+			return block;
+			}
+		}
+	
+	/* Allocate a new block: */
+	return new unsigned char[getSizeClassSize(sizeClass)];
+	}
+
+void FramePool::release(void* block,unsigned int sizeClass)
+	{
+	numReleases.preAdd(1);
+	
+	if(sizeClass!=noSizeClass)
+		{
+		/* Try putting the block into an empty slot of its size class: */
+		Slot* scSlots=slots[sizeClass];
+		for(unsigned int i=0;i<numSlots;++i)
+			if(scSlots[i].block.get()==0&&scSlots[i].block.ifCompareAndSwap(0,block))
+				return;
+		}
+	
+	/* Free the block: */
+	numFreed.preAdd(1);
+	delete[] static_cast<unsigned char*>(block);
+	}
+
+FramePool::Statistics FramePool::getStatistics(void) const
+	{
+	Statistics result;
+	result.numAllocations=numAllocations.get();
+	result.numRecycled=numRecycled.get();
+	result.numReleases=numReleases.get();
+	result.numFreed=numFreed.get();
+	
+	/* Count the blocks currently held for recycling: */
+	result.numPooledBlocks=0;
+	result.numPooledBytes=0;
+	for(unsigned int sizeClass=0;sizeClass<numSizeClasses;++sizeClass)
+		for(unsigned int i=0;i<numSlots;++i)
+			if(slots[sizeClass][i].block.get()!=0)
+				{
+				++result.numPooledBlocks;
+				result.numPooledBytes+=getSizeClassSize(sizeClass);
+				}
+	
+	return result;
+	}
+
+void FramePool::trim(void)
+	{
+	/* Take all recycled blocks out of their slots and free them: */
+	for(unsigned int sizeClass=0;sizeClass<numSizeClasses;++sizeClass)
+		for(unsigned int i=0;i<numSlots;++i)
+			{
+			void* block=slots[sizeClass][i].block.get();
+			if(block!=0&&slots[sizeClass][i].block.ifCompareAndSwap(block,0))
+				delete[] static_cast<unsigned char*>(block);
+			}
+	}
+
+}
@@ -0,0 +1,94 @@
+/***********************************************************************
+FramePool - Class to recycle the memory blocks backing frame buffers in
+a set of size classes, to avoid allocator traffic and page faults when
+allocating a new buffer for every frame.
+Copyright (c) 2020 Oliver Kreylos
+
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#ifndef KINECT_FRAMEPOOL_INCLUDED
+#define KINECT_FRAMEPOOL_INCLUDED
+
+#include <stddef.h>
+#include <Threads/Atomic.h>
+
+namespace Kinect {
+
+class FramePool
+	{
+	/* Embedded classes: */
+	public:
+	static const size_t pageSize=4096; // Granularity of block sizes in bytes
+	static const unsigned int numSizeClasses=104; // Number of size classes; blocks larger than the largest size class (128MB) are not recycled
+	static const unsigned int numSlots=8; // Maximum number of recycled blocks kept per size class
+	static const unsigned int noSizeClass=~0U; // Size class index for blocks that are not recycled
+	
+	struct Statistics // Structure to report a pool's usage
+		{
+		/* Elements: */
+		public:
+		size_t numAllocations; // Number of blocks requested from the pool
+		size_t numRecycled; // Number of requests served by recycling a previously released block
+		size_t numReleases; // Number of blocks released to the pool
+		size_t numFreed; // Number of released blocks freed because their size class was full or they were too large
+		size_t numPooledBlocks; // Number of blocks currently held for recycling
+		size_t numPooledBytes; // Total size of blocks currently held for recycling in bytes
+		};
+	
+	private:
+	struct Slot // Structure for a slot holding a recycled block; a slot is taken or filled with a single compare-and-swap, which avoids ABA problems
+		{
+		/* Elements: */
+		public:
+		Threads::Atomic<void*> block; // Pointer to the recycled block, or null if the slot is empty
+		
+		/* Constructors and destructors: */
+		Slot(void)
+			:block(0)
+			{
+			}
+		};
+	
+	/* Elements: */
+	Slot slots[numSizeClasses][numSlots]; // Recycled blocks for each size class
+	Threads::Atomic<size_t> numAllocations,numRecycled,numReleases,numFreed; // Usage counters
+	
+	/* Constructors and destructors: */
+	public:
+	FramePool(void); // Creates an empty pool
+	private:
+	FramePool(const FramePool& source); // Prohibit copy constructor
+	FramePool& operator=(const FramePool& source); // Prohibit assignment operator
+	public:
+	~FramePool(void); // Frees all recycled blocks
+	
+	/* Methods: */
+	static FramePool& getDefaultPool(void); // Returns the pool used by frame buffers that were not given a pool explicitly; the default pool is never destroyed
+	static unsigned int getSizeClass(size_t size); // Returns the index of the smallest size class holding blocks of the given size in bytes, or noSizeClass if the size is larger than the largest size class
+	static size_t getSizeClassSize(unsigned int sizeClass); // Returns the size of blocks in the given size class in bytes
+	void* allocate(size_t size,unsigned int& sizeClass); // Returns a block of at least the given size in bytes and stores its size class; recycles a block if possible
+	void release(void* block,unsigned int sizeClass); // Returns a block of the given size class to the pool; frees the block if its size class is full
+	Statistics getStatistics(void) const; // Returns the pool's current usage statistics
+	void trim(void); // Frees all blocks currently held for recycling
+	};
+
+}
+
+#endif
@@ -0,0 +1,608 @@
+/***********************************************************************
+KinectV1FrameDecoder - Class to unpack raw 11-bit depth frames and to
+demosaic raw Bayer-pattern color frames received from a first-generation
+Kinect camera, using vectorized kernels where available.
+Copyright (c) 2010-2020 Oliver Kreylos
+
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <Kinect/Internal/KinectV1FrameDecoder.h>
+
+#include <Misc/ThrowStdErr.h>
+
+/* Check whether the x86 vector kernels can be compiled: */
+#if defined(__GNUC__)&&(defined(__x86_64__)||defined(__i386__))
+#define KINECTV1FRAMEDECODER_X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define KINECTV1FRAMEDECODER_X86_KERNELS 0
+#endif
+
+namespace Kinect {
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+typedef Misc::UInt8 Byte;
+typedef FrameSource::DepthPixel DepthPixel;
+typedef FrameSource::ColorComponent ColorComponent;
+
+inline void unpackGroup(const Byte* sPtr,DepthPixel* dPtr) // Converts a run of 11 8-bit bytes into 8 11-bit pixels
+	{
+	dPtr[0]=(DepthPixel(sPtr[0])<<3)|(DepthPixel(sPtr[1])>>5);
+	dPtr[1]=((DepthPixel(sPtr[1])&0x1fU)<<6)|(DepthPixel(sPtr[2])>>2);
+	dPtr[2]=((DepthPixel(sPtr[2])&0x03U)<<9)|(DepthPixel(sPtr[3])<<1)|(DepthPixel(sPtr[4])>>7);
+	dPtr[3]=((DepthPixel(sPtr[4])&0x7fU)<<4)|(DepthPixel(sPtr[5])>>4);
+	dPtr[4]=((DepthPixel(sPtr[5])&0x0fU)<<7)|(DepthPixel(sPtr[6])>>1);
+	dPtr[5]=((DepthPixel(sPtr[6])&0x01U)<<10)|(DepthPixel(sPtr[7])<<2)|(DepthPixel(sPtr[8])>>6);
+	dPtr[6]=((DepthPixel(sPtr[8])&0x3fU)<<5)|(DepthPixel(sPtr[9])>>3);
+	dPtr[7]=((DepthPixel(sPtr[9])&0x07U)<<8)|DepthPixel(sPtr[10]);
+	}
+
+inline void removeBackground(DepthPixel* dPtr,const DepthPixel* bPtr,int numPixels,int fuzz) // Invalidates all pixels at or behind the background
+	{
+	for(int i=0;i<numPixels;++i)
+		if(dPtr[i]+fuzz>=bPtr[i])
+			dPtr[i]=FrameSource::invalidDepth;
+	}
+
+inline ColorComponent avg(ColorComponent v1,ColorComponent v2)
+	{
+	return ColorComponent(((unsigned int)(v1)+(unsigned int)(v2)+1U)>>1);
+	}
+
+inline ColorComponent avg(ColorComponent v1,ColorComponent v2,ColorComponent v3)
+	{
+	return ColorComponent(((unsigned int)(v1)+(unsigned int)(v2)+(unsigned int)(v3)+1U)/3U);
+	}
+
+inline ColorComponent avg(ColorComponent v1,ColorComponent v2,ColorComponent v3,ColorComponent v4)
+	{
+	return ColorComponent(((unsigned int)(v1)+(unsigned int)(v2)+(unsigned int)(v3)+(unsigned int)(v4)+2U)>>2);
+	}
+
+/**************************************************************************
+Scalar kernels. Depth rows are unpacked from the given group-aligned
+column to the end of the row; color rows are converted in a half-open
+range of columns whose begin is zero or odd, and whose end is odd or the
+width of the frame.
+**************************************************************************/
+
+void unpackDepthRowScalar(const Byte* sRowPtr,int width,DepthPixel* dRowPtr,const DepthPixel* bRowPtr,int fuzz,int x)
+	{
+	/* Process pixels in groups of eight: */
+	const Byte* sPtr=sRowPtr+(x/8)*11;
+	for(;x<width;x+=8,sPtr+=11)
+		{
+		unpackGroup(sPtr,dRowPtr+x);
+		if(bRowPtr!=0)
+			removeBackground(dRowPtr+x,bRowPtr+x,8,fuzz);
+		}
+	}
+
+void demosaicFirstRow(const ColorComponent* rPtr,int stride,int width,ColorComponent* cPtr)
+	{
+	/* Convert the first row's first (G) pixel: */
+	*(cPtr++)=rPtr[1];
+	*(cPtr++)=rPtr[0];
+	*(cPtr++)=rPtr[stride];
+	++rPtr;
+	
+	/* Convert the first row's central pixels: */
+	for(int x=1;x<width-1;x+=2)
+		{
+		/* Convert the odd (R) pixel: */
+		*(cPtr++)=rPtr[0];
+		*(cPtr++)=avg(rPtr[-1],rPtr[1],rPtr[stride]);
+		*(cPtr++)=avg(rPtr[stride-1],rPtr[stride+1]);
+		++rPtr;
+		
+		/* Convert the even (G) pixel: */
+		*(cPtr++)=avg(rPtr[-1],rPtr[1]);
+		*(cPtr++)=rPtr[0];
+		*(cPtr++)=rPtr[stride];
+		++rPtr;
+		}
+	
+	/* Convert the first row's last (R) pixel: */
+	*(cPtr++)=rPtr[0];
+	*(cPtr++)=avg(rPtr[-1],rPtr[stride]);
+	*(cPtr++)=rPtr[stride-1];
+	}
+
+void demosaicOddRow(const ColorComponent* rRowPtr,int stride,int width,ColorComponent* cRowPtr,int x,int xEnd)
+	{
+	const ColorComponent* rPtr=rRowPtr+x;
+	ColorComponent* cPtr=cRowPtr+x*3;
+	
+	if(x==0)
+		{
+		/* Convert the odd row's first (B) pixel: */
+		*(cPtr++)=avg(rPtr[-stride+1],rPtr[stride+1]);
+		*(cPtr++)=avg(rPtr[-stride],rPtr[1],rPtr[stride]);
+		*(cPtr++)=rPtr[0];
+		++rPtr;
+		++x;
+		}
+	
+	/* Convert the odd row's central pixels: */
+	for(;x<xEnd&&x<width-1;x+=2)
+		{
+		/* Convert the odd (G) pixel: */
+		*(cPtr++)=avg(rPtr[-stride],rPtr[stride]);
+		*(cPtr++)=rPtr[0];
+		*(cPtr++)=avg(rPtr[-1],rPtr[1]);
+		++rPtr;
+		
+		/* Convert the even (B) pixel: */
+		*(cPtr++)=avg(rPtr[-stride-1],rPtr[-stride+1],rPtr[stride-1],rPtr[stride+1]);
+		*(cPtr++)=avg(rPtr[-stride],rPtr[-1],rPtr[1],rPtr[stride]);
+		*(cPtr++)=rPtr[0];
+		++rPtr;
+		}
+	
+	if(x<xEnd)
+		{
+		/* Convert the odd row's last (G) pixel: */
+		*(cPtr++)=avg(rPtr[-stride],rPtr[stride]);
+		*(cPtr++)=rPtr[0];
+		*(cPtr++)=rPtr[-1];
+		}
+	}
+
+void demosaicEvenRow(const ColorComponent* rRowPtr,int stride,int width,ColorComponent* cRowPtr,int x,int xEnd)
+	{
+	const ColorComponent* rPtr=rRowPtr+x;
+	ColorComponent* cPtr=cRowPtr+x*3;
+	
+	if(x==0)
+		{
+		/* Convert the even row's first (G) pixel: */
+		*(cPtr++)=rPtr[1];
+		*(cPtr++)=rPtr[0];
+		*(cPtr++)=avg(rPtr[-stride],rPtr[stride]);
+		++rPtr;
+		++x;
+		}
+	
+	/* Convert the even row's central pixels: */
+	for(;x<xEnd&&x<width-1;x+=2)
+		{
+		/* Convert the odd (R) pixel: */
+		*(cPtr++)=rPtr[0];
+		*(cPtr++)=avg(rPtr[-stride],rPtr[-1],rPtr[1],rPtr[stride]);
+		*(cPtr++)=avg(rPtr[-stride-1],rPtr[-stride+1],rPtr[stride-1],rPtr[stride+1]);
+		++rPtr;
+		
+		/* Convert the even (G) pixel: */
+		*(cPtr++)=avg(rPtr[-1],rPtr[1]);
+		*(cPtr++)=rPtr[0];
+		*(cPtr++)=avg(rPtr[-stride],rPtr[stride]);
+		++rPtr;
+		}
+	
+	if(x<xEnd)
+		{
+		/* Convert the even row's last (R) pixel: */
+		*(cPtr++)=rPtr[0];
+		*(cPtr++)=avg(rPtr[-stride],rPtr[-1],rPtr[stride]);
+		*(cPtr++)=avg(rPtr[-stride-1],rPtr[stride-1]);
+		}
+	}
+
+void demosaicLastRow(const ColorComponent* rPtr,int stride,int width,ColorComponent* cPtr)
+	{
+	/* Convert the last row's first (B) pixel: */
+	*(cPtr++)=rPtr[-stride+1];
+	*(cPtr++)=avg(rPtr[-stride],rPtr[1]);
+	*(cPtr++)=rPtr[0];
+	++rPtr;
+	
+	/* Convert the last row's central pixels: */
+	for(int x=1;x<width-1;x+=2)
+		{
+		/* Convert the odd (G) pixel: */
+		*(cPtr++)=rPtr[-stride];
+		*(cPtr++)=rPtr[0];
+		*(cPtr++)=avg(rPtr[-1],rPtr[1]);
+		++rPtr;
+		
+		/* Convert the even (B) pixel: */
+		*(cPtr++)=avg(rPtr[-stride-1],rPtr[-stride+1]);
+		*(cPtr++)=avg(rPtr[-stride],rPtr[-1],rPtr[1]);
+		*(cPtr++)=rPtr[0];
+		++rPtr;
+		}
+	
+	/* Convert the last row's last (G) pixel: */
+	*(cPtr++)=rPtr[-stride];
+	*(cPtr++)=rPtr[0];
+	*(cPtr++)=rPtr[-1];
+	}
+
+#if KINECTV1FRAMEDECODER_X86_KERNELS
+
+/**************************************************************************
+Vector kernels. Each group of eight depth pixels is gathered from its 11
+source bytes with two byte shuffles into the two or three bytes
+containing each pixel's bits; the per-pixel bit offsets are then applied
+as multiplications by powers of two. Color kernels convert the interior
+pixels of interior rows; averages of two values are calculated exactly
+by the byte averaging instruction, averages of four values in 16-bit
+lanes. All kernel sets produce identical results.
+**************************************************************************/
+
+__attribute__((target("ssse3")))
+inline __m128i unpackGroupSSSE3(const Byte* sPtr) // Unpacks eight pixels from 11 bytes; reads 16 bytes
+	{
+	const __m128i highShuffle=_mm_setr_epi8(1,0,2,1,3,2,5,4,6,5,7,6,9,8,10,9);
+	const __m128i lowShuffle=_mm_setr_epi8(2,-1,3,-1,4,-1,6,-1,7,-1,8,-1,10,-1,11,-1);
+	const __m128i shifts=_mm_setr_epi16(1,8,64,2,16,128,4,32);
+	__m128i raw=_mm_loadu_si128(reinterpret_cast<const __m128i*>(sPtr));
+	__m128i high=_mm_mullo_epi16(_mm_shuffle_epi8(raw,highShuffle),shifts);
+	__m128i low=_mm_mullo_epi16(_mm_shuffle_epi8(raw,lowShuffle),shifts);
+	return _mm_or_si128(_mm_srli_epi16(high,5),_mm_srli_epi16(low,13));
+	}
+
+__attribute__((target("ssse3")))
+inline __m128i removeBackgroundSSSE3(__m128i depth,const DepthPixel* bPtr,__m128i fuzz) // Invalidates all pixels at or behind the background
+	{
+	/* Compare in 32-bit lanes to match the scalar kernel's integer promotion: */
+	const __m128i zero=_mm_setzero_si128();
+	__m128i background=_mm_loadu_si128(reinterpret_cast<const __m128i*>(bPtr));
+	__m128i keepLow=_mm_cmpgt_epi32(_mm_unpacklo_epi16(background,zero),_mm_add_epi32(_mm_unpacklo_epi16(depth,zero),fuzz));
+	__m128i keepHigh=_mm_cmpgt_epi32(_mm_unpackhi_epi16(background,zero),_mm_add_epi32(_mm_unpackhi_epi16(depth,zero),fuzz));
+	__m128i keep=_mm_packs_epi32(keepLow,keepHigh);
+	return _mm_or_si128(_mm_and_si128(keep,depth),_mm_andnot_si128(keep,_mm_set1_epi16(FrameSource::invalidDepth)));
+	}
+
+__attribute__((target("ssse3")))
+int unpackDepthRowSSSE3(const Byte* sRowPtr,const Byte* sEnd,int width,DepthPixel* dRowPtr,const DepthPixel* bRowPtr,int fuzz,int x)
+	{
+	/* Process pixels in groups of eight while the 16-byte loads stay inside the raw frame: */
+	const Byte* sPtr=sRowPtr+(x/8)*11;
+	if(bRowPtr!=0)
+		{
+		__m128i fuzzv=_mm_set1_epi32(fuzz);
+		for(;x+8<=width&&sEnd-sPtr>=16;x+=8,sPtr+=11)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dRowPtr+x),removeBackgroundSSSE3(unpackGroupSSSE3(sPtr),bRowPtr+x,fuzzv));
+		}
+	else
+		{
+		for(;x+8<=width&&sEnd-sPtr>=16;x+=8,sPtr+=11)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dRowPtr+x),unpackGroupSSSE3(sPtr));
+		}
+	
+	return x;
+	}
+
+__attribute__((target("ssse3")))
+inline __m128i selectSSSE3(__m128i mask,__m128i v1,__m128i v2) // Selects bytes from the first vector where the mask is set, and from the second vector otherwise
+	{
+	return _mm_or_si128(_mm_and_si128(mask,v1),_mm_andnot_si128(mask,v2));
+	}
+
+__attribute__((target("ssse3")))
+inline __m128i avgSSSE3(__m128i v1,__m128i v2,__m128i v3,__m128i v4) // Averages four vectors of bytes with the same rounding as the scalar function
+	{
+	const __m128i zero=_mm_setzero_si128();
+	const __m128i two=_mm_set1_epi16(2);
+	__m128i low=_mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(v1,zero),_mm_unpacklo_epi8(v2,zero)),_mm_add_epi16(_mm_unpacklo_epi8(v3,zero),_mm_unpacklo_epi8(v4,zero)));
+	__m128i high=_mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(v1,zero),_mm_unpackhi_epi8(v2,zero)),_mm_add_epi16(_mm_unpackhi_epi8(v3,zero),_mm_unpackhi_epi8(v4,zero)));
+	return _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(low,two),2),_mm_srli_epi16(_mm_add_epi16(high,two),2));
+	}
+
+__attribute__((target("ssse3")))
+inline void storeRGBSSSE3(__m128i r,__m128i g,__m128i b,ColorComponent* cPtr) // Interleaves 16 red, green, and blue components into 16 RGB pixels
+	{
+	const __m128i r0=_mm_setr_epi8(0,-1,-1,1,-1,-1,2,-1,-1,3,-1,-1,4,-1,-1,5);
+	const __m128i g0=_mm_setr_epi8(-1,0,-1,-1,1,-1,-1,2,-1,-1,3,-1,-1,4,-1,-1);
+	const __m128i b0=_mm_setr_epi8(-1,-1,0,-1,-1,1,-1,-1,2,-1,-1,3,-1,-1,4,-1);
+	const __m128i r1=_mm_setr_epi8(-1,-1,6,-1,-1,7,-1,-1,8,-1,-1,9,-1,-1,10,-1);
+	const __m128i g1=_mm_setr_epi8(5,-1,-1,6,-1,-1,7,-1,-1,8,-1,-1,9,-1,-1,10);
+	const __m128i b1=_mm_setr_epi8(-1,5,-1,-1,6,-1,-1,7,-1,-1,8,-1,-1,9,-1,-1);
+	const __m128i r2=_mm_setr_epi8(-1,11,-1,-1,12,-1,-1,13,-1,-1,14,-1,-1,15,-1,-1);
+	const __m128i g2=_mm_setr_epi8(-1,-1,11,-1,-1,12,-1,-1,13,-1,-1,14,-1,-1,15,-1);
+	const __m128i b2=_mm_setr_epi8(10,-1,-1,11,-1,-1,12,-1,-1,13,-1,-1,14,-1,-1,15);
+	__m128i* vPtr=reinterpret_cast<__m128i*>(cPtr);
+	_mm_storeu_si128(vPtr+0,_mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r,r0),_mm_shuffle_epi8(g,g0)),_mm_shuffle_epi8(b,b0)));
+	_mm_storeu_si128(vPtr+1,_mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r,r1),_mm_shuffle_epi8(g,g1)),_mm_shuffle_epi8(b,b1)));
+	_mm_storeu_si128(vPtr+2,_mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r,r2),_mm_shuffle_epi8(g,g2)),_mm_shuffle_epi8(b,b2)));
+	}
+
+__attribute__((target("ssse3")))
+int demosaicRowSSSE3(const ColorComponent* rRowPtr,int stride,int width,ColorComponent* cRowPtr,bool oddRow,int x)
+	{
+	/* Bytes at even offsets correspond to odd columns, as x is always odd: */
+	const __m128i oddColumns=_mm_set1_epi16(0x00ff);
+	
+	/* Convert runs of 16 pixels while the loads stay inside the row: */
+	for(;x+16<=width-1;x+=16)
+		{
+		const ColorComponent* rPtr=rRowPtr+x;
+		__m128i c=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr));
+		__m128i l=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr-1));
+		__m128i r=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr+1));
+		__m128i u=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr-stride));
+		__m128i ul=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr-stride-1));
+		__m128i ur=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr-stride+1));
+		__m128i d=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr+stride));
+		__m128i dl=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr+stride-1));
+		__m128i dr=_mm_loadu_si128(reinterpret_cast<const __m128i*>(rPtr+stride+1));
+		
+		/* Calculate all interpolants: */
+		__m128i horizontal=_mm_avg_epu8(l,r);
+		__m128i vertical=_mm_avg_epu8(u,d);
+		__m128i cross=avgSSSE3(u,l,r,d);
+		__m128i diagonal=avgSSSE3(ul,ur,dl,dr);
+		
+		/* Assign interpolants to color components based on the pixels' positions in the Bayer pattern: */
+		if(oddRow)
+			storeRGBSSSE3(selectSSSE3(oddColumns,vertical,diagonal),selectSSSE3(oddColumns,c,cross),selectSSSE3(oddColumns,horizontal,c),cRowPtr+x*3);
+		else
+			storeRGBSSSE3(selectSSSE3(oddColumns,c,horizontal),selectSSSE3(oddColumns,cross,c),selectSSSE3(oddColumns,diagonal,vertical),cRowPtr+x*3);
+		}
+	
+	return x;
+	}
+
+__attribute__((target("avx2")))
+inline __m256i unpackGroupsAVX2(const Byte* sPtr) // Unpacks two groups of eight pixels from 22 bytes; reads 27 bytes
+	{
+	const __m256i highShuffle=_mm256_setr_epi8(1,0,2,1,3,2,5,4,6,5,7,6,9,8,10,9,1,0,2,1,3,2,5,4,6,5,7,6,9,8,10,9);
+	const __m256i lowShuffle=_mm256_setr_epi8(2,-1,3,-1,4,-1,6,-1,7,-1,8,-1,10,-1,11,-1,2,-1,3,-1,4,-1,6,-1,7,-1,8,-1,10,-1,11,-1);
+	const __m256i shifts=_mm256_setr_epi16(1,8,64,2,16,128,4,32,1,8,64,2,16,128,4,32);
+	__m256i raw=_mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sPtr))),_mm_loadu_si128(reinterpret_cast<const __m128i*>(sPtr+11)),1);
+	__m256i high=_mm256_mullo_epi16(_mm256_shuffle_epi8(raw,highShuffle),shifts);
+	__m256i low=_mm256_mullo_epi16(_mm256_shuffle_epi8(raw,lowShuffle),shifts);
+	return _mm256_or_si256(_mm256_srli_epi16(high,5),_mm256_srli_epi16(low,13));
+	}
+
+__attribute__((target("avx2")))
+inline __m256i removeBackgroundAVX2(__m256i depth,const DepthPixel* bPtr,__m256i fuzz) // Invalidates all pixels at or behind the background
+	{
+	/* Compare in 32-bit lanes; unpacking and packing within 128-bit lanes retains pixel order: */
+	const __m256i zero=_mm256_setzero_si256();
+	__m256i background=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bPtr));
+	__m256i keepLow=_mm256_cmpgt_epi32(_mm256_unpacklo_epi16(background,zero),_mm256_add_epi32(_mm256_unpacklo_epi16(depth,zero),fuzz));
+	__m256i keepHigh=_mm256_cmpgt_epi32(_mm256_unpackhi_epi16(background,zero),_mm256_add_epi32(_mm256_unpackhi_epi16(depth,zero),fuzz));
+	__m256i keep=_mm256_packs_epi32(keepLow,keepHigh);
+	return _mm256_blendv_epi8(_mm256_set1_epi16(FrameSource::invalidDepth),depth,keep);
+	}
+
+__attribute__((target("avx2")))
+int unpackDepthRowAVX2(const Byte* sRowPtr,const Byte* sEnd,int width,DepthPixel* dRowPtr,const DepthPixel* bRowPtr,int fuzz,int x)
+	{
+	/* Process pixels in groups of sixteen while the 16-byte loads stay inside the raw frame: */
+	const Byte* sPtr=sRowPtr+(x/8)*11;
+	if(bRowPtr!=0)
+		{
+		__m256i fuzzv=_mm256_set1_epi32(fuzz);
+		for(;x+16<=width&&sEnd-sPtr>=27;x+=16,sPtr+=22)
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dRowPtr+x),removeBackgroundAVX2(unpackGroupsAVX2(sPtr),bRowPtr+x,fuzzv));
+		}
+	else
+		{
+		for(;x+16<=width&&sEnd-sPtr>=27;x+=16,sPtr+=22)
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dRowPtr+x),unpackGroupsAVX2(sPtr));
+		}
+	
+	return x;
+	}
+
+__attribute__((target("avx2")))
+inline __m256i avgAVX2(__m256i v1,__m256i v2,__m256i v3,__m256i v4) // Averages four vectors of bytes with the same rounding as the scalar function
+	{
+	const __m256i zero=_mm256_setzero_si256();
+	const __m256i two=_mm256_set1_epi16(2);
+	__m256i low=_mm256_add_epi16(_mm256_add_epi16(_mm256_unpacklo_epi8(v1,zero),_mm256_unpacklo_epi8(v2,zero)),_mm256_add_epi16(_mm256_unpacklo_epi8(v3,zero),_mm256_unpacklo_epi8(v4,zero)));
+	__m256i high=_mm256_add_epi16(_mm256_add_epi16(_mm256_unpackhi_epi8(v1,zero),_mm256_unpackhi_epi8(v2,zero)),_mm256_add_epi16(_mm256_unpackhi_epi8(v3,zero),_mm256_unpackhi_epi8(v4,zero)));
+	return _mm256_packus_epi16(_mm256_srli_epi16(_mm256_add_epi16(low,two),2),_mm256_srli_epi16(_mm256_add_epi16(high,two),2));
+	}
+
+__attribute__((target("avx2")))
+inline void storeRGBAVX2(__m256i r,__m256i g,__m256i b,ColorComponent* cPtr) // Interleaves 32 red, green, and blue components into 32 RGB pixels
+	{
+	storeRGBSSSE3(_mm256_castsi256_si128(r),_mm256_castsi256_si128(g),_mm256_castsi256_si128(b),cPtr);
+	storeRGBSSSE3(_mm256_extracti128_si256(r,1),_mm256_extracti128_si256(g,1),_mm256_extracti128_si256(b,1),cPtr+16*3);
+	}
+
+__attribute__((target("avx2")))
+int demosaicRowAVX2(const ColorComponent* rRowPtr,int stride,int width,ColorComponent* cRowPtr,bool oddRow,int x)
+	{
+	/* Bytes at even offsets correspond to odd columns, as x is always odd: */
+	const __m256i oddColumns=_mm256_set1_epi16(0x00ff);
+	
+	/* Convert runs of 32 pixels while the loads stay inside the row: */
+	for(;x+32<=width-1;x+=32)
+		{
+		const ColorComponent* rPtr=rRowPtr+x;
+		__m256i c=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(rPtr));
+		__m256i l=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(rPtr-1));
+		__m256i r=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(rPtr+1));
+		__m256i u=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(rPtr-stride));
+		__m256i ul=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(rPtr-stride-1));
+		__m256i ur=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(rPtr-stride+1));
+		__m256i d=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(rPtr+stride));
+		__m256i dl=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(rPtr+stride-1));
+		__m256i dr=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(rPtr+stride+1));
+		
+		/* Calculate all interpolants: */
+		__m256i horizontal=_mm256_avg_epu8(l,r);
+		__m256i vertical=_mm256_avg_epu8(u,d);
+		__m256i cross=avgAVX2(u,l,r,d);
+		__m256i diagonal=avgAVX2(ul,ur,dl,dr);
+		
+		/* Assign interpolants to color components based on the pixels' positions in the Bayer pattern: */
+		if(oddRow)
+			storeRGBAVX2(_mm256_blendv_epi8(diagonal,vertical,oddColumns),_mm256_blendv_epi8(cross,c,oddColumns),_mm256_blendv_epi8(c,horizontal,oddColumns),cRowPtr+x*3);
+		else
+			storeRGBAVX2(_mm256_blendv_epi8(horizontal,c,oddColumns),_mm256_blendv_epi8(c,cross,oddColumns),_mm256_blendv_epi8(vertical,diagonal,oddColumns),cRowPtr+x*3);
+		}
+	
+	return x;
+	}
+
+#endif
+
+}
+
+/*************************************
+Methods of class KinectV1FrameDecoder:
+*************************************/
+
+KinectV1FrameDecoder::KinectV1FrameDecoder(void)
+	:kernelSet(getBestKernelSet())
+	{
+	}
+
+bool KinectV1FrameDecoder::isKernelSetSupported(KinectV1FrameDecoder::KernelSet kernelSet)
+	{
+	switch(kernelSet)
+		{
+		case SCALAR:
+			return true;
+		
+		#if KINECTV1FRAMEDECODER_X86_KERNELS
+		case SSSE3:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("ssse3");
+		
+		case AVX2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+		#endif
+		
+		default:
+			return false;
+		}
+	}
+
+KinectV1FrameDecoder::KernelSet KinectV1FrameDecoder::getBestKernelSet(void)
+	{
+	/* Return the widest supported kernel set: */
+	KernelSet result=SCALAR;
+	for(int ks=SSSE3;ks<NUM_KERNELSETS;++ks)
+		if(isKernelSetSupported(KernelSet(ks)))
+			result=KernelSet(ks);
+	return result;
+	}
+
+const char* KinectV1FrameDecoder::getKernelSetName(KinectV1FrameDecoder::KernelSet kernelSet)
+	{
+	static const char* kernelSetNames[NUM_KERNELSETS]={"scalar","SSSE3","AVX2"};
+	return kernelSet>=SCALAR&&kernelSet<NUM_KERNELSETS?kernelSetNames[kernelSet]:"invalid";
+	}
+
+void KinectV1FrameDecoder::setKernelSet(KinectV1FrameDecoder::KernelSet newKernelSet)
+	{
+	if(!isKernelSetSupported(newKernelSet))
+		Misc::throwStdErr("Kinect::KinectV1FrameDecoder::setKernelSet: Kernel set %s is not supported",getKernelSetName(newKernelSet));
+	kernelSet=newKernelSet;
+	}
+
+void KinectV1FrameDecoder::unpackDepth(const Misc::UInt8* rawFrame,int width,int height,FrameSource::DepthPixel* depthFrame,const FrameSource::DepthPixel* backgroundFrame,int backgroundRemovalFuzz) const
+	{
+	const Byte* sRowPtr=rawFrame;
+	const Byte* sEnd=rawFrame+(width*height*11)/8;
+	int sStride=(width*11)/8;
+	DepthPixel* dRowPtr=depthFrame+width*(height-1);
+	const DepthPixel* bRowPtr=backgroundFrame!=0?backgroundFrame+width*(height-1):0;
+	
+	/* Process rows: */
+	for(int y=0;y<height;++y,sRowPtr+=sStride,dRowPtr-=width) // Flip the depth image vertically
+		{
+		/* Unpack the row with the selected kernel set, and finish the remainder with narrower kernels: */
+		int x=0;
+		switch(kernelSet)
+			{
+			#if KINECTV1FRAMEDECODER_X86_KERNELS
+			case AVX2:
+				x=unpackDepthRowAVX2(sRowPtr,sEnd,width,dRowPtr,bRowPtr,backgroundRemovalFuzz,x);
+				// Fall through
+			
+			case SSSE3:
+				x=unpackDepthRowSSSE3(sRowPtr,sEnd,width,dRowPtr,bRowPtr,backgroundRemovalFuzz,x);
+				break;
+			#endif
+			
+			default:
+				;
+			}
+		unpackDepthRowScalar(sRowPtr,width,dRowPtr,bRowPtr,backgroundRemovalFuzz,x);
+		
+		if(bRowPtr!=0)
+			bRowPtr-=width;
+		}
+	}
+
+void KinectV1FrameDecoder::demosaicColor(const Misc::UInt8* rawFrame,int width,int height,FrameSource::ColorComponent* colorFrame) const
+	{
+	int stride=width;
+	const ColorComponent* rRowPtr=rawFrame;
+	ColorComponent* cRowPtr=colorFrame;
+	cRowPtr+=(height-1)*stride*3; // Flip the color image vertically
+	
+	/* Convert the first row: */
+	demosaicFirstRow(rRowPtr,stride,width,cRowPtr);
+	rRowPtr+=stride;
+	cRowPtr-=stride*3;
+	
+	/* Convert the central rows: */
+	for(int y=1;y<height-1;++y,rRowPtr+=stride,cRowPtr-=stride*3)
+		{
+		/* Convert the row's interior pixels with the selected kernel set, and the remainder with the scalar kernel: */
+		bool oddRow=(y&0x1)!=0;
+		int x=1;
+		switch(kernelSet)
+			{
+			#if KINECTV1FRAMEDECODER_X86_KERNELS
+			case AVX2:
+				x=demosaicRowAVX2(rRowPtr,stride,width,cRowPtr,oddRow,x);
+				// Fall through
+			
+			case SSSE3:
+				x=demosaicRowSSSE3(rRowPtr,stride,width,cRowPtr,oddRow,x);
+				break;
+			#endif
+			
+			default:
+				;
+			}
+		if(oddRow)
+			{
+			demosaicOddRow(rRowPtr,stride,width,cRowPtr,0,1);
+			demosaicOddRow(rRowPtr,stride,width,cRowPtr,x,width);
+			}
+		else
+			{
+			demosaicEvenRow(rRowPtr,stride,width,cRowPtr,0,1);
+			demosaicEvenRow(rRowPtr,stride,width,cRowPtr,x,width);
+			}
+		}
+	
+	/* Convert the last row: */
+	demosaicLastRow(rRowPtr,stride,width,cRowPtr);
+	}
+
+}
@@ -0,0 +1,69 @@
+/***********************************************************************
+KinectV1FrameDecoder - Class to unpack raw 11-bit depth frames and to
+demosaic raw Bayer-pattern color frames received from a first-generation
+Kinect camera, using vectorized kernels where available.
+Copyright (c) 2010-2020 Oliver Kreylos
+
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#ifndef KINECT_INTERNAL_KINECTV1FRAMEDECODER_INCLUDED
+#define KINECT_INTERNAL_KINECTV1FRAMEDECODER_INCLUDED
+
+#include <Misc/SizedTypes.h>
+#include <Kinect/FrameSource.h>
+
+namespace Kinect {
+
+class KinectV1FrameDecoder
+	{
+	/* Embedded classes: */
+	public:
+	enum KernelSet // Enumerated type for sets of frame decoding kernels
+		{
+		SCALAR=0, // Portable per-pixel reference kernels
+		SSSE3, // 16-byte kernels using SSSE3 byte shuffles
+		AVX2, // 32-byte kernels using AVX2 instructions
+		NUM_KERNELSETS
+		};
+	
+	/* Elements: */
+	private:
+	KernelSet kernelSet; // Set of kernels used for frame decoding
+	
+	/* Constructors and destructors: */
+	public:
+	KinectV1FrameDecoder(void); // Creates a decoder using the fastest kernel set supported by the current CPU
+	
+	/* Methods: */
+	static bool isKernelSetSupported(KernelSet kernelSet); // Returns true if the given kernel set is compiled in and supported by the current CPU
+	static KernelSet getBestKernelSet(void); // Returns the fastest kernel set supported by the current CPU
+	static const char* getKernelSetName(KernelSet kernelSet); // Returns a human-readable name for the given kernel set
+	KernelSet getKernelSet(void) const // Returns the currently used kernel set
+		{
+		return kernelSet;
+		}
+	void setKernelSet(KernelSet newKernelSet); // Selects a kernel set; throws exception if the kernel set is not supported
+	void unpackDepth(const Misc::UInt8* rawFrame,int width,int height,FrameSource::DepthPixel* depthFrame,const FrameSource::DepthPixel* backgroundFrame,int backgroundRemovalFuzz) const; // Unpacks a raw frame of packed 11-bit depth values into the given depth frame, flipping it vertically; width must be a multiple of eight; removes pixels at or behind the given background frame if it is not null
+	void demosaicColor(const Misc::UInt8* rawFrame,int width,int height,FrameSource::ColorComponent* colorFrame) const; // Converts a raw frame in Bayer GRBG pattern into the given RGB color frame, flipping it vertically; width and height must be even
+	};
+
+}
+
+#endif
@@ -0,0 +1,1232 @@
+/***********************************************************************
+KinectV2DepthDecoder - Class to convert triplets of raw gated IR images
+from a Kinect v2 camera into phase images, and phase images into
+quantized depth images, using vectorized kernels where available.
+Copyright (c) 2015-2020 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <Kinect/Internal/KinectV2DepthDecoder.h>
+
+#include <Misc/ThrowStdErr.h>
+#include <Math/Math.h>
+#include <Math/Constants.h>
+#include <Kinect/LensDistortion.h>
+#include <Kinect/WorkerPool.h>
+
+/* Check whether the x86 vector kernels can be compiled: */
+#if defined(__GNUC__)&&(defined(__x86_64__)||defined(__i386__))
+#define KINECTV2DEPTHDECODER_X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define KINECTV2DEPTHDECODER_X86_KERNELS 0
+#endif
+
+namespace Kinect {
+
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+struct PhaseKernelParameters // Structure holding the parameters of the phase calculation kernels
+	{
+	/* Elements: */
+	public:
+	const KinectV2DepthDecoder::IRPixel* ir[3]; // Triplet of raw gated IR images
+	const float* tt[6]; // Cosines of the three per-image phase angles, followed by negated sines
+	const float* arctanTable; // Table to calculate phase angles from orthogonal vectors
+	float magnitudeFactor; // Multiplication factor for IR pixel intensity
+	float* angles; // Output phase angle image
+	float* magnitudes; // Output phase vector magnitude image
+	};
+
+struct DepthKernelParameters // Structure holding the parameters of the depth calculation kernels
+	{
+	/* Elements: */
+	public:
+	const float* angles[3]; // Three phase angle images
+	const float* magnitudes[3]; // Three phase vector magnitude images
+	const float* xTable;
+	const float* zTable;
+	const float* confidenceTable;
+	float magThreshold1,magThreshold2;
+	float phaseOffset;
+	float unambiguousDistance;
+	float* depthImage; // Output linear depth image
+	};
+
+struct FilterKernelParameters // Structure holding the parameters of the filtering and quantization kernels
+	{
+	/* Elements: */
+	public:
+	const float* depthImage; // Unfiltered linear depth image
+	float* filterImage; // Horizontally filtered linear depth image
+	float filterDistanceThreshold;
+	float zMin,zMax;
+	float A,B;
+	FrameSource::DepthPixel* depthFrame; // Output quantized depth image
+	};
+
+/****************
+Helper functions:
+****************/
+
+inline float filterPixel(float last,float center,float next,float threshold) // Applies the edge-preserving low-pass filter to an interior pixel
+	{
+	float sum=center+center;
+	float weight=2.0f;
+	if(Math::abs(center-last)<threshold)
+		{
+		sum+=last;
+		weight+=1.0f;
+		}
+	if(Math::abs(center-next)<threshold)
+		{
+		sum+=next;
+		weight+=1.0f;
+		}
+	return sum/weight;
+	}
+
+inline float filterFirstPixel(float center,float next,float threshold) // Applies the edge-preserving low-pass filter to the first pixel of a row or column
+	{
+	if(Math::abs(center-next)<threshold)
+		return center*0.667f+next*0.333f;
+	else
+		return center;
+	}
+
+inline float filterLastPixel(float last,float center,float threshold) // Applies the edge-preserving low-pass filter to the last pixel of a row or column
+	{
+	if(Math::abs(center-last)<threshold)
+		return last*0.333f+center*0.667f;
+	else
+		return center;
+	}
+
+inline FrameSource::DepthPixel quantizePixel(float depth,const FilterKernelParameters& p) // Quantizes a linear depth value
+	{
+	if(depth<p.zMin||depth>p.zMax)
+		return FrameSource::invalidDepth;
+	else
+		return FrameSource::DepthPixel(p.B-p.A/depth);
+	}
+
+/**************************************************************************
+The vector kernels below calculate exactly the same sequence of IEEE
+single-precision operations in the same order as the scalar kernels, and
+only replace branches by blends and table lookups by gathers. As long as
+the library is compiled without floating-point contraction or fast-math
+optimizations, all kernel sets produce identical results.
+**************************************************************************/
+
+/* Scalar reference kernels: */
+
+void calcPhasesScalar(const PhaseKernelParameters& p,unsigned int pixelBegin,unsigned int pixelEnd)
+	{
+	const float* arctanTable=p.arctanTable;
+	for(unsigned int i=pixelBegin;i<pixelEnd;++i)
+		{
+		/* Check for pixel saturation: */
+		float angle=0.0f;
+		float magnitude=0.0f;
+		if(p.ir[0][i]!=32767&&p.ir[1][i]!=32767&&p.ir[2][i]!=32767)
+			{
+			/* Calculate the phase vector normally: */
+			float x=p.tt[0][i]*float(p.ir[0][i])+p.tt[1][i]*float(p.ir[1][i])+p.tt[2][i]*float(p.ir[2][i]);
+			float y=p.tt[3][i]*float(p.ir[0][i])+p.tt[4][i]*float(p.ir[1][i])+p.tt[5][i]*float(p.ir[2][i]);
+			
+			/* Calculate the pixel's phase angle in the [0, 2pi) range: */
+			if(y>=0.0f)
+				{
+				if(x>=0.0f)
+					{
+					if(y<=x)
+						{
+						if(x>0.0f)
+							{
+							/* 0-45 degrees: */
+							angle=arctanTable[int(y*8192.0f/x)];
+							}
+						else
+							angle=0.0f; // NaN, actually
+						}
+					else
+						{
+						/* 45-90 degrees: */
+						angle=0.5f*Math::Constants<float>::pi-arctanTable[int(x*8192.0f/y)];
+						}
+					}
+				else // x<0.0f
+					{
+					if(-x<=y)
+						{
+						/* 90-135 degrees: */
+						angle=0.5f*Math::Constants<float>::pi+arctanTable[int(x*-8192.0f/y)];
+						}
+					else
+						{
+						/* 135-180 degrees: */
+						angle=1.0f*Math::Constants<float>::pi-arctanTable[int(y*-8192.0f/x)];
+						}
+					}
+				}
+			else // y<0.0f
+				{
+				if(x<=0.0f)
+					{
+					if(x<=y)
+						{
+						/* 180-225 degrees: */
+						angle=1.0f*Math::Constants<float>::pi+arctanTable[int(y*8192.0f/x)];
+						}
+					else
+						{
+						/* 225-270 degrees: */
+						angle=1.5f*Math::Constants<float>::pi-arctanTable[int(x*8192.0f/y)];
+						}
+					}
+				else
+					{
+					if(x<=-y)
+						{
+						/* 270-315 degrees: */
+						angle=1.5f*Math::Constants<float>::pi+arctanTable[int(x*-8192.0f/y)];
+						}
+					else
+						{
+						/* 315-360 degrees: */
+						angle=2.0f*Math::Constants<float>::pi-arctanTable[int(y*-8192.0f/x)];
+						}
+					}
+				}
+			
+			/* Calculate the pixel's magnitude: */
+			magnitude=Math::sqrt(x*x+y*y)*p.magnitudeFactor;
+			}
+		
+		p.angles[i]=angle;
+		p.magnitudes[i]=magnitude;
+		}
+	}
+
+void calcDepthsScalar(const DepthKernelParameters& p,unsigned int pixelBegin,unsigned int pixelEnd)
+	{
+	const float twoPi=2.0f*Math::Constants<float>::pi;
+	for(unsigned int i=pixelBegin;i<pixelEnd;++i)
+		{
+		float depth=0.0f;
+		
+		float mag0=p.magnitudes[0][i];
+		float mag1=p.magnitudes[1][i];
+		float mag2=p.magnitudes[2][i];
+		float magSum=mag0+mag1+mag2;
+		float magMin=Math::min(mag0,Math::min(mag1,mag2));
+		if(magMin>=p.magThreshold1&&magSum>=p.magThreshold2)
+			{
+			/* Convert phase angles to wave distances: */
+			float t0=p.angles[0][i]*3.0f/twoPi;
+			float t1=p.angles[1][i]*15.0f/twoPi;
+			float t2=p.angles[2][i]*2.0f/twoPi;
+			
+			float t5=Math::floor((t1-t0)*0.333333f+0.5f)*3.0f+t0;
+			float t3=t5-t2;
+			float f1=t3>=0.0f?2.0f:-2.0f;
+			float f2=t3>=0.0f?0.5f:-0.5f;
+			t3*=f2;
+			t3=(t3-int(t3))*f1; // t3 is always >=0
+			
+			float t6=t5;
+			float t7=t1;
+			if(0.5f<Math::abs(t3)&&Math::abs(t3)<1.5f)
+				{
+				t6+=15.0f;
+				t7+=15.0f;
+				}
+			
+			float t8=(Math::floor((t6-t2)*0.5f+0.5f)*2.0f+t2)*0.5f;
+			
+			t6/=3.0f;
+			t7/=15.0f;
+			
+			float t9=(t6+t7+t8);
+			float t10=t9/3.0f;
+			
+			t6*=twoPi;
+			t7*=twoPi;
+			t8*=twoPi;
+			
+			float t6p=t8*0.551318f-t6*0.826977f;
+			float t7p=t6*0.110264f-t7*0.551318f;
+			float t8p=t7*0.826977f-t8*0.110264f;
+			
+			float norm=t6p*t6p+t7p*t7p+t8p*t8p;
+			if(t9<0.0f)
+				t10=0.0f;
+			
+			/* Check the dealiasing confidence (use magMin instead of the maximum magnitude when confidenceSlope>0.0f): */
+			float irX=p.confidenceTable[Math::clamp(int(Math::max(mag0,Math::max(mag1,mag2))),304,871)-304];
+			float phase=irX>=norm?t10:0.0f;
+			if(phase>0.0f)
+				{
+				phase+=p.phaseOffset;
+				
+				float depthLinear=p.zTable[i]*phase;
+				float maxDepth=phase*p.unambiguousDistance*2.0f;
+				
+				float xFactor=p.xTable[i]*90.0f/(maxDepth*maxDepth*8192.0f);
+				float denominator=(1.0f-depthLinear*xFactor);
+				if(denominator>0.0f)
+					depth=depthLinear/denominator;
+				}
+			}
+		
+		p.depthImage[i]=depth;
+		}
+	}
+
+void filterRowsScalar(const FilterKernelParameters& p,int rowBegin,int rowEnd)
+	{
+	const int w=int(KinectV2DepthDecoder::width);
+	float th=p.filterDistanceThreshold;
+	for(int y=rowBegin;y<rowEnd;++y)
+		{
+		const float* diRow=p.depthImage+y*w;
+		float* fiRow=p.filterImage+y*w;
+		fiRow[0]=filterFirstPixel(diRow[0],diRow[1],th);
+		for(int x=1;x<w-1;++x)
+			fiRow[x]=filterPixel(diRow[x-1],diRow[x],diRow[x+1],th);
+		fiRow[w-1]=filterLastPixel(diRow[w-2],diRow[w-1],th);
+		}
+	}
+
+void filterColumnsScalar(const FilterKernelParameters& p,int rowBegin,int rowEnd)
+	{
+	const int w=int(KinectV2DepthDecoder::width);
+	const int h=int(KinectV2DepthDecoder::height);
+	float th=p.filterDistanceThreshold;
+	for(int y=rowBegin;y<rowEnd;++y)
+		{
+		const float* fiRow=p.filterImage+y*w;
+		FrameSource::DepthPixel* dfRow=p.depthFrame+y*w;
+		for(int x=0;x<w;++x)
+			{
+			float depth;
+			if(y==0)
+				depth=filterFirstPixel(fiRow[x],fiRow[x+w],th);
+			else if(y==h-1)
+				depth=filterLastPixel(fiRow[x-w],fiRow[x],th);
+			else
+				depth=filterPixel(fiRow[x-w],fiRow[x],fiRow[x+w],th);
+			dfRow[x]=quantizePixel(depth,p);
+			}
+		}
+	}
+
+#if KINECTV2DEPTHDECODER_X86_KERNELS
+
+/* SSE4.1 kernels: */
+
+__attribute__((target("sse4.1")))
+void calcPhasesSSE41(const PhaseKernelParameters& p,unsigned int pixelBegin,unsigned int pixelEnd)
+	{
+	const __m128 zero=_mm_setzero_ps();
+	const __m128 signMask=_mm_set1_ps(-0.0f);
+	const __m128 one=_mm_set1_ps(1.0f);
+	const __m128 tableScale=_mm_set1_ps(8192.0f);
+	const __m128 halfPi=_mm_set1_ps(0.5f*Math::Constants<float>::pi);
+	const __m128 pi=_mm_set1_ps(1.0f*Math::Constants<float>::pi);
+	const __m128 threeHalfPi=_mm_set1_ps(1.5f*Math::Constants<float>::pi);
+	const __m128 twoPi=_mm_set1_ps(2.0f*Math::Constants<float>::pi);
+	const __m128i saturated=_mm_set1_epi32(32767);
+	const __m128 magnitudeFactor=_mm_set1_ps(p.magnitudeFactor);
+	
+	unsigned int i=pixelBegin;
+	for(;i+4<=pixelEnd;i+=4)
+		{
+		/* Load four pixels of the three raw images and check for saturation: */
+		__m128i ir0=_mm_cvtepi16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p.ir[0]+i)));
+		__m128i ir1=_mm_cvtepi16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p.ir[1]+i)));
+		__m128i ir2=_mm_cvtepi16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p.ir[2]+i)));
+		__m128 sat=_mm_castsi128_ps(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi32(ir0,saturated),_mm_cmpeq_epi32(ir1,saturated)),_mm_cmpeq_epi32(ir2,saturated)));
+		__m128 i0=_mm_cvtepi32_ps(ir0);
+		__m128 i1=_mm_cvtepi32_ps(ir1);
+		__m128 i2=_mm_cvtepi32_ps(ir2);
+		
+		/* Calculate the phase vectors: */
+		__m128 x=_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p.tt[0]+i),i0),_mm_mul_ps(_mm_loadu_ps(p.tt[1]+i),i1)),_mm_mul_ps(_mm_loadu_ps(p.tt[2]+i),i2));
+		__m128 y=_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p.tt[3]+i),i0),_mm_mul_ps(_mm_loadu_ps(p.tt[4]+i),i1)),_mm_mul_ps(_mm_loadu_ps(p.tt[5]+i),i2));
+		
+		/* Look up the arctangent of the smaller over the larger vector component: */
+		__m128 ax=_mm_andnot_ps(signMask,x);
+		__m128 ay=_mm_andnot_ps(signMask,y);
+		__m128 num=_mm_min_ps(ax,ay);
+		__m128 den=_mm_max_ps(ax,ay);
+		__m128 null=_mm_cmpeq_ps(den,zero);
+		den=_mm_blendv_ps(den,one,null);
+		__m128i index=_mm_cvttps_epi32(_mm_div_ps(_mm_mul_ps(num,tableScale),den));
+		int indices[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(indices),index);
+		__m128 a=_mm_setr_ps(p.arctanTable[indices[0]],p.arctanTable[indices[1]],p.arctanTable[indices[2]],p.arctanTable[indices[3]]);
+		
+		/* Select the octant of each phase vector exactly as the scalar kernel does: */
+		__m128 upper=_mm_cmpge_ps(y,zero);
+		__m128 right=_mm_cmpge_ps(x,zero);
+		__m128 left=_mm_cmple_ps(x,zero);
+		__m128 evenQuadrant=_mm_blendv_ps(left,right,upper);
+		__m128 firstHalf=_mm_blendv_ps(_mm_cmple_ps(ax,ay),_mm_cmple_ps(ay,ax),evenQuadrant);
+		__m128 baseFirst=_mm_blendv_ps(_mm_blendv_ps(threeHalfPi,pi,left),_mm_blendv_ps(halfPi,zero,right),upper);
+		__m128 baseSecond=_mm_blendv_ps(_mm_blendv_ps(twoPi,threeHalfPi,left),_mm_blendv_ps(pi,halfPi,right),upper);
+		__m128 angle=_mm_blendv_ps(_mm_sub_ps(baseSecond,a),_mm_add_ps(baseFirst,a),firstHalf);
+		angle=_mm_andnot_ps(_mm_or_ps(null,sat),angle);
+		
+		/* Calculate the phase vector magnitudes: */
+		__m128 magnitude=_mm_mul_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x,x),_mm_mul_ps(y,y))),magnitudeFactor);
+		magnitude=_mm_andnot_ps(sat,magnitude);
+		
+		_mm_storeu_ps(p.angles+i,angle);
+		_mm_storeu_ps(p.magnitudes+i,magnitude);
+		}
+	
+	/* Process leftover pixels: */
+	if(i<pixelEnd)
+		calcPhasesScalar(p,i,pixelEnd);
+	}
+
+__attribute__((target("sse4.1")))
+void calcDepthsSSE41(const DepthKernelParameters& p,unsigned int pixelBegin,unsigned int pixelEnd)
+	{
+	const __m128 zero=_mm_setzero_ps();
+	const __m128 signMask=_mm_set1_ps(-0.0f);
+	const __m128 half=_mm_set1_ps(0.5f);
+	const __m128 one=_mm_set1_ps(1.0f);
+	const __m128 two=_mm_set1_ps(2.0f);
+	const __m128 three=_mm_set1_ps(3.0f);
+	const __m128 fifteen=_mm_set1_ps(15.0f);
+	const __m128 twoPi=_mm_set1_ps(2.0f*Math::Constants<float>::pi);
+	const __m128 magThreshold1=_mm_set1_ps(p.magThreshold1);
+	const __m128 magThreshold2=_mm_set1_ps(p.magThreshold2);
+	const __m128 phaseOffset=_mm_set1_ps(p.phaseOffset);
+	const __m128 unambiguousDistance=_mm_set1_ps(p.unambiguousDistance);
+	
+	unsigned int i=pixelBegin;
+	for(;i+4<=pixelEnd;i+=4)
+		{
+		__m128 mag0=_mm_loadu_ps(p.magnitudes[0]+i);
+		__m128 mag1=_mm_loadu_ps(p.magnitudes[1]+i);
+		__m128 mag2=_mm_loadu_ps(p.magnitudes[2]+i);
+		__m128 magSum=_mm_add_ps(_mm_add_ps(mag0,mag1),mag2);
+		__m128 magMin=_mm_min_ps(mag0,_mm_min_ps(mag1,mag2));
+		__m128 magMax=_mm_max_ps(mag0,_mm_max_ps(mag1,mag2));
+		__m128 valid=_mm_and_ps(_mm_cmpge_ps(magMin,magThreshold1),_mm_cmpge_ps(magSum,magThreshold2));
+		
+		/* Convert phase angles to wave distances: */
+		__m128 t0=_mm_div_ps(_mm_mul_ps(_mm_loadu_ps(p.angles[0]+i),three),twoPi);
+		__m128 t1=_mm_div_ps(_mm_mul_ps(_mm_loadu_ps(p.angles[1]+i),fifteen),twoPi);
+		__m128 t2=_mm_div_ps(_mm_mul_ps(_mm_loadu_ps(p.angles[2]+i),two),twoPi);
+		
+		__m128 t5=_mm_add_ps(_mm_mul_ps(_mm_floor_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(t1,t0),_mm_set1_ps(0.333333f)),half)),three),t0);
+		__m128 t3=_mm_sub_ps(t5,t2);
+		__m128 t3Positive=_mm_cmpge_ps(t3,zero);
+		t3=_mm_mul_ps(t3,_mm_blendv_ps(_mm_set1_ps(-0.5f),half,t3Positive));
+		t3=_mm_mul_ps(_mm_sub_ps(t3,_mm_cvtepi32_ps(_mm_cvttps_epi32(t3))),_mm_blendv_ps(_mm_set1_ps(-2.0f),two,t3Positive));
+		
+		__m128 at3=_mm_andnot_ps(signMask,t3);
+		__m128 shift=_mm_and_ps(_mm_cmplt_ps(half,at3),_mm_cmplt_ps(at3,_mm_set1_ps(1.5f)));
+		__m128 t6=_mm_blendv_ps(t5,_mm_add_ps(t5,fifteen),shift);
+		__m128 t7=_mm_blendv_ps(t1,_mm_add_ps(t1,fifteen),shift);
+		
+		__m128 t8=_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_floor_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(t6,t2),half),half)),two),t2),half);
+		
+		t6=_mm_div_ps(t6,three);
+		t7=_mm_div_ps(t7,fifteen);
+		
+		__m128 t9=_mm_add_ps(_mm_add_ps(t6,t7),t8);
+		__m128 t10=_mm_div_ps(t9,three);
+		
+		t6=_mm_mul_ps(t6,twoPi);
+		t7=_mm_mul_ps(t7,twoPi);
+		t8=_mm_mul_ps(t8,twoPi);
+		
+		__m128 t6p=_mm_sub_ps(_mm_mul_ps(t8,_mm_set1_ps(0.551318f)),_mm_mul_ps(t6,_mm_set1_ps(0.826977f)));
+		__m128 t7p=_mm_sub_ps(_mm_mul_ps(t6,_mm_set1_ps(0.110264f)),_mm_mul_ps(t7,_mm_set1_ps(0.551318f)));
+		__m128 t8p=_mm_sub_ps(_mm_mul_ps(t7,_mm_set1_ps(0.826977f)),_mm_mul_ps(t8,_mm_set1_ps(0.110264f)));
+		
+		__m128 norm=_mm_add_ps(_mm_add_ps(_mm_mul_ps(t6p,t6p),_mm_mul_ps(t7p,t7p)),_mm_mul_ps(t8p,t8p));
+		t10=_mm_andnot_ps(_mm_cmplt_ps(t9,zero),t10);
+		
+		/* Check the dealiasing confidence: */
+		__m128i irIndex=_mm_sub_epi32(_mm_min_epi32(_mm_max_epi32(_mm_cvttps_epi32(magMax),_mm_set1_epi32(304)),_mm_set1_epi32(871)),_mm_set1_epi32(304));
+		int indices[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(indices),irIndex);
+		__m128 irX=_mm_setr_ps(p.confidenceTable[indices[0]],p.confidenceTable[indices[1]],p.confidenceTable[indices[2]],p.confidenceTable[indices[3]]);
+		__m128 phase=_mm_and_ps(_mm_cmpge_ps(irX,norm),t10);
+		valid=_mm_and_ps(valid,_mm_cmpgt_ps(phase,zero));
+		
+		/* Convert phase to linear depth: */
+		phase=_mm_add_ps(phase,phaseOffset);
+		__m128 depthLinear=_mm_mul_ps(_mm_loadu_ps(p.zTable+i),phase);
+		__m128 maxDepth=_mm_mul_ps(_mm_mul_ps(phase,unambiguousDistance),two);
+		__m128 xFactor=_mm_div_ps(_mm_mul_ps(_mm_loadu_ps(p.xTable+i),_mm_set1_ps(90.0f)),_mm_mul_ps(_mm_mul_ps(maxDepth,maxDepth),_mm_set1_ps(8192.0f)));
+		__m128 denominator=_mm_sub_ps(one,_mm_mul_ps(depthLinear,xFactor));
+		valid=_mm_and_ps(valid,_mm_cmpgt_ps(denominator,zero));
+		_mm_storeu_ps(p.depthImage+i,_mm_and_ps(valid,_mm_div_ps(depthLinear,denominator)));
+		}
+	
+	/* Process leftover pixels: */
+	if(i<pixelEnd)
+		calcDepthsScalar(p,i,pixelEnd);
+	}
+
+__attribute__((target("sse4.1")))
+inline __m128 filterPixelsSSE41(__m128 last,__m128 center,__m128 next,__m128 threshold)
+	{
+	const __m128 signMask=_mm_set1_ps(-0.0f);
+	const __m128 one=_mm_set1_ps(1.0f);
+	__m128 sum=_mm_add_ps(center,center);
+	__m128 weight=_mm_set1_ps(2.0f);
+	__m128 useLast=_mm_cmplt_ps(_mm_andnot_ps(signMask,_mm_sub_ps(center,last)),threshold);
+	sum=_mm_blendv_ps(sum,_mm_add_ps(sum,last),useLast);
+	weight=_mm_blendv_ps(weight,_mm_add_ps(weight,one),useLast);
+	__m128 useNext=_mm_cmplt_ps(_mm_andnot_ps(signMask,_mm_sub_ps(center,next)),threshold);
+	sum=_mm_blendv_ps(sum,_mm_add_ps(sum,next),useNext);
+	weight=_mm_blendv_ps(weight,_mm_add_ps(weight,one),useNext);
+	return _mm_div_ps(sum,weight);
+	}
+
+__attribute__((target("sse4.1")))
+void filterRowsSSE41(const FilterKernelParameters& p,int rowBegin,int rowEnd)
+	{
+	const int w=int(KinectV2DepthDecoder::width);
+	float th=p.filterDistanceThreshold;
+	const __m128 threshold=_mm_set1_ps(th);
+	for(int y=rowBegin;y<rowEnd;++y)
+		{
+		const float* diRow=p.depthImage+y*w;
+		float* fiRow=p.filterImage+y*w;
+		fiRow[0]=filterFirstPixel(diRow[0],diRow[1],th);
+		int x=1;
+		for(;x+4<=w-1;x+=4)
+			_mm_storeu_ps(fiRow+x,filterPixelsSSE41(_mm_loadu_ps(diRow+x-1),_mm_loadu_ps(diRow+x),_mm_loadu_ps(diRow+x+1),threshold));
+		for(;x<w-1;++x)
+			fiRow[x]=filterPixel(diRow[x-1],diRow[x],diRow[x+1],th);
+		fiRow[w-1]=filterLastPixel(diRow[w-2],diRow[w-1],th);
+		}
+	}
+
+__attribute__((target("sse4.1")))
+void filterColumnsSSE41(const FilterKernelParameters& p,int rowBegin,int rowEnd)
+	{
+	const int w=int(KinectV2DepthDecoder::width);
+	const int h=int(KinectV2DepthDecoder::height);
+	const __m128 signMask=_mm_set1_ps(-0.0f);
+	const __m128 threshold=_mm_set1_ps(p.filterDistanceThreshold);
+	const __m128 weightCenter=_mm_set1_ps(0.667f);
+	const __m128 weightNeighbor=_mm_set1_ps(0.333f);
+	const __m128 zMin=_mm_set1_ps(p.zMin);
+	const __m128 zMax=_mm_set1_ps(p.zMax);
+	const __m128 A=_mm_set1_ps(p.A);
+	const __m128 B=_mm_set1_ps(p.B);
+	const __m128i invalidDepth=_mm_set1_epi32(FrameSource::invalidDepth);
+	for(int y=rowBegin;y<rowEnd;++y)
+		{
+		const float* fiRow=p.filterImage+y*w;
+		FrameSource::DepthPixel* dfRow=p.depthFrame+y*w;
+		for(int x=0;x<w;x+=4)
+			{
+			/* Filter four pixels vertically: */
+			__m128 center=_mm_loadu_ps(fiRow+x);
+			__m128 depth;
+			if(y==0)
+				{
+				__m128 next=_mm_loadu_ps(fiRow+x+w);
+				__m128 blend=_mm_cmplt_ps(_mm_andnot_ps(signMask,_mm_sub_ps(center,next)),threshold);
+				depth=_mm_blendv_ps(center,_mm_add_ps(_mm_mul_ps(center,weightCenter),_mm_mul_ps(next,weightNeighbor)),blend);
+				}
+			else if(y==h-1)
+				{
+				__m128 last=_mm_loadu_ps(fiRow+x-w);
+				__m128 blend=_mm_cmplt_ps(_mm_andnot_ps(signMask,_mm_sub_ps(center,last)),threshold);
+				depth=_mm_blendv_ps(center,_mm_add_ps(_mm_mul_ps(last,weightNeighbor),_mm_mul_ps(center,weightCenter)),blend);
+				}
+			else
+				depth=filterPixelsSSE41(_mm_loadu_ps(fiRow+x-w),center,_mm_loadu_ps(fiRow+x+w),threshold);
+			
+			/* Quantize the four pixels: */
+			__m128i invalid=_mm_castps_si128(_mm_or_ps(_mm_cmplt_ps(depth,zMin),_mm_cmpgt_ps(depth,zMax)));
+			__m128i quantized=_mm_cvttps_epi32(_mm_sub_ps(B,_mm_div_ps(A,depth)));
+			quantized=_mm_blendv_epi8(quantized,invalidDepth,invalid);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dfRow+x),_mm_packus_epi32(quantized,quantized));
+			}
+		}
+	}
+
+/* AVX2 kernels: */
+
+__attribute__((target("avx2")))
+void calcPhasesAVX2(const PhaseKernelParameters& p,unsigned int pixelBegin,unsigned int pixelEnd)
+	{
+	const __m256 zero=_mm256_setzero_ps();
+	const __m256 signMask=_mm256_set1_ps(-0.0f);
+	const __m256 one=_mm256_set1_ps(1.0f);
+	const __m256 tableScale=_mm256_set1_ps(8192.0f);
+	const __m256 halfPi=_mm256_set1_ps(0.5f*Math::Constants<float>::pi);
+	const __m256 pi=_mm256_set1_ps(1.0f*Math::Constants<float>::pi);
+	const __m256 threeHalfPi=_mm256_set1_ps(1.5f*Math::Constants<float>::pi);
+	const __m256 twoPi=_mm256_set1_ps(2.0f*Math::Constants<float>::pi);
+	const __m256i saturated=_mm256_set1_epi32(32767);
+	const __m256 magnitudeFactor=_mm256_set1_ps(p.magnitudeFactor);
+	
+	unsigned int i=pixelBegin;
+	for(;i+8<=pixelEnd;i+=8)
+		{
+		/* Load eight pixels of the three raw images and check for saturation: */
+		__m256i ir0=_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p.ir[0]+i)));
+		__m256i ir1=_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p.ir[1]+i)));
+		__m256i ir2=_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p.ir[2]+i)));
+		__m256 sat=_mm256_castsi256_ps(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi32(ir0,saturated),_mm256_cmpeq_epi32(ir1,saturated)),_mm256_cmpeq_epi32(ir2,saturated)));
+		__m256 i0=_mm256_cvtepi32_ps(ir0);
+		__m256 i1=_mm256_cvtepi32_ps(ir1);
+		__m256 i2=_mm256_cvtepi32_ps(ir2);
+		
+		/* Calculate the phase vectors: */
+		__m256 x=_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(p.tt[0]+i),i0),_mm256_mul_ps(_mm256_loadu_ps(p.tt[1]+i),i1)),_mm256_mul_ps(_mm256_loadu_ps(p.tt[2]+i),i2));
+		__m256 y=_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(p.tt[3]+i),i0),_mm256_mul_ps(_mm256_loadu_ps(p.tt[4]+i),i1)),_mm256_mul_ps(_mm256_loadu_ps(p.tt[5]+i),i2));
+		
+		/* Look up the arctangent of the smaller over the larger vector component: */
+		__m256 ax=_mm256_andnot_ps(signMask,x);
+		__m256 ay=_mm256_andnot_ps(signMask,y);
+		__m256 num=_mm256_min_ps(ax,ay);
+		__m256 den=_mm256_max_ps(ax,ay);
+		__m256 null=_mm256_cmp_ps(den,zero,_CMP_EQ_OQ);
+		den=_mm256_blendv_ps(den,one,null);
+		__m256i index=_mm256_cvttps_epi32(_mm256_div_ps(_mm256_mul_ps(num,tableScale),den));
+		__m256 a=_mm256_i32gather_ps(p.arctanTable,index,4);
+		
+		/* Select the octant of each phase vector exactly as the scalar kernel does: */
+		__m256 upper=_mm256_cmp_ps(y,zero,_CMP_GE_OQ);
+		__m256 right=_mm256_cmp_ps(x,zero,_CMP_GE_OQ);
+		__m256 left=_mm256_cmp_ps(x,zero,_CMP_LE_OQ);
+		__m256 evenQuadrant=_mm256_blendv_ps(left,right,upper);
+		__m256 firstHalf=_mm256_blendv_ps(_mm256_cmp_ps(ax,ay,_CMP_LE_OQ),_mm256_cmp_ps(ay,ax,_CMP_LE_OQ),evenQuadrant);
+		__m256 baseFirst=_mm256_blendv_ps(_mm256_blendv_ps(threeHalfPi,pi,left),_mm256_blendv_ps(halfPi,zero,right),upper);
+		__m256 baseSecond=_mm256_blendv_ps(_mm256_blendv_ps(twoPi,threeHalfPi,left),_mm256_blendv_ps(pi,halfPi,right),upper);
+		__m256 angle=_mm256_blendv_ps(_mm256_sub_ps(baseSecond,a),_mm256_add_ps(baseFirst,a),firstHalf);
+		angle=_mm256_andnot_ps(_mm256_or_ps(null,sat),angle);
+		
+		/* Calculate the phase vector magnitudes: */
+		__m256 magnitude=_mm256_mul_ps(_mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(x,x),_mm256_mul_ps(y,y))),magnitudeFactor);
+		magnitude=_mm256_andnot_ps(sat,magnitude);
+		
+		_mm256_storeu_ps(p.angles+i,angle);
+		_mm256_storeu_ps(p.magnitudes+i,magnitude);
+		}
+	
+	/* Process leftover pixels: */
+	if(i<pixelEnd)
+		calcPhasesScalar(p,i,pixelEnd);
+	}
+
+__attribute__((target("avx2")))
+void calcDepthsAVX2(const DepthKernelParameters& p,unsigned int pixelBegin,unsigned int pixelEnd)
+	{
+	const __m256 zero=_mm256_setzero_ps();
+	const __m256 signMask=_mm256_set1_ps(-0.0f);
+	const __m256 half=_mm256_set1_ps(0.5f);
+	const __m256 one=_mm256_set1_ps(1.0f);
+	const __m256 two=_mm256_set1_ps(2.0f);
+	const __m256 three=_mm256_set1_ps(3.0f);
+	const __m256 fifteen=_mm256_set1_ps(15.0f);
+	const __m256 twoPi=_mm256_set1_ps(2.0f*Math::Constants<float>::pi);
+	const __m256 magThreshold1=_mm256_set1_ps(p.magThreshold1);
+	const __m256 magThreshold2=_mm256_set1_ps(p.magThreshold2);
+	const __m256 phaseOffset=_mm256_set1_ps(p.phaseOffset);
+	const __m256 unambiguousDistance=_mm256_set1_ps(p.unambiguousDistance);
+	
+	unsigned int i=pixelBegin;
+	for(;i+8<=pixelEnd;i+=8)
+		{
+		__m256 mag0=_mm256_loadu_ps(p.magnitudes[0]+i);
+		__m256 mag1=_mm256_loadu_ps(p.magnitudes[1]+i);
+		__m256 mag2=_mm256_loadu_ps(p.magnitudes[2]+i);
+		__m256 magSum=_mm256_add_ps(_mm256_add_ps(mag0,mag1),mag2);
+		__m256 magMin=_mm256_min_ps(mag0,_mm256_min_ps(mag1,mag2));
+		__m256 magMax=_mm256_max_ps(mag0,_mm256_max_ps(mag1,mag2));
+		__m256 valid=_mm256_and_ps(_mm256_cmp_ps(magMin,magThreshold1,_CMP_GE_OQ),_mm256_cmp_ps(magSum,magThreshold2,_CMP_GE_OQ));
+		
+		/* Convert phase angles to wave distances: */
+		__m256 t0=_mm256_div_ps(_mm256_mul_ps(_mm256_loadu_ps(p.angles[0]+i),three),twoPi);
+		__m256 t1=_mm256_div_ps(_mm256_mul_ps(_mm256_loadu_ps(p.angles[1]+i),fifteen),twoPi);
+		__m256 t2=_mm256_div_ps(_mm256_mul_ps(_mm256_loadu_ps(p.angles[2]+i),two),twoPi);
+		
+		__m256 t5=_mm256_add_ps(_mm256_mul_ps(_mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(t1,t0),_mm256_set1_ps(0.333333f)),half)),three),t0);
+		__m256 t3=_mm256_sub_ps(t5,t2);
+		__m256 t3Positive=_mm256_cmp_ps(t3,zero,_CMP_GE_OQ);
+		t3=_mm256_mul_ps(t3,_mm256_blendv_ps(_mm256_set1_ps(-0.5f),half,t3Positive));
+		t3=_mm256_mul_ps(_mm256_sub_ps(t3,_mm256_cvtepi32_ps(_mm256_cvttps_epi32(t3))),_mm256_blendv_ps(_mm256_set1_ps(-2.0f),two,t3Positive));
+		
+		__m256 at3=_mm256_andnot_ps(signMask,t3);
+		__m256 shift=_mm256_and_ps(_mm256_cmp_ps(half,at3,_CMP_LT_OQ),_mm256_cmp_ps(at3,_mm256_set1_ps(1.5f),_CMP_LT_OQ));
+		__m256 t6=_mm256_blendv_ps(t5,_mm256_add_ps(t5,fifteen),shift);
+		__m256 t7=_mm256_blendv_ps(t1,_mm256_add_ps(t1,fifteen),shift);
+		
+		__m256 t8=_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(t6,t2),half),half)),two),t2),half);
+		
+		t6=_mm256_div_ps(t6,three);
+		t7=_mm256_div_ps(t7,fifteen);
+		
+		__m256 t9=_mm256_add_ps(_mm256_add_ps(t6,t7),t8);
+		__m256 t10=_mm256_div_ps(t9,three);
+		
+		t6=_mm256_mul_ps(t6,twoPi);
+		t7=_mm256_mul_ps(t7,twoPi);
+		t8=_mm256_mul_ps(t8,twoPi);
+		
+		__m256 t6p=_mm256_sub_ps(_mm256_mul_ps(t8,_mm256_set1_ps(0.551318f)),_mm256_mul_ps(t6,_mm256_set1_ps(0.826977f)));
+		__m256 t7p=_mm256_sub_ps(_mm256_mul_ps(t6,_mm256_set1_ps(0.110264f)),_mm256_mul_ps(t7,_mm256_set1_ps(0.551318f)));
+		__m256 t8p=_mm256_sub_ps(_mm256_mul_ps(t7,_mm256_set1_ps(0.826977f)),_mm256_mul_ps(t8,_mm256_set1_ps(0.110264f)));
+		
+		__m256 norm=_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(t6p,t6p),_mm256_mul_ps(t7p,t7p)),_mm256_mul_ps(t8p,t8p));
+		t10=_mm256_andnot_ps(_mm256_cmp_ps(t9,zero,_CMP_LT_OQ),t10);
+		
+		/* Check the dealiasing confidence: */
+		__m256i irIndex=_mm256_sub_epi32(_mm256_min_epi32(_mm256_max_epi32(_mm256_cvttps_epi32(magMax),_mm256_set1_epi32(304)),_mm256_set1_epi32(871)),_mm256_set1_epi32(304));
+		__m256 irX=_mm256_i32gather_ps(p.confidenceTable,irIndex,4);
+		__m256 phase=_mm256_and_ps(_mm256_cmp_ps(irX,norm,_CMP_GE_OQ),t10);
+		valid=_mm256_and_ps(valid,_mm256_cmp_ps(phase,zero,_CMP_GT_OQ));
+		
+		/* Convert phase to linear depth: */
+		phase=_mm256_add_ps(phase,phaseOffset);
+		__m256 depthLinear=_mm256_mul_ps(_mm256_loadu_ps(p.zTable+i),phase);
+		__m256 maxDepth=_mm256_mul_ps(_mm256_mul_ps(phase,unambiguousDistance),two);
+		__m256 xFactor=_mm256_div_ps(_mm256_mul_ps(_mm256_loadu_ps(p.xTable+i),_mm256_set1_ps(90.0f)),_mm256_mul_ps(_mm256_mul_ps(maxDepth,maxDepth),_mm256_set1_ps(8192.0f)));
+		__m256 denominator=_mm256_sub_ps(one,_mm256_mul_ps(depthLinear,xFactor));
+		valid=_mm256_and_ps(valid,_mm256_cmp_ps(denominator,zero,_CMP_GT_OQ));
+		_mm256_storeu_ps(p.depthImage+i,_mm256_and_ps(valid,_mm256_div_ps(depthLinear,denominator)));
+		}
+	
+	/* Process leftover pixels: */
+	if(i<pixelEnd)
+		calcDepthsScalar(p,i,pixelEnd);
+	}
+
+__attribute__((target("avx2")))
+inline __m256 filterPixelsAVX2(__m256 last,__m256 center,__m256 next,__m256 threshold)
+	{
+	const __m256 signMask=_mm256_set1_ps(-0.0f);
+	const __m256 one=_mm256_set1_ps(1.0f);
+	__m256 sum=_mm256_add_ps(center,center);
+	__m256 weight=_mm256_set1_ps(2.0f);
+	__m256 useLast=_mm256_cmp_ps(_mm256_andnot_ps(signMask,_mm256_sub_ps(center,last)),threshold,_CMP_LT_OQ);
+	sum=_mm256_blendv_ps(sum,_mm256_add_ps(sum,last),useLast);
+	weight=_mm256_blendv_ps(weight,_mm256_add_ps(weight,one),useLast);
+	__m256 useNext=_mm256_cmp_ps(_mm256_andnot_ps(signMask,_mm256_sub_ps(center,next)),threshold,_CMP_LT_OQ);
+	sum=_mm256_blendv_ps(sum,_mm256_add_ps(sum,next),useNext);
+	weight=_mm256_blendv_ps(weight,_mm256_add_ps(weight,one),useNext);
+	return _mm256_div_ps(sum,weight);
+	}
+
+__attribute__((target("avx2")))
+void filterRowsAVX2(const FilterKernelParameters& p,int rowBegin,int rowEnd)
+	{
+	const int w=int(KinectV2DepthDecoder::width);
+	float th=p.filterDistanceThreshold;
+	const __m256 threshold=_mm256_set1_ps(th);
+	for(int y=rowBegin;y<rowEnd;++y)
+		{
+		const float* diRow=p.depthImage+y*w;
+		float* fiRow=p.filterImage+y*w;
+		fiRow[0]=filterFirstPixel(diRow[0],diRow[1],th);
+		int x=1;
+		for(;x+8<=w-1;x+=8)
+			_mm256_storeu_ps(fiRow+x,filterPixelsAVX2(_mm256_loadu_ps(diRow+x-1),_mm256_loadu_ps(diRow+x),_mm256_loadu_ps(diRow+x+1),threshold));
+		for(;x<w-1;++x)
+			fiRow[x]=filterPixel(diRow[x-1],diRow[x],diRow[x+1],th);
+		fiRow[w-1]=filterLastPixel(diRow[w-2],diRow[w-1],th);
+		}
+	}
+
+__attribute__((target("avx2")))
+void filterColumnsAVX2(const FilterKernelParameters& p,int rowBegin,int rowEnd)
+	{
+	const int w=int(KinectV2DepthDecoder::width);
+	const int h=int(KinectV2DepthDecoder::height);
+	const __m256 signMask=_mm256_set1_ps(-0.0f);
+	const __m256 threshold=_mm256_set1_ps(p.filterDistanceThreshold);
+	const __m256 weightCenter=_mm256_set1_ps(0.667f);
+	const __m256 weightNeighbor=_mm256_set1_ps(0.333f);
+	const __m256 zMin=_mm256_set1_ps(p.zMin);
+	const __m256 zMax=_mm256_set1_ps(p.zMax);
+	const __m256 A=_mm256_set1_ps(p.A);
+	const __m256 B=_mm256_set1_ps(p.B);
+	const __m256i invalidDepth=_mm256_set1_epi32(FrameSource::invalidDepth);
+	for(int y=rowBegin;y<rowEnd;++y)
+		{
+		const float* fiRow=p.filterImage+y*w;
+		FrameSource::DepthPixel* dfRow=p.depthFrame+y*w;
+		for(int x=0;x<w;x+=8)
+			{
+			/* Filter eight pixels vertically: */
+			__m256 center=_mm256_loadu_ps(fiRow+x);
+			__m256 depth;
+			if(y==0)
+				{
+				__m256 next=_mm256_loadu_ps(fiRow+x+w);
+				__m256 blend=_mm256_cmp_ps(_mm256_andnot_ps(signMask,_mm256_sub_ps(center,next)),threshold,_CMP_LT_OQ);
+				depth=_mm256_blendv_ps(center,_mm256_add_ps(_mm256_mul_ps(center,weightCenter),_mm256_mul_ps(next,weightNeighbor)),blend);
+				}
+			else if(y==h-1)
+				{
+				__m256 last=_mm256_loadu_ps(fiRow+x-w);
+				__m256 blend=_mm256_cmp_ps(_mm256_andnot_ps(signMask,_mm256_sub_ps(center,last)),threshold,_CMP_LT_OQ);
+				depth=_mm256_blendv_ps(center,_mm256_add_ps(_mm256_mul_ps(last,weightNeighbor),_mm256_mul_ps(center,weightCenter)),blend);
+				}
+			else
+				depth=filterPixelsAVX2(_mm256_loadu_ps(fiRow+x-w),center,_mm256_loadu_ps(fiRow+x+w),threshold);
+			
+			/* Quantize the eight pixels: */
+			__m256i invalid=_mm256_castps_si256(_mm256_or_ps(_mm256_cmp_ps(depth,zMin,_CMP_LT_OQ),_mm256_cmp_ps(depth,zMax,_CMP_GT_OQ)));
+			__m256i quantized=_mm256_cvttps_epi32(_mm256_sub_ps(B,_mm256_div_ps(A,depth)));
+			quantized=_mm256_blendv_epi8(quantized,invalidDepth,invalid);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dfRow+x),_mm_packus_epi32(_mm256_castsi256_si128(quantized),_mm256_extracti128_si256(quantized,1)));
+			}
+		}
+	}
+
+#endif
+
+}
+
+/*************************************
+Methods of class KinectV2DepthDecoder:
+*************************************/
+
+void KinectV2DepthDecoder::depthBand(unsigned int bandIndex,int rowBegin,int rowEnd)
+	{
+	/* Calculate the band's linear depth values: */
+	DepthKernelParameters dp;
+	for(int exposure=0;exposure<3;++exposure)
+		{
+		dp.angles[exposure]=phaseAngles[exposure];
+		dp.magnitudes[exposure]=phaseMagnitudes[exposure];
+		}
+	dp.xTable=xTable;
+	dp.zTable=zTable;
+	dp.confidenceTable=confidenceTable;
+	dp.magThreshold1=magThreshold1;
+	dp.magThreshold2=magThreshold2;
+	dp.phaseOffset=phaseOffset;
+	dp.unambiguousDistance=unambiguousDistance;
+	dp.depthImage=depthImage;
+	unsigned int pixelBegin=(unsigned int)rowBegin*width;
+	unsigned int pixelEnd=(unsigned int)rowEnd*width;
+	
+	/* Run the horizontal pass of the spatial low-pass filter over the band: */
+	FilterKernelParameters fp;
+	fp.depthImage=depthImage;
+	fp.filterImage=filterImage;
+	fp.filterDistanceThreshold=filterDistanceThreshold;
+	
+	switch(kernelSet)
+		{
+		#if KINECTV2DEPTHDECODER_X86_KERNELS
+		case SSE41:
+			calcDepthsSSE41(dp,pixelBegin,pixelEnd);
+			filterRowsSSE41(fp,rowBegin,rowEnd);
+			break;
+		
+		case AVX2:
+			calcDepthsAVX2(dp,pixelBegin,pixelEnd);
+			filterRowsAVX2(fp,rowBegin,rowEnd);
+			break;
+		#endif
+		
+		default:
+			calcDepthsScalar(dp,pixelBegin,pixelEnd);
+			filterRowsScalar(fp,rowBegin,rowEnd);
+		}
+	}
+
+void KinectV2DepthDecoder::quantizationBand(unsigned int bandIndex,int rowBegin,int rowEnd)
+	{
+	/* Run the vertical pass of the spatial low-pass filter over the band and quantize the result: */
+	FilterKernelParameters fp;
+	fp.depthImage=depthImage;
+	fp.filterImage=filterImage;
+	fp.filterDistanceThreshold=filterDistanceThreshold;
+	fp.zMin=zMin;
+	fp.zMax=zMax;
+	fp.A=A;
+	fp.B=B;
+	fp.depthFrame=depthFrame;
+	
+	switch(kernelSet)
+		{
+		#if KINECTV2DEPTHDECODER_X86_KERNELS
+		case SSE41:
+			filterColumnsSSE41(fp,rowBegin,rowEnd);
+			break;
+		
+		case AVX2:
+			filterColumnsAVX2(fp,rowBegin,rowEnd);
+			break;
+		#endif
+		
+		default:
+			filterColumnsScalar(fp,rowBegin,rowEnd);
+		}
+	}
+
+KinectV2DepthDecoder::KinectV2DepthDecoder(unsigned int numDepthThreads)
+	:kernelSet(getBestKernelSet()),
+	 arctanTable(0),
+	 confidenceTable(0),xTable(0),zTable(0),
+	 depthImage(0),filterImage(0),
+	 depthWorkers(0),depthFrame(0)
+	{
+	for(int exposure=0;exposure<3;++exposure)
+		{
+		trigonometryTables[exposure]=0;
+		phaseAngles[exposure]=0;
+		phaseMagnitudes[exposure]=0;
+		}
+	
+	/* Create the trigonometry coefficient tables: */
+	for(int exposure=0;exposure<3;++exposure)
+		{
+		trigonometryTables[exposure]=new float[6*height*width];
+		for(unsigned int i=0;i<6*height*width;++i)
+			trigonometryTables[exposure][i]=0.0f;
+		}
+	
+	/* Create the arctangent table: */
+	arctanTable=new float[8193];
+	for(int i=0;i<8192;++i)
+		arctanTable[i]=Math::atan((float(i)+0.5f)/8192.0f);
+	arctanTable[8192]=arctanTable[8191];
+	
+	/* Initialize the magnitude multipliers: */
+	magnitudeFactors[0]=1.322581f*0.6666667f;
+	magnitudeFactors[1]=1.0f*0.6666667f;
+	magnitudeFactors[2]=1.612903f*0.6666667f;
+	
+	/* Allocate the phase images: */
+	for(int exposure=0;exposure<3;++exposure)
+		{
+		phaseAngles[exposure]=new float[height*width];
+		phaseMagnitudes[exposure]=new float[height*width];
+		}
+	
+	/* Initialize the magnitude thresholds: */
+	magThreshold1=3.0f;
+	magThreshold2=10.0f;
+	
+	/* Initialize the dealiasing confidence check parameters: */
+	confidenceSlope=-0.5330578f*0.301030f*3.321928f;
+	confidenceOffset=0.7694894f*3.321928f;
+	
+	minConfidence=0.3490659f;
+	maxConfidence=0.6108653f;
+	
+	/* Initialize the dealiasing confidence table: */
+	confidenceTable=new float[871-304+1];
+	for(int i=304;i<=871;++i)
+		{
+		float irX=float(i)+0.5f;
+		irX=Math::exp(Math::log(irX)*confidenceSlope+confidenceOffset);
+		irX=Math::clamp(irX,minConfidence,maxConfidence);
+		irX*=irX;
+		confidenceTable[i-304]=irX;
+		}
+	
+	/* Initialize phase-to-depth calculation parameters: */
+	phaseOffset=0.0f;
+	unambiguousDistance=6250.0f/3.0f; // Magic number
+	
+	/* Allocate the x and z tables: */
+	xTable=new float[height*width];
+	zTable=new float[height*width];
+	
+	/* Allocate the linear depth images: */
+	depthImage=new float[height*width];
+	filterImage=new float[height*width];
+	
+	/* Set the filter threshold: */
+	filterDistanceThreshold=50.0f;
+	
+	/* Initialize the quantization parameters: */
+	dMax=2047U;
+	setZRange(500.0f,5000.0f);
+	
+	/* Create the depth calculation thread pool: */
+	setNumDepthThreads(numDepthThreads);
+	}
+
+KinectV2DepthDecoder::~KinectV2DepthDecoder(void)
+	{
+	/* Shut down the depth calculation thread pool: */
+	delete depthWorkers;
+	
+	/* Delete the trigonometry coefficient and arctangent tables: */
+	for(int exposure=0;exposure<3;++exposure)
+		delete[] trigonometryTables[exposure];
+	delete[] arctanTable;
+	
+	/* Delete the phase images: */
+	for(int exposure=0;exposure<3;++exposure)
+		{
+		delete[] phaseAngles[exposure];
+		delete[] phaseMagnitudes[exposure];
+		}
+	
+	/* Delete the depth calculation tables: */
+	delete[] confidenceTable;
+	delete[] xTable;
+	delete[] zTable;
+	
+	/* Delete the depth images: */
+	delete[] depthImage;
+	delete[] filterImage;
+	}
+
+bool KinectV2DepthDecoder::isKernelSetSupported(KinectV2DepthDecoder::KernelSet kernelSet)
+	{
+	switch(kernelSet)
+		{
+		case SCALAR:
+			return true;
+		
+		#if KINECTV2DEPTHDECODER_X86_KERNELS
+		case SSE41:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse4.1");
+		
+		case AVX2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+		#endif
+		
+		default:
+			return false;
+		}
+	}
+
+KinectV2DepthDecoder::KernelSet KinectV2DepthDecoder::getBestKernelSet(void)
+	{
+	/* Return the widest supported kernel set: */
+	KernelSet result=SCALAR;
+	for(int ks=SSE41;ks<NUM_KERNELSETS;++ks)
+		if(isKernelSetSupported(KernelSet(ks)))
+			result=KernelSet(ks);
+	return result;
+	}
+
+const char* KinectV2DepthDecoder::getKernelSetName(KinectV2DepthDecoder::KernelSet kernelSet)
+	{
+	static const char* kernelSetNames[NUM_KERNELSETS]={"scalar","SSE4.1","AVX2"};
+	return kernelSet>=SCALAR&&kernelSet<NUM_KERNELSETS?kernelSetNames[kernelSet]:"invalid";
+	}
+
+void KinectV2DepthDecoder::setKernelSet(KinectV2DepthDecoder::KernelSet newKernelSet)
+	{
+	if(!isKernelSetSupported(newKernelSet))
+		Misc::throwStdErr("Kinect::KinectV2DepthDecoder::setKernelSet: Kernel set %s is not supported",getKernelSetName(newKernelSet));
+	kernelSet=newKernelSet;
+	}
+
+unsigned int KinectV2DepthDecoder::getNumDepthThreads(void) const
+	{
+	return depthWorkers!=0?depthWorkers->getNumThreads():1U;
+	}
+
+void KinectV2DepthDecoder::setNumDepthThreads(unsigned int newNumDepthThreads)
+	{
+	/* Shut down the current thread pool: */
+	delete depthWorkers;
+	depthWorkers=0;
+	
+	/* Create a new thread pool if depth calculation is to be shared between threads: */
+	if(newNumDepthThreads!=1U)
+		{
+		depthWorkers=new WorkerPool(newNumDepthThreads);
+		if(depthWorkers->getNumThreads()<=1U)
+			{
+			delete depthWorkers;
+			depthWorkers=0;
+			}
+		}
+	}
+
+void KinectV2DepthDecoder::loadP0Tables(IO::File& file)
+	{
+	file.setEndianness(Misc::LittleEndian);
+	
+	/* Skip the file header: */
+	file.skip<Misc::UInt32>(8);
+	
+	/* Allocate a temporary table: */
+	Misc::UInt16* p0Table=new Misc::UInt16[height*width];
+	
+	/* Load the three tables: */
+	for(int exposure=0;exposure<3;++exposure)
+		{
+		/* Load the raw p0 table: */
+		file.skip<Misc::UInt16>(1);
+		file.read(p0Table,height*width);
+		file.skip<Misc::UInt16>(1);
+		
+		/* Calculate the trigonometry table's six planes: */
+		float* tt[6];
+		for(int i=0;i<6;++i)
+			tt[i]=trigonometryTables[exposure]+i*height*width;
+		for(unsigned int i=0;i<height*width;++i)
+			{
+			/* Convert the per-pixel phase offset to radians: */
+			float p=-2.0f*Math::Constants<float>::pi*float(p0Table[i])/65536.0f;
+			
+			/* Calculate the per-image phase angles: */
+			float p0=p; // First image in a triplet is at base angle
+			float p1=p+2.0f*Math::Constants<float>::pi/3.0f; // Second image is 120 degrees ahead
+			float p2=p+4.0f*Math::Constants<float>::pi/3.0f; // Third image is 240 degrees ahead
+			
+			/* Calculate the per-image phase angle cosines and sines: */
+			tt[0][i]=Math::cos(p0);
+			tt[1][i]=Math::cos(p1);
+			tt[2][i]=Math::cos(p2);
+			
+			tt[3][i]=-Math::sin(p0);
+			tt[4][i]=-Math::sin(p1);
+			tt[5][i]=-Math::sin(p2);
+			}
+		}
+	
+	/* Clean up: */
+	delete[] p0Table;
+	}
+
+void KinectV2DepthDecoder::calcXZTables(const KinectV2CommandDispatcher::DepthCameraParams& depthCameraParams)
+	{
+	/* Get depth camera parameters: */
+	double fx=depthCameraParams.sx;
+	double cx=depthCameraParams.cx;
+	double fy=depthCameraParams.sy;
+	double cy=depthCameraParams.cy;
+	LensDistortion ld;
+	ld.setKappa(0,depthCameraParams.k1);
+	ld.setKappa(1,depthCameraParams.k2);
+	ld.setKappa(2,depthCameraParams.k3);
+	ld.setRho(0,depthCameraParams.p1);
+	ld.setRho(1,depthCameraParams.p2);
+	
+	/* Calculate X and Z tables: */
+	float* xTablePtr=xTable;
+	float* zTablePtr=zTable;
+	for(unsigned int y=0;y<height;++y)
+		{
+		/* Calculate the distorted pixel position in normalized projection space: */
+		LensDistortion::Point dp;
+		dp[1]=(double(y)+0.5-cy)/fy;
+		for(unsigned int x=0;x<width;++x,++xTablePtr,++zTablePtr)
+			{
+			dp[0]=(double(x)+0.5-cx)/fx;
+			
+			/* Undistort the pixel position: */
+			LensDistortion::Point up=ld.undistort(dp);
+			
+			/* Calculate the X and Z table entries: */
+			*xTablePtr=8192.0f*float(up[0]); // Correction factor based on x position to account for distance from lens to IR emitter
+			*zTablePtr=float(unambiguousDistance/Math::sqrt(1.0+up.sqr()));
+			}
+		}
+	}
+
+void KinectV2DepthDecoder::setDMax(unsigned int newDMax)
+	{
+	/* Set the new maximum depth value: */
+	dMax=newDMax;
+	
+	/* Update the z value range with the current values to recalculate the conversion parameters: */
+	setZRange(zMin,zMax);
+	}
+
+void KinectV2DepthDecoder::setZRange(float newZMin,float newZMax)
+	{
+	/* Set the new z value range: */
+	zMin=newZMin;
+	zMax=newZMax;
+	
+	/* Calculate the quantization formula coefficients: */
+	A=(float(dMax)*zMax*zMin)/(zMax-zMin);
+	B=float(dMax)+(float(dMax)*zMin)/(zMax-zMin);
+	}
+
+void KinectV2DepthDecoder::calcPhaseImage(int exposure,const KinectV2DepthDecoder::IRPixel* ir0,const KinectV2DepthDecoder::IRPixel* ir1,const KinectV2DepthDecoder::IRPixel* ir2)
+	{
+	PhaseKernelParameters pp;
+	pp.ir[0]=ir0;
+	pp.ir[1]=ir1;
+	pp.ir[2]=ir2;
+	for(int i=0;i<6;++i)
+		pp.tt[i]=trigonometryTables[exposure]+i*height*width;
+	pp.arctanTable=arctanTable;
+	pp.magnitudeFactor=magnitudeFactors[exposure];
+	pp.angles=phaseAngles[exposure];
+	pp.magnitudes=phaseMagnitudes[exposure];
+	
+	/* Process the image triplet: */
+	switch(kernelSet)
+		{
+		#if KINECTV2DEPTHDECODER_X86_KERNELS
+		case SSE41:
+			calcPhasesSSE41(pp,0,height*width);
+			break;
+		
+		case AVX2:
+			calcPhasesAVX2(pp,0,height*width);
+			break;
+		#endif
+		
+		default:
+			calcPhasesScalar(pp,0,height*width);
+		}
+	}
+
+void KinectV2DepthDecoder::calcDepthFrame(FrameSource::DepthPixel* newDepthFrame)
+	{
+	depthFrame=newDepthFrame;
+	
+	if(depthWorkers!=0)
+		{
+		/* Calculate and horizontally filter all rows in parallel, then vertically filter and quantize all rows in parallel: */
+		depthWorkers->processBands(0,height,this,&KinectV2DepthDecoder::depthBand);
+		depthWorkers->processBands(0,height,this,&KinectV2DepthDecoder::quantizationBand);
+		}
+	else
+		{
+		/* Process the entire image on the calling thread: */
+		depthBand(0,0,height);
+		quantizationBand(0,0,height);
+		}
+	
+	depthFrame=0;
+	}
+
+}
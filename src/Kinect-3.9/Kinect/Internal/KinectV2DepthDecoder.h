@@ -0,0 +1,132 @@
+/***********************************************************************
+KinectV2DepthDecoder - Class to convert triplets of raw gated IR images
+from a Kinect v2 camera into phase images, and phase images into
+quantized depth images, using vectorized kernels where available.
+Copyright (c) 2015-2020 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#ifndef KINECT_INTERNAL_KINECTV2DEPTHDECODER_INCLUDED
+#define KINECT_INTERNAL_KINECTV2DEPTHDECODER_INCLUDED
+
+#include <Misc/SizedTypes.h>
+#include <IO/File.h>
+#include <Kinect/FrameSource.h>
+#include <Kinect/Internal/KinectV2CommandDispatcher.h>
+
+/* Forward declarations: */
+namespace Kinect {
+class WorkerPool;
+}
+
+namespace Kinect {
+
+class KinectV2DepthDecoder
+	{
+	/* Embedded classes: */
+	public:
+	typedef Misc::SInt16 IRPixel; // Type for raw gated IR image pixels
+	
+	enum KernelSet // Enumerated type for sets of phase and depth calculation kernels
+		{
+		SCALAR=0, // Portable per-pixel reference kernels
+		SSE41, // Four-wide kernels using SSE4.1 instructions
+		AVX2, // Eight-wide kernels using AVX2 instructions
+		NUM_KERNELSETS
+		};
+	
+	static const unsigned int width=512; // Width of raw IR and depth images
+	static const unsigned int height=424; // Height of raw IR and depth images
+	
+	/* Elements: */
+	private:
+	KernelSet kernelSet; // Set of kernels used for phase and depth calculation
+	float* trigonometryTables[3]; // Three arrays of six planes of coefficients to convert a range-gated IR image triple into a 2D phase vector
+	float* arctanTable; // Table to calculate phase angles from orthogonal vectors
+	float magnitudeFactors[3]; // Multiplication factors for IR pixel intensity for each image triplet
+	float* phaseAngles[3]; // Three phase angle images, one per exposure
+	float* phaseMagnitudes[3]; // Three phase vector magnitude images, one per exposure
+	float magThreshold1,magThreshold2; // Validity thresholds for each exposure's magnitude, and sum of magnitudes
+	float confidenceSlope,confidenceOffset; // Slope and offset for dealiasing confidence check
+	float minConfidence,maxConfidence; // Dealiasing confidence interval
+	float* confidenceTable; // Tabulated confidence function
+	float phaseOffset; // Constant offset to dealiased phase values
+	float unambiguousDistance;
+	float* xTable;
+	float* zTable;
+	float* depthImage; // Linear depth image before filtering
+	float* filterImage; // Linear depth image after horizontal filtering
+	float filterDistanceThreshold; // Threshold value for edge-retaining low-pass filter
+	float zMin,zMax; // Z value range for quantization
+	unsigned int dMax; // Maximum integer depth value
+	float A,B; // Z-to-depth conversion formula coefficients
+	WorkerPool* depthWorkers; // Pool of threads sharing the depth calculation, or null if depth is calculated on the calling thread
+	FrameSource::DepthPixel* depthFrame; // Depth frame currently being calculated
+	
+	/* Private methods: */
+	void depthBand(unsigned int bandIndex,int rowBegin,int rowEnd); // Calculates and horizontally filters the given range of depth image rows
+	void quantizationBand(unsigned int bandIndex,int rowBegin,int rowEnd); // Vertically filters and quantizes the given range of depth image rows
+	
+	/* Constructors and destructors: */
+	public:
+	KinectV2DepthDecoder(unsigned int numDepthThreads =1); // Creates a decoder calculating depth on the given number of threads; uses number of online CPUs if zero
+	private:
+	KinectV2DepthDecoder(const KinectV2DepthDecoder& source); // Prohibit copy constructor
+	KinectV2DepthDecoder& operator=(const KinectV2DepthDecoder& source); // Prohibit assignment operator
+	public:
+	~KinectV2DepthDecoder(void); // Destroys the decoder
+	
+	/* Methods: */
+	static bool isKernelSetSupported(KernelSet kernelSet); // Returns true if the given kernel set is compiled in and supported by the current CPU
+	static KernelSet getBestKernelSet(void); // Returns the fastest kernel set supported by the current CPU
+	static const char* getKernelSetName(KernelSet kernelSet); // Returns a human-readable name for the given kernel set
+	KernelSet getKernelSet(void) const // Returns the currently used kernel set
+		{
+		return kernelSet;
+		}
+	void setKernelSet(KernelSet newKernelSet); // Selects a kernel set; throws exception if the kernel set is not supported
+	unsigned int getNumDepthThreads(void) const; // Returns the number of threads sharing the depth calculation
+	void setNumDepthThreads(unsigned int newNumDepthThreads); // Sets the number of threads sharing the depth calculation; uses number of online CPUs if zero
+	void loadP0Tables(IO::File& file); // Reads per-pixel and per-exposure phase offset tables from file
+	void calcXZTables(const KinectV2CommandDispatcher::DepthCameraParams& depthCameraParams); // Calculates the X and Z depth calculation tables based on depth camera parameters
+	void setDMax(unsigned int newDMax); // Sets the maximum integer depth value contained in returned depth images; current Kinect package expects 2047; maximum is 65535
+	void setZRange(float newZMin,float newZMax); // Sets the range of linear z values for quantization
+	float getA(void) const // Returns the first z-to-depth conversion formula coefficient
+		{
+		return A;
+		}
+	float getB(void) const // Returns the second z-to-depth conversion formula coefficient
+		{
+		return B;
+		}
+	void calcPhaseImage(int exposure,const IRPixel* ir0,const IRPixel* ir1,const IRPixel* ir2); // Calculates the phase image of the given exposure from a triplet of raw gated IR images; can be called for different exposures concurrently
+	const float* getPhaseAngles(int exposure) const // Returns the phase angle image of the given exposure
+		{
+		return phaseAngles[exposure];
+		}
+	const float* getPhaseMagnitudes(int exposure) const // Returns the phase vector magnitude image of the given exposure
+		{
+		return phaseMagnitudes[exposure];
+		}
+	void calcDepthFrame(FrameSource::DepthPixel* newDepthFrame); // Calculates a quantized depth image from the current three phase images into the given width x height pixel array
+	};
+
+}
+
+#endif
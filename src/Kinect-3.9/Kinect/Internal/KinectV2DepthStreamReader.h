@@ -1,7 +1,7 @@
 /***********************************************************************
 KinectV2DepthStreamReader - Class to extract depth images from raw gated
 IR images read from a stream of USB transfer buffers.
-Copyright (c) 2015-2016 Oliver Kreylos
+Copyright (c) 2015-2020 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -30,6 +30,7 @@ Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #include <IO/File.h>
 #include <USB/TransferPool.h>
 #include <Kinect/Internal/KinectV2CommandDispatcher.h>
+#include <Kinect/Internal/KinectV2DepthDecoder.h>
 
 /* Forward declarations: */
 namespace Misc {
@@ -47,7 +48,7 @@ class KinectV2DepthStreamReader
 	{
 	/* Embedded classes: */
 	public:
-	typedef Misc::SInt16 IRPixel; // Type for raw gated IR image pixels
+	typedef KinectV2DepthDecoder::IRPixel IRPixel; // Type for raw gated IR image pixels
 	
 	struct RawImage // Structure to pass raw range-gated IR images to an interested party
 		{
@@ -75,30 +76,14 @@ class KinectV2DepthStreamReader
 	bool frameValid; // Flag to keep track of errors during frame processing
 	double frameTimeStamp; // Time stamp for the frame that was just received over USB
 	RawImageReadyCallback* rawImageReadyCallback; // Function called whenever a raw range-gated IR image has been decompressed
-	float* trigonometryTables[3]; // Three arrays of coefficients to convert a range-gated IR image triple into a 2D phase vector
-	float* arctanTable; // Table to calculate phase angles from orthogonal vectors
-	float magnitudeFactors[3]; // Multiplication factors for IR pixel intensity for each image triplet
+	KinectV2DepthDecoder depthDecoder; // Object converting raw gated IR image triplets to phase images, and phase images to depth images
 	Threads::Thread phaseThreads[3]; // Three threads to calculate phase vector image for each exposure in parallel
 	Threads::MutexCond phaseThreadConds[3]; // Three condition variables to wake up the phase angle calculation threads
-	float* phaseImages[3]; // Three phase images, containing (angle, squared magnitude) pairs
 	double phaseFrameTimeStamp; // Time stamp of the frame currently processed by the phase calculation threads
 	unsigned int phaseFrameNumbers[3]; // Index of phase image currently in the phase image buffers
 	Threads::Thread depthThread; // Thread to convert a triplet of phase images into a depth image
 	Threads::MutexCond depthThreadCond; // Condition variable to wake up the depth calculation thread
-	float magThreshold1,magThreshold2; // Validity thresholds for each exposure's magnitude, and sum of magnitudes
-	float confidenceSlope,confidenceOffset; // Slope and offset for dealiasing confidence check
-	float minConfidence,maxConfidence; // Dealiasing confidence interval
-	float* confidenceTable; // Tabulated confidence function
-	float phaseOffset; // Constant offset to dealiased phase values
-	float unambiguousDistance;
-	float* xTable;
-	float* zTable;
-	float* depthImage; // Final depth image
-	float filterDistanceThreshold; // Threshold value for edge-retaining low-pass filter
 	unsigned int depthFrameNumber; // Index of depth image currently in the buffer
-	float zMin,zMax; // Z value range for quantization
-	unsigned int dMax; // Maximum integer depth value
-	float A,B; // Z-to-depth conversion formula coefficients
 	ImageReadyCallback* imageReadyCallback; // Function called whenever a new image has been decompressed
 	
 	/* Private methods: */
@@ -117,11 +102,15 @@ class KinectV2DepthStreamReader
 	void setZRange(float newZMin,float newZMax); // Sets the range of linear z values for quantization
 	float getA(void) const // Returns the first z-to-depth conversion formula coefficient
 		{
-		return A;
+		return depthDecoder.getA();
 		}
 	float getB(void) const // Returns the second z-to-depth conversion formula coefficient
 		{
-		return B;
+		return depthDecoder.getB();
+		}
+	KinectV2DepthDecoder& getDepthDecoder(void) // Returns the depth decoder to select kernels or depth calculation threads
+		{
+		return depthDecoder;
 		}
 	void postTransfer(USB::TransferPool::Transfer* newTransfer,USB::TransferPool* newTransferPool); // Writes the given transfer into the raw input buffer
 	void setRawImageReadyCallback(RawImageReadyCallback* newRawImageReadyCallback); // Installs a function to be called when a raw range-gated IR image is decompressed
@@ -225,6 +225,7 @@ void* KinectV2JpegStreamReader::decompressionThreadMethod(void)
 		if(!error)
 			{
 			/* Call the callback: */
+			decompressedFrame.stampSourceTrace(double(camera.timeBase)+decompressedFrame.timeStamp);
 			(*imageReadyCallback)(decompressedFrame);
 			}
 		}
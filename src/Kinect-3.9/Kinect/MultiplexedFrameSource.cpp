@@ -244,9 +244,15 @@ void* MultiplexedFrameSource::receivingThreadMethod(void)
 								{
 								/* Push the streamer's frames: */
 								if(streams[i]->colorStreamingCallback!=0)
+									{
+									frames[i*2+0].stampTrace(FrameBuffer::DECODE);
 									(*streams[i]->colorStreamingCallback)(frames[i*2+0]);
+									}
 								if(streams[i]->depthStreamingCallback!=0)
+									{
+									frames[i*2+1].stampTrace(FrameBuffer::DECODE);
 									(*streams[i]->depthStreamingCallback)(frames[i*2+1]);
+									}
 								}
 							}
 						}
@@ -259,6 +265,7 @@ void* MultiplexedFrameSource::receivingThreadMethod(void)
 				}
 			
 			/* Read the new frame: */
+			Realtime::TimePointMonotonic receiveTime;
 			unsigned int streamIndex=frameId>>1;
 			if(frameId&0x1U)
 				{
@@ -273,8 +280,9 @@ void* MultiplexedFrameSource::receivingThreadMethod(void)
 				--numMissingColorFrames;
 				}
 			
-			/* Adjust the new frame's time stamp: */
+			/* Adjust the new frame's time stamp and record the time at which it started arriving in its trace: */
 			frames[frameId].timeStamp-=timeStampOffset;
+			frames[frameId].stampTrace(FrameBuffer::CAPTURE,double(receiveTime));
 			}
 		}
 	catch(const std::runtime_error& err)
@@ -0,0 +1,205 @@
+/***********************************************************************
+WorkerPool - Class to process ranges of work items in parallel bands on a
+pool of persistent worker threads.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <Kinect/WorkerPool.h>
+
+#include <unistd.h>
+
+namespace Kinect {
+
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+struct SingleBandJob // Structure to run a job of single bands as a range of work items
+	{
+	/* Elements: */
+	public:
+	WorkerPool::SingleBandFunction bandFunction; // Function processing a single band
+	void* bandFunctionUserData; // Additional data passed to the band function
+	
+	/* Methods: */
+	static void processItems(unsigned int bandIndex,int itemBegin,int itemEnd,void* userData)
+		{
+		SingleBandJob* job=static_cast<SingleBandJob*>(userData);
+		for(int item=itemBegin;item<itemEnd;++item)
+			(*job->bandFunction)((unsigned int)(item),job->bandFunctionUserData);
+		}
+	};
+
+}
+
+/***************************
+Methods of class WorkerPool:
+***************************/
+
+bool WorkerPool::processNextBand(void)
+	{
+	/* Claim the next band of the current job: */
+	unsigned int bandIndex;
+	int bandBegin,bandEnd;
+	BandFunction function;
+	void* userData;
+	{
+	Threads::MutexCond::Lock jobLock(jobCond);
+	if(nextBand>=numBands)
+		return false;
+	bandIndex=nextBand++;
+	int numItems=itemEnd-itemBegin;
+	bandBegin=itemBegin+int((long(numItems)*long(bandIndex))/long(numBands));
+	bandEnd=itemBegin+int((long(numItems)*long(bandIndex+1))/long(numBands));
+	function=bandFunction;
+	userData=bandFunctionUserData;
+	}
+	
+	/* Process the band: */
+	(*function)(bandIndex,bandBegin,bandEnd,userData);
+	
+	/* Mark the band as complete and wake up the calling thread if it was the last one: */
+	{
+	Threads::MutexCond::Lock doneLock(doneCond);
+	if(--numPendingBands==0)
+		doneCond.broadcast();
+	}
+	
+	return true;
+	}
+
+void* WorkerPool::workerThreadMethod(void)
+	{
+	unsigned int lastJobVersion=0;
+	
+	while(true)
+		{
+		{
+		Threads::MutexCond::Lock jobLock(jobCond);
+		
+		/* Wait until a new job arrives or the pool shuts down: */
+		while(runWorkers&&lastJobVersion==jobVersion)
+			jobCond.wait(jobLock);
+		
+		/* Bail out if the pool is shutting down: */
+		if(!runWorkers)
+			break;
+		
+		lastJobVersion=jobVersion;
+		}
+		
+		/* Process bands until the current job is exhausted: */
+		while(processNextBand())
+			;
+		}
+	
+	return 0;
+	}
+
+WorkerPool::WorkerPool(unsigned int sNumThreads)
+	:numThreads(sNumThreads),workers(0),
+	 runWorkers(true),jobVersion(0),
+	 bandFunction(0),bandFunctionUserData(0),
+	 itemBegin(0),itemEnd(0),numBands(0),nextBand(0),numPendingBands(0)
+	{
+	/* Use one thread per online CPU if no explicit thread count was given: */
+	if(numThreads==0)
+		{
+		long numCpus=sysconf(_SC_NPROCESSORS_ONLN);
+		numThreads=numCpus>0?(unsigned int)numCpus:1U;
+		}
+	
+	/* Start the background worker threads; the calling thread is the first worker: */
+	if(numThreads>1)
+		{
+		workers=new Threads::Thread[numThreads-1];
+		for(unsigned int i=0;i<numThreads-1;++i)
+			workers[i].start(this,&WorkerPool::workerThreadMethod);
+		}
+	}
+
+WorkerPool::~WorkerPool(void)
+	{
+	/* Shut down all worker threads: */
+	{
+	Threads::MutexCond::Lock jobLock(jobCond);
+	runWorkers=false;
+	jobCond.broadcast();
+	}
+	if(workers!=0)
+		for(unsigned int i=0;i<numThreads-1;++i)
+			workers[i].join();
+	delete[] workers;
+	}
+
+void WorkerPool::processBands(int newItemBegin,int newItemEnd,WorkerPool::BandFunction newBandFunction,void* newBandFunctionUserData)
+	{
+	unsigned int newNumBands=getNumBands(newItemEnd-newItemBegin);
+	if(newNumBands==0)
+		return;
+	
+	if(newNumBands==1)
+		{
+		/* Process the single band in the calling thread: */
+		(*newBandFunction)(0,newItemBegin,newItemEnd,newBandFunctionUserData);
+		return;
+		}
+	
+	/* Post the new job to the worker threads: */
+	{
+	Threads::MutexCond::Lock doneLock(doneCond);
+	numPendingBands=newNumBands;
+	}
+	{
+	Threads::MutexCond::Lock jobLock(jobCond);
+	bandFunction=newBandFunction;
+	bandFunctionUserData=newBandFunctionUserData;
+	itemBegin=newItemBegin;
+	itemEnd=newItemEnd;
+	numBands=newNumBands;
+	nextBand=0;
+	++jobVersion;
+	jobCond.broadcast();
+	}
+	
+	/* Process bands in the calling thread as well: */
+	while(processNextBand())
+		;
+	
+	/* Wait until all bands have been completed: */
+	{
+	Threads::MutexCond::Lock doneLock(doneCond);
+	while(numPendingBands>0)
+		doneCond.wait(doneLock);
+	}
+	}
+
+void WorkerPool::executeBands(unsigned int numBands,WorkerPool::SingleBandFunction bandFunction,void* bandFunctionUserData)
+	{
+	/* Process each band as a separate work item: */
+	SingleBandJob job;
+	job.bandFunction=bandFunction;
+	job.bandFunctionUserData=bandFunctionUserData;
+	processBands(0,int(numBands),&SingleBandJob::processItems,&job);
+	}
+
+}
@@ -0,0 +1,112 @@
+/***********************************************************************
+WorkerPool - Class to process ranges of work items in parallel bands on a
+pool of persistent worker threads.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#ifndef KINECT_WORKERPOOL_INCLUDED
+#define KINECT_WORKERPOOL_INCLUDED
+
+#include <Threads/Thread.h>
+#include <Threads/MutexCond.h>
+#include <Images/BandExecutor.h>
+
+namespace Kinect {
+
+class WorkerPool:public Images::BandExecutor
+	{
+	/* Embedded classes: */
+	public:
+	typedef void (*BandFunction)(unsigned int bandIndex,int itemBegin,int itemEnd,void* userData); // Type for functions processing a band of items [itemBegin, itemEnd)
+	typedef Images::BandExecutor::BandFunction SingleBandFunction; // Type for functions processing a single band of a job run through the Images::BandExecutor interface
+	
+	private:
+	template <class ObjectParam>
+	struct MethodCall // Helper structure to call a method on an object as a band function
+		{
+		/* Embedded classes: */
+		public:
+		typedef void (ObjectParam::*Method)(unsigned int bandIndex,int itemBegin,int itemEnd);
+		
+		/* Elements: */
+		ObjectParam* object;
+		Method method;
+		
+		/* Methods: */
+		static void call(unsigned int bandIndex,int itemBegin,int itemEnd,void* userData)
+			{
+			MethodCall* mc=static_cast<MethodCall*>(userData);
+			(mc->object->*mc->method)(bandIndex,itemBegin,itemEnd);
+			}
+		};
+	
+	/* Elements: */
+	unsigned int numThreads; // Total number of threads processing bands, including the calling thread
+	Threads::Thread* workers; // Array of background worker threads
+	Threads::MutexCond jobCond; // Condition variable to signal arrival of a new job to the worker threads
+	Threads::MutexCond doneCond; // Condition variable to signal completion of a job to the calling thread
+	volatile bool runWorkers; // Flag to keep the worker threads running
+	unsigned int jobVersion; // Version number of the current job
+	BandFunction bandFunction; // Function processing the current job's bands
+	void* bandFunctionUserData; // Additional data passed to the band function
+	int itemBegin,itemEnd; // Range of items covered by the current job
+	unsigned int numBands; // Number of bands in the current job
+	unsigned int nextBand; // Index of the next unclaimed band in the current job
+	unsigned int numPendingBands; // Number of bands in the current job that have not been completed yet
+	
+	/* Private methods: */
+	bool processNextBand(void); // Claims and processes the next unclaimed band of the current job; returns false if there are no more bands
+	void* workerThreadMethod(void); // Method for the background worker threads
+	
+	/* Constructors and destructors: */
+	public:
+	WorkerPool(unsigned int sNumThreads =0); // Creates a pool with the given total number of threads including the caller; uses number of online CPUs if zero
+	private:
+	WorkerPool(const WorkerPool& source); // Prohibit copy constructor
+	WorkerPool& operator=(const WorkerPool& source); // Prohibit assignment operator
+	public:
+	virtual ~WorkerPool(void); // Shuts down all worker threads
+	
+	/* Methods from class Images::BandExecutor: */
+	virtual unsigned int getNumThreads(void) const // Returns the total number of threads processing bands
+		{
+		return numThreads;
+		}
+	virtual void executeBands(unsigned int numBands,SingleBandFunction bandFunction,void* bandFunctionUserData); // Processes the given number of bands in parallel, each one as a separate work item
+	
+	/* New methods: */
+	unsigned int getNumBands(int numItems) const // Returns the number of bands into which a job of the given number of items will be split
+		{
+		return numItems<int(numThreads)?(numItems>0?(unsigned int)numItems:0U):numThreads;
+		}
+	void processBands(int newItemBegin,int newItemEnd,BandFunction newBandFunction,void* newBandFunctionUserData); // Processes the given range of items in parallel bands; returns when all bands are complete
+	template <class ObjectParam>
+	void processBands(int newItemBegin,int newItemEnd,ObjectParam* object,void (ObjectParam::*method)(unsigned int,int,int)) // Ditto, with a method called on the given object
+		{
+		MethodCall<ObjectParam> mc;
+		mc.object=object;
+		mc.method=method;
+		processBands(newItemBegin,newItemEnd,&MethodCall<ObjectParam>::call,&mc);
+		}
+	};
+
+}
+
+#endif
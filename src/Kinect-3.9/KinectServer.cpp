@@ -1,7 +1,7 @@
 /***********************************************************************
 KinectServer - Server to stream 3D video data from one or more Kinect
 cameras to remote clients for tele-immersion.
-Copyright (c) 2010-2018 Oliver Kreylos
+Copyright (c) 2010-2020 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -86,7 +86,7 @@ void KinectServer::CameraState::depthStreamingCallback(const Kinect::FrameBuffer
 	write(framePipeFd,&frameIndex,sizeof(frameIndex));
 	}
 
-KinectServer::CameraState::CameraState(const char* serialNumber,bool sLossyDepthCompression)
+KinectServer::CameraState::CameraState(const char* serialNumber,bool sLossyDepthCompression,unsigned int numDepthTiles,unsigned int numDepthEncodingThreads)
 	:camera(Kinect::openDirectFrameSource(serialNumber,false)),cameraIndex(0U),
 	 depthCorrection(0),framePipeFd(-1),
 	 colorFile(16384),colorCompressor(0),
@@ -107,9 +107,15 @@ KinectServer::CameraState::CameraState(const char* serialNumber,bool sLossyDepth
 	if(lossyDepthCompression)
 		depthCompressor=new Kinect::LossyDepthFrameWriter(depthFile,camera->getActualFrameSize(Kinect::FrameSource::DEPTH));
 	else
-		depthCompressor=new Kinect::DepthFrameWriter(depthFile,camera->getActualFrameSize(Kinect::FrameSource::DEPTH));
+		{
+		Kinect::DepthFrameWriter* dfw=new Kinect::DepthFrameWriter(depthFile,camera->getActualFrameSize(Kinect::FrameSource::DEPTH),numDepthTiles);
+		dfw->setNumEncodingThreads(numDepthEncodingThreads);
+		depthCompressor=dfw;
+		}
 	#else
-	depthCompressor=new Kinect::DepthFrameWriter(depthFile,camera->getActualFrameSize(Kinect::FrameSource::DEPTH));
+	Kinect::DepthFrameWriter* dfw=new Kinect::DepthFrameWriter(depthFile,camera->getActualFrameSize(Kinect::FrameSource::DEPTH),numDepthTiles);
+	dfw->setNumEncodingThreads(numDepthEncodingThreads);
+	depthCompressor=dfw;
 	#endif
 	
 	/* Extract the color and depth compressors' stream header data: */
@@ -498,7 +504,10 @@ KinectServer::KinectServer(Misc::ConfigurationFileSection& configFileSection)
 			#ifdef VERBOSE
 			std::cout<<"KinectServer: Creating streamer for camera with serial number "<<serialNumber<<std::endl;
 			#endif
-			cameraStates[numFoundCameras]=new CameraState(serialNumber.c_str(),cameraSection.retrieveValue<bool>("./lossyDepthCompression",false));
+			bool lossyDepthCompression=cameraSection.retrieveValue<bool>("./lossyDepthCompression",false);
+			unsigned int numDepthTiles=cameraSection.retrieveValue<unsigned int>("./depthCompressionTiles",0);
+			unsigned int numDepthEncodingThreads=cameraSection.retrieveValue<unsigned int>("./depthCompressionThreads",1);
+			cameraStates[numFoundCameras]=new CameraState(serialNumber.c_str(),lossyDepthCompression,numDepthTiles,numDepthEncodingThreads);
 			
 			/* Check if camera is to remove background: */
 			if(cameraSection.retrieveValue<bool>("./removeBackground",true))
@@ -1,7 +1,7 @@
 /***********************************************************************
 KinectServer - Server to stream 3D video data from one or more Kinect
 cameras to remote clients for tele-immersion.
-Copyright (c) 2010-2017 Oliver Kreylos
+Copyright (c) 2010-2020 Oliver Kreylos
 
 This file is part of the Kinect 3D Video Capture Project (Kinect).
 
@@ -100,7 +100,7 @@ class KinectServer
 		void depthStreamingCallback(const Kinect::FrameBuffer& frame);
 		
 		/* Constructors and destructors: */
-		CameraState(const char* serialNumber,bool sLossyDepthCompression); // Creates a capture and compression state for the given Kinect camera device
+		CameraState(const char* serialNumber,bool sLossyDepthCompression,unsigned int numDepthTiles,unsigned int numDepthEncodingThreads); // Creates a capture and compression state for the given Kinect camera device; uses the tiled lossless depth codec if the number of depth tiles is non-zero
 		~CameraState(void);
 		
 		/* Methods: */
@@ -0,0 +1,320 @@
+/***********************************************************************
+KinectV1DecodeBenchmark - Utility to measure the per-frame cost of
+unpacking raw depth frames and demosaicing raw color frames from a
+first-generation Kinect camera with all supported decoding kernel sets.
+Copyright (c) 2020 Oliver Kreylos
+
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <vector>
+#include <iostream>
+#include <Misc/SizedTypes.h>
+#include <Misc/Timer.h>
+#include <IO/SeekableFile.h>
+#include <IO/OpenFile.h>
+#include <Math/Constants.h>
+#include <Kinect/FrameSource.h>
+#include <Kinect/Internal/KinectV1FrameDecoder.h>
+
+/****************
+Helper functions:
+****************/
+
+typedef Kinect::KinectV1FrameDecoder Decoder;
+typedef Kinect::FrameSource::DepthPixel DepthPixel;
+typedef Kinect::FrameSource::ColorComponent ColorComponent;
+
+size_t readRawFrames(const char* fileName,size_t rawFrameSize,std::vector<Misc::UInt8>& rawFrames) // Reads all complete raw frames from the given file; returns number of frames read
+	{
+	IO::SeekableFilePtr file(IO::openSeekableFile(fileName));
+	size_t numFrames=size_t(file->getSize())/rawFrameSize;
+	rawFrames.resize(numFrames*rawFrameSize);
+	if(numFrames>0)
+		file->readRaw(&rawFrames[0],numFrames*rawFrameSize);
+	return numFrames;
+	}
+
+void createDepthFrames(int width,int height,size_t numFrames,std::vector<Misc::UInt8>& rawFrames) // Creates packed raw depth frames of a noisy tilted plane
+	{
+	size_t rawFrameSize=(size_t(width)*size_t(height)*11)/8;
+	rawFrames.resize(numFrames*rawFrameSize);
+	Misc::UInt8* rPtr=&rawFrames[0];
+	for(size_t frame=0;frame<numFrames;++frame)
+		for(int y=0;y<height;++y)
+			for(int x=0;x<width;x+=8,rPtr+=11)
+				{
+				/* Create a group of eight depth values and pack them into 11 bytes, most significant bit first: */
+				unsigned int bitBuffer=0;
+				int numBits=0;
+				Misc::UInt8* bPtr=rPtr;
+				for(int i=0;i<8;++i)
+					{
+					unsigned int depth=(600U+((x+i)*3+y*2)/4+rand()%16)&0x7ffU;
+					bitBuffer=(bitBuffer<<11)|depth;
+					for(numBits+=11;numBits>=8;numBits-=8)
+						*(bPtr++)=Misc::UInt8(bitBuffer>>(numBits-8));
+					}
+				}
+	}
+
+void createColorFrames(int width,int height,size_t numFrames,std::vector<Misc::UInt8>& rawFrames) // Creates random raw Bayer-pattern color frames
+	{
+	rawFrames.resize(numFrames*size_t(width)*size_t(height));
+	for(std::vector<Misc::UInt8>::iterator rIt=rawFrames.begin();rIt!=rawFrames.end();++rIt)
+		*rIt=Misc::UInt8(rand());
+	}
+
+void printUsage(void)
+	{
+	std::cout<<"Usage: KinectV1DecodeBenchmark [-size <width> <height>] [-passes <number of passes>] [-frames <number of frames>] [-fuzz <fuzz value>] [-depth <raw depth file name>] [-color <raw color file name>]"<<std::endl;
+	std::cout<<"  -size <width> <height>"<<std::endl;
+	std::cout<<"     Size of raw frames in pixels. Default: 640 480"<<std::endl;
+	std::cout<<"  -passes <number of passes>"<<std::endl;
+	std::cout<<"     Decodes all frames the given number of times and reports the best"<<std::endl;
+	std::cout<<"     pass. Default: 5"<<std::endl;
+	std::cout<<"  -frames <number of frames>"<<std::endl;
+	std::cout<<"     Number of synthetic frames to create if no raw frame files are given."<<std::endl;
+	std::cout<<"     Default: 30"<<std::endl;
+	std::cout<<"  -fuzz <fuzz value>"<<std::endl;
+	std::cout<<"     Additionally benchmarks depth unpacking with fused background"<<std::endl;
+	std::cout<<"     removal against the first frame, using the given fuzz value"<<std::endl;
+	std::cout<<"  -depth <raw depth file name>"<<std::endl;
+	std::cout<<"     File of concatenated raw packed 11-bit depth frames, as saved by"<<std::endl;
+	std::cout<<"     Kinect::Camera with KINECT_CAMERA_DUMP_RAWFRAMES enabled"<<std::endl;
+	std::cout<<"  -color <raw color file name>"<<std::endl;
+	std::cout<<"     File of concatenated raw Bayer GRBG color frames, ditto"<<std::endl;
+	}
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	int width=640;
+	int height=480;
+	unsigned int numPasses=5;
+	size_t numSyntheticFrames=30;
+	bool removeBackground=false;
+	int fuzz=0;
+	const char* depthFileName=0;
+	const char* colorFileName=0;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"size")==0)
+				{
+				i+=2;
+				if(i<argc)
+					{
+					width=atoi(argv[i-1]);
+					height=atoi(argv[i]);
+					}
+				}
+			else if(strcasecmp(argv[i]+1,"passes")==0)
+				{
+				++i;
+				if(i<argc)
+					numPasses=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"frames")==0)
+				{
+				++i;
+				if(i<argc)
+					numSyntheticFrames=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"fuzz")==0)
+				{
+				++i;
+				if(i<argc)
+					{
+					removeBackground=true;
+					fuzz=atoi(argv[i]);
+					}
+				}
+			else if(strcasecmp(argv[i]+1,"depth")==0)
+				{
+				++i;
+				if(i<argc)
+					depthFileName=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"color")==0)
+				{
+				++i;
+				if(i<argc)
+					colorFileName=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"h")==0)
+				{
+				printUsage();
+				return 0;
+				}
+			else
+				std::cerr<<"Ignoring unrecognized command line option "<<argv[i]<<std::endl;
+			}
+		else
+			std::cerr<<"Ignoring command line argument "<<argv[i]<<std::endl;
+		}
+	if(width<8||width%8!=0||height<2||height%2!=0||numPasses==0)
+		{
+		printUsage();
+		return 1;
+		}
+	
+	/* Load or create raw frames: */
+	size_t rawDepthFrameSize=(size_t(width)*size_t(height)*11)/8;
+	size_t rawColorFrameSize=size_t(width)*size_t(height);
+	std::vector<Misc::UInt8> rawDepthFrames,rawColorFrames;
+	size_t numDepthFrames=0,numColorFrames=0;
+	try
+		{
+		if(depthFileName!=0)
+			numDepthFrames=readRawFrames(depthFileName,rawDepthFrameSize,rawDepthFrames);
+		if(colorFileName!=0)
+			numColorFrames=readRawFrames(colorFileName,rawColorFrameSize,rawColorFrames);
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"Unable to read raw frames due to exception "<<err.what()<<std::endl;
+		return 1;
+		}
+	if(depthFileName==0&&colorFileName==0)
+		{
+		numDepthFrames=numColorFrames=numSyntheticFrames;
+		createDepthFrames(width,height,numDepthFrames,rawDepthFrames);
+		createColorFrames(width,height,numColorFrames,rawColorFrames);
+		}
+	
+	int result=0;
+	std::vector<DepthPixel> background(size_t(width)*size_t(height));
+	std::vector<DepthPixel> referenceDepth(size_t(width)*size_t(height));
+	std::vector<DepthPixel> depth(size_t(width)*size_t(height));
+	std::vector<ColorComponent> referenceColor(size_t(width)*size_t(height)*3);
+	std::vector<ColorComponent> color(size_t(width)*size_t(height)*3);
+	Decoder decoder;
+	
+	/* Use the first depth frame, shifted forward, as background frame: */
+	if(removeBackground&&numDepthFrames>0)
+		{
+		decoder.setKernelSet(Decoder::SCALAR);
+		decoder.unpackDepth(&rawDepthFrames[0],width,height,&background[0],0,0);
+		for(std::vector<DepthPixel>::iterator bIt=background.begin();bIt!=background.end();++bIt)
+			*bIt=*bIt>4?*bIt-4:0;
+		}
+	
+	/* Benchmark depth unpacking with and without background removal: */
+	for(int removal=0;removal<(removeBackground?2:1)&&numDepthFrames>0;++removal)
+		{
+		const DepthPixel* bg=removal!=0?&background[0]:0;
+		std::cout<<"Depth unpacking, "<<numDepthFrames<<" frames of "<<width<<'x'<<height<<" pixels";
+		if(removal!=0)
+			std::cout<<", with background removal at fuzz "<<fuzz;
+		std::cout<<std::endl;
+		for(int ks=Decoder::SCALAR;ks<Decoder::NUM_KERNELSETS;++ks)
+			{
+			Decoder::KernelSet kernelSet=Decoder::KernelSet(ks);
+			if(!Decoder::isKernelSetSupported(kernelSet))
+				continue;
+			
+			/* Decode all frames the requested number of times: */
+			decoder.setKernelSet(kernelSet);
+			double bestTime=Math::Constants<double>::max;
+			for(unsigned int pass=0;pass<numPasses;++pass)
+				{
+				Misc::Timer decodeTimer;
+				for(size_t frame=0;frame<numDepthFrames;++frame)
+					decoder.unpackDepth(&rawDepthFrames[frame*rawDepthFrameSize],width,height,&depth[0],bg,fuzz);
+				decodeTimer.elapse();
+				if(bestTime>decodeTimer.getTime())
+					bestTime=decodeTimer.getTime();
+				}
+			
+			/* Check the kernel set's results against the scalar kernels: */
+			size_t numMismatches=0;
+			for(size_t frame=0;frame<numDepthFrames;++frame)
+				{
+				const Misc::UInt8* rawFrame=&rawDepthFrames[frame*rawDepthFrameSize];
+				decoder.setKernelSet(Decoder::SCALAR);
+				decoder.unpackDepth(rawFrame,width,height,&referenceDepth[0],bg,fuzz);
+				decoder.setKernelSet(kernelSet);
+				decoder.unpackDepth(rawFrame,width,height,&depth[0],bg,fuzz);
+				if(depth!=referenceDepth)
+					++numMismatches;
+				}
+			
+			std::cout<<"  "<<Decoder::getKernelSetName(kernelSet)<<": "<<bestTime*1000.0/double(numDepthFrames)<<" ms/frame, "<<double(numDepthFrames)/bestTime<<" frames/s";
+			if(numMismatches!=0)
+				{
+				std::cout<<", "<<numMismatches<<" frames differ from scalar kernels";
+				result=1;
+				}
+			std::cout<<std::endl;
+			}
+		}
+	
+	/* Benchmark color demosaicing: */
+	if(numColorFrames>0)
+		{
+		std::cout<<"Color demosaicing, "<<numColorFrames<<" frames of "<<width<<'x'<<height<<" pixels"<<std::endl;
+		for(int ks=Decoder::SCALAR;ks<Decoder::NUM_KERNELSETS;++ks)
+			{
+			Decoder::KernelSet kernelSet=Decoder::KernelSet(ks);
+			if(!Decoder::isKernelSetSupported(kernelSet))
+				continue;
+			
+			/* Decode all frames the requested number of times: */
+			decoder.setKernelSet(kernelSet);
+			double bestTime=Math::Constants<double>::max;
+			for(unsigned int pass=0;pass<numPasses;++pass)
+				{
+				Misc::Timer decodeTimer;
+				for(size_t frame=0;frame<numColorFrames;++frame)
+					decoder.demosaicColor(&rawColorFrames[frame*rawColorFrameSize],width,height,&color[0]);
+				decodeTimer.elapse();
+				if(bestTime>decodeTimer.getTime())
+					bestTime=decodeTimer.getTime();
+				}
+			
+			/* Check the kernel set's results against the scalar kernels: */
+			size_t numMismatches=0;
+			for(size_t frame=0;frame<numColorFrames;++frame)
+				{
+				const Misc::UInt8* rawFrame=&rawColorFrames[frame*rawColorFrameSize];
+				decoder.setKernelSet(Decoder::SCALAR);
+				decoder.demosaicColor(rawFrame,width,height,&referenceColor[0]);
+				decoder.setKernelSet(kernelSet);
+				decoder.demosaicColor(rawFrame,width,height,&color[0]);
+				if(color!=referenceColor)
+					++numMismatches;
+				}
+			
+			std::cout<<"  "<<Decoder::getKernelSetName(kernelSet)<<": "<<bestTime*1000.0/double(numColorFrames)<<" ms/frame, "<<double(numColorFrames)/bestTime<<" frames/s";
+			if(numMismatches!=0)
+				{
+				std::cout<<", "<<numMismatches<<" frames differ from scalar kernels";
+				result=1;
+				}
+			std::cout<<std::endl;
+			}
+		}
+	
+	return result;
+	}
@@ -0,0 +1,408 @@
+/***********************************************************************
+KinectV2DepthDecoderTest - Regression test comparing the vectorized phase
+and depth calculation kernels for Kinect v2 cameras against the scalar
+reference kernels on captured or synthetic raw gated IR images.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Kinect 3D Video Capture Project (Kinect).
+
+The Kinect 3D Video Capture Project is free software; you can
+redistribute it and/or modify it under the terms of the GNU General
+Public License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+The Kinect 3D Video Capture Project is distributed in the hope that it
+will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Kinect 3D Video Capture Project; if not, write to the Free
+Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <Misc/SizedTypes.h>
+#include <Misc/Timer.h>
+#include <IO/File.h>
+#include <IO/FixedMemoryFile.h>
+#include <IO/OpenFile.h>
+#include <Math/Math.h>
+#include <Math/Constants.h>
+#include <Kinect/FrameSource.h>
+#include <Kinect/Internal/KinectV2DepthDecoder.h>
+
+typedef Kinect::KinectV2DepthDecoder::IRPixel IRPixel;
+typedef Kinect::FrameSource::DepthPixel DepthPixel;
+
+static const unsigned int numPixels=Kinect::KinectV2DepthDecoder::width*Kinect::KinectV2DepthDecoder::height;
+static const size_t p0TableBlockSize=8*sizeof(Misc::UInt32)+3*(numPixels+2)*sizeof(Misc::UInt16);
+
+/**************
+Helper classes:
+**************/
+
+struct KernelSetResult // Structure to accumulate comparison results and timings for one kernel set
+	{
+	/* Elements: */
+	public:
+	Kinect::KinectV2DepthDecoder* decoder; // Decoder using the kernel set
+	unsigned int maxAngleUlps; // Maximum difference between phase angles and reference phase angles in units in the last place
+	unsigned int maxMagnitudeUlps; // Maximum difference between phase magnitudes and reference phase magnitudes in units in the last place
+	unsigned int maxDepthDifference; // Maximum difference between quantized depth values and reference depth values
+	size_t numPhaseOutliers; // Number of phase image pixels exceeding the phase tolerance
+	size_t numDepthOutliers; // Number of depth image pixels exceeding the depth tolerance
+	double phaseTime,depthTime; // Accumulated phase and depth calculation times in seconds
+	
+	/* Constructors and destructors: */
+	KernelSetResult(void)
+		:decoder(0),
+		 maxAngleUlps(0),maxMagnitudeUlps(0),maxDepthDifference(0),
+		 numPhaseOutliers(0),numDepthOutliers(0),
+		 phaseTime(0.0),depthTime(0.0)
+		{
+		}
+	};
+
+/****************
+Helper functions:
+****************/
+
+unsigned int ulpDistance(float v1,float v2) // Returns the distance between two finite floating-point values in units in the last place
+	{
+	Misc::SInt32 i1,i2;
+	memcpy(&i1,&v1,sizeof(Misc::SInt32));
+	memcpy(&i2,&v2,sizeof(Misc::SInt32));
+	
+	/* Map the sign-magnitude representations to a monotonic integer scale: */
+	Misc::SInt64 o1=i1>=0?Misc::SInt64(i1):Misc::SInt64(Misc::SInt32(0x80000000U)-i1);
+	Misc::SInt64 o2=i2>=0?Misc::SInt64(i2):Misc::SInt64(Misc::SInt32(0x80000000U)-i2);
+	Misc::SInt64 d=o1>=o2?o1-o2:o2-o1;
+	return d<Misc::SInt64(0xffffffffU)?(unsigned int)d:0xffffffffU;
+	}
+
+void createSyntheticP0Tables(std::vector<Misc::UInt8>& p0TableBlock) // Creates a P0 table block with pseudo-random per-pixel phase offsets
+	{
+	p0TableBlock.assign(p0TableBlockSize,0U);
+	Misc::UInt8* ptPtr=&p0TableBlock[8*sizeof(Misc::UInt32)];
+	unsigned int seed=0x12345678U;
+	for(int exposure=0;exposure<3;++exposure)
+		{
+		ptPtr+=sizeof(Misc::UInt16);
+		for(unsigned int i=0;i<numPixels;++i,ptPtr+=sizeof(Misc::UInt16))
+			{
+			/* Store a little-endian pseudo-random offset: */
+			seed=seed*1664525U+1013904223U;
+			ptPtr[0]=Misc::UInt8(seed>>16);
+			ptPtr[1]=Misc::UInt8(seed>>24);
+			}
+		ptPtr+=sizeof(Misc::UInt16);
+		}
+	}
+
+float getP0Offset(const std::vector<Misc::UInt8>& p0TableBlock,int exposure,unsigned int pixelIndex) // Returns a pixel's phase offset in radians from a P0 table block
+	{
+	const Misc::UInt8* ptPtr=&p0TableBlock[8*sizeof(Misc::UInt32)+(exposure*(numPixels+2)+1+pixelIndex)*sizeof(Misc::UInt16)];
+	return -2.0f*Math::Constants<float>::pi*float(Misc::UInt16(ptPtr[0])|(Misc::UInt16(ptPtr[1])<<8))/65536.0f;
+	}
+
+void createSyntheticFrame(const std::vector<Misc::UInt8>& p0TableBlock,unsigned int frameIndex,IRPixel* images[10]) // Creates raw gated IR images of a synthetic scene
+	{
+	static const double frequencies[3]={5.0,1.0,7.5}; // Modulation frequencies of the three exposures relative to 16MHz
+	const double twoPi=2.0*Math::Constants<double>::pi;
+	const int width=int(Kinect::KinectV2DepthDecoder::width);
+	unsigned int seed=0x9e3779b9U*(frameIndex+1);
+	for(unsigned int i=0;i<numPixels;++i)
+		{
+		/* Calculate the pixel's range as fraction of the 16MHz modulation wavelength and its reflectance: */
+		int x=int(i)%width;
+		int y=int(i)/width;
+		double range=0.05+0.3*(double(y)/424.0)+0.02*Math::sin(double(x)*0.05+double(frameIndex)*0.3);
+		double amplitude=20.0+1500.0*double(x)/512.0;
+		
+		/* Sprinkle in some noise, dark pixels, and saturated pixels: */
+		seed=seed*1664525U+1013904223U;
+		unsigned int r=seed>>8;
+		range+=double(int(r%1024U)-512)*1.0e-6;
+		if(r%97U==0U)
+			amplitude=1.0;
+		
+		for(int exposure=0;exposure<3;++exposure)
+			{
+			/* Calculate the exposure's phase angle and the three gated images: */
+			double angle=twoPi*(range*frequencies[exposure]-Math::floor(range*frequencies[exposure]));
+			double p=getP0Offset(p0TableBlock,exposure,i);
+			for(int image=0;image<3;++image)
+				{
+				double value=amplitude*Math::cos(angle+p+double(image)*twoPi/3.0);
+				images[exposure*3+image][i]=r%89U==0U?IRPixel(32767):IRPixel(Math::floor(value+0.5));
+				}
+			}
+		images[9][i]=0;
+		}
+	}
+
+void printUsage(void)
+	{
+	std::cout<<"Usage: KinectV2DepthDecoderTest [-p0 <P0 table file>] [-params <sx> <cx> <sy> <cy> <k1> <k2> <k3> <p1> <p2>] [-synthetic <number of frames>] [-threads <number of threads>] [-phaseTolerance <ULPs>] [-depthTolerance <depth units>] [<raw IR file> ...]"<<std::endl;
+	std::cout<<"  -p0 <P0 table file>"<<std::endl;
+	std::cout<<"     Reads per-pixel phase offset tables from a file saved from the"<<std::endl;
+	std::cout<<"     camera's reply to the P0 table request. Default: pseudo-random tables"<<std::endl;
+	std::cout<<"  -params <sx> <cx> <sy> <cy> <k1> <k2> <k3> <p1> <p2>"<<std::endl;
+	std::cout<<"     Depth camera projection and lens distortion correction parameters."<<std::endl;
+	std::cout<<"     Default: 365 256 365 212 0 0 0 0 0"<<std::endl;
+	std::cout<<"  -synthetic <number of frames>"<<std::endl;
+	std::cout<<"     Tests the given number of synthetic frames in addition to raw IR files."<<std::endl;
+	std::cout<<"     Default: 4 if no raw IR files are given, 0 otherwise"<<std::endl;
+	std::cout<<"  -threads <number of threads>"<<std::endl;
+	std::cout<<"     Calculates depth images on the given number of threads; 0 uses all"<<std::endl;
+	std::cout<<"     CPUs. The scalar reference always uses one thread. Default: 0"<<std::endl;
+	std::cout<<"  -phaseTolerance <ULPs>"<<std::endl;
+	std::cout<<"     Maximum accepted difference between phase angles or magnitudes and the"<<std::endl;
+	std::cout<<"     reference in units in the last place. Default: 0"<<std::endl;
+	std::cout<<"  -depthTolerance <depth units>"<<std::endl;
+	std::cout<<"     Maximum accepted difference between quantized depth values and the"<<std::endl;
+	std::cout<<"     reference. Default: 0"<<std::endl;
+	std::cout<<"  Raw IR files contain sequences of frames of ten consecutive 512x424"<<std::endl;
+	std::cout<<"  little-endian 16-bit raw gated IR images, as delivered to a Kinect v2 depth"<<std::endl;
+	std::cout<<"  stream reader's raw image callback"<<std::endl;
+	}
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	const char* p0FileName=0;
+	Kinect::KinectV2CommandDispatcher::DepthCameraParams depthCameraParams;
+	depthCameraParams.sx=365.0f;
+	depthCameraParams.cx=256.0f;
+	depthCameraParams.sy=365.0f;
+	depthCameraParams.cy=212.0f;
+	depthCameraParams.k1=depthCameraParams.k2=depthCameraParams.k3=0.0f;
+	depthCameraParams.p1=depthCameraParams.p2=0.0f;
+	int numSyntheticFrames=-1;
+	unsigned int numThreads=0;
+	unsigned int phaseTolerance=0;
+	unsigned int depthTolerance=0;
+	std::vector<std::string> rawFileNames;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"p0")==0)
+				{
+				++i;
+				if(i<argc)
+					p0FileName=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"params")==0)
+				{
+				if(i+9<argc)
+					{
+					float* params[9]={&depthCameraParams.sx,&depthCameraParams.cx,&depthCameraParams.sy,&depthCameraParams.cy,
+					                  &depthCameraParams.k1,&depthCameraParams.k2,&depthCameraParams.k3,&depthCameraParams.p1,&depthCameraParams.p2};
+					for(int j=0;j<9;++j)
+						*params[j]=float(atof(argv[i+1+j]));
+					}
+				i+=9;
+				}
+			else if(strcasecmp(argv[i]+1,"synthetic")==0)
+				{
+				++i;
+				if(i<argc)
+					numSyntheticFrames=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"threads")==0)
+				{
+				++i;
+				if(i<argc)
+					numThreads=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"phaseTolerance")==0)
+				{
+				++i;
+				if(i<argc)
+					phaseTolerance=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"depthTolerance")==0)
+				{
+				++i;
+				if(i<argc)
+					depthTolerance=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"h")==0)
+				{
+				printUsage();
+				return 0;
+				}
+			else
+				std::cerr<<"Ignoring unrecognized command line option "<<argv[i]<<std::endl;
+			}
+		else
+			rawFileNames.push_back(argv[i]);
+		}
+	if(numSyntheticFrames<0)
+		numSyntheticFrames=rawFileNames.empty()?4:0;
+	
+	try
+		{
+		/* Load or create the P0 table block: */
+		std::vector<Misc::UInt8> p0TableBlock;
+		if(p0FileName!=0)
+			{
+			IO::FilePtr p0File(IO::openFile(p0FileName));
+			p0TableBlock.resize(p0TableBlockSize);
+			p0File->readRaw(&p0TableBlock[0],p0TableBlockSize);
+			}
+		else
+			createSyntheticP0Tables(p0TableBlock);
+		
+		/* Create a reference decoder using the scalar kernels on a single thread, and one decoder for each supported kernel set: */
+		std::vector<KernelSetResult> results(Kinect::KinectV2DepthDecoder::NUM_KERNELSETS);
+		for(int ks=0;ks<Kinect::KinectV2DepthDecoder::NUM_KERNELSETS;++ks)
+			if(ks==Kinect::KinectV2DepthDecoder::SCALAR||Kinect::KinectV2DepthDecoder::isKernelSetSupported(Kinect::KinectV2DepthDecoder::KernelSet(ks)))
+				results[ks].decoder=new Kinect::KinectV2DepthDecoder(ks==Kinect::KinectV2DepthDecoder::SCALAR?1:numThreads);
+		if(numThreads!=1)
+			{
+			/* Test the scalar kernels on multiple threads as well: */
+			results.push_back(KernelSetResult());
+			results.back().decoder=new Kinect::KinectV2DepthDecoder(numThreads);
+			}
+		for(std::vector<KernelSetResult>::iterator rIt=results.begin();rIt!=results.end();++rIt)
+			if(rIt->decoder!=0)
+				{
+				if(rIt-results.begin()<Kinect::KinectV2DepthDecoder::NUM_KERNELSETS)
+					rIt->decoder->setKernelSet(Kinect::KinectV2DepthDecoder::KernelSet(rIt-results.begin()));
+				else
+					rIt->decoder->setKernelSet(Kinect::KinectV2DepthDecoder::SCALAR);
+				IO::FixedMemoryFile p0File(p0TableBlockSize);
+				memcpy(p0File.getMemory(),&p0TableBlock[0],p0TableBlockSize);
+				rIt->decoder->loadP0Tables(p0File);
+				rIt->decoder->calcXZTables(depthCameraParams);
+				}
+		
+		/* Allocate the raw image buffers and depth frames: */
+		std::vector<IRPixel> imageBlock(10*numPixels);
+		IRPixel* images[10];
+		for(int i=0;i<10;++i)
+			images[i]=&imageBlock[i*numPixels];
+		std::vector<DepthPixel> referenceFrame(numPixels);
+		std::vector<DepthPixel> frame(numPixels);
+		
+		/* Process all synthetic frames and all frames from all raw IR files: */
+		unsigned int numFrames=0;
+		std::vector<std::string>::iterator rfnIt=rawFileNames.begin();
+		IO::FilePtr rawFile;
+		int syntheticFrameIndex=0;
+		while(true)
+			{
+			/* Get the next frame: */
+			if(syntheticFrameIndex<numSyntheticFrames)
+				createSyntheticFrame(p0TableBlock,syntheticFrameIndex++,images);
+			else
+				{
+				/* Open the next raw IR file if there is no current file or the current file is finished: */
+				while(rawFile==0||rawFile->eof())
+					{
+					rawFile=0;
+					if(rfnIt==rawFileNames.end())
+						break;
+					rawFile=IO::openFile((rfnIt++)->c_str());
+					rawFile->setEndianness(Misc::LittleEndian);
+					}
+				if(rawFile==0)
+					break;
+				rawFile->read(&imageBlock[0],10*numPixels);
+				}
+			
+			/* Calculate phase and depth images with all decoders: */
+			for(std::vector<KernelSetResult>::iterator rIt=results.begin();rIt!=results.end();++rIt)
+				if(rIt->decoder!=0)
+					{
+					Misc::Timer phaseTimer;
+					for(int exposure=0;exposure<3;++exposure)
+						rIt->decoder->calcPhaseImage(exposure,images[exposure*3+0],images[exposure*3+1],images[exposure*3+2]);
+					phaseTimer.elapse();
+					rIt->phaseTime+=phaseTimer.getTime();
+					
+					Misc::Timer depthTimer;
+					rIt->decoder->calcDepthFrame(rIt==results.begin()?&referenceFrame[0]:&frame[0]);
+					depthTimer.elapse();
+					rIt->depthTime+=depthTimer.getTime();
+					
+					if(rIt!=results.begin())
+						{
+						/* Compare the phase images against the reference: */
+						for(int exposure=0;exposure<3;++exposure)
+							{
+							const float* refAngles=results[0].decoder->getPhaseAngles(exposure);
+							const float* refMagnitudes=results[0].decoder->getPhaseMagnitudes(exposure);
+							const float* angles=rIt->decoder->getPhaseAngles(exposure);
+							const float* magnitudes=rIt->decoder->getPhaseMagnitudes(exposure);
+							for(unsigned int i=0;i<numPixels;++i)
+								{
+								unsigned int angleUlps=ulpDistance(angles[i],refAngles[i]);
+								unsigned int magnitudeUlps=ulpDistance(magnitudes[i],refMagnitudes[i]);
+								if(rIt->maxAngleUlps<angleUlps)
+									rIt->maxAngleUlps=angleUlps;
+								if(rIt->maxMagnitudeUlps<magnitudeUlps)
+									rIt->maxMagnitudeUlps=magnitudeUlps;
+								if(angleUlps>phaseTolerance||magnitudeUlps>phaseTolerance)
+									++rIt->numPhaseOutliers;
+								}
+							}
+						
+						/* Compare the depth image against the reference: */
+						for(unsigned int i=0;i<numPixels;++i)
+							{
+							unsigned int difference=frame[i]>=referenceFrame[i]?frame[i]-referenceFrame[i]:referenceFrame[i]-frame[i];
+							if(rIt->maxDepthDifference<difference)
+								rIt->maxDepthDifference=difference;
+							if(difference>depthTolerance)
+								++rIt->numDepthOutliers;
+							}
+						}
+					}
+			
+			++numFrames;
+			}
+		
+		/* Print the results: */
+		std::cout<<"Tested "<<numFrames<<" frames"<<std::endl;
+		int result=0;
+		for(std::vector<KernelSetResult>::iterator rIt=results.begin();rIt!=results.end();++rIt)
+			if(rIt->decoder!=0)
+				{
+				std::cout<<Kinect::KinectV2DepthDecoder::getKernelSetName(rIt->decoder->getKernelSet())<<" kernels on "<<rIt->decoder->getNumDepthThreads()<<" depth thread(s):"<<std::endl;
+				if(numFrames>0)
+					std::cout<<"  Phase time: "<<rIt->phaseTime*1000.0/double(numFrames)<<" ms/frame, depth time: "<<rIt->depthTime*1000.0/double(numFrames)<<" ms/frame"<<std::endl;
+				if(rIt==results.begin())
+					std::cout<<"  Reference"<<std::endl;
+				else
+					{
+					std::cout<<"  Max phase angle difference: "<<rIt->maxAngleUlps<<" ULPs, max phase magnitude difference: "<<rIt->maxMagnitudeUlps<<" ULPs"<<std::endl;
+					std::cout<<"  Max depth difference: "<<rIt->maxDepthDifference<<std::endl;
+					if(rIt->numPhaseOutliers!=0||rIt->numDepthOutliers!=0)
+						{
+						std::cout<<"  FAILED: "<<rIt->numPhaseOutliers<<" phase pixels and "<<rIt->numDepthOutliers<<" depth pixels exceed the tolerance"<<std::endl;
+						result=1;
+						}
+					else
+						std::cout<<"  Passed"<<std::endl;
+					}
+				delete rIt->decoder;
+				}
+		
+		return result;
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"Test failed due to exception "<<err.what()<<std::endl;
+		return 1;
+		}
+	}
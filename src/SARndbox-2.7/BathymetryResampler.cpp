@@ -0,0 +1,275 @@
+/***********************************************************************
+BathymetryResampler - Class to resample filtered depth images directly
+into a water table's vertex-centered bathymetry grid on the CPU, as a
+replacement for rendering the depth image's surface into the grid on the
+GPU.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "BathymetryResampler.h"
+
+#include <Math/Math.h>
+#include <Math/Constants.h>
+#include <Geometry/Point.h>
+#include <Geometry/Box.h>
+#include <Geometry/Matrix.h>
+#include <Geometry/OrthonormalTransformation.h>
+
+#include "Float4.h"
+#include "WaterTable2.h"
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+inline void rasterizeTriangle(const float* x,const float* y,const float* e,GLfloat* grid,int gridWidth,int rowBegin,int rowEnd,const float elevationRange[2]) // Rasterizes a triangle with the given grid-space vertex positions and elevations into the given band of grid rows, keeping the highest elevation in each grid vertex
+	{
+	/* Calculate the triangle's signed area and bail out if it is degenerate: */
+	float area=(x[1]-x[0])*(y[2]-y[0])-(y[1]-y[0])*(x[2]-x[0]);
+	if(area==0.0f)
+		return;
+	float invArea=1.0f/area;
+	
+	/* Calculate the range of grid vertices whose centers might be covered by the triangle: */
+	int xMin=int(Math::ceil(Math::min(Math::min(x[0],x[1]),x[2])-0.5f));
+	int xMax=int(Math::floor(Math::max(Math::max(x[0],x[1]),x[2])-0.5f));
+	int yMin=int(Math::ceil(Math::min(Math::min(y[0],y[1]),y[2])-0.5f));
+	int yMax=int(Math::floor(Math::max(Math::max(y[0],y[1]),y[2])-0.5f));
+	if(xMin<0)
+		xMin=0;
+	if(xMax>=gridWidth)
+		xMax=gridWidth-1;
+	if(yMin<rowBegin)
+		yMin=rowBegin;
+	if(yMax>=rowEnd)
+		yMax=rowEnd-1;
+	
+	for(int gy=yMin;gy<=yMax;++gy)
+		{
+		float py=float(gy)+0.5f;
+		GLfloat* rowPtr=grid+size_t(gy)*size_t(gridWidth);
+		for(int gx=xMin;gx<=xMax;++gx)
+			{
+			float px=float(gx)+0.5f;
+			
+			/* Calculate the grid vertex's barycentric coordinates and check if it is inside the triangle: */
+			float b0=((x[1]-px)*(y[2]-py)-(y[1]-py)*(x[2]-px))*invArea;
+			float b1=((x[2]-px)*(y[0]-py)-(y[2]-py)*(x[0]-px))*invArea;
+			float b2=1.0f-b0-b1;
+			if(b0>=0.0f&&b1>=0.0f&&b2>=0.0f)
+				{
+				/* Interpolate the elevation and keep it if it is inside the representable range and above the current elevation: */
+				float elevation=b0*e[0]+b1*e[1]+b2*e[2];
+				if(elevation<=elevationRange[1]&&rowPtr[gx]<elevation)
+					rowPtr[gx]=elevation;
+				}
+			}
+		}
+	}
+
+}
+
+/************************************
+Methods of class BathymetryResampler:
+************************************/
+
+void BathymetryResampler::projectBand(unsigned int bandIndex,int rowBegin,int rowEnd)
+	{
+	size_t numPixels=size_t(depthImageSize[1])*size_t(depthImageSize[0]);
+	Float4 dd0(depthDirection[0]),dd1(depthDirection[1]),dd2(depthDirection[2]),dd3(depthDirection[3]);
+	
+	for(int y=rowBegin;y<rowEnd;++y)
+		{
+		/* Get pointers to the beginning of the row in all buffers: */
+		size_t rowOffset=size_t(y)*size_t(depthImageSize[0]);
+		const float* dPtr=bandDepthImage+rowOffset;
+		const float* p0Ptr=pixelPositions+rowOffset;
+		const float* p1Ptr=p0Ptr+numPixels;
+		const float* p2Ptr=p1Ptr+numPixels;
+		const float* p3Ptr=p2Ptr+numPixels;
+		float* vxPtr=vertexX+rowOffset;
+		float* vyPtr=vertexY+rowOffset;
+		float* vePtr=vertexElevations+rowOffset;
+		unsigned int x=0;
+		
+		/* Project the row in groups of four pixels: */
+		Float4 rowMin4(Math::Constants<float>::max);
+		Float4 rowMax4(-Math::Constants<float>::max);
+		for(;x+4<=depthImageSize[0];x+=4)
+			{
+			Float4 d=Float4::load(dPtr+x);
+			Float4 invW=Float4(1.0f)/(Float4::load(p3Ptr+x)+dd3*d);
+			Float4 vy=(Float4::load(p1Ptr+x)+dd1*d)*invW;
+			((Float4::load(p0Ptr+x)+dd0*d)*invW).store(vxPtr+x);
+			vy.store(vyPtr+x);
+			((Float4::load(p2Ptr+x)+dd2*d)*invW).store(vePtr+x);
+			rowMin4=min(rowMin4,vy);
+			rowMax4=max(rowMax4,vy);
+			}
+		float rowMinMax[8];
+		rowMin4.store(rowMinMax);
+		rowMax4.store(rowMinMax+4);
+		float rowMin=Math::min(Math::min(rowMinMax[0],rowMinMax[1]),Math::min(rowMinMax[2],rowMinMax[3]));
+		float rowMax=Math::max(Math::max(rowMinMax[4],rowMinMax[5]),Math::max(rowMinMax[6],rowMinMax[7]));
+		
+		/* Project the remaining pixels in the row: */
+		for(;x<depthImageSize[0];++x)
+			{
+			float d=dPtr[x];
+			float invW=1.0f/(p3Ptr[x]+depthDirection[3]*d);
+			vxPtr[x]=(p0Ptr[x]+depthDirection[0]*d)*invW;
+			vyPtr[x]=(p1Ptr[x]+depthDirection[1]*d)*invW;
+			vePtr[x]=(p2Ptr[x]+depthDirection[2]*d)*invW;
+			rowMin=Math::min(rowMin,vyPtr[x]);
+			rowMax=Math::max(rowMax,vyPtr[x]);
+			}
+		
+		/* Store the range of grid rows covered by the row: */
+		rowRanges[y*2+0]=rowMin;
+		rowRanges[y*2+1]=rowMax;
+		}
+	}
+
+void BathymetryResampler::rasterizeBand(unsigned int bandIndex,int rowBegin,int rowEnd)
+	{
+	/* Clear the band's grid vertices to the lowest representable elevation: */
+	GLfloat* gPtr=bandGrid+size_t(rowBegin)*size_t(gridSize[0]);
+	for(size_t i=size_t(rowEnd-rowBegin)*size_t(gridSize[0]);i>0;--i,++gPtr)
+		*gPtr=elevationRange[0];
+	
+	/* Rasterize all quads of the depth image surface that overlap the band as pairs of triangles: */
+	float bandMin=float(rowBegin)+0.5f;
+	float bandMax=float(rowEnd)-0.5f;
+	for(unsigned int y=0;y+1<depthImageSize[1];++y)
+		{
+		/* Skip the row of quads if it does not overlap the band: */
+		if(Math::max(rowRanges[y*2+1],rowRanges[y*2+3])<bandMin||Math::min(rowRanges[y*2+0],rowRanges[y*2+2])>bandMax)
+			continue;
+		
+		size_t rowOffset=size_t(y)*size_t(depthImageSize[0]);
+		const float* vx0=vertexX+rowOffset;
+		const float* vy0=vertexY+rowOffset;
+		const float* ve0=vertexElevations+rowOffset;
+		const float* vx1=vx0+depthImageSize[0];
+		const float* vy1=vy0+depthImageSize[0];
+		const float* ve1=ve0+depthImageSize[0];
+		for(unsigned int x=0;x+1<depthImageSize[0];++x)
+			{
+			/* Split the quad along its diagonal from the lower-left to the upper-right vertex: */
+			float tx[3],ty[3],te[3];
+			tx[0]=vx0[x];
+			ty[0]=vy0[x];
+			te[0]=ve0[x];
+			tx[1]=vx0[x+1];
+			ty[1]=vy0[x+1];
+			te[1]=ve0[x+1];
+			tx[2]=vx1[x+1];
+			ty[2]=vy1[x+1];
+			te[2]=ve1[x+1];
+			rasterizeTriangle(tx,ty,te,bandGrid,int(gridSize[0]),rowBegin,rowEnd,elevationRange);
+			tx[1]=vx1[x+1];
+			ty[1]=vy1[x+1];
+			te[1]=ve1[x+1];
+			tx[2]=vx1[x];
+			ty[2]=vy1[x];
+			te[2]=ve1[x];
+			rasterizeTriangle(tx,ty,te,bandGrid,int(gridSize[0]),rowBegin,rowEnd,elevationRange);
+			}
+		}
+	}
+
+BathymetryResampler::BathymetryResampler(const unsigned int sDepthImageSize[2],const Kinect::FrameSource::IntrinsicParameters& ips,const WaterTable2& waterTable,unsigned int numThreads)
+	:pixelPositions(0),
+	 vertexX(0),vertexY(0),vertexElevations(0),rowRanges(0),
+	 workerPool(numThreads),
+	 bandDepthImage(0),bandGrid(0)
+	{
+	/* Remember the depth image and bathymetry grid sizes: */
+	for(int i=0;i<2;++i)
+		{
+		depthImageSize[i]=sDepthImageSize[i];
+		gridSize[i]=(unsigned int)(waterTable.getBathymetrySize(i));
+		}
+	size_t numPixels=size_t(depthImageSize[1])*size_t(depthImageSize[0]);
+	
+	/* Calculate the transformation from upright elevation map space to grid space, where grid vertex (x, y) is centered at (x+0.5, y+0.5): */
+	const WaterTable2::Box& domain=waterTable.getDomain();
+	const GLfloat* cellSize=waterTable.getCellSize();
+	PTransform gridTransform=PTransform::identity;
+	PTransform::Matrix& gtm=gridTransform.getMatrix();
+	for(int i=0;i<2;++i)
+		{
+		gtm(i,i)=Scalar(1)/Scalar(cellSize[i]);
+		gtm(i,3)=-domain.min[i]/Scalar(cellSize[i])-Scalar(0.5);
+		}
+	elevationRange[0]=float(domain.min[2]);
+	elevationRange[1]=float(domain.max[2]);
+	
+	/* Calculate the transformation from depth image space to grid space: */
+	gridTransform*=PTransform(waterTable.getBaseTransform());
+	gridTransform*=ips.depthProjection;
+	const PTransform::Matrix& dgm=gridTransform.getMatrix();
+	for(int i=0;i<4;++i)
+		depthDirection[i]=float(dgm(i,2));
+	
+	/* Calculate the grid-space positions of all undistorted depth pixels at depth zero: */
+	pixelPositions=new float[numPixels*4];
+	float* ppPtr=pixelPositions;
+	for(unsigned int y=0;y<depthImageSize[1];++y)
+		for(unsigned int x=0;x<depthImageSize[0];++x,++ppPtr)
+			{
+			Kinect::LensDistortion::Point up;
+			if(ips.depthLensDistortion.isIdentity())
+				up=Kinect::LensDistortion::Point(Scalar(x)+Scalar(0.5),Scalar(y)+Scalar(0.5));
+			else
+				up=ips.depthLensDistortion.undistortPixel(x,y);
+			for(int i=0;i<4;++i)
+				ppPtr[numPixels*i]=float(dgm(i,0)*up[0]+dgm(i,1)*up[1]+dgm(i,3));
+			}
+	
+	/* Allocate the projected vertex buffers: */
+	vertexX=new float[numPixels];
+	vertexY=new float[numPixels];
+	vertexElevations=new float[numPixels];
+	rowRanges=new float[depthImageSize[1]*2];
+	}
+
+BathymetryResampler::~BathymetryResampler(void)
+	{
+	/* Release all allocated buffers: */
+	delete[] pixelPositions;
+	delete[] vertexX;
+	delete[] vertexY;
+	delete[] vertexElevations;
+	delete[] rowRanges;
+	}
+
+void BathymetryResampler::resample(const Kinect::FrameBuffer& depthImage,GLfloat* bathymetryGrid)
+	{
+	bandDepthImage=depthImage.getData<float>();
+	bandGrid=bathymetryGrid;
+	
+	/* Project all depth image pixels into grid space in parallel bands of depth image rows: */
+	workerPool.processBands(0,int(depthImageSize[1]),this,&BathymetryResampler::projectBand);
+	
+	/* Rasterize the projected surface in parallel bands of grid rows: */
+	workerPool.processBands(0,int(gridSize[1]),this,&BathymetryResampler::rasterizeBand);
+	}
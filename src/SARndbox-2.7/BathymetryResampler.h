@@ -0,0 +1,76 @@
+/***********************************************************************
+BathymetryResampler - Class to resample filtered depth images directly
+into a water table's vertex-centered bathymetry grid on the CPU, as a
+replacement for rendering the depth image's surface into the grid on the
+GPU.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef BATHYMETRYRESAMPLER_INCLUDED
+#define BATHYMETRYRESAMPLER_INCLUDED
+
+#include <GL/gl.h>
+#include <Kinect/FrameBuffer.h>
+#include <Kinect/FrameSource.h>
+#include <Kinect/WorkerPool.h>
+
+#include "Types.h"
+
+/* Forward declarations: */
+class WaterTable2;
+
+class BathymetryResampler
+	{
+	/* Elements: */
+	private:
+	unsigned int depthImageSize[2]; // Width and height of resampled depth images
+	unsigned int gridSize[2]; // Width and height of the bathymetry grid
+	float* pixelPositions; // Homogeneous grid-space positions of all undistorted depth pixels at depth zero, stored as four planes of x, y, z, and w components
+	float depthDirection[4]; // Homogeneous grid-space direction added to a pixel's position per unit of depth
+	float elevationRange[2]; // Range of elevations representable in the bathymetry grid; the lower bound is assigned to grid vertices not covered by the surface
+	float* vertexX; // Grid-space x coordinates of the current depth image's vertices
+	float* vertexY; // Grid-space y coordinates of the current depth image's vertices
+	float* vertexElevations; // Elevations of the current depth image's vertices
+	float* rowRanges; // Ranges of grid-space y coordinates covered by each row of the current depth image's vertices
+	Kinect::WorkerPool workerPool; // Pool of threads processing bands of depth image or grid rows in parallel
+	const float* bandDepthImage; // Depth image processed by the current band job
+	GLfloat* bandGrid; // Bathymetry grid written by the current band job
+	
+	/* Private methods: */
+	void projectBand(unsigned int bandIndex,int rowBegin,int rowEnd); // Projects a band of depth image rows into grid space
+	void rasterizeBand(unsigned int bandIndex,int rowBegin,int rowEnd); // Rasterizes the projected depth image surface into a band of bathymetry grid rows
+	
+	/* Constructors and destructors: */
+	public:
+	BathymetryResampler(const unsigned int sDepthImageSize[2],const Kinect::FrameSource::IntrinsicParameters& ips,const WaterTable2& waterTable,unsigned int numThreads =0); // Creates a resampler for depth images of the given size and intrinsic parameters into the given water table's bathymetry grid, processed by the given number of threads (number of CPUs if zero)
+	private:
+	BathymetryResampler(const BathymetryResampler& source); // Prohibit copy constructor
+	BathymetryResampler& operator=(const BathymetryResampler& source); // Prohibit assignment operator
+	public:
+	~BathymetryResampler(void); // Destroys the resampler
+	
+	/* Methods: */
+	const unsigned int* getGridSize(void) const // Returns the width and height of the bathymetry grid
+		{
+		return gridSize;
+		}
+	void resample(const Kinect::FrameBuffer& depthImage,GLfloat* bathymetryGrid); // Resamples the given filtered depth image into the given vertex-centered bathymetry grid
+	};
+
+#endif
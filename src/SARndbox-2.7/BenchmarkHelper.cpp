@@ -0,0 +1,122 @@
+/***********************************************************************
+BenchmarkHelper - Helper functions shared by the benchmark utilities to
+load pre-recorded depth frames, create synthetic depth frames, and
+evaluate latency statistics.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "BenchmarkHelper.h"
+
+#include <stdlib.h>
+#include <string>
+#include <Misc/ThrowStdErr.h>
+#include <IO/OpenFile.h>
+#include <Math/Math.h>
+#include <Math/Constants.h>
+#include <Kinect/FileFrameSource.h>
+
+void loadDepthFrames(const char* frameFilePrefix,unsigned int maxNumFrames,unsigned int frameSize[2],std::vector<Kinect::FrameBuffer>& frames,BenchmarkPixelDepthCorrection** pixelDepthCorrection)
+	{
+	/* Open the selected pre-recorded 3D video files: */
+	std::string colorFileName=frameFilePrefix;
+	colorFileName.append(".color");
+	std::string depthFileName=frameFilePrefix;
+	depthFileName.append(".depth");
+	Kinect::FileFrameSource source(IO::openFile(colorFileName.c_str()),IO::openFile(depthFileName.c_str()));
+	for(int i=0;i<2;++i)
+		frameSize[i]=source.getActualFrameSize(Kinect::FrameSource::DEPTH)[i];
+	
+	if(pixelDepthCorrection!=0)
+		{
+		/* Evaluate the per-pixel depth correction parameters: */
+		*pixelDepthCorrection=0;
+		Kinect::FrameSource::DepthCorrection* depthCorrection=source.getDepthCorrectionParameters();
+		if(depthCorrection!=0)
+			{
+			*pixelDepthCorrection=depthCorrection->getPixelCorrection(frameSize);
+			delete depthCorrection;
+			}
+		}
+	
+	/* Decompress depth frames into memory so that decompression does not skew the measurements: */
+	while(frames.size()<maxNumFrames)
+		{
+		Kinect::FrameBuffer frame=source.readNextDepthFrame();
+		if(frame.timeStamp>=Math::Constants<double>::max)
+			break;
+		frames.push_back(frame);
+		}
+	if(frames.empty())
+		Misc::throwStdErr("No depth frames in file %s",depthFileName.c_str());
+	}
+
+BenchmarkPixelDepthCorrection* createDummyPixelDepthCorrection(const unsigned int frameSize[2])
+	{
+	BenchmarkPixelDepthCorrection* result=new BenchmarkPixelDepthCorrection[frameSize[1]*frameSize[0]];
+	BenchmarkPixelDepthCorrection* pdcPtr=result;
+	for(unsigned int y=0;y<frameSize[1];++y)
+		for(unsigned int x=0;x<frameSize[0];++x,++pdcPtr)
+			{
+			pdcPtr->scale=1.0f;
+			pdcPtr->offset=0.0f;
+			}
+	
+	return result;
+	}
+
+Kinect::FrameBuffer createSyntheticDepthFrame(const unsigned int frameSize[2],unsigned int baseDepth,unsigned int tiltX,unsigned int tiltY,unsigned int noise)
+	{
+	typedef Kinect::FrameSource::DepthPixel DepthPixel;
+	
+	Kinect::FrameBuffer frame(frameSize[0],frameSize[1],frameSize[1]*frameSize[0]*sizeof(DepthPixel));
+	DepthPixel* fPtr=frame.getData<DepthPixel>();
+	for(unsigned int y=0;y<frameSize[1];++y)
+		for(unsigned int x=0;x<frameSize[0];++x,++fPtr)
+			{
+			int r=rand();
+			if(r%50==0)
+				*fPtr=DepthPixel(2047U);
+			else
+				{
+				int depth=int(baseDepth+(x*tiltX)/frameSize[0]+(y*tiltY)/frameSize[1]);
+				if(noise>0)
+					depth+=(r>>8)%int(noise*2+1)-int(noise);
+				*fPtr=DepthPixel(depth);
+				}
+			}
+	
+	return frame;
+	}
+
+void drawDepthDisc(Kinect::FrameBuffer& depthFrame,int cx,int cy,int radius,Kinect::FrameSource::DepthPixel depth)
+	{
+	Kinect::FrameSource::DepthPixel* frame=depthFrame.getData<Kinect::FrameSource::DepthPixel>();
+	int width=depthFrame.getSize(0);
+	int height=depthFrame.getSize(1);
+	for(int y=Math::max(cy-radius,0);y<=Math::min(cy+radius,height-1);++y)
+		for(int x=Math::max(cx-radius,0);x<=Math::min(cx+radius,width-1);++x)
+			if(Math::sqr(x-cx)+Math::sqr(y-cy)<=Math::sqr(radius))
+				frame[y*width+x]=depth;
+	}
+
+double percentile(const std::vector<double>& sorted,double p)
+	{
+	size_t index=size_t(Math::floor(p*double(sorted.size()-1)+0.5));
+	return sorted[index];
+	}
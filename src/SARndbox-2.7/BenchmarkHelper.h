@@ -0,0 +1,39 @@
+/***********************************************************************
+BenchmarkHelper - Helper functions shared by the benchmark utilities to
+load pre-recorded depth frames, create synthetic depth frames, and
+evaluate latency statistics.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef BENCHMARKHELPER_INCLUDED
+#define BENCHMARKHELPER_INCLUDED
+
+#include <vector>
+#include <Kinect/FrameBuffer.h>
+#include <Kinect/FrameSource.h>
+
+typedef Kinect::FrameSource::DepthCorrection::PixelCorrection BenchmarkPixelDepthCorrection; // Type for per-pixel depth correction factors
+
+void loadDepthFrames(const char* frameFilePrefix,unsigned int maxNumFrames,unsigned int frameSize[2],std::vector<Kinect::FrameBuffer>& frames,BenchmarkPixelDepthCorrection** pixelDepthCorrection =0); // Decompresses up to the given number of depth frames from the pre-recorded 3D video files of the given prefix into the given list; returns the frame size and, if pixelDepthCorrection is !=0, the files' per-pixel depth correction parameters or null
+BenchmarkPixelDepthCorrection* createDummyPixelDepthCorrection(const unsigned int frameSize[2]); // Returns a new-allocated array of identity per-pixel depth correction parameters for frames of the given size
+Kinect::FrameBuffer createSyntheticDepthFrame(const unsigned int frameSize[2],unsigned int baseDepth,unsigned int tiltX,unsigned int tiltY,unsigned int noise); // Creates a synthetic depth frame showing a plane tilted by the given depth differences across the frame, with uniform noise of the given amplitude and one in 50 invalid pixels
+void drawDepthDisc(Kinect::FrameBuffer& depthFrame,int cx,int cy,int radius,Kinect::FrameSource::DepthPixel depth); // Draws a disc of constant depth into the given depth frame, clipped against the frame
+double percentile(const std::vector<double>& sorted,double p); // Returns the given percentile in [0, 1] of the given non-empty list of values sorted in ascending order
+
+#endif
@@ -0,0 +1,396 @@
+/***********************************************************************
+BlobBenchmark - Utility to compare the results and running times of the
+legacy serial blob finder and the parallel blob labeler on pre-recorded
+or synthetic depth frames.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <Realtime/Time.h>
+#include <Math/Math.h>
+#include <Kinect/FrameBuffer.h>
+
+#include "FindBlobs.h"
+#include "BenchmarkHelper.h"
+
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+typedef unsigned short RawDepth; // Type for raw depth values
+typedef Blob<RawDepth> DepthBlob; // Type for extracted blobs
+
+class DepthRangeProperty // Class selecting pixels inside a range of raw depth values
+	{
+	/* Elements: */
+	private:
+	RawDepth minDepth,maxDepth; // Closed range of selected depth values
+	
+	/* Constructors and destructors: */
+	public:
+	DepthRangeProperty(RawDepth sMinDepth,RawDepth sMaxDepth)
+		:minDepth(sMinDepth),maxDepth(sMaxDepth)
+		{
+		}
+	
+	/* Methods: */
+	bool operator()(unsigned int x,unsigned int y,const RawDepth& pixel) const
+		{
+		return pixel>=minDepth&&pixel<=maxDepth;
+		}
+	};
+
+struct LineBlob // Helper structure for the legacy blob finder
+	{
+	/* Elements: */
+	public:
+	unsigned int x1,x2;
+	unsigned int y;
+	unsigned int parent,rank;
+	unsigned int min[2],max[2];
+	double sumX,sumY,sumW;
+	
+	/* Methods: */
+	void merge(const LineBlob& other)
+		{
+		for(int i=0;i<2;++i)
+			{
+			if(min[i]>other.min[i])
+				min[i]=other.min[i];
+			if(max[i]<other.max[i])
+				max[i]=other.max[i];
+			}
+		sumX+=other.sumX;
+		sumY+=other.sumY;
+		sumW+=other.sumW;
+		}
+	};
+
+/****************
+Helper functions:
+****************/
+
+std::vector<DepthBlob> findBlobsLegacy(const unsigned int size[2],const RawDepth* frame,const DepthRangeProperty& property) // Copy of the serial line blob finder that preceded the parallel blob labeler
+	{
+	std::vector<LineBlob> lineBlobs;
+	unsigned int numLineBlobs=0;
+	unsigned int lastLineStart=0;
+	unsigned int lastLineEnd=0;
+	const RawDepth* frameRowPtr=frame;
+	for(unsigned int y=0;y<size[1];++y,frameRowPtr+=size[0])
+		{
+		unsigned int x=0;
+		const RawDepth* framePtr=frameRowPtr;
+		while(x<size[0])
+			{
+			while(x<size[0]&&!property(x,y,*framePtr))
+				{
+				++x;
+				++framePtr;
+				}
+			if(x>=size[0])
+				break;
+			
+			LineBlob lb;
+			lb.x1=x;
+			++x;
+			++framePtr;
+			while(x<size[0]&&property(x,y,*framePtr))
+				{
+				++x;
+				++framePtr;
+				}
+			lb.x2=x;
+			lb.y=y;
+			lb.parent=numLineBlobs;
+			lb.rank=0;
+			lb.min[0]=lb.x1;
+			lb.min[1]=y;
+			lb.max[0]=lb.x2;
+			lb.max[1]=y+1;
+			lb.sumW=double(lb.x2-lb.x1);
+			lb.sumX=double(lb.x1+lb.x2-1)*lb.sumW*0.5;
+			lb.sumY=double(y)*lb.sumW;
+			lineBlobs.push_back(lb);
+			++numLineBlobs;
+			++x;
+			++framePtr;
+			
+			for(unsigned int i=lastLineStart;i<lastLineEnd;++i)
+				{
+				if(lineBlobs[i].x1<=lb.x2&&lineBlobs[i].x2>=lb.x1)
+					{
+					unsigned int root1=i;
+					while(root1!=lineBlobs[root1].parent)
+						root1=lineBlobs[root1].parent;
+					unsigned int root2=numLineBlobs-1;
+					while(root2!=lineBlobs[root2].parent)
+						root2=lineBlobs[root2].parent;
+					if(root1!=root2)
+						{
+						if(lineBlobs[root1].rank>lineBlobs[root2].rank)
+							{
+							lineBlobs[root2].parent=root1;
+							lineBlobs[root1].merge(lineBlobs[root2]);
+							}
+						else
+							{
+							lineBlobs[root1].parent=root2;
+							if(lineBlobs[root1].rank==lineBlobs[root2].rank)
+								++lineBlobs[root2].rank;
+							lineBlobs[root2].merge(lineBlobs[root1]);
+							}
+						}
+					}
+				}
+			}
+		
+		lastLineStart=lastLineEnd;
+		lastLineEnd=numLineBlobs;
+		}
+	
+	std::vector<DepthBlob> result;
+	for(unsigned int i=0;i<numLineBlobs;++i)
+		if(lineBlobs[i].parent==i&&lineBlobs[i].sumW>0.0)
+			{
+			DepthBlob b;
+			b.x=(lineBlobs[i].sumX+lineBlobs[i].sumW*0.5)/lineBlobs[i].sumW;
+			b.y=(lineBlobs[i].sumY+lineBlobs[i].sumW*0.5)/lineBlobs[i].sumW;
+			for(int j=0;j<2;++j)
+				{
+				b.min[j]=lineBlobs[i].min[j];
+				b.max[j]=lineBlobs[i].max[j];
+				}
+			result.push_back(b);
+			}
+	
+	return result;
+	}
+
+bool blobLess(const DepthBlob& b1,const DepthBlob& b2) // Orders blobs by bounding box and centroid
+	{
+	for(int i=1;i>=0;--i)
+		{
+		if(b1.min[i]!=b2.min[i])
+			return b1.min[i]<b2.min[i];
+		if(b1.max[i]!=b2.max[i])
+			return b1.max[i]<b2.max[i];
+		}
+	if(b1.y!=b2.y)
+		return b1.y<b2.y;
+	return b1.x<b2.x;
+	}
+
+bool sameBlobs(std::vector<DepthBlob> blobs1,std::vector<DepthBlob> blobs2) // Returns true if the two blob lists contain the same blobs in any order
+	{
+	if(blobs1.size()!=blobs2.size())
+		return false;
+	std::sort(blobs1.begin(),blobs1.end(),blobLess);
+	std::sort(blobs2.begin(),blobs2.end(),blobLess);
+	for(size_t i=0;i<blobs1.size();++i)
+		{
+		for(int j=0;j<2;++j)
+			if(blobs1[i].min[j]!=blobs2[i].min[j]||blobs1[i].max[j]!=blobs2[i].max[j])
+				return false;
+		if(blobs1[i].x!=blobs2[i].x||blobs1[i].y!=blobs2[i].y)
+			return false;
+		}
+	return true;
+	}
+
+Kinect::FrameBuffer createSyntheticFrame(const unsigned int frameSize[2]) // Creates a synthetic depth frame showing a flat surface with noise, dropouts, and a number of raised discs
+	{
+	Kinect::FrameBuffer frame=createSyntheticDepthFrame(frameSize,900,0,0,1);
+	
+	/* Raise a number of discs of random positions and sizes: */
+	for(int disc=0;disc<20;++disc)
+		{
+		int cx=rand()%int(frameSize[0]);
+		int cy=rand()%int(frameSize[1]);
+		int radius=2+rand()%20;
+		drawDepthDisc(frame,cx,cy,radius,RawDepth(800+rand()%3));
+		}
+	
+	return frame;
+	}
+
+}
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	const char* frameFilePrefix=0;
+	unsigned int syntheticSize[2]={0,0};
+	unsigned int numThreads=0;
+	RawDepth minDepth=0;
+	RawDepth maxDepth=850;
+	unsigned int maxNumFrames=300;
+	unsigned int numBenchmarkFrames=1000;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"h")==0)
+				{
+				std::cout<<"Usage: BlobBenchmark [option 1] ... [option n] (<frame file prefix> | -synthetic <width> <height>)"<<std::endl;
+				std::cout<<"  Options:"<<std::endl;
+				std::cout<<"  -h"<<std::endl;
+				std::cout<<"     Prints this help message"<<std::endl;
+				std::cout<<"  -synthetic <width> <height>"<<std::endl;
+				std::cout<<"     Extracts blobs from synthetic depth frames of the given size"<<std::endl;
+				std::cout<<"     instead of pre-recorded frames"<<std::endl;
+				std::cout<<"  -nt <number of threads>"<<std::endl;
+				std::cout<<"     Number of parallel blob labeler threads"<<std::endl;
+				std::cout<<"     Default: number of CPUs"<<std::endl;
+				std::cout<<"  -range <min depth> <max depth>"<<std::endl;
+				std::cout<<"     Range of raw depth values considered part of blobs"<<std::endl;
+				std::cout<<"     Default: "<<minDepth<<" "<<maxDepth<<std::endl;
+				std::cout<<"  -mf <max num frames>"<<std::endl;
+				std::cout<<"     Maximum number of pre-recorded frames to load into memory"<<std::endl;
+				std::cout<<"     Default: "<<maxNumFrames<<std::endl;
+				std::cout<<"  -n <num frames>"<<std::endl;
+				std::cout<<"     Number of frames to process, cycling through loaded frames"<<std::endl;
+				std::cout<<"     Default: "<<numBenchmarkFrames<<std::endl;
+				return 0;
+				}
+			else if(strcasecmp(argv[i]+1,"synthetic")==0)
+				{
+				for(int j=0;j<2;++j)
+					{
+					++i;
+					syntheticSize[j]=(unsigned int)(atoi(argv[i]));
+					}
+				}
+			else if(strcasecmp(argv[i]+1,"nt")==0)
+				{
+				++i;
+				numThreads=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"range")==0)
+				{
+				++i;
+				minDepth=RawDepth(atoi(argv[i]));
+				++i;
+				maxDepth=RawDepth(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"mf")==0)
+				{
+				++i;
+				maxNumFrames=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"n")==0)
+				{
+				++i;
+				numBenchmarkFrames=(unsigned int)(atoi(argv[i]));
+				}
+			else
+				std::cerr<<"Ignoring unrecognized command line option "<<argv[i]<<std::endl;
+			}
+		else
+			frameFilePrefix=argv[i];
+		}
+	if(frameFilePrefix==0&&(syntheticSize[0]==0||syntheticSize[1]==0))
+		{
+		std::cerr<<"No frame file prefix or synthetic frame size provided; use -h for help"<<std::endl;
+		return 1;
+		}
+	
+	try
+		{
+		unsigned int frameSize[2];
+		std::vector<Kinect::FrameBuffer> frames;
+		if(frameFilePrefix!=0)
+			{
+			/* Load the selected pre-recorded depth frames: */
+			loadDepthFrames(frameFilePrefix,maxNumFrames,frameSize,frames);
+			}
+		else
+			{
+			/* Create synthetic depth frames: */
+			for(int i=0;i<2;++i)
+				frameSize[i]=syntheticSize[i];
+			srand(0);
+			for(unsigned int frameIndex=0;frameIndex<Math::min(maxNumFrames,61U);++frameIndex)
+				frames.push_back(createSyntheticFrame(frameSize));
+			}
+		
+		DepthRangeProperty property(minDepth,maxDepth);
+		BlobFinder<RawDepth> serialBlobFinder(1);
+		BlobFinder<RawDepth> parallelBlobFinder(numThreads);
+		
+		/* Check that all blob finders extract the same blobs from all loaded frames: */
+		size_t numBlobs=0;
+		size_t numMismatches=0;
+		std::vector<DepthBlob> serialBlobs,parallelBlobs;
+		for(std::vector<Kinect::FrameBuffer>::iterator fIt=frames.begin();fIt!=frames.end();++fIt)
+			{
+			const RawDepth* frame=fIt->getData<RawDepth>();
+			std::vector<DepthBlob> legacyBlobs=findBlobsLegacy(frameSize,frame,property);
+			serialBlobFinder.findBlobs(frameSize,frame,property,serialBlobs);
+			parallelBlobFinder.findBlobs(frameSize,frame,property,parallelBlobs);
+			numBlobs+=legacyBlobs.size();
+			if(!sameBlobs(legacyBlobs,serialBlobs)||!sameBlobs(legacyBlobs,parallelBlobs))
+				++numMismatches;
+			}
+		std::cout<<"Extracted "<<numBlobs<<" blobs from "<<frames.size()<<" frames of size "<<frameSize[0]<<" x "<<frameSize[1];
+		std::cout<<"; "<<numMismatches<<" frames with mismatching blobs"<<std::endl;
+		
+		/* Measure the running times of all blob finders: */
+		std::cout<<std::fixed<<std::setprecision(3);
+		for(int finder=0;finder<3;++finder)
+			{
+			std::vector<DepthBlob> blobs;
+			Realtime::TimePointMonotonic start;
+			for(unsigned int frameIndex=0;frameIndex<numBenchmarkFrames;++frameIndex)
+				{
+				const RawDepth* frame=frames[frameIndex%frames.size()].getData<RawDepth>();
+				if(finder==0)
+					blobs=findBlobsLegacy(frameSize,frame,property);
+				else if(finder==1)
+					serialBlobFinder.findBlobs(frameSize,frame,property,blobs);
+				else
+					parallelBlobFinder.findBlobs(frameSize,frame,property,blobs);
+				}
+			double time=double(start.setAndDiff());
+			static const char* finderNames[3]={"Legacy blob finder","Blob labeler, 1 thread","Blob labeler, "};
+			std::cout<<finderNames[finder];
+			if(finder==2)
+				std::cout<<parallelBlobFinder.getNumThreads()<<" threads";
+			std::cout<<": "<<time*1000.0/double(numBenchmarkFrames)<<" ms per frame"<<std::endl;
+			}
+		
+		if(numMismatches!=0)
+			return 1;
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"BlobBenchmark: Terminated due to exception "<<err.what()<<std::endl;
+		return 1;
+		}
+	
+	return 0;
+	}
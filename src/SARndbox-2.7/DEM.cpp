@@ -1,7 +1,7 @@
 /***********************************************************************
 DEM - Class to represent digital elevation models (DEMs) as float-valued
 texture objects.
-Copyright (c) 2013-2016 Oliver Kreylos
+Copyright (c) 2013-2020 Oliver Kreylos
 
 This file is part of the Augmented Reality Sandbox (SARndbox).
 
@@ -20,10 +20,34 @@ with the Augmented Reality Sandbox; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 ***********************************************************************/
 
+/***********************************************************************
+Tiled DEM files are little-endian binary files starting with a 32-byte
+identification string, followed by the DEM's width and height (2 x
+SInt32), its lower-left and upper-right corner coordinates (4 x
+Float32), the width and height of its square tiles (UInt32), and the
+number of levels of detail (UInt32). The header is followed by a table
+of levels, each consisting of the level's width and height (2 x SInt32)
+and the file position of its first tile (UInt64), and by the tiles of
+all levels. Level 0 is the full-resolution grid, and each following
+level averages 2x2 blocks of its predecessor, down to a level that fits
+into a single tile. The tiles of each level are stored in row-major
+order starting in the lower-left corner, each as a row-major array of
+floats, and tiles overlapping the level's right or top edge are padded
+by replicating the edge values. Tiled DEM files are created from binary
+grid files by the TileDEM utility.
+***********************************************************************/
+
 #include "DEM.h"
 
+#include <string.h>
+#include <stdexcept>
+#include <Misc/SizedTypes.h>
+#include <Misc/Endianness.h>
+#include <Misc/ThrowStdErr.h>
+#include <Misc/FileNameExtensions.h>
 #include <IO/File.h>
 #include <IO/OpenFile.h>
+#include <Math/Math.h>
 #include <GL/gl.h>
 #include <GL/GLContextData.h>
 #include <GL/Extensions/GLARBTextureFloat.h>
@@ -37,7 +61,7 @@ Methods of class DEM::DataItem:
 ******************************/
 
 DEM::DataItem::DataItem(void)
-	:textureObjectId(0)
+	:textureObjectId(0),windowVersion(0)
 	{
 	/* Check for and initialize all required OpenGL extensions: */
 	GLARBTextureFloat::initExtension();
@@ -63,7 +87,6 @@ void DEM::calcMatrix(void)
 	{
 	/* Convert the DEM transformation into a projective transformation matrix: */
 	demTransform=PTransform(transform);
-	PTransform::Matrix& dtm=demTransform.getMatrix();
 	
 	/* Pre-multiply the projective transformation matrix with the DEM space to DEM pixel space transformation: */
 	PTransform dem;
@@ -75,24 +98,278 @@ void DEM::calcMatrix(void)
 	dem.getMatrix()(2,3)=verticalScaleBase-verticalScaleBase/verticalScale;
 	demTransform.leftMultiply(dem);
 	
+	/* Request a DEM window covering the domain under the new transformation: */
+	requestWindow();
+	
+	/* Update the transformation to the current window's pixel space: */
+	calcWindowMatrix();
+	}
+
+void DEM::calcWindowMatrix(void)
+	{
+	/* Pre-multiply the DEM pixel space transformation with the DEM pixel space to window pixel space transformation: */
+	const Window& window=windows.getLockedValue();
+	PTransform windowTransform=demTransform;
+	PTransform wt;
+	Scalar levelScale=Scalar(1)/Scalar(1<<window.level);
+	wt.getMatrix()(0,0)=levelScale;
+	wt.getMatrix()(0,3)=-Scalar(window.origin[0]);
+	wt.getMatrix()(1,1)=levelScale;
+	wt.getMatrix()(1,3)=-Scalar(window.origin[1]);
+	windowTransform.leftMultiply(wt);
+	
 	/* Convert the full transformation to column-major OpenGL format: */
+	const PTransform::Matrix& wtm=windowTransform.getMatrix();
 	GLfloat* dtmPtr=demTransformMatrix;
 	for(int j=0;j<4;++j)
 		for(int i=0;i<4;++i,++dtmPtr)
-			*dtmPtr=GLfloat(dtm(i,j));
+			*dtmPtr=GLfloat(wtm(i,j));
+	}
+
+void DEM::requestWindow(void)
+	{
+	/* Bail out if the DEM is not tiled or the domain is undefined: */
+	if(tiledFile==0||domain.isNull())
+		return;
+	
+	/* Calculate the domain's bounding rectangle in full-resolution DEM pixel space: */
+	Scalar min[2],max[2];
+	for(int i=0;i<8;++i)
+		{
+		Point p=demTransform.transform(domain.getVertex(i));
+		for(int j=0;j<2;++j)
+			{
+			if(i==0||min[j]>p[j])
+				min[j]=p[j];
+			if(i==0||max[j]<p[j])
+				max[j]=p[j];
+			}
+		}
+	
+	/* Find the finest level of detail at which the rectangle plus a one-pixel border fits into a window: */
+	int level;
+	for(level=0;level<int(levels.size())-1;++level)
+		{
+		Scalar levelScale=Scalar(1)/Scalar(1<<level);
+		if(Math::ceil(max[0]*levelScale)-Math::floor(min[0]*levelScale)+Scalar(2)<=Scalar(maxWindowSize)&&
+		   Math::ceil(max[1]*levelScale)-Math::floor(min[1]*levelScale)+Scalar(2)<=Scalar(maxWindowSize))
+			break;
+		}
+	
+	/* Calculate the window's region in the level's grid, clamped to the level's grid: */
+	const Level& l=levels[level];
+	Scalar levelScale=Scalar(1)/Scalar(1<<level);
+	int origin[2],size[2];
+	for(int i=0;i<2;++i)
+		{
+		Scalar lMin=Math::clamp(Math::floor(min[i]*levelScale)-Scalar(1),Scalar(0),Scalar(l.size[i]-1));
+		Scalar lMax=Math::clamp(Math::ceil(max[i]*levelScale)+Scalar(1),lMin+Scalar(1),Scalar(l.size[i]));
+		origin[i]=int(lMin);
+		size[i]=Math::min(int(lMax)-origin[i],maxWindowSize);
+		}
+	
+	/* Post the request to the streaming thread unless it is the same as the most recent request: */
+	Threads::MutexCond::Lock requestLock(requestCond);
+	if(requestLevel!=level||requestOrigin[0]!=origin[0]||requestOrigin[1]!=origin[1]||requestSize[0]!=size[0]||requestSize[1]!=size[1])
+		{
+		requestLevel=level;
+		for(int i=0;i<2;++i)
+			{
+			requestOrigin[i]=origin[i];
+			requestSize[i]=size[i];
+			}
+		haveRequest=true;
+		requestCond.signal();
+		}
+	}
+
+void DEM::readWindow(DEM::Window& window) const
+	{
+	const Level& level=levels[window.level];
+	window.elevations.resize(size_t(window.size[1])*size_t(window.size[0]));
+	
+	/* Copy the window row by row, touching only the tiles that overlap the window: */
+	size_t tileRowStride=size_t(tileSize)*size_t(tileSize);
+	float* rowPtr=&window.elevations[0];
+	for(int y=0;y<window.size[1];++y,rowPtr+=window.size[0])
+		{
+		int ly=window.origin[1]+y;
+		const float* tileRow=level.tiles+(size_t(ly/tileSize)*size_t(level.numTiles[0])*size_t(tileSize)+size_t(ly%tileSize))*size_t(tileSize);
+		for(int x=0;x<window.size[0];)
+			{
+			int lx=window.origin[0]+x;
+			int tileX=lx%tileSize;
+			int copySize=Math::min(tileSize-tileX,window.size[0]-x);
+			memcpy(rowPtr+x,tileRow+size_t(lx/tileSize)*tileRowStride+tileX,size_t(copySize)*sizeof(float));
+			#if __BYTE_ORDER==__BIG_ENDIAN
+			Misc::swapEndianness(rowPtr+x,copySize);
+			#endif
+			x+=copySize;
+			}
+		}
+	}
+
+void* DEM::streamingThreadMethod(void)
+	{
+	while(true)
+		{
+		/* Wait for the next window request: */
+		Window request;
+		{
+		Threads::MutexCond::Lock requestLock(requestCond);
+		while(runStreamer&&!haveRequest)
+			requestCond.wait(requestLock);
+		if(!runStreamer)
+			break;
+		request.level=requestLevel;
+		for(int i=0;i<2;++i)
+			{
+			request.origin[i]=requestOrigin[i];
+			request.size[i]=requestSize[i];
+			}
+		haveRequest=false;
+		}
+		
+		/* Assemble the requested window from the memory-mapped tiles, paging them in as needed: */
+		Window& window=windows.startNewValue();
+		window.level=request.level;
+		for(int i=0;i<2;++i)
+			{
+			window.origin[i]=request.origin[i];
+			window.size[i]=request.size[i];
+			}
+		readWindow(window);
+		windows.postNewValue();
+		}
+	
+	return 0;
+	}
+
+void DEM::stopStreaming(void)
+	{
+	if(tiledFile!=0)
+		{
+		/* Shut down the streaming thread: */
+		{
+		Threads::MutexCond::Lock requestLock(requestCond);
+		runStreamer=false;
+		requestCond.signal();
+		}
+		streamingThread.join();
+		
+		/* Release the tiled DEM file: */
+		levels.clear();
+		tiledFile=0;
+		}
+	}
+
+void DEM::loadGrid(const char* demFileName)
+	{
+	/* Read the DEM file: */
+	IO::FilePtr demFile=IO::openFile(demFileName);
+	demFile->setEndianness(Misc::LittleEndian);
+	demFile->read<int>(demSize,2);
+	for(int i=0;i<4;++i)
+		demBox[i]=double(demFile->read<float>());
+	
+	/* Read the entire DEM into a single window: */
+	Window& window=windows.startNewValue();
+	window.level=0;
+	for(int i=0;i<2;++i)
+		{
+		window.origin[i]=0;
+		window.size[i]=demSize[i];
+		}
+	window.elevations.resize(size_t(demSize[1])*size_t(demSize[0]));
+	demFile->read<float>(&window.elevations[0],window.elevations.size());
+	windows.postNewValue();
+	}
+
+void DEM::loadTiled(const char* demFileName)
+	{
+	/* Open and memory-map the tiled DEM file; members are only replaced once the file has been validated: */
+	Misc::Autopointer<IO::MemMappedFile> newTiledFile=new IO::MemMappedFile(demFileName);
+	newTiledFile->setEndianness(Misc::LittleEndian);
+	
+	/* Read and check the file header: */
+	static const char fileId[32]="SARndbox tiled DEM v1.0\n";
+	char id[sizeof(fileId)];
+	newTiledFile->read<char>(id,sizeof(id));
+	if(memcmp(id,fileId,sizeof(fileId))!=0)
+		Misc::throwStdErr("DEM::load: File %s is not a tiled DEM",demFileName);
+	int newDemSize[2];
+	for(int i=0;i<2;++i)
+		newDemSize[i]=newTiledFile->read<Misc::SInt32>();
+	double newDemBox[4];
+	for(int i=0;i<4;++i)
+		newDemBox[i]=double(newTiledFile->read<Misc::Float32>());
+	int newTileSize=int(newTiledFile->read<Misc::UInt32>());
+	unsigned int numLevels=newTiledFile->read<Misc::UInt32>();
+	if(newDemSize[0]<2||newDemSize[1]<2||newTileSize<1||numLevels<1||numLevels>31)
+		Misc::throwStdErr("DEM::load: Invalid header in tiled DEM %s",demFileName);
+	
+	/* Read the table of levels and locate each level's tiles in the file's memory map: */
+	const char* memBase=static_cast<const char*>(newTiledFile->getMemory());
+	Misc::UInt64 fileSize=Misc::UInt64(newTiledFile->getSize());
+	std::vector<Level> newLevels(numLevels);
+	for(unsigned int l=0;l<numLevels;++l)
+		{
+		Level& level=newLevels[l];
+		Misc::UInt64 offset;
+		for(int i=0;i<2;++i)
+			level.size[i]=newTiledFile->read<Misc::SInt32>();
+		offset=newTiledFile->read<Misc::UInt64>();
+		for(int i=0;i<2;++i)
+			level.numTiles[i]=(level.size[i]+newTileSize-1)/newTileSize;
+		Misc::UInt64 levelSize=Misc::UInt64(level.numTiles[1])*Misc::UInt64(level.numTiles[0])*Misc::UInt64(newTileSize)*Misc::UInt64(newTileSize)*sizeof(float);
+		if(level.size[0]!=((newDemSize[0]+(1<<l)-1)>>l)||level.size[1]!=((newDemSize[1]+(1<<l)-1)>>l)||offset%sizeof(float)!=0||offset+levelSize>fileSize)
+			Misc::throwStdErr("DEM::load: Invalid level %u in tiled DEM %s",l,demFileName);
+		level.tiles=reinterpret_cast<const float*>(memBase+offset);
+		}
+	if(newLevels.back().numTiles[0]!=1||newLevels.back().numTiles[1]!=1)
+		Misc::throwStdErr("DEM::load: Missing coarse levels in tiled DEM %s",demFileName);
+	
+	/* Install the validated tiled DEM: */
+	for(int i=0;i<2;++i)
+		demSize[i]=newDemSize[i];
+	for(int i=0;i<4;++i)
+		demBox[i]=newDemBox[i];
+	tileSize=newTileSize;
+	levels.swap(newLevels);
+	
+	/* Read the entire coarsest level into the initial window so that the DEM can be displayed immediately: */
+	Window& window=windows.startNewValue();
+	window.level=numLevels-1;
+	for(int i=0;i<2;++i)
+		{
+		window.origin[i]=0;
+		window.size[i]=levels.back().size[i];
+		}
+	readWindow(window);
+	windows.postNewValue();
+	
+	/* Start the streaming thread to refine the initial window, and only then mark the tiled DEM as active: */
+	runStreamer=true;
+	haveRequest=false;
+	requestLevel=-1;
+	streamingThread.start(this,&DEM::streamingThreadMethod);
+	tiledFile=newTiledFile;
 	}
 
 DEM::DEM(void)
-	:dem(0),
+	:averageElevation(0.0f),
+	 tileSize(0),maxWindowSize(2048),domain(Box::empty),
 	 transform(OGTransform::identity),
-	 verticalScale(1),verticalScaleBase(0)
+	 verticalScale(1),verticalScaleBase(0),
+	 windowVersion(0),
+	 runStreamer(false),haveRequest(false),requestLevel(-1)
 	{
 	demSize[0]=demSize[1]=0;
 	}
 
 DEM::~DEM(void)
 	{
-	delete[] dem;
+	stopStreaming();
 	}
 
 void DEM::initContext(GLContextData& contextData) const
@@ -101,26 +378,36 @@ void DEM::initContext(GLContextData& contextData) const
 	DataItem* dataItem=new DataItem;
 	contextData.addDataItem(this,dataItem);
 	
-	/* Upload the DEM array into the texture object: */
+	/* Initialize the texture object; DEM windows are uploaded on demand: */
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->textureObjectId);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
-	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_LUMINANCE32F_ARB,demSize[0],demSize[1],0,GL_LUMINANCE,GL_FLOAT,dem);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	}
 
 void DEM::load(const char* demFileName)
 	{
-	/* Read the DEM file: */
-	IO::FilePtr demFile=IO::openFile(demFileName);
-	demFile->setEndianness(Misc::LittleEndian);
-	demFile->read<int>(demSize,2);
-	dem=new float[demSize[1]*demSize[0]];
-	for(int i=0;i<4;++i)
-		demBox[i]=double(demFile->read<float>());
-	demFile->read<float>(dem,demSize[1]*demSize[0]);
+	/* Release a previously loaded tiled DEM: */
+	stopStreaming();
+	
+	/* Load the DEM file based on its extension: */
+	if(Misc::hasCaseExtension(demFileName,".tdem"))
+		loadTiled(demFileName);
+	else
+		loadGrid(demFileName);
+	
+	/* Lock the initial window: */
+	windows.lockNewValue();
+	++windowVersion;
+	
+	/* Calculate the average elevation of the initial window, which is the entire DEM at full or lowest resolution: */
+	const std::vector<float>& elevations=windows.getLockedValue().elevations;
+	double elevSum=0.0;
+	for(std::vector<float>::const_iterator eIt=elevations.begin();eIt!=elevations.end();++eIt)
+		elevSum+=double(*eIt);
+	averageElevation=float(elevSum/double(elevations.size()));
 	
 	/* Update the DEM transformation: */
 	calcMatrix();
@@ -128,14 +415,23 @@ void DEM::load(const char* demFileName)
 
 float DEM::calcAverageElevation(void) const
 	{
-	/* Sum all elevation measurements: */
-	double elevSum=0.0;
-	const float* demPtr=dem;
-	for(int i=demSize[1]*demSize[0];i>0;--i,++demPtr)
-		elevSum+=double(*demPtr);
+	return averageElevation;
+	}
+
+void DEM::setMaxWindowSize(int newMaxWindowSize)
+	{
+	maxWindowSize=Math::max(newMaxWindowSize,2);
 	
-	/* Return the average elevation: */
-	return float(elevSum/double(demSize[1]*demSize[0]));
+	/* Request a DEM window of the new maximum size: */
+	requestWindow();
+	}
+
+void DEM::setDomain(const DEM::Box& newDomain)
+	{
+	domain=newDomain;
+	
+	/* Request a DEM window covering the new domain: */
+	requestWindow();
 	}
 
 void DEM::setTransform(const OGTransform& newTransform,Scalar newVerticalScale,Scalar newVerticalScaleBase)
@@ -148,6 +444,17 @@ void DEM::setTransform(const OGTransform& newTransform,Scalar newVerticalScale,S
 	calcMatrix();
 	}
 
+void DEM::updateWindow(void)
+	{
+	/* Check if the streaming thread assembled a new DEM window: */
+	if(windows.lockNewValue())
+		{
+		/* Invalidate the texture object and update the DEM window transformation: */
+		++windowVersion;
+		calcWindowMatrix();
+		}
+	}
+
 void DEM::bindTexture(GLContextData& contextData) const
 	{
 	/* Get the context data item: */
@@ -155,6 +462,14 @@ void DEM::bindTexture(GLContextData& contextData) const
 	
 	/* Bind the DEM texture: */
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->textureObjectId);
+	
+	/* Upload the current DEM window if the texture object is outdated: */
+	if(dataItem->windowVersion!=windowVersion)
+		{
+		const Window& window=windows.getLockedValue();
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_LUMINANCE32F_ARB,window.size[0],window.size[1],0,GL_LUMINANCE,GL_FLOAT,&window.elevations[0]);
+		dataItem->windowVersion=windowVersion;
+		}
 	}
 
 void DEM::uploadDemTransform(GLint location) const
@@ -1,7 +1,7 @@
 /***********************************************************************
 DEM - Class to represent digital elevation models (DEMs) as float-valued
 texture objects.
-Copyright (c) 2013-2016 Oliver Kreylos
+Copyright (c) 2013-2020 Oliver Kreylos
 
 This file is part of the Augmented Reality Sandbox (SARndbox).
 
@@ -23,6 +23,13 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef DEM_INCLUDED
 #define DEM_INCLUDED
 
+#include <vector>
+#include <Misc/Autopointer.h>
+#include <Threads/MutexCond.h>
+#include <Threads/Thread.h>
+#include <Threads/TripleBuffer.h>
+#include <IO/MemMappedFile.h>
+#include <Geometry/Box.h>
 #include <GL/gl.h>
 #include <GL/GLObject.h>
 
@@ -31,12 +38,35 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 class DEM:public GLObject
 	{
 	/* Embedded classes: */
+	public:
+	typedef Geometry::Box<Scalar,3> Box; // Type for bounding boxes
+	
 	private:
+	struct Level // Structure describing a level of detail of a tiled DEM
+		{
+		/* Elements: */
+		public:
+		int size[2]; // Width and height of the level's grid
+		int numTiles[2]; // Number of tiles in x and y
+		const float* tiles; // Pointer to the level's first tile in the memory-mapped DEM file
+		};
+	
+	struct Window // Structure holding a rectangular region of one level of detail of a DEM
+		{
+		/* Elements: */
+		public:
+		int level; // Level of detail covered by the window
+		int origin[2]; // Position of the window's lower-left corner in the level's grid
+		int size[2]; // Width and height of the window
+		std::vector<float> elevations; // Elevations inside the window in row-major order
+		};
+	
 	struct DataItem:public GLObject::DataItem
 		{
 		/* Elements: */
 		public:
 		GLuint textureObjectId; // ID of texture object holding digital elevation model
+		unsigned int windowVersion; // Version number of the window currently uploaded into the texture object
 		
 		/* Constructors and destructors: */
 		DataItem(void);
@@ -44,18 +74,38 @@ class DEM:public GLObject
 		};
 	
 	/* Elements: */
-	private:
 	int demSize[2]; // Width and height of the DEM grid
 	Scalar demBox[4]; // Lower-left and upper-right corner coordinates of the DEM
-	float* dem; // Array of DEM elevation measurements
+	float averageElevation; // Average elevation of the DEM
+	Misc::Autopointer<IO::MemMappedFile> tiledFile; // Memory-mapped tiled DEM file, or null if the DEM was loaded from a grid file
+	int tileSize; // Width and height of the tiles of a tiled DEM
+	std::vector<Level> levels; // Levels of detail of a tiled DEM, from full resolution to a single tile
+	int maxWindowSize; // Maximum width and height of DEM windows uploaded into the texture object
+	Box domain; // Camera-space region that must be covered by DEM windows
 	OGTransform transform; // Transformation from camera space to DEM space (z up)
 	Scalar verticalScale; // Vertical scale (exaggeration) factor
 	Scalar verticalScaleBase; // Base elevation around which vertical scale is applied
 	PTransform demTransform; // Full transformation matrix from camera space to DEM pixel space
-	GLfloat demTransformMatrix[16]; // Full transformation matrix from camera space to DEM pixel space to upload to OpenGL
+	GLfloat demTransformMatrix[16]; // Full transformation matrix from camera space to pixel space of the current DEM window to upload to OpenGL
+	Threads::TripleBuffer<Window> windows; // Triple buffer of DEM windows assembled by the streaming thread
+	unsigned int windowVersion; // Version number of the most recently locked DEM window
+	Threads::MutexCond requestCond; // Condition variable to signal a new window request to the streaming thread
+	bool runStreamer; // Flag to keep the streaming thread running
+	bool haveRequest; // Flag whether there is a window request that has not been picked up by the streaming thread
+	int requestLevel; // Level of detail of the most recently requested window
+	int requestOrigin[2]; // Lower-left corner of the most recently requested window in its level's grid
+	int requestSize[2]; // Size of the most recently requested window
+	Threads::Thread streamingThread; // Thread assembling DEM windows from tiles of a memory-mapped tiled DEM in the background
 	
 	/* Private methods: */
 	void calcMatrix(void); // Calculates the camera space to DEM pixel space transformation
+	void calcWindowMatrix(void); // Calculates the camera space to DEM window pixel space transformation for the current window
+	void requestWindow(void); // Requests a DEM window covering the current domain from the streaming thread
+	void readWindow(Window& window) const; // Copies the window's region of its level of detail from the memory-mapped tiled DEM file
+	void* streamingThreadMethod(void); // Method assembling requested DEM windows in the background
+	void stopStreaming(void); // Shuts down the streaming thread and releases the memory-mapped tiled DEM file
+	void loadGrid(const char* demFileName); // Loads a DEM from a binary grid file
+	void loadTiled(const char* demFileName); // Loads a DEM from a tiled DEM file
 	
 	/* Constructors and destructors: */
 	public:
@@ -66,12 +116,14 @@ class DEM:public GLObject
 	virtual void initContext(GLContextData& contextData) const;
 	
 	/* New methods: */
-	void load(const char* demFileName); // Loads the DEM from the given file
+	void load(const char* demFileName); // Loads the DEM from the given binary grid or tiled DEM file
 	const Scalar* getDemBox(void) const // Returns the DEM's bounding box as lower-left x, lower-left y, upper-right x, upper-right y
 		{
 		return demBox;
 		}
 	float calcAverageElevation(void) const; // Calculates the average elevation of the DEM
+	void setMaxWindowSize(int newMaxWindowSize); // Sets the maximum width and height of DEM windows uploaded into the texture object
+	void setDomain(const Box& newDomain); // Sets the camera-space region that must be covered by the texture object
 	void setTransform(const OGTransform& newTransform,Scalar newVerticalScale,Scalar newVerticalScaleBase); // Sets the DEM transformation
 	const PTransform& getDemTransform(void) const // Returns the full transformation from camera space to vertically-scaled DEM pixel space
 		{
@@ -81,6 +133,7 @@ class DEM:public GLObject
 		{
 		return transform.getScaling()/verticalScale;
 		}
+	void updateWindow(void); // Picks up the most recent DEM window assembled by the streaming thread; must be called once per frame before display
 	void bindTexture(GLContextData& contextData) const; // Binds the DEM texture object to the currently active texture unit
 	void uploadDemTransform(GLint location) const; // Uploads the DEM transformation into the GLSL 4x4 matrix at the given uniform location
 	};
@@ -2,7 +2,7 @@
 DEMTool - Tool class to load a digital elevation model into an augmented
 reality sandbox to colorize the sand surface based on distance to the
 DEM.
-Copyright (c) 2013-2018 Oliver Kreylos
+Copyright (c) 2013-2020 Oliver Kreylos
 
 This file is part of the Augmented Reality Sandbox (SARndbox).
 
@@ -36,7 +36,7 @@ Methods of class DEMToolFactory:
 
 DEMToolFactory::DEMToolFactory(Vrui::ToolManager& toolManager)
 	:ToolFactory("DEMTool",toolManager),
-	 demSelectionHelper(Vrui::getWidgetManager(),"",".grid",IO::openDirectory("."))
+	 demSelectionHelper(Vrui::getWidgetManager(),"",".grid;.tdem",IO::openDirectory("."))
 	{
 	/* Initialize tool layout: */
 	layout.setNumButtons(1);
@@ -175,10 +175,17 @@ void DEMTool::configure(const Misc::ConfigurationFileSection& configFileSection)
 	
 	demVerticalShift=configFileSection.retrieveValue<Scalar>("./demVerticalShift",demVerticalShift);
 	demVerticalScale=configFileSection.retrieveValue<Scalar>("./demVerticalScale",demVerticalScale);
+	
+	/* Read the maximum size of DEM windows paged in from tiled DEMs: */
+	if(configFileSection.hasTag("./demMaxWindowSize"))
+		setMaxWindowSize(configFileSection.retrieveValue<int>("./demMaxWindowSize"));
 	}
 
 void DEMTool::initialize(void)
 	{
+	/* Page in tiled DEMs only where they cover the sandbox's domain: */
+	setDomain(application->bbox);
+	
 	/* Bring up a file selection dialog if there is no pre-configured DEM file: */
 	if(demFileName.empty())
 		{
@@ -197,6 +204,12 @@ const Vrui::ToolFactory* DEMTool::getFactory(void) const
 	return factory;
 	}
 
+void DEMTool::frame(void)
+	{
+	/* Pick up DEM windows paged in from a tiled DEM in the background: */
+	updateWindow();
+	}
+
 void DEMTool::buttonCallback(int buttonSlotIndex,Vrui::InputDevice::ButtonCallbackData* cbData)
 	{
 	if(cbData->newButtonState)
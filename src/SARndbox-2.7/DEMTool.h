@@ -2,7 +2,7 @@
 DEMTool - Tool class to load a digital elevation model into an augmented
 reality sandbox to colorize the sand surface based on distance to the
 DEM.
-Copyright (c) 2013-2016 Oliver Kreylos
+Copyright (c) 2013-2020 Oliver Kreylos
 
 This file is part of the Augmented Reality Sandbox (SARndbox).
 
@@ -85,6 +85,7 @@ class DEMTool:public DEM,public Vrui::Tool,public Vrui::Application::Tool<Sandbo
 	virtual void configure(const Misc::ConfigurationFileSection& configFileSection);
 	virtual void initialize(void);
 	virtual const Vrui::ToolFactory* getFactory(void) const;
+	virtual void frame(void);
 	virtual void buttonCallback(int buttonSlotIndex,Vrui::InputDevice::ButtonCallbackData* cbData);
 	};
 
@@ -2,7 +2,7 @@
 DepthImageRenderer - Class to centralize storage of raw or filtered
 depth images on the GPU, and perform simple repetitive rendering tasks
 such as rendering elevation values into a frame buffer.
-Copyright (c) 2014-2018 Oliver Kreylos
+Copyright (c) 2014-2020 Oliver Kreylos
 
 This file is part of the Augmented Reality Sandbox (SARndbox).
 
@@ -23,11 +23,15 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "DepthImageRenderer.h"
 
+#include <string.h>
+#include <Math/Math.h>
+#include <Math/Constants.h>
 #include <GL/gl.h>
 #include <GL/GLVertexArrayParts.h>
 #include <GL/GLContextData.h>
 #include <GL/Extensions/GLARBFragmentShader.h>
 #include <GL/Extensions/GLARBMultitexture.h>
+#include <GL/Extensions/GLARBPixelBufferObject.h>
 #include <GL/Extensions/GLARBShaderObjects.h>
 #include <GL/Extensions/GLARBTextureFloat.h>
 #include <GL/Extensions/GLARBTextureRectangle.h>
@@ -36,15 +40,34 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <GL/Extensions/GLARBVertexShader.h>
 #include <GL/GLTransformationWrappers.h>
 
+#include "FilteredFrame.h"
+#include "LatencyTracker.h"
 #include "ShaderHelper.h"
 
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+struct TileRun // Structure describing a horizontal run of changed depth image tiles
+	{
+	/* Elements: */
+	public:
+	unsigned int x,y; // Pixel position of the run's lower-left corner
+	unsigned int width,height; // Size of the run in pixels
+	GLfloat* pixels; // Offset of the run's packed pixels in the pixel buffer, or pointer to the run's first pixel in the depth image
+	};
+
+}
+
 /*********************************************
 Methods of class DepthImageRenderer::DataItem:
 *********************************************/
 
 DepthImageRenderer::DataItem::DataItem(void)
 	:vertexBuffer(0),indexBuffer(0),
-	 depthTexture(0),depthTextureVersion(0),
+	 depthTexture(0),depthTextureVersion(0),depthPixelBuffer(0),
 	 depthShader(0),elevationShader(0)
 	{
 	/* Initialize all required extensions: */
@@ -61,6 +84,13 @@ DepthImageRenderer::DataItem::DataItem(void)
 	glGenBuffersARB(1,&vertexBuffer);
 	glGenBuffersARB(1,&indexBuffer);
 	glGenTextures(1,&depthTexture);
+	
+	/* Stream depth images through a pixel buffer if supported: */
+	if(GLARBPixelBufferObject::isSupported())
+		{
+		GLARBPixelBufferObject::initExtension();
+		glGenBuffersARB(1,&depthPixelBuffer);
+		}
 	}
 
 DepthImageRenderer::DataItem::~DataItem(void)
@@ -69,6 +99,8 @@ DepthImageRenderer::DataItem::~DataItem(void)
 	glDeleteBuffersARB(1,&vertexBuffer);
 	glDeleteBuffersARB(1,&indexBuffer);
 	glDeleteTextures(1,&depthTexture);
+	if(depthPixelBuffer!=0)
+		glDeleteBuffersARB(1,&depthPixelBuffer);
 	glDeleteObjectARB(depthShader);
 	glDeleteObjectARB(elevationShader);
 	}
@@ -77,8 +109,92 @@ DepthImageRenderer::DataItem::~DataItem(void)
 Methods of class DepthImageRenderer:
 ***********************************/
 
+void DepthImageRenderer::invalidateTiles(void)
+	{
+	/* Mark all tiles as changed in the current depth image version: */
+	for(std::vector<unsigned int>::iterator tvIt=tileVersions.begin();tvIt!=tileVersions.end();++tvIt)
+		*tvIt=depthImageVersion;
+	}
+
+void DepthImageRenderer::updateDepthTexture(DepthImageRenderer::DataItem* dataItem) const
+	{
+	/* Bail out if the texture is current: */
+	if(dataItem->depthTextureVersion==depthImageVersion)
+		return;
+	
+	/* Collect horizontal runs of tiles that changed since the texture was last updated: */
+	std::vector<TileRun> runs;
+	for(unsigned int tileY=0;tileY<numTiles[1];++tileY)
+		{
+		const unsigned int* tvRow=&tileVersions[tileY*numTiles[0]];
+		for(unsigned int tileX=0;tileX<numTiles[0];++tileX)
+			if(tvRow[tileX]>dataItem->depthTextureVersion)
+				{
+				/* Extend the run to the right as far as possible: */
+				unsigned int runEnd=tileX+1;
+				while(runEnd<numTiles[0]&&tvRow[runEnd]>dataItem->depthTextureVersion)
+					++runEnd;
+				
+				TileRun run;
+				run.x=tileX*FilteredFrame::tileSize;
+				run.y=tileY*FilteredFrame::tileSize;
+				run.width=(runEnd*FilteredFrame::tileSize<depthImageSize[0]?runEnd*FilteredFrame::tileSize:depthImageSize[0])-run.x;
+				run.height=((tileY+1)*FilteredFrame::tileSize<depthImageSize[1]?(tileY+1)*FilteredFrame::tileSize:depthImageSize[1])-run.y;
+				run.pixels=0;
+				runs.push_back(run);
+				
+				tileX=runEnd;
+				}
+		}
+	
+	const GLfloat* diPixels=depthImage.getData<GLfloat>();
+	bool packed=false;
+	if(dataItem->depthPixelBuffer!=0)
+		{
+		/* Orphan the pixel buffer's previous storage and pack all runs into it: */
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB,dataItem->depthPixelBuffer);
+		glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB,size_t(depthImageSize[1])*size_t(depthImageSize[0])*sizeof(GLfloat),0,GL_STREAM_DRAW_ARB);
+		GLfloat* pbPtr=static_cast<GLfloat*>(glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB,GL_WRITE_ONLY_ARB));
+		if(pbPtr!=0)
+			{
+			GLfloat* pbOffset=0;
+			for(std::vector<TileRun>::iterator rIt=runs.begin();rIt!=runs.end();++rIt)
+				{
+				rIt->pixels=pbOffset;
+				for(unsigned int y=0;y<rIt->height;++y,pbPtr+=rIt->width)
+					memcpy(pbPtr,diPixels+(size_t(rIt->y+y)*size_t(depthImageSize[0])+rIt->x),rIt->width*sizeof(GLfloat));
+				pbOffset+=rIt->height*rIt->width;
+				}
+			packed=glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+			}
+		if(!packed)
+			glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB,0);
+		}
+	
+	if(packed)
+		{
+		/* Upload the packed runs from the pixel buffer: */
+		for(std::vector<TileRun>::const_iterator rIt=runs.begin();rIt!=runs.end();++rIt)
+			glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,rIt->x,rIt->y,rIt->width,rIt->height,GL_LUMINANCE,GL_FLOAT,rIt->pixels);
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB,0);
+		}
+	else
+		{
+		/* Upload the runs directly from the depth image: */
+		glPixelStorei(GL_UNPACK_ROW_LENGTH,depthImageSize[0]);
+		for(std::vector<TileRun>::const_iterator rIt=runs.begin();rIt!=runs.end();++rIt)
+			glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,rIt->x,rIt->y,rIt->width,rIt->height,GL_LUMINANCE,GL_FLOAT,diPixels+(size_t(rIt->y)*size_t(depthImageSize[0])+rIt->x));
+		glPixelStorei(GL_UNPACK_ROW_LENGTH,0);
+		}
+	
+	/* Mark the depth texture as current and record the time at which the depth image was first uploaded in the image's shared trace: */
+	dataItem->depthTextureVersion=depthImageVersion;
+	Kinect::FrameBuffer tracedImage=depthImage;
+	tracedImage.stampTrace(LatencyTracker::UPLOAD);
+	}
+
 DepthImageRenderer::DepthImageRenderer(const unsigned int sDepthImageSize[2])
-	:depthImageVersion(0)
+	:depthImageVersion(0),depthImageFrameStamp(0)
 	{
 	/* Copy the depth image size: */
 	for(int i=0;i<2;++i)
@@ -91,6 +207,12 @@ DepthImageRenderer::DepthImageRenderer(const unsigned int sDepthImageSize[2])
 		for(unsigned int x=0;x<depthImageSize[0];++x,++diPtr)
 			*diPtr=0.0f;
 	++depthImageVersion;
+	
+	/* Initialize the tile versions: */
+	for(int i=0;i<2;++i)
+		numTiles[i]=FilteredFrame::getNumTiles(depthImageSize[i]);
+	tileVersions.resize(numTiles[1]*numTiles[0]);
+	invalidateTiles();
 	}
 
 void DepthImageRenderer::initContext(GLContextData& contextData) const
@@ -153,6 +275,14 @@ void DepthImageRenderer::initContext(GLContextData& contextData) const
 	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_LUMINANCE32F_ARB,depthImageSize[0],depthImageSize[1],0,GL_LUMINANCE,GL_FLOAT,0);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	
+	if(dataItem->depthPixelBuffer!=0)
+		{
+		/* Allocate the depth image pixel buffer: */
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB,dataItem->depthPixelBuffer);
+		glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB,size_t(depthImageSize[1])*size_t(depthImageSize[0])*sizeof(GLfloat),0,GL_STREAM_DRAW_ARB);
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB,0);
+		}
+	
 	/* Create the depth rendering shader: */
 	dataItem->depthShader=linkVertexAndFragmentShader("SurfaceDepthShader");
 	dataItem->depthShaderUniforms[0]=glGetUniformLocationARB(dataItem->depthShader,"depthSampler");
@@ -218,13 +348,100 @@ void DepthImageRenderer::setBasePlane(const Plane& newBasePlane)
 	Scalar bpo=basePlane.getOffset();
 	for(int i=0;i<4;++i)
 		basePlaneDicEq[i]=GLfloat(dpm(0,i)*bpn[0]+dpm(1,i)*bpn[1]+dpm(2,i)*bpn[2]-dpm(3,i)*bpo);
+	
+	/* Mark the entire surface as changed: */
+	++depthImageVersion;
+	invalidateTiles();
 	}
 
 void DepthImageRenderer::setDepthImage(const Kinect::FrameBuffer& newDepthImage)
 	{
-	/* Update the depth image: */
+	/* Update the depth image and mark all its tiles as changed: */
 	depthImage=newDepthImage;
 	++depthImageVersion;
+	depthImageFrameStamp=0;
+	invalidateTiles();
+	}
+
+void DepthImageRenderer::setFilteredDepthImage(const FilteredFrame& newDepthImage)
+	{
+	/* Update the depth image: */
+	depthImage=newDepthImage.frame;
+	++depthImageVersion;
+	
+	/* Check if the new depth image carries valid tile stamps continuing the sequence of the previous depth image: */
+	unsigned int frameStamp=newDepthImage.hasTileStamps()?newDepthImage.frameStamp:0U;
+	if(depthImageFrameStamp!=0&&frameStamp>depthImageFrameStamp&&depthImage.getSize(0)==int(depthImageSize[0])&&depthImage.getSize(1)==int(depthImageSize[1]))
+		{
+		/* Mark only those tiles as changed that changed in any output frame of the sequence after the previous depth image: */
+		std::vector<unsigned int>::const_iterator tsIt=newDepthImage.tileStamps.begin();
+		for(std::vector<unsigned int>::iterator tvIt=tileVersions.begin();tvIt!=tileVersions.end();++tvIt,++tsIt)
+			if(*tsIt>depthImageFrameStamp)
+				*tvIt=depthImageVersion;
+		}
+	else
+		invalidateTiles();
+	depthImageFrameStamp=frameStamp;
+	}
+
+bool DepthImageRenderer::calcChangedBox(unsigned int sinceVersion,Scalar box[4]) const
+	{
+	/* Find the range of tiles that changed after the given version: */
+	unsigned int tileMin[2]={numTiles[0],numTiles[1]};
+	unsigned int tileMax[2]={0,0};
+	std::vector<unsigned int>::const_iterator tvIt=tileVersions.begin();
+	for(unsigned int tileY=0;tileY<numTiles[1];++tileY)
+		for(unsigned int tileX=0;tileX<numTiles[0];++tileX,++tvIt)
+			if(*tvIt>sinceVersion)
+				{
+				tileMin[0]=Math::min(tileMin[0],tileX);
+				tileMin[1]=Math::min(tileMin[1],tileY);
+				tileMax[0]=Math::max(tileMax[0],tileX);
+				tileMax[1]=Math::max(tileMax[1],tileY);
+				}
+	if(tileMin[0]>tileMax[0])
+		return false;
+	
+	/* Calculate the range of pixels whose template vertices belong to triangles touching the changed tiles: */
+	unsigned int pixelMin[2],pixelMax[2];
+	for(int i=0;i<2;++i)
+		{
+		pixelMin[i]=tileMin[i]*FilteredFrame::tileSize;
+		if(pixelMin[i]>0)
+			--pixelMin[i];
+		pixelMax[i]=Math::min((tileMax[i]+1)*FilteredFrame::tileSize+1,depthImageSize[i])-1;
+		}
+	
+	if(lensDistortion.isIdentity())
+		{
+		/* Return the template vertices' bounding box: */
+		for(int i=0;i<2;++i)
+			{
+			box[i]=Scalar(pixelMin[i])+Scalar(0.5);
+			box[2+i]=Scalar(pixelMax[i])+Scalar(0.5);
+			}
+		}
+	else
+		{
+		/* Return the bounding box of the undistorted template vertices along the pixel range's boundary: */
+		box[1]=box[0]=Math::Constants<Scalar>::max;
+		box[3]=box[2]=Math::Constants<Scalar>::min;
+		for(unsigned int y=pixelMin[1];y<=pixelMax[1];++y)
+			{
+			unsigned int xStep=y==pixelMin[1]||y==pixelMax[1]?1:Math::max(pixelMax[0]-pixelMin[0],1U);
+			for(unsigned int x=pixelMin[0];x<=pixelMax[0];x+=xStep)
+				{
+				Kinect::LensDistortion::Point up=lensDistortion.undistortPixel(x,y);
+				for(int i=0;i<2;++i)
+					{
+					box[i]=Math::min(box[i],Scalar(up[i]));
+					box[2+i]=Math::max(box[2+i],Scalar(up[i]));
+					}
+				}
+			}
+		}
+	
+	return true;
 	}
 
 Scalar DepthImageRenderer::intersectLine(const Point& p0,const Point& p1,Scalar elevationMin,Scalar elevationMax) const
@@ -267,15 +484,8 @@ void DepthImageRenderer::bindDepthTexture(GLContextData& contextData) const
 	/* Bind the depth image texture: */
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthTexture);
 	
-	/* Check if the texture is outdated: */
-	if(dataItem->depthTextureVersion!=depthImageVersion)
-		{
-		/* Upload the new depth texture: */
-		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,depthImageSize[0],depthImageSize[1],GL_LUMINANCE,GL_FLOAT,depthImage.getData<GLfloat>());
-		
-		/* Mark the depth texture as current: */
-		dataItem->depthTextureVersion=depthImageVersion;
-		}
+	/* Upload the changed parts of the depth texture: */
+	updateDepthTexture(dataItem);
 	}
 
 void DepthImageRenderer::renderSurfaceTemplate(GLContextData& contextData) const
@@ -316,15 +526,8 @@ void DepthImageRenderer::renderDepth(const PTransform& projectionModelview,GLCon
 	glActiveTextureARB(GL_TEXTURE0_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthTexture);
 	
-	/* Check if the texture is outdated: */
-	if(dataItem->depthTextureVersion!=depthImageVersion)
-		{
-		/* Upload the new depth texture: */
-		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,depthImageSize[0],depthImageSize[1],GL_LUMINANCE,GL_FLOAT,depthImage.getData<GLfloat>());
-		
-		/* Mark the depth texture as current: */
-		dataItem->depthTextureVersion=depthImageVersion;
-		}
+	/* Upload the changed parts of the depth texture: */
+	updateDepthTexture(dataItem);
 	glUniform1iARB(dataItem->depthShaderUniforms[0],0); // Tell the shader that the depth texture is in texture unit 0
 	
 	/* Upload the combined projection, modelview, and depth projection matrix: */
@@ -361,15 +564,8 @@ void DepthImageRenderer::renderElevation(const PTransform& projectionModelview,G
 	glActiveTextureARB(GL_TEXTURE0_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthTexture);
 	
-	/* Check if the texture is outdated: */
-	if(dataItem->depthTextureVersion!=depthImageVersion)
-		{
-		/* Upload the new depth texture: */
-		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,depthImageSize[0],depthImageSize[1],GL_LUMINANCE,GL_FLOAT,depthImage.getData<GLfloat>());
-		
-		/* Mark the depth texture as current: */
-		dataItem->depthTextureVersion=depthImageVersion;
-		}
+	/* Upload the changed parts of the depth texture: */
+	updateDepthTexture(dataItem);
 	glUniform1iARB(dataItem->elevationShaderUniforms[0],0); // Tell the shader that the depth texture is in texture unit 0
 	
 	/* Upload the base plane equation in depth image space: */
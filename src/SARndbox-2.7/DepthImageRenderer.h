@@ -2,7 +2,7 @@
 DepthImageRenderer - Class to centralize storage of raw or filtered
 depth images on the GPU, and perform simple repetitive rendering tasks
 such as rendering elevation values into a frame buffer.
-Copyright (c) 2014-2018 Oliver Kreylos
+Copyright (c) 2014-2020 Oliver Kreylos
 
 This file is part of the Augmented Reality Sandbox (SARndbox).
 
@@ -24,6 +24,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef DEPTHIMAGERENDERER_INCLUDED
 #define DEPTHIMAGERENDERER_INCLUDED
 
+#include <vector>
 #include <GL/gl.h>
 #include <GL/Extensions/GLARBShaderObjects.h>
 #include <GL/GLObject.h>
@@ -33,6 +34,9 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "Types.h"
 
+/* Forward declarations: */
+struct FilteredFrame;
+
 class DepthImageRenderer:public GLObject
 	{
 	/* Embedded classes: */
@@ -49,6 +53,7 @@ class DepthImageRenderer:public GLObject
 		GLuint indexBuffer; // ID of index buffer object holding surface's triangles
 		GLuint depthTexture; // ID of texture object holding surface's vertex elevations in depth image space
 		unsigned int depthTextureVersion; // Version number of the depth image texture
+		GLuint depthPixelBuffer; // ID of pixel buffer object through which changed depth image tiles are streamed into the depth texture, or 0 if pixel buffer objects are not supported
 		
 		/* GLSL shader management: */
 		GLhandleARB depthShader; // Shader program to render the surface's depth only
@@ -73,6 +78,13 @@ class DepthImageRenderer:public GLObject
 	/* Transient state: */
 	Kinect::FrameBuffer depthImage; // The most recent float-pixel depth image
 	unsigned int depthImageVersion; // Version number of the depth image
+	unsigned int numTiles[2]; // Number of tiles covering the depth image in x and y
+	std::vector<unsigned int> tileVersions; // Version numbers of the most recent depth images in which each tile changed
+	unsigned int depthImageFrameStamp; // Sequence number of the depth image in its producer's output sequence, or 0 if the depth image did not carry tile stamps
+	
+	/* Private methods: */
+	void invalidateTiles(void); // Marks all tiles of the current depth image as changed
+	void updateDepthTexture(DataItem* dataItem) const; // Uploads all tiles of the depth image that changed since the data item's depth texture was last updated
 	
 	/* Constructors and destructors: */
 	public:
@@ -102,11 +114,13 @@ class DepthImageRenderer:public GLObject
 	void setIntrinsics(const Kinect::FrameSource::IntrinsicParameters& ips); // Sets a new depth unprojection matrix and, if present, 2D lens distortion parameters
 	void setBasePlane(const Plane& newBasePlane); // Sets a new base plane for elevation rendering
 	void setDepthImage(const Kinect::FrameBuffer& newDepthImage); // Sets a new depth image for subsequent surface rendering
+	void setFilteredDepthImage(const FilteredFrame& newDepthImage); // Ditto, for an output frame of a frame filter or height field fuser; only changed tiles will be uploaded if the frame carries valid tile stamps continuing the previous depth image's sequence
 	Scalar intersectLine(const Point& p0,const Point& p1,Scalar elevationMin,Scalar elevationMax) const; // Intersects a line segment with the current depth image in camera space; returns intersection point's parameter along line
 	unsigned int getDepthImageVersion(void) const // Returns the version number of the current depth image
 		{
 		return depthImageVersion;
 		}
+	bool calcChangedBox(unsigned int sinceVersion,Scalar box[4]) const; // Calculates the bounding box (min x, min y, max x, max y) in lens distortion-corrected depth image space of the surface that changed after the given depth image version; returns false if no part of the surface changed
 	void uploadDepthProjection(GLint location) const; // Uploads the depth unprojection matrix into the GLSL 4x4 matrix at the given uniform location
 	void bindDepthTexture(GLContextData& contextData) const; // Binds the up-to-date depth texture image to the currently active texture unit
 	void renderSurfaceTemplate(GLContextData& contextData) const; // Renders the template quad strip mesh using current OpenGL settings
@@ -0,0 +1,63 @@
+/***********************************************************************
+FilteredFrame - Structure for output frames of frame filters and height
+field fusers, carrying the change stamps of the frame's tiles alongside
+the frame itself.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef FILTEREDFRAME_INCLUDED
+#define FILTEREDFRAME_INCLUDED
+
+#include <stddef.h>
+#include <vector>
+#include <Kinect/FrameBuffer.h>
+
+struct FilteredFrame // Structure for a filtered frame and the change stamps of its tiles
+	{
+	/* Embedded classes: */
+	public:
+	static const unsigned int tileSize=32; // Width and height of the frame tiles whose changes are tracked
+	
+	/* Elements: */
+	Kinect::FrameBuffer frame; // Frame of filtered depth values or fused elevations
+	unsigned int frameStamp; // Sequence number of the frame in its producer's output sequence, or 0 if the frame does not carry tile stamps
+	std::vector<unsigned int> tileStamps; // Sequence numbers of the most recent frames of the same sequence in which each tile of the frame changed, in row-major tile order
+	
+	/* Constructors and destructors: */
+	FilteredFrame(void) // Creates an invalid frame
+		:frameStamp(0)
+		{
+		}
+	FilteredFrame(const Kinect::FrameBuffer& sFrame) // Creates a frame without tile stamps
+		:frame(sFrame),frameStamp(0)
+		{
+		}
+	
+	/* Methods: */
+	static unsigned int getNumTiles(unsigned int frameSize) // Returns the number of tiles covering a frame of the given size in one dimension
+		{
+		return (frameSize+tileSize-1)/tileSize;
+		}
+	bool hasTileStamps(void) const // Returns true if the frame carries a sequence number and one tile stamp for each of its tiles
+		{
+		return frameStamp!=0&&frame.isValid()&&tileStamps.size()==size_t(getNumTiles((unsigned int)(frame.getSize(0))))*size_t(getNumTiles((unsigned int)(frame.getSize(1))));
+		}
+	};
+
+#endif
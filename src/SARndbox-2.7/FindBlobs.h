@@ -1,7 +1,7 @@
 /***********************************************************************
-FindBlobs - Helper function to extract all eight-connected blobs of
-pixels from a frame that match an arbitrary property.
-Copyright (c) 2010-2013 Oliver Kreylos
+FindBlobs - Helper functions and classes to extract all eight-connected
+blobs of pixels from a frame that match an arbitrary property.
+Copyright (c) 2010-2020 Oliver Kreylos
 
 This file is part of the Augmented Reality Sandbox (SARndbox).
 
@@ -24,6 +24,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #define FINDBLOBS_INCLUDED
 
 #include <vector>
+#include <Images/BlobLabeler.h>
+#include <Kinect/WorkerPool.h>
 
 template <class PixelParam>
 class BlobProperty // Class to accumulate additional pixel properties along with blobs
@@ -69,6 +71,90 @@ class PixelProperty // Class to check whether a pixel should be considered part
 		}
 	};
 
+template <class PixelParam>
+struct BlobAccumulator // Structure to accumulate blobs while they are labeled and merged by an Images::BlobLabeler
+	{
+	/* Embedded classes: */
+	public:
+	typedef PixelParam Pixel; // Underlying pixel type
+	
+	struct Creator // Dummy helper structure required by Images::BlobLabeler
+		{
+		};
+	
+	/* Elements: */
+	public:
+	unsigned int blobId; // Blob ID assigned by the labeler
+	unsigned int min[2],max[2]; // Half-open bounding box of the blob
+	double sumX,sumY,sumW; // Accumulated pixel positions and number of pixels
+	BlobProperty<Pixel> blobProperty; // Additional accumulated blob property
+	
+	/* Constructors and destructors: */
+	BlobAccumulator(unsigned int x,unsigned int y,const Pixel& pixel,const Creator& creator)
+		:blobId(~0x0U),
+		 sumX(double(x)),sumY(double(y)),sumW(1.0)
+		{
+		min[0]=x;
+		min[1]=y;
+		max[0]=x+1;
+		max[1]=y+1;
+		blobProperty.addPixel(x,y,pixel);
+		}
+	
+	/* Methods: */
+	void addPixel(unsigned int x,unsigned int y,const Pixel& pixel,const Creator& creator) // Adds a pixel to the right of the current span
+		{
+		max[0]=x+1;
+		sumX+=double(x);
+		sumY+=double(y);
+		sumW+=1.0;
+		blobProperty.addPixel(x,y,pixel);
+		}
+	void merge(const BlobAccumulator& other,const Creator& creator)
+		{
+		for(int i=0;i<2;++i)
+			{
+			if(min[i]>other.min[i])
+				min[i]=other.min[i];
+			if(max[i]<other.max[i])
+				max[i]=other.max[i];
+			}
+		sumX+=other.sumX;
+		sumY+=other.sumY;
+		sumW+=other.sumW;
+		blobProperty.merge(other.blobProperty);
+		}
+	};
+
+template <class PixelParam>
+class BlobFinder // Class to extract blobs from a sequence of frames using a parallel labeler that retains its buffers between frames
+	{
+	/* Embedded classes: */
+	public:
+	typedef PixelParam Pixel; // Underlying pixel type
+	
+	/* Elements: */
+	private:
+	Kinect::WorkerPool workers; // Pool of worker threads labeling bands of frames
+	Images::BlobLabeler<BlobAccumulator<Pixel> > labeler; // The blob labeler
+	std::vector<BlobAccumulator<Pixel> > accumulators; // Blobs extracted from the most recent frame
+	
+	/* Constructors and destructors: */
+	public:
+	BlobFinder(unsigned int numThreads =0) // Creates a blob finder using the given number of threads; uses number of online CPUs if zero
+		:workers(numThreads),labeler(&workers)
+		{
+		}
+	
+	/* Methods: */
+	unsigned int getNumThreads(void) const // Returns the number of threads used to extract blobs
+		{
+		return labeler.getNumThreads();
+		}
+	template <class PixelPropertyParam>
+	void findBlobs(const unsigned int size[2],const Pixel* frame,const PixelPropertyParam& property,std::vector<Blob<Pixel> >& blobs); // Replaces the contents of the given blob list with all connected blobs from the given frame whose pixels have the given property
+	};
+
 template <class PixelParam,class PixelPropertyParam>
 std::vector<Blob<PixelParam> > findBlobs(const unsigned int size[2],const PixelParam* frame,const PixelPropertyParam& property); // Extracts all connected blobs from the given frame whose pixels have the given property
 
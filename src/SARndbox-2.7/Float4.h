@@ -0,0 +1,315 @@
+/***********************************************************************
+Float4 - Class for short vectors of four single-precision floating-point
+numbers mapped to SSE registers where available, with a portable scalar
+fallback, to vectorize grid processing loops.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef FLOAT4_INCLUDED
+#define FLOAT4_INCLUDED
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#else
+#include <math.h>
+#include <string.h>
+#endif
+
+class Float4
+	{
+	/* Elements: */
+	public:
+	#ifdef __SSE2__
+	__m128 v; // SSE register holding the four components
+	#else
+	float v[4]; // Array holding the four components
+	#endif
+	
+	/* Constructors and destructors: */
+	Float4(void) // Dummy constructor
+		{
+		}
+	#ifdef __SSE2__
+	Float4(__m128 sV) // Creates vector from SSE register
+		:v(sV)
+		{
+		}
+	explicit Float4(float s) // Creates vector with all components set to the given scalar
+		:v(_mm_set1_ps(s))
+		{
+		}
+	Float4(float s0,float s1,float s2,float s3) // Creates vector from four components
+		:v(_mm_setr_ps(s0,s1,s2,s3))
+		{
+		}
+	#else
+	explicit Float4(float s)
+		{
+		for(int i=0;i<4;++i)
+			v[i]=s;
+		}
+	Float4(float s0,float s1,float s2,float s3)
+		{
+		v[0]=s0;
+		v[1]=s1;
+		v[2]=s2;
+		v[3]=s3;
+		}
+	#endif
+	
+	/* Methods: */
+	#ifdef __SSE2__
+	static Float4 load(const float* p) // Loads four consecutive values from an arbitrarily aligned address
+		{
+		return Float4(_mm_loadu_ps(p));
+		}
+	void store(float* p) const // Stores four consecutive values to an arbitrarily aligned address
+		{
+		_mm_storeu_ps(p,v);
+		}
+	float sum(void) const // Returns the sum of all components
+		{
+		__m128 s=_mm_add_ps(v,_mm_movehl_ps(v,v));
+		s=_mm_add_ss(s,_mm_shuffle_ps(s,s,0x55));
+		return _mm_cvtss_f32(s);
+		}
+	float minComponent(void) const // Returns the smallest component
+		{
+		__m128 m=_mm_min_ps(v,_mm_movehl_ps(v,v));
+		m=_mm_min_ss(m,_mm_shuffle_ps(m,m,0x55));
+		return _mm_cvtss_f32(m);
+		}
+	#else
+	static Float4 load(const float* p)
+		{
+		Float4 result;
+		memcpy(result.v,p,sizeof(result.v));
+		return result;
+		}
+	void store(float* p) const
+		{
+		memcpy(p,v,sizeof(v));
+		}
+	float sum(void) const
+		{
+		return (v[0]+v[2])+(v[1]+v[3]);
+		}
+	float minComponent(void) const
+		{
+		float m0=v[2]<v[0]?v[2]:v[0];
+		float m1=v[3]<v[1]?v[3]:v[1];
+		return m1<m0?m1:m0;
+		}
+	#endif
+	};
+
+/**********************************************************************
+Comparison operators return masks with all bits set in components where
+the comparison holds; masks are only meant to be used with select() and
+any().
+**********************************************************************/
+
+#ifdef __SSE2__
+
+inline Float4 operator+(const Float4& a,const Float4& b)
+	{
+	return Float4(_mm_add_ps(a.v,b.v));
+	}
+
+inline Float4 operator-(const Float4& a,const Float4& b)
+	{
+	return Float4(_mm_sub_ps(a.v,b.v));
+	}
+
+inline Float4 operator-(const Float4& a)
+	{
+	return Float4(_mm_xor_ps(a.v,_mm_set1_ps(-0.0f)));
+	}
+
+inline Float4 operator*(const Float4& a,const Float4& b)
+	{
+	return Float4(_mm_mul_ps(a.v,b.v));
+	}
+
+inline Float4 operator/(const Float4& a,const Float4& b)
+	{
+	return Float4(_mm_div_ps(a.v,b.v));
+	}
+
+inline Float4 min(const Float4& a,const Float4& b)
+	{
+	return Float4(_mm_min_ps(a.v,b.v));
+	}
+
+inline Float4 max(const Float4& a,const Float4& b)
+	{
+	return Float4(_mm_max_ps(a.v,b.v));
+	}
+
+inline Float4 abs(const Float4& a)
+	{
+	return Float4(_mm_andnot_ps(_mm_set1_ps(-0.0f),a.v));
+	}
+
+inline Float4 sqrt(const Float4& a)
+	{
+	return Float4(_mm_sqrt_ps(a.v));
+	}
+
+inline Float4 operator<(const Float4& a,const Float4& b)
+	{
+	return Float4(_mm_cmplt_ps(a.v,b.v));
+	}
+
+inline Float4 operator>(const Float4& a,const Float4& b)
+	{
+	return Float4(_mm_cmpgt_ps(a.v,b.v));
+	}
+
+inline Float4 operator<=(const Float4& a,const Float4& b)
+	{
+	return Float4(_mm_cmple_ps(a.v,b.v));
+	}
+
+inline Float4 operator>=(const Float4& a,const Float4& b)
+	{
+	return Float4(_mm_cmpge_ps(a.v,b.v));
+	}
+
+inline Float4 operator==(const Float4& a,const Float4& b)
+	{
+	return Float4(_mm_cmpeq_ps(a.v,b.v));
+	}
+
+inline Float4 operator!=(const Float4& a,const Float4& b)
+	{
+	return Float4(_mm_cmpneq_ps(a.v,b.v));
+	}
+
+inline Float4 operator&(const Float4& mask1,const Float4& mask2) // Returns the intersection of two masks
+	{
+	return Float4(_mm_and_ps(mask1.v,mask2.v));
+	}
+
+inline Float4 operator|(const Float4& mask1,const Float4& mask2) // Returns the union of two masks
+	{
+	return Float4(_mm_or_ps(mask1.v,mask2.v));
+	}
+
+inline Float4 select(const Float4& mask,const Float4& a,const Float4& b) // Returns a in components where mask is set, b otherwise
+	{
+	return Float4(_mm_or_ps(_mm_and_ps(mask.v,a.v),_mm_andnot_ps(mask.v,b.v)));
+	}
+
+inline Float4 laneIndexLess(int n) // Returns a mask that is set in all components whose index is smaller than n
+	{
+	return Float4(_mm_castsi128_ps(_mm_cmplt_epi32(_mm_setr_epi32(0,1,2,3),_mm_set1_epi32(n))));
+	}
+
+inline bool any(const Float4& mask) // Returns true if the mask is set in any component
+	{
+	return _mm_movemask_ps(mask.v)!=0;
+	}
+
+#else
+
+/* Helper macros to define component-wise operations: */
+#define FLOAT4_BINARY(name,expr) \
+	inline Float4 name(const Float4& a,const Float4& b) \
+		{ \
+		Float4 result; \
+		for(int i=0;i<4;++i) \
+			result.v[i]=(expr); \
+		return result; \
+		}
+#define FLOAT4_COMPARE(name,op) \
+	inline Float4 name(const Float4& a,const Float4& b) \
+		{ \
+		Float4 result; \
+		for(int i=0;i<4;++i) \
+			result.v[i]=a.v[i] op b.v[i]?1.0f:0.0f; \
+		return result; \
+		}
+
+FLOAT4_BINARY(operator+,a.v[i]+b.v[i])
+FLOAT4_BINARY(operator-,a.v[i]-b.v[i])
+FLOAT4_BINARY(operator*,a.v[i]*b.v[i])
+FLOAT4_BINARY(operator/,a.v[i]/b.v[i])
+FLOAT4_BINARY(min,a.v[i]<b.v[i]?a.v[i]:b.v[i])
+FLOAT4_BINARY(max,a.v[i]>b.v[i]?a.v[i]:b.v[i])
+FLOAT4_BINARY(operator&,a.v[i]!=0.0f&&b.v[i]!=0.0f?1.0f:0.0f)
+FLOAT4_BINARY(operator|,a.v[i]!=0.0f||b.v[i]!=0.0f?1.0f:0.0f)
+FLOAT4_COMPARE(operator<,<)
+FLOAT4_COMPARE(operator>,>)
+FLOAT4_COMPARE(operator<=,<=)
+FLOAT4_COMPARE(operator>=,>=)
+FLOAT4_COMPARE(operator==,==)
+FLOAT4_COMPARE(operator!=,!=)
+
+#undef FLOAT4_BINARY
+#undef FLOAT4_COMPARE
+
+inline Float4 operator-(const Float4& a)
+	{
+	Float4 result;
+	for(int i=0;i<4;++i)
+		result.v[i]=-a.v[i];
+	return result;
+	}
+
+inline Float4 abs(const Float4& a)
+	{
+	Float4 result;
+	for(int i=0;i<4;++i)
+		result.v[i]=fabsf(a.v[i]);
+	return result;
+	}
+
+inline Float4 sqrt(const Float4& a)
+	{
+	Float4 result;
+	for(int i=0;i<4;++i)
+		result.v[i]=sqrtf(a.v[i]);
+	return result;
+	}
+
+inline Float4 select(const Float4& mask,const Float4& a,const Float4& b)
+	{
+	Float4 result;
+	for(int i=0;i<4;++i)
+		result.v[i]=mask.v[i]!=0.0f?a.v[i]:b.v[i];
+	return result;
+	}
+
+inline Float4 laneIndexLess(int n)
+	{
+	Float4 result;
+	for(int i=0;i<4;++i)
+		result.v[i]=i<n?1.0f:0.0f;
+	return result;
+	}
+
+inline bool any(const Float4& mask)
+	{
+	return mask.v[0]!=0.0f||mask.v[1]!=0.0f||mask.v[2]!=0.0f||mask.v[3]!=0.0f;
+	}
+
+#endif
+
+#endif
@@ -2,7 +2,7 @@
 FrameFilter - Class to filter streams of depth frames arriving from a
 depth camera, with code to detect unstable values in each pixel, and
 fill holes resulting from invalid samples.
-Copyright (c) 2012-2016 Oliver Kreylos
+Copyright (c) 2012-2020 Oliver Kreylos
 
 This file is part of the Augmented Reality Sandbox (SARndbox).
 
@@ -23,180 +23,582 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "FrameFilter.h"
 
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
 #include <Misc/FunctionCalls.h>
 #include <Geometry/HVector.h>
 #include <Geometry/Matrix.h>
 
+#include "Float4.h"
+#include "LatencyTracker.h"
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+#ifdef __SSE2__
+
+inline __m128i mulLo(__m128i a,__m128i b) // Multiplies two vectors of unsigned 32-bit integers and returns the low 32 bits of the products
+	{
+	#ifdef __SSE4_1__
+	return _mm_mullo_epi32(a,b);
+	#else
+	__m128i p02=_mm_mul_epu32(a,b);
+	__m128i p13=_mm_mul_epu32(_mm_srli_epi64(a,32),_mm_srli_epi64(b,32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(p02,_MM_SHUFFLE(0,0,2,0)),_mm_shuffle_epi32(p13,_MM_SHUFFLE(0,0,2,0)));
+	#endif
+	}
+
+inline __m128i greaterUnsigned(__m128i a,__m128i b) // Returns a mask set in all components where unsigned a>b
+	{
+	__m128i sign=_mm_set1_epi32(int(0x80000000U));
+	return _mm_cmpgt_epi32(_mm_xor_si128(a,sign),_mm_xor_si128(b,sign));
+	}
+
+inline __m128i select(__m128i mask,__m128i a,__m128i b) // Returns a in components where mask is set, b otherwise
+	{
+	return _mm_or_si128(_mm_and_si128(mask,a),_mm_andnot_si128(mask,b));
+	}
+
+inline __m128i loadRawDepth(const unsigned short* p) // Loads four raw depth values and zero-extends them to 32 bits
+	{
+	return _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)),_mm_setzero_si128());
+	}
+
+inline void storeRawDepth(unsigned short* p,__m128i v) // Stores the low 16 bits of four 32-bit values
+	{
+	v=_mm_shufflelo_epi16(v,_MM_SHUFFLE(2,0,2,0));
+	v=_mm_shufflehi_epi16(v,_MM_SHUFFLE(2,0,2,0));
+	v=_mm_shuffle_epi32(v,_MM_SHUFFLE(2,0,2,0));
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(p),v);
+	}
+
+#endif
+
+}
+
 /****************************
 Methods of class FrameFilter:
 ****************************/
 
-void* FrameFilter::filterThreadMethod(void)
+void FrameFilter::initStatistics(void)
 	{
-	unsigned int lastInputFrameVersion=0;
-	
-	while(true)
-		{
-		Kinect::FrameBuffer frame;
+	size_t frameSize=size_t(size[1])*size_t(size[0]);
+	if(statisticsEngine==AVERAGING_SLOTS)
 		{
-		Threads::MutexCond::Lock inputLock(inputCond);
+		/* Release the exponentially weighted statistics buffer: */
+		delete[] expStatBuffer;
+		expStatBuffer=0;
 		
-		/* Wait until a new frame arrives or the program shuts down: */
-		while(runFilterThread&&lastInputFrameVersion==inputFrameVersion)
-			inputCond.wait(inputLock);
+		/* Initialize the averaging buffer: */
+		if(averagingBuffer==0)
+			averagingBuffer=new RawDepth[numAveragingSlots*frameSize];
+		RawDepth* abPtr=averagingBuffer;
+		for(size_t i=numAveragingSlots*frameSize;i>0;--i,++abPtr)
+			*abPtr=2048U; // Mark sample as invalid
+		averagingSlotIndex=0U;
 		
-		/* Bail out if the program is shutting down: */
-		if(!runFilterThread)
-			break;
+		/* Initialize the statistics buffer: */
+		if(statBuffer==0)
+			statBuffer=new unsigned int[frameSize*3];
+		unsigned int* sbPtr=statBuffer;
+		for(size_t i=frameSize*3;i>0;--i,++sbPtr)
+			*sbPtr=0;
+		}
+	else
+		{
+		/* Release the averaging and statistics buffers: */
+		delete[] averagingBuffer;
+		averagingBuffer=0;
+		delete[] statBuffer;
+		statBuffer=0;
 		
-		/* Work on the new frame: */
-		frame=inputFrame;
-		lastInputFrameVersion=inputFrameVersion;
+		/* Initialize the exponentially weighted statistics buffer: */
+		if(expStatBuffer==0)
+			expStatBuffer=new float[frameSize*3];
+		float* esbPtr=expStatBuffer;
+		for(size_t i=frameSize*3;i>0;--i,++esbPtr)
+			*esbPtr=0.0f;
 		}
+	}
+
+void FrameFilter::slotStatisticsBand(unsigned int bandIndex,int rowBegin,int rowEnd)
+	{
+	size_t frameSize=size_t(size[1])*size_t(size[0]);
+	
+	#ifdef __SSE2__
+	
+	/* Prepare constant vectors for the vectorized pixel loop: */
+	__m128 minPlane0=_mm_set1_ps(minPlane[0]);
+	__m128 minPlane1=_mm_set1_ps(minPlane[1]);
+	__m128 minPlane2=_mm_set1_ps(minPlane[2]);
+	__m128 minPlane3=_mm_set1_ps(minPlane[3]);
+	__m128 maxPlane0=_mm_set1_ps(maxPlane[0]);
+	__m128 maxPlane1=_mm_set1_ps(maxPlane[1]);
+	__m128 maxPlane2=_mm_set1_ps(maxPlane[2]);
+	__m128 maxPlane3=_mm_set1_ps(maxPlane[3]);
+	__m128 pxOffsets=_mm_setr_ps(0.5f,1.5f,2.5f,3.5f);
+	__m128 zeroPs=_mm_setzero_ps();
+	__m128 absMask=_mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 hysteresisPs=_mm_set1_ps(hysteresis);
+	__m128 instableValuePs=_mm_set1_ps(instableValue);
+	__m128i invalidDepth=_mm_set1_epi32(2048);
+	__m128i allOnes=_mm_set1_epi32(-1);
+	__m128i minNumSamplesPi=_mm_set1_epi32(int(minNumSamples));
+	__m128i maxVariancePi=_mm_set1_epi32(int(maxVariance));
+	
+	#endif
+	
+	for(int y=rowBegin;y<rowEnd;++y)
+		{
+		/* Get pointers to the beginning of the row in all buffers: */
+		size_t rowOffset=size_t(y)*size_t(size[0]);
+		const RawDepth* ifPtr=bandInputFrame+rowOffset;
+		RawDepth* abPtr=averagingBuffer+averagingSlotIndex*frameSize+rowOffset;
+		unsigned int* s0Ptr=statBuffer+rowOffset; // Number of valid samples
+		unsigned int* s1Ptr=s0Ptr+frameSize; // Sum of valid samples
+		unsigned int* s2Ptr=s1Ptr+frameSize; // Sum of squares of valid samples
+		float* ofPtr=validBuffer+rowOffset;
+		float* nofPtr=bandOutputFrame+rowOffset;
+		const PixelDepthCorrection* pdcPtr=pixelDepthCorrection+rowOffset;
+		float py=float(y)+0.5f;
+		unsigned int x=0;
 		
-		/* Prepare a new output frame: */
-		Kinect::FrameBuffer& newOutputFrame=outputFrames.startNewValue();
+		#ifdef __SSE2__
 		
-		/* Enter the new frame into the averaging buffer and calculate the output frame's pixel values: */
-		const RawDepth* ifPtr=inputFrame.getData<RawDepth>();
-		RawDepth* abPtr=averagingBuffer+averagingSlotIndex*size[1]*size[0];
-		unsigned int* sPtr=statBuffer;
-		float* ofPtr=validBuffer;
-		float* nofPtr=newOutputFrame.getData<float>();
-		const PixelDepthCorrection* pdcPtr=pixelDepthCorrection;
-		for(unsigned int y=0;y<size[1];++y)
+		/* Process the row in groups of four pixels: */
+		__m128 pyPs=_mm_set1_ps(py);
+		for(;x+4<=size[0];x+=4,ifPtr+=4,pdcPtr+=4,abPtr+=4,s0Ptr+=4,s1Ptr+=4,s2Ptr+=4,ofPtr+=4,nofPtr+=4)
 			{
-			float py=float(y)+0.5f;
-			for(unsigned int x=0;x<size[0];++x,++ifPtr,++pdcPtr,++abPtr,sPtr+=3,++ofPtr,++nofPtr)
+			__m128 px=_mm_add_ps(_mm_set1_ps(float(x)),pxOffsets);
+			
+			__m128i oldVal=loadRawDepth(abPtr);
+			__m128i newVal=loadRawDepth(ifPtr);
+			
+			/* Depth-correct the new values: */
+			__m128 pdc01=_mm_loadu_ps(&pdcPtr[0].scale);
+			__m128 pdc23=_mm_loadu_ps(&pdcPtr[2].scale);
+			__m128 pdcScale=_mm_shuffle_ps(pdc01,pdc23,_MM_SHUFFLE(2,0,2,0));
+			__m128 pdcOffset=_mm_shuffle_ps(pdc01,pdc23,_MM_SHUFFLE(3,1,3,1));
+			__m128 newCVal=_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(newVal),pdcScale),pdcOffset);
+			
+			/* Plug the depth-corrected new values into the minimum and maximum plane equations to determine their validity: */
+			__m128 minD=_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(minPlane0,px),_mm_mul_ps(minPlane1,pyPs)),_mm_mul_ps(minPlane2,newCVal)),minPlane3);
+			__m128 maxD=_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(maxPlane0,px),_mm_mul_ps(maxPlane1,pyPs)),_mm_mul_ps(maxPlane2,newCVal)),maxPlane3);
+			__m128i valid=_mm_castps_si128(_mm_and_ps(_mm_cmpge_ps(minD,zeroPs),_mm_cmple_ps(maxD,zeroPs)));
+			
+			/* Store valid new values, and invalid values unless previous valid values are retained: */
+			__m128i store=retainValids?valid:allOnes;
+			storeRawDepth(abPtr,select(store,select(valid,newVal,invalidDepth),oldVal));
+			
+			/* Update the pixels' statistics by adding valid new values and removing overwritten valid old values: */
+			__m128i remove=_mm_andnot_si128(_mm_cmpeq_epi32(oldVal,invalidDepth),store);
+			__m128i s0=_mm_loadu_si128(reinterpret_cast<const __m128i*>(s0Ptr));
+			__m128i s1=_mm_loadu_si128(reinterpret_cast<const __m128i*>(s1Ptr));
+			__m128i s2=_mm_loadu_si128(reinterpret_cast<const __m128i*>(s2Ptr));
+			s0=_mm_add_epi32(_mm_sub_epi32(s0,valid),remove);
+			s1=_mm_sub_epi32(_mm_add_epi32(s1,_mm_and_si128(newVal,valid)),_mm_and_si128(oldVal,remove));
+			s2=_mm_sub_epi32(_mm_add_epi32(s2,_mm_and_si128(mulLo(newVal,newVal),valid)),_mm_and_si128(mulLo(oldVal,oldVal),remove));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(s0Ptr),s0);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(s1Ptr),s1);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(s2Ptr),s2);
+			
+			/* Check if the pixels are considered "stable": */
+			__m128i instable=_mm_or_si128(greaterUnsigned(minNumSamplesPi,s0),greaterUnsigned(mulLo(s2,s0),_mm_add_epi32(mulLo(maxVariancePi,mulLo(s0,s0)),mulLo(s1,s1))));
+			__m128 stable=_mm_castsi128_ps(_mm_andnot_si128(instable,allOnes));
+			
+			/* Update stable pixels whose new depth-corrected running means are outside the previous values' envelopes: */
+			__m128 newFiltered=_mm_add_ps(_mm_mul_ps(_mm_div_ps(_mm_cvtepi32_ps(s1),_mm_cvtepi32_ps(s0)),pdcScale),pdcOffset);
+			__m128 of=_mm_loadu_ps(ofPtr);
+			__m128 update=_mm_and_ps(stable,_mm_cmpge_ps(_mm_and_ps(_mm_sub_ps(newFiltered,of),absMask),hysteresisPs));
+			of=_mm_or_ps(_mm_and_ps(update,newFiltered),_mm_andnot_ps(update,of));
+			_mm_storeu_ps(ofPtr,of);
+			
+			/* Set the output pixel values to the stable values, or assign default values to instable pixels: */
+			if(retainValids)
+				_mm_storeu_ps(nofPtr,of);
+			else
+				_mm_storeu_ps(nofPtr,_mm_or_ps(_mm_and_ps(stable,of),_mm_andnot_ps(stable,instableValuePs)));
+			}
+		
+		#endif
+		
+		/* Process the remaining pixels in the row: */
+		for(;x<size[0];++x,++ifPtr,++pdcPtr,++abPtr,++s0Ptr,++s1Ptr,++s2Ptr,++ofPtr,++nofPtr)
+			{
+			float px=float(x)+0.5f;
+			
+			unsigned int oldVal=*abPtr;
+			unsigned int newVal=*ifPtr;
+			
+			/* Depth-correct the new value: */
+			float newCVal=pdcPtr->correct(newVal);
+			
+			/* Plug the depth-corrected new value into the minimum and maximum plane equations to determine its validity: */
+			float minD=minPlane[0]*px+minPlane[1]*py+minPlane[2]*newCVal+minPlane[3];
+			float maxD=maxPlane[0]*px+maxPlane[1]*py+maxPlane[2]*newCVal+maxPlane[3];
+			if(minD>=0.0f&&maxD<=0.0f)
 				{
-				float px=float(x)+0.5f;
-				
-				unsigned int oldVal=*abPtr;
-				unsigned int newVal=*ifPtr;
+				/* Store the new input value: */
+				*abPtr=newVal;
 				
-				/* Depth-correct the new value: */
-				float newCVal=pdcPtr->correct(newVal);
+				/* Update the pixel's statistics: */
+				++*s0Ptr;
+				*s1Ptr+=newVal;
+				*s2Ptr+=newVal*newVal;
 				
-				/* Plug the depth-corrected new value into the minimum and maximum plane equations to determine its validity: */
-				float minD=minPlane[0]*px+minPlane[1]*py+minPlane[2]*newCVal+minPlane[3];
-				float maxD=maxPlane[0]*px+maxPlane[1]*py+maxPlane[2]*newCVal+maxPlane[3];
-				if(minD>=0.0f&&maxD<=0.0f)
+				/* Check if the previous value in the averaging buffer was valid: */
+				if(oldVal!=2048U)
 					{
-					/* Store the new input value: */
-					*abPtr=newVal;
-					
-					/* Update the pixel's statistics: */
-					++sPtr[0]; // Number of valid samples
-					sPtr[1]+=newVal; // Sum of valid samples
-					sPtr[2]+=newVal*newVal; // Sum of squares of valid samples
-					
-					/* Check if the previous value in the averaging buffer was valid: */
-					if(oldVal!=2048U)
-						{
-						--sPtr[0]; // Number of valid samples
-						sPtr[1]-=oldVal; // Sum of valid samples
-						sPtr[2]-=oldVal*oldVal; // Sum of squares of valid samples
-						}
+					--*s0Ptr;
+					*s1Ptr-=oldVal;
+					*s2Ptr-=oldVal*oldVal;
 					}
-				else if(!retainValids)
+				}
+			else if(!retainValids)
+				{
+				/* Store an invalid input value: */
+				*abPtr=2048U;
+				
+				/* Check if the previous value in the averaging buffer was valid: */
+				if(oldVal!=2048U)
 					{
-					/* Store an invalid input value: */
-					*abPtr=2048U;
-					
-					/* Check if the previous value in the averaging buffer was valid: */
-					if(oldVal!=2048U)
-						{
-						--sPtr[0]; // Number of valid samples
-						sPtr[1]-=oldVal; // Sum of valid samples
-						sPtr[2]-=oldVal*oldVal; // Sum of squares of valid samples
-						}
+					--*s0Ptr;
+					*s1Ptr-=oldVal;
+					*s2Ptr-=oldVal*oldVal;
 					}
-				
-				/* Check if the pixel is considered "stable": */
-				if(sPtr[0]>=minNumSamples&&sPtr[2]*sPtr[0]<=maxVariance*sPtr[0]*sPtr[0]+sPtr[1]*sPtr[1])
+				}
+			
+			/* Check if the pixel is considered "stable": */
+			if(*s0Ptr>=minNumSamples&&*s2Ptr**s0Ptr<=maxVariance**s0Ptr**s0Ptr+*s1Ptr**s1Ptr)
+				{
+				/* Check if the new depth-corrected running mean is outside the previous value's envelope: */
+				float newFiltered=pdcPtr->correct(float(*s1Ptr)/float(*s0Ptr));
+				if(Math::abs(newFiltered-*ofPtr)>=hysteresis)
 					{
-					/* Check if the new depth-corrected running mean is outside the previous value's envelope: */
-					float newFiltered=pdcPtr->correct(float(sPtr[1])/float(sPtr[0]));
-					if(Math::abs(newFiltered-*ofPtr)>=hysteresis)
-						{
-						/* Set the output pixel value to the depth-corrected running mean: */
-						*nofPtr=*ofPtr=newFiltered;
-						}
-					else
-						{
-						/* Leave the pixel at its previous value: */
-						*nofPtr=*ofPtr;
-						}
+					/* Set the output pixel value to the depth-corrected running mean: */
+					*nofPtr=*ofPtr=newFiltered;
 					}
-				else if(retainValids)
+				else
 					{
 					/* Leave the pixel at its previous value: */
 					*nofPtr=*ofPtr;
 					}
+				}
+			else if(retainValids)
+				{
+				/* Leave the pixel at its previous value: */
+				*nofPtr=*ofPtr;
+				}
+			else
+				{
+				/* Assign default value to instable pixels: */
+				*nofPtr=instableValue;
+				}
+			}
+		}
+	}
+
+void FrameFilter::exponentialStatisticsBand(unsigned int bandIndex,int rowBegin,int rowEnd)
+	{
+	size_t frameSize=size_t(size[1])*size_t(size[0]);
+	float maxCount=float(numAveragingSlots);
+	float minCount=float(minNumSamples);
+	float maxVar=float(maxVariance);
+	
+	/* Prepare constant vectors for the vectorized pixel loop: */
+	Float4 minPlane0(minPlane[0]),minPlane1(minPlane[1]),minPlane2(minPlane[2]),minPlane3(minPlane[3]);
+	Float4 maxPlane0(maxPlane[0]),maxPlane1(maxPlane[1]),maxPlane2(maxPlane[2]),maxPlane3(maxPlane[3]);
+	Float4 pxOffsets(0.5f,1.5f,2.5f,3.5f);
+	Float4 zero(0.0f),one(1.0f),sixteen(16.0f);
+	Float4 weight(expWeight);
+	Float4 maxCount4(maxCount),minCount4(minCount),maxVar4(maxVar);
+	Float4 hysteresis4(hysteresis),instableValue4(instableValue);
+	
+	for(int y=rowBegin;y<rowEnd;++y)
+		{
+		/* Get pointers to the beginning of the row in all buffers: */
+		size_t rowOffset=size_t(y)*size_t(size[0]);
+		const RawDepth* ifPtr=bandInputFrame+rowOffset;
+		float* cPtr=expStatBuffer+rowOffset; // Number of valid samples, saturating at the number of averaging slots
+		float* mPtr=cPtr+frameSize; // Exponentially weighted mean
+		float* vPtr=mPtr+frameSize; // Exponentially weighted variance
+		float* ofPtr=validBuffer+rowOffset;
+		float* nofPtr=bandOutputFrame+rowOffset;
+		const PixelDepthCorrection* pdcPtr=pixelDepthCorrection+rowOffset;
+		float py=float(y)+0.5f;
+		Float4 py4(py);
+		unsigned int x=0;
+		
+		/* Process the row in groups of four pixels: */
+		for(;x+4<=size[0];x+=4,ifPtr+=4,pdcPtr+=4,cPtr+=4,mPtr+=4,vPtr+=4,ofPtr+=4,nofPtr+=4)
+			{
+			Float4 px=Float4(float(x))+pxOffsets;
+			Float4 newVal=Float4(float(ifPtr[0]),float(ifPtr[1]),float(ifPtr[2]),float(ifPtr[3]));
+			
+			/* Depth-correct the new values and determine their validity: */
+			Float4 pdcScale(pdcPtr[0].scale,pdcPtr[1].scale,pdcPtr[2].scale,pdcPtr[3].scale);
+			Float4 pdcOffset(pdcPtr[0].offset,pdcPtr[1].offset,pdcPtr[2].offset,pdcPtr[3].offset);
+			Float4 newCVal=newVal*pdcScale+pdcOffset;
+			Float4 minD=minPlane0*px+minPlane1*py4+minPlane2*newCVal+minPlane3;
+			Float4 maxD=maxPlane0*px+maxPlane1*py4+maxPlane2*newCVal+maxPlane3;
+			Float4 valid=(minD>=zero)&(maxD<=zero);
+			
+			/* Enter valid new values into the statistics, restarting them for empty pixels and outliers: */
+			Float4 count=Float4::load(cPtr);
+			Float4 mean=Float4::load(mPtr);
+			Float4 var=Float4::load(vPtr);
+			Float4 diff=newVal-mean;
+			Float4 restart=(count==zero)|(diff*diff>max(var,maxVar4)*sixteen);
+			Float4 newCount=min(count+one,maxCount4);
+			Float4 w=max(one/newCount,weight);
+			Float4 increment=diff*w;
+			Float4 validCount=select(restart,one,newCount);
+			Float4 validMean=select(restart,newVal,mean+increment);
+			Float4 validVar=select(restart,zero,(var+diff*increment)*(one-w));
+			
+			/* Let invalid new values retire a valid sample unless previous valid values are retained: */
+			Float4 invalidCount=retainValids?count:max(count-one,zero);
+			count=select(valid,validCount,invalidCount);
+			mean=select(valid,validMean,mean);
+			var=select(valid,validVar,var);
+			count.store(cPtr);
+			mean.store(mPtr);
+			var.store(vPtr);
+			
+			/* Update stable pixels whose new depth-corrected means are outside the previous values' envelopes: */
+			Float4 stable=(count>=minCount4)&(var<=maxVar4);
+			Float4 newFiltered=mean*pdcScale+pdcOffset;
+			Float4 of=Float4::load(ofPtr);
+			of=select(stable&(abs(newFiltered-of)>=hysteresis4),newFiltered,of);
+			of.store(ofPtr);
+			
+			/* Set the output pixel values to the stable values, or assign default values to instable pixels: */
+			if(retainValids)
+				of.store(nofPtr);
+			else
+				select(stable,of,instableValue4).store(nofPtr);
+			}
+		
+		/* Process the remaining pixels in the row: */
+		for(;x<size[0];++x,++ifPtr,++pdcPtr,++cPtr,++mPtr,++vPtr,++ofPtr,++nofPtr)
+			{
+			float px=float(x)+0.5f;
+			float newVal=float(*ifPtr);
+			
+			/* Depth-correct the new value and determine its validity: */
+			float newCVal=pdcPtr->correct(newVal);
+			float minD=minPlane[0]*px+minPlane[1]*py+minPlane[2]*newCVal+minPlane[3];
+			float maxD=maxPlane[0]*px+maxPlane[1]*py+maxPlane[2]*newCVal+maxPlane[3];
+			if(minD>=0.0f&&maxD<=0.0f)
+				{
+				/* Enter the new value into the statistics, restarting them for an empty pixel or an outlier: */
+				float diff=newVal-*mPtr;
+				if(*cPtr==0.0f||diff*diff>Math::max(*vPtr,maxVar)*16.0f)
+					{
+					*cPtr=1.0f;
+					*mPtr=newVal;
+					*vPtr=0.0f;
+					}
 				else
 					{
-					/* Assign default value to instable pixels: */
-					*nofPtr=instableValue;
+					*cPtr=Math::min(*cPtr+1.0f,maxCount);
+					float w=Math::max(1.0f/(*cPtr),expWeight);
+					float increment=diff*w;
+					*mPtr+=increment;
+					*vPtr=(*vPtr+diff*increment)*(1.0f-w);
 					}
 				}
+			else if(!retainValids)
+				{
+				/* Retire a valid sample: */
+				*cPtr=Math::max(*cPtr-1.0f,0.0f);
+				}
+			
+			/* Check if the pixel is considered "stable": */
+			if(*cPtr>=minCount&&*vPtr<=maxVar)
+				{
+				/* Check if the new depth-corrected mean is outside the previous value's envelope: */
+				float newFiltered=pdcPtr->correct(*mPtr);
+				if(Math::abs(newFiltered-*ofPtr)>=hysteresis)
+					*ofPtr=newFiltered;
+				*nofPtr=*ofPtr;
+				}
+			else if(retainValids)
+				{
+				/* Leave the pixel at its previous value: */
+				*nofPtr=*ofPtr;
+				}
+			else
+				{
+				/* Assign default value to instable pixels: */
+				*nofPtr=instableValue;
+				}
+			}
+		}
+	}
+
+void FrameFilter::columnFilterBand(unsigned int bandIndex,int rowBegin,int rowEnd)
+	{
+	for(int y=rowBegin;y<rowEnd;++y)
+		{
+		/* Get pointers to the current, previous, and next rows: */
+		const float* rowPtr=bandOutputFrame+size_t(y)*size_t(size[0]);
+		const float* prevPtr=rowPtr-size[0];
+		const float* nextPtr=rowPtr+size[0];
+		float* resultPtr=spatialFilterBuffer+size_t(y)*size_t(size[0]);
+		unsigned int x=0;
+		if(y==0)
+			{
+			/* Filter the first row: */
+			for(;x+4<=size[0];x+=4)
+				((Float4::load(rowPtr+x)*Float4(2.0f)+Float4::load(nextPtr+x))/Float4(3.0f)).store(resultPtr+x);
+			for(;x<size[0];++x)
+				resultPtr[x]=(rowPtr[x]*2.0f+nextPtr[x])/3.0f;
+			}
+		else if(y==int(size[1])-1)
+			{
+			/* Filter the last row: */
+			for(;x+4<=size[0];x+=4)
+				((Float4::load(prevPtr+x)+Float4::load(rowPtr+x)*Float4(2.0f))/Float4(3.0f)).store(resultPtr+x);
+			for(;x<size[0];++x)
+				resultPtr[x]=(prevPtr[x]+rowPtr[x]*2.0f)/3.0f;
+			}
+		else
+			{
+			/* Filter an interior row: */
+			for(;x+4<=size[0];x+=4)
+				((Float4::load(prevPtr+x)+Float4::load(rowPtr+x)*Float4(2.0f)+Float4::load(nextPtr+x))*Float4(0.25f)).store(resultPtr+x);
+			for(;x<size[0];++x)
+				resultPtr[x]=(prevPtr[x]+rowPtr[x]*2.0f+nextPtr[x])*0.25f;
+			}
+		}
+	}
+
+void FrameFilter::rowFilterBand(unsigned int bandIndex,int rowBegin,int rowEnd)
+	{
+	for(int y=rowBegin;y<rowEnd;++y)
+		{
+		const float* rowPtr=spatialFilterBuffer+size_t(y)*size_t(size[0]);
+		float* resultPtr=bandOutputFrame+size_t(y)*size_t(size[0]);
+		
+		/* Filter the first pixel in the row: */
+		resultPtr[0]=(rowPtr[0]*2.0f+rowPtr[1])/3.0f;
+		
+		/* Filter the interior pixels in the row: */
+		unsigned int x=1;
+		for(;x+4<size[0];x+=4)
+			((Float4::load(rowPtr+x-1)+Float4::load(rowPtr+x)*Float4(2.0f)+Float4::load(rowPtr+x+1))*Float4(0.25f)).store(resultPtr+x);
+		for(;x<size[0]-1;++x)
+			resultPtr[x]=(rowPtr[x-1]+rowPtr[x]*2.0f+rowPtr[x+1])*0.25f;
+		
+		/* Filter the last pixel in the row: */
+		resultPtr[x]=(rowPtr[x-1]+rowPtr[x]*2.0f)/3.0f;
+		}
+	}
+
+void FrameFilter::changeBand(unsigned int bandIndex,int tileRowBegin,int tileRowEnd)
+	{
+	for(int tileY=tileRowBegin;tileY<tileRowEnd;++tileY)
+		{
+		unsigned int yBegin=tileY*FilteredFrame::tileSize;
+		unsigned int yEnd=yBegin+FilteredFrame::tileSize<size[1]?yBegin+FilteredFrame::tileSize:size[1];
+		for(unsigned int tileX=0;tileX<numTiles[0];++tileX)
+			{
+			unsigned int xBegin=tileX*FilteredFrame::tileSize;
+			size_t rowSize=(xBegin+FilteredFrame::tileSize<size[0]?FilteredFrame::tileSize:size[0]-xBegin)*sizeof(float);
+			
+			/* Find the first row in which the tile differs from the previous output frame; the first frame changes all tiles: */
+			unsigned int y=yBegin;
+			if(frameStamp>1)
+				for(;y<yEnd&&memcmp(bandOutputFrame+(size_t(y)*size_t(size[0])+xBegin),lastOutputBuffer+(size_t(y)*size_t(size[0])+xBegin),rowSize)==0;++y)
+					;
+			if(y<yEnd)
+				{
+				/* Retain the tile's changed rows for the next comparison and stamp the tile: */
+				for(;y<yEnd;++y)
+					memcpy(lastOutputBuffer+(size_t(y)*size_t(size[0])+xBegin),bandOutputFrame+(size_t(y)*size_t(size[0])+xBegin),rowSize);
+				tileStamps[tileY*numTiles[0]+tileX]=frameStamp;
+				}
+			}
+		}
+	}
+
+void* FrameFilter::filterThreadMethod(void)
+	{
+	unsigned int lastInputFrameVersion=0;
+	
+	while(true)
+		{
+		Kinect::FrameBuffer frame;
+		{
+		Threads::MutexCond::Lock inputLock(inputCond);
+		
+		/* Wait until a new frame arrives or the program shuts down: */
+		while(runFilterThread&&lastInputFrameVersion==inputFrameVersion)
+			inputCond.wait(inputLock);
+		
+		/* Bail out if the program is shutting down: */
+		if(!runFilterThread)
+			break;
+		
+		/* Work on the new frame: */
+		frame=inputFrame;
+		lastInputFrameVersion=inputFrameVersion;
+		}
+		
+		/* Prepare a new output frame: */
+		FilteredFrame& newOutputFrame=outputFrames.startNewValue();
+		bandInputFrame=frame.getData<RawDepth>();
+		bandOutputFrame=newOutputFrame.frame.getData<float>();
+		
+		/* Switch to a new statistics engine if one was requested: */
+		if(statisticsEngine!=requestedStatisticsEngine)
+			{
+			statisticsEngine=requestedStatisticsEngine;
+			initStatistics();
 			}
 		
-		/* Go to the next averaging slot: */
-		if(++averagingSlotIndex==numAveragingSlots)
-			averagingSlotIndex=0U;
+		/* Enter the new frame into the running statistics and calculate the output frame's pixel values in parallel bands: */
+		if(statisticsEngine==AVERAGING_SLOTS)
+			{
+			workerPool.processBands(0,int(size[1]),this,&FrameFilter::slotStatisticsBand);
+			
+			/* Go to the next averaging slot: */
+			if(++averagingSlotIndex==numAveragingSlots)
+				averagingSlotIndex=0U;
+			}
+		else
+			workerPool.processBands(0,int(size[1]),this,&FrameFilter::exponentialStatisticsBand);
 		
 		/* Apply a spatial filter if requested: */
 		if(spatialFilter)
 			{
 			for(int filterPass=0;filterPass<2;++filterPass)
 				{
-				/* Low-pass filter the entire output frame in-place: */
-				for(unsigned int x=0;x<size[0];++x)
-					{
-					/* Get a pointer to the current column: */
-					float* colPtr=newOutputFrame.getData<float>()+x;
-					
-					/* Filter the first pixel in the column: */
-					float lastVal=*colPtr;
-					*colPtr=(colPtr[0]*2.0f+colPtr[size[0]])/3.0f;
-					colPtr+=size[0];
-					
-					/* Filter the interior pixels in the column: */
-					for(unsigned int y=1;y<size[1]-1;++y,colPtr+=size[0])
-						{
-						/* Filter the pixel: */
-						float nextLastVal=*colPtr;
-						*colPtr=(lastVal+colPtr[0]*2.0f+colPtr[size[0]])*0.25f;
-						lastVal=nextLastVal;
-						}
-					
-					/* Filter the last pixel in the column: */
-					*colPtr=(lastVal+colPtr[0]*2.0f)/3.0f;
-					}
-				float* rowPtr=newOutputFrame.getData<float>();
-				for(unsigned int y=0;y<size[1];++y)
-					{
-					/* Filter the first pixel in the row: */
-					float lastVal=*rowPtr;
-					*rowPtr=(rowPtr[0]*2.0f+rowPtr[1])/3.0f;
-					++rowPtr;
-					
-					/* Filter the interior pixels in the row: */
-					for(unsigned int x=1;x<size[0]-1;++x,++rowPtr)
-						{
-						/* Filter the pixel: */
-						float nextLastVal=*rowPtr;
-						*rowPtr=(lastVal+rowPtr[0]*2.0f+rowPtr[1])*0.25f;
-						lastVal=nextLastVal;
-						}
-					
-					/* Filter the last pixel in the row: */
-					*rowPtr=(lastVal+rowPtr[0]*2.0f)/3.0f;
-					++rowPtr;
-					}
+				/* Low-pass filter the entire output frame vertically and then horizontally: */
+				workerPool.processBands(0,int(size[1]),this,&FrameFilter::columnFilterBand);
+				workerPool.processBands(0,int(size[1]),this,&FrameFilter::rowFilterBand);
 				}
 			}
 		
+		/* Find the tiles that changed since the previous output frame and pass their stamps along with the output frame: */
+		++frameStamp;
+		workerPool.processBands(0,int(numTiles[1]),this,&FrameFilter::changeBand);
+		newOutputFrame.frameStamp=frameStamp;
+		newOutputFrame.tileStamps.assign(tileStamps,tileStamps+numTiles[1]*numTiles[0]);
+		
+		/* Continue the most recent input frame's trace in the new output frame: */
+		newOutputFrame.frame.copyTrace(frame);
+		newOutputFrame.frame.stampTrace(LatencyTracker::FILTER);
+		
 		/* Finalize the new output frame in the output buffer: */
 		outputFrames.postNewValue();
 		
@@ -208,10 +610,15 @@ void* FrameFilter::filterThreadMethod(void)
 	return 0;
 	}
 
-FrameFilter::FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingSlots,const FrameFilter::PixelDepthCorrection* sPixelDepthCorrection,const PTransform& depthProjection,const Plane& basePlane)
+FrameFilter::FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingSlots,const FrameFilter::PixelDepthCorrection* sPixelDepthCorrection,const PTransform& depthProjection,const Plane& basePlane,unsigned int numThreads)
 	:pixelDepthCorrection(sPixelDepthCorrection),
 	 averagingBuffer(0),
 	 statBuffer(0),
+	 expStatBuffer(0),
+	 spatialFilterBuffer(0),
+	 lastOutputBuffer(0),frameStamp(0),tileStamps(0),
+	 workerPool(numThreads),
+	 bandInputFrame(0),bandOutputFrame(0),
 	 outputFrameFunction(0)
 	{
 	/* Remember the frame size: */
@@ -224,23 +631,12 @@ FrameFilter::FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingS
 	/* Initialize the valid depth range: */
 	setValidDepthInterval(0U,2046U);
 	
-	/* Initialize the averaging buffer: */
+	/* Initialize the running statistics using averaging slots: */
 	numAveragingSlots=sNumAveragingSlots;
-	averagingBuffer=new RawDepth[numAveragingSlots*size[1]*size[0]];
-	RawDepth* abPtr=averagingBuffer;
-	for(unsigned int i=0;i<numAveragingSlots;++i)
-		for(unsigned int y=0;y<size[1];++y)
-			for(unsigned int x=0;x<size[0];++x,++abPtr)
-				*abPtr=2048U; // Mark sample as invalid
-	averagingSlotIndex=0U;
-	
-	/* Initialize the statistics buffer: */
-	statBuffer=new unsigned int[size[1]*size[0]*3];
-	unsigned int* sbPtr=statBuffer;
-	for(unsigned int y=0;y<size[1];++y)
-		for(unsigned int x=0;x<size[0];++x)
-			for(int i=0;i<3;++i,++sbPtr)
-				*sbPtr=0;
+	expWeight=2.0f/float(numAveragingSlots+1);
+	statisticsEngine=AVERAGING_SLOTS;
+	requestedStatisticsEngine=AVERAGING_SLOTS;
+	initStatistics();
 	
 	/* Initialize the stability criterion: */
 	minNumSamples=(numAveragingSlots+1)/2;
@@ -265,9 +661,23 @@ FrameFilter::FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingS
 		for(unsigned int x=0;x<size[0];++x,++vbPtr)
 			*vbPtr=float(-((double(x)+0.5)*basePlaneDic[0]+(double(y)+0.5)*basePlaneDic[1]+basePlaneDic[3])/basePlaneDic[2]);
 	
+	/* Initialize the spatial filter buffer: */
+	spatialFilterBuffer=new float[size[1]*size[0]];
+	
+	/* Initialize the change detection buffers: */
+	for(int i=0;i<2;++i)
+		numTiles[i]=FilteredFrame::getNumTiles(size[i]);
+	lastOutputBuffer=new float[size[1]*size[0]];
+	tileStamps=new unsigned int[numTiles[1]*numTiles[0]];
+	for(unsigned int i=0;i<numTiles[1]*numTiles[0];++i)
+		tileStamps[i]=0;
+	
 	/* Initialize the output frame buffer: */
 	for(int i=0;i<3;++i)
-		outputFrames.getBuffer(i)=Kinect::FrameBuffer(size[0],size[1],size[1]*size[0]*sizeof(float));
+		{
+		outputFrames.getBuffer(i).frame=Kinect::FrameBuffer(size[0],size[1],size[1]*size[0]*sizeof(float));
+		outputFrames.getBuffer(i).tileStamps.resize(numTiles[1]*numTiles[0],0U);
+		}
 	
 	/* Start the filtering thread: */
 	runFilterThread=true;
@@ -287,7 +697,11 @@ FrameFilter::~FrameFilter(void)
 	/* Release all allocated buffers: */
 	delete[] averagingBuffer;
 	delete[] statBuffer;
+	delete[] expStatBuffer;
 	delete[] validBuffer;
+	delete[] spatialFilterBuffer;
+	delete[] lastOutputBuffer;
+	delete[] tileStamps;
 	delete outputFrameFunction;
 	}
 
@@ -329,6 +743,15 @@ void FrameFilter::setStableParameters(unsigned int newMinNumSamples,unsigned int
 	maxVariance=newMaxVariance;
 	}
 
+void FrameFilter::setStableParameters(unsigned int newMinNumSamples,unsigned int newMaxVariance,FrameFilter::StatisticsEngine newStatisticsEngine)
+	{
+	minNumSamples=newMinNumSamples;
+	maxVariance=newMaxVariance;
+	
+	/* Request the new statistics engine, to be activated by the filtering thread before processing the next frame: */
+	requestedStatisticsEngine=newStatisticsEngine;
+	}
+
 void FrameFilter::setHysteresis(float newHysteresis)
 	{
 	hysteresis=newHysteresis;
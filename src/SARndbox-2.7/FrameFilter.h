@@ -2,7 +2,7 @@
 FrameFilter - Class to filter streams of depth frames arriving from a
 depth camera, with code to detect unstable values in each pixel, and
 fill holes resulting from invalid samples.
-Copyright (c) 2012-2016 Oliver Kreylos
+Copyright (c) 2012-2020 Oliver Kreylos
 
 This file is part of the Augmented Reality Sandbox (SARndbox).
 
@@ -29,8 +29,10 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Threads/TripleBuffer.h>
 #include <Kinect/FrameBuffer.h>
 #include <Kinect/FrameSource.h>
+#include <Kinect/WorkerPool.h>
 
 #include "Types.h"
+#include "FilteredFrame.h"
 
 /* Forward declarations: */
 namespace Misc {
@@ -44,9 +46,15 @@ class FrameFilter
 	public:
 	typedef unsigned short RawDepth; // Data type for raw depth values
 	typedef float FilteredDepth; // Data type for filtered depth values
-	typedef Misc::FunctionCall<const Kinect::FrameBuffer&> OutputFrameFunction; // Type for functions called when a new output frame is ready
+	typedef Misc::FunctionCall<const FilteredFrame&> OutputFrameFunction; // Type for functions called when a new output frame is ready
 	typedef Kinect::FrameSource::DepthCorrection::PixelCorrection PixelDepthCorrection; // Type for per-pixel depth correction factors
 	
+	enum StatisticsEngine // Enumerated type for methods to calculate per-pixel running statistics
+		{
+		AVERAGING_SLOTS, // Exact means and variances over a ring buffer of the most recent numAveragingSlots samples
+		EXPONENTIAL // Exponentially weighted means and variances with an effective window of numAveragingSlots samples
+		};
+	
 	/* Elements: */
 	private:
 	unsigned int size[2]; // Width and height of processed frames
@@ -61,7 +69,11 @@ class FrameFilter
 	unsigned int numAveragingSlots; // Number of slots in each pixel's averaging buffer
 	RawDepth* averagingBuffer; // Buffer to calculate running averages of each pixel's depth value
 	unsigned int averagingSlotIndex; // Index of averaging slot in which to store the next frame's depth values
-	unsigned int* statBuffer; // Buffer retaining the running means and variances of each pixel's depth value
+	unsigned int* statBuffer; // Buffer retaining the running means and variances of each pixel's depth value as three consecutive planes of numbers of valid samples, sums, and sums of squares
+	float* expStatBuffer; // Buffer retaining exponentially weighted statistics as three consecutive planes of numbers of valid samples, means, and variances
+	float expWeight; // Weight of a new sample in exponentially weighted statistics once a pixel has collected enough samples; pixels start out with plain running averages
+	StatisticsEngine statisticsEngine; // Method currently used to calculate running statistics
+	volatile StatisticsEngine requestedStatisticsEngine; // Method to be used to calculate running statistics starting with the next frame
 	unsigned int minNumSamples; // Minimum number of valid samples needed to consider a pixel stable
 	unsigned int maxVariance; // Maximum variance to consider a pixel stable
 	float hysteresis; // Amount by which a new filtered value has to differ from the current value to update
@@ -69,21 +81,44 @@ class FrameFilter
 	float instableValue; // Value to assign to instable pixels if retainValids is false
 	bool spatialFilter; // Flag whether to apply a spatial filter to time-averaged depth values
 	float* validBuffer; // Buffer holding the most recent stable depth value for each pixel
-	Threads::TripleBuffer<Kinect::FrameBuffer> outputFrames; // Triple buffer of output frames
+	float* spatialFilterBuffer; // Buffer holding intermediate results of the separable spatial filter
+	unsigned int numTiles[2]; // Number of tiles covering an output frame in x and y
+	float* lastOutputBuffer; // Buffer holding the pixel values of the most recent output frame to detect changed tiles
+	unsigned int frameStamp; // Sequence number of the most recent output frame
+	unsigned int* tileStamps; // Sequence numbers of the most recent output frames in which each tile changed
+	Kinect::WorkerPool workerPool; // Pool of threads processing bands of frame rows in parallel
+	const RawDepth* bandInputFrame; // Raw depth frame processed by the current band job
+	float* bandOutputFrame; // Output frame written by the current band job
+	Threads::TripleBuffer<FilteredFrame> outputFrames; // Triple buffer of output frames and their tile stamps
 	OutputFrameFunction* outputFrameFunction; // Function called when a new output frame is ready
 	
 	/* Private methods: */
+	void initStatistics(void); // Creates and resets the buffers needed by the current statistics engine and releases all others
+	void slotStatisticsBand(unsigned int bandIndex,int rowBegin,int rowEnd); // Enters a band of the input frame into the averaging buffer and calculates the output frame's pixel values
+	void exponentialStatisticsBand(unsigned int bandIndex,int rowBegin,int rowEnd); // Enters a band of the input frame into the exponentially weighted statistics and calculates the output frame's pixel values
+	void columnFilterBand(unsigned int bandIndex,int rowBegin,int rowEnd); // Low-pass filters a band of the output frame vertically into the spatial filter buffer
+	void rowFilterBand(unsigned int bandIndex,int rowBegin,int rowEnd); // Low-pass filters a band of the spatial filter buffer horizontally back into the output frame
+	void changeBand(unsigned int bandIndex,int tileRowBegin,int tileRowEnd); // Compares a band of tile rows of the output frame against the previous output frame and stamps changed tiles
 	void* filterThreadMethod(void); // Method for the background filtering thread
 	
 	/* Constructors and destructors: */
 	public:
-	FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingSlots,const PixelDepthCorrection* sPixelDepthCorrection,const PTransform& depthProjection,const Plane& basePlane); // Creates a filter for frames of the given size and the given running average length
+	FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingSlots,const PixelDepthCorrection* sPixelDepthCorrection,const PTransform& depthProjection,const Plane& basePlane,unsigned int numThreads =0); // Creates a filter for frames of the given size and the given running average length, processed by the given number of threads (number of CPUs if zero)
 	~FrameFilter(void); // Destroys the frame filter
 	
 	/* Methods: */
+	unsigned int getNumThreads(void) const // Returns the number of threads processing each frame
+		{
+		return workerPool.getNumThreads();
+		}
 	void setValidDepthInterval(unsigned int newMinDepth,unsigned int newMaxDepth); // Sets the interval of depth values considered by the depth image filter
 	void setValidElevationInterval(const PTransform& depthProjection,const Plane& basePlane,double newMinElevation,double newMaxElevation); // Sets the interval of elevations relative to the given base plane considered by the depth image filter
+	StatisticsEngine getStatisticsEngine(void) const // Returns the method used to calculate running statistics
+		{
+		return requestedStatisticsEngine;
+		}
 	void setStableParameters(unsigned int newMinNumSamples,unsigned int newMaxVariance); // Sets the statistical properties to consider a pixel stable
+	void setStableParameters(unsigned int newMinNumSamples,unsigned int newMaxVariance,StatisticsEngine newStatisticsEngine); // Ditto, and selects the method to calculate running statistics; resets statistics if the method changes
 	void setHysteresis(float newHysteresis); // Sets the stable value hysteresis envelope
 	void setRetainValids(bool newRetainValids); // Sets whether the filter retains previous stable values for instable pixels
 	void setInstableValue(float newInstableValue); // Sets the depth value to assign to instable pixels
@@ -94,7 +129,7 @@ class FrameFilter
 		{
 		return outputFrames.lockNewValue();
 		}
-	const Kinect::FrameBuffer& getLockedFrame(void) const // Returns the most recently locked output frame
+	const FilteredFrame& getLockedFrame(void) const // Returns the most recently locked output frame
 		{
 		return outputFrames.getLockedValue();
 		}
@@ -0,0 +1,361 @@
+/***********************************************************************
+FrameFilterBenchmark - Utility to measure the per-frame latency and the
+output stability of the depth frame filter on pre-recorded or synthetic
+depth frames.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <Misc/FunctionCalls.h>
+#include <Threads/MutexCond.h>
+#include <Realtime/Time.h>
+#include <Math/Math.h>
+#include <Kinect/FrameBuffer.h>
+
+#include "Types.h"
+#include "FrameFilter.h"
+#include "BenchmarkHelper.h"
+
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+const int stepHeight=50; // Amount by which the left quarter of synthetic frames is raised, in raw depth units
+
+class FrameReceiver // Class to receive filtered frames and measure their latencies and stability
+	{
+	/* Elements: */
+	public:
+	Threads::MutexCond frameCond; // Condition variable to signal arrival of a filtered frame
+	unsigned int numFrames; // Number of filtered frames received so far
+	Realtime::TimePointMonotonic sendTime; // Time point at which the most recent raw frame was sent to the filter
+	std::vector<double> latencies; // Latencies of all received frames in seconds
+	unsigned int numWarmupFrames; // Number of initial frames that are excluded from stability statistics
+	std::vector<float> lastFrame; // Copy of the previously received filtered frame
+	size_t numChangedPixels; // Total number of pixels that changed between consecutive filtered frames after warm-up
+	double totalChange; // Total absolute change of all pixels between consecutive filtered frames after warm-up
+	unsigned int stepFrame; // Index of the first raw frame in which the left side of a synthetic frame is raised
+	unsigned int stepWidth; // Width of the raised region on the left side of synthetic frames; 0 if there is no step
+	std::vector<float> stepTarget; // Expected filtered frame after the step, i.e., the last filtered frame before the step with the raised region applied
+	std::vector<double> stepConvergence; // Fraction of pixels in the raised region that have converged to their new values, for each frame after the step
+	
+	/* Constructors and destructors: */
+	FrameReceiver(void)
+		:numFrames(0),
+		 numWarmupFrames(0),numChangedPixels(0),totalChange(0.0),
+		 stepFrame(~0U),stepWidth(0)
+		{
+		}
+	
+	/* Methods: */
+	void receiveFilteredFrame(const FilteredFrame& filteredFrame)
+		{
+		Realtime::TimePointMonotonic now;
+		double latency=double(now-sendTime);
+		
+		/* Compare the filtered frame to the previous one: */
+		const Kinect::FrameBuffer& frame=filteredFrame.frame;
+		unsigned int size[2];
+		for(int i=0;i<2;++i)
+			size[i]=(unsigned int)(frame.getSize(i));
+		const float* fPtr=frame.getData<float>();
+		size_t numPixels=size_t(size[1])*size_t(size[0]);
+		if(numFrames>numWarmupFrames&&numFrames<stepFrame)
+			{
+			for(size_t i=0;i<numPixels;++i)
+				if(fPtr[i]!=lastFrame[i])
+					{
+					++numChangedPixels;
+					totalChange+=Math::abs(double(fPtr[i])-double(lastFrame[i]));
+					}
+			}
+		
+		if(stepWidth>0&&numFrames>=stepFrame)
+			{
+			if(numFrames==stepFrame)
+				{
+				/* Calculate the expected filtered frame from the last filtered frame before the step: */
+				stepTarget=lastFrame;
+				for(unsigned int y=0;y<size[1];++y)
+					for(unsigned int x=0;x<stepWidth;++x)
+						stepTarget[y*size[0]+x]-=stepHeight;
+				}
+			
+			/* Count the pixels in the interior of the raised region that are close to their expected values: */
+			size_t numConverged=0;
+			size_t numRegionPixels=0;
+			for(unsigned int y=2;y<size[1]-2;++y)
+				for(unsigned int x=2;x<stepWidth-2;++x,++numRegionPixels)
+					if(Math::abs(fPtr[y*size[0]+x]-stepTarget[y*size[0]+x])<=1.0f)
+						++numConverged;
+			stepConvergence.push_back(double(numConverged)/double(numRegionPixels));
+			}
+		lastFrame.assign(fPtr,fPtr+numPixels);
+		
+		Threads::MutexCond::Lock frameLock(frameCond);
+		latencies.push_back(latency);
+		++numFrames;
+		frameCond.signal();
+		}
+	};
+
+/****************
+Helper functions:
+****************/
+
+Kinect::FrameBuffer createSyntheticFrame(const unsigned int frameSize[2],bool raised) // Creates a synthetic depth frame showing a tilted plane with noise and dropouts, optionally with the left quarter raised
+	{
+	Kinect::FrameBuffer frame=createSyntheticDepthFrame(frameSize,800,200,100,1);
+	if(raised)
+		{
+		/* Raise the valid pixels in the left quarter of the frame: */
+		FrameFilter::RawDepth* rowPtr=frame.getData<FrameFilter::RawDepth>();
+		for(unsigned int y=0;y<frameSize[1];++y,rowPtr+=frameSize[0])
+			for(unsigned int x=0;x<frameSize[0]/4;++x)
+				if(rowPtr[x]!=2047U)
+					rowPtr[x]-=stepHeight;
+		}
+	
+	return frame;
+	}
+
+}
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	const char* frameFilePrefix=0;
+	unsigned int syntheticSize[2]={0,0};
+	unsigned int numThreads=0;
+	unsigned int numAveragingSlots=30;
+	unsigned int minNumSamples=10;
+	unsigned int maxVariance=2;
+	bool spatialFilter=true;
+	unsigned int maxNumFrames=300;
+	unsigned int numBenchmarkFrames=1000;
+	FrameFilter::StatisticsEngine statisticsEngine=FrameFilter::AVERAGING_SLOTS;
+	unsigned int stepFrame=~0U;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"h")==0)
+				{
+				std::cout<<"Usage: FrameFilterBenchmark [option 1] ... [option n] (<frame file prefix> | -synthetic <width> <height>)"<<std::endl;
+				std::cout<<"  Options:"<<std::endl;
+				std::cout<<"  -h"<<std::endl;
+				std::cout<<"     Prints this help message"<<std::endl;
+				std::cout<<"  -synthetic <width> <height>"<<std::endl;
+				std::cout<<"     Filters synthetic noisy depth frames of the given size instead of"<<std::endl;
+				std::cout<<"     pre-recorded frames"<<std::endl;
+				std::cout<<"  -nt <number of threads>"<<std::endl;
+				std::cout<<"     Number of frame filter threads"<<std::endl;
+				std::cout<<"     Default: number of CPUs"<<std::endl;
+				std::cout<<"  -nas <num averaging slots>"<<std::endl;
+				std::cout<<"     Sets the number of averaging slots in the frame filter"<<std::endl;
+				std::cout<<"     Default: "<<numAveragingSlots<<std::endl;
+				std::cout<<"  -sp <min num samples> <max variance>"<<std::endl;
+				std::cout<<"     Sets the frame filter parameters minimum number of valid samples"<<std::endl;
+				std::cout<<"     and maximum sample variance before convergence"<<std::endl;
+				std::cout<<"     Default: "<<minNumSamples<<" "<<maxVariance<<std::endl;
+				std::cout<<"  -ews"<<std::endl;
+				std::cout<<"     Uses exponentially weighted running statistics instead of averaging"<<std::endl;
+				std::cout<<"     slots"<<std::endl;
+				std::cout<<"  -nsf"<<std::endl;
+				std::cout<<"     Disables the spatial filter"<<std::endl;
+				std::cout<<"  -mf <max num frames>"<<std::endl;
+				std::cout<<"     Maximum number of pre-recorded frames to load into memory"<<std::endl;
+				std::cout<<"     Default: "<<maxNumFrames<<std::endl;
+				std::cout<<"  -n <num frames>"<<std::endl;
+				std::cout<<"     Number of frames to filter, cycling through loaded frames"<<std::endl;
+				std::cout<<"     Default: "<<numBenchmarkFrames<<std::endl;
+				std::cout<<"  -step <frame index>"<<std::endl;
+				std::cout<<"     Raises the left quarter of synthetic frames starting at the given"<<std::endl;
+				std::cout<<"     frame, and measures how many frames the filter needs to follow"<<std::endl;
+				std::cout<<"     Default: half the number of frames"<<std::endl;
+				return 0;
+				}
+			else if(strcasecmp(argv[i]+1,"synthetic")==0)
+				{
+				for(int j=0;j<2;++j)
+					{
+					++i;
+					syntheticSize[j]=(unsigned int)(atoi(argv[i]));
+					}
+				}
+			else if(strcasecmp(argv[i]+1,"nt")==0)
+				{
+				++i;
+				numThreads=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"nas")==0)
+				{
+				++i;
+				numAveragingSlots=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"sp")==0)
+				{
+				++i;
+				minNumSamples=(unsigned int)(atoi(argv[i]));
+				++i;
+				maxVariance=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"ews")==0)
+				statisticsEngine=FrameFilter::EXPONENTIAL;
+			else if(strcasecmp(argv[i]+1,"nsf")==0)
+				spatialFilter=false;
+			else if(strcasecmp(argv[i]+1,"mf")==0)
+				{
+				++i;
+				maxNumFrames=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"n")==0)
+				{
+				++i;
+				numBenchmarkFrames=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"step")==0)
+				{
+				++i;
+				stepFrame=(unsigned int)(atoi(argv[i]));
+				}
+			else
+				std::cerr<<"Ignoring unrecognized command line option "<<argv[i]<<std::endl;
+			}
+		else
+			frameFilePrefix=argv[i];
+		}
+	if(frameFilePrefix==0&&(syntheticSize[0]==0||syntheticSize[1]==0))
+		{
+		std::cerr<<"No frame file prefix or synthetic frame size provided; use -h for help"<<std::endl;
+		return 1;
+		}
+	
+	try
+		{
+		unsigned int frameSize[2];
+		std::vector<Kinect::FrameBuffer> frames;
+		std::vector<Kinect::FrameBuffer> raisedFrames;
+		FrameFilter::PixelDepthCorrection* pixelDepthCorrection=0;
+		if(frameFilePrefix!=0)
+			{
+			/* Load the selected pre-recorded depth frames: */
+			loadDepthFrames(frameFilePrefix,maxNumFrames,frameSize,frames,&pixelDepthCorrection);
+			}
+		else
+			{
+			/* Create synthetic depth frames without and with a raised region: */
+			for(int i=0;i<2;++i)
+				frameSize[i]=syntheticSize[i];
+			srand(0);
+			for(unsigned int frameIndex=0;frameIndex<Math::min(maxNumFrames,61U);++frameIndex)
+				{
+				frames.push_back(createSyntheticFrame(frameSize,false));
+				raisedFrames.push_back(createSyntheticFrame(frameSize,true));
+				}
+			if(stepFrame==~0U)
+				stepFrame=numBenchmarkFrames/2;
+			}
+		if(pixelDepthCorrection==0)
+			{
+			/* Create dummy per-pixel depth correction parameters: */
+			pixelDepthCorrection=createDummyPixelDepthCorrection(frameSize);
+			}
+		
+		/* Create a frame filter accepting all depth values: */
+		FrameFilter frameFilter(frameSize,numAveragingSlots,pixelDepthCorrection,PTransform::identity,Plane(Plane::Vector(0,0,1),0),numThreads);
+		frameFilter.setStableParameters(minNumSamples,maxVariance,statisticsEngine);
+		frameFilter.setSpatialFilter(spatialFilter);
+		FrameReceiver receiver;
+		receiver.numWarmupFrames=numAveragingSlots*2;
+		if(!raisedFrames.empty()&&frameSize[0]>=32&&frameSize[1]>=8)
+			{
+			receiver.stepFrame=stepFrame;
+			receiver.stepWidth=frameSize[0]/4;
+			}
+		frameFilter.setOutputFrameFunction(Misc::createFunctionCall(&receiver,&FrameReceiver::receiveFilteredFrame));
+		std::cout<<"Filtering "<<numBenchmarkFrames<<" frames of size "<<frameSize[0]<<" x "<<frameSize[1]<<" using "<<frameFilter.getNumThreads()<<" threads"<<std::endl;
+		
+		/* Send frames to the filter one at a time and wait for each filtered frame: */
+		for(unsigned int frameIndex=0;frameIndex<numBenchmarkFrames;++frameIndex)
+			{
+			Threads::MutexCond::Lock frameLock(receiver.frameCond);
+			receiver.sendTime.set();
+			if(frameIndex>=stepFrame&&!raisedFrames.empty())
+				frameFilter.receiveRawFrame(raisedFrames[frameIndex%raisedFrames.size()]);
+			else
+				frameFilter.receiveRawFrame(frames[frameIndex%frames.size()]);
+			while(receiver.numFrames<=frameIndex)
+				receiver.frameCond.wait(frameLock);
+			}
+		
+		/* Print latency statistics: */
+		std::vector<double> sorted=receiver.latencies;
+		std::sort(sorted.begin(),sorted.end());
+		double latencySum=0.0;
+		for(std::vector<double>::iterator lIt=sorted.begin();lIt!=sorted.end();++lIt)
+			latencySum+=*lIt;
+		std::cout<<std::fixed<<std::setprecision(3);
+		std::cout<<"Mean latency: "<<latencySum*1000.0/double(sorted.size())<<" ms"<<std::endl;
+		std::cout<<"Latency percentiles: min "<<sorted.front()*1000.0<<" ms";
+		std::cout<<", 50% "<<percentile(sorted,0.5)*1000.0<<" ms";
+		std::cout<<", 90% "<<percentile(sorted,0.9)*1000.0<<" ms";
+		std::cout<<", 99% "<<percentile(sorted,0.99)*1000.0<<" ms";
+		std::cout<<", max "<<sorted.back()*1000.0<<" ms"<<std::endl;
+		
+		/* Print output stability statistics: */
+		unsigned int stableEnd=Math::min(numBenchmarkFrames,receiver.stepFrame);
+		if(stableEnd>receiver.numWarmupFrames+1)
+			{
+			double numPixels=double(frameSize[1])*double(frameSize[0]);
+			double numComparisons=double(stableEnd-receiver.numWarmupFrames-1);
+			std::cout<<"Changed pixels per frame after warm-up: "<<double(receiver.numChangedPixels)*100.0/(numPixels*numComparisons)<<"%";
+			std::cout<<", mean absolute change: "<<receiver.totalChange/(numPixels*numComparisons)<<std::endl;
+			}
+		
+		if(!receiver.stepConvergence.empty())
+			{
+			/* Print the number of frames it took for the filter to follow the raised region: */
+			unsigned int numStepFrames;
+			for(numStepFrames=0;numStepFrames<receiver.stepConvergence.size()&&receiver.stepConvergence[numStepFrames]<0.9;++numStepFrames)
+				;
+			if(numStepFrames<receiver.stepConvergence.size())
+				std::cout<<"Step response: 90% of raised pixels converged after "<<numStepFrames+1<<" frames"<<std::endl;
+			else
+				std::cout<<"Step response: raised pixels did not converge within "<<receiver.stepConvergence.size()<<" frames"<<std::endl;
+			}
+		
+		delete[] pixelDepthCorrection;
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"FrameFilterBenchmark: Terminated due to exception "<<err.what()<<std::endl;
+		return 1;
+		}
+	
+	return 0;
+	}
@@ -0,0 +1,263 @@
+/***********************************************************************
+GridRecorder - Class to record time series of bathymetry and water level
+grids into chunked, delta-compressed grid recording files from a
+background thread.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "GridRecorder.h"
+
+#include <string.h>
+#include <stdexcept>
+#include <Misc/SizedTypes.h>
+#include <Misc/MessageLogger.h>
+#include <IO/OpenFile.h>
+#include <Math/Math.h>
+
+#include "WaterTable2.h"
+#include "Sandbox.h"
+
+/*****************************
+Methods of class GridRecorder:
+*****************************/
+
+void GridRecorder::writeFrame(const GridRecorder::GridBuffers& grids)
+	{
+	/* Quantize the new grid pair: */
+	std::swap(quantizedGrids[0],quantizedGrids[1]);
+	GridStreamCodec::Value* quantized=&quantizedGrids[0][0];
+	GridStreamCodec::quantize(numBathymetryValues,grids.bathymetry,elevationRange,quantized);
+	GridStreamCodec::quantize(numGridValues-numBathymetryValues,grids.waterLevel,elevationRange,quantized+numBathymetryValues);
+	
+	/* Start a new chunk with a keyframe if the current chunk is full: */
+	GridStreamCodec::FrameTypes frameType=GridStreamCodec::DELTAFRAME;
+	if(chunks.empty()||chunks.back().numFrames>=chunkSize)
+		{
+		GridRecordingReader::Chunk chunk;
+		chunk.time=grids.time;
+		chunk.offset=file->getWritePos();
+		chunk.numFrames=0;
+		chunks.push_back(chunk);
+		frameType=GridStreamCodec::KEYFRAME;
+		}
+	
+	/* Encode the grid pair against the previous grid pair or its own predecessor values: */
+	code.clear();
+	GridStreamCodec::encode(numGridValues,quantized,frameType==GridStreamCodec::DELTAFRAME?&quantizedGrids[1][0]:0,code);
+	
+	/* Write the frame record: */
+	file->write<Misc::Float64>(grids.time);
+	file->write<Misc::UInt8>(Misc::UInt8(frameType));
+	file->write<Misc::UInt32>(Misc::UInt32(code.size()));
+	if(!code.empty())
+		file->write<GridStreamCodec::Byte>(&code[0],code.size());
+	++chunks.back().numFrames;
+	
+	/* Update the recording statistics: */
+	Threads::MutexCond::Lock queueLock(queueCond);
+	++statistics.numFrames;
+	statistics.numChunks=chunks.size();
+	statistics.numRawBytes+=numGridValues*sizeof(GridStreamCodec::Value);
+	statistics.numWrittenBytes+=GridRecordingReader::frameHeaderSize+code.size();
+	}
+
+void GridRecorder::writeIndex(void)
+	{
+	/* Write the chunk index: */
+	IO::SeekableFile::Offset indexOffset=file->getWritePos();
+	file->write<Misc::UInt32>(Misc::UInt32(chunks.size()));
+	for(std::vector<GridRecordingReader::Chunk>::iterator cIt=chunks.begin();cIt!=chunks.end();++cIt)
+		{
+		file->write<Misc::Float64>(cIt->time);
+		file->write<Misc::UInt64>(Misc::UInt64(cIt->offset));
+		file->write<Misc::UInt32>(Misc::UInt32(cIt->numFrames));
+		}
+	
+	/* Write the trailer pointing to the chunk index: */
+	file->write<Misc::UInt64>(Misc::UInt64(indexOffset));
+	file->write<char>(GridRecordingReader::indexTag,sizeof(GridRecordingReader::indexTag));
+	file->flush();
+	}
+
+void* GridRecorder::writerThreadMethod(void)
+	{
+	try
+		{
+		while(true)
+			{
+			/* Wait for the next queued grid pair, or bail out if the recording was stopped and all queued grids are written: */
+			GridBuffers* grids;
+			{
+			Threads::MutexCond::Lock queueLock(queueCond);
+			while(!stopping&&writeQueue.empty())
+				queueCond.wait(queueLock);
+			if(writeQueue.empty())
+				break;
+			grids=writeQueue.front();
+			writeQueue.pop_front();
+			}
+			
+			/* Write the grid pair and return its buffer to the pool: */
+			writeFrame(*grids);
+			{
+			Threads::MutexCond::Lock queueLock(queueCond);
+			freeBuffers.push_back(grids);
+			}
+			}
+		
+		/* Finish the recording file: */
+		writeIndex();
+		}
+	catch(const std::runtime_error& err)
+		{
+		Misc::formattedConsoleError("GridRecorder: Stopping recording due to exception %s",err.what());
+		}
+	
+	/* Release the recording file and signal that the recording is complete: */
+	file=0;
+	{
+	Threads::MutexCond::Lock queueLock(queueCond);
+	writerDone=true;
+	}
+	
+	return 0;
+	}
+
+void GridRecorder::readBackCallback(GLfloat*,GLfloat*,void* userData)
+	{
+	GridRecorder* thisPtr=static_cast<GridRecorder*>(userData);
+	
+	/* Move the filled grid buffer to the write queue and wake up the writer thread: */
+	Threads::MutexCond::Lock queueLock(thisPtr->queueCond);
+	thisPtr->writeQueue.push_back(thisPtr->requestBuffer);
+	thisPtr->requestBuffer=0;
+	thisPtr->queueCond.signal();
+	}
+
+GridRecorder::GridRecorder(Sandbox* sSandbox,const char* fileName,double sRequestInterval,unsigned int sChunkSize)
+	:sandbox(sSandbox),
+	 file(IO::openSeekableFile(fileName,IO::File::WriteOnly)),
+	 requestInterval(sRequestInterval),startTime(-1.0),nextRequestTime(0.0),
+	 chunkSize(sChunkSize>0?sChunkSize:1U),
+	 requestBuffer(0),stopping(false),writerDone(false)
+	{
+	/* Retrieve the water table's grid size: */
+	for(int i=0;i<2;++i)
+		gridSize[i]=sandbox->waterTable->getSize()[i];
+	numBathymetryValues=size_t(gridSize[1]-1)*size_t(gridSize[0]-1);
+	numGridValues=numBathymetryValues+size_t(gridSize[1])*size_t(gridSize[0]);
+	
+	/* Retrieve the water table's elevation range and add a safety margin: */
+	elevationRange[0]=sandbox->waterTable->getDomain().min[2];
+	elevationRange[1]=sandbox->waterTable->getDomain().max[2];
+	GLfloat margin=(elevationRange[1]-elevationRange[0])*0.05f;
+	elevationRange[0]-=margin;
+	elevationRange[1]+=margin;
+	
+	/* Write the recording file's header: */
+	file->setEndianness(Misc::LittleEndian);
+	file->write<char>(GridRecordingReader::fileId,sizeof(GridRecordingReader::fileId));
+	for(int i=0;i<2;++i)
+		file->write<Misc::SInt32>(Misc::SInt32(gridSize[i]));
+	for(int i=0;i<2;++i)
+		file->write<Misc::Float32>(sandbox->waterTable->getCellSize()[i]);
+	for(int i=0;i<2;++i)
+		file->write<Misc::Float32>(elevationRange[i]);
+	file->write<Misc::UInt32>(Misc::UInt32(chunkSize));
+	
+	/* Allocate the grid buffers and the quantized grid pairs: */
+	for(int i=0;i<4;++i)
+		{
+		gridBuffers[i].init(gridSize);
+		freeBuffers.push_back(&gridBuffers[i]);
+		}
+	for(int i=0;i<2;++i)
+		quantizedGrids[i].resize(numGridValues);
+	memset(&statistics,0,sizeof(Statistics));
+	
+	/* Start the writer thread: */
+	writerThread.start(this,&GridRecorder::writerThreadMethod);
+	}
+
+GridRecorder::~GridRecorder(void)
+	{
+	/* Shut down the writer thread after it has written all queued grids: */
+	stop();
+	writerThread.join();
+	}
+
+void GridRecorder::frame(double applicationTime)
+	{
+	/* Check if it's time to request a new set of grids: */
+	if(applicationTime<nextRequestTime)
+		return;
+	
+	/* Claim a free grid buffer unless a request is still pending: */
+	{
+	Threads::MutexCond::Lock queueLock(queueCond);
+	if(stopping||writerDone||requestBuffer!=0)
+		return;
+	if(freeBuffers.empty())
+		{
+		/* Skip this frame because the writer thread is falling behind: */
+		++statistics.numDroppedFrames;
+		nextRequestTime=(Math::floor(applicationTime/requestInterval)+1.0)*requestInterval;
+		return;
+		}
+	requestBuffer=freeBuffers.front();
+	freeBuffers.pop_front();
+	}
+	
+	/* Request new grids: */
+	if(startTime<0.0)
+		startTime=applicationTime;
+	requestBuffer->time=applicationTime-startTime;
+	if(sandbox->gridRequest.requestGrids(requestBuffer->bathymetry,requestBuffer->waterLevel,&GridRecorder::readBackCallback,this))
+		{
+		/* Push the next request time forward: */
+		nextRequestTime=(Math::floor(applicationTime/requestInterval)+1.0)*requestInterval;
+		}
+	else
+		{
+		/* Return the grid buffer and try again on the next frame: */
+		Threads::MutexCond::Lock queueLock(queueCond);
+		freeBuffers.push_front(requestBuffer);
+		requestBuffer=0;
+		}
+	}
+
+void GridRecorder::stop(void)
+	{
+	/* Tell the writer thread to finish the recording file once all queued grids are written: */
+	Threads::MutexCond::Lock queueLock(queueCond);
+	stopping=true;
+	queueCond.signal();
+	}
+
+bool GridRecorder::isFinished(void) const
+	{
+	Threads::MutexCond::Lock queueLock(queueCond);
+	return writerDone&&requestBuffer==0;
+	}
+
+GridRecorder::Statistics GridRecorder::getStatistics(void) const
+	{
+	Threads::MutexCond::Lock queueLock(queueCond);
+	return statistics;
+	}
@@ -0,0 +1,127 @@
+/***********************************************************************
+GridRecorder - Class to record time series of bathymetry and water level
+grids into chunked, delta-compressed grid recording files from a
+background thread.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef GRIDRECORDER_INCLUDED
+#define GRIDRECORDER_INCLUDED
+
+#include <vector>
+#include <deque>
+#include <Threads/MutexCond.h>
+#include <Threads/Thread.h>
+#include <IO/SeekableFile.h>
+#include <GL/gl.h>
+
+#include "GridStreamCodec.h"
+#include "GridRecordingReader.h"
+
+/* Forward declarations: */
+class Sandbox;
+
+class GridRecorder
+	{
+	/* Embedded classes: */
+	public:
+	struct Statistics // Structure reporting the state of a grid recording
+		{
+		/* Elements: */
+		public:
+		unsigned int numFrames; // Number of frames written to the recording file
+		unsigned int numChunks; // Number of chunks started in the recording file
+		unsigned int numDroppedFrames; // Number of frames skipped because the writer thread fell behind
+		size_t numRawBytes; // Total size of all written grid pairs as quantized 16-bit values
+		size_t numWrittenBytes; // Total number of bytes written to the recording file
+		};
+	
+	private:
+	struct GridBuffers // Structure representing a pair of grids waiting to be written
+		{
+		/* Elements: */
+		public:
+		double time; // Recording time at which the grids were requested
+		GLfloat* bathymetry;
+		GLfloat* waterLevel;
+		
+		/* Constructors and destructors: */
+		GridBuffers(void)
+			:time(0.0),bathymetry(0),waterLevel(0)
+			{
+			}
+		~GridBuffers(void)
+			{
+			delete[] bathymetry;
+			delete[] waterLevel;
+			}
+		
+		/* Methods: */
+		void init(const GLsizei gridSize[2]) // Initializes the grids
+			{
+			bathymetry=new GLfloat[(gridSize[1]-1)*(gridSize[0]-1)];
+			waterLevel=new GLfloat[gridSize[1]*gridSize[0]];
+			}
+		};
+	
+	/* Elements: */
+	Sandbox* sandbox; // Pointer to the sandbox object
+	GLsizei gridSize[2]; // Width and height of the water table's cell-centered quantity grid
+	GLfloat elevationRange[2]; // Elevation range mapped to the quantized value range
+	size_t numBathymetryValues; // Number of values in a vertex-centered bathymetry grid
+	size_t numGridValues; // Total number of values in a pair of bathymetry and water level grids
+	IO::SeekableFilePtr file; // The grid recording file
+	double requestInterval; // Time interval between requests for new bathymetry and water level grids
+	double startTime; // Application time at which the first grids were requested, or negative before the first request
+	double nextRequestTime; // Application time at which to request the next bathymetry and water level grids
+	unsigned int chunkSize; // Maximum number of frames per chunk
+	GridBuffers gridBuffers[4]; // Pool of grid buffers to receive read-back grids and hand them to the writer thread
+	mutable Threads::MutexCond queueCond; // Condition variable to signal arrival of new grids in the write queue
+	std::deque<GridBuffers*> freeBuffers; // Grid buffers available for new read-back requests
+	std::deque<GridBuffers*> writeQueue; // Grid buffers waiting to be written by the writer thread
+	GridBuffers* requestBuffer; // Grid buffer of the currently pending read-back request, or null
+	bool stopping; // Flag to stop requesting grids and shut down the writer thread once the write queue is drained
+	bool writerDone; // Flag whether the writer thread has finished the recording file
+	Statistics statistics; // Current state of the recording; protected by queueCond
+	Threads::Thread writerThread; // Thread quantizing, encoding, and writing grids in the background
+	
+	/* Elements only accessed by the writer thread: */
+	std::vector<GridStreamCodec::Value> quantizedGrids[2]; // Most recent and previous quantized grid pairs
+	std::vector<GridStreamCodec::Byte> code; // Buffer for encoded grid pairs
+	std::vector<GridRecordingReader::Chunk> chunks; // Index of all chunks written so far
+	
+	/* Private methods: */
+	void writeFrame(const GridBuffers& grids); // Quantizes, encodes, and writes the given grid pair
+	void writeIndex(void); // Writes the chunk index and trailer at the end of the recording file
+	void* writerThreadMethod(void); // Method writing queued grids to the recording file in the background
+	static void readBackCallback(GLfloat* bathymetryBuffer,GLfloat* waterLevelBuffer,void* userData); // Callback called when new property grids have been read back from the GPU
+	
+	/* Constructors and destructors: */
+	public:
+	GridRecorder(Sandbox* sSandbox,const char* fileName,double sRequestInterval,unsigned int sChunkSize); // Creates a grid recording file of the given name recording grids at the given time interval, with the given maximum number of frames per chunk
+	~GridRecorder(void); // Finishes the recording file; blocks until all queued grids are written
+	
+	/* Methods: */
+	void frame(double applicationTime); // Called from the AR Sandbox's frame method
+	void stop(void); // Stops requesting new grids and finishes the recording file in the background
+	bool isFinished(void) const; // Returns true if the recording was stopped and the recording file is complete, i.e., if the recorder can be destroyed without blocking
+	Statistics getStatistics(void) const; // Returns the current state of the recording
+	};
+
+#endif
@@ -0,0 +1,260 @@
+/***********************************************************************
+GridRecordingReader - Class to read time series of bathymetry and water
+level grids from chunked, delta-compressed grid recording files.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+/***********************************************************************
+Grid recording files are little-endian binary files starting with a
+32-byte identification string, followed by the water table's width and
+height in cells (2 x SInt32), its cell size (2 x Float32), the elevation
+range mapped to quantized values (2 x Float32), and the maximum number
+of frames per chunk (UInt32). The header is followed by a stream of
+frame records, each consisting of the recording time (Float64), the
+frame type (UInt8), the size of the encoded grid pair (UInt32), and the
+bathymetry and water level grids quantized to 16 bits and encoded by
+GridStreamCodec. Each chunk starts with a keyframe, and all other frames
+in a chunk are delta frames against their predecessors. A properly
+closed file ends with a chunk index containing the number of chunks
+(UInt32) and, per chunk, the time (Float64), file position (UInt64), and
+number of frames (UInt32) of the chunk, followed by the file position of
+the chunk index (UInt64) and an 8-byte tag. The index of a file without
+a valid trailer is reconstructed by scanning its frame records.
+***********************************************************************/
+
+#include "GridRecordingReader.h"
+
+#include <string.h>
+#include <stdexcept>
+#include <Misc/SizedTypes.h>
+#include <Misc/ThrowStdErr.h>
+#include <IO/OpenFile.h>
+
+/*********************************************
+Static elements of class GridRecordingReader:
+*********************************************/
+
+const char GridRecordingReader::fileId[32]="SARndbox grid recording v1.0\n";
+const char GridRecordingReader::indexTag[8]={'G','R','I','D','I','N','D','X'};
+const size_t GridRecordingReader::frameHeaderSize;
+
+/************************************
+Methods of class GridRecordingReader:
+************************************/
+
+bool GridRecordingReader::readFrameHeader(double& time,GridStreamCodec::FrameTypes& frameType,size_t& codeSize)
+	{
+	/* Bail out if there is no complete frame header before the end of the frame data: */
+	IO::SeekableFile::Offset pos=file->getReadPos();
+	if(pos+IO::SeekableFile::Offset(frameHeaderSize)>dataEnd)
+		return false;
+	
+	/* Read and check the frame header: */
+	time=file->read<Misc::Float64>();
+	Misc::UInt8 type=file->read<Misc::UInt8>();
+	codeSize=file->read<Misc::UInt32>();
+	if(type>GridStreamCodec::DELTAFRAME||pos+IO::SeekableFile::Offset(frameHeaderSize+codeSize)>dataEnd)
+		return false;
+	frameType=GridStreamCodec::FrameTypes(type);
+	
+	return true;
+	}
+
+bool GridRecordingReader::readIndex(void)
+	{
+	/* Check for an index trailer at the end of the file: */
+	IO::SeekableFile::Offset headerEnd=file->getReadPos();
+	IO::SeekableFile::Offset fileSize=file->getSize();
+	if(fileSize<headerEnd+IO::SeekableFile::Offset(4+8+sizeof(indexTag)))
+		return false;
+	file->setReadPosAbs(fileSize-IO::SeekableFile::Offset(8+sizeof(indexTag)));
+	IO::SeekableFile::Offset indexOffset=IO::SeekableFile::Offset(file->read<Misc::UInt64>());
+	char tag[sizeof(indexTag)];
+	file->read<char>(tag,sizeof(tag));
+	if(memcmp(tag,indexTag,sizeof(indexTag))!=0||indexOffset<headerEnd||indexOffset+4>fileSize)
+		return false;
+	
+	/* Read the chunk index: */
+	file->setReadPosAbs(indexOffset);
+	unsigned int numChunks=file->read<Misc::UInt32>();
+	if(indexOffset+IO::SeekableFile::Offset(4+size_t(numChunks)*20+8+sizeof(indexTag))!=fileSize)
+		return false;
+	chunks.resize(numChunks);
+	numFrames=0;
+	for(std::vector<Chunk>::iterator cIt=chunks.begin();cIt!=chunks.end();++cIt)
+		{
+		cIt->time=file->read<Misc::Float64>();
+		cIt->offset=IO::SeekableFile::Offset(file->read<Misc::UInt64>());
+		cIt->numFrames=file->read<Misc::UInt32>();
+		numFrames+=cIt->numFrames;
+		}
+	dataEnd=indexOffset;
+	
+	/* Retrieve the time of the last frame by skipping through the last chunk: */
+	endTime=0.0;
+	if(!chunks.empty())
+		{
+		file->setReadPosAbs(chunks.back().offset);
+		for(unsigned int i=0;i<chunks.back().numFrames;++i)
+			{
+			GridStreamCodec::FrameTypes frameType;
+			size_t codeSize;
+			if(!readFrameHeader(endTime,frameType,codeSize))
+				Misc::throwStdErr("GridRecordingReader: Corrupted chunk index");
+			file->skip<GridStreamCodec::Byte>(codeSize);
+			}
+		}
+	
+	return true;
+	}
+
+void GridRecordingReader::scanFrames(void)
+	{
+	/* Read all frame headers up to the end of the file, ignoring a partially written last frame: */
+	dataEnd=file->getSize();
+	chunks.clear();
+	numFrames=0;
+	endTime=0.0;
+	while(true)
+		{
+		IO::SeekableFile::Offset pos=file->getReadPos();
+		double time;
+		GridStreamCodec::FrameTypes frameType;
+		size_t codeSize;
+		if(!readFrameHeader(time,frameType,codeSize))
+			{
+			dataEnd=pos;
+			break;
+			}
+		
+		/* Start a new chunk at each keyframe, and ignore delta frames without a preceding keyframe: */
+		if(frameType==GridStreamCodec::KEYFRAME)
+			{
+			Chunk chunk;
+			chunk.time=time;
+			chunk.offset=pos;
+			chunk.numFrames=0;
+			chunks.push_back(chunk);
+			}
+		if(!chunks.empty())
+			{
+			++chunks.back().numFrames;
+			++numFrames;
+			endTime=time;
+			}
+		file->skip<GridStreamCodec::Byte>(codeSize);
+		}
+	}
+
+GridRecordingReader::GridRecordingReader(const char* fileName)
+	:file(IO::openSeekableFile(fileName)),
+	 numFrames(0),endTime(0.0),
+	 frameTime(0.0),haveFrame(false)
+	{
+	/* Read and check the file header: */
+	file->setEndianness(Misc::LittleEndian);
+	char id[sizeof(fileId)];
+	file->read<char>(id,sizeof(id));
+	if(memcmp(id,fileId,sizeof(fileId))!=0)
+		Misc::throwStdErr("GridRecordingReader: File %s is not a grid recording",fileName);
+	for(int i=0;i<2;++i)
+		gridSize[i]=file->read<Misc::SInt32>();
+	for(int i=0;i<2;++i)
+		cellSize[i]=file->read<Misc::Float32>();
+	for(int i=0;i<2;++i)
+		elevationRange[i]=file->read<Misc::Float32>();
+	chunkSize=file->read<Misc::UInt32>();
+	if(gridSize[0]<2||gridSize[1]<2||elevationRange[0]>=elevationRange[1])
+		Misc::throwStdErr("GridRecordingReader: Invalid header in grid recording %s",fileName);
+	numBathymetryValues=size_t(gridSize[1]-1)*size_t(gridSize[0]-1);
+	numGridValues=numBathymetryValues+size_t(gridSize[1])*size_t(gridSize[0]);
+	values.resize(numGridValues);
+	
+	/* Read the chunk index, or reconstruct it if the recording was not closed properly: */
+	IO::SeekableFile::Offset headerEnd=file->getReadPos();
+	if(!readIndex())
+		{
+		file->setReadPosAbs(headerEnd);
+		scanFrames();
+		}
+	
+	/* Position the file at the first frame: */
+	file->setReadPosAbs(chunks.empty()?headerEnd:chunks.front().offset);
+	}
+
+bool GridRecordingReader::readNextFrame(void)
+	{
+	/* Read the next frame header: */
+	double time;
+	GridStreamCodec::FrameTypes frameType;
+	size_t codeSize;
+	if(!readFrameHeader(time,frameType,codeSize))
+		return false;
+	if(frameType==GridStreamCodec::DELTAFRAME&&!haveFrame)
+		throw std::runtime_error("GridRecordingReader: Delta frame without preceding keyframe");
+	
+	/* Read and decode the frame's grid pair in place: */
+	code.resize(codeSize);
+	if(codeSize>0)
+		file->read<GridStreamCodec::Byte>(&code[0],codeSize);
+	haveFrame=false;
+	GridStreamCodec::decode(numGridValues,codeSize>0?&code[0]:0,codeSize,frameType==GridStreamCodec::DELTAFRAME?&values[0]:0,&values[0]);
+	frameTime=time;
+	haveFrame=true;
+	
+	return true;
+	}
+
+bool GridRecordingReader::seek(double time)
+	{
+	/* Find the last chunk starting at or before the given time: */
+	std::vector<Chunk>::iterator cIt;
+	for(cIt=chunks.end();cIt!=chunks.begin()&&(cIt-1)->time>time;--cIt)
+		;
+	if(cIt==chunks.begin())
+		return false;
+	--cIt;
+	
+	/* Decode the chunk's frames up to the last one recorded at or before the given time: */
+	file->setReadPosAbs(cIt->offset);
+	haveFrame=false;
+	readNextFrame();
+	for(unsigned int i=1;i<cIt->numFrames;++i)
+		{
+		/* Peek at the next frame's time and stop if it is past the given time: */
+		IO::SeekableFile::Offset pos=file->getReadPos();
+		double nextTime=file->read<Misc::Float64>();
+		file->setReadPosAbs(pos);
+		if(nextTime>time)
+			break;
+		readNextFrame();
+		}
+	
+	return true;
+	}
+
+void GridRecordingReader::getBathymetry(float* bathymetryGrid) const
+	{
+	GridStreamCodec::dequantize(numBathymetryValues,&values[0],elevationRange,bathymetryGrid);
+	}
+
+void GridRecordingReader::getWaterLevel(float* waterGrid) const
+	{
+	GridStreamCodec::dequantize(numGridValues-numBathymetryValues,&values[numBathymetryValues],elevationRange,waterGrid);
+	}
@@ -0,0 +1,114 @@
+/***********************************************************************
+GridRecordingReader - Class to read time series of bathymetry and water
+level grids from chunked, delta-compressed grid recording files.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef GRIDRECORDINGREADER_INCLUDED
+#define GRIDRECORDINGREADER_INCLUDED
+
+#include <vector>
+#include <IO/SeekableFile.h>
+
+#include "GridStreamCodec.h"
+
+class GridRecordingReader
+	{
+	/* Embedded classes: */
+	public:
+	struct Chunk // Structure describing a chunk of frames starting with a keyframe
+		{
+		/* Elements: */
+		public:
+		double time; // Recording time of the chunk's keyframe in seconds
+		IO::SeekableFile::Offset offset; // Absolute file position of the chunk's keyframe record
+		unsigned int numFrames; // Number of frames in the chunk, including its keyframe
+		};
+	
+	static const char fileId[32]; // Identification string at the beginning of grid recording files
+	static const char indexTag[8]; // Tag identifying the trailer behind a grid recording file's chunk index
+	static const size_t frameHeaderSize=13; // Size of a frame record's header in bytes
+	
+	/* Elements: */
+	private:
+	IO::SeekableFilePtr file; // The grid recording file
+	int gridSize[2]; // Width and height of the recorded water table's cell-centered grid
+	float cellSize[2]; // Width and height of each water table cell
+	float elevationRange[2]; // Elevation range mapped to the quantized value range
+	unsigned int chunkSize; // Maximum number of frames per chunk requested by the recorder
+	size_t numBathymetryValues; // Number of values in a vertex-centered bathymetry grid
+	size_t numGridValues; // Total number of values in a pair of bathymetry and water level grids
+	IO::SeekableFile::Offset dataEnd; // Absolute file position of the end of the last complete frame record
+	std::vector<Chunk> chunks; // Index of all chunks in the file
+	unsigned int numFrames; // Total number of frames in the file
+	double endTime; // Recording time of the last frame in the file
+	std::vector<GridStreamCodec::Byte> code; // Buffer holding the encoded grid pair of the frame being read
+	std::vector<GridStreamCodec::Value> values; // Quantized grid pair of the most recently read frame
+	double frameTime; // Recording time of the most recently read frame
+	bool haveFrame; // Flag whether the most recently read frame is valid, i.e., whether a delta frame can be applied to it
+	
+	/* Private methods: */
+	bool readFrameHeader(double& time,GridStreamCodec::FrameTypes& frameType,size_t& codeSize); // Reads the header of the frame record at the current read position; returns false at the end of the frame data
+	bool readIndex(void); // Reads the chunk index from the end of the file; returns false if the file has no valid index
+	void scanFrames(void); // Reconstructs the chunk index of a file whose recording was not closed properly by scanning all frame records
+	
+	/* Constructors and destructors: */
+	public:
+	GridRecordingReader(const char* fileName); // Opens the given grid recording file
+	
+	/* Methods: */
+	const int* getGridSize(void) const // Returns the width and height of the recorded water table's cell-centered grid
+		{
+		return gridSize;
+		}
+	const float* getCellSize(void) const // Returns the width and height of each water table cell
+		{
+		return cellSize;
+		}
+	const float* getElevationRange(void) const // Returns the elevation range covered by the quantized grids
+		{
+		return elevationRange;
+		}
+	const std::vector<Chunk>& getChunks(void) const // Returns the chunk index
+		{
+		return chunks;
+		}
+	unsigned int getNumFrames(void) const // Returns the total number of frames in the file
+		{
+		return numFrames;
+		}
+	double getStartTime(void) const // Returns the recording time of the first frame
+		{
+		return chunks.empty()?0.0:chunks.front().time;
+		}
+	double getEndTime(void) const // Returns the recording time of the last frame
+		{
+		return endTime;
+		}
+	bool readNextFrame(void); // Reads the next frame; returns false at the end of the file
+	bool seek(double time); // Reads the last frame recorded at or before the given time; returns false if the time precedes the first frame
+	double getFrameTime(void) const // Returns the recording time of the most recently read frame
+		{
+		return frameTime;
+		}
+	void getBathymetry(float* bathymetryGrid) const; // Writes the most recently read vertex-centered bathymetry grid of grid size minus 1 into the given buffer
+	void getWaterLevel(float* waterGrid) const; // Writes the most recently read cell-centered water surface elevation grid into the given buffer
+	};
+
+#endif
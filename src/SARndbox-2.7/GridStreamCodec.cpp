@@ -0,0 +1,223 @@
+/***********************************************************************
+GridStreamCodec - Class to encode streams of quantized bathymetry and
+water level grids as keyframes or frame-to-frame differences using a
+fast run-length and variable-length integer code.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "GridStreamCodec.h"
+
+#include <stdexcept>
+#include <Misc/Endianness.h>
+
+/**********************************************************************
+Encoded grids are sequences of variable-length unsigned integers, seven
+bits per byte, least significant group first, with the high bit set in
+all but the last byte of each integer. An integer with its lowest bit
+cleared represents a run of (integer>>1) unchanged values; an integer
+with its lowest bit set represents a single changed value whose
+zig-zag-encoded difference minus one is (integer>>1).
+**********************************************************************/
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+inline GridStreamCodec::Byte* writeVarInt(GridStreamCodec::Byte* codePtr,size_t value)
+	{
+	while(value>=0x80U)
+		{
+		*(codePtr++)=GridStreamCodec::Byte(value|0x80U);
+		value>>=7;
+		}
+	*(codePtr++)=GridStreamCodec::Byte(value);
+	return codePtr;
+	}
+
+inline const GridStreamCodec::Byte* readVarInt(const GridStreamCodec::Byte* codePtr,const GridStreamCodec::Byte* codeEnd,size_t& value)
+	{
+	value=0;
+	for(unsigned int shift=0;codePtr!=codeEnd&&shift<sizeof(size_t)*8;shift+=7)
+		{
+		GridStreamCodec::Byte b=*(codePtr++);
+		value|=size_t(b&0x7fU)<<shift;
+		if((b&0x80U)==0x0U)
+			return codePtr;
+		}
+	throw std::runtime_error("GridStreamCodec: Truncated grid code");
+	}
+
+}
+
+/*****************************************
+Static elements of class GridStreamCodec:
+*****************************************/
+
+const Misc::UInt32 GridStreamCodec::endiannessToken;
+const unsigned int GridStreamCodec::protocolVersion;
+
+/*********************************
+Methods of class GridStreamCodec:
+*********************************/
+
+bool GridStreamCodec::parseEndiannessToken(Misc::UInt32 token,bool& swapOnRead,unsigned int& version)
+	{
+	/* Check if the token is in native byte order: */
+	if(token>=endiannessToken&&token<endiannessToken+0x100U)
+		{
+		swapOnRead=false;
+		version=token-endiannessToken+1;
+		return true;
+		}
+	
+	/* Check if the token is in swapped byte order: */
+	Misc::swapEndianness(token);
+	if(token>=endiannessToken&&token<endiannessToken+0x100U)
+		{
+		swapOnRead=true;
+		version=token-endiannessToken+1;
+		return true;
+		}
+	
+	return false;
+	}
+
+void GridStreamCodec::encode(size_t numValues,const GridStreamCodec::Value* values,const GridStreamCodec::Value* reference,std::vector<GridStreamCodec::Byte>& code)
+	{
+	/* Make room for the worst case: */
+	size_t codeStart=code.size();
+	code.resize(codeStart+getMaxCodeSize(numValues));
+	Byte* codePtr=&code[codeStart];
+	
+	size_t runLength=0;
+	Value predicted=0;
+	for(size_t i=0;i<numValues;++i)
+		{
+		/* Predict the value from the reference or the previous value: */
+		if(reference!=0)
+			predicted=reference[i];
+		Value diff=Value(values[i]-predicted);
+		predicted=values[i];
+		
+		if(diff==0U)
+			++runLength;
+		else
+			{
+			/* Write the pending run of unchanged values: */
+			if(runLength!=0)
+				{
+				codePtr=writeVarInt(codePtr,runLength<<1);
+				runLength=0;
+				}
+			
+			/* Write the zig-zag-encoded difference: */
+			unsigned int zz=diff<0x8000U?(unsigned int)(diff)<<1:((0x10000U-(unsigned int)(diff))<<1)-1U;
+			codePtr=writeVarInt(codePtr,(size_t(zz-1U)<<1)|0x1U);
+			}
+		}
+	
+	/* Write the final run of unchanged values: */
+	if(runLength!=0)
+		codePtr=writeVarInt(codePtr,runLength<<1);
+	
+	code.resize(codePtr-&code[0]);
+	}
+
+void GridStreamCodec::decode(size_t numValues,const GridStreamCodec::Byte* code,size_t codeSize,const GridStreamCodec::Value* reference,GridStreamCodec::Value* values)
+	{
+	const Byte* codePtr=code;
+	const Byte* codeEnd=code+codeSize;
+	size_t i=0;
+	Value predicted=0;
+	while(codePtr!=codeEnd)
+		{
+		size_t word;
+		codePtr=readVarInt(codePtr,codeEnd,word);
+		if(word&0x1U)
+			{
+			/* Apply a single difference: */
+			if(i>=numValues)
+				throw std::runtime_error("GridStreamCodec: Grid code exceeds grid size");
+			size_t zz=(word>>1)+1;
+			Value diff=(zz&0x1U)?Value(0x10000U-((zz+1)>>1)):Value(zz>>1);
+			if(reference!=0)
+				predicted=reference[i];
+			values[i]=Value(predicted+diff);
+			predicted=values[i];
+			++i;
+			}
+		else
+			{
+			/* Copy a run of unchanged values: */
+			size_t runLength=word>>1;
+			if(runLength>numValues-i)
+				throw std::runtime_error("GridStreamCodec: Grid code exceeds grid size");
+			if(reference!=0)
+				{
+				if(reference!=values)
+					for(size_t j=0;j<runLength;++j)
+						values[i+j]=reference[i+j];
+				}
+			else
+				{
+				for(size_t j=0;j<runLength;++j)
+					values[i+j]=predicted;
+				}
+			i+=runLength;
+			if(runLength!=0)
+				predicted=values[i-1];
+			}
+		}
+	
+	if(i!=numValues)
+		throw std::runtime_error("GridStreamCodec: Grid code is shorter than grid size");
+	}
+
+void GridStreamCodec::quantize(size_t numValues,const float* elevations,const float elevationRange[2],GridStreamCodec::Value* values)
+	{
+	/* Map the elevation range to the quantized value range, rounding to the nearest value: */
+	float eScale=65535.0f/(elevationRange[1]-elevationRange[0]);
+	float eOffset=0.5f-elevationRange[0]*eScale;
+	const float* ePtr=elevations;
+	const float* eEnd=elevations+numValues;
+	Value* vPtr=values;
+	for(;ePtr!=eEnd;++ePtr,++vPtr)
+		{
+		float se=*ePtr*eScale+eOffset;
+		if(se<=0.0f)
+			*vPtr=0U;
+		else if(se>=65535.0f)
+			*vPtr=65535U;
+		else
+			*vPtr=Value(se);
+		}
+	}
+
+void GridStreamCodec::dequantize(size_t numValues,const GridStreamCodec::Value* values,const float elevationRange[2],float* elevations)
+	{
+	float eScale=(elevationRange[1]-elevationRange[0])/65535.0f;
+	float eOffset=elevationRange[0];
+	const Value* vPtr=values;
+	const Value* vEnd=values+numValues;
+	float* ePtr=elevations;
+	for(;vPtr!=vEnd;++vPtr,++ePtr)
+		*ePtr=float(*vPtr)*eScale+eOffset;
+	}
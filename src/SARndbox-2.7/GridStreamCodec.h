@@ -0,0 +1,61 @@
+/***********************************************************************
+GridStreamCodec - Class to encode streams of quantized bathymetry and
+water level grids as keyframes or frame-to-frame differences using a
+fast run-length and variable-length integer code.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef GRIDSTREAMCODEC_INCLUDED
+#define GRIDSTREAMCODEC_INCLUDED
+
+#include <stddef.h>
+#include <vector>
+#include <Misc/SizedTypes.h>
+
+class GridStreamCodec
+	{
+	/* Embedded classes: */
+	public:
+	typedef Misc::UInt16 Value; // Type for quantized grid values
+	typedef Misc::UInt8 Byte; // Type for encoded data
+	
+	enum FrameTypes // Enumerated type for types of encoded grid frames
+		{
+		KEYFRAME=0, // Frame is encoded independently of all previous frames
+		DELTAFRAME // Frame is encoded as differences to the immediately preceding frame
+		};
+	
+	/* Elements: */
+	static const Misc::UInt32 endiannessToken=0x12345678U; // Endianness token sent by protocol version 1 clients; later versions send the token plus their version minus one
+	static const unsigned int protocolVersion=2; // Highest remote protocol version supported by this codec
+	
+	/* Methods: */
+	static size_t getMaxCodeSize(size_t numValues) // Returns the maximum size of the code encoding the given number of values
+		{
+		/* Each value is encoded in at most three bytes, plus one trailing run: */
+		return numValues*3+sizeof(size_t)*2;
+		}
+	static bool parseEndiannessToken(Misc::UInt32 token,bool& swapOnRead,unsigned int& version); // Extracts byte order and protocol version from an endianness token; returns false if the token is invalid
+	static void encode(size_t numValues,const Value* values,const Value* reference,std::vector<Byte>& code); // Appends the given values to the code buffer, encoded as differences to the given reference values, or to their predecessors if reference is null
+	static void decode(size_t numValues,const Byte* code,size_t codeSize,const Value* reference,Value* values); // Decodes values encoded against the given reference values, or against their predecessors if reference is null; reference and values can be the same array; throws exception on malformed code
+	static void quantize(size_t numValues,const float* elevations,const float elevationRange[2],Value* values); // Quantizes the given elevations to the full range of quantized values, clamping elevations outside the given range
+	static void dequantize(size_t numValues,const Value* values,const float elevationRange[2],float* elevations); // Converts the given quantized values back to elevations in the given range
+	};
+
+#endif
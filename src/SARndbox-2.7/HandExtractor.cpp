@@ -36,34 +36,44 @@ namespace {
 Helper classes:
 **************/
 
-struct Span // Helper structure to extract foreground blobs from a depth image
-	{
-	/* Elements: */
-	public:
-	unsigned int y; // Row index of the span
-	unsigned int start; // Starting column of span
-	unsigned int end; // Ending column of span
-	unsigned int parent; // Span's parent span
-	unsigned int numPixels; // Number of pixels in the span's subtree
-	unsigned int blobId; // Blob ID of a root span
-	};
-
-struct BlobOrigin // Helper structure to store a point on the border of a foreground blob
+class ForegroundSelector // Helper class to select foreground pixels in a depth image
 	{
 	/* Elements: */
+	private:
+	HandExtractor::DepthPixel maxFgDepth; // Maximum depth value for foreground pixels
+	
+	/* Constructors and destructors: */
 	public:
-	bool assigned; // Flag if the blob origin has already been assigned
-	unsigned int x,y; // Coordinates of blob origin in depth frame
-	const unsigned short* biPtr; // Pointer to blob origin in blob ID image
+	ForegroundSelector(HandExtractor::DepthPixel sMaxFgDepth)
+		:maxFgDepth(sMaxFgDepth)
+		{
+		}
+	
+	/* Methods: */
+	bool operator()(unsigned int x,unsigned int y,const HandExtractor::DepthPixel& pixel) const
+		{
+		return pixel<=maxFgDepth;
+		}
 	};
 
-struct Corner // Helper class to store corners in blob images
+class DepthMergeChecker // Helper class to check whether adjacent foreground pixels have similar depths
 	{
 	/* Elements: */
+	private:
+	unsigned int maxDepthDist; // Maximum depth distance between adjacent pixels to belong to the same foreground blob
+	
+	/* Constructors and destructors: */
 	public:
-	int cornerType; // Corner type, +1: finger tip, -1: finger nook
-	unsigned start; // Boundary pixel index at which the corner started
-	int x,y; // Corner position in depth frame
+	DepthMergeChecker(unsigned int sMaxDepthDist)
+		:maxDepthDist(sMaxDepthDist)
+		{
+		}
+	
+	/* Methods: */
+	bool operator()(unsigned int x1,unsigned int y1,const HandExtractor::DepthPixel& pixel1,unsigned int x2,unsigned int y2,const HandExtractor::DepthPixel& pixel2) const
+		{
+		return pixel1+maxDepthDist>=pixel2&&pixel1<=pixel2+maxDepthDist;
+		}
 	};
 
 typedef Math::Interval<float> Interval;
@@ -268,14 +278,16 @@ void* HandExtractor::extractorThreadMethod(void)
 	return 0;
 	}
 
-HandExtractor::HandExtractor(const unsigned int sDepthFrameSize[2],const HandExtractor::PixelDepthCorrection* sPixelDepthCorrection,const PTransform& sDepthProjection)
+HandExtractor::HandExtractor(const unsigned int sDepthFrameSize[2],const HandExtractor::PixelDepthCorrection* sPixelDepthCorrection,const PTransform& sDepthProjection,unsigned int numThreads)
 	:pixelDepthCorrection(sPixelDepthCorrection),depthProjection(sDepthProjection),
 	 inputFrameVersion(0),runExtractorThread(false),
 	 maxFgDepth(0x07ffU-1U),maxDepthDist(1),minBlobSize(1500),maxBlobSize(150000),
+	 workerPool(numThreads),blobLabeler(&workerPool),
 	 blobIdImage(0),
-	 snakeLength(50),snake(0),
+	 snakeLength(50),
 	 maxCornerEnterDist(28),minCenterDist(10),minCornerExitDist(32),
 	 minHandProbability(0.15f),
+	 workspaces(0),bandDepthFrame(0),
 	 handsExtractedFunction(0)
 	{
 	/* Copy the depth frame size: */
@@ -301,8 +313,8 @@ HandExtractor::HandExtractor(const unsigned int sDepthFrameSize[2],const HandExt
 	for(int i=0;i<8;++i)
 		walkOffsets[i]=walkDy[i]*biStride+walkDx[i];
 	
-	/* Initialize the edge walking snake: */
-	setSnakeLength(snakeLength);
+	/* Create one workspace for each thread classifying blobs: */
+	workspaces=new Workspace[workerPool.getNumThreads()];
 	
 	/* Start the hand extraction thread: */
 	runExtractorThread=true;
@@ -320,7 +332,7 @@ HandExtractor::~HandExtractor(void)
 	extractorThread.join();
 	
 	delete[] blobIdImage;
-	delete[] snake;
+	delete[] workspaces;
 	}
 
 void HandExtractor::setMaxFgDepth(DepthPixel newMaxFgDepth)
@@ -341,11 +353,8 @@ void HandExtractor::setBlobSizeRange(unsigned int newMinBlobSize,unsigned int ne
 
 void HandExtractor::setSnakeLength(unsigned int newSnakeLength)
 	{
+	/* Snake arrays are re-allocated by each thread's workspace on the next frame: */
 	snakeLength=newSnakeLength;
-	
-	/* Re-allocate the snake array: */
-	delete[] snake;
-	snake=new EdgePixel[snakeLength];
 	}
 
 void HandExtractor::setCornerDists(int newMaxCornerEnterDist,int newMinCenterDist,int newMinCornerExitDist)
@@ -366,112 +375,31 @@ void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,Han
 		}
 	
 	/* Extract all four-connected foreground blobs from the given depth frame: */
-	std::vector<Span> spans;
-	unsigned int numSpans=0;
-	unsigned int lastRowSpan=0;
-	const DepthPixel* dfRowPtr=depthFrame;
-	for(unsigned int y=0;y<depthFrameSize[1];++y,dfRowPtr+=depthFrameSize[0])
-		{
-		const DepthPixel* dfPtr=dfRowPtr;
-		unsigned int rowSpan=numSpans;
-		unsigned int x=0;
-		while(true)
-			{
-			/* Find the beginning of the next foreground span: */
-			for(;x<depthFrameSize[0]&&*dfPtr>maxFgDepth;++x,++dfPtr)
-				;
-			if(x>=depthFrameSize[0])
-				break;
-			
-			/* Start a new foreground span: */
-			Span newSpan;
-			newSpan.y=y;
-			newSpan.start=x;
-			
-			/* Trace out the current foreground span: */
-			DepthPixel lastDepth=*dfPtr;
-			++x;
-			++dfPtr;
-			for(;x<depthFrameSize[0]&&*dfPtr<=maxFgDepth&&*dfPtr+maxDepthDist>=lastDepth&&*dfPtr<=lastDepth+maxDepthDist;++x,++dfPtr)
-				lastDepth=*dfPtr;
-			
-			/* Finalize and store the new foreground span: */
-			newSpan.end=x;
-			newSpan.parent=numSpans;
-			newSpan.numPixels=newSpan.end-newSpan.start;
-			newSpan.blobId=invalidBlobId;
-			spans.push_back(newSpan);
-			++numSpans;
-			
-			/* Skip any spans from the previous row that were just passed by: */
-			for(;lastRowSpan<rowSpan&&spans[lastRowSpan].end<newSpan.start;++lastRowSpan)
-				;
-			
-			/* Check if the current span links up with any from the previous row: */
-			for(unsigned int lrs=lastRowSpan;lrs<rowSpan&&spans[lrs].start<=newSpan.end;++lrs)
-				{
-				/* Check if the two spans have depth in common: */
-				unsigned int o1=Misc::max(newSpan.start,spans[lrs].start);
-				unsigned int o2=Misc::min(newSpan.end,spans[lrs].end);
-				const DepthPixel* lrsPtr1=dfRowPtr+o1;
-				const DepthPixel* lrsPtr0=lrsPtr1-depthFrameSize[0];
-				bool canLink=false;
-				for(unsigned int o=o1;o<o2&&!canLink;++o,++lrsPtr0,++lrsPtr1)
-					canLink=*lrsPtr0+maxDepthDist>=*lrsPtr1&&*lrsPtr0<=*lrsPtr1+maxDepthDist;
-				
-				/* Merge the two spans if they can link: */
-				if(canLink)
-					{
-					/* Find the roots of the two spans' respective subtrees: */
-					unsigned int root1=lrs;
-					while(root1!=spans[root1].parent)
-						root1=spans[root1].parent;
-					unsigned int root2=numSpans-1;
-					while(root2!=spans[root2].parent)
-						root2=spans[root2].parent;
-					
-					if(root1<root2)
-						{
-						/* Make the first span the new root: */
-						spans[root2].parent=root1;
-						spans[root1].numPixels+=spans[root2].numPixels;
-						}
-					else if(root1>root2)
-						{
-						/* Make the second span the new root: */
-						spans[root1].parent=root2;
-						spans[root2].numPixels+=spans[root1].numPixels;
-						}
-					}
-				}
-			}
-		
-		/* Skip any leftover spans from the previous row: */
-		lastRowSpan=rowSpan;
-		}
+	blobLabeler.labelBlobs(depthFrameSize,depthFrame,ForegroundSelector(maxFgDepth),DepthMergeChecker(maxDepthDist),BlobLabeler::Creator());
+	unsigned int numSpans=(unsigned int)(blobLabeler.getNumSpans());
 	
-	/* Assign consecutive blob IDs to all root spans: */
+	/* Assign consecutive blob IDs to all root spans whose blobs are hand candidates: */
+	spanBlobIds.resize(numSpans);
 	unsigned int nextBlobId=0;
 	for(unsigned int i=0;i<numSpans;++i)
 		{
+		const BlobLabeler::Span& span=blobLabeler.getSpan(i);
+		
 		/* Check if the span is a root span: */
-		if(spans[i].parent==i)
+		if(span.parent==i)
 			{
-			if(spans[i].numPixels>=minBlobSize&&spans[i].numPixels<=maxBlobSize)
+			if(span.numPixels>=minBlobSize&&span.numPixels<=maxBlobSize)
 				{
-				spans[i].blobId=nextBlobId;
+				spanBlobIds[i]=nextBlobId;
 				++nextBlobId;
 				}
+			else
+				spanBlobIds[i]=invalidBlobId;
 			}
 		else
 			{
-			/* Find the root of the span's subtree: */
-			unsigned int root=spans[i].parent;
-			while(root!=spans[root].parent)
-				root=spans[root].parent;
-			
-			/* Assign the span's blob ID from the root: */
-			spans[i].blobId=spans[root].blobId;
+			/* Assign the span's blob ID from its root, which always precedes it: */
+			spanBlobIds[i]=spanBlobIds[span.parent];
 			}
 		}
 	
@@ -502,24 +430,20 @@ void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,Han
 	
 	for(unsigned int i=0;i<numSpans;++i)
 		{
-		/* Find the span's root: */
-		int root=i;
-		while(spans[root].parent!=root)
-			root=spans[root].parent;
-		
-		if(spans[root].blobId!=invalidBlobId)
+		const BlobLabeler::Span& span=blobLabeler.getSpan(i);
+		if(spanBlobIds[i]!=invalidBlobId)
 			{
 			/* Fill in the span: */
-			Images::RGBImage::Color* cPtr=result.modifyPixelRow(spans[i].y)+spans[i].start;
-			for(int x=spans[i].start;x<spans[i].end;++x,++cPtr)
-				*cPtr=blobColors[spans[root].blobId%18];
+			Images::RGBImage::Color* cPtr=result.modifyPixelRow(span.y)+span.x1;
+			for(unsigned int x=span.x1;x<span.x2;++x,++cPtr)
+				*cPtr=blobColors[spanBlobIds[i]%18];
 			}
 		}
 	
 	#endif
 	
 	/* Create an array of blob origin points: */
-	BlobOrigin* blobOrigins=new BlobOrigin[nextBlobId];
+	blobOrigins.resize(nextBlobId);
 	for(unsigned int i=0;i<nextBlobId;++i)
 		blobOrigins[i].assigned=false;
 	
@@ -535,8 +459,8 @@ void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,Han
 			{
 			/* Find the start of the next span in the current row: */
 			unsigned int nextSpanStart=depthFrameSize[0];
-			if(spanIndex<numSpans&&spans[spanIndex].y==y)
-				nextSpanStart=spans[spanIndex].start;
+			if(spanIndex<numSpans&&blobLabeler.getSpan(spanIndex).y==y)
+				nextSpanStart=blobLabeler.getSpan(spanIndex).x1;
 			
 			/* Assign the invalid blob IDs until the start of the next span: */
 			for(;x<nextSpanStart;++x,++biPtr)
@@ -547,7 +471,7 @@ void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,Han
 				break;
 			
 			/* Check if the current span's blob is valid, and encountered for the first time: */
-			unsigned int blobId=spans[spanIndex].blobId;
+			unsigned int blobId=spanBlobIds[spanIndex];
 			if(blobId<nextBlobId&&!blobOrigins[blobId].assigned)
 				{
 				/* Store the beginning of the current span as the blob's origin: */
@@ -558,7 +482,7 @@ void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,Han
 				}
 			
 			/* Assign the current span's blob ID: */
-			for(;x<spans[spanIndex].end;++x,++biPtr)
+			for(unsigned int spanEnd=blobLabeler.getSpan(spanIndex).x2;x<spanEnd;++x,++biPtr)
 				*biPtr=blobId;
 			
 			/* Go to the next span: */
@@ -566,324 +490,350 @@ void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,Han
 			}
 		}
 	
-	/* Initialize the result list: */
-	hands.clear();
-	
 	/* Walk around the edges of all foreground blobs in counter-clockwise order and decide whether they are hand-shaped: */
+	blobResults.resize(nextBlobId);
+	if(imgPtr!=0)
+		{
+		/* Classify all blobs in the calling thread so that they can be drawn into the result image: */
+		for(unsigned int blobId=0;blobId<nextBlobId;++blobId)
+			blobResults[blobId].isHand=classifyBlob(depthFrame,blobId,workspaces[0],blobImage,imgPtr,blobResults[blobId].hand);
+		}
+	else
+		{
+		/* Classify blobs in parallel: */
+		bandDepthFrame=depthFrame;
+		workerPool.processBands(0,int(nextBlobId),this,&HandExtractor::classifyBlobBand);
+		}
+	
+	/* Collect all hands in order of their blob IDs: */
+	hands.clear();
+	for(unsigned int blobId=0;blobId<nextBlobId;++blobId)
+		if(blobResults[blobId].isHand)
+			hands.push_back(blobResults[blobId].hand);
+	}
+
+bool HandExtractor::classifyBlob(const HandExtractor::DepthPixel* depthFrame,unsigned int blobId,HandExtractor::Workspace& ws,Images::RGBImage* blobImage,Images::RGBImage::Color* imgPtr,HandExtractor::Hand& hand)
+	{
+	/* Prepare the thread's workspace: */
+	if(ws.snake.size()!=snakeLength)
+		ws.snake.resize(snakeLength);
+	EdgePixel* snake=&ws.snake[0];
 	EdgePixel* snakeEnd=snake+snakeLength;
+	std::vector<Corner>& corners=ws.corners;
+	corners.clear();
 	int enterDist2=Math::sqr(maxCornerEnterDist);
 	int centerDist2=Math::sqr(minCenterDist);
 	int exitDist2=Math::sqr(minCornerExitDist);
-	std::vector<Corner> corners;
-	corners.reserve(10);
-	for(unsigned int blobId=0;blobId<nextBlobId;++blobId)
+	
+	/* Initialize the edge-walking snake: */
+	EdgePixel* snakeHead=snake;
+	snakeHead->x=int(blobOrigins[blobId].x);
+	snakeHead->y=int(blobOrigins[blobId].y);
+	snakeHead->biPtr=blobOrigins[blobId].biPtr;
+	unsigned int walkDir=0; // The blob origin is the bottom-left pixel of the blob, so 0 is the correct initial walking direction
+	for(unsigned int i=1;i<snakeLength;++i)
 		{
-		/* Initialize the edge-walking snake: */
-		EdgePixel* snakeHead=snake;
-		snakeHead->x=int(blobOrigins[blobId].x);
-		snakeHead->y=int(blobOrigins[blobId].y);
-		snakeHead->biPtr=blobOrigins[blobId].biPtr;
-		unsigned int walkDir=0; // The blob origin is the bottom-left pixel of the blob, so 0 is the correct initial walking direction
-		for(unsigned int i=1;i<snakeLength;++i)
-			{
-			/* Turn 90 degrees clockwise: */
-			walkDir=(walkDir+6)&0x7U;
-			
-			/* Turn counter-clockwise until the next step stays in the same blob: */
-			while(snakeHead->biPtr[walkOffsets[walkDir]]!=blobId)
-				walkDir=(walkDir+1)&0x7U;
-			
-			/* Walk one step along the blob edge: */
-			snakeHead[1].x=snakeHead->x+walkDx[walkDir];
-			snakeHead[1].y=snakeHead->y+walkDy[walkDir];
-			snakeHead[1].biPtr=snakeHead->biPtr+walkOffsets[walkDir];
-			
-			/* Move the snake head forward: */
-			++snakeHead;
-			}
-		EdgePixel* snakeTail=snake;
-		EdgePixel* snakeMid=snake+snakeLength/2;
+		/* Turn 90 degrees clockwise: */
+		walkDir=(walkDir+6)&0x7U;
 		
-		/* Walk the snake exactly once around the blob: */
-		Corner corner;
-		corner.cornerType=0;
-		int cornerDist2=0;
-		unsigned int pixelIndex=0;
-		int firstCornerDist2=0;
-		unsigned int firstCornerStart=0;
-		do
+		/* Turn counter-clockwise until the next step stays in the same blob: */
+		while(snakeHead->biPtr[walkOffsets[walkDir]]!=blobId)
+			walkDir=(walkDir+1)&0x7U;
+		
+		/* Walk one step along the blob edge: */
+		snakeHead[1].x=snakeHead->x+walkDx[walkDir];
+		snakeHead[1].y=snakeHead->y+walkDy[walkDir];
+		snakeHead[1].biPtr=snakeHead->biPtr+walkOffsets[walkDir];
+		
+		/* Move the snake head forward: */
+		++snakeHead;
+		}
+	EdgePixel* snakeTail=snake;
+	EdgePixel* snakeMid=snake+snakeLength/2;
+	
+	/* Walk the snake exactly once around the blob: */
+	Corner corner;
+	corner.cornerType=0;
+	int cornerDist2=0;
+	unsigned int pixelIndex=0;
+	int firstCornerDist2=0;
+	unsigned int firstCornerStart=0;
+	do
+		{
+		/* Check if the current snake sits on a corner: */
+		int newCornerType=0;
+		int headTailDist2=Math::sqr(snakeHead->x-snakeTail->x)+Math::sqr(snakeHead->y-snakeTail->y);
+		int centerElevation2=0;
+		if(headTailDist2<=enterDist2)
 			{
-			/* Check if the current snake sits on a corner: */
-			int newCornerType=0;
-			int headTailDist2=Math::sqr(snakeHead->x-snakeTail->x)+Math::sqr(snakeHead->y-snakeTail->y);
-			int centerElevation2=0;
-			if(headTailDist2<=enterDist2)
+			/* Determine the type of corner by comparing the snake's center point against the line defined by its head and tail: */
+			int nx=snakeTail->y-snakeHead->y;
+			int ny=snakeHead->x-snakeTail->x;
+			int d=nx*(snakeMid->x-snakeTail->x)+ny*(snakeMid->y-snakeTail->y);
+			if(Math::sqr(d)>=centerDist2*headTailDist2)
 				{
-				/* Determine the type of corner by comparing the snake's center point against the line defined by its head and tail: */
-				int nx=snakeTail->y-snakeHead->y;
-				int ny=snakeHead->x-snakeTail->x;
-				int d=nx*(snakeMid->x-snakeTail->x)+ny*(snakeMid->y-snakeTail->y);
-				if(Math::sqr(d)>=centerDist2*headTailDist2)
-					{
-					/* Enter corner state: */
-					if(d<0)
-						newCornerType=1; // Finger tip
-					else
-						newCornerType=-1; // Finger nook
-					if(headTailDist2>0)
-						centerElevation2=Math::sqr(d)/headTailDist2;
-					else
-						centerElevation2=Math::sqr(snakeMid->x-snakeTail->x)+Math::sqr(snakeMid->y-snakeTail->y);
-					}
+				/* Enter corner state: */
+				if(d<0)
+					newCornerType=1; // Finger tip
+				else
+					newCornerType=-1; // Finger nook
+				if(headTailDist2>0)
+					centerElevation2=Math::sqr(d)/headTailDist2;
+				else
+					centerElevation2=Math::sqr(snakeMid->x-snakeTail->x)+Math::sqr(snakeMid->y-snakeTail->y);
 				}
-			
-			/* Check if the snake changed corner type since the last step: */
-			if(corner.cornerType!=newCornerType)
+			}
+		
+		/* Check if the snake changed corner type since the last step: */
+		if(corner.cornerType!=newCornerType)
+			{
+			if(corner.cornerType!=0)
 				{
-				if(corner.cornerType!=0)
-					{
-					/* If the previous corner is the first, remember its corner distance: */
-					if(corners.empty())
-						firstCornerDist2=cornerDist2;
-					
-					/* Store the previous corner: */
-					corners.push_back(corner);
-					}
+				/* If the previous corner is the first, remember its corner distance: */
+				if(corners.empty())
+					firstCornerDist2=cornerDist2;
 				
-				if(newCornerType!=0)
-					{
-					/* Start a new corner: */
-					corner.start=pixelIndex;
-					corner.x=snakeMid->x;
-					corner.y=snakeMid->y;
-					cornerDist2=centerElevation2;
-					
-					/* If this is the first corner, remember its starting pixel: */
-					if(corners.empty())
-						firstCornerStart=pixelIndex;
-					}
-				
-				/* Change the type of the current corner: */
-				corner.cornerType=newCornerType;
+				/* Store the previous corner: */
+				corners.push_back(corner);
 				}
-			else if(corner.cornerType!=0&&cornerDist2<centerElevation2)
+			
+			if(newCornerType!=0)
 				{
-				/* Update the current corner: */
+				/* Start a new corner: */
+				corner.start=pixelIndex;
 				corner.x=snakeMid->x;
 				corner.y=snakeMid->y;
 				cornerDist2=centerElevation2;
+				
+				/* If this is the first corner, remember its starting pixel: */
+				if(corners.empty())
+					firstCornerStart=pixelIndex;
 				}
 			
-			if(imgPtr!=0)
-				{
-				/* Draw the snake's center point: */
-				Images::RGBImage::Color* cPtr=imgPtr+(snakeMid->y*depthFrameSize[0]+snakeMid->x);
-				if(corner.cornerType==1)
-					*cPtr=Images::RGBImage::Color(96,160,96);
-				else if(corner.cornerType==-1)
-					*cPtr=Images::RGBImage::Color(160,96,160);
-				else
-					{
-					#if 1
-					*cPtr=Images::RGBImage::Color(128,128,128);
-					#else
-					for(int i=0;i<3;++i)
-						(*cPtr)[i]=(*cPtr)[i]+(255U-(*cPtr)[i])/2;
-					#endif
-					}
-				}
-			
-			/* Walk one step along the blob edge: */
-			walkDir=(walkDir+6)&0x7U; // Turn 90 degrees counter-clockwise
-			while(snakeHead->biPtr[walkOffsets[walkDir]]!=blobId)
-				walkDir=(walkDir+1)&0x7U;
-			snakeTail->x=snakeHead->x+walkDx[walkDir];
-			snakeTail->y=snakeHead->y+walkDy[walkDir];
-			snakeTail->biPtr=snakeHead->biPtr+walkOffsets[walkDir];
-			
-			/* Move the snake head forward: */
-			snakeHead=snakeTail;
-			if(++snakeMid==snakeEnd)
-				snakeMid=snake;
-			if(++snakeTail==snakeEnd)
-				snakeTail=snake;
-			
-			++pixelIndex;
+			/* Change the type of the current corner: */
+			corner.cornerType=newCornerType;
+			}
+		else if(corner.cornerType!=0&&cornerDist2<centerElevation2)
+			{
+			/* Update the current corner: */
+			corner.x=snakeMid->x;
+			corner.y=snakeMid->y;
+			cornerDist2=centerElevation2;
 			}
-		while(snakeTail->biPtr!=blobOrigins[blobId].biPtr);
 		
-		if(corner.cornerType!=0)
+		if(imgPtr!=0)
 			{
-			if(!corners.empty()&&firstCornerStart==0&&corners.front().cornerType==corner.cornerType)
-				{
-				/* Merge the first and last corners: */
-				if(firstCornerDist2<cornerDist2)
-					{
-					corners.front().x=corner.x;
-					corners.front().y=corner.y;
-					}
-				}
+			/* Draw the snake's center point: */
+			Images::RGBImage::Color* cPtr=imgPtr+(snakeMid->y*depthFrameSize[0]+snakeMid->x);
+			if(corner.cornerType==1)
+				*cPtr=Images::RGBImage::Color(96,160,96);
+			else if(corner.cornerType==-1)
+				*cPtr=Images::RGBImage::Color(160,96,160);
 			else
 				{
-				/* Store the last corner: */
-				corners.push_back(corner);
+				#if 1
+				*cPtr=Images::RGBImage::Color(128,128,128);
+				#else
+				for(int i=0;i<3;++i)
+					(*cPtr)[i]=(*cPtr)[i]+(255U-(*cPtr)[i])/2;
+				#endif
 				}
 			}
 		
-		if(imgPtr!=0)
+		/* Walk one step along the blob edge: */
+		walkDir=(walkDir+6)&0x7U; // Turn 90 degrees counter-clockwise
+		while(snakeHead->biPtr[walkOffsets[walkDir]]!=blobId)
+			walkDir=(walkDir+1)&0x7U;
+		snakeTail->x=snakeHead->x+walkDx[walkDir];
+		snakeTail->y=snakeHead->y+walkDy[walkDir];
+		snakeTail->biPtr=snakeHead->biPtr+walkOffsets[walkDir];
+		
+		/* Move the snake head forward: */
+		snakeHead=snakeTail;
+		if(++snakeMid==snakeEnd)
+			snakeMid=snake;
+		if(++snakeTail==snakeEnd)
+			snakeTail=snake;
+		
+		++pixelIndex;
+		}
+	while(snakeTail->biPtr!=blobOrigins[blobId].biPtr);
+	
+	if(corner.cornerType!=0)
+		{
+		if(!corners.empty()&&firstCornerStart==0&&corners.front().cornerType==corner.cornerType)
 			{
-			/* Draw all corners: */
-			for(std::vector<Corner>::iterator cIt=corners.begin();cIt!=corners.end();++cIt)
+			/* Merge the first and last corners: */
+			if(firstCornerDist2<cornerDist2)
 				{
-				Images::RGBImage::Color* cPtr=imgPtr+(cIt->y*depthFrameSize[0]+cIt->x);
-				if(cIt->cornerType==1)
-					*cPtr=Images::RGBImage::Color(0,255,0);
-				else if(cIt->cornerType==-1)
-					*cPtr=Images::RGBImage::Color(255,0,255);
+				corners.front().x=corner.x;
+				corners.front().y=corner.y;
 				}
 			}
-		
-		/* Check if the extracted set of corners matches a hand model: */
-		float maxProb=minHandProbability;
-		Point2 center=Point2::origin; // Hand center point
-		float depth=0.0f; // Hand's average depth value
-		float radius=0.0f; // Hand radius
-		size_t numCorners=corners.size();
-		if(numCorners>=8) // At least four finger tips, three nooks, and a thumb tip (thumb nook optional)
+		else
+			{
+			/* Store the last corner: */
+			corners.push_back(corner);
+			}
+		}
+	
+	if(imgPtr!=0)
+		{
+		/* Draw all corners: */
+		for(std::vector<Corner>::iterator cIt=corners.begin();cIt!=corners.end();++cIt)
 			{
-			for(size_t i=0;i<numCorners;++i)
+			Images::RGBImage::Color* cPtr=imgPtr+(cIt->y*depthFrameSize[0]+cIt->x);
+			if(cIt->cornerType==1)
+				*cPtr=Images::RGBImage::Color(0,255,0);
+			else if(cIt->cornerType==-1)
+				*cPtr=Images::RGBImage::Color(255,0,255);
+			}
+		}
+	
+	/* Check if the extracted set of corners matches a hand model: */
+	float maxProb=minHandProbability;
+	Point2 center=Point2::origin; // Hand center point
+	float depth=0.0f; // Hand's average depth value
+	float radius=0.0f; // Hand radius
+	size_t numCorners=corners.size();
+	if(numCorners>=8) // At least four finger tips, three nooks, and a thumb tip (thumb nook optional)
+		{
+		for(size_t i=0;i<numCorners;++i)
+			{
+			/* Check if the current corner starts a sequence of four tips interleaved with three nooks: */
+			Corner& t0=corners[i];
+			Corner& n1=corners[(i+1)%numCorners];
+			Corner& t1=corners[(i+2)%numCorners];
+			Corner& n2=corners[(i+3)%numCorners];
+			Corner& t2=corners[(i+4)%numCorners];
+			Corner& n3=corners[(i+5)%numCorners];
+			Corner& t3=corners[(i+6)%numCorners];
+			if(t0.cornerType==1&&
+			   n1.cornerType==-1&&t1.cornerType==1&&
+			   n2.cornerType==-1&&t2.cornerType==1&&
+			   n3.cornerType==-1&&t3.cornerType==1)
 				{
-				/* Check if the current corner starts a sequence of four tips interleaved with three nooks: */
-				Corner& t0=corners[i];
-				Corner& n1=corners[(i+1)%numCorners];
-				Corner& t1=corners[(i+2)%numCorners];
-				Corner& n2=corners[(i+3)%numCorners];
-				Corner& t2=corners[(i+4)%numCorners];
-				Corner& n3=corners[(i+5)%numCorners];
-				Corner& t3=corners[(i+6)%numCorners];
-				if(t0.cornerType==1&&
-				   n1.cornerType==-1&&t1.cornerType==1&&
-				   n2.cornerType==-1&&t2.cornerType==1&&
-				   n3.cornerType==-1&&t3.cornerType==1)
+				/* Construct a hand model: */
+				Point2 tp0(float(t0.x)+0.5f,float(t0.y)+0.5f);
+				Point2 np1(float(n1.x)+0.5f,float(n1.y)+0.5f);
+				Point2 tp1(float(t1.x)+0.5f,float(t1.y)+0.5f);
+				Point2 np2(float(n2.x)+0.5f,float(n2.y)+0.5f);
+				Point2 tp2(float(t2.x)+0.5f,float(t2.y)+0.5f);
+				Point2 np3(float(n3.x)+0.5f,float(n3.y)+0.5f);
+				Point2 tp3(float(t3.x)+0.5f,float(t3.y)+0.5f);
+				
+				/* Calculate the range of finger tip distances: */
+				Interval tipDistance(Geometry::dist(tp0,tp1));
+				tipDistance.addValue(Geometry::dist(tp1,tp2));
+				tipDistance.addValue(Geometry::dist(tp2,tp3));
+				
+				/* Calculate the range of finger nook distances: */
+				Interval nookDistance(Geometry::dist(np1,np2));
+				nookDistance.addValue(Geometry::dist(np2,np3));
+				
+				/* Calculate finger root points: */
+				Vector2 curve=Geometry::mid(np1,np3)-np2;
+				Point2 rp0=np1+(np1-np2)*0.5f+curve;
+				Point2 rp1=Geometry::mid(np1,np2);
+				Point2 rp2=Geometry::mid(np2,np3);
+				Point2 rp3=np3+(np3-np2)*0.5f+curve;
+				
+				/* Calculate the range of finger lengths: */
+				Interval fingerLength(Geometry::dist(tp0,rp0));
+				fingerLength.addValue(Geometry::dist(tp1,rp1));
+				fingerLength.addValue(Geometry::dist(tp2,rp2));
+				fingerLength.addValue(Geometry::dist(tp3,rp3));
+				
+				/* Calculate the probability that this is a hand: */
+				float prob=1.0f;
+				prob*=Math::sqr(tipDistance.getMin()/tipDistance.getMax());
+				prob*=nookDistance.getMin()/nookDistance.getMax();
+				prob*=fingerLength.getMin()/fingerLength.getMax();
+				
+				if(maxProb<prob)
 					{
-					/* Construct a hand model: */
-					Point2 tp0(float(t0.x)+0.5f,float(t0.y)+0.5f);
-					Point2 np1(float(n1.x)+0.5f,float(n1.y)+0.5f);
-					Point2 tp1(float(t1.x)+0.5f,float(t1.y)+0.5f);
-					Point2 np2(float(n2.x)+0.5f,float(n2.y)+0.5f);
-					Point2 tp2(float(t2.x)+0.5f,float(t2.y)+0.5f);
-					Point2 np3(float(n3.x)+0.5f,float(n3.y)+0.5f);
-					Point2 tp3(float(t3.x)+0.5f,float(t3.y)+0.5f);
+					/* Calculate finger length to nook distance ratio: */
+					float fdNdRatio=Math::mid(Geometry::dist(tp1,rp1),Geometry::dist(tp2,rp2))/Math::mid(Geometry::dist(np1,np2),Geometry::dist(np2,np3));
 					
-					/* Calculate the range of finger tip distances: */
-					Interval tipDistance(Geometry::dist(tp0,tp1));
-					tipDistance.addValue(Geometry::dist(tp1,tp2));
-					tipDistance.addValue(Geometry::dist(tp2,tp3));
+					/* Calculate the hand center and radius: */
+					float centerOffset=1.0f/fdNdRatio;
+					center=Geometry::mid(Geometry::mid(rp0+(rp0-tp0)*centerOffset,rp1+(rp1-tp1)*centerOffset),
+					                     Geometry::mid(rp2+(rp2-tp2)*centerOffset,rp3+(rp3-tp3)*centerOffset));
+					center=Geometry::mid(rp1+(rp1-tp1)*centerOffset,rp2+(rp2-tp2)*centerOffset);
+					radius=(Geometry::dist(center,tp0)+Geometry::dist(center,tp1)+Geometry::dist(center,tp2)+Geometry::dist(center,tp3))*0.25f;
 					
-					/* Calculate the range of finger nook distances: */
-					Interval nookDistance(Geometry::dist(np1,np2));
-					nookDistance.addValue(Geometry::dist(np2,np3));
-					
-					/* Calculate finger root points: */
-					Vector2 curve=Geometry::mid(np1,np3)-np2;
-					Point2 rp0=np1+(np1-np2)*0.5f+curve;
-					Point2 rp1=Geometry::mid(np1,np2);
-					Point2 rp2=Geometry::mid(np2,np3);
-					Point2 rp3=np3+(np3-np2)*0.5f+curve;
-					
-					/* Calculate the range of finger lengths: */
-					Interval fingerLength(Geometry::dist(tp0,rp0));
-					fingerLength.addValue(Geometry::dist(tp1,rp1));
-					fingerLength.addValue(Geometry::dist(tp2,rp2));
-					fingerLength.addValue(Geometry::dist(tp3,rp3));
+					/* Calculate the hand's average depth in depth-corrected depth image space: */
+					depth=0.0f;
+					if(pixelDepthCorrection!=0)
+						{
+						ptrdiff_t t0Off=t0.y*depthFrameSize[0]+t0.x;
+						depth+=pixelDepthCorrection[t0Off].correct(float(depthFrame[t0Off]));
+						ptrdiff_t n1Off=n1.y*depthFrameSize[0]+n1.x;
+						depth+=pixelDepthCorrection[n1Off].correct(float(depthFrame[n1Off]));
+						ptrdiff_t t1Off=t1.y*depthFrameSize[0]+t1.x;
+						depth+=pixelDepthCorrection[t1Off].correct(float(depthFrame[t1Off]));
+						ptrdiff_t n2Off=n2.y*depthFrameSize[0]+n2.x;
+						depth+=pixelDepthCorrection[n2Off].correct(float(depthFrame[n2Off]));
+						ptrdiff_t t2Off=t2.y*depthFrameSize[0]+t2.x;
+						depth+=pixelDepthCorrection[t2Off].correct(float(depthFrame[t2Off]));
+						ptrdiff_t n3Off=n3.y*depthFrameSize[0]+n3.x;
+						depth+=pixelDepthCorrection[n3Off].correct(float(depthFrame[n3Off]));
+						ptrdiff_t t3Off=t3.y*depthFrameSize[0]+t3.x;
+						depth+=pixelDepthCorrection[t3Off].correct(float(depthFrame[t3Off]));
+						}
+					else
+						{
+						depth+=float(depthFrame[t0.y*depthFrameSize[0]+t0.x]);
+						depth+=float(depthFrame[n1.y*depthFrameSize[0]+n1.x]);
+						depth+=float(depthFrame[t1.y*depthFrameSize[0]+t1.x]);
+						depth+=float(depthFrame[n2.y*depthFrameSize[0]+n2.x]);
+						depth+=float(depthFrame[t2.y*depthFrameSize[0]+t2.x]);
+						depth+=float(depthFrame[n3.y*depthFrameSize[0]+n3.x]);
+						depth+=float(depthFrame[t3.y*depthFrameSize[0]+t3.x]);
+						}
+					depth/=7.0f;
 					
-					/* Calculate the probability that this is a hand: */
-					float prob=1.0f;
-					prob*=Math::sqr(tipDistance.getMin()/tipDistance.getMax());
-					prob*=nookDistance.getMin()/nookDistance.getMax();
-					prob*=fingerLength.getMin()/fingerLength.getMax();
+					maxProb=prob;
 					
-					if(maxProb<prob)
+					if(imgPtr!=0)
 						{
-						/* Calculate finger length to nook distance ratio: */
-						float fdNdRatio=Math::mid(Geometry::dist(tp1,rp1),Geometry::dist(tp2,rp2))/Math::mid(Geometry::dist(np1,np2),Geometry::dist(np2,np3));
-						
-						/* Calculate the hand center and radius: */
-						float centerOffset=1.0f/fdNdRatio;
-						center=Geometry::mid(Geometry::mid(rp0+(rp0-tp0)*centerOffset,rp1+(rp1-tp1)*centerOffset),
-						                     Geometry::mid(rp2+(rp2-tp2)*centerOffset,rp3+(rp3-tp3)*centerOffset));
-						center=Geometry::mid(rp1+(rp1-tp1)*centerOffset,rp2+(rp2-tp2)*centerOffset);
-						radius=(Geometry::dist(center,tp0)+Geometry::dist(center,tp1)+Geometry::dist(center,tp2)+Geometry::dist(center,tp3))*0.25f;
-						
-						/* Calculate the hand's average depth in depth-corrected depth image space: */
-						depth=0.0f;
-						if(pixelDepthCorrection!=0)
-							{
-							ptrdiff_t t0Off=t0.y*depthFrameSize[0]+t0.x;
-							depth+=pixelDepthCorrection[t0Off].correct(float(depthFrame[t0Off]));
-							ptrdiff_t n1Off=n1.y*depthFrameSize[0]+n1.x;
-							depth+=pixelDepthCorrection[n1Off].correct(float(depthFrame[n1Off]));
-							ptrdiff_t t1Off=t1.y*depthFrameSize[0]+t1.x;
-							depth+=pixelDepthCorrection[t1Off].correct(float(depthFrame[t1Off]));
-							ptrdiff_t n2Off=n2.y*depthFrameSize[0]+n2.x;
-							depth+=pixelDepthCorrection[n2Off].correct(float(depthFrame[n2Off]));
-							ptrdiff_t t2Off=t2.y*depthFrameSize[0]+t2.x;
-							depth+=pixelDepthCorrection[t2Off].correct(float(depthFrame[t2Off]));
-							ptrdiff_t n3Off=n3.y*depthFrameSize[0]+n3.x;
-							depth+=pixelDepthCorrection[n3Off].correct(float(depthFrame[n3Off]));
-							ptrdiff_t t3Off=t3.y*depthFrameSize[0]+t3.x;
-							depth+=pixelDepthCorrection[t3Off].correct(float(depthFrame[t3Off]));
-							}
-						else
-							{
-							depth+=float(depthFrame[t0.y*depthFrameSize[0]+t0.x]);
-							depth+=float(depthFrame[n1.y*depthFrameSize[0]+n1.x]);
-							depth+=float(depthFrame[t1.y*depthFrameSize[0]+t1.x]);
-							depth+=float(depthFrame[n2.y*depthFrameSize[0]+n2.x]);
-							depth+=float(depthFrame[t2.y*depthFrameSize[0]+t2.x]);
-							depth+=float(depthFrame[n3.y*depthFrameSize[0]+n3.x]);
-							depth+=float(depthFrame[t3.y*depthFrameSize[0]+t3.x]);
-							}
-						depth/=7.0f;
-						
-						maxProb=prob;
-						
-						if(imgPtr!=0)
-							{
-							/* Draw the hand: */
-							drawLine(*blobImage,tp0,rp0,Images::RGBImage::Color(255,255,255));
-							drawLine(*blobImage,tp1,rp1,Images::RGBImage::Color(255,255,255));
-							drawLine(*blobImage,tp2,rp2,Images::RGBImage::Color(255,255,255));
-							drawLine(*blobImage,tp3,rp3,Images::RGBImage::Color(255,255,255));
-							drawCircle(*blobImage,center,radius,Images::RGBImage::Color(255,255,255));
-							}
+						/* Draw the hand: */
+						drawLine(*blobImage,tp0,rp0,Images::RGBImage::Color(255,255,255));
+						drawLine(*blobImage,tp1,rp1,Images::RGBImage::Color(255,255,255));
+						drawLine(*blobImage,tp2,rp2,Images::RGBImage::Color(255,255,255));
+						drawLine(*blobImage,tp3,rp3,Images::RGBImage::Color(255,255,255));
+						drawCircle(*blobImage,center,radius,Images::RGBImage::Color(255,255,255));
 						}
 					}
 				}
 			}
+		}
+	
+	/* Check if the blob matches a hand: */
+	if(maxProb>minHandProbability)
+		{
+		// DEBUGGING
+		// std::cout<<"Hand in depth space: "<<center[0]<<", "<<center[1]<<", "<<depth<<", "<<radius<<std::endl;
 		
-		/* Check if the blob matches a hand: */
-		if(maxProb>minHandProbability)
-			{
-			// DEBUGGING
-			// std::cout<<"Hand in depth space: "<<center[0]<<", "<<center[1]<<", "<<depth<<", "<<radius<<std::endl;
-			
-			/* Store the hand in camera space: */
-			Hand newHand;
-			newHand.center=depthProjection.transform(Point(center[0],center[1],depth));
-			newHand.radius=Geometry::dist(newHand.center,depthProjection.transform(Point(center[0]+radius,center[1],depth)));
-			hands.push_back(newHand);
-			
-			// DEBUGGING
-			// std::cout<<"Hand in camera space: "<<newHand.center[0]<<", "<<newHand.center[1]<<", "<<newHand.center[2]<<", "<<newHand.radius<<std::endl;
-			}
+		/* Return the hand in camera space: */
+		hand.center=depthProjection.transform(Point(center[0],center[1],depth));
+		hand.radius=Geometry::dist(hand.center,depthProjection.transform(Point(center[0]+radius,center[1],depth)));
 		
-		/* Clean up: */
-		corners.clear();
+		// DEBUGGING
+		// std::cout<<"Hand in camera space: "<<hand.center[0]<<", "<<hand.center[1]<<", "<<hand.center[2]<<", "<<hand.radius<<std::endl;
+		
+		return true;
 		}
 	
-	/* Clean up: */
-	delete[] blobOrigins;
+	return false;
+	}
+
+void HandExtractor::classifyBlobBand(unsigned int bandIndex,int blobBegin,int blobEnd)
+	{
+	/* Walk around the edges of all blobs in the band using the band's workspace: */
+	Workspace& ws=workspaces[bandIndex];
+	for(int blobId=blobBegin;blobId<blobEnd;++blobId)
+		blobResults[blobId].isHand=classifyBlob(bandDepthFrame,(unsigned int)(blobId),ws,0,0,blobResults[blobId].hand);
 	}
 
 void HandExtractor::setHandsExtractedFunction(HandExtractor::HandsExtractedFunction* newHandsExtractedFunction)
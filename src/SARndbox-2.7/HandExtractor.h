@@ -29,8 +29,11 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Threads/MutexCond.h>
 #include <Threads/TripleBuffer.h>
 #include <Images/RGBImage.h>
+#include <Images/ExtractBlobs.h>
+#include <Images/BlobLabeler.h>
 #include <Kinect/FrameBuffer.h>
 #include <Kinect/FrameSource.h>
+#include <Kinect/WorkerPool.h>
 
 #include "Types.h"
 
@@ -59,6 +62,8 @@ class HandExtractor
 	typedef Misc::FunctionCall<const HandList&> HandsExtractedFunction; // Type for functions called when a new hand list has been extracted
 	
 	private:
+	typedef Images::BlobLabeler<Images::Blob<DepthPixel> > BlobLabeler; // Type for labelers extracting foreground blobs from depth frames
+	
 	struct EdgePixel // Helper structure storing an edge pixel of a blob
 		{
 		/* Elements: */
@@ -66,6 +71,40 @@ class HandExtractor
 		int x,y; // Position of edge pixel in depth frame
 		const unsigned short* biPtr; // Pointer to edge pixel in blob ID image
 		};
+	
+	struct BlobOrigin // Helper structure to store a point on the border of a foreground blob
+		{
+		/* Elements: */
+		public:
+		bool assigned; // Flag if the blob origin has already been assigned
+		unsigned int x,y; // Coordinates of blob origin in depth frame
+		const unsigned short* biPtr; // Pointer to blob origin in blob ID image
+		};
+	
+	struct Corner // Helper class to store corners in blob images
+		{
+		/* Elements: */
+		public:
+		int cornerType; // Corner type, +1: finger tip, -1: finger nook
+		unsigned start; // Boundary pixel index at which the corner started
+		int x,y; // Corner position in depth frame
+		};
+	
+	struct Workspace // Structure holding scratch arrays used by one thread to classify blobs, retained between frames
+		{
+		/* Elements: */
+		public:
+		std::vector<EdgePixel> snake; // Array of the edge-walking snake's pixels
+		std::vector<Corner> corners; // List of corners detected along the current blob's edge
+		};
+	
+	struct BlobResult // Structure holding the classification result of a blob
+		{
+		/* Elements: */
+		public:
+		bool isHand; // Flag whether the blob was classified as a hand
+		Hand hand; // Hand position in camera space if the blob is a hand
+		};
 
 	/* Elements: */
 	private:
@@ -82,6 +121,9 @@ class HandExtractor
 	DepthPixel maxFgDepth; // Maximum depth value for foreground blobs
 	unsigned int maxDepthDist; // Maximum depth distance between adjacent pixels to belong to the same foreground blob
 	unsigned int minBlobSize,maxBlobSize; // Minimum and maximum number of pixels to consider a blob a hand candidate
+	Kinect::WorkerPool workerPool; // Pool of threads labeling bands of depth frames and classifying hand candidate blobs in parallel
+	BlobLabeler blobLabeler; // Labeler extracting four-connected foreground blobs from depth frames
+	std::vector<unsigned short> spanBlobIds; // Hand candidate blob IDs of all spans in the most recently labeled depth frame
 	unsigned short* blobIdImage; // Image of per-pixel blob IDs with one pixel boundary layer
 	ptrdiff_t biStride; // Row stride in blob ID image
 	static const unsigned short invalidBlobId; // Invalid blob ID
@@ -89,21 +131,27 @@ class HandExtractor
 	static const int walkDy[8]; // Array of edge walking steps in clockwise order in y
 	ptrdiff_t walkOffsets[8]; // Array of pointer offsets for edge walking steps in clockwise order
 	unsigned int snakeLength; // Length of the "snake" walking around blobs' edges to detect corners
-	EdgePixel* snake; // Array of snake's pixels
 	int maxCornerEnterDist; // Maximum distance between snake's head and tail to enter corner state
 	int minCenterDist; // Minimum distance from snake's center to line defined by its head and tail to enter corner state
 	int minCornerExitDist; // Minimum distance between snake's head and tail to leave corner state
 	float minHandProbability; // Minimum probability rating at which to accept a blob as a hand
+	std::vector<BlobOrigin> blobOrigins; // Origin points of all hand candidate blobs in the most recent frame
+	Workspace* workspaces; // Array of per-thread workspaces, one for each thread in the worker pool
+	std::vector<BlobResult> blobResults; // Classification results of all hand candidate blobs in the most recent frame
+	const DepthPixel* bandDepthFrame; // Depth frame whose blobs are currently being classified by the worker pool
 	
 	Threads::TripleBuffer<HandList> extractedHands; // Triple buffer of lists of extracted hands
 	HandsExtractedFunction* handsExtractedFunction; // Function called when a new list of extracted hands is ready
 	
 	/* Private methods: */
 	void* extractorThreadMethod(void); // Method for the background hand extraction thread
+	bool classifyBlob(const DepthPixel* depthFrame,unsigned int blobId,Workspace& ws,Images::RGBImage* blobImage,Images::RGBImage::Color* imgPtr,Hand& hand); // Walks around the edge of the given blob using the given workspace and returns true and the hand's position if the blob is hand-shaped; draws into the given blob image if imgPtr is not null
+	void classifyBlobBand(unsigned int bandIndex,int blobBegin,int blobEnd); // Classifies a range of blobs using the workspace of the given band
+	
 	
 	/* Constructors and destructors: */
 	public:
-	HandExtractor(const unsigned int sDepthFrameSize[2],const PixelDepthCorrection* sPixelDepthCorrection,const PTransform& sDepthProjection); // Creates a hand extractor for depth frames of the given size
+	HandExtractor(const unsigned int sDepthFrameSize[2],const PixelDepthCorrection* sPixelDepthCorrection,const PTransform& sDepthProjection,unsigned int numThreads =0); // Creates a hand extractor for depth frames of the given size, using the given number of threads to label and classify blobs; uses number of online CPUs if zero
 	private:
 	HandExtractor(const HandExtractor& source); // Prohibit copy constructor
 	HandExtractor& operator=(const HandExtractor& source); // Prohibit assignment operator
@@ -111,6 +159,10 @@ class HandExtractor
 	~HandExtractor(void);
 	
 	/* Methods: */
+	unsigned int getNumThreads(void) const // Returns the number of threads used to label and classify blobs
+		{
+		return workerPool.getNumThreads();
+		}
 	DepthPixel getMaxFgDepth(void) const // Returns the maximum depth value for foreground blobs
 		{
 		return maxFgDepth;
@@ -0,0 +1,268 @@
+/***********************************************************************
+HandExtractorBenchmark - Utility to measure the per-frame latency and
+the number of detected hands of the hand extractor on pre-recorded or
+synthetic depth frames arriving at typical depth camera frame rates.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <Misc/FunctionCalls.h>
+#include <Threads/MutexCond.h>
+#include <Realtime/Time.h>
+#include <Math/Math.h>
+#include <Kinect/FrameBuffer.h>
+
+#include "Types.h"
+#include "HandExtractor.h"
+#include "BenchmarkHelper.h"
+
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+class HandReceiver // Class to receive extracted hand lists and measure their latencies
+	{
+	/* Elements: */
+	public:
+	Threads::MutexCond handsCond; // Condition variable to signal arrival of an extracted hand list
+	unsigned int numFrames; // Number of hand lists received so far
+	size_t numHands; // Total number of hands received so far
+	Realtime::TimePointMonotonic sendTime; // Time point at which the most recent raw frame was sent to the hand extractor
+	std::vector<double> latencies; // Latencies of all received hand lists in seconds
+	
+	/* Constructors and destructors: */
+	HandReceiver(void)
+		:numFrames(0),numHands(0)
+		{
+		}
+	
+	/* Methods: */
+	void receiveHands(const HandExtractor::HandList& hands)
+		{
+		Realtime::TimePointMonotonic now;
+		double latency=double(now-sendTime);
+		
+		Threads::MutexCond::Lock handsLock(handsCond);
+		latencies.push_back(latency);
+		numHands+=hands.size();
+		++numFrames;
+		handsCond.signal();
+		}
+	};
+
+/****************
+Helper functions:
+****************/
+
+void drawHand(Kinect::FrameBuffer& frame,int cx,int cy,HandExtractor::DepthPixel depth) // Draws a splayed hand of constant depth into the given depth frame
+	{
+	HandExtractor::DepthPixel* fPtr=frame.getData<HandExtractor::DepthPixel>();
+	int width=frame.getSize(0);
+	int height=frame.getSize(1);
+	
+	/* Draw the palm and the thumb and fingers as thick line segments: */
+	static const double fingerAngles[5]={-0.55,-0.18,0.18,0.55,1.3};
+	static const double fingerLengths[5]={55.0,62.0,60.0,50.0,42.0};
+	for(int y=Math::max(cy-100,0);y<Math::min(cy+60,height);++y)
+		for(int x=Math::max(cx-100,0);x<Math::min(cx+100,width);++x)
+			{
+			double dx=double(x-cx);
+			double dy=double(y-cy);
+			bool inside=dx*dx+dy*dy<=35.0*35.0;
+			for(int i=0;i<5&&!inside;++i)
+				{
+				/* Check the pixel against the finger's line segment: */
+				double fx=Math::sin(fingerAngles[i]);
+				double fy=-Math::cos(fingerAngles[i]);
+				double t=dx*fx+dy*fy;
+				if(t>=0.0&&t<=30.0+fingerLengths[i])
+					inside=Math::sqr(dx-t*fx)+Math::sqr(dy-t*fy)<=36.0;
+				}
+			if(inside)
+				fPtr[y*width+x]=depth;
+			}
+	}
+
+Kinect::FrameBuffer createSyntheticFrame(const unsigned int frameSize[2],unsigned int frameIndex) // Creates a synthetic depth frame showing a tilted sand surface with dropouts and two moving hands
+	{
+	Kinect::FrameBuffer frame=createSyntheticDepthFrame(frameSize,900,20,0,0);
+	
+	/* Draw two hands moving across the frame: */
+	int offset=int(frameIndex*4)%int(frameSize[0]/2);
+	drawHand(frame,int(frameSize[0]/4)+offset,int(frameSize[1]/2),700);
+	drawHand(frame,int(frameSize[0]*3/4)-offset,int(frameSize[1]*2/3),720);
+	
+	return frame;
+	}
+
+}
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	const char* frameFilePrefix=0;
+	unsigned int syntheticSize[2]={0,0};
+	unsigned int numThreads=0;
+	unsigned int maxNumFrames=300;
+	unsigned int numBenchmarkFrames=300;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"h")==0)
+				{
+				std::cout<<"Usage: HandExtractorBenchmark [option 1] ... [option n] (<frame file prefix> | -synthetic <width> <height>)"<<std::endl;
+				std::cout<<"  Options:"<<std::endl;
+				std::cout<<"  -h"<<std::endl;
+				std::cout<<"     Prints this help message"<<std::endl;
+				std::cout<<"  -synthetic <width> <height>"<<std::endl;
+				std::cout<<"     Extracts hands from synthetic depth frames of the given size"<<std::endl;
+				std::cout<<"     instead of pre-recorded frames"<<std::endl;
+				std::cout<<"  -nt <number of threads>"<<std::endl;
+				std::cout<<"     Number of hand extractor threads"<<std::endl;
+				std::cout<<"     Default: number of CPUs"<<std::endl;
+				std::cout<<"  -mf <max num frames>"<<std::endl;
+				std::cout<<"     Maximum number of pre-recorded frames to load into memory"<<std::endl;
+				std::cout<<"     Default: "<<maxNumFrames<<std::endl;
+				std::cout<<"  -n <num frames>"<<std::endl;
+				std::cout<<"     Number of frames to process at each frame rate, cycling through"<<std::endl;
+				std::cout<<"     loaded frames"<<std::endl;
+				std::cout<<"     Default: "<<numBenchmarkFrames<<std::endl;
+				return 0;
+				}
+			else if(strcasecmp(argv[i]+1,"synthetic")==0)
+				{
+				for(int j=0;j<2;++j)
+					{
+					++i;
+					syntheticSize[j]=(unsigned int)(atoi(argv[i]));
+					}
+				}
+			else if(strcasecmp(argv[i]+1,"nt")==0)
+				{
+				++i;
+				numThreads=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"mf")==0)
+				{
+				++i;
+				maxNumFrames=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"n")==0)
+				{
+				++i;
+				numBenchmarkFrames=(unsigned int)(atoi(argv[i]));
+				}
+			else
+				std::cerr<<"Ignoring unrecognized command line option "<<argv[i]<<std::endl;
+			}
+		else
+			frameFilePrefix=argv[i];
+		}
+	if(frameFilePrefix==0&&(syntheticSize[0]==0||syntheticSize[1]==0))
+		{
+		std::cerr<<"No frame file prefix or synthetic frame size provided; use -h for help"<<std::endl;
+		return 1;
+		}
+	
+	try
+		{
+		unsigned int frameSize[2];
+		std::vector<Kinect::FrameBuffer> frames;
+		HandExtractor::PixelDepthCorrection* pixelDepthCorrection=0;
+		if(frameFilePrefix!=0)
+			{
+			/* Load the selected pre-recorded depth frames: */
+			loadDepthFrames(frameFilePrefix,maxNumFrames,frameSize,frames,&pixelDepthCorrection);
+			}
+		else
+			{
+			/* Create synthetic depth frames: */
+			for(int i=0;i<2;++i)
+				frameSize[i]=syntheticSize[i];
+			srand(0);
+			for(unsigned int frameIndex=0;frameIndex<Math::min(maxNumFrames,61U);++frameIndex)
+				frames.push_back(createSyntheticFrame(frameSize,frameIndex));
+			}
+		
+		/* Run the hand extractor at typical frame rates of first- and second-generation depth cameras: */
+		static const double frameRates[2]={30.0,90.0};
+		std::cout<<std::fixed<<std::setprecision(3);
+		for(int rateIndex=0;rateIndex<2;++rateIndex)
+			{
+			/* Create a hand extractor: */
+			HandExtractor handExtractor(frameSize,pixelDepthCorrection,PTransform::identity,numThreads);
+			HandReceiver receiver;
+			handExtractor.setHandsExtractedFunction(Misc::createFunctionCall(&receiver,&HandReceiver::receiveHands));
+			
+			/* Send frames to the hand extractor at the frame rate and wait for each hand list: */
+			Realtime::TimeVector framePeriod(1.0/frameRates[rateIndex]);
+			Realtime::TimePointMonotonic nextFrameTime;
+			unsigned int numMissedFrames=0;
+			for(unsigned int frameIndex=0;frameIndex<numBenchmarkFrames;++frameIndex)
+				{
+				Realtime::TimePointMonotonic::sleep(nextFrameTime);
+				{
+				Threads::MutexCond::Lock handsLock(receiver.handsCond);
+				receiver.sendTime.set();
+				handExtractor.receiveRawFrame(frames[frameIndex%frames.size()]);
+				while(receiver.numFrames<=frameIndex)
+					receiver.handsCond.wait(handsLock);
+				}
+				
+				/* Schedule the next frame, or send it immediately if the current frame overran its period: */
+				nextFrameTime+=framePeriod;
+				Realtime::TimePointMonotonic now;
+				if(nextFrameTime<now)
+					{
+					++numMissedFrames;
+					nextFrameTime=now;
+					}
+				}
+			
+			/* Print latency and detection statistics: */
+			std::vector<double> sorted=receiver.latencies;
+			std::sort(sorted.begin(),sorted.end());
+			std::cout<<std::setprecision(0)<<frameRates[rateIndex]<<" Hz, "<<handExtractor.getNumThreads()<<" threads: "<<std::setprecision(3);
+			std::cout<<double(receiver.numHands)/double(receiver.numFrames)<<" hands/frame";
+			std::cout<<", latency 50% "<<percentile(sorted,0.5)*1000.0<<" ms";
+			std::cout<<", 90% "<<percentile(sorted,0.9)*1000.0<<" ms";
+			std::cout<<", 99% "<<percentile(sorted,0.99)*1000.0<<" ms";
+			std::cout<<", max "<<sorted.back()*1000.0<<" ms";
+			std::cout<<", "<<numMissedFrames<<" of "<<numBenchmarkFrames<<" frames missed their period"<<std::endl;
+			}
+		
+		delete[] pixelDepthCorrection;
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"HandExtractorBenchmark: Terminated due to exception "<<err.what()<<std::endl;
+		return 1;
+		}
+	
+	return 0;
+	}
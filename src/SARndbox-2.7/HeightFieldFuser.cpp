@@ -0,0 +1,439 @@
+/***********************************************************************
+HeightFieldFuser - Class to resample the filtered depth frames of
+multiple calibrated depth cameras into a common elevation grid above the
+sandbox's base plane, and to blend them into a single seamless height
+field using per-pixel confidence weights.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "HeightFieldFuser.h"
+
+#include <string.h>
+#include <Misc/FunctionCalls.h>
+#include <Math/Math.h>
+#include <Geometry/Point.h>
+#include <Geometry/Vector.h>
+#include <Geometry/HVector.h>
+#include <Geometry/Matrix.h>
+
+#include "LatencyTracker.h"
+
+/*********************************
+Methods of class HeightFieldFuser:
+*********************************/
+
+void HeightFieldFuser::resampleFrame(HeightFieldFuser::Camera& camera,const Kinect::FrameBuffer& frame,HeightFieldFuser::Layer& layer)
+	{
+	/* Clear the layer's accumulation buffers: */
+	size_t gridCells=size_t(gridSize[1])*size_t(gridSize[0]);
+	memset(layer.weights,0,gridCells*sizeof(float));
+	memset(layer.weightedElevations,0,gridCells*sizeof(float));
+	
+	/* Splat all valid depth pixels into the elevation grid: */
+	float gridMax[2];
+	for(int i=0;i<2;++i)
+		gridMax[i]=float(gridSize[i])-1.0f;
+	float cellSize2=cellSize*cellSize;
+	const float* dPtr=frame.getData<float>();
+	const float* ppPtr=camera.pixelPositions;
+	const float* fwPtr=camera.featherWeights;
+	for(unsigned int y=0;y<camera.frameSize[1];++y)
+		for(unsigned int x=0;x<camera.frameSize[0];++x,++dPtr,ppPtr+=4,++fwPtr)
+			{
+			/* Skip invalid pixels and pixels without confidence: */
+			float d=*dPtr;
+			if(d<=0.0f||*fwPtr==0.0f)
+				continue;
+			
+			/* Transform the pixel to grid space: */
+			float w=ppPtr[3]+camera.depthDirection[3]*d;
+			float gx=(ppPtr[0]+camera.depthDirection[0]*d)/w-0.5f;
+			float gy=(ppPtr[1]+camera.depthDirection[1]*d)/w-0.5f;
+			float e=(ppPtr[2]+camera.depthDirection[2]*d)/w;
+			
+			/* Skip pixels outside the elevation grid: */
+			if(!(gx>=0.0f&&gx<=gridMax[0]&&gy>=0.0f&&gy<=gridMax[1]))
+				continue;
+			
+			/* Weigh the pixel by its distance from the frame's border and the inverse squared distance from the camera: */
+			float dx=gx+0.5f-camera.center[0];
+			float dy=gy+0.5f-camera.center[1];
+			float de=e-camera.center[2];
+			float weight=*fwPtr/((dx*dx+dy*dy)*cellSize2+de*de);
+			
+			/* Splat the pixel's elevation into the four grid cells surrounding it: */
+			unsigned int cx=(unsigned int)(gx);
+			if(cx>=gridSize[0]-1)
+				cx=gridSize[0]-2;
+			unsigned int cy=(unsigned int)(gy);
+			if(cy>=gridSize[1]-1)
+				cy=gridSize[1]-2;
+			float wx1=gx-float(cx);
+			float wx0=1.0f-wx1;
+			float wy1=gy-float(cy);
+			float wy0=1.0f-wy1;
+			size_t cell=size_t(cy)*size_t(gridSize[0])+size_t(cx);
+			float* wPtr=layer.weights+cell;
+			float* wePtr=layer.weightedElevations+cell;
+			float w00=wx0*wy0*weight;
+			float w10=wx1*wy0*weight;
+			float w01=wx0*wy1*weight;
+			float w11=wx1*wy1*weight;
+			wPtr[0]+=w00;
+			wePtr[0]+=w00*e;
+			wPtr[1]+=w10;
+			wePtr[1]+=w10*e;
+			wPtr[gridSize[0]]+=w01;
+			wePtr[gridSize[0]]+=w01*e;
+			wPtr[gridSize[0]+1]+=w11;
+			wePtr[gridSize[0]+1]+=w11*e;
+			}
+	
+	/* Remember the filtered frame's trace: */
+	layer.traceFrame.copyTrace(frame);
+	}
+
+void HeightFieldFuser::blendBand(unsigned int bandIndex,int tileRowBegin,int tileRowEnd)
+	{
+	for(int tileY=tileRowBegin;tileY<tileRowEnd;++tileY)
+		{
+		unsigned int yBegin=tileY*FilteredFrame::tileSize;
+		unsigned int yEnd=yBegin+FilteredFrame::tileSize<gridSize[1]?yBegin+FilteredFrame::tileSize:gridSize[1];
+		for(unsigned int tileX=0;tileX<numTiles[0];++tileX)
+			{
+			unsigned int xBegin=tileX*FilteredFrame::tileSize;
+			unsigned int xEnd=xBegin+FilteredFrame::tileSize<gridSize[0]?xBegin+FilteredFrame::tileSize:gridSize[0];
+			
+			/* Blend all cameras' layers inside the tile, retaining the previous elevations of cells no camera currently sees: */
+			bool changed=frameStamp<=1; // The first frame changes all tiles
+			for(unsigned int y=yBegin;y<yEnd;++y)
+				{
+				size_t rowOffset=size_t(y)*size_t(gridSize[0]);
+				for(unsigned int x=xBegin;x<xEnd;++x)
+					{
+					size_t cell=rowOffset+x;
+					float weightSum=0.0f;
+					float weightedElevationSum=0.0f;
+					for(unsigned int cameraIndex=0;cameraIndex<numCameras;++cameraIndex)
+						{
+						const Layer& layer=cameras[cameraIndex].layers[cameras[cameraIndex].fusedLayer];
+						weightSum+=layer.weights[cell];
+						weightedElevationSum+=layer.weightedElevations[cell];
+						}
+					if(weightSum>0.0f)
+						{
+						float elevation=weightedElevationSum/weightSum;
+						if(elevations[cell]!=elevation)
+							{
+							elevations[cell]=elevation;
+							changed=true;
+							}
+						}
+					bandOutputFrame[cell]=elevations[cell];
+					}
+				}
+			
+			/* Stamp the tile if any of its cells changed: */
+			if(changed)
+				tileStamps[tileY*numTiles[0]+tileX]=frameStamp;
+			}
+		}
+	}
+
+void* HeightFieldFuser::fusionThreadMethod(void)
+	{
+	unsigned int lastLayerVersion=0;
+	
+	while(true)
+		{
+		unsigned int traceCameraIndex;
+		{
+		Threads::MutexCond::Lock layerLock(layerCond);
+		
+		/* Wait until a new layer arrives or the program shuts down: */
+		while(runFusionThread&&lastLayerVersion==layerVersion)
+			layerCond.wait(layerLock);
+		
+		/* Bail out if the program is shutting down: */
+		if(!runFusionThread)
+			break;
+		
+		/* Grab the most recent layers of all cameras that resampled new frames: */
+		for(unsigned int cameraIndex=0;cameraIndex<numCameras;++cameraIndex)
+			{
+			Camera& camera=cameras[cameraIndex];
+			if(camera.fusedVersion!=camera.readyVersion)
+				{
+				std::swap(camera.fusedLayer,camera.readyLayer);
+				camera.fusedVersion=camera.readyVersion;
+				}
+			}
+		lastLayerVersion=layerVersion;
+		traceCameraIndex=lastCameraIndex;
+		}
+		
+		/* Prepare a new output frame: */
+		FilteredFrame& newOutputFrame=outputFrames.startNewValue();
+		bandOutputFrame=newOutputFrame.frame.getData<float>();
+		
+		/* Blend the current layers into the output frame in parallel bands of tile rows, and pass the stamps of changed tiles along with the output frame: */
+		++frameStamp;
+		workerPool.processBands(0,int(numTiles[1]),this,&HeightFieldFuser::blendBand);
+		newOutputFrame.frameStamp=frameStamp;
+		newOutputFrame.tileStamps.assign(tileStamps,tileStamps+numTiles[1]*numTiles[0]);
+		
+		/* Continue the trace of the most recently resampled frame in the new output frame: */
+		const Camera& traceCamera=cameras[traceCameraIndex];
+		newOutputFrame.frame.copyTrace(traceCamera.layers[traceCamera.fusedLayer].traceFrame);
+		
+		/* Finalize the new output frame in the output buffer: */
+		outputFrames.postNewValue();
+		
+		/* Pass the new output frame to the registered receiver: */
+		if(outputFrameFunction!=0)
+			(*outputFrameFunction)(newOutputFrame);
+		}
+	
+	return 0;
+	}
+
+HeightFieldFuser::HeightFieldFuser(unsigned int sNumCameras,const unsigned int sGridSize[2],const Plane& basePlane,const Point basePlaneCorners[4],unsigned int numThreads)
+	:featherWidth(32),
+	 numCameras(sNumCameras),cameras(new Camera[numCameras]),
+	 layerVersion(0),lastCameraIndex(0),
+	 elevations(0),frameStamp(0),tileStamps(0),
+	 workerPool(numThreads),
+	 bandOutputFrame(0),
+	 outputFrameFunction(0)
+	{
+	/* Remember the grid size: */
+	for(int i=0;i<2;++i)
+		gridSize[i]=sGridSize[i];
+	size_t gridCells=size_t(gridSize[1])*size_t(gridSize[0]);
+	
+	/* Create a right-handed grid frame whose z axis is the base plane normal and whose x axis follows the sandbox's long edges: */
+	Vector z=basePlane.getNormal();
+	z.normalize();
+	Vector x=(basePlaneCorners[1]-basePlaneCorners[0])+(basePlaneCorners[3]-basePlaneCorners[2]);
+	x-=z*(x*z);
+	x.normalize();
+	Vector y=Geometry::cross(z,x);
+	
+	/* Calculate the extents of the base plane quadrilateral in the grid frame: */
+	Point p0=basePlane.project(basePlaneCorners[0]);
+	Scalar min[2],max[2];
+	for(int i=0;i<2;++i)
+		min[i]=max[i]=Scalar(0);
+	for(int i=1;i<4;++i)
+		{
+		Vector d=basePlane.project(basePlaneCorners[i])-p0;
+		Scalar c[2];
+		c[0]=d*x;
+		c[1]=d*y;
+		for(int j=0;j<2;++j)
+			{
+			if(min[j]>c[j])
+				min[j]=c[j];
+			if(max[j]<c[j])
+				max[j]=c[j];
+			}
+		}
+	
+	/* Cover the quadrilateral with square grid cells, centering the grid on it: */
+	Scalar cs=Math::max((max[0]-min[0])/Scalar(gridSize[0]),(max[1]-min[1])/Scalar(gridSize[1]));
+	cellSize=float(cs);
+	Point origin=p0+x*(Math::mid(min[0],max[0])-Scalar(gridSize[0])*cs*Scalar(0.5))+y*(Math::mid(min[1],max[1])-Scalar(gridSize[1])*cs*Scalar(0.5));
+	
+	/* Create the transformation from grid space to camera space: */
+	PTransform::Matrix& gtm=gridTransform.getMatrix();
+	for(int i=0;i<3;++i)
+		{
+		gtm(i,0)=x[i]*cs;
+		gtm(i,1)=y[i]*cs;
+		gtm(i,2)=z[i];
+		gtm(i,3)=origin[i];
+		gtm(3,i)=Scalar(0);
+		}
+	gtm(3,3)=Scalar(1);
+	
+	/* Initialize the cameras: */
+	for(unsigned int cameraIndex=0;cameraIndex<numCameras;++cameraIndex)
+		{
+		Camera& camera=cameras[cameraIndex];
+		for(int i=0;i<2;++i)
+			camera.frameSize[i]=0;
+		camera.pixelPositions=0;
+		camera.featherWeights=0;
+		for(int i=0;i<3;++i)
+			{
+			camera.layers[i].weights=new float[gridCells];
+			memset(camera.layers[i].weights,0,gridCells*sizeof(float));
+			camera.layers[i].weightedElevations=new float[gridCells];
+			memset(camera.layers[i].weightedElevations,0,gridCells*sizeof(float));
+			camera.layers[i].traceFrame=Kinect::FrameBuffer(0,0,0);
+			}
+		camera.workingLayer=0;
+		camera.readyLayer=1;
+		camera.fusedLayer=2;
+		camera.readyVersion=0;
+		camera.fusedVersion=0;
+		}
+	
+	/* Initialize the retained elevations to the base plane: */
+	elevations=new float[gridCells];
+	for(size_t i=0;i<gridCells;++i)
+		elevations[i]=0.0f;
+	
+	/* Initialize the change detection buffers using the frame filter's tiles, which renderers use to interpret the tile stamps: */
+	for(int i=0;i<2;++i)
+		numTiles[i]=FilteredFrame::getNumTiles(gridSize[i]);
+	tileStamps=new unsigned int[numTiles[1]*numTiles[0]];
+	for(unsigned int i=0;i<numTiles[1]*numTiles[0];++i)
+		tileStamps[i]=0;
+	
+	/* Initialize the output frame buffer: */
+	for(int i=0;i<3;++i)
+		{
+		outputFrames.getBuffer(i).frame=Kinect::FrameBuffer(gridSize[0],gridSize[1],gridCells*sizeof(float));
+		outputFrames.getBuffer(i).tileStamps.resize(numTiles[1]*numTiles[0],0U);
+		}
+	
+	/* Start the fusion thread: */
+	runFusionThread=true;
+	fusionThread.start(this,&HeightFieldFuser::fusionThreadMethod);
+	}
+
+HeightFieldFuser::~HeightFieldFuser(void)
+	{
+	/* Shut down the fusion thread: */
+	{
+	Threads::MutexCond::Lock layerLock(layerCond);
+	runFusionThread=false;
+	layerCond.signal();
+	}
+	fusionThread.join();
+	
+	/* Release all allocated buffers: */
+	for(unsigned int cameraIndex=0;cameraIndex<numCameras;++cameraIndex)
+		{
+		Camera& camera=cameras[cameraIndex];
+		delete[] camera.pixelPositions;
+		delete[] camera.featherWeights;
+		for(int i=0;i<3;++i)
+			{
+			delete[] camera.layers[i].weights;
+			delete[] camera.layers[i].weightedElevations;
+			}
+		}
+	delete[] cameras;
+	delete[] elevations;
+	delete[] tileStamps;
+	delete outputFrameFunction;
+	}
+
+Kinect::FrameSource::IntrinsicParameters HeightFieldFuser::getIntrinsicParameters(void) const
+	{
+	/* Fused height fields have no lens distortion and map grid cells and elevations directly to camera space: */
+	Kinect::FrameSource::IntrinsicParameters result;
+	result.depthProjection=gridTransform;
+	result.colorProjection=Kinect::FrameSource::IntrinsicParameters::PTransform::identity;
+	
+	return result;
+	}
+
+void HeightFieldFuser::setFeatherWidth(unsigned int newFeatherWidth)
+	{
+	featherWidth=newFeatherWidth;
+	}
+
+void HeightFieldFuser::setCamera(unsigned int cameraIndex,const unsigned int frameSize[2],const Kinect::FrameSource::IntrinsicParameters& ips,const PTransform& cameraTransform)
+	{
+	Camera& camera=cameras[cameraIndex];
+	for(int i=0;i<2;++i)
+		camera.frameSize[i]=frameSize[i];
+	size_t numPixels=size_t(frameSize[1])*size_t(frameSize[0]);
+	
+	/* Calculate the transformation from the camera's depth image space to grid space: */
+	PTransform dicToGrid=Geometry::invert(gridTransform)*cameraTransform*ips.depthProjection;
+	const PTransform::Matrix& dgm=dicToGrid.getMatrix();
+	for(int i=0;i<4;++i)
+		camera.depthDirection[i]=float(dgm(i,2));
+	
+	/* Calculate the camera's center of projection in grid space: */
+	Point center=Geometry::invert(gridTransform).transform(cameraTransform.transform(Point::origin));
+	for(int i=0;i<3;++i)
+		camera.center[i]=float(center[i]);
+	
+	/* Calculate the grid-space positions of all undistorted depth pixels at depth zero: */
+	delete[] camera.pixelPositions;
+	camera.pixelPositions=new float[numPixels*4];
+	float* ppPtr=camera.pixelPositions;
+	for(unsigned int y=0;y<frameSize[1];++y)
+		for(unsigned int x=0;x<frameSize[0];++x,ppPtr+=4)
+			{
+			Kinect::LensDistortion::Point up;
+			if(ips.depthLensDistortion.isIdentity())
+				up=Kinect::LensDistortion::Point(Scalar(x)+Scalar(0.5),Scalar(y)+Scalar(0.5));
+			else
+				up=ips.depthLensDistortion.undistortPixel(x,y);
+			for(int i=0;i<4;++i)
+				ppPtr[i]=float(dgm(i,0)*up[0]+dgm(i,1)*up[1]+dgm(i,3));
+			}
+	
+	/* Calculate feathering weights that fall off smoothly towards the depth frame's borders to blend seams between cameras: */
+	delete[] camera.featherWeights;
+	camera.featherWeights=new float[numPixels];
+	float* fwPtr=camera.featherWeights;
+	float fw=float(Math::max(featherWidth,1U));
+	for(unsigned int y=0;y<frameSize[1];++y)
+		{
+		float wy=Math::min(float(Math::min(y,frameSize[1]-1-y))+0.5f,fw)/fw;
+		for(unsigned int x=0;x<frameSize[0];++x,++fwPtr)
+			{
+			float wx=Math::min(float(Math::min(x,frameSize[0]-1-x))+0.5f,fw)/fw;
+			*fwPtr=wx*wy;
+			}
+		}
+	}
+
+void HeightFieldFuser::setOutputFrameFunction(HeightFieldFuser::OutputFrameFunction* newOutputFrameFunction)
+	{
+	delete outputFrameFunction;
+	outputFrameFunction=newOutputFrameFunction;
+	}
+
+void HeightFieldFuser::receiveFilteredFrame(const FilteredFrame& frame,unsigned int cameraIndex)
+	{
+	/* Resample the frame into the camera's working layer in the calling thread: */
+	Camera& camera=cameras[cameraIndex];
+	resampleFrame(camera,frame.frame,camera.layers[camera.workingLayer]);
+	
+	{
+	Threads::MutexCond::Lock layerLock(layerCond);
+	
+	/* Make the working layer the camera's most recent layer: */
+	std::swap(camera.workingLayer,camera.readyLayer);
+	++camera.readyVersion;
+	++layerVersion;
+	lastCameraIndex=cameraIndex;
+	
+	/* Signal the fusion thread: */
+	layerCond.signal();
+	}
+	}
@@ -0,0 +1,124 @@
+/***********************************************************************
+HeightFieldFuser - Class to resample the filtered depth frames of
+multiple calibrated depth cameras into a common elevation grid above the
+sandbox's base plane, and to blend them into a single seamless height
+field using per-pixel confidence weights.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef HEIGHTFIELDFUSER_INCLUDED
+#define HEIGHTFIELDFUSER_INCLUDED
+
+#include <Threads/Thread.h>
+#include <Threads/MutexCond.h>
+#include <Threads/TripleBuffer.h>
+#include <Kinect/FrameBuffer.h>
+#include <Kinect/FrameSource.h>
+#include <Kinect/WorkerPool.h>
+
+#include "Types.h"
+#include "FilteredFrame.h"
+
+/* Forward declarations: */
+namespace Misc {
+template <class ParameterParam>
+class FunctionCall;
+}
+
+class HeightFieldFuser
+	{
+	/* Embedded classes: */
+	public:
+	typedef Misc::FunctionCall<const FilteredFrame&> OutputFrameFunction; // Type for functions called when a new fused height field is ready
+	
+	private:
+	struct Layer // Structure holding a camera's filtered depth frame resampled into the elevation grid
+		{
+		/* Elements: */
+		public:
+		float* weights; // Sums of the confidence weights of all samples splatted into each grid cell
+		float* weightedElevations; // Sums of the confidence-weighted elevations of all samples splatted into each grid cell
+		Kinect::FrameBuffer traceFrame; // Empty frame holding a copy of the trace of the filtered depth frame from which the layer was resampled
+		};
+	
+	struct Camera // Structure holding the resampling state of a contributing camera
+		{
+		/* Elements: */
+		public:
+		unsigned int frameSize[2]; // Width and height of the camera's depth frames
+		float* pixelPositions; // Homogeneous grid-space positions of all depth pixels at depth zero, four components per pixel
+		float depthDirection[4]; // Homogeneous grid-space direction added to a pixel's position per unit of depth
+		float center[3]; // Camera's center of projection in grid space
+		float* featherWeights; // Per-pixel confidence weights falling off towards the depth frame's borders
+		Layer layers[3]; // Triple buffer of resampled layers
+		int workingLayer; // Index of the layer into which the next depth frame is resampled
+		int readyLayer; // Index of the most recently resampled layer
+		int fusedLayer; // Index of the layer currently used by the fusion thread
+		unsigned int readyVersion; // Version number of the most recently resampled layer
+		unsigned int fusedVersion; // Version number of the layer currently used by the fusion thread
+		};
+	
+	/* Elements: */
+	unsigned int gridSize[2]; // Width and height of the elevation grid
+	PTransform gridTransform; // Transformation from grid space (cell coordinates and elevation) to camera space
+	float cellSize; // Width and height of a grid cell in camera space units
+	unsigned int featherWidth; // Width of the band along depth frame borders in which confidence weights fall off, in pixels
+	unsigned int numCameras; // Number of contributing cameras
+	Camera* cameras; // Array of contributing cameras
+	Threads::MutexCond layerCond; // Condition variable to signal arrival of a new resampled layer
+	unsigned int layerVersion; // Version number of the most recently resampled layer across all cameras
+	unsigned int lastCameraIndex; // Index of the camera that resampled the most recent layer
+	volatile bool runFusionThread; // Flag to keep the background fusion thread running
+	Threads::Thread fusionThread; // The background fusion thread
+	float* elevations; // Elevations of the most recent fused height field, retained in grid cells no camera currently sees
+	unsigned int numTiles[2]; // Number of tiles covering the elevation grid in x and y
+	unsigned int frameStamp; // Sequence number of the most recent output frame
+	unsigned int* tileStamps; // Sequence numbers of the most recent output frames in which each tile changed
+	Kinect::WorkerPool workerPool; // Pool of threads blending bands of tile rows in parallel
+	float* bandOutputFrame; // Output frame written by the current band job
+	Threads::TripleBuffer<FilteredFrame> outputFrames; // Triple buffer of output frames and their tile stamps
+	OutputFrameFunction* outputFrameFunction; // Function called when a new fused height field is ready
+	
+	/* Private methods: */
+	void resampleFrame(Camera& camera,const Kinect::FrameBuffer& frame,Layer& layer); // Resamples the given filtered depth frame of the given camera into the given layer
+	void blendBand(unsigned int bandIndex,int tileRowBegin,int tileRowEnd); // Blends a band of tile rows of all cameras' current layers into the output frame and stamps changed tiles
+	void* fusionThreadMethod(void); // Method for the background fusion thread
+	
+	/* Constructors and destructors: */
+	public:
+	HeightFieldFuser(unsigned int sNumCameras,const unsigned int sGridSize[2],const Plane& basePlane,const Point basePlaneCorners[4],unsigned int numThreads =0); // Creates a fuser for the given number of cameras producing an elevation grid of the given size covering the given base plane quadrilateral in camera space, blended by the given number of threads (number of CPUs if zero)
+	private:
+	HeightFieldFuser(const HeightFieldFuser& source); // Prohibit copy constructor
+	HeightFieldFuser& operator=(const HeightFieldFuser& source); // Prohibit assignment operator
+	public:
+	~HeightFieldFuser(void); // Destroys the fuser
+	
+	/* Methods: */
+	const unsigned int* getGridSize(void) const // Returns the width and height of the elevation grid
+		{
+		return gridSize;
+		}
+	Kinect::FrameSource::IntrinsicParameters getIntrinsicParameters(void) const; // Returns intrinsic parameters of a virtual camera whose depth images are fused height fields, with elevations above the base plane as depth values
+	void setFeatherWidth(unsigned int newFeatherWidth); // Sets the width of the band along depth frame borders in which confidence weights fall off; must be called before setCamera
+	void setCamera(unsigned int cameraIndex,const unsigned int frameSize[2],const Kinect::FrameSource::IntrinsicParameters& ips,const PTransform& cameraTransform); // Sets the depth frame size and intrinsic parameters of the given camera, and the transformation from its camera space to the common camera space
+	void setOutputFrameFunction(OutputFrameFunction* newOutputFrameFunction); // Sets the output function; adopts given functor object
+	void receiveFilteredFrame(const FilteredFrame& frame,unsigned int cameraIndex); // Called to receive a new filtered depth frame from the given camera's frame filter; resamples the frame in the calling thread
+	};
+
+#endif
@@ -0,0 +1,198 @@
+/***********************************************************************
+LatencyTracker - Class to collect the trace records of depth frames that
+made it from the camera to the projector, to calculate rolling
+per-stage latency percentiles, and to dump traces to a binary file.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "LatencyTracker.h"
+
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <Misc/SizedTypes.h>
+#include <IO/OpenFile.h>
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+LatencyTracker::Percentiles calcLatencyPercentiles(std::vector<double>& latencies) // Calculates percentiles of the given list of latencies; sorts the list
+	{
+	LatencyTracker::Percentiles result;
+	result.numSamples=(unsigned int)(latencies.size());
+	if(!latencies.empty())
+		{
+		std::sort(latencies.begin(),latencies.end());
+		size_t last=latencies.size()-1;
+		result.p50=latencies[(last*50+50)/100];
+		result.p90=latencies[(last*90+50)/100];
+		result.p99=latencies[(last*99+50)/100];
+		result.max=latencies[last];
+		}
+	else
+		result.p50=result.p90=result.p99=result.max=0.0;
+	
+	return result;
+	}
+
+}
+
+/***************************************
+Static elements of class LatencyTracker:
+***************************************/
+
+const char* LatencyTracker::stageNames[LatencyTracker::NUM_STAGES]=
+	{
+	"Capture","Decode","Filter","Pickup","Upload","Water","Draw","Swap"
+	};
+
+/*******************************
+Methods of class LatencyTracker:
+*******************************/
+
+LatencyTracker::LatencyTracker(unsigned int sWindowSize)
+	:windowSize(sWindowSize>0?sWindowSize:1U),
+	 nextTraceIndex(0),numTraces(0)
+	{
+	traces.reserve(windowSize);
+	}
+
+LatencyTracker::~LatencyTracker(void)
+	{
+	}
+
+void LatencyTracker::addTrace(const Kinect::FrameBuffer::Trace& trace)
+	{
+	Threads::Mutex::Lock lock(mutex);
+	
+	/* Store the trace in the ring buffer: */
+	if(traces.size()<windowSize)
+		traces.push_back(trace);
+	else
+		traces[nextTraceIndex]=trace;
+	if(++nextTraceIndex==windowSize)
+		nextTraceIndex=0;
+	++numTraces;
+	
+	if(traceFile!=0)
+		{
+		/* Write the trace to the trace file, writing zero times for unrecorded stages: */
+		traceFile->write<Misc::UInt32>(trace.stampMask&((0x1U<<NUM_STAGES)-1U));
+		for(int stage=0;stage<NUM_STAGES;++stage)
+			traceFile->write<Misc::Float64>(trace.isStamped(stage)?trace.times[stage]:0.0);
+		}
+	}
+
+void LatencyTracker::startTraceFile(const char* traceFileName)
+	{
+	/* Open the new trace file before closing the current one: */
+	IO::FilePtr newTraceFile=IO::openFile(traceFileName,IO::File::WriteOnly);
+	newTraceFile->setEndianness(Misc::LittleEndian);
+	
+	/*********************************************************************
+	Write the trace file header: an identification string, the number of
+	stages, and the stages' names as length-prefixed strings. Each trace
+	record following the header contains a 32-bit bit mask of recorded
+	stages, followed by one 64-bit time in seconds on the monotonic clock
+	per stage.
+	*********************************************************************/
+	
+	static const char header[]="SARndbox latency trace v1.0\n";
+	newTraceFile->write<char>(header,sizeof(header)-1);
+	newTraceFile->write<Misc::UInt32>(NUM_STAGES);
+	for(int stage=0;stage<NUM_STAGES;++stage)
+		{
+		Misc::UInt32 nameLength=Misc::UInt32(strlen(stageNames[stage]));
+		newTraceFile->write<Misc::UInt32>(nameLength);
+		newTraceFile->write<char>(stageNames[stage],nameLength);
+		}
+	
+	/* Install the new trace file: */
+	Threads::Mutex::Lock lock(mutex);
+	traceFile=newTraceFile;
+	}
+
+void LatencyTracker::stopTraceFile(void)
+	{
+	Threads::Mutex::Lock lock(mutex);
+	traceFile=0;
+	}
+
+LatencyTracker::Percentiles LatencyTracker::calcPercentiles(int stage) const
+	{
+	Threads::Mutex::Lock lock(mutex);
+	
+	/* Collect the latencies between the given stage and the closest preceding recorded stage in all traces recording the given stage: */
+	std::vector<double> latencies;
+	latencies.reserve(traces.size());
+	for(std::vector<Kinect::FrameBuffer::Trace>::const_iterator tIt=traces.begin();tIt!=traces.end();++tIt)
+		if(tIt->isStamped(stage))
+			{
+			int previous;
+			for(previous=stage-1;previous>=0&&!tIt->isStamped(previous);--previous)
+				;
+			if(previous>=0)
+				latencies.push_back(tIt->times[stage]-tIt->times[previous]);
+			}
+	
+	return calcLatencyPercentiles(latencies);
+	}
+
+LatencyTracker::Percentiles LatencyTracker::calcTotalPercentiles(void) const
+	{
+	Threads::Mutex::Lock lock(mutex);
+	
+	/* Collect the latencies between the first and last recorded stages of all traces: */
+	std::vector<double> latencies;
+	latencies.reserve(traces.size());
+	for(std::vector<Kinect::FrameBuffer::Trace>::const_iterator tIt=traces.begin();tIt!=traces.end();++tIt)
+		{
+		int first,last;
+		for(first=0;first<NUM_STAGES&&!tIt->isStamped(first);++first)
+			;
+		for(last=NUM_STAGES-1;last>first&&!tIt->isStamped(last);--last)
+			;
+		if(first<last)
+			latencies.push_back(tIt->times[last]-tIt->times[first]);
+		}
+	
+	return calcLatencyPercentiles(latencies);
+	}
+
+void LatencyTracker::printStatistics(std::ostream& os) const
+	{
+	size_t totalNumTraces;
+	{
+	Threads::Mutex::Lock lock(mutex);
+	totalNumTraces=numTraces;
+	}
+	os<<"Frame latencies over the last "<<std::min(totalNumTraces,size_t(windowSize))<<" of "<<totalNumTraces<<" frames (p50/p90/p99/max in ms):"<<std::endl;
+	for(int stage=1;stage<NUM_STAGES;++stage)
+		{
+		Percentiles p=calcPercentiles(stage);
+		if(p.numSamples>0)
+			os<<"  "<<stageNames[stage]<<": "<<p.p50*1000.0<<" / "<<p.p90*1000.0<<" / "<<p.p99*1000.0<<" / "<<p.max*1000.0<<" ("<<p.numSamples<<" frames)"<<std::endl;
+		}
+	Percentiles p=calcTotalPercentiles();
+	if(p.numSamples>0)
+		os<<"  Total: "<<p.p50*1000.0<<" / "<<p.p90*1000.0<<" / "<<p.p99*1000.0<<" / "<<p.max*1000.0<<std::endl;
+	}
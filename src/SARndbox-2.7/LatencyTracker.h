@@ -0,0 +1,82 @@
+/***********************************************************************
+LatencyTracker - Class to collect the trace records of depth frames that
+made it from the camera to the projector, to calculate rolling
+per-stage latency percentiles, and to dump traces to a binary file.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef LATENCYTRACKER_INCLUDED
+#define LATENCYTRACKER_INCLUDED
+
+#include <vector>
+#include <iosfwd>
+#include <Threads/Mutex.h>
+#include <IO/File.h>
+#include <Kinect/FrameBuffer.h>
+
+class LatencyTracker
+	{
+	/* Embedded classes: */
+	public:
+	enum Stage // Enumerated type for the processing stages recorded in depth frames' traces
+		{
+		CAPTURE=Kinect::FrameBuffer::CAPTURE, // Camera started receiving the raw depth frame
+		DECODE=Kinect::FrameBuffer::DECODE, // Camera finished decoding the raw depth frame
+		FILTER=Kinect::FrameBuffer::FIRST_USER_TRACE_STAGE, // Frame filter posted the filtered frame derived from the raw depth frame
+		PICKUP, // Frame method picked up the filtered frame
+		UPLOAD, // Depth image renderer uploaded the filtered frame into a depth texture
+		WATER, // Display method finished updating the water simulation from the filtered frame
+		DRAW, // Display method finished rendering the filtered frame
+		SWAP, // Rendered image was presented, as observed by the next frame method
+		NUM_STAGES
+		};
+	
+	struct Percentiles // Structure holding latency percentiles of a stage in seconds
+		{
+		/* Elements: */
+		public:
+		unsigned int numSamples; // Number of traces that recorded the stage
+		double p50,p90,p99,max; // Median, 90th and 99th percentile, and maximum latency
+		};
+	
+	/* Elements: */
+	static const char* stageNames[NUM_STAGES]; // Names of all stages
+	private:
+	mutable Threads::Mutex mutex; // Mutex serializing access to the tracker's state
+	unsigned int windowSize; // Number of most recent traces used to calculate rolling statistics
+	std::vector<Kinect::FrameBuffer::Trace> traces; // Ring buffer of the most recent traces
+	unsigned int nextTraceIndex; // Index of the ring buffer slot to receive the next trace
+	size_t numTraces; // Total number of traces added to the tracker
+	IO::FilePtr traceFile; // File to which all added traces are written, or null
+	
+	/* Constructors and destructors: */
+	public:
+	LatencyTracker(unsigned int sWindowSize); // Creates a latency tracker calculating statistics over the given number of most recent traces
+	~LatencyTracker(void);
+	
+	/* Methods: */
+	void addTrace(const Kinect::FrameBuffer::Trace& trace); // Adds the trace of a frame that completed its last stage
+	void startTraceFile(const char* traceFileName); // Writes all subsequently added traces to a binary trace file of the given name; throws exception if file can not be created
+	void stopTraceFile(void); // Closes the current binary trace file
+	Percentiles calcPercentiles(int stage) const; // Returns the percentiles of the latency between the given stage and the closest preceding recorded stage over the current window
+	Percentiles calcTotalPercentiles(void) const; // Returns the percentiles of the latency between the first and last recorded stage over the current window
+	void printStatistics(std::ostream& os) const; // Prints rolling per-stage and total latency percentiles to the given stream
+	};
+
+#endif
@@ -0,0 +1,551 @@
+/***********************************************************************
+PipelineBenchmark - Utility to replay pre-recorded or synthetic depth
+and color streams through the sandbox's CPU processing stages without a
+camera or a GPU, and report throughput, per-stage latencies, dropped
+frames, and dynamic memory allocations in machine-readable form.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <new>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <Misc/ThrowStdErr.h>
+#include <Misc/FunctionCalls.h>
+#include <Threads/Atomic.h>
+#include <Threads/MutexCond.h>
+#include <Realtime/Time.h>
+#include <IO/OpenFile.h>
+#include <Math/Math.h>
+#include <Math/Constants.h>
+#include <Kinect/FrameBuffer.h>
+#include <Kinect/FramePool.h>
+#include <Kinect/FrameSource.h>
+#include <Kinect/FileFrameSource.h>
+
+#include "Types.h"
+#include "FrameFilter.h"
+#include "HandExtractor.h"
+#include "RainMaker.h"
+#include "BenchmarkHelper.h"
+
+namespace {
+
+/****************
+Helper variables:
+****************/
+
+Threads::Atomic<size_t> numAllocations(0); // Number of dynamic memory allocations since program start
+Threads::Atomic<size_t> numAllocatedBytes(0); // Number of dynamically allocated bytes since program start
+
+}
+
+/*************************************************
+Global allocation operators counting allocations:
+*************************************************/
+
+void* operator new(size_t size)
+	{
+	numAllocations.preAdd(1);
+	numAllocatedBytes.preAdd(size);
+	void* result=malloc(size>0?size:1);
+	if(result==0)
+		throw std::bad_alloc();
+	return result;
+	}
+
+void* operator new[](size_t size)
+	{
+	return operator new(size);
+	}
+
+void operator delete(void* ptr) throw()
+	{
+	free(ptr);
+	}
+
+void operator delete[](void* ptr) throw()
+	{
+	free(ptr);
+	}
+
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+enum StageIndex // Enumerated type for pipeline stages
+	{
+	FRAMEFILTER=0,HANDEXTRACTOR,RAINMAKER,NUM_STAGES
+	};
+
+const char* stageNames[NUM_STAGES]={"FrameFilter","HandExtractor","RainMaker"};
+
+const double histogramBounds[]={0.25,0.5,1.0,2.0,4.0,8.0,16.0,32.0,64.0,128.0,256.0}; // Upper bounds of latency histogram bins in ms; the last bin is open-ended
+const int numHistogramBins=sizeof(histogramBounds)/sizeof(double)+1;
+
+class PipelineMonitor // Class to track which frames are processed by each pipeline stage and measure the stages' latencies
+	{
+	/* Embedded classes: */
+	public:
+	struct Stage // Structure holding the processing state and statistics of a pipeline stage
+		{
+		/* Elements: */
+		public:
+		int busyFrame; // Index of the frame currently processed by the stage, or -1 if the stage is idle
+		int waitingFrame; // Index of the most recent frame delivered while the stage was busy, or -1 if there is none
+		unsigned int numOutputs; // Number of results produced by the stage
+		size_t numResults; // Total number of hands or objects reported by the stage
+		std::vector<double> latencies; // Latencies of all results in seconds
+		
+		/* Constructors and destructors: */
+		Stage(void)
+			:busyFrame(-1),waitingFrame(-1),numOutputs(0),numResults(0)
+			{
+			}
+		};
+	
+	/* Elements: */
+	Threads::MutexCond cond; // Condition variable serializing frame delivery and result reception, and signaling results
+	std::vector<Realtime::TimePointMonotonic> sendTimes; // Time points at which each frame was delivered to the pipeline
+	Stage stages[NUM_STAGES]; // States of all pipeline stages
+	
+	/* Private methods: */
+	void receiveResult(int stageIndex,size_t numResults) // Called with the monitor locked when the given stage produces a result
+		{
+		Realtime::TimePointMonotonic now;
+		Stage& s=stages[stageIndex];
+		
+		/* Attribute the result to the frame the stage was working on: */
+		if(s.busyFrame>=0)
+			s.latencies.push_back(double(now-sendTimes[s.busyFrame]));
+		++s.numOutputs;
+		s.numResults+=numResults;
+		
+		/* Continue with the most recent frame delivered in the meantime, or go idle: */
+		s.busyFrame=s.waitingFrame;
+		s.waitingFrame=-1;
+		cond.broadcast();
+		}
+	
+	/* Methods: */
+	public:
+	void frameDelivered(unsigned int frameIndex) // Called with the monitor locked when the given frame is delivered to all stages
+		{
+		if(sendTimes.size()<=frameIndex)
+			sendTimes.resize(frameIndex+1);
+		sendTimes[frameIndex].set();
+		for(int i=0;i<NUM_STAGES;++i)
+			{
+			if(stages[i].busyFrame<0)
+				stages[i].busyFrame=int(frameIndex);
+			else
+				stages[i].waitingFrame=int(frameIndex);
+			}
+		}
+	bool isIdle(void) const // Returns true if all stages are idle
+		{
+		bool result=true;
+		for(int i=0;i<NUM_STAGES;++i)
+			result=result&&stages[i].busyFrame<0;
+		return result;
+		}
+	void resetStatistics(void) // Resets all stages' statistics
+		{
+		for(int i=0;i<NUM_STAGES;++i)
+			{
+			stages[i].numOutputs=0;
+			stages[i].numResults=0;
+			stages[i].latencies.clear();
+			}
+		}
+	void receiveFilteredFrame(const FilteredFrame& frame)
+		{
+		Threads::MutexCond::Lock lock(cond);
+		receiveResult(FRAMEFILTER,0);
+		}
+	void receiveHands(const HandExtractor::HandList& hands)
+		{
+		Threads::MutexCond::Lock lock(cond);
+		receiveResult(HANDEXTRACTOR,hands.size());
+		}
+	void receiveBlobs(const RainMaker::BlobList& blobs)
+		{
+		Threads::MutexCond::Lock lock(cond);
+		receiveResult(RAINMAKER,blobs.size());
+		}
+	};
+
+/****************
+Helper functions:
+****************/
+
+Kinect::FrameBuffer createSyntheticFrame(const unsigned int frameSize[2],unsigned int frameIndex) // Creates a synthetic depth frame showing a noisy tilted sand surface and two objects moving above it
+	{
+	Kinect::FrameBuffer frame=createSyntheticDepthFrame(frameSize,900,20,0,1);
+	int offset=int(frameIndex*4)%int(frameSize[0]/2);
+	int radius=int(frameSize[1]/12);
+	drawDepthDisc(frame,int(frameSize[0]/4)+offset,int(frameSize[1]/2),radius,700);
+	drawDepthDisc(frame,int(frameSize[0]*3/4)-offset,int(frameSize[1]*2/3),radius,720);
+	
+	return frame;
+	}
+
+}
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	const char* frameFilePrefix=0;
+	unsigned int syntheticSize[2]={0,0};
+	unsigned int numThreads=0;
+	unsigned int maxNumFrames=300;
+	unsigned int numWarmupFrames=30;
+	unsigned int numBenchmarkFrames=300;
+	double frameRate=0.0;
+	Plane basePlane(Plane::Vector(0,0,1),0);
+	double elevationRange[2]={650.0,850.0};
+	bool tracking=false;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"h")==0)
+				{
+				std::cout<<"Usage: PipelineBenchmark [option 1] ... [option n] (<frame file prefix> | -synthetic <width> <height>)"<<std::endl;
+				std::cout<<"  Options:"<<std::endl;
+				std::cout<<"  -h"<<std::endl;
+				std::cout<<"     Prints this help message"<<std::endl;
+				std::cout<<"  -synthetic <width> <height>"<<std::endl;
+				std::cout<<"     Processes synthetic depth frames of the given size instead of"<<std::endl;
+				std::cout<<"     pre-recorded frames"<<std::endl;
+				std::cout<<"  -nt <number of threads>"<<std::endl;
+				std::cout<<"     Number of frame filter and hand extractor threads"<<std::endl;
+				std::cout<<"     Default: number of CPUs"<<std::endl;
+				std::cout<<"  -mf <max num frames>"<<std::endl;
+				std::cout<<"     Maximum number of pre-recorded frames to load into memory"<<std::endl;
+				std::cout<<"     Default: "<<maxNumFrames<<std::endl;
+				std::cout<<"  -w <num frames>"<<std::endl;
+				std::cout<<"     Number of warm-up frames processed before measuring"<<std::endl;
+				std::cout<<"     Default: "<<numWarmupFrames<<std::endl;
+				std::cout<<"  -n <num frames>"<<std::endl;
+				std::cout<<"     Number of frames to measure, cycling through loaded frames"<<std::endl;
+				std::cout<<"     Default: "<<numBenchmarkFrames<<std::endl;
+				std::cout<<"  -rate <frame rate>"<<std::endl;
+				std::cout<<"     Delivers frames at the given rate in Hz, dropping frames in stages"<<std::endl;
+				std::cout<<"     that fall behind; 0 delivers each frame as soon as all stages"<<std::endl;
+				std::cout<<"     finished the previous one"<<std::endl;
+				std::cout<<"     Default: "<<frameRate<<std::endl;
+				std::cout<<"  -bp <normal x> <normal y> <normal z> <offset>"<<std::endl;
+				std::cout<<"     Base plane equation for the rain maker in camera space"<<std::endl;
+				std::cout<<"     Default: 0 0 1 0"<<std::endl;
+				std::cout<<"  -er <min elevation> <max elevation>"<<std::endl;
+				std::cout<<"     Elevation range of rain-making objects relative to the base plane"<<std::endl;
+				std::cout<<"     Default: "<<elevationRange[0]<<" "<<elevationRange[1]<<std::endl;
+				std::cout<<"  -track"<<std::endl;
+				std::cout<<"     Enables the rain maker's region of interest tracking mode"<<std::endl;
+				return 0;
+				}
+			else if(strcasecmp(argv[i]+1,"synthetic")==0)
+				{
+				for(int j=0;j<2;++j)
+					{
+					++i;
+					syntheticSize[j]=(unsigned int)(atoi(argv[i]));
+					}
+				}
+			else if(strcasecmp(argv[i]+1,"nt")==0)
+				{
+				++i;
+				numThreads=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"mf")==0)
+				{
+				++i;
+				maxNumFrames=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"w")==0)
+				{
+				++i;
+				numWarmupFrames=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"n")==0)
+				{
+				++i;
+				numBenchmarkFrames=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"rate")==0)
+				{
+				++i;
+				frameRate=atof(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"bp")==0)
+				{
+				Plane::Vector normal;
+				for(int j=0;j<3;++j)
+					{
+					++i;
+					normal[j]=Scalar(atof(argv[i]));
+					}
+				++i;
+				basePlane=Plane(normal,Scalar(atof(argv[i])));
+				}
+			else if(strcasecmp(argv[i]+1,"er")==0)
+				{
+				for(int j=0;j<2;++j)
+					{
+					++i;
+					elevationRange[j]=atof(argv[i]);
+					}
+				}
+			else if(strcasecmp(argv[i]+1,"track")==0)
+				tracking=true;
+			else
+				std::cerr<<"Ignoring unrecognized command line option "<<argv[i]<<std::endl;
+			}
+		else
+			frameFilePrefix=argv[i];
+		}
+	if(frameFilePrefix==0&&(syntheticSize[0]==0||syntheticSize[1]==0))
+		{
+		std::cerr<<"No frame file prefix or synthetic frame size provided; use -h for help"<<std::endl;
+		return 1;
+		}
+	if(numBenchmarkFrames==0)
+		{
+		std::cerr<<"No frames to measure; use -h for help"<<std::endl;
+		return 1;
+		}
+	
+	try
+		{
+		unsigned int frameSize[2];
+		unsigned int colorFrameSize[2];
+		std::vector<Kinect::FrameBuffer> depthFrames;
+		std::vector<Kinect::FrameBuffer> colorFrames;
+		FrameFilter::PixelDepthCorrection* pixelDepthCorrection=0;
+		PTransform depthProjection=PTransform::identity;
+		PTransform colorProjection=PTransform::identity;
+		if(frameFilePrefix!=0)
+			{
+			/* Open the selected pre-recorded 3D video files: */
+			std::string colorFileName=frameFilePrefix;
+			colorFileName.append(".color");
+			std::string depthFileName=frameFilePrefix;
+			depthFileName.append(".depth");
+			Kinect::FileFrameSource source(IO::openFile(colorFileName.c_str()),IO::openFile(depthFileName.c_str()));
+			for(int i=0;i<2;++i)
+				{
+				frameSize[i]=source.getActualFrameSize(Kinect::FrameSource::DEPTH)[i];
+				colorFrameSize[i]=source.getActualFrameSize(Kinect::FrameSource::COLOR)[i];
+				}
+			Kinect::FrameSource::IntrinsicParameters ips=source.getIntrinsicParameters();
+			depthProjection=ips.depthProjection;
+			colorProjection=ips.colorProjection;
+			
+			/* Evaluate the per-pixel depth correction parameters: */
+			Kinect::FrameSource::DepthCorrection* depthCorrection=source.getDepthCorrectionParameters();
+			if(depthCorrection!=0)
+				{
+				pixelDepthCorrection=depthCorrection->getPixelCorrection(frameSize);
+				delete depthCorrection;
+				}
+			
+			/* Decompress depth and color frames into memory so that decompression does not skew the measurements: */
+			while(depthFrames.size()<maxNumFrames)
+				{
+				Kinect::FrameBuffer depthFrame=source.readNextDepthFrame();
+				Kinect::FrameBuffer colorFrame=source.readNextColorFrame();
+				if(depthFrame.timeStamp>=Math::Constants<double>::max||colorFrame.timeStamp>=Math::Constants<double>::max)
+					break;
+				depthFrames.push_back(depthFrame);
+				colorFrames.push_back(colorFrame);
+				}
+			if(depthFrames.empty())
+				Misc::throwStdErr("No depth and color frames in files %s and %s",depthFileName.c_str(),colorFileName.c_str());
+			}
+		else
+			{
+			/* Create synthetic depth frames and a black color frame: */
+			for(int i=0;i<2;++i)
+				colorFrameSize[i]=frameSize[i]=syntheticSize[i];
+			srand(0);
+			for(unsigned int frameIndex=0;frameIndex<Math::min(maxNumFrames,61U);++frameIndex)
+				depthFrames.push_back(createSyntheticFrame(frameSize,frameIndex));
+			Kinect::FrameBuffer colorFrame(colorFrameSize[0],colorFrameSize[1],colorFrameSize[1]*colorFrameSize[0]*3);
+			memset(colorFrame.getData<unsigned char>(),0,colorFrameSize[1]*colorFrameSize[0]*3);
+			colorFrames.push_back(colorFrame);
+			}
+		if(pixelDepthCorrection==0)
+			{
+			/* Create dummy per-pixel depth correction parameters: */
+			pixelDepthCorrection=createDummyPixelDepthCorrection(frameSize);
+			}
+		
+		/* Create the pipeline stages and connect them to the monitor: */
+		PipelineMonitor monitor;
+		FrameFilter frameFilter(frameSize,30,pixelDepthCorrection,depthProjection,basePlane,numThreads);
+		frameFilter.setOutputFrameFunction(Misc::createFunctionCall(&monitor,&PipelineMonitor::receiveFilteredFrame));
+		HandExtractor handExtractor(frameSize,pixelDepthCorrection,depthProjection,numThreads);
+		handExtractor.setHandsExtractedFunction(Misc::createFunctionCall(&monitor,&PipelineMonitor::receiveHands));
+		RainMaker rainMaker(frameSize,colorFrameSize,depthProjection,colorProjection,basePlane,elevationRange[0],elevationRange[1],20);
+		rainMaker.setTrackingParameters(tracking,16,8,2);
+		rainMaker.setOutputBlobsFunction(Misc::createFunctionCall(&monitor,&PipelineMonitor::receiveBlobs));
+		std::cerr<<"Processing "<<numWarmupFrames<<" warm-up and "<<numBenchmarkFrames<<" measured frames of size "<<frameSize[0]<<" x "<<frameSize[1]<<std::endl;
+		
+		/* Process the warm-up frames and the measured frames: */
+		Realtime::TimeVector framePeriod(frameRate>0.0?1.0/frameRate:0.0);
+		Realtime::TimePointMonotonic startTime;
+		Realtime::TimePointMonotonic nextFrameTime;
+		size_t allocationsStart=0;
+		size_t allocatedBytesStart=0;
+		Kinect::FramePool& framePool=Kinect::FramePool::getDefaultPool();
+		Kinect::FramePool::Statistics poolStart=framePool.getStatistics();
+		unsigned int numFrames=numWarmupFrames+numBenchmarkFrames;
+		for(unsigned int frameIndex=0;frameIndex<numFrames;++frameIndex)
+			{
+			bool lockstep=frameRate<=0.0||frameIndex<numWarmupFrames;
+			if(frameIndex==numWarmupFrames)
+				{
+				/* Start measuring: */
+				Threads::MutexCond::Lock monitorLock(monitor.cond);
+				monitor.resetStatistics();
+				startTime.set();
+				nextFrameTime=startTime;
+				allocationsStart=numAllocations.get();
+				allocatedBytesStart=numAllocatedBytes.get();
+				poolStart=framePool.getStatistics();
+				}
+			if(!lockstep)
+				{
+				/* Wait for the frame's delivery time, or deliver immediately if the previous delivery overran its period: */
+				Realtime::TimePointMonotonic::sleep(nextFrameTime);
+				nextFrameTime+=framePeriod;
+				}
+			
+			/* Deliver the next frame to all stages: */
+			Threads::MutexCond::Lock monitorLock(monitor.cond);
+			monitor.frameDelivered(frameIndex);
+			const Kinect::FrameBuffer& depthFrame=depthFrames[frameIndex%depthFrames.size()];
+			frameFilter.receiveRawFrame(depthFrame);
+			handExtractor.receiveRawFrame(depthFrame);
+			rainMaker.receiveRawColorFrame(colorFrames[frameIndex%colorFrames.size()]);
+			rainMaker.receiveRawDepthFrame(depthFrame);
+			
+			/* Wait until all stages finished the frame in lock-step mode: */
+			if(lockstep)
+				while(!monitor.isIdle())
+					monitor.cond.wait(monitorLock);
+			}
+		
+		/* Wait for all stages to finish their current frames: */
+		{
+		Threads::MutexCond::Lock monitorLock(monitor.cond);
+		while(!monitor.isIdle())
+			monitor.cond.wait(monitorLock);
+		}
+		Realtime::TimePointMonotonic endTime;
+		double duration=double(endTime-startTime);
+		size_t allocations=numAllocations.get()-allocationsStart;
+		size_t allocatedBytes=numAllocatedBytes.get()-allocatedBytesStart;
+		Kinect::FramePool::Statistics poolEnd=framePool.getStatistics();
+		
+		/* Print the results as a JSON object: */
+		std::cout<<std::fixed<<std::setprecision(4);
+		std::cout<<"{"<<std::endl;
+		std::cout<<"\t\"frameSize\": ["<<frameSize[0]<<", "<<frameSize[1]<<"],"<<std::endl;
+		std::cout<<"\t\"mode\": \""<<(frameRate>0.0?"paced":"lockstep")<<"\","<<std::endl;
+		std::cout<<"\t\"frameRate\": "<<frameRate<<","<<std::endl;
+		std::cout<<"\t\"frames\": "<<numBenchmarkFrames<<","<<std::endl;
+		std::cout<<"\t\"duration\": "<<duration<<","<<std::endl;
+		std::cout<<"\t\"throughput\": "<<double(numBenchmarkFrames)/duration<<","<<std::endl;
+		std::cout<<"\t\"allocationsPerFrame\": "<<double(allocations)/double(numBenchmarkFrames)<<","<<std::endl;
+		std::cout<<"\t\"allocatedBytesPerFrame\": "<<double(allocatedBytes)/double(numBenchmarkFrames)<<","<<std::endl;
+		std::cout<<"\t\"framePool\": {";
+		std::cout<<"\"allocations\": "<<poolEnd.numAllocations-poolStart.numAllocations;
+		std::cout<<", \"recycled\": "<<poolEnd.numRecycled-poolStart.numRecycled;
+		std::cout<<", \"releases\": "<<poolEnd.numReleases-poolStart.numReleases;
+		std::cout<<", \"freed\": "<<poolEnd.numFreed-poolStart.numFreed;
+		std::cout<<", \"pooledBlocks\": "<<poolEnd.numPooledBlocks;
+		std::cout<<", \"pooledBytes\": "<<poolEnd.numPooledBytes<<"},"<<std::endl;
+		std::cout<<"\t\"latencyHistogramBounds\": [";
+		for(int bin=0;bin<numHistogramBins-1;++bin)
+			std::cout<<(bin>0?", ":"")<<histogramBounds[bin];
+		std::cout<<"],"<<std::endl;
+		std::cout<<"\t\"stages\": ["<<std::endl;
+		for(int stageIndex=0;stageIndex<NUM_STAGES;++stageIndex)
+			{
+			const PipelineMonitor::Stage& s=monitor.stages[stageIndex];
+			std::vector<double> sorted=s.latencies;
+			std::sort(sorted.begin(),sorted.end());
+			double latencySum=0.0;
+			unsigned int histogram[numHistogramBins];
+			for(int bin=0;bin<numHistogramBins;++bin)
+				histogram[bin]=0;
+			for(std::vector<double>::iterator lIt=sorted.begin();lIt!=sorted.end();++lIt)
+				{
+				latencySum+=*lIt;
+				int bin;
+				for(bin=0;bin<numHistogramBins-1&&*lIt*1000.0>histogramBounds[bin];++bin)
+					;
+				++histogram[bin];
+				}
+			
+			std::cout<<"\t\t{"<<std::endl;
+			std::cout<<"\t\t\"name\": \""<<stageNames[stageIndex]<<"\","<<std::endl;
+			std::cout<<"\t\t\"outputs\": "<<s.numOutputs<<","<<std::endl;
+			std::cout<<"\t\t\"droppedFrames\": "<<(numBenchmarkFrames>s.numOutputs?numBenchmarkFrames-s.numOutputs:0U)<<","<<std::endl;
+			std::cout<<"\t\t\"throughput\": "<<double(s.numOutputs)/duration<<","<<std::endl;
+			if(stageIndex!=FRAMEFILTER)
+				std::cout<<"\t\t\"resultsPerFrame\": "<<(s.numOutputs>0?double(s.numResults)/double(s.numOutputs):0.0)<<","<<std::endl;
+			if(!sorted.empty())
+				{
+				std::cout<<"\t\t\"latency\": {";
+				std::cout<<"\"mean\": "<<latencySum*1000.0/double(sorted.size());
+				std::cout<<", \"min\": "<<sorted.front()*1000.0;
+				std::cout<<", \"p50\": "<<percentile(sorted,0.5)*1000.0;
+				std::cout<<", \"p90\": "<<percentile(sorted,0.9)*1000.0;
+				std::cout<<", \"p99\": "<<percentile(sorted,0.99)*1000.0;
+				std::cout<<", \"max\": "<<sorted.back()*1000.0<<"},"<<std::endl;
+				}
+			std::cout<<"\t\t\"latencyHistogram\": [";
+			for(int bin=0;bin<numHistogramBins;++bin)
+				std::cout<<(bin>0?", ":"")<<histogram[bin];
+			std::cout<<"]"<<std::endl;
+			std::cout<<"\t\t}"<<(stageIndex<NUM_STAGES-1?",":"")<<std::endl;
+			}
+		std::cout<<"\t]"<<std::endl;
+		std::cout<<"}"<<std::endl;
+		
+		delete[] pixelDepthCorrection;
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"PipelineBenchmark: Terminated due to exception "<<err.what()<<std::endl;
+		return 1;
+		}
+	
+	return 0;
+	}
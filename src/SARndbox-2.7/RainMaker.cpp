@@ -22,7 +22,9 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "RainMaker.h"
 
+#include <algorithm>
 #include <Misc/FunctionCalls.h>
+#include <Math/Math.h>
 #include <Geometry/HVector.h>
 #include <Geometry/Plane.h>
 
@@ -198,24 +200,260 @@ class ValidPixelProperty // Functor class to identify valid pixels in raw depth
 		}
 	};
 
+class RegionPixelProperty // Adapter class to identify valid pixels in regions of interest or coarse versions of raw depth frames
+	{
+	/* Elements: */
+	private:
+	const ValidPixelProperty& vpp; // Pixel validity decider for entire depth frames
+	unsigned int offset[2]; // Position of the region's first pixel in the depth frame
+	unsigned int scale; // Number of depth frame pixels per region pixel along each axis
+	
+	/* Constructors and destructors: */
+	public:
+	RegionPixelProperty(const ValidPixelProperty& sVpp,unsigned int offsetX,unsigned int offsetY,unsigned int sScale)
+		:vpp(sVpp),scale(sScale)
+		{
+		offset[0]=offsetX;
+		offset[1]=offsetY;
+		}
+	
+	/* Methods: */
+	template <class PixelParam>
+	bool operator()(unsigned int x,unsigned int y,const PixelParam& pixel) const
+		{
+		return vpp(x*scale+offset[0],y*scale+offset[1],pixel);
+		}
+	};
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+inline bool overlap(const unsigned int min0[2],const unsigned int max0[2],const unsigned int min1[2],const unsigned int max1[2]) // Returns true if the two given half-open boxes overlap or touch
+	{
+	return min0[0]<=max1[0]&&min1[0]<=max0[0]&&min0[1]<=max1[1]&&min1[1]<=max0[1];
+	}
+
+}
+
 /**************************
 Methods of class RainMaker:
 **************************/
 
 template <class DepthPixelParam>
 inline
-void RainMaker::extractBlobs(const Kinect::FrameBuffer& depthFrame,const ValidPixelProperty& vpp,RainMaker::BlobList& blobsCc)
+void RainMaker::findBlobsInRegion(const Kinect::FrameBuffer& depthFrame,const ValidPixelProperty& vpp,BlobFinder<DepthPixelParam>& blobFinder,const RainMaker::Region& region,unsigned int regionIndex,std::vector<RainMaker::DetectedBlob>& blobsDic)
+	{
+	std::vector< ::Blob<DepthPixelParam> > blobs;
+	if(region.min[0]==0&&region.min[1]==0&&region.max[0]==depthSize[0]&&region.max[1]==depthSize[1])
+		{
+		/* Extract raw blobs from the entire depth frame: */
+		blobFinder.findBlobs(depthSize,depthFrame.getData<DepthPixelParam>(),vpp,blobs);
+		}
+	else
+		{
+		/* Copy the region of interest into a contiguous buffer: */
+		unsigned int regionSize[2];
+		for(int i=0;i<2;++i)
+			regionSize[i]=region.max[i]-region.min[i];
+		regionBuffer.resize(size_t(regionSize[1])*size_t(regionSize[0])*sizeof(DepthPixelParam));
+		DepthPixelParam* rbPtr=reinterpret_cast<DepthPixelParam*>(&regionBuffer[0]);
+		const DepthPixelParam* dfRowPtr=depthFrame.getData<DepthPixelParam>()+(size_t(region.min[1])*size_t(depthSize[0])+region.min[0]);
+		for(unsigned int y=0;y<regionSize[1];++y,dfRowPtr+=depthSize[0],rbPtr+=regionSize[0])
+			std::copy(dfRowPtr,dfRowPtr+regionSize[0],rbPtr);
+		
+		/* Extract raw blobs from the region of interest: */
+		blobFinder.findBlobs(regionSize,reinterpret_cast<DepthPixelParam*>(&regionBuffer[0]),RegionPixelProperty(vpp,region.min[0],region.min[1],1),blobs);
+		}
+	
+	/* Store the blobs in depth image space: */
+	for(typename std::vector< ::Blob<DepthPixelParam> >::const_iterator bIt=blobs.begin();bIt!=blobs.end();++bIt)
+		{
+		DetectedBlob blob;
+		blob.centroid=bIt->blobProperty.calcCentroid();
+		blob.centroid[0]+=double(region.min[0]);
+		blob.centroid[1]+=double(region.min[1]);
+		for(int i=0;i<2;++i)
+			{
+			blob.min[i]=bIt->min[i]+region.min[i];
+			blob.max[i]=bIt->max[i]+region.min[i];
+			}
+		blob.regionIndex=regionIndex;
+		blobsDic.push_back(blob);
+		}
+	}
+
+template <class DepthPixelParam>
+inline
+void RainMaker::findCoarseRegions(const Kinect::FrameBuffer& depthFrame,const ValidPixelProperty& vpp,BlobFinder<DepthPixelParam>& blobFinder,std::vector<RainMaker::Region>& regions)
 	{
-	/* Extract raw blobs from the depth frame: */
-	std::vector< ::Blob<DepthPixelParam> > blobsDic=findBlobs(depthSize,depthFrame.getData<DepthPixelParam>(),vpp);
+	/* Subsample the depth frame by picking the center pixel of each coarse pixel's footprint: */
+	unsigned int scale=1U<<coarseLevel;
+	unsigned int coarseSize[2];
+	for(int i=0;i<2;++i)
+		coarseSize[i]=depthSize[i]>>coarseLevel;
+	if(coarseSize[0]==0||coarseSize[1]==0)
+		return;
+	regionBuffer.resize(size_t(coarseSize[1])*size_t(coarseSize[0])*sizeof(DepthPixelParam));
+	DepthPixelParam* cPtr=reinterpret_cast<DepthPixelParam*>(&regionBuffer[0]);
+	const DepthPixelParam* dfRowPtr=depthFrame.getData<DepthPixelParam>()+(size_t(scale/2)*size_t(depthSize[0])+scale/2);
+	for(unsigned int y=0;y<coarseSize[1];++y,dfRowPtr+=size_t(scale)*size_t(depthSize[0]))
+		{
+		const DepthPixelParam* dfPtr=dfRowPtr;
+		for(unsigned int x=0;x<coarseSize[0];++x,++cPtr,dfPtr+=scale)
+			*cPtr=*dfPtr;
+		}
+	
+	/* Extract raw blobs from the coarse frame: */
+	std::vector< ::Blob<DepthPixelParam> > blobs;
+	blobFinder.findBlobs(coarseSize,reinterpret_cast<DepthPixelParam*>(&regionBuffer[0]),RegionPixelProperty(vpp,scale/2,scale/2,scale),blobs);
+	
+	/* Create padded regions of interest around all coarse blobs that could be large enough at full resolution: */
+	unsigned int minCoarseSize=Math::max((unsigned int)(minBlobSize)>>coarseLevel,1U);
+	for(typename std::vector< ::Blob<DepthPixelParam> >::const_iterator bIt=blobs.begin();bIt!=blobs.end();++bIt)
+		if(bIt->max[0]-bIt->min[0]>=minCoarseSize&&bIt->max[1]-bIt->min[1]>=minCoarseSize)
+			{
+			Region region;
+			for(int i=0;i<2;++i)
+				{
+				region.min[i]=bIt->min[i]*scale>roiPadding+scale?bIt->min[i]*scale-roiPadding-scale:0U;
+				region.max[i]=Math::min((bIt->max[i]+1)*scale+roiPadding,depthSize[i]);
+				}
+			regions.push_back(region);
+			}
+	}
+
+template <class DepthPixelParam>
+inline
+void RainMaker::trackBlobs(const Kinect::FrameBuffer& depthFrame,const ValidPixelProperty& vpp,BlobFinder<DepthPixelParam>& blobFinder,std::vector<RainMaker::DetectedBlob>& blobsDic)
+	{
+	/* Predict regions of interest from the objects detected in the previous frame: */
+	std::vector<Region> regions;
+	for(std::vector<Track>::iterator tIt=tracks.begin();tIt!=tracks.end();++tIt)
+		{
+		Region region;
+		for(int i=0;i<2;++i)
+			{
+			int min=int(tIt->min[i])+tIt->velocity[i]-int(roiPadding);
+			int max=int(tIt->max[i])+tIt->velocity[i]+int(roiPadding);
+			region.min[i]=(unsigned int)(Math::clamp(min,0,int(depthSize[i])));
+			region.max[i]=(unsigned int)(Math::clamp(max,0,int(depthSize[i])));
+			}
+		if(region.min[0]<region.max[0]&&region.min[1]<region.max[1])
+			regions.push_back(region);
+		}
+	
+	/* Scan a coarse version of the entire frame every few frames to pick up new objects: */
+	if(numTrackedFrames%fullScanInterval==0)
+		findCoarseRegions(depthFrame,vpp,blobFinder,regions);
+	++numTrackedFrames;
+	
+	/* Merge overlapping regions of interest until all regions are disjoint: */
+	bool merged=true;
+	while(merged)
+		{
+		merged=false;
+		for(unsigned int i=0;i<regions.size();++i)
+			for(unsigned int j=regions.size()-1;j>i;--j)
+				if(overlap(regions[i].min,regions[i].max,regions[j].min,regions[j].max))
+					{
+					for(int k=0;k<2;++k)
+						{
+						regions[i].min[k]=Math::min(regions[i].min[k],regions[j].min[k]);
+						regions[i].max[k]=Math::max(regions[i].max[k],regions[j].max[k]);
+						}
+					regions[j]=regions.back();
+					regions.pop_back();
+					merged=true;
+					}
+		}
+	
+	/* Detect objects inside all regions of interest: */
+	std::vector<bool> regionValid(regions.size(),true);
+	for(unsigned int regionIndex=0;regionIndex<regions.size();++regionIndex)
+		{
+		/* Skip regions that have been absorbed by grown regions: */
+		if(!regionValid[regionIndex])
+			continue;
+		
+		Region& region=regions[regionIndex];
+		for(int pass=0;pass<4;++pass)
+			{
+			size_t firstBlob=blobsDic.size();
+			findBlobsInRegion(depthFrame,vpp,blobFinder,region,regionIndex,blobsDic);
+			
+			/* Grow the region around any objects that touch its interior borders: */
+			bool grown=false;
+			for(size_t b=firstBlob;b<blobsDic.size();++b)
+				for(int i=0;i<2;++i)
+					{
+					if(blobsDic[b].min[i]==region.min[i]&&region.min[i]>0)
+						{
+						region.min[i]=blobsDic[b].min[i]>roiPadding?blobsDic[b].min[i]-roiPadding:0U;
+						grown=true;
+						}
+					if(blobsDic[b].max[i]==region.max[i]&&region.max[i]<depthSize[i])
+						{
+						region.max[i]=Math::min(blobsDic[b].max[i]+roiPadding,depthSize[i]);
+						grown=true;
+						}
+					}
+			if(!grown||pass==3)
+				break;
+			
+			/* Absorb all other regions that overlap the grown region and discard their objects: */
+			for(unsigned int j=0;j<regions.size();++j)
+				if(j!=regionIndex&&regionValid[j]&&overlap(region.min,region.max,regions[j].min,regions[j].max))
+					{
+					for(int k=0;k<2;++k)
+						{
+						region.min[k]=Math::min(region.min[k],regions[j].min[k]);
+						region.max[k]=Math::max(region.max[k],regions[j].max[k]);
+						}
+					regionValid[j]=false;
+					}
+			
+			/* Remove all objects found in this or absorbed regions before re-scanning: */
+			size_t dest=0;
+			for(size_t b=0;b<blobsDic.size();++b)
+				if(blobsDic[b].regionIndex!=regionIndex&&regionValid[blobsDic[b].regionIndex])
+					blobsDic[dest++]=blobsDic[b];
+			blobsDic.resize(dest);
+			}
+		}
+	}
+
+template <class DepthPixelParam>
+inline
+void RainMaker::extractBlobs(const Kinect::FrameBuffer& depthFrame,const ValidPixelProperty& vpp,BlobFinder<DepthPixelParam>& blobFinder,RainMaker::BlobList& blobsCc)
+	{
+	/* Detect objects in the depth frame: */
+	std::vector<DetectedBlob> blobsDic;
+	if(tracking)
+		trackBlobs(depthFrame,vpp,blobFinder,blobsDic);
+	else
+		{
+		/* Detect objects in the entire frame: */
+		Region frameRegion;
+		for(int i=0;i<2;++i)
+			{
+			frameRegion.min[i]=0;
+			frameRegion.max[i]=depthSize[i];
+			}
+		findBlobsInRegion(depthFrame,vpp,blobFinder,frameRegion,0,blobsDic);
+		numTrackedFrames=0;
+		}
 	
 	/* Transform all blobs larger than the threshold to camera space: */
+	std::vector<Track> newTracks;
 	blobsCc.reserve(blobsDic.size());
-	for(typename std::vector< ::Blob<DepthPixelParam> >::const_iterator bIt=blobsDic.begin();bIt!=blobsDic.end();++bIt)
-		if(bIt->max[0]-bIt->min[0]>=minBlobSize&&bIt->max[1]-bIt->min[1]>=minBlobSize)
+	for(std::vector<DetectedBlob>::const_iterator bIt=blobsDic.begin();bIt!=blobsDic.end();++bIt)
+		if(bIt->max[0]-bIt->min[0]>=(unsigned int)(minBlobSize)&&bIt->max[1]-bIt->min[1]>=(unsigned int)(minBlobSize))
 			{
 			Blob blobCc;
-			Point centroidDic=bIt->blobProperty.calcCentroid();
+			const Point& centroidDic=bIt->centroid;
 			blobCc.centroid=depthProjection.transform(centroidDic);
 			
 			/* Estimate the radius of the blob in camera space (this is admittedly ad-hoc): */
@@ -230,7 +468,36 @@ void RainMaker::extractBlobs(const Kinect::FrameBuffer& depthFrame,const ValidPi
 			
 			/* Store the blob: */
 			blobsCc.push_back(blobCc);
+			
+			if(tracking)
+				{
+				/* Find the closest object from the previous frame to estimate the object's velocity: */
+				Track track;
+				track.centroid=centroidDic;
+				for(int i=0;i<2;++i)
+					{
+					track.min[i]=bIt->min[i];
+					track.max[i]=bIt->max[i];
+					track.velocity[i]=0;
+					}
+				double maxDist2=Math::sqr(double(roiPadding)+double(Math::max(bIt->max[0]-bIt->min[0],bIt->max[1]-bIt->min[1])));
+				double bestDist2=maxDist2;
+				for(std::vector<Track>::const_iterator tIt=tracks.begin();tIt!=tracks.end();++tIt)
+					{
+					double dist2=Math::sqr(centroidDic[0]-tIt->centroid[0])+Math::sqr(centroidDic[1]-tIt->centroid[1]);
+					if(bestDist2>dist2)
+						{
+						bestDist2=dist2;
+						for(int i=0;i<2;++i)
+							track.velocity[i]=int(Math::floor(centroidDic[i]-tIt->centroid[i]+0.5));
+						}
+					}
+				newTracks.push_back(track);
+				}
 			}
+	
+	/* Follow the detected objects in the next frame: */
+	tracks.swap(newTracks);
 	}
 
 void* RainMaker::detectionThreadMethod(void)
@@ -241,6 +508,10 @@ void* RainMaker::detectionThreadMethod(void)
 	/* Create a pixel validity decider: */
 	ValidPixelProperty vpp(minPlane,maxPlane,colorDepthHomography,colorSize);
 	
+	/* Create blob finders for both depth pixel types that keep their buffers and threads between frames: */
+	BlobFinder<unsigned short> uintBlobFinder;
+	BlobFinder<float> floatBlobFinder;
+	
 	while(true)
 		{
 		Kinect::FrameBuffer depthFrame,colorFrame;
@@ -270,9 +541,9 @@ void* RainMaker::detectionThreadMethod(void)
 			/* Detect all objects in the depth frame between the min and max planes: */
 			BlobList blobsCc;
 			if(depthIsFloat)
-				extractBlobs<float>(depthFrame,vpp,blobsCc);
+				extractBlobs<float>(depthFrame,vpp,floatBlobFinder,blobsCc);
 			else
-				extractBlobs<unsigned short>(depthFrame,vpp,blobsCc);
+				extractBlobs<unsigned short>(depthFrame,vpp,uintBlobFinder,blobsCc);
 			
 			/* Call the callback function: */
 			(*outputBlobsFunction)(blobsCc);
@@ -284,7 +555,9 @@ void* RainMaker::detectionThreadMethod(void)
 
 RainMaker::RainMaker(const unsigned int sDepthSize[2],const unsigned int sColorSize[2],const RainMaker::PTransform& sDepthProjection,const RainMaker::PTransform& sColorProjection,const RainMaker::Plane& basePlane,double minElevation,double maxElevation,int sMinBlobSize)
 	:depthIsFloat(false),
-	 outputBlobsFunction(0)
+	 tracking(false),roiPadding(16),fullScanInterval(8),coarseLevel(2),
+	 outputBlobsFunction(0),
+	 numTrackedFrames(0)
 	{
 	/* Remember the frame sizes: */
 	for(int i=0;i<2;++i)
@@ -354,6 +627,14 @@ void RainMaker::setDepthIsFloat(bool newDepthIsFloat)
 	depthIsFloat=newDepthIsFloat;
 	}
 
+void RainMaker::setTrackingParameters(bool newTracking,unsigned int newRoiPadding,unsigned int newFullScanInterval,unsigned int newCoarseLevel)
+	{
+	tracking=newTracking;
+	roiPadding=newRoiPadding;
+	fullScanInterval=Math::max(newFullScanInterval,1U);
+	coarseLevel=newCoarseLevel;
+	}
+
 void RainMaker::setOutputBlobsFunction(RainMaker::OutputBlobsFunction* newOutputBlobsFunction)
 	{
 	delete outputBlobsFunction;
@@ -41,6 +41,8 @@ template <class ScalarParam,int dimensionParam>
 class Plane;
 }
 class ValidPixelProperty;
+template <class PixelParam>
+class BlobFinder;
 
 class RainMaker
 	{
@@ -62,6 +64,32 @@ class RainMaker
 	typedef std::vector<Blob> BlobList; // Type for lists of detected objects
 	typedef Misc::FunctionCall<const BlobList&> OutputBlobsFunction; // Type for functions called when a new object list has been extracted
 	
+	private:
+	struct Region // Structure for rectangular regions of interest in depth image space
+		{
+		/* Elements: */
+		public:
+		unsigned int min[2],max[2]; // Half-open pixel range of the region
+		};
+	
+	struct DetectedBlob // Structure to describe a detected object in depth image space
+		{
+		/* Elements: */
+		public:
+		Point centroid; // Object's centroid in depth image space
+		unsigned int min[2],max[2]; // Half-open bounding box of the object in depth image space
+		unsigned int regionIndex; // Index of the region of interest in which the object was detected
+		};
+	
+	struct Track // Structure to follow an object detected in the previous frame
+		{
+		/* Elements: */
+		public:
+		Point centroid; // Object's centroid in depth image space in the previous frame
+		unsigned int min[2],max[2]; // Object's bounding box in depth image space in the previous frame
+		int velocity[2]; // Object's displacement in depth image space between the two previous frames
+		};
+	
 	/* Elements: */
 	private:
 	unsigned int depthSize[2]; // Width and height of incoming depth frames
@@ -73,6 +101,10 @@ class RainMaker
 	float minPlane[4]; // Plane equation of the lower bound of valid depth values in depth image space
 	float maxPlane[4]; // Plane equation of the upper bound of valid depth values in depth image space
 	int minBlobSize; // Minimum size of objects to be detected
+	bool tracking; // Flag whether objects are tracked inside regions of interest instead of detected in entire frames
+	unsigned int roiPadding; // Number of pixels by which predicted object bounding boxes are grown to form regions of interest
+	unsigned int fullScanInterval; // Number of frames between scans of entire coarse frames to detect new objects
+	unsigned int coarseLevel; // Downsampling level of coarse frames; coarse pixels cover 2^level x 2^level depth pixels
 	Threads::MutexCond inputCond; // Condition variable to signal arrival of a new input frame
 	Kinect::FrameBuffer inputDepthFrame; // The most recent input depth frame
 	unsigned int inputDepthFrameVersion; // Version number of input depth frame
@@ -82,9 +114,20 @@ class RainMaker
 	Threads::Thread detectionThread; // The background object detection thread
 	OutputBlobsFunction* outputBlobsFunction; // Function called when a new (potentially empty) object list has been extracted
 	
+	/* Tracking state, only accessed by the object detection thread: */
+	std::vector<Track> tracks; // Objects detected in the previous frame
+	unsigned int numTrackedFrames; // Number of frames processed since tracking was enabled
+	std::vector<char> regionBuffer; // Buffer holding a copy of a region of interest or a coarse depth frame
+	
 	/* Private methods: */
 	template <class DepthPixelParam>
-	void extractBlobs(const Kinect::FrameBuffer& depthFrame,const ValidPixelProperty& vpp,BlobList& blobsCc);
+	void findBlobsInRegion(const Kinect::FrameBuffer& depthFrame,const ValidPixelProperty& vpp,BlobFinder<DepthPixelParam>& blobFinder,const Region& region,unsigned int regionIndex,std::vector<DetectedBlob>& blobsDic); // Appends objects detected inside the given region of interest to the given list
+	template <class DepthPixelParam>
+	void findCoarseRegions(const Kinect::FrameBuffer& depthFrame,const ValidPixelProperty& vpp,BlobFinder<DepthPixelParam>& blobFinder,std::vector<Region>& regions); // Appends regions of interest around all objects detected in a coarse version of the given depth frame to the given list
+	template <class DepthPixelParam>
+	void trackBlobs(const Kinect::FrameBuffer& depthFrame,const ValidPixelProperty& vpp,BlobFinder<DepthPixelParam>& blobFinder,std::vector<DetectedBlob>& blobsDic); // Detects objects inside regions of interest predicted from the previous frame or found by coarse scans
+	template <class DepthPixelParam>
+	void extractBlobs(const Kinect::FrameBuffer& depthFrame,const ValidPixelProperty& vpp,BlobFinder<DepthPixelParam>& blobFinder,BlobList& blobsCc);
 	void* detectionThreadMethod(void); // Method for the object detection thread
 	
 	/* Constructors and destructors: */
@@ -94,6 +137,7 @@ class RainMaker
 	
 	/* Methods: */
 	void setDepthIsFloat(bool newDepthIsFloat); // Sets whether incoming depth frames have float pixel values
+	void setTrackingParameters(bool newTracking,unsigned int newRoiPadding,unsigned int newFullScanInterval,unsigned int newCoarseLevel); // Enables or disables tracking objects inside regions of interest, and sets the region padding, the interval between coarse full-frame scans, and the coarse downsampling level
 	void setOutputBlobsFunction(OutputBlobsFunction* newOutputBlobsFunction); // Sets the output function; adopts given functor object
 	void receiveRawDepthFrame(const Kinect::FrameBuffer& newDepthFrame); // Called to receive a new raw depth frame
 	void receiveRawColorFrame(const Kinect::FrameBuffer& newColorFrame); // Called to receive a new raw color frame
@@ -23,6 +23,12 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include "RemoteServer.h"
 
 #include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdexcept>
+#include <Misc/ThrowStdErr.h>
 #include <Misc/SizedTypes.h>
 #include <Misc/MessageLogger.h>
 #include <Math/Math.h>
@@ -42,7 +48,11 @@ Methods of class RemoteServer::Client:
 RemoteServer::Client::Client(RemoteServer* sServer)
 	:server(sServer),
 	 clientPipe(server->listenSocket),
-	 state(START)
+	 state(START),
+	 address(clientPipe.getPeerAddress()),
+	 protocolVersion(1),needKeyframe(true),
+	 sendOffset(0),waitingForWrite(false),
+	 numSentFrames(0),numDroppedFrames(0),numSentBytes(0)
 	{
 	}
 
@@ -77,6 +87,79 @@ void RemoteServer::disconnectClient(Client* client,bool removeListener)
 			}
 	}
 
+bool RemoteServer::sendQueuedMessages(RemoteServer::Client* client)
+	{
+	int fd=client->clientPipe.getFd();
+	while(!client->sendQueue.empty())
+		{
+		/* Write as much of the first message as the socket accepts: */
+		const std::vector<GridStreamCodec::Byte>& data=client->sendQueue.front()->data;
+		ssize_t writeResult=::write(fd,&data[client->sendOffset],data.size()-client->sendOffset);
+		if(writeResult>0)
+			{
+			client->sendOffset+=size_t(writeResult);
+			client->numSentBytes+=size_t(writeResult);
+			if(client->sendOffset==data.size())
+				{
+				/* Move on to the next message: */
+				client->sendQueue.pop_front();
+				client->sendOffset=0;
+				++client->numSentFrames;
+				}
+			}
+		else if(writeResult<0&&(errno==EAGAIN||errno==EWOULDBLOCK))
+			{
+			/* The socket's send buffer is full; try again when it becomes writable: */
+			return false;
+			}
+		else if(writeResult<0&&errno==EINTR)
+			{
+			/* Try again: */
+			}
+		else if(writeResult==0||errno==EPIPE||errno==ECONNRESET)
+			throw std::runtime_error("Connection terminated by peer");
+		else
+			{
+			char buffer[512];
+			throw std::runtime_error(Misc::printStdErrMsgReentrant(buffer,sizeof(buffer),"Fatal error %d (%s) while writing to client",errno,strerror(errno)));
+			}
+		}
+	
+	return true;
+	}
+
+void RemoteServer::makeRoomInQueue(RemoteServer::Client* client)
+	{
+	/* Drop unsent messages from the back of a full queue to make room for the latest message: */
+	while(client->sendQueue.size()>=maxQueueLength&&(client->sendQueue.size()>1||client->sendOffset==0))
+		{
+		client->sendQueue.pop_back();
+		++client->numDroppedFrames;
+		
+		/* Subsequent delta frames would refer to the dropped message; continue with a keyframe: */
+		client->needKeyframe=true;
+		}
+	}
+
+RemoteServer::GridMessagePtr RemoteServer::createFrameMessage(GridStreamCodec::FrameTypes frameType) const
+	{
+	GridMessagePtr result=new GridMessage;
+	
+	/* Write the message header with a placeholder for the code size: */
+	std::vector<GridStreamCodec::Byte>& data=result->data;
+	data.resize(1+sizeof(Misc::UInt32));
+	data[0]=GridStreamCodec::Byte(frameType);
+	
+	/* Append the encoded grid pair: */
+	GridStreamCodec::encode(numGridValues,&quantizedGrids[0][0],frameType==GridStreamCodec::DELTAFRAME?&quantizedGrids[1][0]:0,data);
+	
+	/* Fill in the code size in native byte order: */
+	Misc::UInt32 codeSize=Misc::UInt32(data.size()-(1+sizeof(Misc::UInt32)));
+	memcpy(&data[1],&codeSize,sizeof(Misc::UInt32));
+	
+	return result;
+	}
+
 bool RemoteServer::newConnectionCallback(Threads::EventDispatcher::ListenerKey eventKey,int eventType,void* userData)
 	{
 	/* Get a pointer to the server object: */
@@ -89,7 +172,7 @@ bool RemoteServer::newConnectionCallback(Threads::EventDispatcher::ListenerKey e
 		newClient=new Client(thisPtr);
 		
 		/* Send an endianness token to the client: */
-		newClient->clientPipe.write<Misc::UInt32>(0x12345678U);
+		newClient->clientPipe.write<Misc::UInt32>(GridStreamCodec::endiannessToken);
 		
 		/* Send the water table's grid size and cell size to the client: */
 		for(int i=0;i<2;++i)
@@ -128,17 +211,45 @@ bool RemoteServer::clientMessageCallback(Threads::EventDispatcher::ListenerKey e
 	
 	try
 		{
+		if(eventType&Threads::EventDispatcher::Write)
+			{
+			/* Continue sending queued messages, and stop listening for write readiness once the queue is drained: */
+			if(sendQueuedMessages(client))
+				{
+				server->dispatcher.setIOEventListenerEventTypeMaskFromCallback(eventKey,Threads::EventDispatcher::Read);
+				client->waitingForWrite=false;
+				}
+			
+			if(!(eventType&Threads::EventDispatcher::Read))
+				return false;
+			}
+		
 		/* Handle incoming message based on the client's state: */
 		switch(client->state)
 			{
 			case Client::START:
 				{
-				/* Read an endianness token: */
+				/* Read an endianness token, which also carries the client's protocol version: */
 				Misc::UInt32 token=client->clientPipe.read<Misc::UInt32>();
-				if(token==0x78563412U)
-					client->clientPipe.setSwapOnRead(true);
-				else if(token!=0x12345678U)
+				bool swapOnRead;
+				unsigned int clientProtocolVersion;
+				if(!GridStreamCodec::parseEndiannessToken(token,swapOnRead,clientProtocolVersion))
 					throw std::runtime_error("Invalid endianness token");
+				client->clientPipe.setSwapOnRead(swapOnRead);
+				
+				/* Negotiate the protocol version; version 1 clients do not expect a reply: */
+				client->protocolVersion=Math::min(clientProtocolVersion,GridStreamCodec::protocolVersion);
+				if(client->protocolVersion>=2)
+					{
+					client->clientPipe.write<Misc::UInt32>(client->protocolVersion);
+					client->clientPipe.flush();
+					}
+				
+				/* Switch the client's socket to non-blocking mode so that grid messages can be sent without stalling other clients: */
+				int fd=client->clientPipe.getFd();
+				int flags=fcntl(fd,F_GETFL);
+				if(flags<0||fcntl(fd,F_SETFL,flags|O_NONBLOCK)<0)
+					throw std::runtime_error("Unable to switch client socket to non-blocking mode");
 				
 				/* Go to the next state: */
 				client->state=Client::STREAMING;
@@ -202,57 +313,68 @@ void* RemoteServer::communicationThreadMethod(void)
 		/* Check if there is a new grid pair: */
 		if(grids.lockNewValue())
 			{
-			/* Send the new grid pair to all connected clients in streaming state: */
+			/* Quantize the new grid pair once for all clients: */
+			std::swap(quantizedGrids[0],quantizedGrids[1]);
+			GridStreamCodec::Value* quantized=&quantizedGrids[0][0];
+			size_t numBathymetryValues=size_t(gridSize[1]-1)*size_t(gridSize[0]-1);
+			GridStreamCodec::quantize(numBathymetryValues,grids.getLockedValue().bathymetry,elevationRange,quantized);
+			GridStreamCodec::quantize(numGridValues-numBathymetryValues,grids.getLockedValue().waterLevel,elevationRange,quantized+numBathymetryValues);
+			
+			/* Send a keyframe to all clients periodically, or if there is no previous grid pair to send a delta against: */
+			bool forceKeyframe=!haveQuantizedGrids||numDeltaFrames>=keyframeInterval;
+			if(forceKeyframe)
+				numDeltaFrames=0;
+			else
+				++numDeltaFrames;
+			haveQuantizedGrids=true;
+			
+			/* Queue the new grid pair for all connected clients in streaming state, creating each type of message at most once: */
+			GridMessagePtr frameMessages[2];
+			GridMessagePtr rawMessage;
 			std::vector<Client*> deadClients;
-			const GLfloat* bathymetry=grids.getLockedValue().bathymetry;
-			const GLfloat* waterLevel=grids.getLockedValue().waterLevel;
 			for(std::vector<Client*>::iterator cIt=clients.begin();cIt!=clients.end();++cIt)
 				if((*cIt)->state==Client::STREAMING)
 					{
-					/* Calculate elevation quantization factors: */
-					GLfloat eScale=65535.0f/(elevationRange[1]-elevationRange[0]);
-					GLfloat eOffset=0.5f-elevationRange[0]*eScale;
-					
+					Client* client=*cIt;
 					try
 						{
-						Comm::TCPPipe& clientPipe=(*cIt)->clientPipe;
-						
-						/* Send the bathymetry grid: */
-						const GLfloat* bPtr=bathymetry;
-						for(GLsizei y=0;y<gridSize[1]-1;++y)
-							for(GLsizei x=0;x<gridSize[0]-1;++x,++bPtr)
+						if(client->protocolVersion>=2)
+							{
+							/* Determine the frame type after making room in the queue, as dropping a queued message requires a keyframe: */
+							makeRoomInQueue(client);
+							GridStreamCodec::FrameTypes frameType=forceKeyframe||client->needKeyframe?GridStreamCodec::KEYFRAME:GridStreamCodec::DELTAFRAME;
+							if(frameMessages[frameType]==0)
+								frameMessages[frameType]=createFrameMessage(frameType);
+							client->sendQueue.push_back(frameMessages[frameType]);
+							client->needKeyframe=false;
+							}
+						else
+							{
+							/* Queue the raw quantized grid pair: */
+							if(rawMessage==0)
 								{
-								GLfloat se=*bPtr*eScale+eOffset;
-								if(se<=0.0f)
-									clientPipe.write<Misc::UInt16>(0U);
-								else if(se>=65535.0f)
-									clientPipe.write<Misc::UInt16>(65535U);
-								else
-									clientPipe.write<Misc::UInt16>(Misc::UInt16(se));
+								rawMessage=new GridMessage;
+								const GridStreamCodec::Byte* qBegin=reinterpret_cast<const GridStreamCodec::Byte*>(quantized);
+								rawMessage->data.assign(qBegin,qBegin+numGridValues*sizeof(GridStreamCodec::Value));
 								}
+							makeRoomInQueue(client);
+							client->sendQueue.push_back(rawMessage);
+							}
 						
-						/* Send the water level grid: */
-						const GLfloat* wlPtr=waterLevel;
-						for(GLsizei y=0;y<gridSize[1];++y)
-							for(GLsizei x=0;x<gridSize[0];++x,++wlPtr)
-								{
-								GLfloat se=*wlPtr*eScale+eOffset;
-								if(se<=0.0f)
-									clientPipe.write<Misc::UInt16>(0U);
-								else if(se>=65535.0f)
-									clientPipe.write<Misc::UInt16>(65535U);
-								else
-									clientPipe.write<Misc::UInt16>(Misc::UInt16(se));
-								}
-						
-						/* Finish the message: */
-						clientPipe.flush();
+						/* Send as much as possible right away, and wait for write readiness if the client's socket is backed up: */
+						bool drained=sendQueuedMessages(client);
+						if(drained==client->waitingForWrite)
+							{
+							/* The communication thread is not inside the dispatcher's wait, so the listener can be changed directly: */
+							dispatcher.setIOEventListenerEventTypeMaskFromCallback(client->listenerKey,drained?Threads::EventDispatcher::Read:Threads::EventDispatcher::ReadWrite);
+							client->waitingForWrite=!drained;
+							}
 						}
 					catch(const std::runtime_error& err)
 						{
 						/* Disconnect the client: */
 						Misc::formattedConsoleWarning("RemoteServer: Disconnecting client due to exception %s",err.what());
-						deadClients.push_back(*cIt);
+						deadClients.push_back(client);
 						}
 					}
 			
@@ -260,6 +382,23 @@ void* RemoteServer::communicationThreadMethod(void)
 			for(std::vector<Client*>::iterator dcIt=deadClients.begin();dcIt!=deadClients.end();++dcIt)
 				disconnectClient(*dcIt,true);
 			}
+		
+		/* Collect the streaming statistics of all connected clients in streaming state: */
+		std::vector<ClientStatistics>& statistics=clientStatistics.startNewValue();
+		statistics.clear();
+		for(std::vector<Client*>::iterator cIt=clients.begin();cIt!=clients.end();++cIt)
+			if((*cIt)->state==Client::STREAMING)
+				{
+				ClientStatistics cs;
+				cs.address=(*cIt)->address;
+				cs.protocolVersion=(*cIt)->protocolVersion;
+				cs.numSentFrames=(*cIt)->numSentFrames;
+				cs.numDroppedFrames=(*cIt)->numDroppedFrames;
+				cs.numQueuedFrames=(*cIt)->sendQueue.size();
+				cs.numSentBytes=(*cIt)->numSentBytes;
+				statistics.push_back(cs);
+				}
+		clientStatistics.postNewValue();
 		}
 	
 	return 0;
@@ -278,7 +417,9 @@ RemoteServer::RemoteServer(Sandbox* sSandbox,int listenPortId,double sRequestInt
 	:sandbox(sSandbox),
 	 listenSocket(listenPortId,0),
 	 numClients(0),
-	 requestInterval(sRequestInterval),nextRequestTime(0.0)
+	 maxQueueLength(2),
+	 requestInterval(sRequestInterval),nextRequestTime(0.0),
+	 haveQuantizedGrids(false),keyframeInterval(300),numDeltaFrames(0)
 	{
 	/* Ignore SIGPIPE and leave handling of pipe errors to TCP sockets: */
 	struct sigaction sigPipeAction;
@@ -305,6 +446,11 @@ RemoteServer::RemoteServer(Sandbox* sSandbox,int listenPortId,double sRequestInt
 	for(int i=0;i<3;++i)
 		grids.getBuffer(i).init(gridSize);
 	
+	/* Allocate the quantized grid pairs: */
+	numGridValues=size_t(gridSize[1]-1)*size_t(gridSize[0]-1)+size_t(gridSize[1])*size_t(gridSize[0]);
+	for(int i=0;i<2;++i)
+		quantizedGrids[i].resize(numGridValues);
+	
 	/* Start listening for incoming connections on the listening sockets: */
 	dispatcher.addIOEventListener(listenSocket.getFd(),Threads::EventDispatcher::Read,newConnectionCallback,this);
 	communicationThread.start(this,&RemoteServer::communicationThreadMethod);
@@ -323,8 +469,9 @@ RemoteServer::~RemoteServer(void)
 
 void RemoteServer::frame(double applicationTime)
 	{
-	/* Lock the most recent list of client positions: */
+	/* Lock the most recent lists of client positions and streaming statistics: */
 	clientPositions.lockNewValue();
+	clientStatistics.lockNewValue();
 	
 	/* Check if it's time to request a new set of grids: */
 	if(numClients>0&&applicationTime>=nextRequestTime)
@@ -23,7 +23,12 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef REMOTESERVER_INCLUDED
 #define REMOTESERVER_INCLUDED
 
+#include <string>
 #include <vector>
+#include <deque>
+#include <Misc/SizedTypes.h>
+#include <Misc/RefCounted.h>
+#include <Misc/Autopointer.h>
 #include <Threads/Thread.h>
 #include <Threads/TripleBuffer.h>
 #include <Threads/EventDispatcher.h>
@@ -35,6 +40,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <GL/gl.h>
 #include <Vrui/Geometry.h>
 
+#include "GridStreamCodec.h"
+
 /* Forward declarations: */
 class GLContextData;
 class Sandbox;
@@ -42,7 +49,29 @@ class Sandbox;
 class RemoteServer
 	{
 	/* Embedded classes: */
+	public:
+	struct ClientStatistics // Structure reporting the streaming state of a remote client for monitoring
+		{
+		/* Elements: */
+		public:
+		std::string address; // Client's network address
+		unsigned int protocolVersion; // Protocol version negotiated with the client
+		unsigned int numSentFrames; // Number of grid frames completely sent to the client
+		unsigned int numDroppedFrames; // Number of grid frames dropped from the client's send queue because the client fell behind
+		unsigned int numQueuedFrames; // Number of grid frames currently waiting in the client's send queue, including a partially sent frame
+		size_t numSentBytes; // Total number of bytes sent to the client
+		};
+	
 	private:
+	struct GridMessage:public Misc::RefCounted // Structure for encoded grid messages shared between the send queues of multiple clients
+		{
+		/* Elements: */
+		public:
+		std::vector<GridStreamCodec::Byte> data; // Message data as sent over the network
+		};
+	
+	typedef Misc::Autopointer<GridMessage> GridMessagePtr; // Type for pointers to shared grid messages
+	
 	struct GridBuffers // Structure representing a pair of grids
 		{
 		/* Elements: */
@@ -83,6 +112,15 @@ class RemoteServer
 		Comm::TCPPipe clientPipe; // Pipe connected to the remote client
 		Threads::EventDispatcher::ListenerKey listenerKey; // Key with which this client is listening for I/O events
 		ClientStates state; // Client's protocol state
+		std::string address; // Client's network address
+		unsigned int protocolVersion; // Protocol version negotiated with the client
+		bool needKeyframe; // Flag whether the next grid message queued for the client must be a keyframe
+		std::deque<GridMessagePtr> sendQueue; // Queue of grid messages waiting to be sent to the client
+		size_t sendOffset; // Number of bytes of the first message in the send queue that have already been sent
+		bool waitingForWrite; // Flag whether the client is listening for write readiness to drain its send queue
+		unsigned int numSentFrames; // Number of grid frames completely sent to the client
+		unsigned int numDroppedFrames; // Number of grid frames dropped from the send queue because the client fell behind
+		size_t numSentBytes; // Total number of bytes sent to the client
 		Vrui::Point position; // Client's current position in grid space
 		Vrui::Vector direction; // Client's current viewing direction in grid space
 		
@@ -101,12 +139,22 @@ class RemoteServer
 	std::vector<Client*> clients; // List of currently connected clients
 	unsigned int numClients; // Number of connected clients in streaming state
 	Threads::TripleBuffer<std::vector<Vrui::ONTransform> > clientPositions; // Triple buffer of lists of positions/orientations of connected clients
+	Threads::TripleBuffer<std::vector<ClientStatistics> > clientStatistics; // Triple buffer of lists of streaming statistics of connected clients
+	unsigned int maxQueueLength; // Maximum number of grid messages in each client's send queue, including a partially sent message
 	double requestInterval; // Time interval between requests fro new bathymetry and water level grids
 	double nextRequestTime; // Application time at which to request the next bathymetry and water level grids
 	Threads::TripleBuffer<GridBuffers> grids; // Triple buffer of arrays to receive bathymetry and water level grids
+	size_t numGridValues; // Total number of values in a pair of bathymetry and water level grids
+	std::vector<GridStreamCodec::Value> quantizedGrids[2]; // Most recent and previous grid pairs, quantized once for all clients
+	bool haveQuantizedGrids; // Flag whether the previous quantized grid pair is valid
+	unsigned int keyframeInterval; // Number of grid updates after which a keyframe is sent to all clients
+	unsigned int numDeltaFrames; // Number of delta frames sent since the last keyframe
 	
 	/* Private methods: */
 	void disconnectClient(Client* client,bool removeListener); // Disconnects the given client after a communications error
+	static bool sendQueuedMessages(Client* client); // Writes as much of the given client's send queue as possible without blocking; returns true if the queue was drained
+	void makeRoomInQueue(Client* client); // Drops unsent messages from the given client's full send queue to make room for a new message; requests a keyframe if messages were dropped
+	GridMessagePtr createFrameMessage(GridStreamCodec::FrameTypes frameType) const; // Encodes the current quantized grid pair into a new keyframe or delta frame message
 	static bool newConnectionCallback(Threads::EventDispatcher::ListenerKey eventKey,int eventType,void* userData); // Callback called when a connection attempt is made at the listening socket
 	static bool clientMessageCallback(Threads::EventDispatcher::ListenerKey eventKey,int eventType,void* userData); // Callback called when a message is received from a connected client
 	void* communicationThreadMethod(void); // Method handling communication with connected clients in the background
@@ -119,6 +167,10 @@ class RemoteServer
 	
 	/* Methods: */
 	void frame(double applicationTime); // Called from the AR Sandbox's frame method
+	const std::vector<ClientStatistics>& getClientStatistics(void) const // Returns the streaming statistics of all connected clients as of the most recent call to frame()
+		{
+		return clientStatistics.getLockedValue();
+		}
 	void glRenderAction(GLContextData& contextData) const; // Renders the remote server's current state
 	};
 
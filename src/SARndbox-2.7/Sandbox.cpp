@@ -49,6 +49,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Math/Constants.h>
 #include <Math/Interval.h>
 #include <Math/MathValueCoders.h>
+#include <Realtime/Time.h>
 #include <Geometry/Point.h>
 #include <Geometry/AffineCombiner.h>
 #include <Geometry/HVector.h>
@@ -69,6 +70,11 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <GL/Extensions/GLARBVertexShader.h>
 #include <GL/Extensions/GLARBFragmentShader.h>
 #include <GL/Extensions/GLARBMultitexture.h>
+#include <GL/Extensions/GLARBVertexBufferObject.h>
+#include <GL/Extensions/GLARBPixelBufferObject.h>
+#include <GL/Extensions/GLARBSync.h>
+#include <GL/Extensions/GLARBOcclusionQuery.h>
+#include <GL/Extensions/GLARBTimerQuery.h>
 #include <GL/GLContextData.h>
 #include <GL/GLGeometryWrappers.h>
 #include <GL/GLTransformationWrappers.h>
@@ -100,13 +106,17 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #endif
 
 #include "FrameFilter.h"
+#include "HeightFieldFuser.h"
 #include "DepthImageRenderer.h"
 #include "ElevationColorMap.h"
 #include "DEM.h"
 #include "SurfaceRenderer.h"
 #include "WaterTable2.h"
+#include "BathymetryResampler.h"
 #include "HandExtractor.h"
+#include "LatencyTracker.h"
 #include "RemoteServer.h"
+#include "GridRecorder.h"
 #include "WaterRenderer.h"
 #include "GlobalWaterTool.h"
 #include "LocalWaterTool.h"
@@ -121,7 +131,10 @@ Methods of class Sandbox::DataItem:
 
 Sandbox::DataItem::DataItem(void)
 	:waterTableTime(0.0),
-	 shadowFramebufferObject(0),shadowDepthTextureObject(0)
+	 shadowFramebufferObject(0),shadowDepthTextureObject(0),
+	 haveAsyncReadback(false),gridReadbackFence(0),gridReadbackStallTime(0.0),gridReadbackFrames(0),
+	 haveTimerQuery(false),firstWaterTimerQuery(0),numPendingWaterTimerQueries(0),
+	 bathymetryVersion(0)
 	{
 	/* Check if all required extensions are supported: */
 	bool supported=GLEXTFramebufferObject::isSupported();
@@ -146,6 +159,26 @@ Sandbox::DataItem::DataItem(void)
 	GLARBVertexShader::initExtension();
 	GLARBFragmentShader::initExtension();
 	GLARBMultitexture::initExtension();
+	
+	/* Initialize the optional extensions to read back grids asynchronously: */
+	haveAsyncReadback=GLARBVertexBufferObject::isSupported()&&GLARBPixelBufferObject::isSupported()&&GLARBSync::isSupported();
+	if(haveAsyncReadback)
+		{
+		GLARBVertexBufferObject::initExtension();
+		GLARBPixelBufferObject::initExtension();
+		GLARBSync::initExtension();
+		}
+	gridReadbackBufferObjects[0]=gridReadbackBufferObjects[1]=0;
+	
+	/* Initialize the optional extensions to measure the GPU time of water simulation steps: */
+	haveTimerQuery=GLARBOcclusionQuery::isSupported()&&GLARBTimerQuery::isSupported();
+	if(haveTimerQuery)
+		{
+		GLARBOcclusionQuery::initExtension();
+		GLARBTimerQuery::initExtension();
+		}
+	for(int i=0;i<4;++i)
+		waterTimerQueries[i]=0;
 	}
 
 Sandbox::DataItem::~DataItem(void)
@@ -153,6 +186,14 @@ Sandbox::DataItem::~DataItem(void)
 	/* Delete all shaders, buffers, and texture objects: */
 	glDeleteFramebuffersEXT(1,&shadowFramebufferObject);
 	glDeleteTextures(1,&shadowDepthTextureObject);
+	if(haveAsyncReadback)
+		{
+		if(gridReadbackFence!=0)
+			glDeleteSync(gridReadbackFence);
+		glDeleteBuffersARB(2,gridReadbackBufferObjects);
+		}
+	if(haveTimerQuery)
+		glDeleteQueriesARB(4,waterTimerQueries);
 	}
 
 /****************************************
@@ -256,10 +297,17 @@ void Sandbox::rawDepthFrameDispatcher(const Kinect::FrameBuffer& frameBuffer)
 		handExtractor->receiveRawFrame(frameBuffer);
 	}
 
-void Sandbox::receiveFilteredFrame(const Kinect::FrameBuffer& frameBuffer)
+void Sandbox::secondaryDepthFrameDispatcher(const Kinect::FrameBuffer& frameBuffer,unsigned int secondaryCameraIndex)
+	{
+	/* Pass the received frame to the secondary camera's frame filter: */
+	if(!pauseUpdates)
+		secondaryCameras[secondaryCameraIndex].frameFilter->receiveRawFrame(frameBuffer);
+	}
+
+void Sandbox::receiveFilteredFrame(const FilteredFrame& frame)
 	{
 	/* Put the new frame into the frame input buffer: */
-	filteredFrames.postNewValue(frameBuffer);
+	filteredFrames.postNewValue(frame);
 	
 	/* Wake up the foreground thread: */
 	Vrui::requestUpdate();
@@ -318,6 +366,105 @@ void Sandbox::addWater(GLContextData& contextData) const
 		}
 	}
 
+void Sandbox::readGrid(Sandbox::DataItem* dataItem,bool async,int gridIndex,GLfloat* gridBuffer) const
+	{
+	if(async)
+		{
+		/* Read the currently bound grid texture into the grid's pixel buffer object without waiting for the result: */
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->gridReadbackBufferObjects[gridIndex]);
+		glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,0);
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+		}
+	else
+		{
+		/* Read the currently bound grid texture directly, which waits for all pending rendering commands: */
+		glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,gridBuffer);
+		}
+	}
+
+void Sandbox::finishGridReadback(Sandbox::DataItem* dataItem) const
+	{
+	Realtime::TimePointMonotonic checkStart;
+	++dataItem->gridReadbackFrames;
+	
+	/* Check whether the read-back commands have been executed without waiting for them: */
+	if(glClientWaitSync(dataItem->gridReadbackFence,GL_SYNC_FLUSH_COMMANDS_BIT,0)!=GL_TIMEOUT_EXPIRED)
+		{
+		glDeleteSync(dataItem->gridReadbackFence);
+		dataItem->gridReadbackFence=0;
+		
+		/* Copy the requested grids from their pixel buffer objects; CPU-resampled bathymetry grids were copied directly: */
+		GridRequest::Request& request=dataItem->gridReadbackRequest;
+		if(request.bathymetryBuffer!=0&&bathymetryResampler==0)
+			{
+			glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->gridReadbackBufferObjects[0]);
+			GLsizeiptrARB gridSize=GLsizeiptrARB(waterTable->getBathymetrySize(0))*GLsizeiptrARB(waterTable->getBathymetrySize(1))*sizeof(GLfloat);
+			glGetBufferSubDataARB(GL_PIXEL_PACK_BUFFER_ARB,0,gridSize,request.bathymetryBuffer);
+			}
+		if(request.waterLevelBuffer!=0)
+			{
+			glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->gridReadbackBufferObjects[1]);
+			GLsizeiptrARB gridSize=GLsizeiptrARB(waterTable->getSize()[0])*GLsizeiptrARB(waterTable->getSize()[1])*sizeof(GLfloat);
+			glGetBufferSubDataARB(GL_PIXEL_PACK_BUFFER_ARB,0,gridSize,request.waterLevelBuffer);
+			}
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+		
+		/* Finish the grid request: */
+		dataItem->gridReadbackStallTime+=double(Realtime::TimePointMonotonic()-checkStart);
+		gridRequest.completeRequest(request,dataItem->gridReadbackStallTime,dataItem->gridReadbackFrames);
+		}
+	else
+		dataItem->gridReadbackStallTime+=double(Realtime::TimePointMonotonic()-checkStart);
+	}
+
+void Sandbox::collectWaterTimerQueries(Sandbox::DataItem* dataItem) const
+	{
+	/* Collect results from the oldest pending timer queries until one is not available yet: */
+	while(dataItem->numPendingWaterTimerQueries>0)
+		{
+		GLuint query=dataItem->waterTimerQueries[dataItem->firstWaterTimerQuery];
+		GLint available=0;
+		glGetQueryObjectivARB(query,GL_QUERY_RESULT_AVAILABLE_ARB,&available);
+		if(!available)
+			break;
+		GLuint64 elapsedTime;
+		glGetQueryObjectui64v(query,GL_QUERY_RESULT_ARB,&elapsedTime);
+		
+		/* Update the step time estimate with the simulation pass's GPU time: */
+		{
+		Threads::Mutex::Lock statisticsLock(waterStepStatisticsMutex);
+		waterStepStatistics.addStepTime(double(elapsedTime)*1.0e-9,dataItem->waterTimerQuerySteps[dataItem->firstWaterTimerQuery]);
+		}
+		
+		dataItem->firstWaterTimerQuery=(dataItem->firstWaterTimerQuery+1)%4;
+		--dataItem->numPendingWaterTimerQueries;
+		}
+	}
+
+void Sandbox::startGridRecording(const char* gridRecordingFileName)
+	{
+	if(waterTable==0)
+		{
+		std::cerr<<"Cannot record grids without a water simulation"<<std::endl;
+		return;
+		}
+	if(gridRecorder!=0)
+		{
+		std::cerr<<"Cannot record grids into "<<gridRecordingFileName<<" while another grid recording is active"<<std::endl;
+		return;
+		}
+	
+	try
+		{
+		/* Create a grid recorder: */
+		gridRecorder=new GridRecorder(this,gridRecordingFileName,gridRecordingInterval,gridRecordingChunkSize);
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"Cannot create grid recording file "<<gridRecordingFileName<<" due to exception "<<err.what()<<std::endl;
+		}
+	}
+
 void Sandbox::pauseUpdatesCallback(GLMotif::ToggleButton::ValueChangedCallbackData* cbData)
 	{
 	pauseUpdates=cbData->set;
@@ -422,6 +569,19 @@ GLMotif::PopupWindow* Sandbox::createWaterControlDialog(void)
 	
 	frameRateMargin->manageChild();
 	
+	new GLMotif::Label("WaterLagLabel",waterControlDialog,"Lag %");
+	
+	GLMotif::Margin* waterLagMargin=new GLMotif::Margin("WaterLagMargin",waterControlDialog,false);
+	waterLagMargin->setAlignment(GLMotif::Alignment::LEFT);
+	
+	waterLagTextField=new GLMotif::TextField("WaterLagTextField",waterLagMargin,8);
+	waterLagTextField->setFieldWidth(7);
+	waterLagTextField->setPrecision(1);
+	waterLagTextField->setFloatFormat(GLMotif::TextField::FIXED);
+	waterLagTextField->setValue(0.0);
+	
+	waterLagMargin->manageChild();
+	
 	new GLMotif::Label("WaterAttenuationLabel",waterControlDialog,"Attenuation");
 	
 	waterAttenuationSlider=new GLMotif::TextFieldSlider("WaterAttenuationSlider",waterControlDialog,8,ss.fontHeight*10.0f);
@@ -461,6 +621,12 @@ void printUsage(void)
 	std::cout<<"  -f <frame file name prefix>"<<std::endl;
 	std::cout<<"     Reads a pre-recorded 3D video stream from a pair of color/depth"<<std::endl;
 	std::cout<<"     files of the given file name prefix"<<std::endl;
+	std::cout<<"  -fuse"<<std::endl;
+	std::cout<<"     Fuses the depth frames of all calibrated cameras served by a Kinect"<<std::endl;
+	std::cout<<"     server selected via -p into a single height field"<<std::endl;
+	std::cout<<"  -fgs <fused grid width> <fused grid height>"<<std::endl;
+	std::cout<<"     Sets the width and height of the fused height field's grid"<<std::endl;
+	std::cout<<"     Default: 640 480"<<std::endl;
 	std::cout<<"  -s <scale factor>"<<std::endl;
 	std::cout<<"     Scale factor from real sandbox to simulated terrain"<<std::endl;
 	std::cout<<"     Default: 100.0 (1:100 scale, 1cm in sandbox is 1m in terrain"<<std::endl;
@@ -481,6 +647,13 @@ void printUsage(void)
 	std::cout<<"     Sets the frame filter parameters minimum number of valid samples"<<std::endl;
 	std::cout<<"     and maximum sample variance before convergence"<<std::endl;
 	std::cout<<"     Default: 10 2"<<std::endl;
+	std::cout<<"  -ews"<<std::endl;
+	std::cout<<"     Uses exponentially weighted running statistics in the frame filter"<<std::endl;
+	std::cout<<"     instead of averaging slots, reducing memory usage and latency"<<std::endl;
+	std::cout<<"  -fnt <num filter threads>"<<std::endl;
+	std::cout<<"     Sets the number of threads processing each frame in the frame filter;"<<std::endl;
+	std::cout<<"     0 uses all CPUs"<<std::endl;
+	std::cout<<"     Default: 2"<<std::endl;
 	std::cout<<"  -he <hysteresis envelope>"<<std::endl;
 	std::cout<<"     Sets the size of the hysteresis envelope used for jitter removal"<<std::endl;
 	std::cout<<"     Default: 0.1"<<std::endl;
@@ -491,6 +664,32 @@ void printUsage(void)
 	std::cout<<"     Sets the relative speed of the water simulation and the maximum"<<std::endl;
 	std::cout<<"     number of simulation steps per frame"<<std::endl;
 	std::cout<<"     Default: 1.0 30"<<std::endl;
+	std::cout<<"  -wfb <water frame budget>"<<std::endl;
+	std::cout<<"     Limits the number of water simulation steps per frame to fit into the"<<std::endl;
+	std::cout<<"     given time budget in ms, based on measured step times; 0 disables"<<std::endl;
+	std::cout<<"     the budget"<<std::endl;
+	std::cout<<"     Default: 0"<<std::endl;
+	std::cout<<"  -wcpu"<<std::endl;
+	std::cout<<"     Runs the water flow simulation on the CPU instead of the GPU"<<std::endl;
+	std::cout<<"  -wst <water simulation rate>"<<std::endl;
+	std::cout<<"     Runs the water flow simulation on the CPU in a dedicated thread at"<<std::endl;
+	std::cout<<"     the given rate in Hz, decoupled from the rendering frame rate; 0"<<std::endl;
+	std::cout<<"     runs the simulation in the rendering loop; implies -wcpu"<<std::endl;
+	std::cout<<"     Default: 0"<<std::endl;
+	std::cout<<"  -wnt <num water simulation threads>"<<std::endl;
+	std::cout<<"     Sets the number of threads running the water flow simulation on the"<<std::endl;
+	std::cout<<"     CPU; 0 uses all CPUs"<<std::endl;
+	std::cout<<"     Default: 4"<<std::endl;
+	std::cout<<"  -srb"<<std::endl;
+	std::cout<<"     Reads back bathymetry and water level grids synchronously instead of"<<std::endl;
+	std::cout<<"     through pixel buffer objects"<<std::endl;
+	std::cout<<"  -cbr"<<std::endl;
+	std::cout<<"     Resamples filtered depth frames into the bathymetry grid on the CPU"<<std::endl;
+	std::cout<<"     instead of rendering them into the grid on the GPU"<<std::endl;
+	std::cout<<"  -bnt <num bathymetry resampler threads>"<<std::endl;
+	std::cout<<"     Sets the number of threads resampling the bathymetry grid on the CPU;"<<std::endl;
+	std::cout<<"     0 uses all CPUs"<<std::endl;
+	std::cout<<"     Default: 2"<<std::endl;
 	std::cout<<"  -rer <min rain elevation> <max rain elevation>"<<std::endl;
 	std::cout<<"     Sets the elevation range of the rain cloud level relative to the"<<std::endl;
 	std::cout<<"     ground plane in cm"<<std::endl;
@@ -498,6 +697,10 @@ void printUsage(void)
 	std::cout<<"  -rs <rain strength>"<<std::endl;
 	std::cout<<"     Sets the strength of global or local rainfall in cm/s"<<std::endl;
 	std::cout<<"     Default: 0.25"<<std::endl;
+	std::cout<<"  -hnt <num hand extractor threads>"<<std::endl;
+	std::cout<<"     Sets the number of threads labeling and classifying blobs in the"<<std::endl;
+	std::cout<<"     hand extractor; 0 uses all CPUs"<<std::endl;
+	std::cout<<"     Default: 2"<<std::endl;
 	std::cout<<"  -evr <evaporation rate>"<<std::endl;
 	std::cout<<"     Water evaporation rate in cm/s"<<std::endl;
 	std::cout<<"     Default: 0.0"<<std::endl;
@@ -542,22 +745,58 @@ void printUsage(void)
 	std::cout<<"     Default: 2.0"<<std::endl;
 	std::cout<<"  -cp <control pipe name>"<<std::endl;
 	std::cout<<"     Sets the name of a named POSIX pipe from which to read control commands"<<std::endl;
+	std::cout<<"  -ltf <latency trace file name>"<<std::endl;
+	std::cout<<"     Writes the latency trace records of all presented depth frames to the"<<std::endl;
+	std::cout<<"     given binary file"<<std::endl;
+	std::cout<<"  -grf <grid recording file name>"<<std::endl;
+	std::cout<<"     Records bathymetry and water level grids into the given grid recording file"<<std::endl;
+	std::cout<<"  -gri <grid recording interval>"<<std::endl;
+	std::cout<<"     Sets the time between recorded bathymetry and water level grids in seconds"<<std::endl;
+	std::cout<<"     Default: 1.0"<<std::endl;
+	}
+
+Kinect::FrameSource::DepthCorrection::PixelCorrection* createPixelDepthCorrection(Kinect::FrameSource& camera,const unsigned int frameSize[2]) // Evaluates the given camera's per-pixel depth correction parameters on its depth frame's pixel grid
+	{
+	Kinect::FrameSource::DepthCorrection::PixelCorrection* result;
+	
+	/* Get the camera's per-pixel depth correction parameters: */
+	Kinect::FrameSource::DepthCorrection* depthCorrection=camera.getDepthCorrectionParameters();
+	if(depthCorrection!=0)
+		{
+		result=depthCorrection->getPixelCorrection(frameSize);
+		delete depthCorrection;
+		}
+	else
+		{
+		/* Create dummy per-pixel depth correction parameters: */
+		result=new Kinect::FrameSource::DepthCorrection::PixelCorrection[frameSize[1]*frameSize[0]];
+		Kinect::FrameSource::DepthCorrection::PixelCorrection* pdcPtr=result;
+		for(unsigned int y=0;y<frameSize[1];++y)
+			for(unsigned int x=0;x<frameSize[0];++x,++pdcPtr)
+				{
+				pdcPtr->scale=1.0f;
+				pdcPtr->offset=0.0f;
+				}
+		}
+	
+	return result;
 	}
 
 }
 
 Sandbox::Sandbox(int& argc,char**& argv)
 	:Vrui::Application(argc,argv),
-	 remoteServer(0),
+	 remoteServer(0),gridRecorder(0),
 	 camera(0),pixelDepthCorrection(0),
-	 frameFilter(0),pauseUpdates(false),
+	 frameFilter(0),heightFieldFuser(0),pauseUpdates(false),latencyTracker(0),
 	 depthImageRenderer(0),
-	 waterTable(0),
+	 waterTable(0),bathymetryResampler(0),bathymetryGrid(0),bathymetryVersion(0),lastWaterSubmitTime(-1.0),
 	 handExtractor(0),addWaterFunction(0),addWaterFunctionRegistered(false),
+	 asyncGridReadback(true),gridRecordingInterval(1.0),gridRecordingChunkSize(60),
 	 sun(0),
 	 activeDem(0),
 	 mainMenu(0),pauseUpdatesToggle(0),waterControlDialog(0),
-	 waterSpeedSlider(0),waterMaxStepsSlider(0),frameRateTextField(0),waterAttenuationSlider(0),
+	 waterSpeedSlider(0),waterMaxStepsSlider(0),frameRateTextField(0),waterLagTextField(0),waterAttenuationSlider(0),
 	 controlPipeFd(-1)
 	{
 	/* Read the sandbox's default configuration parameters: */
@@ -581,6 +820,8 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	unsigned int numAveragingSlots=cfg.retrieveValue<unsigned int>("./numAveragingSlots",30);
 	unsigned int minNumSamples=cfg.retrieveValue<unsigned int>("./minNumSamples",10);
 	unsigned int maxVariance=cfg.retrieveValue<unsigned int>("./maxVariance",2);
+	bool exponentialStatistics=cfg.retrieveValue<bool>("./exponentialStatistics",false);
+	unsigned int numFilterThreads=cfg.retrieveValue<unsigned int>("./numFilterThreads",2);
 	float hysteresis=cfg.retrieveValue<float>("./hysteresis",0.1f);
 	Misc::FixedArray<unsigned int,2> wtSize;
 	wtSize[0]=640;
@@ -588,11 +829,29 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	wtSize=cfg.retrieveValue<Misc::FixedArray<unsigned int,2> >("./waterTableSize",wtSize);
 	waterSpeed=cfg.retrieveValue<double>("./waterSpeed",1.0);
 	waterMaxSteps=cfg.retrieveValue<unsigned int>("./waterMaxSteps",30U);
+	waterFrameBudget=cfg.retrieveValue<double>("./waterFrameBudget",0.0)*0.001;
+	double waterSimulationRate=cfg.retrieveValue<double>("./waterSimulationRate",0.0);
+	unsigned int numWaterThreads=cfg.retrieveValue<unsigned int>("./numWaterThreads",4);
 	Math::Interval<double> rainElevationRange=cfg.retrieveValue<Math::Interval<double> >("./rainElevationRange",Math::Interval<double>(-1000.0,1000.0));
 	rainStrength=cfg.retrieveValue<GLfloat>("./rainStrength",0.25f);
+	unsigned int numHandExtractorThreads=cfg.retrieveValue<unsigned int>("./numHandExtractorThreads",2);
 	double evaporationRate=cfg.retrieveValue<double>("./evaporationRate",0.0);
 	float demDistScale=cfg.retrieveValue<float>("./demDistScale",1.0f);
+	asyncGridReadback=cfg.retrieveValue<bool>("./asyncGridReadback",asyncGridReadback);
 	std::string controlPipeName=cfg.retrieveString("./controlPipeName","");
+	unsigned int latencyWindowSize=cfg.retrieveValue<unsigned int>("./latencyWindowSize",300);
+	std::string latencyTraceFileName=cfg.retrieveString("./latencyTraceFileName","");
+	bool fuseCameras=cfg.retrieveValue<bool>("./fuseCameras",false);
+	Misc::FixedArray<unsigned int,2> fusedGridSize;
+	fusedGridSize[0]=640;
+	fusedGridSize[1]=480;
+	fusedGridSize=cfg.retrieveValue<Misc::FixedArray<unsigned int,2> >("./fusedGridSize",fusedGridSize);
+	unsigned int fusionFeatherWidth=cfg.retrieveValue<unsigned int>("./fusionFeatherWidth",32);
+	bool cpuBathymetry=cfg.retrieveValue<bool>("./cpuBathymetry",false);
+	unsigned int numBathymetryThreads=cfg.retrieveValue<unsigned int>("./numBathymetryThreads",2);
+	std::string gridRecordingFileName=cfg.retrieveString("./gridRecordingFileName","");
+	gridRecordingInterval=cfg.retrieveValue<double>("./gridRecordingInterval",gridRecordingInterval);
+	gridRecordingChunkSize=cfg.retrieveValue<unsigned int>("./gridRecordingChunkSize",gridRecordingChunkSize);
 	
 	/* Process command line parameters: */
 	bool printHelp=false;
@@ -600,6 +859,7 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	const char* kinectServerName=0;
 	bool useRemoteServer=false;
 	int remoteServerPortId=26000;
+	WaterTable2::Engine waterEngine=WaterTable2::GPU;
 	int windowIndex=0;
 	renderSettings.push_back(RenderSettings());
 	for(int i=1;i<argc;++i)
@@ -634,6 +894,16 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				++i;
 				kinectServerName=argv[i];
 				}
+			else if(strcasecmp(argv[i]+1,"fuse")==0)
+				fuseCameras=true;
+			else if(strcasecmp(argv[i]+1,"fgs")==0)
+				{
+				for(int j=0;j<2;++j)
+					{
+					++i;
+					fusedGridSize[j]=(unsigned int)(atoi(argv[i]));
+					}
+				}
 			else if(strcasecmp(argv[i]+1,"s")==0)
 				{
 				++i;
@@ -677,6 +947,13 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				++i;
 				maxVariance=atoi(argv[i]);
 				}
+			else if(strcasecmp(argv[i]+1,"ews")==0)
+				exponentialStatistics=true;
+			else if(strcasecmp(argv[i]+1,"fnt")==0)
+				{
+				++i;
+				numFilterThreads=atoi(argv[i]);
+				}
 			else if(strcasecmp(argv[i]+1,"he")==0)
 				{
 				++i;
@@ -697,6 +974,32 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				++i;
 				waterMaxSteps=atoi(argv[i]);
 				}
+			else if(strcasecmp(argv[i]+1,"wfb")==0)
+				{
+				++i;
+				waterFrameBudget=atof(argv[i])*0.001;
+				}
+			else if(strcasecmp(argv[i]+1,"wcpu")==0)
+				waterEngine=WaterTable2::CPU;
+			else if(strcasecmp(argv[i]+1,"wst")==0)
+				{
+				++i;
+				waterSimulationRate=atof(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"wnt")==0)
+				{
+				++i;
+				numWaterThreads=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"srb")==0)
+				asyncGridReadback=false;
+			else if(strcasecmp(argv[i]+1,"cbr")==0)
+				cpuBathymetry=true;
+			else if(strcasecmp(argv[i]+1,"bnt")==0)
+				{
+				++i;
+				numBathymetryThreads=atoi(argv[i]);
+				}
 			else if(strcasecmp(argv[i]+1,"rer")==0)
 				{
 				++i;
@@ -710,6 +1013,11 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				++i;
 				rainStrength=GLfloat(atof(argv[i]));
 				}
+			else if(strcasecmp(argv[i]+1,"hnt")==0)
+				{
+				++i;
+				numHandExtractorThreads=atoi(argv[i]);
+				}
 			else if(strcasecmp(argv[i]+1,"evr")==0)
 				{
 				++i;
@@ -795,6 +1103,21 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				++i;
 				controlPipeName=argv[i];
 				}
+			else if(strcasecmp(argv[i]+1,"ltf")==0)
+				{
+				++i;
+				latencyTraceFileName=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"grf")==0)
+				{
+				++i;
+				gridRecordingFileName=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"gri")==0)
+				{
+				++i;
+				gridRecordingInterval=atof(argv[i]);
+				}
 			else
 				std::cerr<<"Ignoring unrecognized command line switch "<<argv[i]<<std::endl;
 			}
@@ -840,6 +1163,21 @@ Sandbox::Sandbox(int& argc,char**& argv)
 		
 		/* Use the server's first component stream as the camera device: */
 		camera=source->getStream(0);
+		
+		if(fuseCameras)
+			{
+			/* Use all other component streams as secondary cameras: */
+			for(unsigned int streamIndex=1;streamIndex<source->getNumStreams();++streamIndex)
+				{
+				SecondaryCamera sc;
+				sc.camera=source->getStream(streamIndex);
+				sc.pixelDepthCorrection=0;
+				sc.frameFilter=0;
+				secondaryCameras.push_back(sc);
+				}
+			if(secondaryCameras.empty())
+				std::cerr<<"Kinect server "<<kinectServerName<<" only serves a single camera; disabling height field fusion"<<std::endl;
+			}
 		}
 	else
 		{
@@ -849,28 +1187,13 @@ Sandbox::Sandbox(int& argc,char**& argv)
 		realCamera->configure(cameraConfigurationSection);
 		camera=realCamera;
 		}
+	if(fuseCameras&&kinectServerName==0)
+		std::cerr<<"Height field fusion requires a Kinect server; disabling height field fusion"<<std::endl;
 	for(int i=0;i<2;++i)
 		frameSize[i]=camera->getActualFrameSize(Kinect::FrameSource::DEPTH)[i];
 	
 	/* Get the camera's per-pixel depth correction parameters and evaluate it on the depth frame's pixel grid: */
-	Kinect::FrameSource::DepthCorrection* depthCorrection=camera->getDepthCorrectionParameters();
-	if(depthCorrection!=0)
-		{
-		pixelDepthCorrection=depthCorrection->getPixelCorrection(frameSize);
-		delete depthCorrection;
-		}
-	else
-		{
-		/* Create dummy per-pixel depth correction parameters: */
-		pixelDepthCorrection=new PixelDepthCorrection[frameSize[1]*frameSize[0]];
-		PixelDepthCorrection* pdcPtr=pixelDepthCorrection;
-		for(unsigned int y=0;y<frameSize[1];++y)
-			for(unsigned int x=0;x<frameSize[0];++x,++pdcPtr)
-				{
-				pdcPtr->scale=1.0f;
-				pdcPtr->offset=0.0f;
-				}
-		}
+	pixelDepthCorrection=createPixelDepthCorrection(*camera,frameSize);
 	
 	/* Get the camera's intrinsic parameters: */
 	cameraIps=camera->getIntrinsicParameters();
@@ -930,26 +1253,94 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	evaporationRate*=sf;
 	demDistScale*=sf;
 	
+	/* Create the latency tracker for filtered depth frames and start writing a latency trace file if requested: */
+	latencyTracker=new LatencyTracker(latencyWindowSize);
+	if(!latencyTraceFileName.empty())
+		{
+		try
+			{
+			latencyTracker->startTraceFile(latencyTraceFileName.c_str());
+			}
+		catch(const std::runtime_error& err)
+			{
+			std::cerr<<"Cannot create latency trace file "<<latencyTraceFileName<<" due to exception "<<err.what()<<"; ignoring"<<std::endl;
+			}
+		}
+	
 	/* Create the frame filter object: */
-	frameFilter=new FrameFilter(frameSize,numAveragingSlots,pixelDepthCorrection,cameraIps.depthProjection,basePlane);
+	frameFilter=new FrameFilter(frameSize,numAveragingSlots,pixelDepthCorrection,cameraIps.depthProjection,basePlane,numFilterThreads);
 	frameFilter->setValidElevationInterval(cameraIps.depthProjection,basePlane,elevationRange.getMin(),elevationRange.getMax());
-	frameFilter->setStableParameters(minNumSamples,maxVariance);
+	frameFilter->setStableParameters(minNumSamples,maxVariance,exponentialStatistics?FrameFilter::EXPONENTIAL:FrameFilter::AVERAGING_SLOTS);
 	frameFilter->setHysteresis(hysteresis);
 	frameFilter->setSpatialFilter(true);
-	frameFilter->setOutputFrameFunction(Misc::createFunctionCall(this,&Sandbox::receiveFilteredFrame));
+	
+	if(!secondaryCameras.empty())
+		{
+		/* Create a height field fuser whose common camera space is the main camera's camera space: */
+		heightFieldFuser=new HeightFieldFuser(1+secondaryCameras.size(),fusedGridSize.getElements(),basePlane,basePlaneCorners,numFilterThreads);
+		heightFieldFuser->setFeatherWidth(fusionFeatherWidth);
+		heightFieldFuser->setCamera(0,frameSize,cameraIps,PTransform::identity);
+		PTransform invMainExtrinsics=Geometry::invert(PTransform(camera->getExtrinsicParameters()));
+		
+		/* Create a frame filter for each secondary camera that feeds into the height field fuser: */
+		for(unsigned int i=0;i<secondaryCameras.size();++i)
+			{
+			SecondaryCamera& sc=secondaryCameras[i];
+			unsigned int scFrameSize[2];
+			for(int j=0;j<2;++j)
+				scFrameSize[j]=sc.camera->getActualFrameSize(Kinect::FrameSource::DEPTH)[j];
+			sc.pixelDepthCorrection=createPixelDepthCorrection(*sc.camera,scFrameSize);
+			
+			/* Calculate the secondary camera's depth projection into the main camera's scaled camera space: */
+			Kinect::FrameSource::IntrinsicParameters scIps=sc.camera->getIntrinsicParameters();
+			PTransform cameraTransform=invMainExtrinsics*PTransform(sc.camera->getExtrinsicParameters());
+			for(int j=0;j<3;++j)
+				{
+				for(int k=0;k<4;++k)
+					scIps.depthProjection.getMatrix()(j,k)*=sf;
+				cameraTransform.getMatrix()(j,3)*=sf;
+				}
+			PTransform scDepthProjection=cameraTransform*scIps.depthProjection;
+			
+			sc.frameFilter=new FrameFilter(scFrameSize,numAveragingSlots,sc.pixelDepthCorrection,scDepthProjection,basePlane,numFilterThreads);
+			sc.frameFilter->setValidElevationInterval(scDepthProjection,basePlane,elevationRange.getMin(),elevationRange.getMax());
+			sc.frameFilter->setStableParameters(minNumSamples,maxVariance,exponentialStatistics?FrameFilter::EXPONENTIAL:FrameFilter::AVERAGING_SLOTS);
+			sc.frameFilter->setHysteresis(hysteresis);
+			sc.frameFilter->setSpatialFilter(true);
+			sc.frameFilter->setOutputFrameFunction(Misc::createFunctionCall(heightFieldFuser,&HeightFieldFuser::receiveFilteredFrame,i+1));
+			heightFieldFuser->setCamera(i+1,scFrameSize,scIps,cameraTransform);
+			}
+		
+		/* Fuse the main camera's filtered frames with the secondary cameras' and pass the fused height fields on: */
+		frameFilter->setOutputFrameFunction(Misc::createFunctionCall(heightFieldFuser,&HeightFieldFuser::receiveFilteredFrame,0U));
+		heightFieldFuser->setOutputFrameFunction(Misc::createFunctionCall(this,&Sandbox::receiveFilteredFrame));
+		}
+	else
+		frameFilter->setOutputFrameFunction(Misc::createFunctionCall(this,&Sandbox::receiveFilteredFrame));
 	
 	if(waterSpeed>0.0)
 		{
 		/* Create the hand extractor object: */
-		handExtractor=new HandExtractor(frameSize,pixelDepthCorrection,cameraIps.depthProjection);
+		handExtractor=new HandExtractor(frameSize,pixelDepthCorrection,cameraIps.depthProjection,numHandExtractorThreads);
 		}
 	
 	/* Start streaming depth frames: */
 	camera->startStreaming(0,Misc::createFunctionCall(this,&Sandbox::rawDepthFrameDispatcher));
+	for(unsigned int i=0;i<secondaryCameras.size();++i)
+		secondaryCameras[i].camera->startStreaming(0,Misc::createFunctionCall(this,&Sandbox::secondaryDepthFrameDispatcher,i));
 	
-	/* Create the depth image renderer: */
-	depthImageRenderer=new DepthImageRenderer(frameSize);
-	depthImageRenderer->setIntrinsics(cameraIps);
+	if(heightFieldFuser!=0)
+		{
+		/* Create a depth image renderer for fused height fields: */
+		depthImageRenderer=new DepthImageRenderer(heightFieldFuser->getGridSize());
+		depthImageRenderer->setIntrinsics(heightFieldFuser->getIntrinsicParameters());
+		}
+	else
+		{
+		/* Create the depth image renderer: */
+		depthImageRenderer=new DepthImageRenderer(frameSize);
+		depthImageRenderer->setIntrinsics(cameraIps);
+		}
 	depthImageRenderer->setBasePlane(basePlane);
 	
 	{
@@ -978,10 +1369,26 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	if(waterSpeed>0.0)
 		{
 		/* Initialize the water flow simulator: */
-		waterTable=new WaterTable2(wtSize[0],wtSize[1],depthImageRenderer,basePlaneCorners);
+		if(waterSimulationRate>0.0)
+			waterEngine=WaterTable2::CPU;
+		waterTable=new WaterTable2(wtSize[0],wtSize[1],depthImageRenderer,basePlaneCorners,waterEngine,numWaterThreads);
 		waterTable->setElevationRange(elevationRange.getMin(),rainElevationRange.getMax());
 		waterTable->setWaterDeposit(evaporationRate);
 		
+		/* Run the water flow simulation in a dedicated thread if requested: */
+		if(waterSimulationRate>0.0)
+			waterTable->startSimulationThread(waterSimulationRate);
+		
+		if(cpuBathymetry)
+			{
+			/* Resample filtered depth frames into the bathymetry grid on the CPU instead of rendering them on the GPU: */
+			if(heightFieldFuser!=0)
+				bathymetryResampler=new BathymetryResampler(heightFieldFuser->getGridSize(),heightFieldFuser->getIntrinsicParameters(),*waterTable,numBathymetryThreads);
+			else
+				bathymetryResampler=new BathymetryResampler(frameSize,cameraIps,*waterTable,numBathymetryThreads);
+			bathymetryGrid=new GLfloat[size_t(waterTable->getBathymetrySize(1))*size_t(waterTable->getBathymetrySize(0))];
+			}
+		
 		/* Register a render function with the water table: */
 		addWaterFunction=Misc::createFunctionCall(this,&Sandbox::addWater);
 		waterTable->addRenderFunction(addWaterFunction);
@@ -1001,6 +1408,10 @@ Sandbox::Sandbox(int& argc,char**& argv)
 			}
 		}
 	
+	/* Start recording bathymetry and water level grids if requested: */
+	if(!gridRecordingFileName.empty())
+		startGridRecording(gridRecordingFileName.c_str());
+	
 	/* Initialize all surface renderers: */
 	for(std::vector<RenderSettings>::iterator rsIt=renderSettings.begin();rsIt!=renderSettings.end();++rsIt)
 		{
@@ -1078,16 +1489,29 @@ Sandbox::~Sandbox(void)
 	{
 	/* Stop streaming depth frames: */
 	camera->stopStreaming();
+	for(std::vector<SecondaryCamera>::iterator scIt=secondaryCameras.begin();scIt!=secondaryCameras.end();++scIt)
+		scIt->camera->stopStreaming();
 	delete camera;
 	delete frameFilter;
+	for(std::vector<SecondaryCamera>::iterator scIt=secondaryCameras.begin();scIt!=secondaryCameras.end();++scIt)
+		{
+		delete scIt->camera;
+		delete scIt->frameFilter;
+		delete[] scIt->pixelDepthCorrection;
+		}
+	delete heightFieldFuser;
+	delete latencyTracker;
 	
 	/* Delete helper objects: */
+	delete bathymetryResampler;
+	delete[] bathymetryGrid;
 	delete waterTable;
 	delete depthImageRenderer;
 	delete handExtractor;
 	delete addWaterFunction;
 	delete[] pixelDepthCorrection;
 	delete remoteServer;
+	delete gridRecorder;
 	
 	delete mainMenu;
 	delete waterControlDialog;
@@ -1160,11 +1584,40 @@ void Sandbox::frame(void)
 	if(remoteServer!=0)
 		remoteServer->frame(Vrui::getApplicationTime());
 	
+	/* Call the grid recorder's frame method, and destroy it once a stopped recording is complete: */
+	if(gridRecorder!=0)
+		{
+		gridRecorder->frame(Vrui::getApplicationTime());
+		if(gridRecorder->isFinished())
+			{
+			delete gridRecorder;
+			gridRecorder=0;
+			}
+		}
+	
+	/* Check if the current filtered frame was rendered and presented for the first time: */
+	Kinect::FrameBuffer& presentedFrame=filteredFrames.getLockedValue().frame;
+	if(presentedFrame.isValid()&&presentedFrame.getTrace().isStamped(LatencyTracker::DRAW)&&presentedFrame.stampTrace(LatencyTracker::SWAP))
+		{
+		/* Add the frame's completed trace to the latency statistics: */
+		latencyTracker->addTrace(presentedFrame.getTrace());
+		}
+	
 	/* Check if the filtered frame has been updated: */
 	if(filteredFrames.lockNewValue())
 		{
+		/* Record the time at which the new filtered frame was picked up: */
+		filteredFrames.getLockedValue().frame.stampTrace(LatencyTracker::PICKUP);
+		
 		/* Update the depth image renderer's depth image: */
-		depthImageRenderer->setDepthImage(filteredFrames.getLockedValue());
+		depthImageRenderer->setFilteredDepthImage(filteredFrames.getLockedValue());
+		
+		if(bathymetryResampler!=0)
+			{
+			/* Resample the new filtered frame into the bathymetry grid: */
+			bathymetryResampler->resample(filteredFrames.getLockedValue().frame,bathymetryGrid);
+			++bathymetryVersion;
+			}
 		}
 	
 	if(handExtractor!=0)
@@ -1234,6 +1687,76 @@ void Sandbox::frame(void)
 					else
 						std::cerr<<"Wrong number of arguments for waterMaxSteps control pipe command"<<std::endl;
 					}
+				else if(isToken(tokens[0],"waterFrameBudget"))
+					{
+					if(tokens.size()==2)
+						waterFrameBudget=atof(tokens[1].c_str())*0.001;
+					else
+						std::cerr<<"Wrong number of arguments for waterFrameBudget control pipe command"<<std::endl;
+					}
+				else if(isToken(tokens[0],"waterStatistics"))
+					{
+					if(waterTable!=0&&waterTable->hasSimulationThread())
+						{
+						/* Print and reset the simulation thread's statistics: */
+						WaterTable2::ThreadStatistics statistics=waterTable->getThreadStatistics(true);
+						std::cout<<"Water simulation thread: "<<statistics.numTicks<<" ticks, "<<statistics.tickTime*1000.0<<" ms per tick";
+						if(statistics.numTicks>0)
+							{
+							std::cout<<", "<<double(statistics.numSteps)/double(statistics.numTicks)<<" steps per tick";
+							std::cout<<", "<<statistics.numLaggingTicks<<" lagging ticks";
+							}
+						if(statistics.requestedTime>0.0)
+							std::cout<<", lag "<<statistics.lagTime*100.0/statistics.requestedTime<<"% of requested simulation time";
+						std::cout<<std::endl;
+						}
+					else
+						{
+						/* Print and reset the water simulation step statistics: */
+						WaterStepStatistics statistics;
+						{
+						Threads::Mutex::Lock statisticsLock(waterStepStatisticsMutex);
+						statistics=waterStepStatistics;
+						waterStepStatistics.resetCounters();
+						}
+						std::cout<<"Water simulation: "<<statistics.numFrames<<" frames, "<<statistics.stepTime*1000.0<<" ms per step";
+						if(statistics.numFrames>0)
+							{
+							std::cout<<", "<<double(statistics.numSteps)/double(statistics.numFrames)<<" steps per frame";
+							std::cout<<", "<<statistics.numLaggingFrames<<" lagging frames";
+							}
+						if(statistics.requestedTime>0.0)
+							std::cout<<", lag "<<statistics.lagTime*100.0/statistics.requestedTime<<"% of requested simulation time";
+						std::cout<<std::endl;
+						}
+					}
+				else if(isToken(tokens[0],"latencyStatistics"))
+					{
+					/* Print the rolling latency statistics of presented depth frames: */
+					latencyTracker->printStatistics(std::cout);
+					}
+				else if(isToken(tokens[0],"latencyTrace"))
+					{
+					if(tokens.size()==2)
+						{
+						if(isToken(tokens[1],"off"))
+							latencyTracker->stopTraceFile();
+						else
+							{
+							try
+								{
+								/* Write the traces of all subsequently presented depth frames to the given file: */
+								latencyTracker->startTraceFile(tokens[1].c_str());
+								}
+							catch(const std::runtime_error& err)
+								{
+								std::cerr<<"Cannot create latency trace file "<<tokens[1]<<" due to exception "<<err.what()<<std::endl;
+								}
+							}
+						}
+					else
+						std::cerr<<"Wrong number of arguments for latencyTrace control pipe command"<<std::endl;
+					}
 				else if(isToken(tokens[0],"waterAttenuation"))
 					{
 					if(tokens.size()==2)
@@ -1383,6 +1906,66 @@ void Sandbox::frame(void)
 					else
 						std::cerr<<"Wrong number of arguments for dippingBedThickness control pipe command"<<std::endl;
 					}
+				else if(isToken(tokens[0],"remoteClients"))
+					{
+					if(remoteServer!=0)
+						{
+						/* Print the streaming statistics of all connected remote clients: */
+						const std::vector<RemoteServer::ClientStatistics>& statistics=remoteServer->getClientStatistics();
+						std::cout<<"Remote clients: "<<statistics.size()<<std::endl;
+						for(std::vector<RemoteServer::ClientStatistics>::const_iterator csIt=statistics.begin();csIt!=statistics.end();++csIt)
+							{
+							std::cout<<"  "<<csIt->address<<", protocol version "<<csIt->protocolVersion;
+							std::cout<<": "<<csIt->numSentFrames<<" frames sent, "<<csIt->numDroppedFrames<<" dropped, "<<csIt->numQueuedFrames<<" queued, ";
+							std::cout<<csIt->numSentBytes<<" bytes sent"<<std::endl;
+							}
+						}
+					else
+						std::cerr<<"Remote server is not enabled"<<std::endl;
+					}
+				else if(isToken(tokens[0],"gridRecording"))
+					{
+					if(tokens.size()==2)
+						{
+						if(isToken(tokens[1],"off"))
+							{
+							/* Finish the current grid recording in the background: */
+							if(gridRecorder!=0)
+								gridRecorder->stop();
+							}
+						else
+							startGridRecording(tokens[1].c_str());
+						}
+					else
+						std::cerr<<"Wrong number of arguments for gridRecording control pipe command"<<std::endl;
+					}
+				else if(isToken(tokens[0],"gridRecordingStatistics"))
+					{
+					if(gridRecorder!=0)
+						{
+						/* Print the state of the current grid recording: */
+						GridRecorder::Statistics statistics=gridRecorder->getStatistics();
+						std::cout<<"Grid recording: "<<statistics.numFrames<<" frames in "<<statistics.numChunks<<" chunks, "<<statistics.numDroppedFrames<<" dropped, ";
+						std::cout<<statistics.numWrittenBytes<<" bytes written";
+						if(statistics.numWrittenBytes>0)
+							std::cout<<", compression ratio "<<double(statistics.numRawBytes)/double(statistics.numWrittenBytes);
+						std::cout<<std::endl;
+						}
+					else
+						std::cerr<<"Grid recording is not active"<<std::endl;
+					}
+				else if(isToken(tokens[0],"gridReadbackStatistics"))
+					{
+					/* Print and reset the timing statistics of grid read-backs: */
+					GridRequest::Statistics statistics=gridRequest.getStatistics(true);
+					std::cout<<"Grid read-backs: "<<statistics.numReadbacks<<(asyncGridReadback?" asynchronous":" synchronous");
+					if(statistics.numReadbacks>0)
+						{
+						std::cout<<", rendering thread time "<<statistics.totalStallTime*1000.0/double(statistics.numReadbacks)<<" ms average, "<<statistics.maxStallTime*1000.0<<" ms max";
+						std::cout<<", latency "<<double(statistics.totalLatencyFrames)/double(statistics.numReadbacks)<<" frames average";
+						}
+					std::cout<<std::endl;
+					}
 				else
 					std::cerr<<"Unrecognized control pipe command "<<tokens[0]<<std::endl;
 				}
@@ -1391,8 +1974,21 @@ void Sandbox::frame(void)
 	
 	if(frameRateTextField!=0&&Vrui::getWidgetManager()->isVisible(waterControlDialog))
 		{
-		/* Update the frame rate display: */
+		/* Update the frame rate and simulation lag displays: */
 		frameRateTextField->setValue(1.0/Vrui::getCurrentFrameTime());
+		if(waterTable!=0&&waterTable->hasSimulationThread())
+			waterLagTextField->setValue(waterTable->getThreadStatistics(false).lagFraction*100.0);
+		else
+			{
+			Threads::Mutex::Lock statisticsLock(waterStepStatisticsMutex);
+			waterLagTextField->setValue(waterStepStatistics.lagFraction*100.0);
+			}
+		}
+	
+	if(waterTable!=0&&waterTable->hasSimulationThread())
+		{
+		/* Forward the current simulation parameters to the simulation thread and lock its most recent state: */
+		waterTable->updateSimulationThread(waterSpeed,waterMaxSteps);
 		}
 	
 	if(pauseUpdates)
@@ -1415,62 +2011,160 @@ void Sandbox::display(GLContextData& contextData) const
 	/* Check if the water simulation state needs to be updated: */
 	if(waterTable!=0&&dataItem->waterTableTime!=Vrui::getApplicationTime())
 		{
-		/* Retrieve a potential pending grid read-back request: */
-		GridRequest::Request request=gridRequest.getRequest();
+		/* Collect the results of an in-flight asynchronous grid read-back: */
+		if(dataItem->gridReadbackFence!=0)
+			finishGridReadback(dataItem);
+		
+		/* Retrieve a potential pending grid read-back request unless a previous one is still in flight: */
+		GridRequest::Request request;
+		if(dataItem->gridReadbackFence==0)
+			request=gridRequest.getRequest();
+		bool asyncRequest=request.isActive()&&asyncGridReadback&&dataItem->gridReadbackBufferObjects[0]!=0;
+		double stallTime=0.0;
 		
 		/* Update the water table's bathymetry grid: */
-		waterTable->updateBathymetry(contextData);
+		if(bathymetryResampler!=0)
+			{
+			/* Upload the most recent CPU-resampled bathymetry grid if it has not been uploaded yet: */
+			if(dataItem->bathymetryVersion!=bathymetryVersion)
+				{
+				waterTable->updateBathymetry(bathymetryGrid,contextData);
+				dataItem->bathymetryVersion=bathymetryVersion;
+				}
+			}
+		else
+			waterTable->updateBathymetry(contextData);
 		
 		/* Check if the grid request is active and wants bathymetry data: */
-		if(request.isActive()&&request.bathymetryBuffer!=0)
+		if(request.isActive()&&request.bathymetryBuffer!=0&&bathymetryResampler!=0)
+			{
+			/* Copy the current CPU-resampled bathymetry grid without reading it back: */
+			memcpy(request.bathymetryBuffer,bathymetryGrid,size_t(waterTable->getBathymetrySize(1))*size_t(waterTable->getBathymetrySize(0))*sizeof(GLfloat));
+			}
+		else if(request.isActive()&&request.bathymetryBuffer!=0)
 			{
 			/* Read back the current bathymetry grid: */
+			Realtime::TimePointMonotonic readStart;
 			waterTable->bindBathymetryTexture(contextData);
-			glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,request.bathymetryBuffer);
+			readGrid(dataItem,asyncRequest,0,request.bathymetryBuffer);
 			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+			stallTime+=double(Realtime::TimePointMonotonic()-readStart);
 			}
 		
-		/* Run the water flow simulation's main pass: */
-		GLfloat totalTimeStep=GLfloat(Vrui::getFrameTime()*waterSpeed);
-		unsigned int numSteps=0;
-		while(numSteps<waterMaxSteps-1U&&totalTimeStep>1.0e-8f)
+		if(waterTable->hasSimulationThread())
+			{
+			/* Hand this frame's water sources to the simulation thread, only once per frame across all windows: */
+			bool submitWater;
 			{
-			/* Run with a self-determined time step to maintain stability: */
-			waterTable->setMaxStepSize(totalTimeStep);
-			GLfloat timeStep=waterTable->runSimulationStep(false,contextData);
-			totalTimeStep-=timeStep;
-			++numSteps;
+			Threads::Mutex::Lock statisticsLock(waterStepStatisticsMutex);
+			submitWater=lastWaterSubmitTime!=Vrui::getApplicationTime();
+			lastWaterSubmitTime=Vrui::getApplicationTime();
 			}
-		#if 0
-		if(totalTimeStep>1.0e-8f)
+			if(submitWater)
+				waterTable->submitWaterSources(GLfloat(Vrui::getFrameTime()*waterSpeed),contextData);
+			}
+		else
 			{
-			std::cout<<'.'<<std::flush;
-			/* Force the final step to avoid simulation slow-down: */
-			waterTable->setMaxStepSize(totalTimeStep);
-			GLfloat timeStep=waterTable->runSimulationStep(true,contextData);
-			totalTimeStep-=timeStep;
-			++numSteps;
+			/* Collect the GPU times of previous water simulation passes: */
+			if(dataItem->numPendingWaterTimerQueries>0)
+				collectWaterTimerQueries(dataItem);
+			
+			/* Limit the number of simulation steps to fit into the per-frame time budget: */
+			unsigned int maxNumSteps=waterMaxSteps-1U;
+			if(waterFrameBudget>0.0)
+				{
+				Threads::Mutex::Lock statisticsLock(waterStepStatisticsMutex);
+				if(waterStepStatistics.stepTime>0.0)
+					{
+					/* Always run at least one step to keep the simulation alive: */
+					double budgetSteps=Math::floor(waterFrameBudget/waterStepStatistics.stepTime);
+					if(budgetSteps<1.0)
+						budgetSteps=1.0;
+					if(double(maxNumSteps)>budgetSteps)
+						maxNumSteps=(unsigned int)(budgetSteps);
+					}
+				}
+			
+			/* Measure the main pass's GPU time if the GPU engine is used, and if there is a free timer query: */
+			bool measureGpuTime=dataItem->haveTimerQuery&&waterTable->getEngine()==WaterTable2::GPU&&dataItem->numPendingWaterTimerQueries<4;
+			unsigned int timerQueryIndex=(dataItem->firstWaterTimerQuery+dataItem->numPendingWaterTimerQueries)%4;
+			if(measureGpuTime)
+				glBeginQueryARB(GL_TIME_ELAPSED,dataItem->waterTimerQueries[timerQueryIndex]);
+			Realtime::TimePointMonotonic passStart;
+			
+			/* Run the water flow simulation's main pass: */
+			GLfloat requestedTimeStep=GLfloat(Vrui::getFrameTime()*waterSpeed);
+			GLfloat totalTimeStep=requestedTimeStep;
+			unsigned int numSteps=0;
+			while(numSteps<maxNumSteps&&totalTimeStep>1.0e-8f)
+				{
+				/* Run with a self-determined time step to maintain stability: */
+				waterTable->setMaxStepSize(totalTimeStep);
+				GLfloat timeStep=waterTable->runSimulationStep(false,contextData);
+				totalTimeStep-=timeStep;
+				++numSteps;
+				}
+			#if 0
+			if(totalTimeStep>1.0e-8f)
+				{
+				std::cout<<'.'<<std::flush;
+				/* Force the final step to avoid simulation slow-down: */
+				waterTable->setMaxStepSize(totalTimeStep);
+				GLfloat timeStep=waterTable->runSimulationStep(true,contextData);
+				totalTimeStep-=timeStep;
+				++numSteps;
+				}
+			#endif
+			
+			double passTime=double(Realtime::TimePointMonotonic()-passStart);
+			if(measureGpuTime)
+				{
+				glEndQueryARB(GL_TIME_ELAPSED);
+				dataItem->waterTimerQuerySteps[timerQueryIndex]=numSteps;
+				++dataItem->numPendingWaterTimerQueries;
+				}
+			
+			{
+			/* Update the step statistics, using the main pass's CPU time if its GPU time can not be measured: */
+			Threads::Mutex::Lock statisticsLock(waterStepStatisticsMutex);
+			if(waterTable->getEngine()==WaterTable2::CPU||!dataItem->haveTimerQuery)
+				waterStepStatistics.addStepTime(passTime,numSteps);
+			waterStepStatistics.addFrame(numSteps,requestedTimeStep,totalTimeStep>1.0e-8f?totalTimeStep:0.0);
+			}
 			}
-		#else
-		if(totalTimeStep>1.0e-8f)
-			std::cout<<"Ran out of time by "<<totalTimeStep<<std::endl;
-		#endif
 		
 		/* Check if the grid request is active and wants water level data: */
 		if(request.isActive()&&request.waterLevelBuffer!=0)
 			{
 			/* Read back the current water level grid: */
+			Realtime::TimePointMonotonic readStart;
 			waterTable->bindQuantityTexture(contextData);
-			glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,request.waterLevelBuffer);
+			readGrid(dataItem,asyncRequest,1,request.waterLevelBuffer);
 			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+			stallTime+=double(Realtime::TimePointMonotonic()-readStart);
 			}
 		
-		/* Finish an active grid request: */
-		if(request.isActive())
-			request.complete();
+		if(asyncRequest)
+			{
+			/* Insert a fence behind the read-back commands and collect the grids once it has been passed: */
+			dataItem->gridReadbackFence=glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0x0);
+			dataItem->gridReadbackRequest=request;
+			dataItem->gridReadbackStallTime=stallTime;
+			dataItem->gridReadbackFrames=0;
+			}
+		else if(request.isActive())
+			{
+			/* Finish the grid request immediately: */
+			gridRequest.completeRequest(request,stallTime,0);
+			}
 		
 		/* Mark the water simulation state as up-to-date for this frame: */
 		dataItem->waterTableTime=Vrui::getApplicationTime();
+		
+		/* Record the time at which the water simulation was first updated from the current filtered frame in the frame's shared trace: */
+		Kinect::FrameBuffer tracedFrame=filteredFrames.getLockedValue().frame;
+		if(tracedFrame.isValid())
+			tracedFrame.stampTrace(LatencyTracker::WATER);
 		}
 	
 	/* Calculate the projection matrix: */
@@ -1685,6 +2379,11 @@ void Sandbox::display(GLContextData& contextData) const
 		glPopMatrix();
 		glMatrixMode(GL_MODELVIEW);
 		}
+	
+	/* Record the time at which the current filtered frame was first rendered in the frame's shared trace: */
+	Kinect::FrameBuffer tracedFrame=filteredFrames.getLockedValue().frame;
+	if(tracedFrame.isValid())
+		tracedFrame.stampTrace(LatencyTracker::DRAW);
 	}
 
 void Sandbox::resetNavigation(void)
@@ -1756,6 +2455,23 @@ void Sandbox::initContext(GLContextData& contextData) const
 	glReadBuffer(GL_NONE);
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
 	} 
+	
+	if(waterTable!=0&&dataItem->haveAsyncReadback)
+		{
+		/* Create pixel buffer objects to read back bathymetry and water level grids asynchronously: */
+		glGenBuffersARB(2,dataItem->gridReadbackBufferObjects);
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->gridReadbackBufferObjects[0]);
+		glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB,GLsizeiptrARB(waterTable->getBathymetrySize(0))*GLsizeiptrARB(waterTable->getBathymetrySize(1))*sizeof(GLfloat),0,GL_STREAM_READ_ARB);
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->gridReadbackBufferObjects[1]);
+		glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB,GLsizeiptrARB(waterTable->getSize()[0])*GLsizeiptrARB(waterTable->getSize()[1])*sizeof(GLfloat),0,GL_STREAM_READ_ARB);
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+		}
+	
+	if(dataItem->haveTimerQuery)
+		{
+		/* Create timer queries to measure the GPU time of water simulation passes: */
+		glGenQueriesARB(4,dataItem->waterTimerQueries);
+		}
 	}
 
 VRUI_APPLICATION_RUN(Sandbox)
@@ -29,6 +29,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Geometry/OrthonormalTransformation.h>
 #include <Geometry/ProjectiveTransformation.h>
 #include <GL/gl.h>
+#include <GL/Extensions/GLARBSync.h>
+#include <GL/Extensions/GLARBTimerQuery.h>
 #include <GL/GLColorMap.h>
 #include <GL/GLMaterial.h>
 #include <GL/GLObject.h>
@@ -43,6 +45,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Kinect/FrameSource.h>
 
 #include "Types.h"
+#include "FilteredFrame.h"
 
 /* Forward declarations: */
 namespace Misc {
@@ -62,14 +65,18 @@ namespace Kinect {
 class Camera;
 }
 class FrameFilter;
+class HeightFieldFuser;
 class DepthImageRenderer;
 class ElevationColorMap;
 class DEM;
 class SurfaceRenderer;
 class WaterTable2;
+class BathymetryResampler;
 class HandExtractor;
+class LatencyTracker;
 typedef Misc::FunctionCall<GLContextData&> AddWaterFunction;
 class RemoteServer;
+class GridRecorder;
 class WaterRenderer;
 
 class Sandbox:public Vrui::Application,public GLObject
@@ -80,20 +87,6 @@ class Sandbox:public Vrui::Application,public GLObject
 	typedef Geometry::OrthonormalTransformation<Scalar,3> ONTransform; // Type for rigid body transformations
 	typedef Kinect::FrameSource::DepthCorrection::PixelCorrection PixelDepthCorrection; // Type for per-pixel depth correction factors
 	
-	struct DataItem:public GLObject::DataItem
-		{
-		/* Elements: */
-		public:
-		double waterTableTime; // Simulation time stamp of the water table in this OpenGL context
-		GLsizei shadowBufferSize[2]; // Size of the shadow rendering frame buffer
-		GLuint shadowFramebufferObject; // Frame buffer object to render shadow maps
-		GLuint shadowDepthTextureObject; // Depth texture for the shadow rendering frame buffer
-		
-		/* Constructors and destructors: */
-		DataItem(void);
-		virtual ~DataItem(void);
-		};
-	
 	struct GridRequest // Structure representing a request to read back bathymetry and/or water level grids from the GPU
 		{
 		/* Embedded classes: */
@@ -126,12 +119,31 @@ class Sandbox:public Vrui::Application,public GLObject
 				}
 			};
 		
+		struct Statistics // Structure holding timing statistics of completed read-backs
+			{
+			/* Elements: */
+			public:
+			unsigned int numReadbacks; // Number of completed read-backs
+			double totalStallTime; // Total time spent in read-back OpenGL calls on the rendering thread in seconds
+			double maxStallTime; // Longest time spent in read-back OpenGL calls for a single request in seconds
+			unsigned int totalLatencyFrames; // Total number of frames between taking and completing requests
+			
+			/* Constructors and destructors: */
+			Statistics(void)
+				:numReadbacks(0),totalStallTime(0.0),maxStallTime(0.0),totalLatencyFrames(0)
+				{
+				}
+			};
+		
 		/* Elements: */
 		Threads::Mutex mutex; // Mutex serializing access to the request structure
 		Request currentRequest; // The currently pending grid request
+		bool requestTaken; // Flag whether the current request is being processed by the rendering thread
+		Statistics statistics; // Timing statistics of completed read-backs
 		
 		/* Constructors and destructors: */
 		GridRequest(void) // Creates an inactive grid request
+			:requestTaken(false)
 			{
 			}
 		
@@ -145,20 +157,124 @@ class Sandbox:public Vrui::Application,public GLObject
 				currentRequest.waterLevelBuffer=newWaterLevelBuffer;
 				currentRequest.callback=newCallback;
 				currentRequest.callbackData=newCallbackData;
+				requestTaken=false;
 				return true;
 				}
 			else
 				return false;
 			}
-		Request getRequest(void) // Returns the current grid request and deactivates it
+		Request getRequest(void) // Returns the current grid request if it has not been taken yet, and marks it as taken
+			{
+			Threads::Mutex::Lock lock(mutex);
+			Request result;
+			if(!requestTaken)
+				{
+				result=currentRequest;
+				requestTaken=currentRequest.isActive();
+				}
+			return result;
+			}
+		void completeRequest(Request& request,double stallTime,unsigned int latencyFrames) // Deactivates the given previously taken request, records its timing statistics, and calls its read-back callback
+			{
 			{
 			Threads::Mutex::Lock lock(mutex);
-			Request result=currentRequest;
 			currentRequest.callback=0;
+			requestTaken=false;
+			++statistics.numReadbacks;
+			statistics.totalStallTime+=stallTime;
+			if(statistics.maxStallTime<stallTime)
+				statistics.maxStallTime=stallTime;
+			statistics.totalLatencyFrames+=latencyFrames;
+			}
+			
+			/* Call the read-back callback outside the lock so that it can issue a new request: */
+			request.complete();
+			}
+		Statistics getStatistics(bool reset) // Returns the current read-back statistics and optionally resets them
+			{
+			Threads::Mutex::Lock lock(mutex);
+			Statistics result=statistics;
+			if(reset)
+				statistics=Statistics();
 			return result;
 			}
 		};
 	
+	struct WaterStepStatistics // Structure holding running statistics of the water flow simulation's per-frame step scheduler
+		{
+		/* Elements: */
+		public:
+		double stepTime; // Running estimate of the time to run a single simulation step in seconds; 0 if unknown
+		double lagFraction; // Running estimate of the fraction of requested simulation time that could not be covered
+		unsigned int numFrames; // Number of frames that ran the water simulation since the last reset
+		unsigned int numSteps; // Number of simulation steps run since the last reset
+		unsigned int numLaggingFrames; // Number of frames since the last reset that could not cover their requested simulation time
+		double requestedTime; // Total simulation time requested since the last reset in seconds
+		double lagTime; // Total requested simulation time that could not be covered since the last reset in seconds
+		
+		/* Constructors and destructors: */
+		WaterStepStatistics(void)
+			:stepTime(0.0),lagFraction(0.0)
+			{
+			resetCounters();
+			}
+		
+		/* Methods: */
+		void resetCounters(void) // Resets the counters accumulated since the last reset, but keeps the running estimates
+			{
+			numFrames=0;
+			numSteps=0;
+			numLaggingFrames=0;
+			requestedTime=0.0;
+			lagTime=0.0;
+			}
+		void addStepTime(double passTime,unsigned int passNumSteps) // Updates the step time estimate with the measured time of a simulation pass of the given number of steps
+			{
+			if(passNumSteps>0)
+				{
+				double newStepTime=passTime/double(passNumSteps);
+				stepTime=stepTime!=0.0?stepTime+(newStepTime-stepTime)*0.1:newStepTime;
+				}
+			}
+		void addFrame(unsigned int frameNumSteps,double frameRequestedTime,double frameLagTime) // Adds a frame that ran the given number of steps and left the given simulation time uncovered
+			{
+			++numFrames;
+			numSteps+=frameNumSteps;
+			if(frameLagTime>0.0)
+				++numLaggingFrames;
+			requestedTime+=frameRequestedTime;
+			lagTime+=frameLagTime;
+			if(frameRequestedTime>0.0)
+				lagFraction+=(frameLagTime/frameRequestedTime-lagFraction)*0.1;
+			}
+		};
+	
+	struct DataItem:public GLObject::DataItem
+		{
+		/* Elements: */
+		public:
+		double waterTableTime; // Simulation time stamp of the water table in this OpenGL context
+		GLsizei shadowBufferSize[2]; // Size of the shadow rendering frame buffer
+		GLuint shadowFramebufferObject; // Frame buffer object to render shadow maps
+		GLuint shadowDepthTextureObject; // Depth texture for the shadow rendering frame buffer
+		bool haveAsyncReadback; // Flag whether the local OpenGL supports asynchronous grid read-back
+		GLuint gridReadbackBufferObjects[2]; // Pixel buffer objects receiving read-back bathymetry and water level grids
+		GLsync gridReadbackFence; // Fence signaling completion of an in-flight grid read-back, or null
+		GridRequest::Request gridReadbackRequest; // Grid request whose asynchronous read-back is in flight
+		double gridReadbackStallTime; // Time spent in OpenGL calls for the in-flight grid read-back so far in seconds
+		unsigned int gridReadbackFrames; // Number of frames the in-flight grid read-back has been pending
+		bool haveTimerQuery; // Flag whether the local OpenGL supports timer queries
+		GLuint waterTimerQueries[4]; // Ring buffer of timer query objects measuring the GPU time of water simulation passes
+		unsigned int waterTimerQuerySteps[4]; // Number of simulation steps measured by each timer query
+		unsigned int firstWaterTimerQuery; // Index of the oldest pending timer query in the ring buffer
+		unsigned int numPendingWaterTimerQueries; // Number of timer queries whose results have not been collected yet
+		unsigned int bathymetryVersion; // Version number of the CPU-resampled bathymetry grid most recently passed to the water table
+		
+		/* Constructors and destructors: */
+		DataItem(void);
+		virtual ~DataItem(void);
+		};
+	
 	struct RenderSettings // Structure to hold per-window rendering settings
 		{
 		/* Elements: */
@@ -187,34 +303,58 @@ class Sandbox:public Vrui::Application,public GLObject
 		void loadHeightMap(const char* heightMapName); // Loads the selected height map
 		};
 	
+	struct SecondaryCamera // Structure holding the state of an additional camera contributing to a fused height field
+		{
+		/* Elements: */
+		public:
+		Kinect::FrameSource* camera; // The camera's component stream
+		PixelDepthCorrection* pixelDepthCorrection; // Buffer of the camera's per-pixel depth correction coefficients
+		FrameFilter* frameFilter; // Processing object to filter raw depth frames from the camera
+		};
+	
 	friend class GlobalWaterTool;
 	friend class LocalWaterTool;
 	friend class DEMTool;
 	friend class BathymetrySaverTool;
 	friend class RemoteServer;
+	friend class GridRecorder;
 	
 	/* Elements: */
 	private:
 	RemoteServer* remoteServer; // A server to stream bathymetry and water level grids to remote clients
+	GridRecorder* gridRecorder; // A recorder writing bathymetry and water level grids to a grid recording file
 	Kinect::FrameSource* camera; // The Kinect camera device
 	unsigned int frameSize[2]; // Width and height of the camera's depth frames
 	PixelDepthCorrection* pixelDepthCorrection; // Buffer of per-pixel depth correction coefficients
 	Kinect::FrameSource::IntrinsicParameters cameraIps; // Intrinsic parameters of the Kinect camera
 	FrameFilter* frameFilter; // Processing object to filter raw depth frames from the Kinect camera
+	std::vector<SecondaryCamera> secondaryCameras; // List of additional cameras whose filtered depth frames are fused with the main camera's
+	HeightFieldFuser* heightFieldFuser; // Object fusing the filtered depth frames of all cameras into a single height field if there are secondary cameras
 	bool pauseUpdates; // Pauses updates of the topography
-	Threads::TripleBuffer<Kinect::FrameBuffer> filteredFrames; // Triple buffer for incoming filtered depth frames
+	Threads::TripleBuffer<FilteredFrame> filteredFrames; // Triple buffer for incoming filtered depth frames and their tile stamps
+	LatencyTracker* latencyTracker; // Object collecting the trace records of filtered depth frames that were presented
 	DepthImageRenderer* depthImageRenderer; // Object managing the current filtered depth image
 	ONTransform boxTransform; // Transformation from camera space to baseplane space (x along long sandbox axis, z up)
 	Scalar boxSize; // Radius of sphere around sandbox area
 	Box bbox; // Bounding box around all potential surfaces
 	WaterTable2* waterTable; // Water flow simulation object
+	BathymetryResampler* bathymetryResampler; // Object resampling filtered depth frames into the water table's bathymetry grid on the CPU, or null if the grid is rendered on the GPU
+	GLfloat* bathymetryGrid; // Most recent bathymetry grid resampled on the CPU
+	unsigned int bathymetryVersion; // Version number of the most recent bathymetry grid resampled on the CPU
 	double waterSpeed; // Relative speed of water flow simulation
 	unsigned int waterMaxSteps; // Maximum number of water simulation steps per frame
+	double waterFrameBudget; // Time budget for water simulation steps per frame in seconds; 0 disables the budget
+	mutable Threads::Mutex waterStepStatisticsMutex; // Mutex serializing access to the water simulation step statistics
+	mutable WaterStepStatistics waterStepStatistics; // Running statistics of the water simulation's per-frame step scheduler
+	mutable double lastWaterSubmitTime; // Application time at which water sources were last submitted to the water simulation thread; protected by waterStepStatisticsMutex
 	GLfloat rainStrength; // Amount of water deposited by rain tools and objects on each water simulation step
 	HandExtractor* handExtractor; // Object to detect splayed hands above the sand surface to make rain
 	const AddWaterFunction* addWaterFunction; // Render function registered with the water table
 	bool addWaterFunctionRegistered; // Flag if the water adding function is currently registered with the water table
 	mutable GridRequest gridRequest; // Structure holding pending grid read-back requests
+	bool asyncGridReadback; // Flag whether to read back grids asynchronously through pixel buffer objects if supported
+	double gridRecordingInterval; // Time interval between frames recorded into grid recording files
+	unsigned int gridRecordingChunkSize; // Maximum number of frames per chunk in grid recording files
 	std::vector<RenderSettings> renderSettings; // List of per-window rendering settings
 	Vrui::Lightsource* sun; // An external fixed light source
 	DEM* activeDem; // The currently active DEM
@@ -224,14 +364,20 @@ class Sandbox:public Vrui::Application,public GLObject
 	GLMotif::TextFieldSlider* waterSpeedSlider;
 	GLMotif::TextFieldSlider* waterMaxStepsSlider;
 	GLMotif::TextField* frameRateTextField;
+	GLMotif::TextField* waterLagTextField;
 	GLMotif::TextFieldSlider* waterAttenuationSlider;
 	int controlPipeFd; // File descriptor of an optional named pipe to send control commands to a running AR Sandbox
 	
 	/* Private methods: */
 	void rawDepthFrameDispatcher(const Kinect::FrameBuffer& frameBuffer); // Callback receiving raw depth frames from the Kinect camera; forwards them to the frame filter and rain maker objects
-	void receiveFilteredFrame(const Kinect::FrameBuffer& frameBuffer); // Callback receiving filtered depth frames from the filter object
+	void secondaryDepthFrameDispatcher(const Kinect::FrameBuffer& frameBuffer,unsigned int secondaryCameraIndex); // Callback receiving raw depth frames from a secondary camera; forwards them to the camera's frame filter
+	void receiveFilteredFrame(const FilteredFrame& frame); // Callback receiving filtered depth frames from the filter object
 	void toggleDEM(DEM* dem); // Sets or toggles the currently active DEM
 	void addWater(GLContextData& contextData) const; // Function to render geometry that adds water to the water table
+	void readGrid(DataItem* dataItem,bool async,int gridIndex,GLfloat* gridBuffer) const; // Reads back the currently bound bathymetry (index 0) or water level (index 1) grid texture into the given buffer, or into the grid's pixel buffer object if async is true
+	void finishGridReadback(DataItem* dataItem) const; // Completes an in-flight asynchronous grid read-back if its results have arrived
+	void collectWaterTimerQueries(DataItem* dataItem) const; // Updates the water simulation step time estimate from all finished timer queries
+	void startGridRecording(const char* gridRecordingFileName); // Starts recording bathymetry and water level grids into a grid recording file of the given name
 	void pauseUpdatesCallback(GLMotif::ToggleButton::ValueChangedCallbackData* cbData);
 	void showWaterControlDialogCallback(Misc::CallbackData* cbData);
 	void waterSpeedSliderCallback(GLMotif::TextFieldSlider::ValueChangedCallbackData* cbData);
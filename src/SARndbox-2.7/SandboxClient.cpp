@@ -334,26 +334,103 @@ SandboxClient::DataItem::~DataItem(void)
 Methods of class SandboxClient:
 ******************************/
 
+void SandboxClient::connectToServer(const char* serverName,int serverPortId,unsigned int requestedProtocolVersion)
+	{
+	/* Connect to the AR Sandbox server: */
+	pipe=new Comm::TCPPipe(serverName,serverPortId);
+	
+	try
+		{
+		/* Send an endianness token carrying the requested protocol version to the server: */
+		pipe->write<Misc::UInt32>(GridStreamCodec::endiannessToken+(requestedProtocolVersion-1));
+		pipe->flush();
+		
+		/* Receive an endianness token from the server: */
+		Misc::UInt32 token=pipe->read<Misc::UInt32>();
+		if(token==0x78563412U)
+			pipe->setSwapOnRead(true);
+		else if(token!=GridStreamCodec::endiannessToken)
+			throw std::runtime_error("SandboxClient: Invalid response from remote AR Sandbox");
+		
+		/* Receive the remote AR Sandbox's water table grid size, cell size, and elevation range: */
+		for(int i=0;i<2;++i)
+			{
+			gridSize[i]=pipe->read<Misc::UInt32>();
+			cellSize[i]=pipe->read<Misc::Float32>();
+			}
+		for(int i=0;i<2;++i)
+			elevationRange[i]=pipe->read<Misc::Float32>();
+		
+		/* Receive the negotiated protocol version; version 1 servers do not send one: */
+		protocolVersion=1;
+		if(requestedProtocolVersion>=2)
+			{
+			protocolVersion=pipe->read<Misc::UInt32>();
+			if(protocolVersion<2||protocolVersion>requestedProtocolVersion)
+				throw std::runtime_error("SandboxClient: Unsupported protocol version from remote AR Sandbox");
+			}
+		}
+	catch(const std::runtime_error& err)
+		{
+		/* Disconnect from the remote AR Sandbox: */
+		delete pipe;
+		pipe=0;
+		
+		/* Re-throw the exception: */
+		throw;
+		}
+	}
+
 void SandboxClient::readGrids(void)
 	{
 	/* Start a new set of grids: */
 	GridBuffers& gb=grids.startNewValue();
 	
+	GridStreamCodec::Value* quantized=&quantizedGrids[0];
+	if(protocolVersion>=2)
+		{
+		/* Receive an encoded keyframe or delta frame: */
+		unsigned int frameType=pipe->read<Misc::UInt8>();
+		size_t codeSize=pipe->read<Misc::UInt32>();
+		if(codeSize>GridStreamCodec::getMaxCodeSize(quantizedGrids.size()))
+			throw std::runtime_error("SandboxClient: Oversized grid frame from remote AR Sandbox");
+		frameCode.resize(codeSize);
+		if(codeSize>0)
+			pipe->read(&frameCode[0],codeSize);
+		
+		/* Decode the frame into the quantized grids: */
+		if(frameType==GridStreamCodec::KEYFRAME)
+			{
+			GridStreamCodec::decode(quantizedGrids.size(),codeSize>0?&frameCode[0]:0,codeSize,0,quantized);
+			haveKeyframe=true;
+			}
+		else if(frameType==GridStreamCodec::DELTAFRAME&&haveKeyframe)
+			GridStreamCodec::decode(quantizedGrids.size(),codeSize>0?&frameCode[0]:0,codeSize,quantized,quantized);
+		else
+			throw std::runtime_error("SandboxClient: Invalid grid frame from remote AR Sandbox");
+		}
+	else
+		{
+		/* Receive the raw quantized grids: */
+		pipe->read(quantized,quantizedGrids.size());
+		}
+	
 	/* Calculate elevation quantization factors: */
 	GLfloat eScale=(elevationRange[1]-elevationRange[0])/65535.0f;
 	GLfloat eOffset=elevationRange[0];
 	
-	/* Receive the bathymetry grid: */
+	/* Convert the bathymetry grid: */
+	const GridStreamCodec::Value* qPtr=quantized;
 	GLfloat* bPtr=gb.bathymetry;
 	for(GLsizei y=0;y<gridSize[1]-1;++y)
-		for(GLsizei x=0;x<gridSize[0]-1;++x,++bPtr)
-			*bPtr=GLfloat(pipe->read<Misc::UInt16>())*eScale+eOffset;
+		for(GLsizei x=0;x<gridSize[0]-1;++x,++qPtr,++bPtr)
+			*bPtr=GLfloat(*qPtr)*eScale+eOffset;
 	
-	/* Receive the water level grid: */
+	/* Convert the water level grid: */
 	GLfloat* wlPtr=gb.waterLevel;
 	for(GLsizei y=0;y<gridSize[1];++y)
-		for(GLsizei x=0;x<gridSize[0];++x,++wlPtr)
-			*wlPtr=GLfloat(pipe->read<Misc::UInt16>())*eScale+eOffset;
+		for(GLsizei x=0;x<gridSize[0];++x,++qPtr,++wlPtr)
+			*wlPtr=GLfloat(*qPtr)*eScale+eOffset;
 	
 	/* Post the new set of grids: */
 	grids.postNewValue();
@@ -727,7 +804,8 @@ void SandboxClient::compileShaders(SandboxClient::DataItem* dataItem,const GLLig
 
 SandboxClient::SandboxClient(int& argc,char**& argv)
 	:Vrui::Application(argc,argv),
-	 pipe(0),
+	 pipe(0),protocolVersion(1),
+	 haveKeyframe(false),
 	 gridVersion(0),
 	 sun(0),underwater(false)
 	{
@@ -748,37 +826,23 @@ SandboxClient::SandboxClient(int& argc,char**& argv)
 	if(serverName==0)
 		throw std::runtime_error("SandboxClient: No server name provided");
 	
-	/* Connect to the AR Sandbox server: */
-	pipe=new Comm::TCPPipe(serverName,serverPortId);
-	
-	/* Send an endianness token to the server: */
-	pipe->write<Misc::UInt32>(0x12345678U);
-	pipe->flush();
-	
-	/* Receive an endianness token from the server: */
-	Misc::UInt32 token=pipe->read<Misc::UInt32>();
-	if(token==0x78563412U)
-		pipe->setSwapOnRead(true);
-	else if(token!=0x12345678U)
+	/* Connect to the AR Sandbox server with the highest supported protocol version: */
+	try
 		{
-		delete pipe;
-		throw std::runtime_error("SandboxClient: Invalid response from remote AR Sandbox");
+		connectToServer(serverName,serverPortId,GridStreamCodec::protocolVersion);
+		}
+	catch(const std::runtime_error& err)
+		{
+		/* Version 1 servers close the connection when they receive a newer endianness token; reconnect using protocol version 1: */
+		connectToServer(serverName,serverPortId,1);
 		}
 	
 	try
 		{
-		/* Receive the remote AR Sandbox's water table grid size, cell size, and elevation range: */
-		for(int i=0;i<2;++i)
-			{
-			gridSize[i]=pipe->read<Misc::UInt32>();
-			cellSize[i]=pipe->read<Misc::Float32>();
-			}
-		for(int i=0;i<2;++i)
-			elevationRange[i]=pipe->read<Misc::Float32>();
-		
 		/* Initialize the grid buffers: */
 		for(int i=0;i<3;++i)
 			grids.getBuffer(i).init(gridSize);
+		quantizedGrids.resize(size_t(gridSize[1]-1)*size_t(gridSize[0]-1)+size_t(gridSize[1])*size_t(gridSize[0]));
 		
 		/* Read the initial set of grids: */
 		readGrids();
@@ -23,6 +23,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef SANDBOXCLIENT_INCLUDED
 #define SANDBOXCLIENT_INCLUDED
 
+#include <vector>
 #include <Threads/Thread.h>
 #include <Threads/TripleBuffer.h>
 #include <Threads/EventDispatcher.h>
@@ -39,6 +40,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Vrui/GenericToolFactory.h>
 #include <Vrui/SurfaceNavigationTool.h>
 
+#include "GridStreamCodec.h"
+
 /* Forward declarations: */
 namespace Comm {
 class TCPPipe;
@@ -151,17 +154,22 @@ class SandboxClient:public Vrui::Application,public GLObject
 	
 	/* Elements: */
 	Comm::TCPPipe* pipe; // TCP pipe connected to the remote AR Sandbox
+	unsigned int protocolVersion; // Protocol version negotiated with the remote AR Sandbox
 	GLsizei gridSize[2]; // Width and height of the water table's cell-centered quantity grid
 	GLfloat cellSize[2]; // Width and height of each water table cell
 	GLfloat elevationRange[2]; // Minimum and maximum valid elevations
 	Threads::EventDispatcher dispatcher; // Dispatcher for events on the TCP pipe
 	Threads::Thread communicationThread; // Thread to handle communication with the remote AR Sandbox in the background
 	Threads::TripleBuffer<GridBuffers> grids; // Triple buffer of bathymetry and water level grids
+	std::vector<GridStreamCodec::Value> quantizedGrids; // Most recently received quantized bathymetry and water level grids
+	bool haveKeyframe; // Flag whether a keyframe has been received, to which subsequent deltas can be applied
+	std::vector<GridStreamCodec::Byte> frameCode; // Buffer to receive encoded grid frames
 	unsigned int gridVersion; // Version number of currently locked grids
 	Vrui::Lightsource* sun; // Light source representing the sun
 	bool underwater; // Flag if the main viewer's head is currently under water
 	
 	/* Private methods: */
+	void connectToServer(const char* serverName,int serverPortId,unsigned int requestedProtocolVersion); // Connects to the remote AR Sandbox and receives its water table layout using the requested protocol version; throws exception and leaves the client disconnected on failure
 	void readGrids(void); // Reads a new set of bathymetry and water level grids from the remote AR Sandbox
 	Scalar intersectLine(const Point& p0,const Point& p1) const; // Returns the intersection parameter of a line segment with the bathymetry; returns 1.0 if there is no intersection
 	static bool serverMessageCallback(Threads::EventDispatcher::ListenerKey eventKey,int eventType,void* userData); // Callback called when a message arrives from the remote AR Sandbox
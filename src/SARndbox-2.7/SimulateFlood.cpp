@@ -0,0 +1,540 @@
+/***********************************************************************
+SimulateFlood - Utility to run the water flow simulation offline on a
+sequence of saved bathymetry grids, to benchmark the simulation and to
+precompute flooding scenarios.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+/***********************************************************************
+Water level snapshot files are little-endian binary files starting with
+a 32-byte identification string, followed by the water table's width and
+height in cells (2 x int) and its cell size (2 x float). The header is
+followed by a stream of records, each consisting of a record type (int),
+the simulation time at which the record was taken (double), and a grid
+of floats. Bathymetry records (type 0) contain the vertex-centered
+bathymetry grid of water table size minus one, and water level records
+(type 1) contain the cell-centered water surface elevation grid.
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <Misc/ThrowStdErr.h>
+#include <Misc/SelfDestructPointer.h>
+#include <Misc/FileNameExtensions.h>
+#include <Misc/Timer.h>
+#include <IO/File.h>
+#include <IO/OpenFile.h>
+#include <Math/Math.h>
+
+#include "WaterTableCPU.h"
+#include "GridRecordingReader.h"
+
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+struct BathymetryGrid // Structure for vertex-centered bathymetry grids loaded from files
+	{
+	/* Elements: */
+	public:
+	int size[2]; // Width and height of the grid in vertices
+	float cellSize[2]; // Distance between adjacent grid vertices in x and y
+	std::vector<float> elevations; // Grid of elevations in row-major order, starting in the south-west corner
+	};
+
+/****************
+Helper functions:
+****************/
+
+void loadBinaryGrid(const char* gridFileName,BathymetryGrid& grid)
+	{
+	/* Open the grid file and read the header in the same format as the DEM class: */
+	IO::FilePtr gridFile=IO::openFile(gridFileName);
+	gridFile->setEndianness(Misc::LittleEndian);
+	gridFile->read<int>(grid.size,2);
+	if(grid.size[0]<2||grid.size[1]<2)
+		Misc::throwStdErr("loadBinaryGrid: Invalid grid size %d x %d in file %s",grid.size[0],grid.size[1],gridFileName);
+	float box[4];
+	gridFile->read<float>(box,4);
+	for(int i=0;i<2;++i)
+		grid.cellSize[i]=(box[2+i]-box[i])/float(grid.size[i]-1);
+	
+	/* Read the elevation postings: */
+	grid.elevations.resize(size_t(grid.size[1])*size_t(grid.size[0]));
+	gridFile->read<float>(&grid.elevations[0],grid.elevations.size());
+	}
+
+int parseInt(const std::vector<char>& record,size_t offset,int width)
+	{
+	std::string field(&record[offset],width);
+	return atoi(field.c_str());
+	}
+
+double parseFloat(const std::vector<char>& record,size_t offset,int width)
+	{
+	/* Replace FORTRAN-style exponent markers before conversion: */
+	std::string field(&record[offset],width);
+	for(std::string::iterator fIt=field.begin();fIt!=field.end();++fIt)
+		if(*fIt=='D'||*fIt=='d')
+			*fIt='E';
+	return atof(field.c_str());
+	}
+
+void loadUsgsDem(const char* demFileName,BathymetryGrid& grid)
+	{
+	/* Read the entire DEM file: */
+	std::vector<char> dem;
+	{
+	IO::FilePtr demFile=IO::openFile(demFileName);
+	char buffer[8192];
+	size_t readSize;
+	while((readSize=demFile->readUpTo(buffer,sizeof(buffer)))>0)
+		dem.insert(dem.end(),buffer,buffer+readSize);
+	}
+	if(dem.size()<2048)
+		Misc::throwStdErr("loadUsgsDem: File %s is too short",demFileName);
+	dem.push_back('\0');
+	
+	/* Parse the fixed-format fields of the A record as written by BathymetrySaverTool: */
+	for(int i=0;i<2;++i)
+		grid.cellSize[i]=float(parseFloat(dem,816+i*12,12));
+	double zResolution=parseFloat(dem,840,12);
+	grid.size[0]=parseInt(dem,858,6);
+	if(grid.size[0]<2||grid.cellSize[0]<=0.0f||grid.cellSize[1]<=0.0f||zResolution<=0.0)
+		Misc::throwStdErr("loadUsgsDem: Invalid A record in file %s",demFileName);
+	
+	/* Read all elevation profiles, one per grid column: */
+	size_t offset=1024;
+	grid.size[1]=0;
+	for(int column=0;column<grid.size[0];++column)
+		{
+		if(offset+144>dem.size())
+			Misc::throwStdErr("loadUsgsDem: Truncated profile %d in file %s",column+1,demFileName);
+		
+		/* Parse the B record header: */
+		int numRows=parseInt(dem,offset+12,6);
+		double datum=parseFloat(dem,offset+72,24);
+		if(column==0)
+			{
+			if(numRows<2)
+				Misc::throwStdErr("loadUsgsDem: Invalid profile size %d in file %s",numRows,demFileName);
+			grid.size[1]=numRows;
+			grid.elevations.resize(size_t(grid.size[1])*size_t(grid.size[0]));
+			}
+		else if(numRows!=grid.size[1])
+			Misc::throwStdErr("loadUsgsDem: Mismatching size of profile %d in file %s",column+1,demFileName);
+		
+		/* Parse the profile's elevation postings, which are separated by whitespace and record padding: */
+		const char* pPtr=&dem[offset+144];
+		float* ePtr=&grid.elevations[column];
+		for(int row=0;row<numRows;++row,ePtr+=grid.size[0])
+			{
+			char* end;
+			long posting=strtol(pPtr,&end,10);
+			if(end==pPtr)
+				Misc::throwStdErr("loadUsgsDem: Truncated profile %d in file %s",column+1,demFileName);
+			*ePtr=float(datum+double(posting)*zResolution);
+			pPtr=end;
+			}
+		
+		/* Advance to the record following the profile: */
+		offset=((size_t(pPtr-&dem[0])+1023U)&~size_t(1023U));
+		}
+	}
+
+void loadBathymetryGrid(const char* fileName,BathymetryGrid& grid)
+	{
+	if(Misc::hasCaseExtension(fileName,".grid"))
+		loadBinaryGrid(fileName,grid);
+	else if(Misc::hasCaseExtension(fileName,".dem"))
+		loadUsgsDem(fileName,grid);
+	else
+		Misc::throwStdErr("loadBathymetryGrid: Unrecognized format of file %s",fileName);
+	}
+
+void writeRecord(IO::File& snapshotFile,int recordType,double simTime,const float* grid,size_t gridSize)
+	{
+	snapshotFile.write<int>(recordType);
+	snapshotFile.write<double>(simTime);
+	snapshotFile.write<float>(grid,gridSize);
+	}
+
+}
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	double totalTime=60.0;
+	double bathymetryInterval=0.0;
+	double frameTime=1.0/60.0;
+	unsigned int maxNumSteps=30;
+	bool forceSteps=false;
+	float attenuation=-1.0f;
+	bool dryBoundary=true;
+	bool haveWaterLevel=false;
+	float waterLevel=0.0f;
+	float waterDeposit=0.0f;
+	double snapshotInterval=1.0;
+	const char* snapshotFileName=0;
+	unsigned int numThreads=0;
+	const char* recordingFileName=0;
+	double recordingStartTime=0.0;
+	bool haveTotalTime=false;
+	std::vector<const char*> gridFileNames;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"h")==0)
+				{
+				std::cout<<"Usage: SimulateFlood [option 1] ... [option n] <bathymetry file 1> ... <bathymetry file m>"<<std::endl;
+				std::cout<<"  Bathymetry files are binary grids (.grid) as loaded by DEMTool, or"<<std::endl;
+				std::cout<<"  USGS ASCII DEMs (.dem) as written by BathymetrySaverTool"<<std::endl;
+				std::cout<<"  Bathymetry files are not used when replaying a grid recording"<<std::endl;
+				std::cout<<"  Options:"<<std::endl;
+				std::cout<<"  -h"<<std::endl;
+				std::cout<<"     Prints this help message"<<std::endl;
+				std::cout<<"  -t <total simulation time>"<<std::endl;
+				std::cout<<"     Total amount of simulated time in seconds"<<std::endl;
+				std::cout<<"     Default: 60.0, or remaining duration of replayed grid recording"<<std::endl;
+				std::cout<<"  -bi <bathymetry interval>"<<std::endl;
+				std::cout<<"     Simulated time in seconds between loading successive bathymetry files"<<std::endl;
+				std::cout<<"     Default: total simulation time divided by number of bathymetry files"<<std::endl;
+				std::cout<<"  -ws <frame time> <max number of steps>"<<std::endl;
+				std::cout<<"     Simulated time in seconds per frame, and maximum number of"<<std::endl;
+				std::cout<<"     simulation steps per frame"<<std::endl;
+				std::cout<<"     Default: "<<frameTime<<" "<<maxNumSteps<<std::endl;
+				std::cout<<"  -fs"<<std::endl;
+				std::cout<<"     Forces the last simulation step of each frame to use up the frame's"<<std::endl;
+				std::cout<<"     remaining time, which may lead to instability"<<std::endl;
+				std::cout<<"  -wa <attenuation>"<<std::endl;
+				std::cout<<"     Attenuation factor for partial discharges"<<std::endl;
+				std::cout<<"     Default: water table default"<<std::endl;
+				std::cout<<"  -nodry"<<std::endl;
+				std::cout<<"     Disables dry boundary conditions"<<std::endl;
+				std::cout<<"  -wl <water level>"<<std::endl;
+				std::cout<<"     Fills the initial bathymetry with water up to the given elevation"<<std::endl;
+				std::cout<<"  -wd <water deposit>"<<std::endl;
+				std::cout<<"     Amount of water added to (or removed from if negative) each cell per second"<<std::endl;
+				std::cout<<"     Default: 0.0"<<std::endl;
+				std::cout<<"  -o <snapshot file name>"<<std::endl;
+				std::cout<<"     Writes bathymetry and water level snapshots to the given file"<<std::endl;
+				std::cout<<"  -si <snapshot interval>"<<std::endl;
+				std::cout<<"     Simulated time in seconds between water level snapshots"<<std::endl;
+				std::cout<<"     Default: 1.0"<<std::endl;
+				std::cout<<"  -nt <number of threads>"<<std::endl;
+				std::cout<<"     Number of simulation threads"<<std::endl;
+				std::cout<<"     Default: number of CPUs"<<std::endl;
+				std::cout<<"  -rec <grid recording file name>"<<std::endl;
+				std::cout<<"     Replays the bathymetry grids of the given grid recording at their recorded"<<std::endl;
+				std::cout<<"     times, starting from the recorded water level unless -wl is given"<<std::endl;
+				std::cout<<"  -rst <replay start time>"<<std::endl;
+				std::cout<<"     Starts replaying the grid recording at the given recording time in seconds"<<std::endl;
+				std::cout<<"     Default: 0.0"<<std::endl;
+				return 0;
+				}
+			else if(strcasecmp(argv[i]+1,"t")==0)
+				{
+				++i;
+				totalTime=atof(argv[i]);
+				haveTotalTime=true;
+				}
+			else if(strcasecmp(argv[i]+1,"bi")==0)
+				{
+				++i;
+				bathymetryInterval=atof(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"ws")==0)
+				{
+				++i;
+				frameTime=atof(argv[i]);
+				++i;
+				maxNumSteps=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"fs")==0)
+				forceSteps=true;
+			else if(strcasecmp(argv[i]+1,"wa")==0)
+				{
+				++i;
+				attenuation=float(atof(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"nodry")==0)
+				dryBoundary=false;
+			else if(strcasecmp(argv[i]+1,"wl")==0)
+				{
+				++i;
+				haveWaterLevel=true;
+				waterLevel=float(atof(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"wd")==0)
+				{
+				++i;
+				waterDeposit=float(atof(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"o")==0)
+				{
+				++i;
+				snapshotFileName=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"si")==0)
+				{
+				++i;
+				snapshotInterval=atof(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"nt")==0)
+				{
+				++i;
+				numThreads=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"rec")==0)
+				{
+				++i;
+				recordingFileName=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"rst")==0)
+				{
+				++i;
+				recordingStartTime=atof(argv[i]);
+				}
+			else
+				std::cerr<<"Ignoring unrecognized command line option "<<argv[i]<<std::endl;
+			}
+		else
+			gridFileNames.push_back(argv[i]);
+		}
+	if(gridFileNames.empty()&&recordingFileName==0)
+		{
+		std::cerr<<"No bathymetry files provided; use -h for help"<<std::endl;
+		return 1;
+		}
+	if(frameTime<=0.0||maxNumSteps==0)
+		{
+		std::cerr<<"Invalid frame time or step budget"<<std::endl;
+		return 1;
+		}
+	if(bathymetryInterval<=0.0&&!gridFileNames.empty())
+		bathymetryInterval=totalTime/double(gridFileNames.size());
+	
+	try
+		{
+		/* Load the first bathymetry grid: */
+		BathymetryGrid grid;
+		Misc::SelfDestructPointer<GridRecordingReader> recording;
+		bool haveRecordedFrame=false;
+		if(recordingFileName!=0)
+			{
+			/* Open the grid recording and read the frame recorded at the start time: */
+			recording.setTarget(new GridRecordingReader(recordingFileName));
+			recordingStartTime+=recording->getStartTime();
+			if(!recording->seek(recordingStartTime)&&!recording->readNextFrame())
+				Misc::throwStdErr("Grid recording %s does not contain any frames",recordingFileName);
+			for(int i=0;i<2;++i)
+				{
+				grid.size[i]=recording->getGridSize()[i]-1;
+				grid.cellSize[i]=recording->getCellSize()[i];
+				}
+			grid.elevations.resize(size_t(grid.size[1])*size_t(grid.size[0]));
+			recording->getBathymetry(&grid.elevations[0]);
+			if(!haveTotalTime&&recording->getEndTime()>recordingStartTime)
+				totalTime=recording->getEndTime()-recordingStartTime;
+			}
+		else
+			loadBathymetryGrid(gridFileNames[0],grid);
+		int gridSize[2];
+		for(int i=0;i<2;++i)
+			gridSize[i]=grid.size[i];
+		float baseElevation=grid.elevations[0];
+		for(std::vector<float>::iterator eIt=grid.elevations.begin();eIt!=grid.elevations.end();++eIt)
+			baseElevation=Math::min(baseElevation,*eIt);
+		
+		/* Create a water table with one more cell than bathymetry vertices in each direction: */
+		WaterTableCPU waterTable(gridSize[0]+1,gridSize[1]+1,grid.cellSize,baseElevation,numThreads);
+		if(attenuation>=0.0f)
+			waterTable.setAttenuation(attenuation);
+		waterTable.setDryBoundary(dryBoundary);
+		waterTable.updateBathymetry(&grid.elevations[0]);
+		const int* size=waterTable.getSize();
+		size_t numCells=size_t(size[1])*size_t(size[0]);
+		std::vector<float> waterGrid(numCells);
+		if(haveWaterLevel)
+			{
+			for(size_t i=0;i<numCells;++i)
+				waterGrid[i]=waterLevel;
+			waterTable.setWaterLevel(&waterGrid[0]);
+			}
+		else if(recording.isValid())
+			{
+			/* Start from the recorded water level: */
+			recording->getWaterLevel(&waterGrid[0]);
+			waterTable.setWaterLevel(&waterGrid[0]);
+			}
+		if(recording.isValid())
+			{
+			std::cout<<"Replaying grid recording "<<recordingFileName<<" with "<<recording->getNumFrames()<<" frames in "<<recording->getChunks().size()<<" chunks from time "<<recording->getFrameTime()<<" s"<<std::endl;
+			haveRecordedFrame=recording->readNextFrame();
+			}
+		std::cout<<"Simulating "<<totalTime<<" s on a "<<size[0]<<" x "<<size[1]<<" water table using "<<waterTable.getNumThreads()<<" threads"<<std::endl;
+		
+		/* Open the snapshot file and write its header and the initial state: */
+		IO::FilePtr snapshotFile;
+		if(snapshotFileName!=0)
+			{
+			snapshotFile=IO::openFile(snapshotFileName,IO::File::WriteOnly);
+			snapshotFile->setEndianness(Misc::LittleEndian);
+			char fileHeader[32];
+			memset(fileHeader,0,sizeof(fileHeader));
+			strcpy(fileHeader,"SARndbox water levels v1.0\n");
+			snapshotFile->write<char>(fileHeader,sizeof(fileHeader));
+			snapshotFile->write<int>(size,2);
+			snapshotFile->write<float>(waterTable.getCellSize(),2);
+			writeRecord(*snapshotFile,0,0.0,waterTable.getBathymetry(),size_t(gridSize[1])*size_t(gridSize[0]));
+			waterTable.getWaterLevel(&waterGrid[0]);
+			writeRecord(*snapshotFile,1,0.0,&waterGrid[0],numCells);
+			}
+		
+		/* Run the simulation frame by frame, using the same step budget logic as the Sandbox application: */
+		double simTime=0.0;
+		double simulatedTime=0.0;
+		double lostTime=0.0;
+		size_t nextGridIndex=1;
+		double nextGridTime=bathymetryInterval;
+		double nextSnapshotTime=snapshotInterval;
+		unsigned int numFrames=0;
+		unsigned int numLaggingFrames=0;
+		unsigned int numSteps=0;
+		double solverTime=0.0;
+		Misc::Timer wallTimer;
+		while(simTime<totalTime-1.0e-8)
+			{
+			/* Replay all recorded bathymetry grids that are due: */
+			bool replayGrid=false;
+			while(haveRecordedFrame&&recording->getFrameTime()-recordingStartTime<=simTime+1.0e-8)
+				{
+				recording->getBathymetry(&grid.elevations[0]);
+				replayGrid=true;
+				haveRecordedFrame=recording->readNextFrame();
+				}
+			if(replayGrid)
+				{
+				Misc::Timer updateTimer;
+				waterTable.updateBathymetry(&grid.elevations[0]);
+				updateTimer.elapse();
+				solverTime+=updateTimer.getTime();
+				if(snapshotFile!=0)
+					writeRecord(*snapshotFile,0,simTime,waterTable.getBathymetry(),size_t(gridSize[1])*size_t(gridSize[0]));
+				}
+			
+			/* Load the next bathymetry grid if it is due: */
+			if(!recording.isValid()&&nextGridIndex<gridFileNames.size()&&simTime>=nextGridTime-1.0e-8)
+				{
+				loadBathymetryGrid(gridFileNames[nextGridIndex],grid);
+				if(grid.size[0]!=gridSize[0]||grid.size[1]!=gridSize[1])
+					Misc::throwStdErr("Bathymetry file %s has mismatching grid size %d x %d",gridFileNames[nextGridIndex],grid.size[0],grid.size[1]);
+				Misc::Timer updateTimer;
+				waterTable.updateBathymetry(&grid.elevations[0]);
+				updateTimer.elapse();
+				solverTime+=updateTimer.getTime();
+				if(snapshotFile!=0)
+					writeRecord(*snapshotFile,0,simTime,waterTable.getBathymetry(),size_t(gridSize[1])*size_t(gridSize[0]));
+				++nextGridIndex;
+				nextGridTime+=bathymetryInterval;
+				}
+			
+			/* Simulate one frame: */
+			Misc::Timer frameTimer;
+			float totalTimeStep=float(Math::min(frameTime,totalTime-simTime));
+			unsigned int frameSteps=0;
+			while(frameSteps<maxNumSteps-1U&&totalTimeStep>1.0e-8f)
+				{
+				/* Run with a self-determined time step to maintain stability: */
+				waterTable.setMaxStepSize(totalTimeStep);
+				float timeStep=waterTable.runSimulationStep(false);
+				if(waterDeposit!=0.0f)
+					waterTable.addWater(waterDeposit*timeStep);
+				totalTimeStep-=timeStep;
+				simulatedTime+=double(timeStep);
+				++frameSteps;
+				}
+			if(totalTimeStep>1.0e-8f)
+				{
+				if(forceSteps)
+					{
+					/* Force the final step to use up the frame's remaining time: */
+					waterTable.setMaxStepSize(totalTimeStep);
+					float timeStep=waterTable.runSimulationStep(true);
+					if(waterDeposit!=0.0f)
+						waterTable.addWater(waterDeposit*timeStep);
+					totalTimeStep-=timeStep;
+					simulatedTime+=double(timeStep);
+					++frameSteps;
+					}
+				else
+					{
+					/* Account for simulation time lost due to the step budget: */
+					lostTime+=double(totalTimeStep);
+					++numLaggingFrames;
+					}
+				}
+			frameTimer.elapse();
+			solverTime+=frameTimer.getTime();
+			numSteps+=frameSteps;
+			++numFrames;
+			simTime+=Math::min(frameTime,totalTime-simTime);
+			
+			/* Write a water level snapshot if one is due: */
+			if(snapshotFile!=0&&(simTime>=nextSnapshotTime-1.0e-8||simTime>=totalTime-1.0e-8))
+				{
+				waterTable.getWaterLevel(&waterGrid[0]);
+				writeRecord(*snapshotFile,1,simTime,&waterGrid[0],numCells);
+				while(nextSnapshotTime<=simTime+1.0e-8)
+					nextSnapshotTime+=snapshotInterval;
+				}
+			}
+		wallTimer.elapse();
+		double wallTime=wallTimer.getTime();
+		
+		/* Print simulation statistics: */
+		std::cout<<std::fixed<<std::setprecision(3);
+		std::cout<<"Simulated "<<simulatedTime<<" s of "<<simTime<<" s in "<<numFrames<<" frames and "<<numSteps<<" steps"<<std::endl;
+		if(numLaggingFrames>0)
+			std::cout<<numLaggingFrames<<" frames exhausted the step budget, losing "<<lostTime<<" s of simulation time"<<std::endl;
+		std::cout<<"Solver time: "<<solverTime<<" s, total wall-clock time: "<<wallTime<<" s"<<std::endl;
+		if(numSteps>0&&solverTime>0.0)
+			{
+			std::cout<<"Simulation speed: "<<simulatedTime/solverTime<<" simulated s per wall-clock s ("<<simulatedTime/wallTime<<" including I/O)"<<std::endl;
+			std::cout<<"Step rate: "<<double(numSteps)/solverTime<<" steps/s, "<<solverTime*1000.0/double(numSteps)<<" ms per step"<<std::endl;
+			}
+		else
+			std::cout<<"No simulation steps were run"<<std::endl;
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"SimulateFlood: Terminated due to exception "<<err.what()<<std::endl;
+		return 1;
+		}
+	
+	return 0;
+	}
@@ -0,0 +1,309 @@
+/***********************************************************************
+SimulateRemoteClients - Utility to connect a number of fake remote
+clients, some of them deliberately slow, to an Augmented Reality
+Sandbox's remote server, and to report the grid frame rates each client
+receives.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <Misc/SizedTypes.h>
+#include <Misc/Time.h>
+#include <Misc/Endianness.h>
+#include <Threads/Thread.h>
+#include <Comm/TCPPipe.h>
+#include <Math/Math.h>
+#include <Realtime/Time.h>
+
+#include "GridStreamCodec.h"
+
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+class FakeClient // Class for fake remote clients receiving and decoding grid frames in a background thread
+	{
+	/* Elements: */
+	public:
+	Comm::TCPPipe pipe; // Pipe connected to the remote server
+	unsigned int protocolVersion; // Protocol version requested from the remote server
+	double bytesPerSecond; // Maximum rate at which the client reads from the remote server; 0 for no limit
+	size_t numGridValues; // Total number of values in a pair of bathymetry and water level grids
+	Threads::Thread receiveThread; // Thread receiving grid frames
+	volatile bool keepRunning; // Flag to shut down the receive thread
+	
+	/* Receive statistics: */
+	unsigned int numFrames; // Number of received grid frames
+	unsigned int numKeyframes; // Number of received keyframes
+	size_t numBytes; // Number of received bytes
+	double maxFrameGap; // Longest time between two received frames in seconds
+	std::string error; // Error message if the receive thread terminated due to an exception
+	
+	/* Receive methods: */
+	void readThrottled(void* buffer,size_t size) // Reads the given amount of data, throttled to the client's maximum read rate
+		{
+		char* bufPtr=static_cast<char*>(buffer);
+		while(size>0)
+			{
+			size_t chunkSize=size;
+			if(bytesPerSecond>0.0)
+				{
+				/* Read at most a tenth of a second's worth of data before sleeping: */
+				chunkSize=Math::min(chunkSize,Math::max(size_t(bytesPerSecond*0.1),size_t(1)));
+				Misc::sleep(Misc::Time(double(chunkSize)/bytesPerSecond));
+				}
+			pipe.readRaw(bufPtr,chunkSize);
+			bufPtr+=chunkSize;
+			size-=chunkSize;
+			}
+		numBytes+=size_t(bufPtr-static_cast<char*>(buffer));
+		}
+	void* receiveThreadMethod(void)
+		{
+		try
+			{
+			std::vector<GridStreamCodec::Value> grids(numGridValues);
+			std::vector<GridStreamCodec::Byte> code;
+			bool haveKeyframe=false;
+			Realtime::TimePointMonotonic lastFrameTime;
+			while(keepRunning)
+				{
+				if(protocolVersion>=2)
+					{
+					/* Receive and decode a grid frame: */
+					Misc::UInt8 frameType;
+					readThrottled(&frameType,sizeof(frameType));
+					Misc::UInt32 codeSize;
+					readThrottled(&codeSize,sizeof(codeSize));
+					if(pipe.mustSwapOnRead())
+						Misc::swapEndianness(codeSize);
+					code.resize(codeSize);
+					if(codeSize>0)
+						readThrottled(&code[0],codeSize);
+					if(frameType==GridStreamCodec::KEYFRAME)
+						{
+						GridStreamCodec::decode(numGridValues,codeSize>0?&code[0]:0,codeSize,0,&grids[0]);
+						haveKeyframe=true;
+						++numKeyframes;
+						}
+					else if(frameType==GridStreamCodec::DELTAFRAME&&haveKeyframe)
+						GridStreamCodec::decode(numGridValues,codeSize>0?&code[0]:0,codeSize,&grids[0],&grids[0]);
+					else
+						throw std::runtime_error("Invalid grid frame");
+					}
+				else
+					{
+					/* Receive a raw grid pair: */
+					readThrottled(&grids[0],numGridValues*sizeof(GridStreamCodec::Value));
+					}
+				
+				/* Update the frame statistics: */
+				Realtime::TimePointMonotonic now;
+				if(numFrames>0)
+					maxFrameGap=Math::max(maxFrameGap,double(now-lastFrameTime));
+				lastFrameTime=now;
+				++numFrames;
+				}
+			}
+		catch(const std::runtime_error& err)
+			{
+			if(keepRunning)
+				error=err.what();
+			}
+		
+		return 0;
+		}
+	
+	/* Constructors and destructors: */
+	FakeClient(const char* serverName,int serverPortId,unsigned int sProtocolVersion,double sBytesPerSecond)
+		:pipe(serverName,serverPortId),
+		 protocolVersion(sProtocolVersion),bytesPerSecond(sBytesPerSecond),
+		 keepRunning(true),
+		 numFrames(0),numKeyframes(0),numBytes(0),maxFrameGap(0.0)
+		{
+		/* Send an endianness token carrying the requested protocol version: */
+		pipe.write<Misc::UInt32>(GridStreamCodec::endiannessToken+(protocolVersion-1));
+		pipe.flush();
+		
+		/* Receive the server's endianness token, grid size, cell size, and elevation range: */
+		Misc::UInt32 token=pipe.read<Misc::UInt32>();
+		if(token==0x78563412U)
+			pipe.setSwapOnRead(true);
+		else if(token!=GridStreamCodec::endiannessToken)
+			throw std::runtime_error("Invalid response from remote server");
+		unsigned int gridSize[2];
+		for(int i=0;i<2;++i)
+			{
+			gridSize[i]=pipe.read<Misc::UInt32>();
+			pipe.read<Misc::Float32>();
+			}
+		for(int i=0;i<2;++i)
+			pipe.read<Misc::Float32>();
+		numGridValues=size_t(gridSize[1]-1)*size_t(gridSize[0]-1)+size_t(gridSize[1])*size_t(gridSize[0]);
+		
+		/* Receive the negotiated protocol version: */
+		if(protocolVersion>=2)
+			{
+			protocolVersion=pipe.read<Misc::UInt32>();
+			if(protocolVersion<2||protocolVersion>GridStreamCodec::protocolVersion)
+				throw std::runtime_error("Unsupported protocol version from remote server");
+			}
+		
+		/* Start receiving grid frames: */
+		receiveThread.start(this,&FakeClient::receiveThreadMethod);
+		}
+	~FakeClient(void)
+		{
+		stop();
+		}
+	
+	/* Methods: */
+	void stop(void) // Shuts down the receive thread by closing the connection underneath it
+		{
+		if(keepRunning)
+			{
+			keepRunning=false;
+			pipe.shutdown(true,true);
+			receiveThread.join();
+			}
+		}
+	};
+
+}
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	const char* serverName="localhost";
+	int serverPortId=26000;
+	unsigned int numHealthyClients=4;
+	unsigned int numSlowClients=1;
+	double slowBytesPerSecond=50000.0;
+	unsigned int protocolVersion=GridStreamCodec::protocolVersion;
+	double duration=10.0;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"h")==0)
+				{
+				std::cout<<"Usage: SimulateRemoteClients [option 1] ... [option n] [<server host name>]"<<std::endl;
+				std::cout<<"  Options:"<<std::endl;
+				std::cout<<"  -h"<<std::endl;
+				std::cout<<"     Prints this help message"<<std::endl;
+				std::cout<<"  -port <server port>"<<std::endl;
+				std::cout<<"     Port on which the remote server listens for connections"<<std::endl;
+				std::cout<<"     Default: "<<serverPortId<<std::endl;
+				std::cout<<"  -n <num healthy clients>"<<std::endl;
+				std::cout<<"     Number of clients that receive grids as fast as possible"<<std::endl;
+				std::cout<<"     Default: "<<numHealthyClients<<std::endl;
+				std::cout<<"  -slow <num slow clients> <bytes per second>"<<std::endl;
+				std::cout<<"     Number of clients that receive grids at the given limited rate"<<std::endl;
+				std::cout<<"     Default: "<<numSlowClients<<" "<<slowBytesPerSecond<<std::endl;
+				std::cout<<"  -pv <protocol version>"<<std::endl;
+				std::cout<<"     Protocol version requested from the remote server"<<std::endl;
+				std::cout<<"     Default: "<<protocolVersion<<std::endl;
+				std::cout<<"  -t <duration>"<<std::endl;
+				std::cout<<"     Time to receive grids in seconds"<<std::endl;
+				std::cout<<"     Default: "<<duration<<std::endl;
+				return 0;
+				}
+			else if(strcasecmp(argv[i]+1,"port")==0)
+				{
+				++i;
+				serverPortId=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"n")==0)
+				{
+				++i;
+				numHealthyClients=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"slow")==0)
+				{
+				++i;
+				numSlowClients=(unsigned int)(atoi(argv[i]));
+				++i;
+				slowBytesPerSecond=atof(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"pv")==0)
+				{
+				++i;
+				protocolVersion=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"t")==0)
+				{
+				++i;
+				duration=atof(argv[i]);
+				}
+			else
+				std::cerr<<"Ignoring unrecognized command line option "<<argv[i]<<std::endl;
+			}
+		else
+			serverName=argv[i];
+		}
+	if(protocolVersion<1||protocolVersion>GridStreamCodec::protocolVersion)
+		{
+		std::cerr<<"Unsupported protocol version "<<protocolVersion<<std::endl;
+		return 1;
+		}
+	
+	std::vector<FakeClient*> clients;
+	try
+		{
+		/* Connect all fake clients: */
+		for(unsigned int i=0;i<numHealthyClients+numSlowClients;++i)
+			clients.push_back(new FakeClient(serverName,serverPortId,protocolVersion,i<numHealthyClients?0.0:slowBytesPerSecond));
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"Unable to connect to remote server "<<serverName<<":"<<serverPortId<<" due to exception "<<err.what()<<std::endl;
+		for(std::vector<FakeClient*>::iterator cIt=clients.begin();cIt!=clients.end();++cIt)
+			delete *cIt;
+		return 1;
+		}
+	
+	/* Receive grids for the requested amount of time: */
+	std::cout<<"Receiving grids with "<<numHealthyClients<<" healthy and "<<numSlowClients<<" slow clients for "<<duration<<" s"<<std::endl;
+	Misc::sleep(Misc::Time(duration));
+	
+	/* Disconnect all fake clients and print their statistics: */
+	std::cout<<std::fixed<<std::setprecision(1);
+	for(unsigned int i=0;i<clients.size();++i)
+		{
+		FakeClient* client=clients[i];
+		client->stop();
+		std::cout<<"Client "<<i<<(i<numHealthyClients?" (healthy)":" (slow)    ")<<": ";
+		std::cout<<double(client->numFrames)/duration<<" frames/s, "<<client->numKeyframes<<" keyframes, ";
+		std::cout<<double(client->numBytes)/(duration*1024.0)<<" KB/s, max frame gap "<<client->maxFrameGap*1000.0<<" ms";
+		if(!client->error.empty())
+			std::cout<<", terminated by "<<client->error;
+		std::cout<<std::endl;
+		}
+	for(std::vector<FakeClient*>::iterator cIt=clients.begin();cIt!=clients.end();++cIt)
+		delete *cIt;
+	
+	return 0;
+	}
@@ -0,0 +1,209 @@
+/***********************************************************************
+TileDEM - Utility to convert binary grid DEMs into tiled, multi-
+resolution DEMs that can be paged in by the AR Sandbox on demand.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <iostream>
+#include <vector>
+#include <Misc/SizedTypes.h>
+#include <Misc/Endianness.h>
+#include <Misc/ThrowStdErr.h>
+#include <IO/File.h>
+#include <IO/OpenFile.h>
+#include <IO/MemMappedFile.h>
+#include <Math/Math.h>
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+inline int levelSize(int size,int level) // Returns the size of a DEM dimension at the given level of detail
+	{
+	return (size+(1<<level)-1)>>level;
+	}
+
+void writeLevel(IO::File& tiledFile,const float* dem,const int demSize[2],int level,int tileSize,std::vector<float>& strip) // Writes the tiles of one level of detail, averaging blocks of the full-resolution grid
+	{
+	int size[2],numTiles[2];
+	for(int i=0;i<2;++i)
+		{
+		size[i]=levelSize(demSize[i],level);
+		numTiles[i]=(size[i]+tileSize-1)/tileSize;
+		}
+	int blockSize=1<<level;
+	
+	/* Process the level one strip of tiles at a time to bound memory use: */
+	size_t tileValues=size_t(tileSize)*size_t(tileSize);
+	strip.resize(size_t(numTiles[0])*tileValues);
+	for(int ty=0;ty<numTiles[1];++ty)
+		{
+		for(int row=0;row<tileSize;++row)
+			{
+			/* Replicate the level's top row into the padding rows of the last tile strip: */
+			int y=Math::min(ty*tileSize+row,size[1]-1);
+			int y0=y*blockSize;
+			int y1=Math::min(y0+blockSize,demSize[1]);
+			for(int x=0;x<size[0];++x)
+				{
+				/* Average the block of full-resolution values covered by the level's grid vertex: */
+				int x0=x*blockSize;
+				int x1=Math::min(x0+blockSize,demSize[0]);
+				double sum=0.0;
+				for(int by=y0;by<y1;++by)
+					{
+					const float* dPtr=dem+size_t(by)*size_t(demSize[0]);
+					for(int bx=x0;bx<x1;++bx)
+						sum+=double(dPtr[bx]);
+					}
+				strip[size_t(x/tileSize)*tileValues+size_t(row)*size_t(tileSize)+size_t(x%tileSize)]=float(sum/double((y1-y0)*(x1-x0)));
+				}
+			
+			/* Replicate the level's right column into the padding columns of the last tile: */
+			float* tileRow=&strip[size_t(numTiles[0]-1)*tileValues+size_t(row)*size_t(tileSize)];
+			for(int x=size[0]-(numTiles[0]-1)*tileSize;x<tileSize;++x)
+				tileRow[x]=tileRow[x-1];
+			}
+		
+		/* Write the strip's tiles: */
+		tiledFile.write<float>(&strip[0],strip.size());
+		}
+	}
+
+}
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	int tileSize=256;
+	const char* gridFileName=0;
+	const char* tiledFileName=0;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"h")==0)
+				{
+				std::cout<<"Usage: TileDEM [option 1] ... [option n] <grid file name> <tiled DEM file name>"<<std::endl;
+				std::cout<<"  Converts a binary grid DEM (.grid) as loaded by DEMTool into a tiled DEM"<<std::endl;
+				std::cout<<"  (.tdem) with levels of detail down to a single tile"<<std::endl;
+				std::cout<<"  Options:"<<std::endl;
+				std::cout<<"  -h"<<std::endl;
+				std::cout<<"     Prints this help message"<<std::endl;
+				std::cout<<"  -ts <tile size>"<<std::endl;
+				std::cout<<"     Width and height of each tile in grid vertices"<<std::endl;
+				std::cout<<"     Default: "<<tileSize<<std::endl;
+				return 0;
+				}
+			else if(strcasecmp(argv[i]+1,"ts")==0)
+				{
+				++i;
+				tileSize=atoi(argv[i]);
+				}
+			else
+				std::cerr<<"Ignoring unrecognized command line option "<<argv[i]<<std::endl;
+			}
+		else if(gridFileName==0)
+			gridFileName=argv[i];
+		else if(tiledFileName==0)
+			tiledFileName=argv[i];
+		else
+			std::cerr<<"Ignoring extra command line argument "<<argv[i]<<std::endl;
+		}
+	if(gridFileName==0||tiledFileName==0)
+		{
+		std::cerr<<"No grid file or tiled DEM file name provided; use -h for help"<<std::endl;
+		return 1;
+		}
+	if(tileSize<2)
+		{
+		std::cerr<<"Invalid tile size "<<tileSize<<std::endl;
+		return 1;
+		}
+	
+	try
+		{
+		/* Memory-map the grid file and read its header in the same format as the DEM class: */
+		IO::MemMappedFile gridFile(gridFileName);
+		gridFile.setEndianness(Misc::LittleEndian);
+		int demSize[2];
+		for(int i=0;i<2;++i)
+			demSize[i]=gridFile.read<Misc::SInt32>();
+		float demBox[4];
+		gridFile.read<Misc::Float32>(demBox,4);
+		if(demSize[0]<2||demSize[1]<2||size_t(gridFile.getSize())<24+size_t(demSize[1])*size_t(demSize[0])*sizeof(float))
+			Misc::throwStdErr("Invalid or truncated grid file %s",gridFileName);
+		#if __BYTE_ORDER==__BIG_ENDIAN
+		Misc::throwStdErr("Tiling grid files is not supported on big-endian hosts");
+		#endif
+		const float* dem=reinterpret_cast<const float*>(static_cast<const char*>(gridFile.getMemory())+24);
+		
+		/* Determine the number of levels of detail required to reach a single tile: */
+		int numLevels=1;
+		while(levelSize(demSize[0],numLevels-1)>tileSize||levelSize(demSize[1],numLevels-1)>tileSize)
+			++numLevels;
+		
+		/* Write the tiled DEM file's header: */
+		IO::FilePtr tiledFile=IO::openFile(tiledFileName,IO::File::WriteOnly);
+		tiledFile->setEndianness(Misc::LittleEndian);
+		char fileId[32];
+		memset(fileId,0,sizeof(fileId));
+		strcpy(fileId,"SARndbox tiled DEM v1.0\n");
+		tiledFile->write<char>(fileId,sizeof(fileId));
+		for(int i=0;i<2;++i)
+			tiledFile->write<Misc::SInt32>(demSize[i]);
+		tiledFile->write<Misc::Float32>(demBox,4);
+		tiledFile->write<Misc::UInt32>(Misc::UInt32(tileSize));
+		tiledFile->write<Misc::UInt32>(Misc::UInt32(numLevels));
+		
+		/* Write the table of levels: */
+		Misc::UInt64 offset=64+Misc::UInt64(numLevels)*16;
+		for(int level=0;level<numLevels;++level)
+			{
+			int size[2];
+			for(int i=0;i<2;++i)
+				{
+				size[i]=levelSize(demSize[i],level);
+				tiledFile->write<Misc::SInt32>(size[i]);
+				}
+			tiledFile->write<Misc::UInt64>(offset);
+			offset+=Misc::UInt64((size[1]+tileSize-1)/tileSize)*Misc::UInt64((size[0]+tileSize-1)/tileSize)*Misc::UInt64(tileSize)*Misc::UInt64(tileSize)*sizeof(float);
+			}
+		
+		/* Write all levels of detail: */
+		std::vector<float> strip;
+		for(int level=0;level<numLevels;++level)
+			{
+			std::cout<<"Writing level "<<level<<" of size "<<levelSize(demSize[0],level)<<" x "<<levelSize(demSize[1],level)<<std::endl;
+			writeLevel(*tiledFile,dem,demSize,level,tileSize,strip);
+			}
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"TileDEM: Terminated due to exception "<<err.what()<<std::endl;
+		return 1;
+		}
+	
+	return 0;
+	}
@@ -26,7 +26,10 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <stdarg.h>
 #include <stdio.h>
 #include <string>
+#include <Misc/ThrowStdErr.h>
+#include <Realtime/Time.h>
 #include <Math/Math.h>
+#include <Math/Constants.h>
 #include <Geometry/AffineCombiner.h>
 #include <Geometry/Vector.h>
 #include <GL/gl.h>
@@ -44,6 +47,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "DepthImageRenderer.h"
 #include "ShaderHelper.h"
+#include "WaterTableCPU.h"
 
 // DEBUGGING
 // #include <iostream>
@@ -54,6 +58,24 @@ namespace {
 Helper functions:
 ****************/
 
+void uniteRects(GLint rect[4],const GLint other[4]) // Extends the given (x, y, width, height) rectangle to also cover the other rectangle
+	{
+	if(other[2]<=0||other[3]<=0)
+		return;
+	if(rect[2]<=0||rect[3]<=0)
+		{
+		for(int i=0;i<4;++i)
+			rect[i]=other[i];
+		return;
+		}
+	for(int i=0;i<2;++i)
+		{
+		GLint end=Math::max(rect[i]+rect[2+i],other[i]+other[2+i]);
+		rect[i]=Math::min(rect[i],other[i]);
+		rect[2+i]=end-rect[i];
+		}
+	}
+
 GLfloat* makeBuffer(int width,int height,int numComponents,...)
 	{
 	va_list ap;
@@ -80,10 +102,11 @@ Methods of class WaterTable2::DataItem:
 **************************************/
 
 WaterTable2::DataItem::DataItem(void)
-	:currentBathymetry(0),bathymetryVersion(0),currentQuantity(0),
+	:currentBathymetry(0),bathymetryVersion(0),bathymetryTransformationVersion(0),currentQuantity(0),
 	 derivativeTextureObject(0),waterTextureObject(0),
 	 bathymetryFramebufferObject(0),derivativeFramebufferObject(0),maxStepSizeFramebufferObject(0),integrationFramebufferObject(0),waterFramebufferObject(0),
-	 bathymetryShader(0),waterAdaptShader(0),derivativeShader(0),maxStepSizeShader(0),boundaryShader(0),eulerStepShader(0),rungeKuttaStepShader(0),waterAddShader(0),waterShader(0)
+	 bathymetryShader(0),waterAdaptShader(0),derivativeShader(0),maxStepSizeShader(0),boundaryShader(0),eulerStepShader(0),rungeKuttaStepShader(0),waterAddShader(0),waterShader(0),
+	 cpuBathymetryVersion(0),cpuQuantityVersion(0),cpuTransferBuffer(0)
 	{
 	for(int i=0;i<2;++i)
 		{
@@ -92,6 +115,8 @@ WaterTable2::DataItem::DataItem(void)
 		}
 	for(int i=0;i<3;++i)
 		quantityTextureObjects[i]=0;
+	for(int i=0;i<4;++i)
+		staleBathymetryRect[i]=0;
 	
 	/* Initialize all required OpenGL extensions: */
 	GLARBDrawBuffers::initExtension();
@@ -127,6 +152,7 @@ WaterTable2::DataItem::~DataItem(void)
 	glDeleteObjectARB(rungeKuttaStepShader);
 	glDeleteObjectARB(waterAddShader);
 	glDeleteObjectARB(waterShader);
+	delete[] cpuTransferBuffer;
 	}
 
 /****************************
@@ -156,6 +182,9 @@ void WaterTable2::calcTransformations(void)
 	bathymetryPmv*=baseTransform;
 	}
 	
+	/* Invalidate all bathymetry grids rendered with the previous transformations: */
+	++transformationVersion;
+	
 	/* Calculate the combined modelview and projection matrix to render water-adding geometry into the water texture: */
 	{
 	waterAddPmv=PTransform::identity;
@@ -197,6 +226,87 @@ void WaterTable2::calcTransformations(void)
 			*wttmPtr=GLfloat(wttm(i,j));
 	}
 
+bool WaterTable2::calcBathymetryRect(unsigned int sinceVersion,GLint rect[4]) const
+	{
+	/* Get the bounding box of the changed surface in depth image space: */
+	Scalar box[4];
+	if(!depthImageRenderer->calcChangedBox(sinceVersion,box))
+		return false;
+	
+	/* Calculate the transformation from depth image space into the bathymetry grid's clip space: */
+	PTransform depthPmv=bathymetryPmv;
+	depthPmv*=depthImageRenderer->getDepthProjection();
+	const PTransform::Matrix& dpm=depthPmv.getMatrix();
+	
+	/* Intersect the viewing rays through the box's corners with the near and far planes of the bathymetry grid's elevation range: */
+	Scalar clipMin[2],clipMax[2];
+	for(int i=0;i<2;++i)
+		{
+		clipMin[i]=Math::Constants<Scalar>::max;
+		clipMax[i]=Math::Constants<Scalar>::min;
+		}
+	for(int corner=0;corner<4;++corner)
+		{
+		/* Represent the viewing ray as p0+p1*d in homogeneous clip space, where d is depth image depth: */
+		Scalar x=box[(corner&0x1)?2:0];
+		Scalar y=box[(corner&0x2)?3:1];
+		Scalar p0[4],p1[4];
+		for(int i=0;i<4;++i)
+			{
+			p0[i]=dpm(i,0)*x+dpm(i,1)*y+dpm(i,3);
+			p1[i]=dpm(i,2);
+			}
+		
+		for(int plane=-1;plane<=1;plane+=2)
+			{
+			/* Find the ray's intersection with the z=plane clip plane: */
+			Scalar denominator=p1[2]-Scalar(plane)*p1[3];
+			Scalar d=denominator!=Scalar(0)?(Scalar(plane)*p0[3]-p0[2])/denominator:Scalar(0);
+			Scalar w=p0[3]+p1[3]*d;
+			if(denominator==Scalar(0)||w<=Scalar(0))
+				{
+				/* The frustum is degenerate; assume the entire bathymetry grid changed: */
+				rect[0]=rect[1]=0;
+				rect[2]=size[0]-1;
+				rect[3]=size[1]-1;
+				return true;
+				}
+			for(int i=0;i<2;++i)
+				{
+				Scalar c=(p0[i]+p1[i]*d)/w;
+				clipMin[i]=Math::min(clipMin[i],c);
+				clipMax[i]=Math::max(clipMax[i],c);
+				}
+			}
+		}
+	
+	/* Convert the clip-space bounding box to bathymetry grid pixels, with a one-pixel margin for rasterization: */
+	for(int i=0;i<2;++i)
+		{
+		Scalar scale=Scalar(size[i]-1)*Scalar(0.5);
+		Scalar begin=Math::max(Math::floor((clipMin[i]+Scalar(1))*scale)-Scalar(1),Scalar(0));
+		Scalar end=Math::min(Math::ceil((clipMax[i]+Scalar(1))*scale)+Scalar(1),Scalar(size[i]-1));
+		if(begin>=end)
+			return false;
+		rect[i]=GLint(begin);
+		rect[2+i]=GLint(end)-rect[i];
+		}
+	
+	return true;
+	}
+
+void WaterTable2::createCpuEngine(WaterTable2::Engine engine,unsigned int numCpuEngineThreads)
+	{
+	if(engine==CPU)
+		{
+		/* Create a CPU-based simulation engine with the same grid and simulation parameters: */
+		cpuEngine=new WaterTableCPU(size[0],size[1],cellSize,GLfloat(domain.min[2]),numCpuEngineThreads);
+		cpuEngine->setAttenuation(attenuation);
+		cpuEngine->setMaxStepSize(maxStepSize);
+		cpuEngine->setDryBoundary(dryBoundary);
+		}
+	}
+
 GLfloat WaterTable2::calcDerivative(WaterTable2::DataItem* dataItem,GLuint quantityTextureObject,bool calcMaxStepSize) const
 	{
 	/*********************************************************************
@@ -291,10 +401,192 @@ GLfloat WaterTable2::calcDerivative(WaterTable2::DataItem* dataItem,GLuint quant
 	return stepSize;
 	}
 
-WaterTable2::WaterTable2(GLsizei width,GLsizei height,const GLfloat sCellSize[2])
+void WaterTable2::renderWaterSources(WaterTable2::DataItem* dataItem,GLfloat stepSize,GLfloat baseWaterAmount,GLContextData& contextData) const
+	{
+	/* Save OpenGL state: */
+	GLfloat currentClearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE,currentClearColor);
+	
+	/* Set up and clear the water frame buffer: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->waterFramebufferObject);
+	glViewport(0,0,size[0],size[1]);
+	glClearColor(baseWaterAmount,0.0f,0.0f,0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	
+	/* Enable additive rendering: */
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE,GL_ONE);
+	
+	/* Set up the water adding shader: */
+	glUseProgramObjectARB(dataItem->waterAddShader);
+	glUniformMatrix4fvARB(dataItem->waterAddShaderUniformLocations[0],1,GL_FALSE,waterAddPmvMatrix);
+	glUniform1fARB(dataItem->waterAddShaderUniformLocations[1],stepSize);
+	
+	/* Bind the water texture: */
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->waterTextureObject);
+	glUniform1iARB(dataItem->waterAddShaderUniformLocations[2],0);
+	
+	/* Call all render functions: */
+	for(std::vector<const AddWaterFunction*>::const_iterator rfIt=renderFunctions.begin();rfIt!=renderFunctions.end();++rfIt)
+		(**rfIt)(contextData);
+	
+	/* Restore OpenGL state: */
+	glDisable(GL_BLEND);
+	glClearColor(currentClearColor[0],currentClearColor[1],currentClearColor[2],currentClearColor[3]);
+	}
+
+void WaterTable2::postThreadSettings(void)
+	{
+	/* Let the simulation thread apply the new settings on its next tick: */
+	Threads::Mutex::Lock inputLock(threadInputMutex);
+	threadAttenuation=attenuation;
+	threadDryBoundary=dryBoundary;
+	threadSettingsValid=true;
+	}
+
+void* WaterTable2::simulationThreadMethod(void)
+	{
+	std::vector<GLfloat> bathymetry,waterLevel,water;
+	double tickInterval=1.0/simulationRate;
+	Realtime::TimePointMonotonic nextTick;
+	while(keepSimulating)
+		{
+		/* Wait for the next tick, and skip ticks that have been missed entirely: */
+		nextTick+=Realtime::TimeVector(tickInterval);
+		Realtime::TimePointMonotonic now;
+		if(nextTick>now)
+			Realtime::TimePointMonotonic::sleep(nextTick);
+		else if(double(now-nextTick)>tickInterval)
+			nextTick=now;
+		Realtime::TimePointMonotonic tickStart;
+		
+		/* Pick up new inputs and simulation parameters: */
+		bool haveReset=false;
+		GLfloat resetElevation=0.0f;
+		bool haveSettings=false;
+		GLfloat newAttenuation=1.0f;
+		bool newDryBoundary=true;
+		bool haveBathymetry=false;
+		bool haveWaterLevel=false;
+		bool haveWater=false;
+		double speed;
+		unsigned int maxSteps;
+		GLfloat deposit;
+		{
+		Threads::Mutex::Lock inputLock(threadInputMutex);
+		if(threadResetValid)
+			{
+			resetElevation=threadResetElevation;
+			threadResetValid=false;
+			haveReset=true;
+			}
+		if(threadSettingsValid)
+			{
+			newAttenuation=threadAttenuation;
+			newDryBoundary=threadDryBoundary;
+			threadSettingsValid=false;
+			haveSettings=true;
+			}
+		if(threadBathymetryValid)
+			{
+			std::swap(bathymetry,threadBathymetry);
+			threadBathymetryValid=false;
+			haveBathymetry=true;
+			}
+		if(threadWaterLevelValid)
+			{
+			std::swap(waterLevel,threadWaterLevel);
+			threadWaterLevelValid=false;
+			haveWaterLevel=true;
+			}
+		if(threadWaterValid)
+			{
+			std::swap(water,threadWater);
+			threadWaterValid=false;
+			haveWater=true;
+			}
+		speed=threadSpeed;
+		maxSteps=threadMaxSteps;
+		deposit=threadWaterDeposit;
+		}
+		
+		GLfloat requestedTime=GLfloat(tickInterval*speed);
+		GLfloat remainingTime=requestedTime;
+		unsigned int numSteps=0;
+		
+		/* Apply the new inputs; the simulation thread has exclusive access to the CPU engine while it runs: */
+		if(haveReset)
+			cpuEngine->reset(resetElevation);
+		if(haveSettings)
+			{
+			cpuEngine->setAttenuation(newAttenuation);
+			cpuEngine->setDryBoundary(newDryBoundary);
+			}
+		if(haveBathymetry)
+			cpuEngine->updateBathymetry(&bathymetry[0]);
+		if(haveWaterLevel)
+			cpuEngine->setWaterLevel(&waterLevel[0]);
+		if(haveWater)
+			cpuEngine->addWater(&water[0]);
+		
+		/* Advance the simulation by one tick's worth of simulation time: */
+		while(numSteps<maxSteps&&remainingTime>1.0e-8f)
+			{
+			/* Run with a self-determined time step to maintain stability: */
+			cpuEngine->setMaxStepSize(remainingTime);
+			GLfloat stepSize=cpuEngine->runSimulationStep(false);
+			if(deposit!=0.0f)
+				cpuEngine->addWater(deposit*stepSize);
+			remainingTime-=stepSize;
+			++numSteps;
+			}
+		
+		/* Publish the new simulation state: */
+		SimulationState& state=simulationStates.startNewValue();
+		if(state.bathymetryVersion!=cpuEngine->getBathymetryVersion())
+			{
+			state.bathymetry.assign(cpuEngine->getBathymetry(),cpuEngine->getBathymetry()+size_t(size[0]-1)*size_t(size[1]-1));
+			state.bathymetryVersion=cpuEngine->getBathymetryVersion();
+			}
+		state.quantities.resize(size_t(size[0])*size_t(size[1])*3);
+		cpuEngine->getQuantities(&state.quantities[0]);
+		state.quantityVersion=cpuEngine->getQuantityVersion();
+		simulationStates.postNewValue();
+		
+		/* Update the thread statistics: */
+		double tickTime=double(Realtime::TimePointMonotonic()-tickStart);
+		GLfloat lagTime=remainingTime>1.0e-8f?remainingTime:0.0f;
+		{
+		Threads::Mutex::Lock inputLock(threadInputMutex);
+		ThreadStatistics& ts=threadStatistics;
+		++ts.numTicks;
+		ts.numSteps+=numSteps;
+		if(lagTime>0.0f)
+			++ts.numLaggingTicks;
+		ts.requestedTime+=requestedTime;
+		ts.lagTime+=lagTime;
+		ts.tickTime=ts.tickTime!=0.0?ts.tickTime+(tickTime-ts.tickTime)*0.1:tickTime;
+		if(requestedTime>0.0f)
+			ts.lagFraction+=(double(lagTime)/double(requestedTime)-ts.lagFraction)*0.1;
+		}
+		}
+	
+	return 0;
+	}
+
+WaterTable2::WaterTable2(GLsizei width,GLsizei height,const GLfloat sCellSize[2],WaterTable2::Engine sEngine,unsigned int numCpuEngineThreads)
 	:depthImageRenderer(0),
 	 baseTransform(ONTransform::identity),
-	 dryBoundary(true)
+	 transformationVersion(0),
+	 dryBoundary(true),
+	 cpuEngine(0),
+	 simulationRate(0.0),
+	 threadBathymetryValid(false),threadWaterValid(false),threadWaterLevelValid(false),
+	 threadResetValid(false),threadResetElevation(0.0f),
+	 threadSettingsValid(false),threadAttenuation(1.0f),threadDryBoundary(true),
+	 threadSpeed(1.0),threadMaxSteps(30),threadWaterDeposit(0.0f),
+	 keepSimulating(false)
 	{
 	/* Initialize the water table size and cell size: */
 	size[0]=width;
@@ -321,11 +613,22 @@ WaterTable2::WaterTable2(GLsizei width,GLsizei height,const GLfloat sCellSize[2]
 	
 	/* Initialize the water deposit amount: */
 	waterDeposit=0.0f;
+	
+	/* Create the selected simulation engine: */
+	createCpuEngine(sEngine,numCpuEngineThreads);
 	}
 
-WaterTable2::WaterTable2(GLsizei width,GLsizei height,const DepthImageRenderer* sDepthImageRenderer,const Point basePlaneCorners[4])
+WaterTable2::WaterTable2(GLsizei width,GLsizei height,const DepthImageRenderer* sDepthImageRenderer,const Point basePlaneCorners[4],WaterTable2::Engine sEngine,unsigned int numCpuEngineThreads)
 	:depthImageRenderer(sDepthImageRenderer),
-	 dryBoundary(true)
+	 transformationVersion(0),
+	 dryBoundary(true),
+	 cpuEngine(0),
+	 simulationRate(0.0),
+	 threadBathymetryValid(false),threadWaterValid(false),threadWaterLevelValid(false),
+	 threadResetValid(false),threadResetElevation(0.0f),
+	 threadSettingsValid(false),threadAttenuation(1.0f),threadDryBoundary(true),
+	 threadSpeed(1.0),threadMaxSteps(30),threadWaterDeposit(0.0f),
+	 keepSimulating(false)
 	{
 	/* Initialize the water table size: */
 	size[0]=width;
@@ -377,10 +680,21 @@ WaterTable2::WaterTable2(GLsizei width,GLsizei height,const DepthImageRenderer*
 	
 	/* Initialize the water deposit amount: */
 	waterDeposit=0.0f;
+	
+	/* Create the selected simulation engine: */
+	createCpuEngine(sEngine,numCpuEngineThreads);
 	}
 
 WaterTable2::~WaterTable2(void)
 	{
+	if(simulationRate>0.0)
+		{
+		/* Shut down the simulation thread: */
+		keepSimulating=false;
+		simulationThread.join();
+		}
+	
+	delete cpuEngine;
 	}
 
 void WaterTable2::initContext(GLContextData& contextData) const
@@ -535,6 +849,10 @@ void WaterTable2::initContext(GLContextData& contextData) const
 	/* Restore the previously bound frame buffer: */
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
 	
+	/* Create a buffer to transfer grids between the CPU engine and OpenGL: */
+	if(cpuEngine!=0)
+		dataItem->cpuTransferBuffer=new GLfloat[size[0]*size[1]*3];
+	
 	/* Create a simple vertex shader to render quads in pixel space: */
 	static const char* vertexShaderSourceTemplate="void main(){gl_Position=vec4(gl_Vertex.x*%f-1.0,gl_Vertex.y*%f-1.0,0.0,1.0);}";
 	char vertexShaderSource[256];
@@ -659,16 +977,33 @@ void WaterTable2::setElevationRange(Scalar newMin,Scalar newMax)
 	
 	/* Recalculate the water table transformations: */
 	calcTransformations();
+	
+	/* Reset the CPU engine to the new base elevation: */
+	if(simulationRate>0.0)
+		{
+		/* Let the simulation thread reset the CPU engine on its next tick: */
+		Threads::Mutex::Lock inputLock(threadInputMutex);
+		threadResetElevation=GLfloat(domain.min[2]);
+		threadResetValid=true;
+		}
+	else if(cpuEngine!=0)
+		cpuEngine->reset(GLfloat(domain.min[2]));
 	}
 
 void WaterTable2::setAttenuation(GLfloat newAttenuation)
 	{
 	attenuation=newAttenuation;
+	if(simulationRate>0.0)
+		postThreadSettings();
+	else if(cpuEngine!=0)
+		cpuEngine->setAttenuation(attenuation);
 	}
 
 void WaterTable2::setMaxStepSize(GLfloat newMaxStepSize)
 	{
 	maxStepSize=newMaxStepSize;
+	if(cpuEngine!=0&&simulationRate==0.0)
+		cpuEngine->setMaxStepSize(maxStepSize);
 	}
 
 void WaterTable2::addRenderFunction(const AddWaterFunction* newRenderFunction)
@@ -697,6 +1032,95 @@ void WaterTable2::setWaterDeposit(GLfloat newWaterDeposit)
 void WaterTable2::setDryBoundary(bool newDryBoundary)
 	{
 	dryBoundary=newDryBoundary;
+	if(simulationRate>0.0)
+		postThreadSettings();
+	else if(cpuEngine!=0)
+		cpuEngine->setDryBoundary(dryBoundary);
+	}
+
+void WaterTable2::startSimulationThread(double newSimulationRate)
+	{
+	if(cpuEngine==0)
+		Misc::throwStdErr("WaterTable2::startSimulationThread: Simulation thread requires the CPU engine");
+	if(simulationRate>0.0||newSimulationRate<=0.0)
+		return;
+	
+	/* Start the simulation thread: */
+	simulationRate=newSimulationRate;
+	keepSimulating=true;
+	simulationThread.start(this,&WaterTable2::simulationThreadMethod);
+	}
+
+void WaterTable2::updateSimulationThread(double newSpeed,unsigned int newMaxStepsPerTick)
+	{
+	{
+	/* Forward the new simulation parameters to the simulation thread: */
+	Threads::Mutex::Lock inputLock(threadInputMutex);
+	threadSpeed=newSpeed;
+	threadMaxSteps=newMaxStepsPerTick;
+	threadWaterDeposit=waterDeposit;
+	}
+	
+	/* Lock the most recently published simulation state: */
+	simulationStates.lockNewValue();
+	}
+
+void WaterTable2::submitWaterSources(GLfloat stepSize,GLContextData& contextData) const
+	{
+	/* Bail out if there are no water sources or sinks; the simulation thread deposits uniform water itself: */
+	if(renderFunctions.empty())
+		return;
+	
+	/* Get the data item: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	
+	/* Save relevant OpenGL state: */
+	glPushAttrib(GL_COLOR_BUFFER_BIT|GL_VIEWPORT_BIT);
+	GLint currentFrameBuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+	
+	/* Render all water sources and sinks into the water texture and read it back: */
+	renderWaterSources(dataItem,stepSize,0.0f,contextData);
+	glUseProgramObjectARB(0);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+	glReadPixels(0,0,size[0],size[1],GL_RED,GL_FLOAT,dataItem->cpuTransferBuffer);
+	glReadBuffer(GL_NONE);
+	
+	/* Restore OpenGL state: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
+	glPopAttrib();
+	
+	/* Add the gathered water to the water that has not been picked up by the simulation thread yet: */
+	Threads::Mutex::Lock inputLock(threadInputMutex);
+	size_t numCells=size_t(size[0])*size_t(size[1]);
+	if(threadWaterValid)
+		{
+		GLfloat* twPtr=&threadWater[0];
+		const GLfloat* ctbPtr=dataItem->cpuTransferBuffer;
+		for(size_t i=0;i<numCells;++i,++twPtr,++ctbPtr)
+			*twPtr+=*ctbPtr;
+		}
+	else
+		{
+		threadWater.assign(dataItem->cpuTransferBuffer,dataItem->cpuTransferBuffer+numCells);
+		threadWaterValid=true;
+		}
+	}
+
+WaterTable2::ThreadStatistics WaterTable2::getThreadStatistics(bool reset)
+	{
+	Threads::Mutex::Lock inputLock(threadInputMutex);
+	ThreadStatistics result=threadStatistics;
+	if(reset)
+		{
+		/* Reset the counters, but keep the running estimates: */
+		ThreadStatistics newStatistics;
+		newStatistics.tickTime=threadStatistics.tickTime;
+		newStatistics.lagFraction=threadStatistics.lagFraction;
+		threadStatistics=newStatistics;
+		}
+	return result;
 	}
 
 void WaterTable2::updateBathymetry(GLContextData& contextData) const
@@ -707,72 +1131,131 @@ void WaterTable2::updateBathymetry(GLContextData& contextData) const
 	/* Check if the current bathymetry texture is outdated: */
 	if(dataItem->bathymetryVersion!=depthImageRenderer->getDepthImageVersion())
 		{
+		/* Determine the region of the bathymetry grid covering the changed parts of the surface: */
+		GLint changedRect[4]={0,0,size[0]-1,size[1]-1};
+		if(cpuEngine==0&&dataItem->bathymetryTransformationVersion==transformationVersion&&!calcBathymetryRect(dataItem->bathymetryVersion,changedRect))
+			{
+			/* The bathymetry grid did not change; keep the current bathymetry texture: */
+			dataItem->bathymetryVersion=depthImageRenderer->getDepthImageVersion();
+			return;
+			}
+		
+		/* Re-render the changed region and the region where the other bathymetry texture is still outdated: */
+		GLint renderRect[4];
+		for(int i=0;i<4;++i)
+			renderRect[i]=changedRect[i];
+		uniteRects(renderRect,dataItem->staleBathymetryRect);
+		
 		/* Save relevant OpenGL state: */
-		glPushAttrib(GL_VIEWPORT_BIT);
+		glPushAttrib(GL_VIEWPORT_BIT|GL_SCISSOR_BIT);
 		GLint currentFrameBuffer;
 		glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
 		GLfloat currentClearColor[4];
 		glGetFloatv(GL_COLOR_CLEAR_VALUE,currentClearColor);
 		
-		/* Bind the bathymetry rendering frame buffer and clear it: */
+		/* Bind the bathymetry rendering frame buffer and clear the render region: */
 		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->bathymetryFramebufferObject);
 		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentBathymetry));
 		glViewport(0,0,size[0]-1,size[1]-1);
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(renderRect[0],renderRect[1],renderRect[2],renderRect[3]);
 		glClearColor(GLfloat(domain.min[2]),0.0f,0.0f,1.0f);
 		glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 		
 		/* Render the surface into the bathymetry grid: */
 		depthImageRenderer->renderElevation(bathymetryPmv,contextData);
+		glDisable(GL_SCISSOR_TEST);
 		
-		/* Set up the integration frame buffer to update the conserved quantities based on bathymetry changes: */
-		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->integrationFramebufferObject);
-		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentQuantity));
-		glViewport(0,0,size[0],size[1]);
-		
-		/* Set up the bathymetry update shader: */
-		glUseProgramObjectARB(dataItem->bathymetryShader);
-		glActiveTextureARB(GL_TEXTURE0_ARB);
-		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
-		glUniform1iARB(dataItem->bathymetryShaderUniformLocations[0],0);
-		glActiveTextureARB(GL_TEXTURE1_ARB);
-		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[1-dataItem->currentBathymetry]);
-		glUniform1iARB(dataItem->bathymetryShaderUniformLocations[1],1);
-		
-		glActiveTextureARB(GL_TEXTURE2_ARB);
-		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
-		glUniform1iARB(dataItem->bathymetryShaderUniformLocations[2],2);
-		
-		/* Run the bathymetry update: */
-		glBegin(GL_QUADS);
-		glVertex2i(0,0);
-		glVertex2i(size[0],0);
-		glVertex2i(size[0],size[1]);
-		glVertex2i(0,size[1]);
-		glEnd();
-		
-		/* Unbind all shaders and textures: */
-		glUseProgramObjectARB(0);
-		glActiveTextureARB(GL_TEXTURE2_ARB);
-		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
-		glActiveTextureARB(GL_TEXTURE1_ARB);
-		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
-		glActiveTextureARB(GL_TEXTURE0_ARB);
-		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+		if(cpuEngine!=0)
+			{
+			/* Read back the new bathymetry grid and forward it to the CPU engine: */
+			glReadBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentBathymetry));
+			glReadPixels(0,0,size[0]-1,size[1]-1,GL_RED,GL_FLOAT,dataItem->cpuTransferBuffer);
+			glReadBuffer(GL_NONE);
+			if(simulationRate>0.0)
+				{
+				/* Hand the new bathymetry grid to the simulation thread: */
+				Threads::Mutex::Lock inputLock(threadInputMutex);
+				threadBathymetry.assign(dataItem->cpuTransferBuffer,dataItem->cpuTransferBuffer+size_t(size[0]-1)*size_t(size[1]-1));
+				threadBathymetryValid=true;
+				}
+			else
+				{
+				cpuEngine->updateBathymetry(dataItem->cpuTransferBuffer);
+				dataItem->cpuBathymetryVersion=cpuEngine->getBathymetryVersion();
+				}
+			}
+		else
+			{
+			/* Set up the integration frame buffer to update the conserved quantities based on bathymetry changes: */
+			glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->integrationFramebufferObject);
+			glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentQuantity));
+			glViewport(0,0,size[0],size[1]);
+			
+			/* Set up the bathymetry update shader: */
+			glUseProgramObjectARB(dataItem->bathymetryShader);
+			glActiveTextureARB(GL_TEXTURE0_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
+			glUniform1iARB(dataItem->bathymetryShaderUniformLocations[0],0);
+			glActiveTextureARB(GL_TEXTURE1_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[1-dataItem->currentBathymetry]);
+			glUniform1iARB(dataItem->bathymetryShaderUniformLocations[1],1);
+			
+			glActiveTextureARB(GL_TEXTURE2_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+			glUniform1iARB(dataItem->bathymetryShaderUniformLocations[2],2);
+			
+			/* Run the bathymetry update: */
+			glBegin(GL_QUADS);
+			glVertex2i(0,0);
+			glVertex2i(size[0],0);
+			glVertex2i(size[0],size[1]);
+			glVertex2i(0,size[1]);
+			glEnd();
+			
+			/* Unbind all shaders and textures: */
+			glUseProgramObjectARB(0);
+			glActiveTextureARB(GL_TEXTURE2_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+			glActiveTextureARB(GL_TEXTURE1_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+			glActiveTextureARB(GL_TEXTURE0_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+			}
 		
 		/* Restore OpenGL state: */
 		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
 		glClearColor(currentClearColor[0],currentClearColor[1],currentClearColor[2],currentClearColor[3]);
 		glPopAttrib();
 		
-		/* Update the bathymetry and quantity grids: */
+		/* Update the bathymetry and quantity grids; the now other bathymetry texture is outdated in the changed region: */
 		dataItem->currentBathymetry=1-dataItem->currentBathymetry;
 		dataItem->bathymetryVersion=depthImageRenderer->getDepthImageVersion();
-		dataItem->currentQuantity=1-dataItem->currentQuantity;
+		dataItem->bathymetryTransformationVersion=transformationVersion;
+		for(int i=0;i<4;++i)
+			dataItem->staleBathymetryRect[i]=changedRect[i];
+		if(cpuEngine==0)
+			dataItem->currentQuantity=1-dataItem->currentQuantity;
 		}
 	}
 
 void WaterTable2::updateBathymetry(const GLfloat* bathymetryGrid,GLContextData& contextData) const
 	{
+	if(simulationRate>0.0)
+		{
+		/* Hand the new bathymetry grid to the simulation thread; textures will be updated on demand: */
+		Threads::Mutex::Lock inputLock(threadInputMutex);
+		threadBathymetry.assign(bathymetryGrid,bathymetryGrid+size_t(size[0]-1)*size_t(size[1]-1));
+		threadBathymetryValid=true;
+		return;
+		}
+	if(cpuEngine!=0)
+		{
+		/* Forward the new bathymetry grid to the CPU engine; textures will be updated on demand: */
+		cpuEngine->updateBathymetry(bathymetryGrid);
+		return;
+		}
+	
 	/* Get the data item: */
 	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
 	
@@ -821,13 +1304,31 @@ void WaterTable2::updateBathymetry(const GLfloat* bathymetryGrid,GLContextData&
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
 	glPopAttrib();
 
-	/* Update the bathymetry and quantity grids: */
+	/* Update the bathymetry and quantity grids; the now other bathymetry texture is entirely outdated: */
 	dataItem->currentBathymetry=1-dataItem->currentBathymetry;
 	dataItem->currentQuantity=1-dataItem->currentQuantity;
+	dataItem->staleBathymetryRect[0]=dataItem->staleBathymetryRect[1]=0;
+	dataItem->staleBathymetryRect[2]=size[0]-1;
+	dataItem->staleBathymetryRect[3]=size[1]-1;
 	}
 
 void WaterTable2::setWaterLevel(const GLfloat* waterGrid,GLContextData& contextData) const
 	{
+	if(simulationRate>0.0)
+		{
+		/* Hand the new water level grid to the simulation thread; textures will be updated on demand: */
+		Threads::Mutex::Lock inputLock(threadInputMutex);
+		threadWaterLevel.assign(waterGrid,waterGrid+size_t(size[0])*size_t(size[1]));
+		threadWaterLevelValid=true;
+		return;
+		}
+	if(cpuEngine!=0)
+		{
+		/* Forward the new water level grid to the CPU engine; textures will be updated on demand: */
+		cpuEngine->setWaterLevel(waterGrid);
+		return;
+		}
+	
 	/* Get the data item: */
 	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
 	
@@ -883,6 +1384,42 @@ GLfloat WaterTable2::runSimulationStep(bool forceStepSize,GLContextData& context
 	/* Get the data item: */
 	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
 	
+	if(simulationRate>0.0)
+		Misc::throwStdErr("WaterTable2::runSimulationStep: Simulation is run by a dedicated simulation thread");
+	
+	if(cpuEngine!=0)
+		{
+		/* Run the integration step on the CPU: */
+		GLfloat stepSize=cpuEngine->runSimulationStep(forceStepSize);
+		
+		if(!renderFunctions.empty())
+			{
+			/* Save relevant OpenGL state: */
+			glPushAttrib(GL_COLOR_BUFFER_BIT|GL_VIEWPORT_BIT);
+			GLint currentFrameBuffer;
+			glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+			
+			/* Render all water sources and sinks into the water texture and read it back: */
+			renderWaterSources(dataItem,stepSize,waterDeposit*stepSize,contextData);
+			glUseProgramObjectARB(0);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+			glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+			glReadPixels(0,0,size[0],size[1],GL_RED,GL_FLOAT,dataItem->cpuTransferBuffer);
+			glReadBuffer(GL_NONE);
+			
+			/* Restore OpenGL state: */
+			glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
+			glPopAttrib();
+			
+			/* Add the gathered water to the CPU engine: */
+			cpuEngine->addWater(dataItem->cpuTransferBuffer);
+			}
+		else if(waterDeposit!=0.0f)
+			cpuEngine->addWater(waterDeposit*stepSize);
+		
+		return stepSize;
+		}
+	
 	/* Save relevant OpenGL state: */
 	glPushAttrib(GL_COLOR_BUFFER_BIT|GL_VIEWPORT_BIT);
 	GLint currentFrameBuffer;
@@ -983,42 +1520,12 @@ GLfloat WaterTable2::runSimulationStep(bool forceStepSize,GLContextData& context
 	
 	if(waterDeposit!=0.0f||!renderFunctions.empty())
 		{
-		/* Save OpenGL state: */
-		GLfloat currentClearColor[4];
-		glGetFloatv(GL_COLOR_CLEAR_VALUE,currentClearColor);
-		
 		/*******************************************************************
 		Step 5: Render all water sources and sinks additively into the water
 		texture.
 		*******************************************************************/
 		
-		/* Set up and clear the water frame buffer: */
-		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->waterFramebufferObject);
-		glViewport(0,0,size[0],size[1]);
-		glClearColor(waterDeposit*stepSize,0.0f,0.0f,0.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
-		
-		/* Enable additive rendering: */
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_ONE,GL_ONE);
-		
-		/* Set up the water adding shader: */
-		glUseProgramObjectARB(dataItem->waterAddShader);
-		glUniformMatrix4fvARB(dataItem->waterAddShaderUniformLocations[0],1,GL_FALSE,waterAddPmvMatrix);
-		glUniform1fARB(dataItem->waterAddShaderUniformLocations[1],stepSize);
-		
-		/* Bind the water texture: */
-		glActiveTextureARB(GL_TEXTURE0_ARB);
-		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->waterTextureObject);
-		glUniform1iARB(dataItem->waterAddShaderUniformLocations[2],0);
-		
-		/* Call all render functions: */
-		for(std::vector<const AddWaterFunction*>::const_iterator rfIt=renderFunctions.begin();rfIt!=renderFunctions.end();++rfIt)
-			(**rfIt)(contextData);
-		
-		/* Restore OpenGL state: */
-		glDisable(GL_BLEND);
-		glClearColor(currentClearColor[0],currentClearColor[1],currentClearColor[2],currentClearColor[3]);
+		renderWaterSources(dataItem,stepSize,waterDeposit*stepSize,contextData);
 		
 		/*******************************************************************
 		Step 6: Update the conserved quantities based on the water texture.
@@ -1077,6 +1584,23 @@ void WaterTable2::bindBathymetryTexture(GLContextData& contextData) const
 	
 	/* Bind the bathymetry texture: */
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
+	
+	if(simulationRate>0.0)
+		{
+		/* Upload the bathymetry grid of the simulation thread's locked state if it changed: */
+		const SimulationState& state=simulationStates.getLockedValue();
+		if(!state.bathymetry.empty()&&dataItem->cpuBathymetryVersion!=state.bathymetryVersion)
+			{
+			glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,size[0]-1,size[1]-1,GL_LUMINANCE,GL_FLOAT,&state.bathymetry[0]);
+			dataItem->cpuBathymetryVersion=state.bathymetryVersion;
+			}
+		}
+	else if(cpuEngine!=0&&dataItem->cpuBathymetryVersion!=cpuEngine->getBathymetryVersion())
+		{
+		/* Upload the CPU engine's current bathymetry grid: */
+		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,size[0]-1,size[1]-1,GL_LUMINANCE,GL_FLOAT,cpuEngine->getBathymetry());
+		dataItem->cpuBathymetryVersion=cpuEngine->getBathymetryVersion();
+		}
 	}
 
 void WaterTable2::bindQuantityTexture(GLContextData& contextData) const
@@ -1086,6 +1610,24 @@ void WaterTable2::bindQuantityTexture(GLContextData& contextData) const
 	
 	/* Bind the conserved quantities texture: */
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+	
+	if(simulationRate>0.0)
+		{
+		/* Upload the conserved quantity grid of the simulation thread's locked state if it changed: */
+		const SimulationState& state=simulationStates.getLockedValue();
+		if(!state.quantities.empty()&&dataItem->cpuQuantityVersion!=state.quantityVersion)
+			{
+			glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,size[0],size[1],GL_RGB,GL_FLOAT,&state.quantities[0]);
+			dataItem->cpuQuantityVersion=state.quantityVersion;
+			}
+		}
+	else if(cpuEngine!=0&&dataItem->cpuQuantityVersion!=cpuEngine->getQuantityVersion())
+		{
+		/* Upload the CPU engine's current conserved quantity grid: */
+		cpuEngine->getQuantities(dataItem->cpuTransferBuffer);
+		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,size[0],size[1],GL_RGB,GL_FLOAT,dataItem->cpuTransferBuffer);
+		dataItem->cpuQuantityVersion=cpuEngine->getQuantityVersion();
+		}
 	}
 
 void WaterTable2::uploadWaterTextureTransform(GLint location) const
@@ -2,7 +2,7 @@
 WaterTable2 - Class to simulate water flowing over a surface using
 improved water flow simulation based on Saint-Venant system of partial
 differenctial equations.
-Copyright (c) 2012-2019 Oliver Kreylos
+Copyright (c) 2012-2020 Oliver Kreylos
 
 This file is part of the Augmented Reality Sandbox (SARndbox).
 
@@ -26,6 +26,9 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include <vector>
 #include <Misc/FunctionCalls.h>
+#include <Threads/Mutex.h>
+#include <Threads/Thread.h>
+#include <Threads/TripleBuffer.h>
 #include <Geometry/Point.h>
 #include <Geometry/Box.h>
 #include <Geometry/OrthonormalTransformation.h>
@@ -38,6 +41,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 /* Forward declarations: */
 class DepthImageRenderer;
+class WaterTableCPU;
 
 typedef Misc::FunctionCall<GLContextData&> AddWaterFunction; // Type for render functions called to locally add water to the water table
 
@@ -48,6 +52,32 @@ class WaterTable2:public GLObject
 	typedef Geometry::Box<Scalar,3> Box;
 	typedef Geometry::OrthonormalTransformation<Scalar,3> ONTransform;
 	
+	enum Engine // Enumerated type for water flow simulation engines
+		{
+		GPU, // Simulation runs in GLSL shaders on the graphics card
+		CPU // Simulation runs in a multithreaded and vectorized CPU implementation
+		};
+	
+	struct ThreadStatistics // Structure holding statistics of a dedicated simulation thread
+		{
+		/* Elements: */
+		public:
+		unsigned int numTicks; // Number of simulation ticks since the last reset
+		unsigned int numSteps; // Number of simulation steps run since the last reset
+		unsigned int numLaggingTicks; // Number of ticks since the last reset that could not cover their requested simulation time
+		double requestedTime; // Total simulation time requested since the last reset in seconds
+		double lagTime; // Total requested simulation time that could not be covered since the last reset in seconds
+		double tickTime; // Running estimate of the wall-clock time spent per tick in seconds
+		double lagFraction; // Running estimate of the fraction of requested simulation time that could not be covered
+		
+		/* Constructors and destructors: */
+		ThreadStatistics(void)
+			:numTicks(0),numSteps(0),numLaggingTicks(0),requestedTime(0.0),lagTime(0.0),
+			 tickTime(0.0),lagFraction(0.0)
+			{
+			}
+		};
+	
 	private:
 	struct DataItem:public GLObject::DataItem // Structure holding per-context state
 		{
@@ -56,6 +86,8 @@ class WaterTable2:public GLObject
 		GLuint bathymetryTextureObjects[2]; // Double-buffered one-component float color texture object holding the vertex-centered bathymetry grid
 		int currentBathymetry; // Index of bathymetry texture containing the most recent bathymetry grid
 		unsigned int bathymetryVersion; // Version number of the most recent bathymetry grid
+		unsigned int bathymetryTransformationVersion; // Version number of the transformations with which the most recent bathymetry grid was rendered
+		GLint staleBathymetryRect[4]; // Region (x, y, width, height) in which the other bathymetry texture does not match the most recent bathymetry grid
 		GLuint quantityTextureObjects[3]; // Double-buffered three-component color texture object holding the cell-centered conserved quantity grid (w, hu, hv)
 		int currentQuantity; // Index of quantity texture containing the most recent conserved quantity grid
 		GLuint derivativeTextureObject; // Three-component color texture object holding the cell-centered temporal derivative grid
@@ -84,12 +116,31 @@ class WaterTable2:public GLObject
 		GLint waterAddShaderUniformLocations[3];
 		GLhandleARB waterShader; // Shader to add or remove water from the conserved quantities grid
 		GLint waterShaderUniformLocations[3];
+		unsigned int cpuBathymetryVersion; // Version number of the CPU engine's bathymetry grid in the current bathymetry texture
+		unsigned int cpuQuantityVersion; // Version number of the CPU engine's quantity grid in the current quantity texture
+		GLfloat* cpuTransferBuffer; // Buffer to transfer grids between the CPU engine and OpenGL
 		
 		/* Constructors and destructors: */
 		DataItem(void);
 		virtual ~DataItem(void);
 		};
 	
+	struct SimulationState // Structure holding a snapshot of the CPU engine's state published by a dedicated simulation thread
+		{
+		/* Elements: */
+		public:
+		std::vector<GLfloat> bathymetry; // Vertex-centered bathymetry grid
+		unsigned int bathymetryVersion; // CPU engine's version number of the bathymetry grid
+		std::vector<GLfloat> quantities; // Interleaved cell-centered conserved quantity grid
+		unsigned int quantityVersion; // CPU engine's version number of the conserved quantity grid
+		
+		/* Constructors and destructors: */
+		SimulationState(void)
+			:bathymetryVersion(0),quantityVersion(0)
+			{
+			}
+		};
+	
 	/* Elements: */
 	GLsizei size[2]; // Width and height of water table in pixels
 	const DepthImageRenderer* depthImageRenderer; // Renderer object used to update the water table's bathymetry grid
@@ -97,6 +148,7 @@ class WaterTable2:public GLObject
 	Box domain; // Domain of elevation map space in rotated camera space
 	GLfloat cellSize[2]; // Width and height of water table cells in world coordinate units
 	PTransform bathymetryPmv; // Combined projection and modelview matrix to render the current surface into the bathymetry grid
+	unsigned int transformationVersion; // Version number of the derived transformations
 	PTransform waterAddPmv; // Combined projection and modelview matrix to render water-adding geometry into the water grid
 	GLfloat waterAddPmvMatrix[16]; // Same, in GLSL-compatible format
 	GLfloat theta; // Coefficient for minmod flux-limiting differential operator
@@ -109,21 +161,55 @@ class WaterTable2:public GLObject
 	std::vector<const AddWaterFunction*> renderFunctions; // A list of functions that are called after each water flow simulation step to locally add or remove water from the water table
 	GLfloat waterDeposit; // A fixed amount of water added at every iteration of the flow simulation, for evaporation etc.
 	bool dryBoundary; // Flag whether to enforce dry boundary conditions at the end of each simulation step
+	WaterTableCPU* cpuEngine; // CPU-based simulation engine if the CPU engine was selected; null otherwise
+	double simulationRate; // Tick rate of the dedicated simulation thread in Hz; 0 if the simulation is run by the caller
+	mutable Threads::Mutex threadInputMutex; // Mutex protecting inputs to and statistics of the dedicated simulation thread
+	mutable std::vector<GLfloat> threadBathymetry; // New bathymetry grid for the simulation thread
+	mutable bool threadBathymetryValid; // Flag whether the new bathymetry grid has not been picked up yet
+	mutable std::vector<GLfloat> threadWater; // Accumulated amounts of water to add to the conserved quantities on the next tick
+	mutable bool threadWaterValid; // Flag whether the accumulated water grid has not been picked up yet
+	mutable std::vector<GLfloat> threadWaterLevel; // New water level grid for the simulation thread
+	mutable bool threadWaterLevelValid; // Flag whether the new water level grid has not been picked up yet
+	bool threadResetValid; // Flag whether the simulation thread has to reset the CPU engine to a new base elevation
+	GLfloat threadResetElevation; // Base elevation to which to reset the CPU engine
+	bool threadSettingsValid; // Flag whether the simulation thread has to apply new attenuation and boundary settings to the CPU engine
+	GLfloat threadAttenuation; // New attenuation factor for the CPU engine
+	bool threadDryBoundary; // New dry boundary flag for the CPU engine
+	double threadSpeed; // Simulation time advanced per second of real time by the simulation thread
+	unsigned int threadMaxSteps; // Maximum number of simulation steps per tick
+	GLfloat threadWaterDeposit; // Amount of water deposited per unit of simulation time by the simulation thread
+	ThreadStatistics threadStatistics; // Statistics of the simulation thread
+	Threads::TripleBuffer<SimulationState> simulationStates; // Triple buffer of simulation states published by the simulation thread
+	volatile bool keepSimulating; // Flag to shut down the simulation thread
+	Threads::Thread simulationThread; // Dedicated thread running the CPU engine
 	
 	/* Private methods: */
 	void calcTransformations(void); // Calculates derived transformations
+	bool calcBathymetryRect(unsigned int sinceVersion,GLint rect[4]) const; // Calculates the region (x, y, width, height) of the bathymetry grid covering the surface that changed after the given depth image version; returns false if no changes fall into the bathymetry grid
+	void createCpuEngine(Engine engine,unsigned int numCpuEngineThreads); // Creates the CPU-based simulation engine processed by the given number of threads (number of CPUs if zero) if the CPU engine was selected
 	GLfloat calcDerivative(DataItem* dataItem,GLuint quantityTextureObject,bool calcMaxStepSize) const; // Calculates the temporal derivative of the conserved quantities in the given texture object and returns maximum step size if flag is true
+	void renderWaterSources(DataItem* dataItem,GLfloat stepSize,GLfloat baseWaterAmount,GLContextData& contextData) const; // Renders all water sources and sinks for the given step size additively on top of the given uniform water amount into the water texture
+	void postThreadSettings(void); // Forwards the current attenuation and boundary settings to the simulation thread
+	void* simulationThreadMethod(void); // Runs the CPU engine at the simulation thread's tick rate; has exclusive access to the CPU engine while running
 	
 	/* Constructors and destructors: */
 	public:
-	WaterTable2(GLsizei width,GLsizei height,const GLfloat sCellSize[2]); // Creates water table for offline simulation
-	WaterTable2(GLsizei width,GLsizei height,const DepthImageRenderer* sDepthImageRenderer,const Point basePlaneCorners[4]); // Creates a water table of the given size in pixels, for the base plane quadrilateral defined by the depth image renderer's plane equation and four corner points
+	WaterTable2(GLsizei width,GLsizei height,const GLfloat sCellSize[2],Engine sEngine =GPU,unsigned int numCpuEngineThreads =0); // Creates water table for offline simulation using the given simulation engine; CPU engine is processed by the given number of threads (number of CPUs if zero)
+	WaterTable2(GLsizei width,GLsizei height,const DepthImageRenderer* sDepthImageRenderer,const Point basePlaneCorners[4],Engine sEngine =GPU,unsigned int numCpuEngineThreads =0); // Creates a water table of the given size in pixels, for the base plane quadrilateral defined by the depth image renderer's plane equation and four corner points, using the given simulation engine; CPU engine is processed by the given number of threads (number of CPUs if zero)
 	virtual ~WaterTable2(void);
 	
 	/* Methods from GLObject: */
 	virtual void initContext(GLContextData& contextData) const;
 	
 	/* New methods: */
+	Engine getEngine(void) const // Returns the water flow simulation engine
+		{
+		return cpuEngine!=0?CPU:GPU;
+		}
+	const WaterTableCPU* getCpuEngine(void) const // Returns the CPU-based simulation engine, or null if the GPU engine is used
+		{
+		return cpuEngine;
+		}
 	const GLsizei* getSize(void) const // Returns the size of the water table
 		{
 		return size;
@@ -148,7 +234,7 @@ class WaterTable2:public GLObject
 		{
 		return dryBoundary;
 		}
-	void setElevationRange(Scalar newMin,Scalar newMax); // Sets the range of possible elevations in the water table
+	void setElevationRange(Scalar newMin,Scalar newMax); // Sets the range of possible elevations in the water table; resets the CPU engine's simulation state
 	void setAttenuation(GLfloat newAttenuation); // Sets the attenuation factor for partial discharges
 	void setMaxStepSize(GLfloat newMaxStepSize); // Sets the maximum step size for all subsequent integration steps
 	const PTransform& getWaterTextureTransform(void) const // Returns the matrix transforming from camera space into water texture space
@@ -163,10 +249,18 @@ class WaterTable2:public GLObject
 		}
 	void setWaterDeposit(GLfloat newWaterDeposit); // Sets the amount of deposited water
 	void setDryBoundary(bool newDryBoundary); // Enables or disables enforcement of dry boundaries
+	void startSimulationThread(double newSimulationRate); // Runs the CPU engine on a dedicated thread ticking at the given rate in Hz; throws exception if the GPU engine is used
+	bool hasSimulationThread(void) const // Returns true if the simulation runs on a dedicated thread
+		{
+		return simulationRate>0.0;
+		}
+	void updateSimulationThread(double newSpeed,unsigned int newMaxStepsPerTick); // Sets the simulation thread's speed and maximum number of steps per tick, and locks its most recently published state for rendering; must be called once per frame
+	void submitWaterSources(GLfloat stepSize,GLContextData& contextData) const; // Renders all water sources and sinks for the given simulation time and forwards them to the simulation thread
+	ThreadStatistics getThreadStatistics(bool reset); // Returns the simulation thread's statistics, and optionally resets its counters
 	void updateBathymetry(GLContextData& contextData) const; // Prepares the water table for subsequent calls to the runSimulationStep() method
 	void updateBathymetry(const GLfloat* bathymetryGrid,GLContextData& contextData) const; // Updates the bathymetry directly with a vertex-centered elevation grid of grid size minus 1
 	void setWaterLevel(const GLfloat* waterGrid,GLContextData& contextData) const; // Sets the current water level to the given grid, and resets flux components to zero
-	GLfloat runSimulationStep(bool forceStepSize,GLContextData& contextData) const; // Runs a water flow simulation step, always uses maxStepSize if flag is true (may lead to instability); returns step size taken by Runge-Kutta integration step
+	GLfloat runSimulationStep(bool forceStepSize,GLContextData& contextData) const; // Runs a water flow simulation step, always uses maxStepSize if flag is true (may lead to instability); returns step size taken by Runge-Kutta integration step; throws exception if a simulation thread is running
 	void bindBathymetryTexture(GLContextData& contextData) const; // Binds the bathymetry texture object to the active texture unit
 	void bindQuantityTexture(GLContextData& contextData) const; // Binds the most recent conserved quantities texture object to the active texture unit
 	void uploadWaterTextureTransform(GLint location) const; // Uploads the water texture transformation into the GLSL 4x4 matrix at the given uniform location
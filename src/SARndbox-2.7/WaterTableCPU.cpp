@@ -0,0 +1,828 @@
+/***********************************************************************
+WaterTableCPU - Class to simulate water flowing over a surface on the
+CPU, using the same Saint-Venant discretization as the GPU-based
+WaterTable2 class, vectorized and multithreaded across horizontal bands
+of the simulation grid, and restricted to tiles of the simulation grid
+that contain or border water.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "WaterTableCPU.h"
+
+#include <string.h>
+#include <Misc/ThrowStdErr.h>
+#include <Math/Math.h>
+
+#include "Float4.h"
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+inline int roundUp4(int value)
+	{
+	return (value+3)&~3;
+	}
+
+inline int clamp(int value,int max)
+	{
+	return value<0?0:(value>max?max:value);
+	}
+
+inline void loadQuantity(float* const q[3],int index,Float4 result[3])
+	{
+	for(int i=0;i<3;++i)
+		result[i]=Float4::load(q[i]+index);
+	}
+
+inline void storeQuantity(const Float4 value[3],int index,float* const q[3])
+	{
+	for(int i=0;i<3;++i)
+		value[i].store(q[i]+index);
+	}
+
+inline void calcSlope(const Float4 q0[3],const Float4 q1[3],const Float4 q2[3],float cellSize,float theta,const Float4& b0,const Float4& b1,Float4 slope[3])
+	{
+	/* Calculate the left, central, and right differences and their minmod-limited slopes: */
+	Float4 zero(0.0f);
+	Float4 thetaOverCellSize(theta/cellSize);
+	Float4 twoCellSize(2.0f*cellSize);
+	for(int i=0;i<3;++i)
+		{
+		Float4 d01=(q1[i]-q0[i])*thetaOverCellSize;
+		Float4 d02=(q2[i]-q0[i])/twoCellSize;
+		Float4 d12=(q2[i]-q1[i])*thetaOverCellSize;
+		Float4 dMin=min(min(d01,d02),d12);
+		Float4 dMax=max(max(d01,d02),d12);
+		slope[i]=select(dMin>zero,dMin,select(dMax<zero,dMax,zero));
+		}
+	
+	/* Check the calculated slope against the left and right face-centered bathymetry values: */
+	Float4 halfCellSize(cellSize*0.5f);
+	slope[0]=select(q1[0]-slope[0]*halfCellSize<b0,(q1[0]-b0)/halfCellSize,slope[0]);
+	slope[0]=select(q1[0]+slope[0]*halfCellSize<b1,(b1-q1[0])/halfCellSize,slope[0]);
+	}
+
+inline void calcUv(Float4 q[3],const Float4& h,const Float4& epsilon,Float4 uv[2])
+	{
+	/* Calculate velocity using a desingularizing division operator: */
+	Float4 h2=h*h;
+	Float4 h4=h2*h2;
+	Float4 factor=Float4(1.41421356237309f)*h/sqrt(h4+max(h4,epsilon));
+	
+	/* Recalculate discharge based on desingularized velocity: */
+	for(int i=0;i<2;++i)
+		{
+		uv[i]=q[1+i]*factor;
+		q[1+i]=uv[i]*h;
+		}
+	}
+
+template <int directionParam>
+inline Float4 calcPartialFlux(Float4 qe[3],Float4 qw[3],const Float4& b,const Float4& g,const Float4& epsilon,const Float4& halfCellSize,Float4 flux[3])
+	{
+	/* Calculate one-sided water column heights: */
+	Float4 zero(0.0f);
+	Float4 he=max(qe[0]-b,zero);
+	Float4 hw=max(qw[0]-b,zero);
+	
+	/* Calculate one-sided velocities: */
+	Float4 uve[2],uvw[2];
+	calcUv(qe,he,epsilon,uve);
+	calcUv(qw,hw,epsilon,uvw);
+	
+	/* Calculate one-sided flux quadratures along the flux direction: */
+	Float4 halfG=g*Float4(0.5f);
+	Float4 fe[3],fw[3];
+	fe[0]=qe[1+directionParam];
+	fe[1]=uve[0]*qe[1+directionParam];
+	fe[2]=uve[1]*qe[1+directionParam];
+	fe[1+directionParam]=fe[1+directionParam]+halfG*he*he;
+	fw[0]=qw[1+directionParam];
+	fw[1]=uvw[0]*qw[1+directionParam];
+	fw[2]=uvw[1]*qw[1+directionParam];
+	fw[1+directionParam]=fw[1+directionParam]+halfG*hw*hw;
+	
+	/* Calculate one-sided local speeds of propagation: */
+	Float4 sghe=sqrt(g*he);
+	Float4 sghw=sqrt(g*hw);
+	Float4 ae=min(min(uve[directionParam]-sghe,uvw[directionParam]-sghw),zero);
+	Float4 aw=max(max(uve[directionParam]+sghe,uvw[directionParam]+sghw),zero);
+	
+	/* Calculate complete flux: */
+	Float4 denominator=aw-ae;
+	Float4 valid=denominator!=zero;
+	Float4 awae=aw*ae;
+	for(int i=0;i<3;++i)
+		flux[i]=select(valid,((fe[i]*aw-fw[i]*ae)+(qw[i]-qe[i])*awae)/denominator,zero);
+	
+	/* Return maximum possible step size: */
+	return halfCellSize/max(-ae,aw);
+	}
+
+}
+
+/**************************************
+Static elements of class WaterTableCPU:
+**************************************/
+
+const int WaterTableCPU::tileSize;
+
+/******************************
+Methods of class WaterTableCPU:
+******************************/
+
+void WaterTableCPU::fillGhostCells(float* const q[3])
+	{
+	for(int i=0;i<3;++i)
+		{
+		/* Extend each row's first and last cells into the left and right ghost cells: */
+		for(int y=0;y<size[1];++y)
+			{
+			float* row=cell(q[i],0,y);
+			for(int x=-4;x<0;++x)
+				row[x]=row[0];
+			for(int x=size[0];x<stride-4;++x)
+				row[x]=row[size[0]-1];
+			}
+		
+		/* Extend the first and last rows into the bottom and top ghost rows: */
+		for(int y=-2;y<0;++y)
+			memcpy(cell(q[i],-4,y),cell(q[i],-4,0),stride*sizeof(float));
+		for(int y=size[1];y<size[1]+2;++y)
+			memcpy(cell(q[i],-4,y),cell(q[i],-4,size[1]-1),stride*sizeof(float));
+		}
+	}
+
+void WaterTableCPU::bathymetryBand(unsigned int,int rowBegin,int rowEnd)
+	{
+	int bWidth=size[0]-1;
+	int bMax[2]={size[0]-2,size[1]-2};
+	for(int y=rowBegin;y<rowEnd;++y)
+		{
+		/* Get the two rows of bathymetry vertices surrounding this row of cells, clamped to the grid: */
+		const float* b0Row=bathymetry+clamp(y-1,bMax[1])*bWidth;
+		const float* b1Row=bathymetry+clamp(y,bMax[1])*bWidth;
+		bool interiorRow=y>=0&&y<size[1];
+		
+		for(int x=-4;x<stride-4;++x)
+			{
+			/* Get the four bathymetry vertices surrounding this cell: */
+			int x0=clamp(x-1,bMax[0]);
+			int x1=clamp(x,bMax[0]);
+			float b00=b0Row[x0];
+			float b10=b0Row[x1];
+			float b01=b1Row[x0];
+			float b11=b1Row[x1];
+			
+			/* Calculate face-centered and cell-centered bathymetry elevations: */
+			int index=y*stride+x;
+			bathymetryWest[index]=(b00+b01)*0.5f;
+			bathymetryEast[index]=(b10+b11)*0.5f;
+			bathymetrySouth[index]=(b00+b10)*0.5f;
+			bathymetryNorth[index]=(b01+b11)*0.5f;
+			float bNew=(b00+b10+b01+b11)*0.25f;
+			
+			/* Keep the water column height of interior cells constant: */
+			if(interiorRow&&x>=0&&x<size[0])
+				quantity[0][index]=Math::max(quantity[0][index]-bathymetryCenter[index],0.0f)+bNew;
+			
+			bathymetryCenter[index]=bNew;
+			}
+		}
+	}
+
+void WaterTableCPU::wetTileBand(unsigned int,int tileRowBegin,int tileRowEnd)
+	{
+	for(int ty=tileRowBegin;ty<tileRowEnd;++ty)
+		{
+		int yBegin,yEnd;
+		getTileRows(ty,yBegin,yEnd);
+		for(int tx=0;tx<numTiles[0];++tx)
+			{
+			int xBegin,xEnd;
+			getTileColumns(tx,xBegin,xEnd);
+			
+			/* Check if any cell in the tile contains water; partial discharges of dry cells have no effect on the simulation: */
+			bool wet=false;
+			for(int y=yBegin;y<yEnd&&!wet;++y)
+				for(int x=xBegin;x<xEnd&&!wet;x+=4)
+					{
+					int index=y*stride+x;
+					Float4 cellWet=Float4::load(quantity[0]+index)>Float4::load(bathymetryCenter+index);
+					if(x+4>size[0])
+						cellWet=cellWet&laneIndexLess(size[0]-x);
+					wet=any(cellWet);
+					}
+			tileWet[ty*numTiles[0]+tx]=wet;
+			}
+		}
+	}
+
+void WaterTableCPU::updateTileStates(void)
+	{
+	/* Recalculate the tiles' wetness flags if the conserved quantities were changed wholesale: */
+	if(!tileWetValid)
+		{
+		workerPool.processBands(0,numTiles[1],this,&WaterTableCPU::wetTileBand);
+		tileWetValid=true;
+		}
+	
+	/* Activate all tiles containing or bordering water, and mark all tiles bordering active tiles as halo: */
+	numActiveTiles=0;
+	for(int ty=0;ty<numTiles[1];++ty)
+		for(int tx=0;tx<numTiles[0];++tx)
+			{
+			int minDist=3;
+			for(int dy=-2;dy<=2;++dy)
+				for(int dx=-2;dx<=2;++dx)
+					{
+					int nx=tx+dx;
+					int ny=ty+dy;
+					if(nx>=0&&nx<numTiles[0]&&ny>=0&&ny<numTiles[1]&&tileWet[ny*numTiles[0]+nx])
+						minDist=Math::min(minDist,Math::max(Math::abs(dx),Math::abs(dy)));
+					}
+			TileState state=minDist<=1?ACTIVE:(minDist==2?HALO:DRY);
+			tileStates[ty*numTiles[0]+tx]=state;
+			if(state==ACTIVE)
+				++numActiveTiles;
+			}
+	}
+
+void WaterTableCPU::waterLevelBand(unsigned int,int tileRowBegin,int tileRowEnd)
+	{
+	for(int ty=tileRowBegin;ty<tileRowEnd;++ty)
+		{
+		int yBegin,yEnd;
+		getTileRows(ty,yBegin,yEnd);
+		for(int tx=0;tx<numTiles[0];++tx)
+			{
+			int xBegin,xEnd;
+			getTileColumns(tx,xBegin,xEnd);
+			bool wet=false;
+			for(int y=yBegin;y<yEnd;++y)
+				{
+				const float* wRow=passGrid+y*size[0];
+				for(int x=xBegin;x<xEnd;++x)
+					{
+					/* Raise the water surface to the bathymetry and reset partial discharges: */
+					int index=y*stride+x;
+					quantity[0][index]=Math::max(wRow[x],bathymetryCenter[index]);
+					quantity[1][index]=0.0f;
+					quantity[2][index]=0.0f;
+					wet=wet||quantity[0][index]>bathymetryCenter[index];
+					}
+				}
+			tileWet[ty*numTiles[0]+tx]=wet;
+			}
+		}
+	}
+
+void WaterTableCPU::slopeBand(unsigned int,int tileRowBegin,int tileRowEnd)
+	{
+	float* const* q=passQuantity;
+	for(int ty=tileRowBegin;ty<tileRowEnd;++ty)
+		{
+		/* Extend the first and last tile rows into the ghost rows: */
+		int yBegin,yEnd;
+		getTileRows(ty,yBegin,yEnd);
+		if(ty==0)
+			yBegin=-1;
+		if(ty==numTiles[1]-1)
+			yEnd=size[1]+1;
+		
+		for(int tx=0;tx<numTiles[0];++tx)
+			{
+			if(getTileState(tx,ty)==DRY)
+				continue;
+			
+			/* Extend the first and last tile columns into the ghost columns: */
+			int xBegin,xEnd;
+			getTileColumns(tx,xBegin,xEnd);
+			int xSlopeBegin=tx==0?-4:xBegin;
+			int xSlopeEnd=tx==numTiles[0]-1?size[0]+1:xEnd;
+			
+			for(int y=yBegin;y<yEnd;++y)
+				{
+				if(y>=0&&y<size[1])
+					{
+					/* Calculate x-direction slopes for all cells adjacent to a western face, including the ghost cells on either side: */
+					for(int x=xSlopeBegin;x<xSlopeEnd;x+=4)
+						{
+						int index=y*stride+x;
+						Float4 q0[3],q1[3],q2[3],slope[3];
+						loadQuantity(q,index-1,q0);
+						loadQuantity(q,index,q1);
+						loadQuantity(q,index+1,q2);
+						calcSlope(q0,q1,q2,cellSize[0],theta,Float4::load(bathymetryWest+index),Float4::load(bathymetryEast+index),slope);
+						storeQuantity(slope,index,slopeX);
+						}
+					}
+				
+				/* Calculate y-direction slopes: */
+				for(int x=xBegin;x<xEnd;x+=4)
+					{
+					int index=y*stride+x;
+					Float4 q0[3],q1[3],q2[3],slope[3];
+					loadQuantity(q,index-stride,q0);
+					loadQuantity(q,index,q1);
+					loadQuantity(q,index+stride,q2);
+					calcSlope(q0,q1,q2,cellSize[1],theta,Float4::load(bathymetrySouth+index),Float4::load(bathymetryNorth+index),slope);
+					storeQuantity(slope,index,slopeY);
+					}
+				}
+			}
+		}
+	}
+
+void WaterTableCPU::fluxBand(unsigned int bandIndex,int tileRowBegin,int tileRowEnd)
+	{
+	float* const* q=passQuantity;
+	Float4 g4(g);
+	Float4 epsilon4(epsilon);
+	Float4 halfCellSize[2];
+	for(int i=0;i<2;++i)
+		halfCellSize[i]=Float4(cellSize[i]*0.5f);
+	Float4 minStepSize(maxStepSize);
+	
+	for(int ty=tileRowBegin;ty<tileRowEnd;++ty)
+		{
+		int yBegin,yEnd;
+		getTileRows(ty,yBegin,yEnd);
+		for(int tx=0;tx<numTiles[0];++tx)
+			{
+			if(getTileState(tx,ty)!=ACTIVE)
+				continue;
+			
+			/* Calculate the faces between this and the next tile in either direction unless the next tile calculates them itself: */
+			int xBegin,xEnd;
+			getTileColumns(tx,xBegin,xEnd);
+			int xFaceEnd=getTileState(tx+1,ty)==ACTIVE?xEnd-1:xEnd;
+			int yFaceEnd=getTileState(tx,ty+1)==ACTIVE?yEnd:yEnd+1;
+			
+			for(int y=yBegin;y<yFaceEnd;++y)
+				{
+				if(y<yEnd)
+					{
+					/* Calculate partial fluxes across the western faces of all cells, including the eastern face of the tile's last cell: */
+					for(int x=xBegin;x<=xFaceEnd;x+=4)
+						{
+						int index=y*stride+x;
+						Float4 qe[3],qw[3],s[3],flux[3];
+						loadQuantity(q,index-1,qe);
+						loadQuantity(slopeX,index-1,s);
+						for(int i=0;i<3;++i)
+							qe[i]=qe[i]+s[i]*halfCellSize[0];
+						loadQuantity(q,index,qw);
+						loadQuantity(slopeX,index,s);
+						for(int i=0;i<3;++i)
+							qw[i]=qw[i]-s[i]*halfCellSize[0];
+						Float4 stepSize=calcPartialFlux<0>(qe,qw,Float4::load(bathymetryWest+index),g4,epsilon4,halfCellSize[0],flux);
+						storeQuantity(flux,index,fluxX);
+						
+						if(passCalcStepSize)
+							{
+							/* Ignore faces beyond the end of the row: */
+							if(x+4>size[0]+1)
+								stepSize=select(laneIndexLess(size[0]+1-x),stepSize,minStepSize);
+							minStepSize=min(stepSize,minStepSize);
+							}
+						}
+					}
+				
+				/* Calculate partial fluxes across the southern faces of all cells in this row, or the northern faces of the tile's last row: */
+				for(int x=xBegin;x<xEnd;x+=4)
+					{
+					int index=y*stride+x;
+					Float4 qn[3],qs[3],s[3],flux[3];
+					loadQuantity(q,index-stride,qn);
+					loadQuantity(slopeY,index-stride,s);
+					for(int i=0;i<3;++i)
+						qn[i]=qn[i]+s[i]*halfCellSize[1];
+					loadQuantity(q,index,qs);
+					loadQuantity(slopeY,index,s);
+					for(int i=0;i<3;++i)
+						qs[i]=qs[i]-s[i]*halfCellSize[1];
+					Float4 stepSize=calcPartialFlux<1>(qn,qs,Float4::load(bathymetrySouth+index),g4,epsilon4,halfCellSize[1],flux);
+					storeQuantity(flux,index,fluxY);
+					
+					if(passCalcStepSize)
+						{
+						/* Ignore faces beyond the end of the row: */
+						if(x+4>size[0])
+							stepSize=select(laneIndexLess(size[0]-x),stepSize,minStepSize);
+						minStepSize=min(stepSize,minStepSize);
+						}
+					}
+				}
+			}
+		}
+	
+	bandStepSizes[bandIndex]=minStepSize.minComponent();
+	}
+
+namespace {
+
+inline void calcDerivative(float* const fluxX[3],float* const fluxY[3],int stride,const float* q0,const float* bathymetryWest,const float* bathymetryEast,const float* bathymetrySouth,const float* bathymetryNorth,int index,const Float4& g,const Float4 cellSize[2],Float4 qt[3])
+	{
+	/* Calculate the water column height at the cell center: */
+	Float4 bw=Float4::load(bathymetryWest+index);
+	Float4 be=Float4::load(bathymetryEast+index);
+	Float4 bs=Float4::load(bathymetrySouth+index);
+	Float4 bn=Float4::load(bathymetryNorth+index);
+	Float4 h=max(Float4::load(q0+index)-(bw+be)*Float4(0.5f),Float4(0.0f));
+	
+	/* Calculate equation source terms at the cell center: */
+	Float4 source[3];
+	source[0]=Float4(0.0f);
+	source[1]=-g*h*(be-bw)/cellSize[0];
+	source[2]=-g*h*(bn-bs)/cellSize[1];
+	
+	/* Calculate the temporal derivative: */
+	for(int i=0;i<3;++i)
+		qt[i]=source[i]-(Float4::load(fluxX[i]+index+1)-Float4::load(fluxX[i]+index))/cellSize[0]-(Float4::load(fluxY[i]+index+stride)-Float4::load(fluxY[i]+index))/cellSize[1];
+	}
+
+}
+
+void WaterTableCPU::eulerStepBand(unsigned int,int tileRowBegin,int tileRowEnd)
+	{
+	Float4 g4(g);
+	Float4 cellSize4[2];
+	for(int i=0;i<2;++i)
+		cellSize4[i]=Float4(cellSize[i]);
+	Float4 stepSize(passStepSize);
+	Float4 attenuation4(passAttenuation);
+	
+	for(int ty=tileRowBegin;ty<tileRowEnd;++ty)
+		{
+		int yBegin,yEnd;
+		getTileRows(ty,yBegin,yEnd);
+		for(int tx=0;tx<numTiles[0];++tx)
+			{
+			TileState state=getTileState(tx,ty);
+			if(state==DRY)
+				continue;
+			
+			int xBegin,xEnd;
+			getTileColumns(tx,xBegin,xEnd);
+			if(state==HALO)
+				{
+				/* Copy the unchanging quantities of halo tiles so that active tiles can read them in the next pass: */
+				for(int y=yBegin;y<yEnd;++y)
+					for(int i=0;i<3;++i)
+						memcpy(cell(passResult[i],xBegin,y),cell(passQuantity[i],xBegin,y),(xEnd-xBegin)*sizeof(float));
+				continue;
+				}
+			
+			for(int y=yBegin;y<yEnd;++y)
+				for(int x=xBegin;x<xEnd;x+=4)
+					{
+					int index=y*stride+x;
+					Float4 qt[3],q[3];
+					calcDerivative(fluxX,fluxY,stride,passQuantity[0],bathymetryWest,bathymetryEast,bathymetrySouth,bathymetryNorth,index,g4,cellSize4,qt);
+					
+					/* Calculate the Euler step: */
+					loadQuantity(passQuantity,index,q);
+					q[0]=q[0]+qt[0]*stepSize;
+					for(int i=1;i<3;++i)
+						q[i]=(q[i]+qt[i]*stepSize)*attenuation4;
+					storeQuantity(q,index,passResult);
+					}
+			}
+		}
+	}
+
+void WaterTableCPU::rungeKuttaStepBand(unsigned int,int tileRowBegin,int tileRowEnd)
+	{
+	Float4 g4(g);
+	Float4 cellSize4[2];
+	for(int i=0;i<2;++i)
+		cellSize4[i]=Float4(cellSize[i]);
+	Float4 stepSize(passStepSize);
+	Float4 attenuation4(passAttenuation);
+	Float4 half(0.5f);
+	Float4 zero(0.0f);
+	
+	for(int ty=tileRowBegin;ty<tileRowEnd;++ty)
+		{
+		int yBegin,yEnd;
+		getTileRows(ty,yBegin,yEnd);
+		for(int tx=0;tx<numTiles[0];++tx)
+			{
+			if(getTileState(tx,ty)!=ACTIVE)
+				continue;
+			
+			int xBegin,xEnd;
+			getTileColumns(tx,xBegin,xEnd);
+			Float4 wet(zero);
+			for(int y=yBegin;y<yEnd;++y)
+				for(int x=xBegin;x<xEnd;x+=4)
+					{
+					int index=y*stride+x;
+					Float4 qt[3],q[3],qStar[3];
+					calcDerivative(fluxX,fluxY,stride,passQuantity[0],bathymetryWest,bathymetryEast,bathymetrySouth,bathymetryNorth,index,g4,cellSize4,qt);
+					
+					/* Calculate the Runge-Kutta step: */
+					loadQuantity(passResult,index,q);
+					loadQuantity(passQuantity,index,qStar);
+					q[0]=(q[0]+qStar[0]+qt[0]*stepSize)*half;
+					for(int i=1;i<3;++i)
+						q[i]=((q[i]+qStar[i]+qt[i]*stepSize)*half)*attenuation4;
+					storeQuantity(q,index,passResult);
+					
+					/* Track whether the tile still contains water: */
+					Float4 cellWet=q[0]>Float4::load(bathymetryCenter+index);
+					if(x+4>size[0])
+						cellWet=cellWet&laneIndexLess(size[0]-x);
+					wet=wet|cellWet;
+					}
+			tileWet[ty*numTiles[0]+tx]=any(wet);
+			}
+		}
+	}
+
+void WaterTableCPU::waterBand(unsigned int,int tileRowBegin,int tileRowEnd)
+	{
+	for(int ty=tileRowBegin;ty<tileRowEnd;++ty)
+		{
+		int yBegin,yEnd;
+		getTileRows(ty,yBegin,yEnd);
+		for(int tx=0;tx<numTiles[0];++tx)
+			{
+			int xBegin,xEnd;
+			getTileColumns(tx,xBegin,xEnd);
+			bool wet=false;
+			for(int y=yBegin;y<yEnd;++y)
+				{
+				const float* wRow=passGrid!=0?passGrid+y*size[0]:0;
+				for(int x=xBegin;x<xEnd;++x)
+					{
+					int index=y*stride+x;
+					
+					/* Calculate the old and new water column heights: */
+					float b=bathymetryCenter[index];
+					float hOld=quantity[0][index]-b;
+					float hNew=Math::max(hOld+(wRow!=0?wRow[x]:passWaterAmount),0.0f);
+					
+					/* Update the water surface height: */
+					quantity[0][index]=hNew+b;
+					
+					/* Update the partial discharges; new water is added with zero velocity, and water is removed at current velocity: */
+					if(hNew==0.0f)
+						{
+						quantity[1][index]=0.0f;
+						quantity[2][index]=0.0f;
+						}
+					else if(hNew<hOld)
+						{
+						float scale=hNew/hOld;
+						quantity[1][index]*=scale;
+						quantity[2][index]*=scale;
+						}
+					wet=wet||hNew>0.0f;
+					}
+				}
+			tileWet[ty*numTiles[0]+tx]=wet;
+			}
+		}
+	}
+
+float WaterTableCPU::calcFluxes(float* const q[3],bool calcMaxStepSize)
+	{
+	/* Calculate flux-limited slopes for all cells adjacent to a face: */
+	fillGhostCells(q);
+	passQuantity=q;
+	workerPool.processBands(0,numTiles[1],this,&WaterTableCPU::slopeBand);
+	
+	/* Calculate partial fluxes across all faces of active tiles: */
+	passCalcStepSize=calcMaxStepSize;
+	workerPool.processBands(0,numTiles[1],this,&WaterTableCPU::fluxBand);
+	
+	/* Gather the maximum step size from all bands: */
+	float stepSize=maxStepSize;
+	if(calcMaxStepSize)
+		{
+		unsigned int numBands=workerPool.getNumBands(numTiles[1]);
+		for(unsigned int i=0;i<numBands;++i)
+			stepSize=Math::min(stepSize,bandStepSizes[i]);
+		}
+	
+	return stepSize;
+	}
+
+WaterTableCPU::WaterTableCPU(int width,int height,const float sCellSize[2],float baseElevation,unsigned int numThreads)
+	:dryBoundary(true),
+	 workerPool(numThreads),
+	 gridMemory(0),
+	 bandStepSizes(workerPool.getNumThreads(),0.0f),
+	 tileWetValid(false),numActiveTiles(0),
+	 bathymetryVersion(0),quantityVersion(0),
+	 passQuantity(0),passResult(0),passCalcStepSize(false),
+	 passStepSize(0.0f),passAttenuation(1.0f),passWaterAmount(0.0f),passGrid(0)
+	{
+	/* Check the water table size: */
+	if(width<2||height<2)
+		Misc::throwStdErr("WaterTableCPU::WaterTableCPU: Invalid water table size %d x %d",width,height);
+	
+	/* Initialize the water table size and cell size: */
+	size[0]=width;
+	size[1]=height;
+	for(int i=0;i<2;++i)
+		cellSize[i]=sCellSize[i];
+	
+	/* Cover the water table with tiles: */
+	for(int i=0;i<2;++i)
+		numTiles[i]=(size[i]+tileSize-1)/tileSize;
+	tileWet.resize(size_t(numTiles[0])*size_t(numTiles[1]),0);
+	tileStates.resize(size_t(numTiles[0])*size_t(numTiles[1]),DRY);
+	
+	/* Initialize simulation parameters: */
+	theta=1.3f;
+	g=9.81f;
+	epsilon=0.01f*Math::max(Math::max(cellSize[0],cellSize[1]),1.0f);
+	attenuation=127.0f/128.0f;
+	maxStepSize=1.0f;
+	
+	/* Pad all grids by four ghost columns on either side, rounding the interior up to a multiple of four, and by two ghost rows: */
+	stride=roundUp4(size[0])+8;
+	size_t paddedGridSize=size_t(size[1]+4)*size_t(stride)+8;
+	size_t origin=size_t(2*stride+8);
+	
+	/* Allocate all grids in a single memory block: */
+	gridMemory=new float[paddedGridSize*23+size_t(size[0]-1)*size_t(size[1]-1)];
+	float* gridPtr=gridMemory;
+	float** paddedGrids[5]={&bathymetryWest,&bathymetryEast,&bathymetrySouth,&bathymetryNorth,&bathymetryCenter};
+	for(int i=0;i<5;++i,gridPtr+=paddedGridSize)
+		*paddedGrids[i]=gridPtr+origin;
+	float** quantityGrids[6]={quantity,quantityStar,slopeX,slopeY,fluxX,fluxY};
+	for(int j=0;j<6;++j)
+		for(int i=0;i<3;++i,gridPtr+=paddedGridSize)
+			quantityGrids[j][i]=gridPtr+origin;
+	bathymetry=gridPtr;
+	
+	/* Initialize the water table: */
+	reset(baseElevation);
+	}
+
+WaterTableCPU::~WaterTableCPU(void)
+	{
+	delete[] gridMemory;
+	}
+
+void WaterTableCPU::setAttenuation(float newAttenuation)
+	{
+	attenuation=newAttenuation;
+	}
+
+void WaterTableCPU::setMaxStepSize(float newMaxStepSize)
+	{
+	maxStepSize=newMaxStepSize;
+	}
+
+void WaterTableCPU::setDryBoundary(bool newDryBoundary)
+	{
+	dryBoundary=newDryBoundary;
+	}
+
+void WaterTableCPU::reset(float baseElevation)
+	{
+	/* Clear all grids: */
+	size_t paddedGridSize=size_t(size[1]+4)*size_t(stride)+8;
+	size_t numBathymetryVertices=size_t(size[0]-1)*size_t(size[1]-1);
+	memset(gridMemory,0,(paddedGridSize*23+numBathymetryVertices)*sizeof(float));
+	
+	/* Create a flat bathymetry and fill the water table to the bathymetry: */
+	for(size_t i=0;i<numBathymetryVertices;++i)
+		bathymetry[i]=baseElevation;
+	workerPool.processBands(-2,size[1]+2,this,&WaterTableCPU::bathymetryBand);
+	tileWetValid=false;
+	
+	++bathymetryVersion;
+	++quantityVersion;
+	}
+
+void WaterTableCPU::updateBathymetry(const float* bathymetryGrid)
+	{
+	/* Copy the new bathymetry grid: */
+	memcpy(bathymetry,bathymetryGrid,size_t(size[0]-1)*size_t(size[1]-1)*sizeof(float));
+	
+	/* Update the derived bathymetry grids and the conserved quantities: */
+	workerPool.processBands(-2,size[1]+2,this,&WaterTableCPU::bathymetryBand);
+	tileWetValid=false;
+	
+	++bathymetryVersion;
+	++quantityVersion;
+	}
+
+void WaterTableCPU::setWaterLevel(const float* waterGrid)
+	{
+	passGrid=waterGrid;
+	workerPool.processBands(0,numTiles[1],this,&WaterTableCPU::waterLevelBand);
+	passGrid=0;
+	
+	++quantityVersion;
+	}
+
+float WaterTableCPU::runSimulationStep(bool forceStepSize)
+	{
+	/* Determine which tiles need to be processed; nothing moves if there is no water: */
+	updateTileStates();
+	if(numActiveTiles==0)
+		return maxStepSize;
+	
+	/*********************************************************************
+	Step 1: Calculate partial fluxes of most recent quantities and perform
+	the tentative Euler integration step.
+	*********************************************************************/
+	
+	passStepSize=calcFluxes(quantity,!forceStepSize);
+	passAttenuation=Math::pow(attenuation,passStepSize);
+	passQuantity=quantity;
+	passResult=quantityStar;
+	workerPool.processBands(0,numTiles[1],this,&WaterTableCPU::eulerStepBand);
+	
+	/*********************************************************************
+	Step 2: Calculate partial fluxes of intermediate quantities and
+	perform the final Runge-Kutta integration step in place.
+	*********************************************************************/
+	
+	calcFluxes(quantityStar,false);
+	passQuantity=quantityStar;
+	passResult=quantity;
+	workerPool.processBands(0,numTiles[1],this,&WaterTableCPU::rungeKuttaStepBand);
+	
+	if(dryBoundary)
+		{
+		/* Set the outermost layer of cells to dry conditions: */
+		for(int y=0;y<size[1];++y)
+			{
+			int xStep=y==0||y==size[1]-1?1:size[0]-1;
+			for(int x=0;x<size[0];x+=xStep)
+				{
+				int index=y*stride+x;
+				quantity[0][index]=bathymetryCenter[index];
+				quantity[1][index]=0.0f;
+				quantity[2][index]=0.0f;
+				}
+			}
+		}
+	
+	++quantityVersion;
+	
+	/* Return the Runge-Kutta step's step size: */
+	return passStepSize;
+	}
+
+void WaterTableCPU::addWater(float waterAmount)
+	{
+	passWaterAmount=waterAmount;
+	workerPool.processBands(0,numTiles[1],this,&WaterTableCPU::waterBand);
+	
+	++quantityVersion;
+	}
+
+void WaterTableCPU::addWater(const float* waterGrid)
+	{
+	passGrid=waterGrid;
+	workerPool.processBands(0,numTiles[1],this,&WaterTableCPU::waterBand);
+	passGrid=0;
+	
+	++quantityVersion;
+	}
+
+void WaterTableCPU::getQuantities(float* quantityGrid) const
+	{
+	float* qgPtr=quantityGrid;
+	for(int y=0;y<size[1];++y)
+		for(int x=0;x<size[0];++x,qgPtr+=3)
+			{
+			int index=y*stride+x;
+			for(int i=0;i<3;++i)
+				qgPtr[i]=quantity[i][index];
+			}
+	}
+
+void WaterTableCPU::getWaterLevel(float* waterGrid) const
+	{
+	for(int y=0;y<size[1];++y)
+		memcpy(waterGrid+y*size[0],cell(quantity[0],0,y),size[0]*sizeof(float));
+	}
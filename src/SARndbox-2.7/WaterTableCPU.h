@@ -0,0 +1,192 @@
+/***********************************************************************
+WaterTableCPU - Class to simulate water flowing over a surface on the
+CPU, using the same Saint-Venant discretization as the GPU-based
+WaterTable2 class, vectorized and multithreaded across horizontal bands
+of the simulation grid, and restricted to tiles of the simulation grid
+that contain or border water.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef WATERTABLECPU_INCLUDED
+#define WATERTABLECPU_INCLUDED
+
+#include <vector>
+#include <Kinect/WorkerPool.h>
+
+class WaterTableCPU
+	{
+	/* Embedded classes: */
+	private:
+	enum TileState // Enumerated type for processing states of grid tiles during a simulation step
+		{
+		DRY=0, // Tile is neither read nor written
+		HALO, // Tile is read by neighboring active tiles, but its conserved quantities do not change
+		ACTIVE // Tile's fluxes are calculated and its conserved quantities are integrated
+		};
+	
+	/* Elements: */
+	static const int tileSize=16; // Width and height of grid tiles in cells; must be a multiple of four
+	int size[2]; // Width and height of water table in cells
+	float cellSize[2]; // Width and height of water table cells in world coordinate units
+	float theta; // Coefficient for minmod flux-limiting differential operator
+	float g; // Gravitiational acceleration constant
+	float epsilon; // Coefficient for desingularizing division operator
+	float attenuation; // Attenuation factor for partial discharges
+	float maxStepSize; // Maximum step size for each Runge-Kutta integration step
+	bool dryBoundary; // Flag whether to enforce dry boundary conditions at the end of each simulation step
+	Kinect::WorkerPool workerPool; // Pool of threads processing bands of grid rows in parallel
+	
+	/* Grid storage; all cell-centered grids are padded by a layer of ghost cells on each side: */
+	int stride; // Distance between adjacent rows in all padded grids
+	float* gridMemory; // Memory block holding all padded grids
+	float* bathymetry; // Unpadded vertex-centered bathymetry grid of size minus one
+	float* bathymetryWest; // Padded grid of bathymetry elevations at the centers of cells' western faces
+	float* bathymetryEast; // Ditto for eastern faces
+	float* bathymetrySouth; // Ditto for southern faces
+	float* bathymetryNorth; // Ditto for northern faces
+	float* bathymetryCenter; // Padded grid of bathymetry elevations at cell centers
+	float* quantity[3]; // Padded grids holding the cell-centered conserved quantities (w, hu, hv)
+	float* quantityStar[3]; // Padded grids holding the intermediate quantities of the Euler integration step
+	float* slopeX[3]; // Padded grids holding flux-limited x-direction slopes of the conserved quantities
+	float* slopeY[3]; // Ditto for y-direction slopes
+	float* fluxX[3]; // Padded grids holding partial fluxes across cells' western faces
+	float* fluxY[3]; // Ditto for southern faces
+	std::vector<float> bandStepSizes; // Maximum step sizes gathered by each band of the current flux computation
+	int numTiles[2]; // Number of tiles covering the simulation grid in x and y
+	std::vector<unsigned char> tileWet; // Flags whether each tile contains water
+	bool tileWetValid; // Flag whether the tile wetness flags reflect the current conserved quantities
+	std::vector<unsigned char> tileStates; // Processing state of each tile during the current simulation step
+	unsigned int numActiveTiles; // Number of active tiles during the most recent simulation step
+	unsigned int bathymetryVersion; // Version number of the current bathymetry grid
+	unsigned int quantityVersion; // Version number of the current conserved quantity grid
+	
+	/* State of the currently processed pass: */
+	float* const* passQuantity; // Conserved quantities read by the current pass
+	float* const* passResult; // Conserved quantities written by the current pass
+	bool passCalcStepSize; // Flag whether the current flux pass gathers maximum step sizes
+	float passStepSize; // Integration step size for the current pass
+	float passAttenuation; // Attenuation factor for partial discharges for the current pass
+	float passWaterAmount; // Uniform amount of water to add in the current pass
+	const float* passGrid; // Grid of new bathymetry, water level, or water amount values for the current pass
+	
+	/* Private methods: */
+	float* cell(float* grid,int x,int y) const // Returns a pointer to the given cell in the given padded grid
+		{
+		return grid+(y*stride+x);
+		}
+	const float* cell(const float* grid,int x,int y) const
+		{
+		return grid+(y*stride+x);
+		}
+	void fillGhostCells(float* const q[3]); // Copies boundary values of the given conserved quantities into their ghost cells
+	void bathymetryBand(unsigned int bandIndex,int rowBegin,int rowEnd); // Recalculates derived bathymetry grids and adapts conserved quantities to a new bathymetry
+	void getTileColumns(int tileX,int& xBegin,int& xEnd) const // Returns the range of grid columns covered by the given tile column
+		{
+		xBegin=tileX*tileSize;
+		xEnd=xBegin+tileSize<size[0]?xBegin+tileSize:size[0];
+		}
+	void getTileRows(int tileY,int& yBegin,int& yEnd) const // Returns the range of grid rows covered by the given tile row
+		{
+		yBegin=tileY*tileSize;
+		yEnd=yBegin+tileSize<size[1]?yBegin+tileSize:size[1];
+		}
+	TileState getTileState(int tileX,int tileY) const // Returns the processing state of the given tile; tiles outside the grid are dry
+		{
+		if(tileX<0||tileX>=numTiles[0]||tileY<0||tileY>=numTiles[1])
+			return DRY;
+		return TileState(tileStates[tileY*numTiles[0]+tileX]);
+		}
+	void wetTileBand(unsigned int bandIndex,int tileRowBegin,int tileRowEnd); // Recalculates the wetness flags of a band of tile rows
+	void updateTileStates(void); // Derives the processing states of all tiles from the tiles' wetness flags
+	void waterLevelBand(unsigned int bandIndex,int tileRowBegin,int tileRowEnd); // Sets conserved quantities from a water level grid
+	void slopeBand(unsigned int bandIndex,int tileRowBegin,int tileRowEnd); // Calculates flux-limited slopes of the pass quantities in active and halo tiles
+	void fluxBand(unsigned int bandIndex,int tileRowBegin,int tileRowEnd); // Calculates partial fluxes across the faces of active tiles' cells and optionally maximum step sizes
+	void eulerStepBand(unsigned int bandIndex,int tileRowBegin,int tileRowEnd); // Calculates the temporal derivative and performs a tentative Euler step in active tiles
+	void rungeKuttaStepBand(unsigned int bandIndex,int tileRowBegin,int tileRowEnd); // Calculates the temporal derivative and performs the final Runge-Kutta step in active tiles
+	void waterBand(unsigned int bandIndex,int tileRowBegin,int tileRowEnd); // Adds or removes water to/from the conserved quantities
+	float calcFluxes(float* const q[3],bool calcMaxStepSize); // Calculates partial fluxes across the faces of active tiles' cells for the given conserved quantities; returns maximum step size if flag is true
+	
+	/* Constructors and destructors: */
+	public:
+	WaterTableCPU(int width,int height,const float sCellSize[2],float baseElevation,unsigned int numThreads =0); // Creates a water table of the given size in cells with flat bathymetry at the given elevation, processed by the given number of threads (number of CPUs if zero)
+	private:
+	WaterTableCPU(const WaterTableCPU& source); // Prohibit copy constructor
+	WaterTableCPU& operator=(const WaterTableCPU& source); // Prohibit assignment operator
+	public:
+	~WaterTableCPU(void);
+	
+	/* Methods: */
+	const int* getSize(void) const // Returns the size of the water table
+		{
+		return size;
+		}
+	const float* getCellSize(void) const // Returns the water table's cell size
+		{
+		return cellSize;
+		}
+	unsigned int getNumThreads(void) const // Returns the number of threads processing the simulation
+		{
+		return workerPool.getNumThreads();
+		}
+	float getAttenuation(void) const // Returns the attenuation factor for partial discharges
+		{
+		return attenuation;
+		}
+	float getMaxStepSize(void) const // Returns the maximum step size for integration steps
+		{
+		return maxStepSize;
+		}
+	bool getDryBoundary(void) const // Returns true if dry boundaries are enforced after every simulation step
+		{
+		return dryBoundary;
+		}
+	unsigned int getNumTiles(void) const // Returns the total number of tiles covering the simulation grid
+		{
+		return (unsigned int)(numTiles[0]*numTiles[1]);
+		}
+	unsigned int getNumActiveTiles(void) const // Returns the number of tiles processed by the most recent simulation step
+		{
+		return numActiveTiles;
+		}
+	void setAttenuation(float newAttenuation); // Sets the attenuation factor for partial discharges
+	void setMaxStepSize(float newMaxStepSize); // Sets the maximum step size for all subsequent integration steps
+	void setDryBoundary(bool newDryBoundary); // Enables or disables enforcement of dry boundaries
+	void reset(float baseElevation); // Resets the water table to a dry and flat bathymetry at the given elevation
+	void updateBathymetry(const float* bathymetryGrid); // Updates the bathymetry with a vertex-centered elevation grid of grid size minus 1
+	void setWaterLevel(const float* waterGrid); // Sets the current water level to the given grid, and resets flux components to zero
+	float runSimulationStep(bool forceStepSize); // Runs a water flow simulation step on all tiles containing or bordering water, always uses maxStepSize if flag is true (may lead to instability); returns step size taken by Runge-Kutta integration step
+	void addWater(float waterAmount); // Adds the given amount of water to all cells, or removes water if negative
+	void addWater(const float* waterGrid); // Adds or removes the per-cell amounts of water in the given grid
+	unsigned int getBathymetryVersion(void) const // Returns the version number of the current bathymetry grid
+		{
+		return bathymetryVersion;
+		}
+	unsigned int getQuantityVersion(void) const // Returns the version number of the current conserved quantity grid
+		{
+		return quantityVersion;
+		}
+	const float* getBathymetry(void) const // Returns the current vertex-centered bathymetry grid of grid size minus 1
+		{
+		return bathymetry;
+		}
+	void getQuantities(float* quantityGrid) const; // Writes the current conserved quantities as interleaved (w, hu, hv) triples into the given grid
+	void getWaterLevel(float* waterGrid) const; // Writes the current water surface elevations into the given grid
+	};
+
+#endif
@@ -0,0 +1,608 @@
+/***********************************************************************
+WaterTableCPUTest - Regression test comparing the multithreaded and
+vectorized CPU water simulation engine against a scalar reference
+transcription of WaterTable2's GPU shaders on a synthetic flood
+scenario.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <iostream>
+#include <vector>
+#include <Math/Math.h>
+
+#include "WaterTableCPU.h"
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+inline float minimum(float a,float b) // Returns the smaller of two values, or the second one if they compare equal, like the GPU's min function
+	{
+	return a<b?a:b;
+	}
+
+inline float maximum(float a,float b) // Returns the larger of two values, or the second one if they compare equal, like the GPU's max function
+	{
+	return a>b?a:b;
+	}
+
+void createBathymetry(int width,int height,bool dig,std::vector<float>& bathymetry) // Creates a synthetic bathymetry grid of hills and valleys, optionally with a pit dug into it
+	{
+	bathymetry.resize(size_t(width-1)*size_t(height-1));
+	for(int y=0;y<height-1;++y)
+		for(int x=0;x<width-1;++x)
+			{
+			float e=float(x)*0.05f+3.0f*Math::sin(float(x)*0.11f)*Math::cos(float(y)*0.07f)+2.0f*Math::sin(float(x+y)*0.05f);
+			if(dig)
+				{
+				float dx=float(x-width/2);
+				float dy=float(y-height/2);
+				e-=4.0f*Math::max(1.0f-(dx*dx+dy*dy)/100.0f,0.0f);
+				}
+			bathymetry[y*(width-1)+x]=e;
+			}
+	}
+
+void printUsage(void)
+	{
+	std::cout<<"Usage: WaterTableCPUTest [-size <width> <height>] [-cellSize <cell width> <cell height>] [-steps <number of steps>] [-threads <number of threads>] [-elevationTolerance <elevation>] [-dischargeTolerance <discharge>] [-stepSizeTolerance <fraction>]"<<std::endl;
+	std::cout<<"  -size <width> <height>"<<std::endl;
+	std::cout<<"     Size of the simulation grid in cells. Default: 160 120"<<std::endl;
+	std::cout<<"  -cellSize <cell width> <cell height>"<<std::endl;
+	std::cout<<"     Size of each simulation grid cell. Default: 1 1"<<std::endl;
+	std::cout<<"  -steps <number of steps>"<<std::endl;
+	std::cout<<"     Number of simulation steps to compare. Default: 400"<<std::endl;
+	std::cout<<"  -threads <number of threads>"<<std::endl;
+	std::cout<<"     Runs the CPU engine on the given number of threads in addition to a single"<<std::endl;
+	std::cout<<"     thread; 0 uses all CPUs. Default: 0"<<std::endl;
+	std::cout<<"  -elevationTolerance <elevation>"<<std::endl;
+	std::cout<<"     Maximum accepted difference between water surface elevations and the"<<std::endl;
+	std::cout<<"     reference after any step. Default: 0.005"<<std::endl;
+	std::cout<<"  -dischargeTolerance <discharge>"<<std::endl;
+	std::cout<<"     Maximum accepted difference between partial discharges and the reference"<<std::endl;
+	std::cout<<"     after any step. Default: 0.05"<<std::endl;
+	std::cout<<"  -stepSizeTolerance <fraction>"<<std::endl;
+	std::cout<<"     Maximum accepted relative difference between step sizes and the"<<std::endl;
+	std::cout<<"     reference. Default: 0.001"<<std::endl;
+	std::cout<<"  The synthetic scenario breaks a dam on hilly terrain, rains on part of the"<<std::endl;
+	std::cout<<"  grid, and digs a pit into the terrain halfway through. Engines running on"<<std::endl;
+	std::cout<<"  different numbers of threads must produce identical results"<<std::endl;
+	}
+
+/**************
+Helper classes:
+**************/
+
+class ReferenceWaterTable // Class to simulate water flow one cell at a time, transcribed from the Water2 family of GPU shaders
+	{
+	/* Embedded classes: */
+	public:
+	struct Quantity // Structure for conserved quantities (w, hu, hv) of a single cell
+		{
+		/* Elements: */
+		public:
+		float q[3];
+		};
+	
+	/* Elements: */
+	private:
+	int size[2]; // Width and height of water table in cells
+	float cellSize[2]; // Width and height of water table cells
+	float theta; // Coefficient for minmod flux-limiting differential operator
+	float g; // Gravitiational acceleration constant
+	float epsilon; // Coefficient for desingularizing division operator
+	float attenuation; // Attenuation factor for partial discharges
+	float maxStepSize; // Maximum step size for each Runge-Kutta integration step
+	std::vector<float> bathymetry; // Vertex-centered bathymetry grid of size minus one
+	std::vector<Quantity> quantity; // Cell-centered conserved quantities
+	std::vector<Quantity> quantityStar; // Intermediate quantities of the Euler integration step
+	std::vector<Quantity> derivative; // Temporal derivative of the most recently processed quantities
+	
+	/* Private methods: */
+	float b(const std::vector<float>& bGrid,int x,int y) const // Samples a bathymetry grid like a clamped rectangle texture
+		{
+		x=x<0?0:(x>size[0]-2?size[0]-2:x);
+		y=y<0?0:(y>size[1]-2?size[1]-2:y);
+		return bGrid[y*(size[0]-1)+x];
+		}
+	float bCenter(const std::vector<float>& bGrid,int x,int y) const // Returns the bathymetry elevation at a cell center
+		{
+		return (b(bGrid,x-1,y-1)+b(bGrid,x,y-1)+b(bGrid,x-1,y)+b(bGrid,x,y))*0.25f;
+		}
+	const Quantity& q(const std::vector<Quantity>& qGrid,int x,int y) const // Samples a quantity grid like a clamped rectangle texture
+		{
+		x=x<0?0:(x>size[0]-1?size[0]-1:x);
+		y=y<0?0:(y>size[1]-1?size[1]-1:y);
+		return qGrid[y*size[0]+x];
+		}
+	Quantity calcSlope(const Quantity& q0,const Quantity& q1,const Quantity& q2,float cs,float b0,float b1) const;
+	void calcUv(Quantity& qf,float h,float uv[2]) const;
+	float calcPartialFlux(int direction,Quantity qe,Quantity qw,float bew,float cs,Quantity& flux) const;
+	float calcDerivative(const std::vector<Quantity>& qGrid); // Calculates the temporal derivative of the given quantities; returns maximum step size
+	
+	/* Constructors and destructors: */
+	public:
+	ReferenceWaterTable(int width,int height,const float sCellSize[2],float baseElevation);
+	
+	/* Methods: */
+	void setAttenuation(float newAttenuation)
+		{
+		attenuation=newAttenuation;
+		}
+	void setMaxStepSize(float newMaxStepSize)
+		{
+		maxStepSize=newMaxStepSize;
+		}
+	void updateBathymetry(const float* bathymetryGrid);
+	void setWaterLevel(const float* waterGrid);
+	float runSimulationStep(bool forceStepSize,bool dryBoundary);
+	void addWater(const float* waterGrid);
+	const Quantity& getQuantity(int x,int y) const
+		{
+		return quantity[y*size[0]+x];
+		}
+	};
+
+ReferenceWaterTable::Quantity ReferenceWaterTable::calcSlope(const ReferenceWaterTable::Quantity& q0,const ReferenceWaterTable::Quantity& q1,const ReferenceWaterTable::Quantity& q2,float cs,float b0,float b1) const
+	{
+	/* Calculate the minmod-limited slope: */
+	Quantity slope;
+	for(int i=0;i<3;++i)
+		{
+		float d01=(q1.q[i]-q0.q[i])*(theta/cs);
+		float d02=(q2.q[i]-q0.q[i])/(2.0f*cs);
+		float d12=(q2.q[i]-q1.q[i])*(theta/cs);
+		float dMin=minimum(minimum(d01,d02),d12);
+		float dMax=maximum(maximum(d01,d02),d12);
+		slope.q[i]=dMin>0.0f?dMin:dMax<0.0f?dMax:0.0f;
+		}
+	
+	/* Check the calculated slope against the left and right face-centered bathymetry values: */
+	if(q1.q[0]-slope.q[0]*cs*0.5f<b0)
+		slope.q[0]=(q1.q[0]-b0)/(cs*0.5f);
+	if(q1.q[0]+slope.q[0]*cs*0.5f<b1)
+		slope.q[0]=(b1-q1.q[0])/(cs*0.5f);
+	
+	return slope;
+	}
+
+void ReferenceWaterTable::calcUv(ReferenceWaterTable::Quantity& qf,float h,float uv[2]) const
+	{
+	/* Calculate velocity using a desingularizing division operator: */
+	float h4=h*h*h*h;
+	float factor=1.41421356237309f*h/Math::sqrt(h4+maximum(h4,epsilon));
+	
+	/* Recalculate discharge based on desingularized velocity: */
+	for(int i=0;i<2;++i)
+		{
+		uv[i]=qf.q[1+i]*factor;
+		qf.q[1+i]=uv[i]*h;
+		}
+	}
+
+float ReferenceWaterTable::calcPartialFlux(int direction,ReferenceWaterTable::Quantity qe,ReferenceWaterTable::Quantity qw,float bew,float cs,ReferenceWaterTable::Quantity& flux) const
+	{
+	/* Calculate one-sided water column heights: */
+	float he=maximum(qe.q[0]-bew,0.0f);
+	float hw=maximum(qw.q[0]-bew,0.0f);
+	
+	/* Calculate one-sided velocities: */
+	float uve[2],uvw[2];
+	calcUv(qe,he,uve);
+	calcUv(qw,hw,uvw);
+	
+	/* Calculate one-sided flux quadratures along the flux direction: */
+	Quantity fe,fw;
+	fe.q[0]=qe.q[1+direction];
+	fe.q[1]=uve[0]*qe.q[1+direction];
+	fe.q[2]=uve[1]*qe.q[1+direction];
+	fe.q[1+direction]+=0.5f*g*he*he;
+	fw.q[0]=qw.q[1+direction];
+	fw.q[1]=uvw[0]*qw.q[1+direction];
+	fw.q[2]=uvw[1]*qw.q[1+direction];
+	fw.q[1+direction]+=0.5f*g*hw*hw;
+	
+	/* Calculate one-sided local speeds of propagation: */
+	float sghe=Math::sqrt(g*he);
+	float sghw=Math::sqrt(g*hw);
+	float ae=minimum(minimum(uve[direction]-sghe,uvw[direction]-sghw),0.0f);
+	float aw=maximum(maximum(uve[direction]+sghe,uvw[direction]+sghw),0.0f);
+	
+	/* Calculate complete flux: */
+	for(int i=0;i<3;++i)
+		flux.q[i]=aw-ae!=0.0f?((fe.q[i]*aw-fw.q[i]*ae)+(qw.q[i]-qe.q[i])*(aw*ae))/(aw-ae):0.0f;
+	
+	/* Return maximum possible step size: */
+	return 0.5f*cs/maximum(-ae,aw);
+	}
+
+float ReferenceWaterTable::calcDerivative(const std::vector<ReferenceWaterTable::Quantity>& qGrid)
+	{
+	float stepSize=maxStepSize;
+	for(int y=0;y<size[1];++y)
+		for(int x=0;x<size[0];++x)
+			{
+			/* Calculate face-centered bathymetry elevations required for partial flux computations: */
+			float b00=b(bathymetry,x-1,y-1);
+			float b10=b(bathymetry,x,y-1);
+			float b01=b(bathymetry,x-1,y);
+			float b11=b(bathymetry,x,y);
+			float b0=(b(bathymetry,x-1,y-2)+b(bathymetry,x,y-2))*0.5f;
+			float b1=(b00+b10)*0.5f;
+			float b2=(b(bathymetry,x-2,y-1)+b(bathymetry,x-2,y))*0.5f;
+			float b3=(b00+b01)*0.5f;
+			float b4=(b10+b11)*0.5f;
+			float b5=(b(bathymetry,x+1,y-1)+b(bathymetry,x+1,y))*0.5f;
+			float b6=(b01+b11)*0.5f;
+			float b7=(b(bathymetry,x-1,y+1)+b(bathymetry,x,y+1))*0.5f;
+			
+			/* Get quantities required for partial flux computations: */
+			const Quantity& q1=q(qGrid,x,y-1);
+			const Quantity& q3=q(qGrid,x-1,y);
+			const Quantity& q4=q(qGrid,x,y);
+			const Quantity& q5=q(qGrid,x+1,y);
+			const Quantity& q7=q(qGrid,x,y+1);
+			
+			/* Calculate one-sided quantities required for partial flux computations: */
+			Quantity s1=calcSlope(q(qGrid,x,y-2),q1,q4,cellSize[1],b0,b1);
+			Quantity s3=calcSlope(q(qGrid,x-2,y),q3,q4,cellSize[0],b2,b3);
+			Quantity s4x=calcSlope(q3,q4,q5,cellSize[0],b3,b4);
+			Quantity s4y=calcSlope(q1,q4,q7,cellSize[1],b1,b6);
+			Quantity s5=calcSlope(q4,q5,q(qGrid,x+2,y),cellSize[0],b4,b5);
+			Quantity s7=calcSlope(q4,q7,q(qGrid,x,y+2),cellSize[1],b6,b7);
+			Quantity q1n,q3e,q4w,q4e,q4s,q4n,q5w,q7s;
+			for(int i=0;i<3;++i)
+				{
+				q1n.q[i]=q1.q[i]+s1.q[i]*(cellSize[1]*0.5f);
+				q3e.q[i]=q3.q[i]+s3.q[i]*(cellSize[0]*0.5f);
+				q4w.q[i]=q4.q[i]-s4x.q[i]*(cellSize[0]*0.5f);
+				q4e.q[i]=q4.q[i]+s4x.q[i]*(cellSize[0]*0.5f);
+				q4s.q[i]=q4.q[i]-s4y.q[i]*(cellSize[1]*0.5f);
+				q4n.q[i]=q4.q[i]+s4y.q[i]*(cellSize[1]*0.5f);
+				q5w.q[i]=q5.q[i]-s5.q[i]*(cellSize[0]*0.5f);
+				q7s.q[i]=q7.q[i]-s7.q[i]*(cellSize[1]*0.5f);
+				}
+			
+			/* Calculate partial fluxes across the cell's faces and the maximum possible step size for this cell: */
+			Quantity fluxXw,fluxXe,fluxYs,fluxYn;
+			stepSize=minimum(stepSize,calcPartialFlux(0,q3e,q4w,b3,cellSize[0],fluxXw));
+			stepSize=minimum(stepSize,calcPartialFlux(0,q4e,q5w,b4,cellSize[0],fluxXe));
+			stepSize=minimum(stepSize,calcPartialFlux(1,q1n,q4s,b1,cellSize[1],fluxYs));
+			stepSize=minimum(stepSize,calcPartialFlux(1,q4n,q7s,b6,cellSize[1],fluxYn));
+			
+			/* Calculate the water column height and the equation source terms at the cell center: */
+			float h=maximum(q4.q[0]-(b3+b4)*0.5f,0.0f);
+			float source[3];
+			source[0]=0.0f;
+			source[1]=-g*h*(b4-b3)/cellSize[0];
+			source[2]=-g*h*(b6-b1)/cellSize[1];
+			
+			/* Calculate the temporal derivative: */
+			Quantity& qt=derivative[y*size[0]+x];
+			for(int i=0;i<3;++i)
+				qt.q[i]=source[i]-(fluxXe.q[i]-fluxXw.q[i])/cellSize[0]-(fluxYn.q[i]-fluxYs.q[i])/cellSize[1];
+			}
+	
+	return stepSize;
+	}
+
+ReferenceWaterTable::ReferenceWaterTable(int width,int height,const float sCellSize[2],float baseElevation)
+	:theta(1.3f),g(9.81f),
+	 attenuation(127.0f/128.0f),maxStepSize(1.0f),
+	 bathymetry(size_t(width-1)*size_t(height-1),baseElevation),
+	 quantity(size_t(width)*size_t(height)),
+	 quantityStar(size_t(width)*size_t(height)),
+	 derivative(size_t(width)*size_t(height))
+	{
+	size[0]=width;
+	size[1]=height;
+	for(int i=0;i<2;++i)
+		cellSize[i]=sCellSize[i];
+	epsilon=0.01f*maximum(maximum(cellSize[0],cellSize[1]),1.0f);
+	
+	/* Fill the water table to the flat bathymetry: */
+	for(std::vector<Quantity>::iterator qIt=quantity.begin();qIt!=quantity.end();++qIt)
+		{
+		qIt->q[0]=baseElevation;
+		qIt->q[1]=qIt->q[2]=0.0f;
+		}
+	}
+
+void ReferenceWaterTable::updateBathymetry(const float* bathymetryGrid)
+	{
+	/* Keep the water column height of all cells constant: */
+	std::vector<float> newBathymetry(bathymetryGrid,bathymetryGrid+bathymetry.size());
+	for(int y=0;y<size[1];++y)
+		for(int x=0;x<size[0];++x)
+			{
+			Quantity& qc=quantity[y*size[0]+x];
+			qc.q[0]=maximum(qc.q[0]-bCenter(bathymetry,x,y),0.0f)+bCenter(newBathymetry,x,y);
+			}
+	bathymetry.swap(newBathymetry);
+	}
+
+void ReferenceWaterTable::setWaterLevel(const float* waterGrid)
+	{
+	/* Raise the water surface to the bathymetry and reset partial discharges: */
+	for(int y=0;y<size[1];++y)
+		for(int x=0;x<size[0];++x)
+			{
+			Quantity& qc=quantity[y*size[0]+x];
+			qc.q[0]=maximum(waterGrid[y*size[0]+x],bCenter(bathymetry,x,y));
+			qc.q[1]=qc.q[2]=0.0f;
+			}
+	}
+
+float ReferenceWaterTable::runSimulationStep(bool forceStepSize,bool dryBoundary)
+	{
+	/* Perform the tentative Euler integration step: */
+	float stepSize=calcDerivative(quantity);
+	if(forceStepSize)
+		stepSize=maxStepSize;
+	float stepAttenuation=Math::pow(attenuation,stepSize);
+	for(size_t i=0;i<quantity.size();++i)
+		{
+		quantityStar[i].q[0]=quantity[i].q[0]+derivative[i].q[0]*stepSize;
+		for(int j=1;j<3;++j)
+			quantityStar[i].q[j]=(quantity[i].q[j]+derivative[i].q[j]*stepSize)*stepAttenuation;
+		}
+	
+	/* Perform the final Runge-Kutta integration step: */
+	calcDerivative(quantityStar);
+	for(size_t i=0;i<quantity.size();++i)
+		{
+		quantity[i].q[0]=(quantity[i].q[0]+quantityStar[i].q[0]+derivative[i].q[0]*stepSize)*0.5f;
+		for(int j=1;j<3;++j)
+			quantity[i].q[j]=((quantity[i].q[j]+quantityStar[i].q[j]+derivative[i].q[j]*stepSize)*0.5f)*stepAttenuation;
+		}
+	
+	if(dryBoundary)
+		{
+		/* Set the outermost layer of cells to dry conditions: */
+		for(int y=0;y<size[1];++y)
+			for(int x=0;x<size[0];++x)
+				if(x==0||x==size[0]-1||y==0||y==size[1]-1)
+					{
+					Quantity& qc=quantity[y*size[0]+x];
+					qc.q[0]=bCenter(bathymetry,x,y);
+					qc.q[1]=qc.q[2]=0.0f;
+					}
+		}
+	
+	return stepSize;
+	}
+
+void ReferenceWaterTable::addWater(const float* waterGrid)
+	{
+	for(int y=0;y<size[1];++y)
+		for(int x=0;x<size[0];++x)
+			{
+			/* Calculate the old and new water column heights: */
+			Quantity& qc=quantity[y*size[0]+x];
+			float bc=bCenter(bathymetry,x,y);
+			float hOld=qc.q[0]-bc;
+			float hNew=maximum(hOld+waterGrid[y*size[0]+x],0.0f);
+			qc.q[0]=hNew+bc;
+			
+			/* New water is added with zero velocity; water is removed at current velocity: */
+			if(hNew==0.0f)
+				qc.q[1]=qc.q[2]=0.0f;
+			else if(hNew<hOld)
+				{
+				qc.q[1]*=hNew/hOld;
+				qc.q[2]*=hNew/hOld;
+				}
+			}
+	}
+
+}
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	int size[2]={160,120};
+	float cellSize[2]={1.0f,1.0f};
+	unsigned int numSteps=400;
+	unsigned int numThreads=0;
+	float elevationTolerance=0.005f;
+	float dischargeTolerance=0.05f;
+	float stepSizeTolerance=0.001f;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"size")==0)
+				{
+				if(i+2<argc)
+					{
+					for(int j=0;j<2;++j)
+						size[j]=atoi(argv[i+1+j]);
+					}
+				i+=2;
+				}
+			else if(strcasecmp(argv[i]+1,"cellSize")==0)
+				{
+				if(i+2<argc)
+					{
+					for(int j=0;j<2;++j)
+						cellSize[j]=float(atof(argv[i+1+j]));
+					}
+				i+=2;
+				}
+			else if(strcasecmp(argv[i]+1,"steps")==0)
+				{
+				++i;
+				if(i<argc)
+					numSteps=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"threads")==0)
+				{
+				++i;
+				if(i<argc)
+					numThreads=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"elevationTolerance")==0)
+				{
+				++i;
+				if(i<argc)
+					elevationTolerance=float(atof(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"dischargeTolerance")==0)
+				{
+				++i;
+				if(i<argc)
+					dischargeTolerance=float(atof(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"stepSizeTolerance")==0)
+				{
+				++i;
+				if(i<argc)
+					stepSizeTolerance=float(atof(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"h")==0)
+				{
+				printUsage();
+				return 0;
+				}
+			else
+				std::cerr<<"Ignoring unrecognized command line option "<<argv[i]<<std::endl;
+			}
+		else
+			std::cerr<<"Ignoring command line argument "<<argv[i]<<std::endl;
+		}
+	
+	try
+		{
+		/* Create the reference water table and CPU engines on one and the requested number of threads: */
+		ReferenceWaterTable reference(size[0],size[1],cellSize,0.0f);
+		WaterTableCPU engine1(size[0],size[1],cellSize,0.0f,1);
+		WaterTableCPU engineN(size[0],size[1],cellSize,0.0f,numThreads);
+		WaterTableCPU* engines[2]={&engine1,&engineN};
+		
+		/* Create the initial bathymetry and a dam holding back water in the western quarter of the grid: */
+		std::vector<float> bathymetry;
+		createBathymetry(size[0],size[1],false,bathymetry);
+		std::vector<float> waterLevel(size_t(size[0])*size_t(size[1]),-1.0e10f);
+		for(int y=0;y<size[1];++y)
+			for(int x=0;x<size[0]/4;++x)
+				waterLevel[y*size[0]+x]=6.0f;
+		reference.updateBathymetry(&bathymetry[0]);
+		reference.setWaterLevel(&waterLevel[0]);
+		for(int i=0;i<2;++i)
+			{
+			engines[i]->updateBathymetry(&bathymetry[0]);
+			engines[i]->setWaterLevel(&waterLevel[0]);
+			}
+		
+		/* Create a rain pattern over the eastern part of the grid: */
+		std::vector<float> rain(size_t(size[0])*size_t(size[1]),0.0f);
+		for(int y=size[1]/4;y<size[1]*3/4;++y)
+			for(int x=size[0]*5/8;x<size[0]*7/8;++x)
+				rain[y*size[0]+x]=0.02f;
+		
+		/* Run the scenario on all engines and compare the results after every step: */
+		float maxElevationDifference=0.0f;
+		float maxDischargeDifference=0.0f;
+		float maxStepSizeDifference=0.0f;
+		unsigned int numOutliers=0;
+		bool threadsIdentical=true;
+		std::vector<float> quantities[2];
+		for(int i=0;i<2;++i)
+			quantities[i].resize(size_t(size[0])*size_t(size[1])*3);
+		for(unsigned int step=0;step<numSteps;++step)
+			{
+			if(step==numSteps/2)
+				{
+				/* Dig a pit into the middle of the terrain: */
+				createBathymetry(size[0],size[1],true,bathymetry);
+				reference.updateBathymetry(&bathymetry[0]);
+				for(int i=0;i<2;++i)
+					engines[i]->updateBathymetry(&bathymetry[0]);
+				}
+			if(step%10==0)
+				{
+				reference.addWater(&rain[0]);
+				for(int i=0;i<2;++i)
+					engines[i]->addWater(&rain[0]);
+				}
+			
+			/* Run one simulation step: */
+			float referenceStepSize=reference.runSimulationStep(false,true);
+			float stepSizes[2];
+			for(int i=0;i<2;++i)
+				{
+				stepSizes[i]=engines[i]->runSimulationStep(false);
+				engines[i]->getQuantities(&quantities[i][0]);
+				}
+			
+			/* Compare the step sizes: */
+			float stepSizeDifference=Math::abs(stepSizes[0]-referenceStepSize)/referenceStepSize;
+			if(maxStepSizeDifference<stepSizeDifference)
+				maxStepSizeDifference=stepSizeDifference;
+			if(stepSizeDifference>stepSizeTolerance)
+				++numOutliers;
+			
+			/* Compare the conserved quantities: */
+			const float* qPtr=&quantities[0][0];
+			for(int y=0;y<size[1];++y)
+				for(int x=0;x<size[0];++x,qPtr+=3)
+					{
+					const ReferenceWaterTable::Quantity& rq=reference.getQuantity(x,y);
+					float elevationDifference=Math::abs(qPtr[0]-rq.q[0]);
+					float dischargeDifference=Math::max(Math::abs(qPtr[1]-rq.q[1]),Math::abs(qPtr[2]-rq.q[2]));
+					if(maxElevationDifference<elevationDifference)
+						maxElevationDifference=elevationDifference;
+					if(maxDischargeDifference<dischargeDifference)
+						maxDischargeDifference=dischargeDifference;
+					if(elevationDifference>elevationTolerance||dischargeDifference>dischargeTolerance)
+						++numOutliers;
+					}
+			
+			/* Check that the engine's results do not depend on the number of threads: */
+			if(stepSizes[1]!=stepSizes[0]||memcmp(&quantities[1][0],&quantities[0][0],quantities[0].size()*sizeof(float))!=0)
+				threadsIdentical=false;
+			}
+		
+		/* Print the results: */
+		std::cout<<"Compared "<<numSteps<<" steps on a "<<size[0]<<" x "<<size[1]<<" grid against the reference"<<std::endl;
+		std::cout<<"  Max elevation difference: "<<maxElevationDifference<<", max discharge difference: "<<maxDischargeDifference<<std::endl;
+		std::cout<<"  Max relative step size difference: "<<maxStepSizeDifference<<std::endl;
+		std::cout<<"  Results on 1 and "<<engineN.getNumThreads()<<" thread(s) are "<<(threadsIdentical?"identical":"different")<<std::endl;
+		int result=0;
+		if(numOutliers!=0||!threadsIdentical)
+			{
+			std::cout<<"  FAILED: "<<numOutliers<<" cells or steps exceed the tolerance"<<std::endl;
+			result=1;
+			}
+		else
+			std::cout<<"  Passed"<<std::endl;
+		
+		return result;
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"Test failed due to exception "<<err.what()<<std::endl;
+		return 1;
+		}
+	}
@@ -0,0 +1,88 @@
+/***********************************************************************
+GLARBOcclusionQuery - OpenGL extension class for the
+GL_ARB_occlusion_query extension.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the OpenGL Support Library (GLSupport).
+
+The OpenGL Support Library is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The OpenGL Support Library is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the OpenGL Support Library; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include <GL/Extensions/GLARBOcclusionQuery.h>
+
+#include <GL/gl.h>
+#include <GL/GLContextData.h>
+#include <GL/GLExtensionManager.h>
+
+/********************************************
+Static elements of class GLARBOcclusionQuery:
+********************************************/
+
+GL_THREAD_LOCAL(GLARBOcclusionQuery*) GLARBOcclusionQuery::current=0;
+const char* GLARBOcclusionQuery::name="GL_ARB_occlusion_query";
+
+/************************************
+Methods of class GLARBOcclusionQuery:
+************************************/
+
+GLARBOcclusionQuery::GLARBOcclusionQuery(void)
+	:glGenQueriesARBProc(GLExtensionManager::getFunction<PFNGLGENQUERIESARBPROC>("glGenQueriesARB")),
+	 glDeleteQueriesARBProc(GLExtensionManager::getFunction<PFNGLDELETEQUERIESARBPROC>("glDeleteQueriesARB")),
+	 glIsQueryARBProc(GLExtensionManager::getFunction<PFNGLISQUERYARBPROC>("glIsQueryARB")),
+	 glBeginQueryARBProc(GLExtensionManager::getFunction<PFNGLBEGINQUERYARBPROC>("glBeginQueryARB")),
+	 glEndQueryARBProc(GLExtensionManager::getFunction<PFNGLENDQUERYARBPROC>("glEndQueryARB")),
+	 glGetQueryivARBProc(GLExtensionManager::getFunction<PFNGLGETQUERYIVARBPROC>("glGetQueryivARB")),
+	 glGetQueryObjectivARBProc(GLExtensionManager::getFunction<PFNGLGETQUERYOBJECTIVARBPROC>("glGetQueryObjectivARB")),
+	 glGetQueryObjectuivARBProc(GLExtensionManager::getFunction<PFNGLGETQUERYOBJECTUIVARBPROC>("glGetQueryObjectuivARB"))
+	{
+	}
+
+GLARBOcclusionQuery::~GLARBOcclusionQuery(void)
+	{
+	}
+
+const char* GLARBOcclusionQuery::getExtensionName(void) const
+	{
+	return name;
+	}
+
+void GLARBOcclusionQuery::activate(void)
+	{
+	current=this;
+	}
+
+void GLARBOcclusionQuery::deactivate(void)
+	{
+	current=0;
+	}
+
+bool GLARBOcclusionQuery::isSupported(void)
+	{
+	/* Ask the current extension manager whether the extension is supported in the current OpenGL context: */
+	return GLExtensionManager::isExtensionSupported(name);
+	}
+
+void GLARBOcclusionQuery::initExtension(void)
+	{
+	/* Check if the extension is already initialized: */
+	if(!GLExtensionManager::isExtensionRegistered(name))
+		{
+		/* Create a new extension object: */
+		GLARBOcclusionQuery* newExtension=new GLARBOcclusionQuery;
+		
+		/* Register the extension with the current extension manager: */
+		GLExtensionManager::registerExtension(newExtension);
+		}
+	}
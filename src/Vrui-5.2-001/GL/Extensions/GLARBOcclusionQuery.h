@@ -0,0 +1,134 @@
+/***********************************************************************
+GLARBOcclusionQuery - OpenGL extension class for the
+GL_ARB_occlusion_query extension.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the OpenGL Support Library (GLSupport).
+
+The OpenGL Support Library is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The OpenGL Support Library is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the OpenGL Support Library; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef GLEXTENSIONS_GLARBOCCLUSIONQUERY_INCLUDED
+#define GLEXTENSIONS_GLARBOCCLUSIONQUERY_INCLUDED
+
+#include <GL/gl.h>
+#include <GL/TLSHelper.h>
+#include <GL/Extensions/GLExtension.h>
+
+/********************************
+Extension-specific parts of gl.h:
+********************************/
+
+#ifndef GL_ARB_occlusion_query
+#define GL_ARB_occlusion_query 1
+
+/* Extension-specific functions: */
+typedef void (APIENTRY * PFNGLGENQUERIESARBPROC)(GLsizei n, GLuint* ids);
+typedef void (APIENTRY * PFNGLDELETEQUERIESARBPROC)(GLsizei n, const GLuint* ids);
+typedef GLboolean (APIENTRY * PFNGLISQUERYARBPROC)(GLuint id);
+typedef void (APIENTRY * PFNGLBEGINQUERYARBPROC)(GLenum target, GLuint id);
+typedef void (APIENTRY * PFNGLENDQUERYARBPROC)(GLenum target);
+typedef void (APIENTRY * PFNGLGETQUERYIVARBPROC)(GLenum target, GLenum pname, GLint* params);
+typedef void (APIENTRY * PFNGLGETQUERYOBJECTIVARBPROC)(GLuint id, GLenum pname, GLint* params);
+typedef void (APIENTRY * PFNGLGETQUERYOBJECTUIVARBPROC)(GLuint id, GLenum pname, GLuint* params);
+
+/* Extension-specific constants: */
+#define GL_QUERY_COUNTER_BITS_ARB               0x8864
+#define GL_CURRENT_QUERY_ARB                    0x8865
+#define GL_QUERY_RESULT_ARB                     0x8866
+#define GL_QUERY_RESULT_AVAILABLE_ARB           0x8867
+#define GL_SAMPLES_PASSED_ARB                   0x8914
+
+#endif
+
+/* Forward declarations of friend functions: */
+void glGenQueriesARB(GLsizei n,GLuint* ids);
+void glDeleteQueriesARB(GLsizei n,const GLuint* ids);
+GLboolean glIsQueryARB(GLuint id);
+void glBeginQueryARB(GLenum target,GLuint id);
+void glEndQueryARB(GLenum target);
+void glGetQueryivARB(GLenum target,GLenum pname,GLint* params);
+void glGetQueryObjectivARB(GLuint id,GLenum pname,GLint* params);
+void glGetQueryObjectuivARB(GLuint id,GLenum pname,GLuint* params);
+
+class GLARBOcclusionQuery:public GLExtension
+	{
+	/* Elements: */
+	private:
+	static GL_THREAD_LOCAL(GLARBOcclusionQuery*) current; // Pointer to extension object for current OpenGL context
+	static const char* name; // Extension name
+	PFNGLGENQUERIESARBPROC glGenQueriesARBProc;
+	PFNGLDELETEQUERIESARBPROC glDeleteQueriesARBProc;
+	PFNGLISQUERYARBPROC glIsQueryARBProc;
+	PFNGLBEGINQUERYARBPROC glBeginQueryARBProc;
+	PFNGLENDQUERYARBPROC glEndQueryARBProc;
+	PFNGLGETQUERYIVARBPROC glGetQueryivARBProc;
+	PFNGLGETQUERYOBJECTIVARBPROC glGetQueryObjectivARBProc;
+	PFNGLGETQUERYOBJECTUIVARBPROC glGetQueryObjectuivARBProc;
+	
+	/* Constructors and destructors: */
+	private:
+	GLARBOcclusionQuery(void);
+	public:
+	virtual ~GLARBOcclusionQuery(void);
+	
+	/* Methods: */
+	public:
+	virtual const char* getExtensionName(void) const;
+	virtual void activate(void);
+	virtual void deactivate(void);
+	static bool isSupported(void); // Returns true if the extension is supported in the current OpenGL context
+	static void initExtension(void); // Initializes the extension in the current OpenGL context
+	
+	/* Extension entry points: */
+	inline friend void glGenQueriesARB(GLsizei n,GLuint* ids)
+		{
+		GLARBOcclusionQuery::current->glGenQueriesARBProc(n,ids);
+		}
+	inline friend void glDeleteQueriesARB(GLsizei n,const GLuint* ids)
+		{
+		GLARBOcclusionQuery::current->glDeleteQueriesARBProc(n,ids);
+		}
+	inline friend GLboolean glIsQueryARB(GLuint id)
+		{
+		return GLARBOcclusionQuery::current->glIsQueryARBProc(id);
+		}
+	inline friend void glBeginQueryARB(GLenum target,GLuint id)
+		{
+		GLARBOcclusionQuery::current->glBeginQueryARBProc(target,id);
+		}
+	inline friend void glEndQueryARB(GLenum target)
+		{
+		GLARBOcclusionQuery::current->glEndQueryARBProc(target);
+		}
+	inline friend void glGetQueryivARB(GLenum target,GLenum pname,GLint* params)
+		{
+		GLARBOcclusionQuery::current->glGetQueryivARBProc(target,pname,params);
+		}
+	inline friend void glGetQueryObjectivARB(GLuint id,GLenum pname,GLint* params)
+		{
+		GLARBOcclusionQuery::current->glGetQueryObjectivARBProc(id,pname,params);
+		}
+	inline friend void glGetQueryObjectuivARB(GLuint id,GLenum pname,GLuint* params)
+		{
+		GLARBOcclusionQuery::current->glGetQueryObjectuivARBProc(id,pname,params);
+		}
+	};
+
+/*******************************
+Extension-specific entry points:
+*******************************/
+
+#endif
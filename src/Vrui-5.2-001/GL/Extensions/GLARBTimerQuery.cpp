@@ -0,0 +1,83 @@
+/***********************************************************************
+GLARBTimerQuery - OpenGL extension class for the
+GL_ARB_timer_query extension.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the OpenGL Support Library (GLSupport).
+
+The OpenGL Support Library is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The OpenGL Support Library is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the OpenGL Support Library; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include <GL/Extensions/GLARBTimerQuery.h>
+
+#include <GL/gl.h>
+#include <GL/GLContextData.h>
+#include <GL/GLExtensionManager.h>
+
+/****************************************
+Static elements of class GLARBTimerQuery:
+****************************************/
+
+GL_THREAD_LOCAL(GLARBTimerQuery*) GLARBTimerQuery::current=0;
+const char* GLARBTimerQuery::name="GL_ARB_timer_query";
+
+/********************************
+Methods of class GLARBTimerQuery:
+********************************/
+
+GLARBTimerQuery::GLARBTimerQuery(void)
+	:glQueryCounterProc(GLExtensionManager::getFunction<PFNGLQUERYCOUNTERPROC>("glQueryCounter")),
+	 glGetQueryObjecti64vProc(GLExtensionManager::getFunction<PFNGLGETQUERYOBJECTI64VPROC>("glGetQueryObjecti64v")),
+	 glGetQueryObjectui64vProc(GLExtensionManager::getFunction<PFNGLGETQUERYOBJECTUI64VPROC>("glGetQueryObjectui64v"))
+	{
+	}
+
+GLARBTimerQuery::~GLARBTimerQuery(void)
+	{
+	}
+
+const char* GLARBTimerQuery::getExtensionName(void) const
+	{
+	return name;
+	}
+
+void GLARBTimerQuery::activate(void)
+	{
+	current=this;
+	}
+
+void GLARBTimerQuery::deactivate(void)
+	{
+	current=0;
+	}
+
+bool GLARBTimerQuery::isSupported(void)
+	{
+	/* Ask the current extension manager whether the extension is supported in the current OpenGL context: */
+	return GLExtensionManager::isExtensionSupported(name);
+	}
+
+void GLARBTimerQuery::initExtension(void)
+	{
+	/* Check if the extension is already initialized: */
+	if(!GLExtensionManager::isExtensionRegistered(name))
+		{
+		/* Create a new extension object: */
+		GLARBTimerQuery* newExtension=new GLARBTimerQuery;
+		
+		/* Register the extension with the current extension manager: */
+		GLExtensionManager::registerExtension(newExtension);
+		}
+	}
@@ -0,0 +1,48 @@
+/***********************************************************************
+BandExecutor - Abstract base class for objects that process the bands of
+a parallel job, for example on a pool of worker threads owned by the
+caller, so that image processing algorithms can share thread pools with
+their callers.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Image Handling Library (Images).
+
+The Image Handling Library is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Image Handling Library is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Image Handling Library; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef IMAGES_BANDEXECUTOR_INCLUDED
+#define IMAGES_BANDEXECUTOR_INCLUDED
+
+namespace Images {
+
+class BandExecutor // Abstract base class for objects processing the bands of a job in parallel on behalf of image processing algorithms
+	{
+	/* Embedded classes: */
+	public:
+	typedef void (*BandFunction)(unsigned int bandIndex,void* userData); // Type for functions processing a single band of a job
+	
+	/* Constructors and destructors: */
+	virtual ~BandExecutor(void)
+		{
+		}
+	
+	/* Methods: */
+	virtual unsigned int getNumThreads(void) const =0; // Returns the number of threads processing bands in parallel
+	virtual void executeBands(unsigned int numBands,BandFunction bandFunction,void* bandFunctionUserData) =0; // Calls the given band function for band indices 0 to numBands-1 in parallel; returns when all bands are complete
+	};
+
+}
+
+#endif
@@ -0,0 +1,155 @@
+/***********************************************************************
+BlobLabeler - Class to find connected sets of "foreground" pixels in
+images of arbitrary pixel types by labeling bands of image rows in
+parallel on a caller-supplied band executor and merging blobs across the
+seams between bands, reusing its internal buffers between images.
+Copyright (c) 2020 Oliver Kreylos
+
+This file is part of the Image Handling Library (Images).
+
+The Image Handling Library is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Image Handling Library is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Image Handling Library; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef IMAGES_BLOBLABELER_INCLUDED
+#define IMAGES_BLOBLABELER_INCLUDED
+
+#include <stddef.h>
+#include <vector>
+#include <Images/BandExecutor.h>
+
+namespace Images {
+
+template <class BlobParam>
+class BlobLabeler
+	{
+	/* Embedded classes: */
+	public:
+	typedef BlobParam Blob; // Type of extracted blobs
+	typedef typename BlobParam::Pixel Pixel; // Data type for image pixels
+	typedef typename BlobParam::Creator Creator; // Helper structure to create and modify blobs
+	
+	struct Span:public BlobParam // Structure for horizontal runs of foreground pixels; root spans accumulate the properties of their entire blobs
+		{
+		/* Elements: */
+		public:
+		unsigned int y; // Image row containing the span
+		unsigned int x1,x2; // Half-open range of image columns covered by the span
+		unsigned int parent; // Index of the span's parent span; after labeling, index of the span's root span
+		
+		/* Constructors and destructors: */
+		Span(unsigned int sX,unsigned int sY,const Pixel& pixel,const Creator& creator)
+			:BlobParam(sX,sY,pixel,creator),
+			 y(sY),x1(sX)
+			{
+			}
+		};
+	
+	private:
+	struct Band // Structure for bands of image rows labeled by a single thread
+		{
+		/* Elements: */
+		public:
+		unsigned int rowBegin,rowEnd; // Half-open range of image rows covered by the band
+		std::vector<Span> spans; // Spans extracted from the band, with parent indices local to the band
+		};
+	
+	struct NoMergeChecker // Tag structure to label 8-connected blobs without checking whether neighboring pixels can be merged
+		{
+		};
+	
+	template <class PixelParam,class ForegroundSelectorParam,class MergeCheckerParam>
+	struct LabelJob; // Structure passing the parameters of a labeling operation to the worker threads
+	
+	/* Elements: */
+	static const unsigned int minBandRows=32; // Minimum number of image rows in a band
+	BandExecutor* bandExecutor; // Executor labeling bands of image rows in parallel; labels in the calling thread if null
+	unsigned int imageSize[2]; // Size of the most recently labeled image
+	std::vector<Band> bands; // Bands of the most recently labeled image
+	std::vector<Span> spans; // Spans of the most recently labeled image in row-major order
+	
+	/* Private methods: */
+	template <class PixelParam,class MergeCheckerParam>
+	static bool canMergeInRow(const MergeCheckerParam& mergeChecker,unsigned int x,unsigned int y,const PixelParam* imagePtr) // Checks whether a foreground pixel can be merged with its foreground left neighbor
+		{
+		return mergeChecker(x-1,y,imagePtr[-1],x,y,*imagePtr);
+		}
+	template <class PixelParam>
+	static bool canMergeInRow(const NoMergeChecker& mergeChecker,unsigned int x,unsigned int y,const PixelParam* imagePtr) // Neighboring foreground pixels in a row always belong to the same 8-connected blob
+		{
+		return true;
+		}
+	template <class PixelParam,class MergeCheckerParam>
+	static bool canMergeSpans(const MergeCheckerParam& mergeChecker,const unsigned int size[2],const PixelParam* image,unsigned int y,const Span& span1,const Span& span2); // Checks whether the given spans in rows y-1 and y contain at least one pair of vertically adjacent mergeable pixels
+	template <class PixelParam>
+	static bool canMergeSpans(const NoMergeChecker& mergeChecker,const unsigned int size[2],const PixelParam* image,unsigned int y,const Span& span1,const Span& span2) // Touching spans in adjacent rows always belong to the same 8-connected blob
+		{
+		return true;
+		}
+	template <class PixelParam,class ForegroundSelectorParam,class MergeCheckerParam>
+	void labelBand(unsigned int rowBegin,unsigned int rowEnd,const unsigned int size[2],const PixelParam* image,const ForegroundSelectorParam& foregroundSelector,const MergeCheckerParam& mergeChecker,const Creator& blobCreator,std::vector<Span>& bandSpans); // Extracts and merges spans from the given band of image rows
+	unsigned int findRoot(unsigned int spanIndex) const // Returns the index of the root span of the given span's blob
+		{
+		while(spanIndex!=spans[spanIndex].parent)
+			spanIndex=spans[spanIndex].parent;
+		return spanIndex;
+		}
+	template <class PixelParam,class ForegroundSelectorParam,class MergeCheckerParam>
+	void label(const unsigned int size[2],const PixelParam* image,const ForegroundSelectorParam& foregroundSelector,const MergeCheckerParam& mergeChecker,const Creator& blobCreator); // Labels the given image in parallel bands and merges blobs across band seams
+	
+	/* Constructors and destructors: */
+	public:
+	BlobLabeler(BandExecutor* sBandExecutor =0) // Creates a blob labeler labeling bands on the given band executor, which must outlive the labeler; labels in the calling thread if null
+		:bandExecutor(sBandExecutor)
+		{
+		imageSize[0]=imageSize[1]=0;
+		}
+	
+	/* Methods: */
+	unsigned int getNumThreads(void) const // Returns the number of threads labeling bands
+		{
+		return bandExecutor!=0?bandExecutor->getNumThreads():1U;
+		}
+	void setBandExecutor(BandExecutor* newBandExecutor) // Sets the band executor for subsequent images; labels in the calling thread if null
+		{
+		bandExecutor=newBandExecutor;
+		}
+	template <class PixelParam,class ForegroundSelectorParam>
+	void labelBlobs(const unsigned int size[2],const PixelParam* image,const ForegroundSelectorParam& foregroundSelector,const Creator& blobCreator) // Labels all 8-connected blobs of foreground pixels in the given image
+		{
+		label(size,image,foregroundSelector,NoMergeChecker(),blobCreator);
+		}
+	template <class PixelParam,class ForegroundSelectorParam,class MergeCheckerParam>
+	void labelBlobs(const unsigned int size[2],const PixelParam* image,const ForegroundSelectorParam& foregroundSelector,const MergeCheckerParam& mergeChecker,const Creator& blobCreator) // Labels all 4-connected blobs of foreground pixels whose neighboring pixels are accepted by the given merge checker
+		{
+		label(size,image,foregroundSelector,mergeChecker,blobCreator);
+		}
+	size_t getNumSpans(void) const // Returns the number of spans in the most recently labeled image
+		{
+		return spans.size();
+		}
+	const Span& getSpan(size_t spanIndex) const // Returns the span of the given index; spans are in row-major order, and a span is the root of its blob if its parent is the span itself
+		{
+		return spans[spanIndex];
+		}
+	void getBlobs(std::vector<BlobParam>& blobs,unsigned int* blobIdImage =0); // Appends the blobs of the most recently labeled image to the given list and assigns consecutive blob IDs; if blobIdImage is !=0, creates per-pixel blob ID array
+	};
+
+}
+
+#ifndef IMAGES_BLOBLABELER_IMPLEMENTATION
+#include <Images/BlobLabeler.icpp>
+#endif
+
+#endif